@@ -3013,7 +3013,7 @@ PDFAnnotationDefaultAppearance PDFAnnotationDefaultAppearance::parse(const QByte
         if (token.type == PDFLexicalAnalyzer::TokenType::Real ||
             token.type == PDFLexicalAnalyzer::TokenType::Integer)
         {
-            return token.data.toDouble();
+            return token.getReal();
         }
 
         return 0.0;
@@ -3024,7 +3024,7 @@ PDFAnnotationDefaultAppearance PDFAnnotationDefaultAppearance::parse(const QByte
         const PDFLexicalAnalyzer::Token& token = tokens[i];
         if (token.type == PDFLexicalAnalyzer::TokenType::Command)
         {
-            QByteArray command = token.data.toByteArray();
+            QByteArrayView command = token.getStringView();
             if (command == "Tf")
             {
                 if (i >= 1)
@@ -3033,7 +3033,7 @@ PDFAnnotationDefaultAppearance PDFAnnotationDefaultAppearance::parse(const QByte
                 }
                 if (i >= 2)
                 {
-                    result.m_fontName = tokens[i - 2].data.toByteArray();
+                    result.m_fontName = tokens[i - 2].getString();
                 }
             }
             else if (command == "g" && i >= 1)
@@ -0,0 +1,98 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pdfbyterangesource.h"
+#include "pdfexception.h"
+#include "pdfdbgheap.h"
+
+namespace pdf
+{
+
+QByteArray PDFByteRangeSource::read(PDFInteger offset, PDFInteger length) const
+{
+    const PDFInteger size = getSize();
+    offset = qBound(PDFInteger(0), offset, size);
+    length = qBound(PDFInteger(0), length, size - offset);
+
+    if (length == 0)
+    {
+        return QByteArray();
+    }
+
+    QByteArray data = readData(offset, length);
+    m_bytesRead.fetch_add(data.size(), std::memory_order_relaxed);
+
+    // Range is clamped to the source data, so short read is always an error. Callers
+    // are enlarging the range, until data can be parsed, so we must not return
+    // fewer bytes, otherwise they would never reach the end of the source data.
+    if (data.size() != length)
+    {
+        throw PDFException(PDFTranslationContext::tr("Can't read %1 bytes at offset %2 from the source data.").arg(length).arg(offset));
+    }
+
+    return data;
+}
+
+PDFByteArrayRangeSource::PDFByteArrayRangeSource(QByteArray data, std::shared_ptr<QFile> mappedFile) :
+    m_data(qMove(data)),
+    m_mappedFile(qMove(mappedFile))
+{
+
+}
+
+QByteArray PDFByteArrayRangeSource::readData(PDFInteger offset, PDFInteger length) const
+{
+    // Data are owned by this source, which outlives the parsing
+    // of the returned data, so we can avoid copying.
+    return QByteArray::fromRawData(m_data.constData() + offset, length);
+}
+
+PDFIODeviceRangeSource::PDFIODeviceRangeSource(std::unique_ptr<QIODevice> device) :
+    m_device(qMove(device))
+{
+    Q_ASSERT(m_device);
+    Q_ASSERT(m_device->isReadable());
+    Q_ASSERT(!m_device->isSequential());
+
+    m_size = m_device->size();
+}
+
+QByteArray PDFIODeviceRangeSource::readData(PDFInteger offset, PDFInteger length) const
+{
+    QMutexLocker lock(&m_mutex);
+
+    if (!m_device->seek(offset))
+    {
+        return QByteArray();
+    }
+
+    return m_device->read(length);
+}
+
+PDFCallbackRangeSource::PDFCallbackRangeSource(PDFInteger size, ReadFunction readFunction) :
+    m_size(size),
+    m_readFunction(qMove(readFunction))
+{
+
+}
+
+QByteArray PDFCallbackRangeSource::readData(PDFInteger offset, PDFInteger length) const
+{
+    return m_readFunction(offset, length);
+}
+
+}   // namespace pdf
@@ -0,0 +1,136 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef PDFBYTERANGESOURCE_H
+#define PDFBYTERANGESOURCE_H
+
+#include "pdfglobal.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QIODevice>
+#include <QByteArray>
+
+#include <atomic>
+#include <memory>
+#include <functional>
+
+namespace pdf
+{
+
+/// Source of the document data, from which byte ranges are read on demand.
+/// It is used, when document is opened with lazy loading, so only parts
+/// of the document, which are really needed, are read. Reading must be thread safe.
+class PDF4QTLIBSHARED_EXPORT PDFByteRangeSource
+{
+public:
+    explicit inline PDFByteRangeSource() = default;
+    virtual ~PDFByteRangeSource() = default;
+
+    PDFByteRangeSource(const PDFByteRangeSource&) = delete;
+    PDFByteRangeSource& operator=(const PDFByteRangeSource&) = delete;
+
+    /// Returns size of the source data in bytes
+    virtual PDFInteger getSize() const = 0;
+
+    /// Reads byte range from the source. If range exceeds the source data,
+    /// then it is clamped. If data can't be read (read fails, or fewer bytes
+    /// than requested are returned), then exception is thrown.
+    /// \param offset Offset of the first byte
+    /// \param length Number of bytes to be read
+    QByteArray read(PDFInteger offset, PDFInteger length) const;
+
+    /// Returns total number of bytes read from the source
+    PDFInteger getBytesRead() const { return m_bytesRead.load(std::memory_order_relaxed); }
+
+protected:
+    /// Reads byte range from the source. Range is always valid.
+    /// \param offset Offset of the first byte
+    /// \param length Number of bytes to be read
+    virtual QByteArray readData(PDFInteger offset, PDFInteger length) const = 0;
+
+private:
+    mutable std::atomic<PDFInteger> m_bytesRead = 0;
+};
+
+using PDFByteRangeSourcePointer = std::shared_ptr<const PDFByteRangeSource>;
+
+/// Byte range source over byte array. Byte array can also contain memory mapped file,
+/// in that case, file is owned by this source, so memory stays mapped, while
+/// the source exists. Data are not copied, when they are read.
+class PDF4QTLIBSHARED_EXPORT PDFByteArrayRangeSource : public PDFByteRangeSource
+{
+public:
+    explicit PDFByteArrayRangeSource(QByteArray data, std::shared_ptr<QFile> mappedFile = nullptr);
+
+    virtual PDFInteger getSize() const override { return m_data.size(); }
+
+    /// Returns whole data of the source
+    const QByteArray& getData() const { return m_data; }
+
+protected:
+    virtual QByteArray readData(PDFInteger offset, PDFInteger length) const override;
+
+private:
+    QByteArray m_data;
+    std::shared_ptr<QFile> m_mappedFile;
+};
+
+/// Byte range source reading from random access device. Device is owned
+/// by this source and it must be opened for reading.
+class PDF4QTLIBSHARED_EXPORT PDFIODeviceRangeSource : public PDFByteRangeSource
+{
+public:
+    explicit PDFIODeviceRangeSource(std::unique_ptr<QIODevice> device);
+
+    virtual PDFInteger getSize() const override { return m_size; }
+
+protected:
+    virtual QByteArray readData(PDFInteger offset, PDFInteger length) const override;
+
+private:
+    mutable QMutex m_mutex;
+    std::unique_ptr<QIODevice> m_device;
+    PDFInteger m_size = 0;
+};
+
+/// Byte range source, which reads data using callback function. It can
+/// be used for remote documents, for example, callback can issue
+/// HTTP range requests.
+class PDF4QTLIBSHARED_EXPORT PDFCallbackRangeSource : public PDFByteRangeSource
+{
+public:
+    using ReadFunction = std::function<QByteArray(PDFInteger, PDFInteger)>;
+
+    /// Creates callback byte range source
+    /// \param size Size of the source data
+    /// \param readFunction Thread safe function reading data (offset, length)
+    explicit PDFCallbackRangeSource(PDFInteger size, ReadFunction readFunction);
+
+    virtual PDFInteger getSize() const override { return m_size; }
+
+protected:
+    virtual QByteArray readData(PDFInteger offset, PDFInteger length) const override;
+
+private:
+    PDFInteger m_size = 0;
+    ReadFunction m_readFunction;
+};
+
+}   // namespace pdf
+
+#endif // PDFBYTERANGESOURCE_H
@@ -693,4 +693,143 @@ CCITT_2D_Code_Mode PDFCCITTFaxDecoder::get2DMode()
     throw PDFException(PDFTranslationContext::tr("Invalid CCITT 2D mode."));
 }
 
+QByteArray PDFCCITTFaxEncoder::encode(const PDFImageData& imageData)
+{
+    Q_ASSERT(imageData.getComponents() == 1);
+    Q_ASSERT(imageData.getBitsPerComponent() == 1);
+
+    const int columns = static_cast<int>(imageData.getWidth());
+    const unsigned int rows = imageData.getHeight();
+
+    PDFBitWriter writer(1);
+    writer.reserve(static_cast<int>(imageData.getStride() * rows / 8));
+
+    // Lines are represented by changing elements (column indices, where color
+    // of the pixel changes). Changing elements with even index are changes to black,
+    // odd indices are changes to white. Lines are terminated by sentinels (three
+    // sentinels are used, so b2 is always valid). Reference line of the first
+    // coding line is imaginary white line.
+    std::vector<int> referenceLine(3, columns);
+    std::vector<int> codingLine;
+    codingLine.reserve(columns + 3);
+
+    for (unsigned int row = 0; row < rows; ++row)
+    {
+        const unsigned char* rowData = imageData.getRow(row);
+
+        codingLine.clear();
+        bool isBlack = false;
+        for (int i = 0; i < columns; ++i)
+        {
+            const bool isPixelBlack = (rowData[i / 8] & (0x80 >> (i % 8))) == 0;
+            if (isPixelBlack != isBlack)
+            {
+                codingLine.push_back(i);
+                isBlack = isPixelBlack;
+            }
+        }
+        codingLine.insert(codingLine.end(), 3, columns);
+
+        // Imaginary changing element a0 is placed before the first pixel of the line
+        int a0 = -1;
+        bool isCurrentPixelBlack = false;
+        size_t a1_index = 0;
+        size_t b1_index = 0;
+
+        while (a0 < columns)
+        {
+            while (codingLine[a1_index] <= a0)
+            {
+                ++a1_index;
+            }
+
+            // b1 is first changing element on the reference line right of a0,
+            // which has opposite color than a0. As a0 can move backward against
+            // b1 (vertical mode with negative offset), we must also step back.
+            while (b1_index > 0 && referenceLine[b1_index - 1] > a0)
+            {
+                --b1_index;
+            }
+            while (referenceLine[b1_index] <= a0 || (b1_index % 2 == 1) != isCurrentPixelBlack)
+            {
+                ++b1_index;
+            }
+
+            const int a1 = codingLine[a1_index];
+            const int a2 = codingLine[a1_index + 1];
+            const int b1 = referenceLine[b1_index];
+            const int b2 = referenceLine[b1_index + 1];
+
+            if (b2 < a1)
+            {
+                write2DMode(writer, Pass);
+                a0 = b2;
+            }
+            else if (std::abs(a1 - b1) <= 3)
+            {
+                write2DMode(writer, static_cast<CCITT_2D_Code_Mode>(Vertical_0 + a1 - b1));
+                a0 = a1;
+                isCurrentPixelBlack = !isCurrentPixelBlack;
+            }
+            else
+            {
+                write2DMode(writer, Horizontal);
+                writeRunLength(writer, a1 - qMax(a0, 0), isCurrentPixelBlack);
+                writeRunLength(writer, a2 - a1, !isCurrentPixelBlack);
+                a0 = a2;
+            }
+        }
+
+        std::swap(codingLine, referenceLine);
+    }
+
+    // End of facsimile block - two consecutive end-of-line patterns
+    writer.write(1, 12);
+    writer.write(1, 12);
+    writer.finishLine();
+
+    return writer.takeByteArray();
+}
+
+void PDFCCITTFaxEncoder::write2DMode(PDFBitWriter& writer, CCITT_2D_Code_Mode mode)
+{
+    for (const PDFCCITT2DModeInfo& info : CCITT_2D_CODE_MODES)
+    {
+        if (info.mode == mode)
+        {
+            writer.write(info.code, info.bits);
+            return;
+        }
+    }
+
+    Q_ASSERT(false);
+}
+
+void PDFCCITTFaxEncoder::writeRunLength(PDFBitWriter& writer, int runLength, bool isBlack)
+{
+    // Code tables contain terminating codes for run lengths 0-63 at indices 0-63,
+    // followed by make-up codes for run lengths 64, 128, ..., 2560.
+    const PDFCCITTCode* codes = isBlack ? CCITT_BLACK_CODES : CCITT_WHITE_CODES;
+    constexpr int MAX_MAKEUP_RUN_LENGTH = 2560;
+
+    auto writeCode = [&writer](const PDFCCITTCode& code)
+    {
+        writer.write(code.code, code.bits);
+    };
+
+    while (runLength >= MAX_MAKEUP_RUN_LENGTH)
+    {
+        writeCode(codes[63 + MAX_MAKEUP_RUN_LENGTH / 64]);
+        runLength -= MAX_MAKEUP_RUN_LENGTH;
+    }
+
+    if (runLength >= 64)
+    {
+        writeCode(codes[63 + runLength / 64]);
+        runLength %= 64;
+    }
+
+    writeCode(codes[runLength]);
+}
+
 }   // namespace pdf
@@ -86,7 +86,7 @@ enum CCITT_2D_Code_Mode
     Invalid
 };
 
-class PDFCCITTFaxDecoder
+class PDF4QTLIBSHARED_EXPORT PDFCCITTFaxDecoder
 {
 public:
     explicit PDFCCITTFaxDecoder(const QByteArray* stream, const PDFCCITTFaxDecoderParameters& parameters);
@@ -128,6 +128,27 @@ private:
     PDFCCITTFaxDecoderParameters m_parameters;
 };
 
+/// Encoder of bitonal images using pure two dimensional CCITT encoding (Group 4).
+/// Image data are expected in the same form, as produced by the decoder, i.e. one
+/// component with one bit per component, where bit 0 is black pixel and bit 1 is white
+/// pixel. So encoded data must be decoded with BlackIs1 set to false.
+class PDF4QTLIBSHARED_EXPORT PDFCCITTFaxEncoder
+{
+public:
+    /// Encodes image data using Group 4 encoding (K = -1). Lines are not byte aligned,
+    /// end-of-line patterns are not used, data are terminated by end-of-facsimile
+    /// block (EOFB).
+    /// \param imageData Image data (one component, one bit per component)
+    static QByteArray encode(const PDFImageData& imageData);
+
+private:
+    /// Writes 2D mode code word to the output
+    static void write2DMode(PDFBitWriter& writer, CCITT_2D_Code_Mode mode);
+
+    /// Writes run length (make-up code words followed by terminating code word)
+    static void writeRunLength(PDFBitWriter& writer, int runLength, bool isBlack);
+};
+
 }   // namespace pdf
 
 #endif // PDFCCITTFAXDECODER_H
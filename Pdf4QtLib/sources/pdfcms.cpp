@@ -21,7 +21,7 @@
 #include "pdfdbgheap.h"
 
 #include <QApplication>
-#include <QReadWriteLock>
+#include <QMutex>
 
 #ifdef PDF4QT_COMPILER_CLANG
 #pragma clang diagnostic push
@@ -54,11 +54,92 @@
 #endif
 #endif
 
-#include <unordered_map>
+#include <map>
+#include <atomic>
+#include <memory>
+#include <tuple>
 
 namespace pdf
 {
 
+/// Cache of little CMS transforms. Transforms are created only once and they are
+/// not removed from the cache until the cache is destroyed. Lookup in the cache is
+/// lock-free - content of the cache is immutable map, which is replaced by a new map
+/// (containing the new transform) when a transform is inserted. Superseded maps are
+/// kept alive until the cache is destroyed, because other threads may still read them.
+/// Only a handful of transforms is created per document, and color management system
+/// (together with its caches) is recreated, when document is reset, so superseded
+/// maps are released then. Transforms are created without the cache (flag
+/// cmsFLAGS_NOCACHE), so they can be used from multiple threads simultaneously.
+template<typename Key>
+class PDFLittleCMSTransformCache
+{
+public:
+    inline PDFLittleCMSTransformCache()
+    {
+        m_maps.push_back(std::make_unique<const Map>());
+        m_map.store(m_maps.back().get(), std::memory_order_release);
+    }
+
+    inline ~PDFLittleCMSTransformCache()
+    {
+        for (const auto& transformItem : *m_map.load(std::memory_order_acquire))
+        {
+            cmsHTRANSFORM transform = transformItem.second;
+            if (transform)
+            {
+                cmsDeleteTransform(transform);
+            }
+        }
+    }
+
+    PDFLittleCMSTransformCache(const PDFLittleCMSTransformCache&) = delete;
+    PDFLittleCMSTransformCache& operator=(const PDFLittleCMSTransformCache&) = delete;
+
+    /// Returns transform for given key. If transform is not in the cache,
+    /// then it is created using the factory and inserted into the cache.
+    /// Transform can be null, if it can't be created.
+    /// \param key Key of the transform (or value comparable with the key)
+    /// \param factory Function, which creates the transform
+    template<typename LookupKey, typename Factory>
+    cmsHTRANSFORM get(const LookupKey& key, Factory factory)
+    {
+        const Map* map = m_map.load(std::memory_order_acquire);
+        auto it = map->find(key);
+        if (it != map->cend())
+        {
+            return it->second;
+        }
+
+        QMutexLocker lock(&m_mutex);
+
+        // Now, we have locked cache for writing. We must find out,
+        // if some other thread doesn't created the transformation already.
+        map = m_map.load(std::memory_order_acquire);
+        it = map->find(key);
+        if (it != map->cend())
+        {
+            return it->second;
+        }
+
+        cmsHTRANSFORM transform = factory();
+
+        std::unique_ptr<Map> newMap = std::make_unique<Map>(*map);
+        newMap->emplace(Key(key), transform);
+        m_map.store(newMap.get(), std::memory_order_release);
+        m_maps.push_back(qMove(newMap));
+
+        return transform;
+    }
+
+private:
+    using Map = std::map<Key, cmsHTRANSFORM, std::less<>>;
+
+    QMutex m_mutex;
+    std::atomic<const Map*> m_map;
+    std::vector<std::unique_ptr<const Map>> m_maps;
+};
+
 class PDFLittleCMS : public PDFCMS
 {
 public:
@@ -75,6 +156,8 @@ public:
     virtual bool fillRGBBufferFromDeviceGray(const std::vector<float>& colors, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const override;
     virtual bool fillRGBBufferFromDeviceRGB(const std::vector<float>& colors, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const override;
     virtual bool fillRGBBufferFromDeviceCMYK(const std::vector<float>& colors, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const override;
+    virtual bool fillRGBBufferFromDeviceRGB8(const unsigned char* samples, size_t pixelCount, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const override;
+    virtual bool fillRGBBufferFromDeviceCMYK8(const unsigned char* samples, size_t pixelCount, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const override;
     virtual bool fillRGBBufferFromXYZ(const PDFColor3& whitePoint, const std::vector<float>& colors, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const override;
     virtual bool fillRGBBufferFromICC(const std::vector<float>& colors, RenderingIntent renderingIntent, unsigned char* outputBuffer, const QByteArray& iccID, const QByteArray& iccData, PDFRenderErrorReporter* reporter) const override;
     virtual bool transformColorSpace(const ColorSpaceTransformParams& params) const override;
@@ -117,7 +200,8 @@ private:
     /// \param profile Color profile
     /// \param intent Rendering intent
     /// \param isRGB888Buffer If true, 8-bit RGB output buffer is used, otherwise FLOAT RGB output buffer is used
-    cmsHTRANSFORM getTransform(Profile profile, RenderingIntent intent, bool isRGB888Buffer) const;
+    /// \param is8BitInput If true, 8-bit input buffer is used, otherwise FLOAT input buffer is used
+    cmsHTRANSFORM getTransform(Profile profile, RenderingIntent intent, bool isRGB888Buffer, bool is8BitInput = false) const;
 
     /// Gets transform for ICC profile from cache. If transform doesn't exist, then it is created.
     /// \param iccData Data of icc profile
@@ -137,7 +221,8 @@ private:
     /// \param profile Color profile
     /// \param intent Rendering intent
     /// \param isRGB888Buffer If true, 8-bit RGB output buffer is used, otherwise FLOAT RGB output buffer is used
-    static constexpr int getCacheKey(Profile profile, RenderingIntent intent, bool isRGB888Buffer) { return ((int(intent) * ProfileCount + profile) << 1) + (isRGB888Buffer ? 1 : 0); }
+    /// \param is8BitInput If true, 8-bit input buffer is used, otherwise FLOAT input buffer is used
+    static constexpr int getCacheKey(Profile profile, RenderingIntent intent, bool isRGB888Buffer, bool is8BitInput) { return ((int(intent) * ProfileCount + profile) << 2) + (is8BitInput ? 2 : 0) + (isRGB888Buffer ? 1 : 0); }
 
     /// Returns little CMS rendering intent
     /// \param intent Rendering intent
@@ -147,6 +232,10 @@ private:
     /// \param profile Color profile handle
     static cmsUInt32Number getProfileDataFormat(cmsHPROFILE profile);
 
+    /// Returns little CMS 8-bit data format for profile
+    /// \param profile Color profile handle
+    static cmsUInt32Number getProfileDataFormat8Bit(cmsHPROFILE profile);
+
     /// Returns color from output color. Clamps invalid rgb output values to range [0.0, 1.0].
     /// \param color01 Rgb color (range 0-1 is assumed).
     static QColor getColorFromOutputColor(std::array<float, 3> color01);
@@ -161,14 +250,9 @@ private:
     QColor m_paperColor;
     std::array<cmsHPROFILE, ProfileCount> m_profiles;
 
-    mutable QReadWriteLock m_transformationCacheLock;
-    mutable std::unordered_map<int, cmsHTRANSFORM> m_transformationCache;
-
-    mutable QReadWriteLock m_customIccProfileCacheLock;
-    mutable std::map<std::pair<QByteArray, RenderingIntent>, cmsHTRANSFORM> m_customIccProfileCache;
-
-    mutable QReadWriteLock m_transformColorSpaceCacheLock;
-    mutable std::map<QByteArray, cmsHTRANSFORM> m_transformColorSpaceCache;
+    mutable PDFLittleCMSTransformCache<int> m_transformationCache;
+    mutable PDFLittleCMSTransformCache<std::tuple<QByteArray, RenderingIntent, bool>> m_customIccProfileCache;
+    mutable PDFLittleCMSTransformCache<QByteArray> m_transformColorSpaceCache;
 };
 
 bool PDFLittleCMS::fillRGBBufferFromDeviceGray(const std::vector<float>& colors,
@@ -253,6 +337,55 @@ bool PDFLittleCMS::fillRGBBufferFromDeviceCMYK(const std::vector<float>& colors,
     return false;
 }
 
+bool PDFLittleCMS::fillRGBBufferFromDeviceRGB8(const unsigned char* samples, size_t pixelCount, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const
+{
+    cmsHTRANSFORM transform = getTransform(RGB, getEffectiveRenderingIntent(intent), true, true);
+
+    if (!transform)
+    {
+        reporter->reportRenderErrorOnce(RenderErrorType::Error, PDFTranslationContext::tr("Conversion from RGB to output device using CMS failed."));
+        return false;
+    }
+
+    if (cmsGetTransformInputFormat(transform) == TYPE_RGB_8)
+    {
+        Q_ASSERT(cmsGetTransformOutputFormat(transform) == TYPE_RGB_8);
+        cmsDoTransform(transform, samples, outputBuffer, static_cast<cmsUInt32Number>(pixelCount));
+        return true;
+    }
+    else
+    {
+        reporter->reportRenderErrorOnce(RenderErrorType::Error, PDFTranslationContext::tr("Conversion from RGB to output device using CMS failed - invalid data format."));
+    }
+
+    return false;
+}
+
+bool PDFLittleCMS::fillRGBBufferFromDeviceCMYK8(const unsigned char* samples, size_t pixelCount, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const
+{
+    cmsHTRANSFORM transform = getTransform(CMYK, getEffectiveRenderingIntent(intent), true, true);
+
+    if (!transform)
+    {
+        reporter->reportRenderErrorOnce(RenderErrorType::Error, PDFTranslationContext::tr("Conversion from CMYK to output device using CMS failed."));
+        return false;
+    }
+
+    // 8-bit CMYK samples are already in the range 0-255 representing 0-100 % of ink
+    if (cmsGetTransformInputFormat(transform) == TYPE_CMYK_8)
+    {
+        Q_ASSERT(cmsGetTransformOutputFormat(transform) == TYPE_RGB_8);
+        cmsDoTransform(transform, samples, outputBuffer, static_cast<cmsUInt32Number>(pixelCount));
+        return true;
+    }
+    else
+    {
+        reporter->reportRenderErrorOnce(RenderErrorType::Error, PDFTranslationContext::tr("Conversion from CMYK to output device using CMS failed - invalid data format."));
+    }
+
+    return false;
+}
+
 bool PDFLittleCMS::fillRGBBufferFromXYZ(const PDFColor3& whitePoint, const std::vector<float>& colors, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const
 {
     cmsHTRANSFORM transform = getTransform(XYZ, getEffectiveRenderingIntent(intent), true);
@@ -457,33 +590,6 @@ PDFLittleCMS::PDFLittleCMS(const PDFCMSManager* manager, const PDFCMSSettings& s
 
 PDFLittleCMS::~PDFLittleCMS()
 {
-    for (const auto& transformItem : m_transformationCache)
-    {
-        cmsHTRANSFORM transform = transformItem.second;
-        if (transform)
-        {
-            cmsDeleteTransform(transform);
-        }
-    }
-
-    for (const auto& transformItem : m_customIccProfileCache)
-    {
-        cmsHTRANSFORM transform = transformItem.second;
-        if (transform)
-        {
-            cmsDeleteTransform(transform);
-        }
-    }
-
-    for (const auto& transformItem : m_transformColorSpaceCache)
-    {
-        cmsHTRANSFORM transform = transformItem.second;
-        if (transform)
-        {
-            cmsDeleteTransform(transform);
-        }
-    }
-
     for (cmsHPROFILE profile : m_profiles)
     {
         if (profile)
@@ -615,58 +721,42 @@ QColor PDFLittleCMS::getColorFromXYZ(const PDFColor3& whitePoint, const PDFColor
 cmsHTRANSFORM PDFLittleCMS::getTransformFromICCProfile(const QByteArray& iccData, const QByteArray& iccID, RenderingIntent renderingIntent, bool isRGB888Buffer) const
 {
     RenderingIntent effectiveRenderingIntent = getEffectiveRenderingIntent(renderingIntent);
-    const auto key = std::make_pair(iccID + (isRGB888Buffer ? "RGB_888" : "FLT"), effectiveRenderingIntent);
-    QReadLocker lock(&m_customIccProfileCacheLock);
-    auto it = m_customIccProfileCache.find(key);
-    if (it == m_customIccProfileCache.cend())
-    {
-        lock.unlock();
-        QWriteLocker writeLock(&m_customIccProfileCacheLock);
 
-        // Now, we have locked cache for writing. We must find out,
-        // if some other thread doesn't created the transformation already.
-        it = m_customIccProfileCache.find(key);
-        if (it == m_customIccProfileCache.cend())
+    // Key is referencing the profile identifier, so no copy of the identifier is made during lookup
+    const auto key = std::forward_as_tuple(iccID, effectiveRenderingIntent, isRGB888Buffer);
+
+    return m_customIccProfileCache.get(key, [&]()
+    {
+        cmsHTRANSFORM transform = cmsHTRANSFORM();
+        cmsHPROFILE profile = cmsOpenProfileFromMem(iccData.data(), iccData.size());
+        if (profile)
         {
-            cmsHTRANSFORM transform = cmsHTRANSFORM();
-            cmsHPROFILE profile = cmsOpenProfileFromMem(iccData.data(), iccData.size());
-            if (profile)
+            if (const cmsUInt32Number inputDataFormat = getProfileDataFormat(profile))
             {
-                if (const cmsUInt32Number inputDataFormat = getProfileDataFormat(profile))
-                {
-                    cmsUInt32Number lcmsIntent = getLittleCMSRenderingIntent(effectiveRenderingIntent);
+                cmsUInt32Number lcmsIntent = getLittleCMSRenderingIntent(effectiveRenderingIntent);
 
-                    if (isSoftProofing())
-                    {
-                        cmsHPROFILE proofingProfile = m_profiles[SoftProofing];
-                        RenderingIntent proofingIntent = m_settings.proofingIntent;
-                        if (m_settings.proofingIntent == RenderingIntent::Auto)
-                        {
-                            proofingIntent = effectiveRenderingIntent;
-                        }
-
-                        transform = cmsCreateProofingTransform(profile, inputDataFormat, m_profiles[Output], isRGB888Buffer ? TYPE_RGB_8 : TYPE_RGB_FLT, proofingProfile,
-                                                               lcmsIntent, getLittleCMSRenderingIntent(proofingIntent), getTransformationFlags());
-                    }
-                    else
+                if (isSoftProofing())
+                {
+                    cmsHPROFILE proofingProfile = m_profiles[SoftProofing];
+                    RenderingIntent proofingIntent = m_settings.proofingIntent;
+                    if (m_settings.proofingIntent == RenderingIntent::Auto)
                     {
-                        transform = cmsCreateTransform(profile, inputDataFormat, m_profiles[Output], isRGB888Buffer ? TYPE_RGB_8 : TYPE_RGB_FLT, lcmsIntent, getTransformationFlags());
+                        proofingIntent = effectiveRenderingIntent;
                     }
+
+                    transform = cmsCreateProofingTransform(profile, inputDataFormat, m_profiles[Output], isRGB888Buffer ? TYPE_RGB_8 : TYPE_RGB_FLT, proofingProfile,
+                                                           lcmsIntent, getLittleCMSRenderingIntent(proofingIntent), getTransformationFlags());
+                }
+                else
+                {
+                    transform = cmsCreateTransform(profile, inputDataFormat, m_profiles[Output], isRGB888Buffer ? TYPE_RGB_8 : TYPE_RGB_FLT, lcmsIntent, getTransformationFlags());
                 }
-                cmsCloseProfile(profile);
             }
-
-            it = m_customIccProfileCache.insert(std::make_pair(key, transform)).first;
+            cmsCloseProfile(profile);
         }
 
-        return it->second;
-    }
-    else
-    {
-        return it->second;
-    }
-
-    return cmsHTRANSFORM();
+        return transform;
+    });
 }
 
 QColor PDFLittleCMS::getColorFromICC(const PDFColor& color, RenderingIntent renderingIntent, const QByteArray& iccID, const QByteArray& iccData, PDFRenderErrorReporter* reporter) const
@@ -730,11 +820,6 @@ void PDFLittleCMS::init()
             m_paperColor = QColor(Qt::white);
         }
     }
-
-    // 64 should be enough, because we can have 4 input color spaces (gray, RGB, CMYK and XYZ),
-    // and 4 rendering intents. We have 4 * 4 = 16 input tables, so 64 will suffice enough
-    // (because we then have 25% load factor).
-    m_transformationCache.reserve(64);
 }
 
 int PDFLittleCMS::installCmsPlugins()
@@ -966,55 +1051,40 @@ cmsHPROFILE PDFLittleCMS::createProfile(const QString& id, const PDFColorProfile
     return cmsHPROFILE();
 }
 
-cmsHTRANSFORM PDFLittleCMS::getTransform(Profile profile, RenderingIntent intent, bool isRGB888Buffer) const
+cmsHTRANSFORM PDFLittleCMS::getTransform(Profile profile, RenderingIntent intent, bool isRGB888Buffer, bool is8BitInput) const
 {
-    const int key = getCacheKey(profile, intent, isRGB888Buffer);
+    const int key = getCacheKey(profile, intent, isRGB888Buffer, is8BitInput);
 
-    QReadLocker lock(&m_transformationCacheLock);
-    auto it = m_transformationCache.find(key);
-    if (it == m_transformationCache.cend())
+    return m_transformationCache.get(key, [&]()
     {
-        lock.unlock();
-        QWriteLocker writeLock(&m_transformationCacheLock);
+        cmsHTRANSFORM transform = cmsHTRANSFORM();
+        cmsHPROFILE input = m_profiles[profile];
+        cmsHPROFILE output = m_profiles[Output];
 
-        // Now, we have locked cache for writing. We must find out,
-        // if some other thread doesn't created the transformation already.
-        it = m_transformationCache.find(key);
-        if (it == m_transformationCache.cend())
+        if (input && output)
         {
-            cmsHTRANSFORM transform = cmsHTRANSFORM();
-            cmsHPROFILE input = m_profiles[profile];
-            cmsHPROFILE output = m_profiles[Output];
+            const cmsUInt32Number inputDataFormat = is8BitInput ? getProfileDataFormat8Bit(input) : getProfileDataFormat(input);
 
-            if (input && output)
+            if (isSoftProofing())
             {
-                if (isSoftProofing())
-                {
-                    cmsHPROFILE proofingProfile = m_profiles[SoftProofing];
-                    RenderingIntent proofingIntent = m_settings.proofingIntent;
-                    if (m_settings.proofingIntent == RenderingIntent::Auto)
-                    {
-                        proofingIntent = intent;
-                    }
-
-                    transform = cmsCreateProofingTransform(input, getProfileDataFormat(input), output, isRGB888Buffer ? TYPE_RGB_8 : TYPE_RGB_FLT, proofingProfile,
-                                                           getLittleCMSRenderingIntent(intent), getLittleCMSRenderingIntent(proofingIntent), getTransformationFlags());
-                }
-                else
+                cmsHPROFILE proofingProfile = m_profiles[SoftProofing];
+                RenderingIntent proofingIntent = m_settings.proofingIntent;
+                if (m_settings.proofingIntent == RenderingIntent::Auto)
                 {
-                    transform = cmsCreateTransform(input, getProfileDataFormat(input), output, isRGB888Buffer ? TYPE_RGB_8 : TYPE_RGB_FLT, getLittleCMSRenderingIntent(intent), getTransformationFlags());
+                    proofingIntent = intent;
                 }
-            }
 
-            it = m_transformationCache.insert(std::make_pair(key, transform)).first;
+                transform = cmsCreateProofingTransform(input, inputDataFormat, output, isRGB888Buffer ? TYPE_RGB_8 : TYPE_RGB_FLT, proofingProfile,
+                                                       getLittleCMSRenderingIntent(intent), getLittleCMSRenderingIntent(proofingIntent), getTransformationFlags());
+            }
+            else
+            {
+                transform = cmsCreateTransform(input, inputDataFormat, output, isRGB888Buffer ? TYPE_RGB_8 : TYPE_RGB_FLT, getLittleCMSRenderingIntent(intent), getTransformationFlags());
+            }
         }
 
-        // We must return it here to avoid race condition (after current block,
-        // lock is not locked, because we unlocked lock for reading).
-        return it->second;
-    }
-
-    return it->second;
+        return transform;
+    });
 }
 
 cmsUInt32Number PDFLittleCMS::getTransformationFlags() const
@@ -1117,6 +1187,27 @@ cmsUInt32Number PDFLittleCMS::getProfileDataFormat(cmsHPROFILE profile)
     return 0;
 }
 
+cmsUInt32Number PDFLittleCMS::getProfileDataFormat8Bit(cmsHPROFILE profile)
+{
+    cmsColorSpaceSignature signature = cmsGetColorSpace(profile);
+    switch (signature)
+    {
+        case cmsSigGrayData:
+            return TYPE_GRAY_8;
+
+        case cmsSigRgbData:
+            return TYPE_RGB_8;
+
+        case cmsSigCmykData:
+            return TYPE_CMYK_8;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
 QColor PDFLittleCMS::getColorFromOutputColor(std::array<float, 3> color01)
 {
     QColor color(QColor::Rgb);
@@ -1146,102 +1237,84 @@ QByteArray PDFLittleCMS::getTransformColorSpaceKey(const PDFCMS::ColorSpaceTrans
 cmsHTRANSFORM PDFLittleCMS::getTransformBetweenColorSpaces(const PDFCMS::ColorSpaceTransformParams& params) const
 {
     QByteArray key = getTransformColorSpaceKey(params);
-    QReadLocker lock(&m_transformColorSpaceCacheLock);
-    auto it = m_transformColorSpaceCache.find(key);
-    if (it == m_transformColorSpaceCache.cend())
+
+    return m_transformColorSpaceCache.get(key, [&]()
     {
-        lock.unlock();
-        QWriteLocker writeLock(&m_transformColorSpaceCacheLock);
+        cmsHPROFILE inputProfile = cmsHPROFILE();
+        cmsHPROFILE outputProfile = cmsHPROFILE();
+        cmsHTRANSFORM transform = cmsHTRANSFORM();
 
-        // Now, we have locked cache for writing. We must find out,
-        // if some other thread doesn't created the transformation already.
-        it = m_transformColorSpaceCache.find(key);
-        if (it == m_transformColorSpaceCache.cend())
+        switch (params.sourceType)
         {
-            cmsHPROFILE inputProfile = cmsHPROFILE();
-            cmsHPROFILE outputProfile = cmsHPROFILE();
-            cmsHTRANSFORM transform = cmsHTRANSFORM();
-
-            switch (params.sourceType)
-            {
-                case ColorSpaceType::DeviceGray:
-                    inputProfile = m_profiles[Gray];
-                    break;
-
-                case ColorSpaceType::DeviceRGB:
-                    inputProfile = m_profiles[RGB];
-                    break;
-
-                case ColorSpaceType::DeviceCMYK:
-                    inputProfile = m_profiles[CMYK];
-                    break;
+            case ColorSpaceType::DeviceGray:
+                inputProfile = m_profiles[Gray];
+                break;
 
-                case ColorSpaceType::XYZ:
-                    inputProfile = m_profiles[XYZ];
-                    break;
+            case ColorSpaceType::DeviceRGB:
+                inputProfile = m_profiles[RGB];
+                break;
 
-                case ColorSpaceType::ICC:
-                    inputProfile = cmsOpenProfileFromMem(params.sourceIccData.data(), params.sourceIccData.size());
-                    break;
+            case ColorSpaceType::DeviceCMYK:
+                inputProfile = m_profiles[CMYK];
+                break;
 
-                default:
-                    Q_ASSERT(false);
-                    break;
-            }
+            case ColorSpaceType::XYZ:
+                inputProfile = m_profiles[XYZ];
+                break;
 
-            switch (params.targetType)
-            {
-                case ColorSpaceType::DeviceGray:
-                    outputProfile = m_profiles[Gray];
-                    break;
+            case ColorSpaceType::ICC:
+                inputProfile = cmsOpenProfileFromMem(params.sourceIccData.data(), params.sourceIccData.size());
+                break;
 
-                case ColorSpaceType::DeviceRGB:
-                    outputProfile = m_profiles[RGB];
-                    break;
+            default:
+                Q_ASSERT(false);
+                break;
+        }
 
-                case ColorSpaceType::DeviceCMYK:
-                    outputProfile = m_profiles[CMYK];
-                    break;
+        switch (params.targetType)
+        {
+            case ColorSpaceType::DeviceGray:
+                outputProfile = m_profiles[Gray];
+                break;
 
-                case ColorSpaceType::XYZ:
-                    outputProfile = m_profiles[XYZ];
-                    break;
+            case ColorSpaceType::DeviceRGB:
+                outputProfile = m_profiles[RGB];
+                break;
 
-                case ColorSpaceType::ICC:
-                    outputProfile = cmsOpenProfileFromMem(params.targetIccData.data(), params.targetIccData.size());
-                    break;
+            case ColorSpaceType::DeviceCMYK:
+                outputProfile = m_profiles[CMYK];
+                break;
 
-                default:
-                    Q_ASSERT(false);
-                    break;
-            }
+            case ColorSpaceType::XYZ:
+                outputProfile = m_profiles[XYZ];
+                break;
 
-            if (inputProfile && outputProfile)
-            {
-                transform = cmsCreateTransform(inputProfile, getProfileDataFormat(inputProfile), outputProfile, getProfileDataFormat(outputProfile), getLittleCMSRenderingIntent(params.intent), getTransformationFlags());
-            }
+            case ColorSpaceType::ICC:
+                outputProfile = cmsOpenProfileFromMem(params.targetIccData.data(), params.targetIccData.size());
+                break;
 
-            if (params.sourceType == ColorSpaceType::ICC)
-            {
-                cmsCloseProfile(inputProfile);
-            }
+            default:
+                Q_ASSERT(false);
+                break;
+        }
 
-            if (params.targetType == ColorSpaceType::ICC)
-            {
-                cmsCloseProfile(outputProfile);
-            }
+        if (inputProfile && outputProfile)
+        {
+            transform = cmsCreateTransform(inputProfile, getProfileDataFormat(inputProfile), outputProfile, getProfileDataFormat(outputProfile), getLittleCMSRenderingIntent(params.intent), getTransformationFlags());
+        }
 
-            it = m_transformColorSpaceCache.insert(std::make_pair(key, transform)).first;
+        if (params.sourceType == ColorSpaceType::ICC)
+        {
+            cmsCloseProfile(inputProfile);
         }
 
-        return it->second;
-    }
-    else
-    {
-        return it->second;
-    }
+        if (params.targetType == ColorSpaceType::ICC)
+        {
+            cmsCloseProfile(outputProfile);
+        }
 
-    return cmsHTRANSFORM();
+        return transform;
+    });
 }
 
 QString getInfoFromProfile(cmsHPROFILE profile, cmsInfoType infoType)
@@ -1368,6 +1441,26 @@ bool PDFCMSGeneric::fillRGBBufferFromDeviceCMYK(const std::vector<float>& colors
     return false;
 }
 
+bool PDFCMSGeneric::fillRGBBufferFromDeviceRGB8(const unsigned char* samples, size_t pixelCount, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const
+{
+    Q_UNUSED(samples);
+    Q_UNUSED(pixelCount);
+    Q_UNUSED(intent);
+    Q_UNUSED(outputBuffer);
+    Q_UNUSED(reporter);
+    return false;
+}
+
+bool PDFCMSGeneric::fillRGBBufferFromDeviceCMYK8(const unsigned char* samples, size_t pixelCount, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const
+{
+    Q_UNUSED(samples);
+    Q_UNUSED(pixelCount);
+    Q_UNUSED(intent);
+    Q_UNUSED(outputBuffer);
+    Q_UNUSED(reporter);
+    return false;
+}
+
 bool PDFCMSGeneric::fillRGBBufferFromXYZ(const PDFColor3& whitePoint, const std::vector<float>& colors, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const
 {
     Q_UNUSED(whitePoint);
@@ -1575,6 +1668,12 @@ void PDFCMSManager::setDocument(const PDFDocument* document)
     }
 }
 
+void PDFCMSManager::resetCMS()
+{
+    QMutexLocker lock(&m_mutex);
+    m_CMS.dirty();
+}
+
 QString PDFCMSManager::getSystemName(PDFCMSSettings::System system)
 {
     switch (system)
@@ -1857,6 +1956,12 @@ PDFColorProfileIdentifier PDFColorProfileIdentifier::createOutputIntent(PDFColor
     return result;
 }
 
+PDFCMS::PDFCMS()
+{
+    static std::atomic<quint64> s_identifier = 0;
+    m_identifier = ++s_identifier;
+}
+
 PDFColor3 PDFCMS::getDefaultXYZWhitepoint()
 {
     const cmsCIEXYZ* whitePoint = cmsD50_XYZ();
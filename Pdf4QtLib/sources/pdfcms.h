@@ -88,12 +88,17 @@ struct PDFCMSSettings
 /// Color management system base class. It contains functions to transform
 /// colors from various color system to device color system. If color management
 /// system can't handle color transform, it should return invalid color.
-class PDFCMS
+class PDF4QTLIBSHARED_EXPORT PDFCMS
 {
 public:
-    explicit inline PDFCMS() = default;
+    explicit PDFCMS();
     virtual ~PDFCMS() = default;
 
+    /// Returns unique identifier of this color management system. Identifiers
+    /// are never reused, so they can be used in keys of caches of color
+    /// converted data (for example, decoded images).
+    quint64 getIdentifier() const { return m_identifier; }
+
     /// This function should decide, if color management system is compatible with these
     /// settings (so, it transforms colors according to this setting). If this
     /// function returns false, then this color management system should be replaced
@@ -187,6 +192,32 @@ public:
                                              unsigned char* outputBuffer,
                                              PDFRenderErrorReporter* reporter) const = 0;
 
+    /// Fills colors in Device RGB color space with 8-bit samples to the RGB buffer. If error occurs,
+    /// then false is returned. Caller then should handle this - try to convert color as accurate as possible.
+    /// \param samples Buffer with three 8-bit color channels, so it has pixels * tuple(R, G, B) size
+    /// \param pixelCount Number of pixels
+    /// \param intent Rendering intent
+    /// \param outputBuffer Output buffer in format RGB_888 (8-bit RGB values)
+    /// \param reporter Render error reporter (used, when color transform fails)
+    virtual bool fillRGBBufferFromDeviceRGB8(const unsigned char* samples,
+                                             size_t pixelCount,
+                                             RenderingIntent intent,
+                                             unsigned char* outputBuffer,
+                                             PDFRenderErrorReporter* reporter) const = 0;
+
+    /// Fills colors in Device CMYK color space with 8-bit samples to the RGB buffer. If error occurs,
+    /// then false is returned. Caller then should handle this - try to convert color as accurate as possible.
+    /// \param samples Buffer with four 8-bit color channels, so it has pixels * tuple(C, M, Y, K) size
+    /// \param pixelCount Number of pixels
+    /// \param intent Rendering intent
+    /// \param outputBuffer Output buffer in format RGB_888 (8-bit RGB values)
+    /// \param reporter Render error reporter (used, when color transform fails)
+    virtual bool fillRGBBufferFromDeviceCMYK8(const unsigned char* samples,
+                                              size_t pixelCount,
+                                              RenderingIntent intent,
+                                              unsigned char* outputBuffer,
+                                              PDFRenderErrorReporter* reporter) const = 0;
+
     /// Fills colors in XYZ color space to the RGB buffer. If error occurs, then false is returned.
     /// Caller then should handle this - try to convert color as accurate as possible.
     /// \param whitePoint White point of source XYZ color space
@@ -246,11 +277,14 @@ public:
 
     /// Get D50 white point for XYZ color space
     static PDFColor3 getDefaultXYZWhitepoint();
+
+private:
+    quint64 m_identifier;
 };
 
 using PDFCMSPointer = QSharedPointer<PDFCMS>;
 
-class PDFCMSGeneric : public PDFCMS
+class PDF4QTLIBSHARED_EXPORT PDFCMSGeneric : public PDFCMS
 {
 public:
     explicit inline PDFCMSGeneric() = default;
@@ -265,6 +299,8 @@ public:
     virtual bool fillRGBBufferFromDeviceGray(const std::vector<float>& colors, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const override;
     virtual bool fillRGBBufferFromDeviceRGB(const std::vector<float>& colors, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const override;
     virtual bool fillRGBBufferFromDeviceCMYK(const std::vector<float>& colors, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const override;
+    virtual bool fillRGBBufferFromDeviceRGB8(const unsigned char* samples, size_t pixelCount, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const override;
+    virtual bool fillRGBBufferFromDeviceCMYK8(const unsigned char* samples, size_t pixelCount, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const override;
     virtual bool fillRGBBufferFromXYZ(const PDFColor3& whitePoint, const std::vector<float>& colors, RenderingIntent intent, unsigned char* outputBuffer, PDFRenderErrorReporter* reporter) const override;
     virtual bool fillRGBBufferFromICC(const std::vector<float>& colors, RenderingIntent renderingIntent, unsigned char* outputBuffer, const QByteArray& iccID, const QByteArray& iccData, PDFRenderErrorReporter* reporter) const override;
     virtual bool transformColorSpace(const ColorSpaceTransformParams& params) const override;
@@ -372,6 +408,11 @@ public:
     /// \param document Document
     void setDocument(const PDFDocument* document);
 
+    /// Releases current CMS, so new one is created, when it is requested.
+    /// Transforms cached by the old CMS are released, when the old CMS is
+    /// no longer used. Call this function, when document is reset.
+    void resetCMS();
+
     /// Get translated name for color management system
     /// \param system System
     static QString getSystemName(PDFCMSSettings::System system);
@@ -227,9 +227,10 @@ QImage PDFAbstractColorSpace::getImage(const PDFImageData& imageData,
                     throw PDFException(PDFTranslationContext::tr("Invalid size of the decode array. Expected %1, actual %2.").arg(componentCount * 2).arg(decode.size()));
                 }
 
-                const unsigned int imageWidth = imageData.getWidth();
                 const unsigned int imageHeight = imageData.getHeight();
 
+                const ImageLineTransform transform = createImageLineTransform(imageData, intent, cms, reporter);
+
                 QMutex exceptionMutex;
                 std::optional<PDFException> exception;
 
@@ -243,40 +244,7 @@ QImage PDFAbstractColorSpace::getImage(const PDFImageData& imageData,
 
                     try
                     {
-                        PDFBitReader reader(&imageData.getData(), imageData.getBitsPerComponent());
-                        reader.seek(i * imageData.getStride());
-
-                        const double max = reader.max();
-                        const double coefficient = 1.0 / max;
-                        unsigned char* outputLine = image.scanLine(i);
-
-                        std::vector<float> inputColors(imageWidth * componentCount, 0.0f);
-                        auto itInputColor = inputColors.begin();
-
-                        if (!decode.empty())
-                        {
-                            // Interpolate value
-                            for (unsigned int j = 0; j < imageData.getWidth(); ++j)
-                            {
-                                for (unsigned int k = 0; k < componentCount; ++k)
-                                {
-                                    PDFReal value = reader.read();
-                                    *itInputColor++ = interpolate(value, 0.0, max, decode[2 * k], decode[2 * k + 1]);
-                                }
-                            }
-                        }
-                        else
-                        {
-                            // Just read all values and multiply them with coefficient
-                            const unsigned int pixelCount = imageData.getWidth() * componentCount;
-                            for (unsigned int j = 0; j < pixelCount; ++j)
-                            {
-                                PDFReal value = reader.read();
-                                *itInputColor++ = value * coefficient;
-                            }
-                        }
-
-                        fillRGBBuffer(inputColors, outputLine, intent, cms, reporter);
+                        transformImageLine(imageData, transform, i, image.scanLine(i), intent, cms, reporter);
                     }
                     catch (const PDFException &lineException)
                     {
@@ -327,6 +295,8 @@ QImage PDFAbstractColorSpace::getImage(const PDFImageData& imageData,
                     alphaMask = alphaMask.scaled(image.size());
                 }
 
+                const ImageLineTransform transform = createImageLineTransform(imageData, intent, cms, reporter);
+
                 QMutex exceptionMutex;
                 std::optional<PDFException> exception;
 
@@ -340,37 +310,11 @@ QImage PDFAbstractColorSpace::getImage(const PDFImageData& imageData,
 
                     try
                     {
-                        PDFBitReader reader(&imageData.getData(), imageData.getBitsPerComponent());
-                        reader.seek(i * imageData.getStride());
-
-                        const double max = reader.max();
-                        const double coefficient = 1.0 / max;
                         unsigned char* outputLine = image.scanLine(i);
                         unsigned char* alphaLine = alphaMask.scanLine(i);
 
-                        std::vector<float> inputColors(imageWidth * componentCount, 0.0f);
                         std::vector<unsigned char> outputColors(imageWidth * 3, 0);
-
-                        auto itInputColor = inputColors.begin();
-                        for (unsigned int j = 0; j < imageData.getWidth(); ++j)
-                        {
-                            for (unsigned int k = 0; k < componentCount; ++k)
-                            {
-                                PDFReal value = reader.read();
-
-                                // Interpolate value, if it is not empty
-                                if (!decode.empty())
-                                {
-                                    *itInputColor++ = interpolate(value, 0.0, max, decode[2 * k], decode[2 * k + 1]);
-                                }
-                                else
-                                {
-                                    *itInputColor++ = value * coefficient;
-                                }
-                            }
-                        }
-
-                        fillRGBBuffer(inputColors, outputColors.data(), intent, cms, reporter);
+                        transformImageLine(imageData, transform, i, outputColors.data(), intent, cms, reporter);
 
                         const unsigned char* transformedLine = outputColors.data();
                         for (unsigned int ii = 0; ii < imageWidth; ++ii)
@@ -488,6 +432,354 @@ QImage PDFAbstractColorSpace::getImage(const PDFImageData& imageData,
     return QImage();
 }
 
+std::vector<float> PDFAbstractColorSpace::createImageDecodeTable(const PDFImageData& imageData)
+{
+    std::vector<float> decodeTable;
+
+    const unsigned int bitsPerComponent = imageData.getBitsPerComponent();
+    if (bitsPerComponent > 8)
+    {
+        return decodeTable;
+    }
+
+    const unsigned int componentCount = imageData.getComponents();
+    const unsigned int valueCount = 1 << bitsPerComponent;
+    const std::vector<PDFReal>& decode = imageData.getDecode();
+
+    const double max = valueCount - 1;
+    const double coefficient = 1.0 / max;
+
+    decodeTable.reserve(componentCount * valueCount);
+    for (unsigned int k = 0; k < componentCount; ++k)
+    {
+        for (unsigned int value = 0; value < valueCount; ++value)
+        {
+            if (!decode.empty())
+            {
+                decodeTable.push_back(interpolate(value, 0.0, max, decode[2 * k], decode[2 * k + 1]));
+            }
+            else
+            {
+                decodeTable.push_back(value * coefficient);
+            }
+        }
+    }
+
+    return decodeTable;
+}
+
+PDFAbstractColorSpace::ImageLineTransform PDFAbstractColorSpace::createImageLineTransform(const PDFImageData& imageData,
+                                                                                       RenderingIntent intent,
+                                                                                       const PDFCMS* cms,
+                                                                                       PDFRenderErrorReporter* reporter) const
+{
+    ImageLineTransform transform;
+    transform.decodeTable = createImageDecodeTable(imageData);
+
+    const std::vector<float>& decodeTable = transform.decodeTable;
+    if (decodeTable.empty())
+    {
+        // Images with more than 8 bits per component are transformed generically
+        return transform;
+    }
+
+    const unsigned int componentCount = imageData.getComponents();
+    const size_t valueCount = decodeTable.size() / componentCount;
+
+    // Images with single color component and at most 8 bits per component
+    // have at most 256 different colors, so we transform each color only once.
+    if (componentCount == 1)
+    {
+        transform.kernel = ImageLineTransform::Kernel::Palette;
+        transform.colorTable.resize(valueCount * 3, 0);
+        fillRGBBuffer(decodeTable, transform.colorTable.data(), intent, cms, reporter);
+        return transform;
+    }
+
+    const ColorSpace colorSpace = getColorSpace();
+    if (colorSpace != ColorSpace::DeviceRGB && colorSpace != ColorSpace::DeviceCMYK)
+    {
+        return transform;
+    }
+
+    const bool isRGB = colorSpace == ColorSpace::DeviceRGB;
+
+    // Try to transform colors by color management system directly from 8-bit samples
+    std::array<unsigned char, 4> probeSamples = { };
+    std::array<unsigned char, 3> probeOutput = { };
+    const bool isCMSTransform8Bit = isRGB ? cms->fillRGBBufferFromDeviceRGB8(probeSamples.data(), 1, intent, probeOutput.data(), reporter)
+                                          : cms->fillRGBBufferFromDeviceCMYK8(probeSamples.data(), 1, intent, probeOutput.data(), reporter);
+    if (isCMSTransform8Bit)
+    {
+        transform.kernel = isRGB ? ImageLineTransform::Kernel::DeviceRGB8 : ImageLineTransform::Kernel::DeviceCMYK8;
+
+        bool isIdentity = true;
+        transform.sampleTable.reserve(decodeTable.size());
+        for (size_t i = 0; i < decodeTable.size(); ++i)
+        {
+            const unsigned char value = static_cast<unsigned char>(qRound(clip01(decodeTable[i]) * 255.0f));
+            isIdentity = isIdentity && value == i % valueCount;
+            transform.sampleTable.push_back(value);
+        }
+
+        if (isIdentity)
+        {
+            // 8-bit samples without decode array can be transformed as they are
+            transform.sampleTable.clear();
+        }
+
+        return transform;
+    }
+
+    const QColor cmsColor = isRGB ? cms->getColorFromDeviceRGB(PDFColor(0.0f, 0.0f, 0.0f), intent, reporter)
+                                  : cms->getColorFromDeviceCMYK(PDFColor(0.0f, 0.0f, 0.0f, 0.0f), intent, reporter);
+    if (cmsColor.isValid())
+    {
+        // Color management system transforms colors, but not from 8-bit samples
+        return transform;
+    }
+
+    // Colors are converted by Qt. In RGB, each output channel depends only on
+    // its own component. In CMYK, each output channel depends only on its own
+    // component and black component (red on cyan, green on magenta and blue on yellow).
+    if (isRGB)
+    {
+        transform.kernel = ImageLineTransform::Kernel::ComponentRGB;
+        transform.colorTable.resize(valueCount * 3, 0);
+
+        PDFColor color;
+        color.resize(3);
+
+        for (size_t value = 0; value < valueCount; ++value)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                color[k] = decodeTable[k * valueCount + value];
+            }
+
+            const QRgb rgb = getColor(color, cms, intent, reporter, true).rgb();
+            transform.colorTable[value] = qRed(rgb);
+            transform.colorTable[valueCount + value] = qGreen(rgb);
+            transform.colorTable[2 * valueCount + value] = qBlue(rgb);
+        }
+    }
+    else
+    {
+        // Tables have (2^bpc)^2 items, so use them only, if image has more pixels
+        const size_t tableSize = valueCount * valueCount;
+        if (size_t(imageData.getWidth()) * imageData.getHeight() < tableSize)
+        {
+            return transform;
+        }
+
+        transform.kernel = ImageLineTransform::Kernel::ComponentCMYK;
+        transform.colorTable.resize(tableSize * 3, 0);
+
+        PDFColor color;
+        color.resize(4);
+
+        for (size_t value = 0; value < valueCount; ++value)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                color[k] = decodeTable[k * valueCount + value];
+            }
+
+            for (size_t black = 0; black < valueCount; ++black)
+            {
+                color[3] = decodeTable[3 * valueCount + black];
+
+                const QRgb rgb = getColor(color, cms, intent, reporter, true).rgb();
+                const size_t index = value * valueCount + black;
+                transform.colorTable[index] = qRed(rgb);
+                transform.colorTable[tableSize + index] = qGreen(rgb);
+                transform.colorTable[2 * tableSize + index] = qBlue(rgb);
+            }
+        }
+    }
+
+    return transform;
+}
+
+const unsigned char* PDFAbstractColorSpace::readImageLineSamples(const PDFImageData& imageData, unsigned int line, std::vector<unsigned char>& buffer)
+{
+    Q_ASSERT(imageData.getBitsPerComponent() <= 8);
+
+    const unsigned int sampleCount = imageData.getWidth() * imageData.getComponents();
+    const qint64 lineOffset = qint64(line) * imageData.getStride();
+    const QByteArray& data = imageData.getData();
+
+    if (imageData.getBitsPerComponent() == 8 && lineOffset + sampleCount <= data.size())
+    {
+        // Samples are bytes, so we can use them directly
+        return reinterpret_cast<const unsigned char*>(data.constData()) + lineOffset;
+    }
+
+    PDFBitReader reader(&data, imageData.getBitsPerComponent());
+    reader.seek(lineOffset);
+
+    buffer.resize(sampleCount);
+    for (unsigned int i = 0; i < sampleCount; ++i)
+    {
+        buffer[i] = static_cast<unsigned char>(reader.read());
+    }
+
+    return buffer.data();
+}
+
+void PDFAbstractColorSpace::transformImageLine(const PDFImageData& imageData,
+                                               const ImageLineTransform& transform,
+                                               unsigned int line,
+                                               unsigned char* outputBuffer,
+                                               RenderingIntent intent,
+                                               const PDFCMS* cms,
+                                               PDFRenderErrorReporter* reporter) const
+{
+    const unsigned int imageWidth = imageData.getWidth();
+    const unsigned int componentCount = imageData.getComponents();
+    const std::vector<float>& decodeTable = transform.decodeTable;
+
+    std::vector<float> inputColors;
+
+    if (!decodeTable.empty())
+    {
+        std::vector<unsigned char> buffer;
+        const unsigned char* samples = readImageLineSamples(imageData, line, buffer);
+        const unsigned char* samplesEnd = samples + size_t(imageWidth) * componentCount;
+        const size_t valueCount = decodeTable.size() / componentCount;
+
+        switch (transform.kernel)
+        {
+            case ImageLineTransform::Kernel::Generic:
+                break;
+
+            case ImageLineTransform::Kernel::Palette:
+            {
+                // Colors are already transformed, just copy them
+                for (const unsigned char* sample = samples; sample != samplesEnd; ++sample)
+                {
+                    const unsigned char* color = transform.colorTable.data() + 3 * (*sample);
+                    *outputBuffer++ = color[0];
+                    *outputBuffer++ = color[1];
+                    *outputBuffer++ = color[2];
+                }
+
+                return;
+            }
+
+            case ImageLineTransform::Kernel::DeviceRGB8:
+            case ImageLineTransform::Kernel::DeviceCMYK8:
+            {
+                if (!transform.sampleTable.empty())
+                {
+                    // Decode samples in place, buffer is either empty, or contains samples
+                    buffer.resize(samplesEnd - samples);
+                    unsigned char* decodedSample = buffer.data();
+                    for (const unsigned char* sample = samples; sample != samplesEnd;)
+                    {
+                        const unsigned char* componentTable = transform.sampleTable.data();
+                        for (unsigned int k = 0; k < componentCount; ++k)
+                        {
+                            *decodedSample++ = componentTable[*sample++];
+                            componentTable += valueCount;
+                        }
+                    }
+                    samples = buffer.data();
+                }
+
+                const bool isTransformed = (transform.kernel == ImageLineTransform::Kernel::DeviceRGB8) ? cms->fillRGBBufferFromDeviceRGB8(samples, imageWidth, intent, outputBuffer, reporter)
+                                                                                                       : cms->fillRGBBufferFromDeviceCMYK8(samples, imageWidth, intent, outputBuffer, reporter);
+                if (isTransformed)
+                {
+                    return;
+                }
+
+                // Samples were decoded in place, so read them again for the generic path
+                samples = readImageLineSamples(imageData, line, buffer);
+                break;
+            }
+
+            case ImageLineTransform::Kernel::ComponentRGB:
+            {
+                const unsigned char* redTable = transform.colorTable.data();
+                const unsigned char* greenTable = redTable + valueCount;
+                const unsigned char* blueTable = greenTable + valueCount;
+
+                for (const unsigned char* sample = samples; sample != samplesEnd; sample += 3)
+                {
+                    *outputBuffer++ = redTable[sample[0]];
+                    *outputBuffer++ = greenTable[sample[1]];
+                    *outputBuffer++ = blueTable[sample[2]];
+                }
+
+                return;
+            }
+
+            case ImageLineTransform::Kernel::ComponentCMYK:
+            {
+                const size_t tableSize = valueCount * valueCount;
+                const unsigned char* redTable = transform.colorTable.data();
+                const unsigned char* greenTable = redTable + tableSize;
+                const unsigned char* blueTable = greenTable + tableSize;
+
+                for (const unsigned char* sample = samples; sample != samplesEnd; sample += 4)
+                {
+                    const unsigned char black = sample[3];
+                    *outputBuffer++ = redTable[sample[0] * valueCount + black];
+                    *outputBuffer++ = greenTable[sample[1] * valueCount + black];
+                    *outputBuffer++ = blueTable[sample[2] * valueCount + black];
+                }
+
+                return;
+            }
+        }
+
+        inputColors.resize(imageWidth * componentCount, 0.0f);
+        auto itInputColor = inputColors.begin();
+        auto itSample = samples;
+        for (unsigned int j = 0; j < imageWidth; ++j)
+        {
+            const float* componentTable = decodeTable.data();
+            for (unsigned int k = 0; k < componentCount; ++k)
+            {
+                *itInputColor++ = componentTable[*itSample++];
+                componentTable += valueCount;
+            }
+        }
+    }
+    else
+    {
+        PDFBitReader reader(&imageData.getData(), imageData.getBitsPerComponent());
+        reader.seek(qint64(line) * imageData.getStride());
+
+        const std::vector<PDFReal>& decode = imageData.getDecode();
+        const double max = reader.max();
+        const double coefficient = 1.0 / max;
+
+        inputColors.resize(imageWidth * componentCount, 0.0f);
+        auto itInputColor = inputColors.begin();
+        for (unsigned int j = 0; j < imageWidth; ++j)
+        {
+            for (unsigned int k = 0; k < componentCount; ++k)
+            {
+                PDFReal value = reader.read();
+
+                // Interpolate value, if it is not empty
+                if (!decode.empty())
+                {
+                    *itInputColor++ = interpolate(value, 0.0, max, decode[2 * k], decode[2 * k + 1]);
+                }
+                else
+                {
+                    *itInputColor++ = value * coefficient;
+                }
+            }
+        }
+    }
+
+    fillRGBBuffer(inputColors, outputBuffer, intent, cms, reporter);
+}
+
 void PDFAbstractColorSpace::fillRGBBuffer(const std::vector<float>& colors,
                                           unsigned char* outputBuffer,
                                           RenderingIntent intent,
@@ -1899,6 +2191,8 @@ QImage PDFIndexedColorSpace::getImage(const PDFImageData& imageData,
                 PDFColor color;
                 color.resize(1);
 
+                const std::vector<QRgb> palette = createPalette(imageData.getBitsPerComponent(), cms, intent, reporter);
+
                 for (unsigned int i = 0, rowCount = imageData.getHeight(); i < rowCount; ++i)
                 {
                     // Is operation being cancelled?
@@ -1913,10 +2207,17 @@ QImage PDFIndexedColorSpace::getImage(const PDFImageData& imageData,
                     for (unsigned int j = 0; j < imageData.getWidth(); ++j)
                     {
                         PDFBitReader::Value index = reader.read();
-                        color[0] = index;
+                        QRgb rgb = 0;
 
-                        QColor transformedColor = getColor(color, cms, intent, reporter, false);
-                        QRgb rgb = transformedColor.rgb();
+                        if (index < palette.size())
+                        {
+                            rgb = palette[index];
+                        }
+                        else
+                        {
+                            color[0] = index;
+                            rgb = getColor(color, cms, intent, reporter, false).rgb();
+                        }
 
                         *outputLine++ = qRed(rgb);
                         *outputLine++ = qGreen(rgb);
@@ -1945,6 +2246,8 @@ QImage PDFIndexedColorSpace::getImage(const PDFImageData& imageData,
                 PDFColor color;
                 color.resize(1);
 
+                const std::vector<QRgb> palette = createPalette(imageData.getBitsPerComponent(), cms, intent, reporter);
+
                 QImage alphaMask = createAlphaMask(softMask);
                 if (alphaMask.size() != image.size())
                 {
@@ -1967,10 +2270,17 @@ QImage PDFIndexedColorSpace::getImage(const PDFImageData& imageData,
                     for (unsigned int j = 0; j < imageData.getWidth(); ++j)
                     {
                         PDFBitReader::Value index = reader.read();
-                        color[0] = index;
+                        QRgb rgb = 0;
 
-                        QColor transformedColor = getColor(color, cms, intent, reporter, false);
-                        QRgb rgb = transformedColor.rgb();
+                        if (index < palette.size())
+                        {
+                            rgb = palette[index];
+                        }
+                        else
+                        {
+                            color[0] = index;
+                            rgb = getColor(color, cms, intent, reporter, false).rgb();
+                        }
 
                         *outputLine++ = qRed(rgb);
                         *outputLine++ = qGreen(rgb);
@@ -1990,6 +2300,31 @@ QImage PDFIndexedColorSpace::getImage(const PDFImageData& imageData,
     return QImage();
 }
 
+std::vector<QRgb> PDFIndexedColorSpace::createPalette(unsigned int bitsPerComponent,
+                                                      const PDFCMS* cms,
+                                                      RenderingIntent intent,
+                                                      PDFRenderErrorReporter* reporter) const
+{
+    std::vector<QRgb> palette;
+
+    if (bitsPerComponent <= 8)
+    {
+        const unsigned int valueCount = 1 << bitsPerComponent;
+        palette.reserve(valueCount);
+
+        PDFColor color;
+        color.resize(1);
+
+        for (unsigned int index = 0; index < valueCount; ++index)
+        {
+            color[0] = index;
+            palette.push_back(getColor(color, cms, intent, reporter, false).rgb());
+        }
+    }
+
+    return palette;
+}
+
 PDFColorSpacePointer PDFIndexedColorSpace::createIndexedColorSpace(const PDFDictionary* colorSpaceDictionary,
                                                                    const PDFDocument* document,
                                                                    const PDFArray* array,
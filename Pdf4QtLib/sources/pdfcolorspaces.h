@@ -497,6 +497,72 @@ protected:
                                                                  int recursion,
                                                                  std::set<QByteArray>& usedNames);
 
+    /// Creates lookup table of color component values for images with at most 8 bits
+    /// per component. Table contains 2^bpc values for each color component (decode
+    /// array of the image is applied). If image has more than 8 bits per component,
+    /// then empty table is returned.
+    /// \param imageData Image data
+    static std::vector<float> createImageDecodeTable(const PDFImageData& imageData);
+
+    /// Precomputed transformation of image samples to the RGB colors. It is created
+    /// once per image and then used to transform all lines of the image.
+    struct ImageLineTransform
+    {
+        enum class Kernel
+        {
+            Generic,        ///< Samples are decoded to float colors and transformed using fillRGBBuffer
+            Palette,        ///< Single component image, samples are mapped to the palette colors
+            DeviceRGB8,     ///< 8-bit RGB samples are transformed by color management system
+            DeviceCMYK8,    ///< 8-bit CMYK samples are transformed by color management system
+            ComponentRGB,   ///< Each output channel is taken from the table of corresponding RGB component
+            ComponentCMYK   ///< Each output channel is taken from the table of corresponding CMY component and K component
+        };
+
+        Kernel kernel = Kernel::Generic;
+        std::vector<float> decodeTable;             ///< Decode table (see createImageDecodeTable)
+        std::vector<unsigned char> sampleTable;     ///< Decoded samples scaled to 0-255 (empty, if samples are used as they are)
+        std::vector<unsigned char> colorTable;      ///< Transformed colors (palette, or tables of components)
+    };
+
+    /// Returns samples of the image line. Image must have at most 8 bits per component.
+    /// If samples are bytes, then pointer to the image data is returned, otherwise
+    /// samples are unpacked to the \p buffer. If image data are incomplete, exception is thrown.
+    /// \param imageData Image data
+    /// \param line Index of the line
+    /// \param buffer Buffer for unpacked samples
+    static const unsigned char* readImageLineSamples(const PDFImageData& imageData, unsigned int line, std::vector<unsigned char>& buffer);
+
+    /// Creates transformation of image samples to the RGB colors. For images
+    /// with at most 8 bits per component, the fastest available kernel is selected:
+    /// single component images use palette, device RGB/CMYK images are transformed
+    /// by color management system directly from 8-bit samples, or by per-component
+    /// lookup tables if color management system doesn't handle these color spaces.
+    /// \param imageData Image data
+    /// \param intent Rendering intent
+    /// \param cms Color management system
+    /// \param reporter Error reporter
+    ImageLineTransform createImageLineTransform(const PDFImageData& imageData,
+                                                RenderingIntent intent,
+                                                const PDFCMS* cms,
+                                                PDFRenderErrorReporter* reporter) const;
+
+    /// Transforms one line of the image to the RGB buffer (3 bytes per pixel)
+    /// using the kernel of the image transform.
+    /// \param imageData Image data
+    /// \param transform Image transform (see createImageLineTransform)
+    /// \param line Index of the line
+    /// \param outputBuffer Output RGB buffer
+    /// \param intent Rendering intent
+    /// \param cms Color management system
+    /// \param reporter Error reporter
+    void transformImageLine(const PDFImageData& imageData,
+                            const ImageLineTransform& transform,
+                            unsigned int line,
+                            unsigned char* outputBuffer,
+                            RenderingIntent intent,
+                            const PDFCMS* cms,
+                            PDFRenderErrorReporter* reporter) const;
+
     /// Converts XYZ value to the standard RGB value (linear). No gamma correction is applied.
     /// Default transformation matrix is applied.
     /// \param xyzColor Color in XYZ space
@@ -555,7 +621,7 @@ protected:
     }
 };
 
-class PDFDeviceGrayColorSpace : public PDFAbstractColorSpace
+class PDF4QTLIBSHARED_EXPORT PDFDeviceGrayColorSpace : public PDFAbstractColorSpace
 {
 public:
     explicit PDFDeviceGrayColorSpace() = default;
@@ -568,7 +634,7 @@ public:
     virtual void fillRGBBuffer(const std::vector<float>& colors,unsigned char* outputBuffer, RenderingIntent intent, const PDFCMS* cms, PDFRenderErrorReporter* reporter) const override;
 };
 
-class PDFDeviceRGBColorSpace : public PDFAbstractColorSpace
+class PDF4QTLIBSHARED_EXPORT PDFDeviceRGBColorSpace : public PDFAbstractColorSpace
 {
 public:
     explicit PDFDeviceRGBColorSpace() = default;
@@ -581,7 +647,7 @@ public:
     virtual void fillRGBBuffer(const std::vector<float>& colors,unsigned char* outputBuffer, RenderingIntent intent, const PDFCMS* cms, PDFRenderErrorReporter* reporter) const override;
 };
 
-class PDFDeviceCMYKColorSpace : public PDFAbstractColorSpace
+class PDF4QTLIBSHARED_EXPORT PDFDeviceCMYKColorSpace : public PDFAbstractColorSpace
 {
 public:
     explicit PDFDeviceCMYKColorSpace() = default;
@@ -743,7 +809,7 @@ private:
     PDFObjectReference m_metadata;
 };
 
-class PDFIndexedColorSpace : public PDFAbstractColorSpace
+class PDF4QTLIBSHARED_EXPORT PDFIndexedColorSpace : public PDFAbstractColorSpace
 {
 public:
     explicit PDFIndexedColorSpace(PDFColorSpacePointer baseColorSpace, QByteArray&& colors, int maxValue);
@@ -783,6 +849,18 @@ private:
     static constexpr const int MIN_VALUE = 0;
     static constexpr const int MAX_VALUE = 255;
 
+    /// Creates palette of transformed colors of all sample values of the image
+    /// with given bits per component, so each color is transformed only once.
+    /// If image has more than 8 bits per component, empty palette is returned.
+    /// \param bitsPerComponent Bits per component of the image
+    /// \param cms Color management system
+    /// \param intent Rendering intent
+    /// \param reporter Error reporter
+    std::vector<QRgb> createPalette(unsigned int bitsPerComponent,
+                                    const PDFCMS* cms,
+                                    RenderingIntent intent,
+                                    PDFRenderErrorReporter* reporter) const;
+
     PDFColorSpacePointer m_baseColorSpace;
     QByteArray m_colors;
     int m_maxValue;
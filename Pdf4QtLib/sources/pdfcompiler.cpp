@@ -29,6 +29,159 @@
 namespace pdf
 {
 
+PDFPrecompiledPageCache::PDFPrecompiledPageCache(qint64 cacheLimit) :
+    m_cacheLimit(cacheLimit)
+{
+
+}
+
+std::shared_ptr<PDFPrecompiledPage> PDFPrecompiledPageCache::getPage(PDFInteger pageIndex)
+{
+    auto it = m_entries.find(pageIndex);
+    if (it == m_entries.end())
+    {
+        ++m_statistics.misses;
+        return nullptr;
+    }
+
+    ++m_statistics.hits;
+    m_lruList.splice(m_lruList.begin(), m_lruList, it->second.lruIterator);
+    return it->second.page;
+}
+
+bool PDFPrecompiledPageCache::insert(PDFInteger pageIndex, PDFPrecompiledPage page)
+{
+    remove(pageIndex);
+
+    const qint64 size = page.getMemoryConsumptionEstimate();
+    if (!makeSpace(size, getPriority(pageIndex)))
+    {
+        ++m_statistics.rejections;
+        return false;
+    }
+
+    m_lruList.push_front(pageIndex);
+
+    Entry entry;
+    entry.page = std::make_shared<PDFPrecompiledPage>(qMove(page));
+    entry.size = size;
+    entry.lruIterator = m_lruList.begin();
+    m_entries.emplace(pageIndex, qMove(entry));
+    m_cacheSize += size;
+    return true;
+}
+
+void PDFPrecompiledPageCache::remove(PDFInteger pageIndex)
+{
+    auto it = m_entries.find(pageIndex);
+    if (it != m_entries.end())
+    {
+        m_cacheSize -= it->second.size;
+        m_lruList.erase(it->second.lruIterator);
+        m_entries.erase(it);
+    }
+}
+
+void PDFPrecompiledPageCache::clear()
+{
+    m_entries.clear();
+    m_lruList.clear();
+    m_cacheSize = 0;
+}
+
+void PDFPrecompiledPageCache::removeExpiredPages(qint64 milisecondsLimit)
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();)
+    {
+        if (getPriority(it->first) == Priority::Normal && it->second.page->hasExpired(milisecondsLimit))
+        {
+            m_cacheSize -= it->second.size;
+            m_lruList.erase(it->second.lruIterator);
+            it = m_entries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void PDFPrecompiledPageCache::setVisiblePages(std::vector<PDFInteger> pages)
+{
+    Q_ASSERT(std::is_sorted(pages.cbegin(), pages.cend()));
+    m_visiblePages = qMove(pages);
+}
+
+void PDFPrecompiledPageCache::setPrefetchedPages(std::vector<PDFInteger> pages)
+{
+    Q_ASSERT(std::is_sorted(pages.cbegin(), pages.cend()));
+    m_prefetchedPages = qMove(pages);
+}
+
+PDFPrecompiledPageCache::Priority PDFPrecompiledPageCache::getPriority(PDFInteger pageIndex) const
+{
+    if (std::binary_search(m_visiblePages.cbegin(), m_visiblePages.cend(), pageIndex))
+    {
+        return Priority::Visible;
+    }
+
+    if (std::binary_search(m_prefetchedPages.cbegin(), m_prefetchedPages.cend(), pageIndex))
+    {
+        return Priority::Prefetched;
+    }
+
+    return Priority::Normal;
+}
+
+void PDFPrecompiledPageCache::setCacheLimit(qint64 cacheLimit)
+{
+    m_cacheLimit = cacheLimit;
+
+    // Cache limit is a hard limit, so we must remove also visible pages, if needed
+    makeSpace(0, Priority::Visible);
+
+    while (m_cacheSize > m_cacheLimit && !m_lruList.empty())
+    {
+        remove(m_lruList.back());
+        ++m_statistics.evictions;
+    }
+}
+
+bool PDFPrecompiledPageCache::makeSpace(qint64 requiredSize, Priority maxPriority)
+{
+    if (requiredSize > m_cacheLimit)
+    {
+        return false;
+    }
+
+    // Remove least recently used pages, pages with lower priority first.
+    // Visible pages are never removed to make space for other pages.
+    for (Priority priority : { Priority::Normal, Priority::Prefetched })
+    {
+        if (priority > maxPriority)
+        {
+            break;
+        }
+
+        auto it = m_lruList.end();
+        while (m_cacheSize + requiredSize > m_cacheLimit && it != m_lruList.begin())
+        {
+            --it;
+
+            const PDFInteger pageIndex = *it;
+            if (getPriority(pageIndex) == priority)
+            {
+                // Removing the page invalidates only the iterator of the removed page
+                it = std::next(it);
+                remove(pageIndex);
+                ++m_statistics.evictions;
+            }
+        }
+    }
+
+    return m_cacheSize + requiredSize <= m_cacheLimit;
+}
+
 PDFAsynchronousPageCompilerWorkerThread::PDFAsynchronousPageCompilerWorkerThread(PDFAsynchronousPageCompiler* parent) :
     QThread(parent),
     m_compiler(parent),
@@ -50,12 +203,35 @@ void PDFAsynchronousPageCompilerWorkerThread::run()
                 std::vector<PDFAsynchronousPageCompiler::CompileTask> tasks;
                 for (auto& task : m_compiler->m_tasks)
                 {
-                    if (!task.second.finished)
+                    if (!task.second.finished && !task.second.prefetch)
                     {
                         tasks.push_back(task.second);
                     }
                 }
 
+                if (tasks.empty())
+                {
+                    // Prefetch tasks are compiled only, if no page is waiting to be displayed.
+                    // They are compiled in small batches, so pages, which are requested
+                    // meanwhile for drawing, don't wait for all prefetched pages.
+                    for (auto& task : m_compiler->m_tasks)
+                    {
+                        if (!task.second.finished)
+                        {
+                            tasks.push_back(task.second);
+                        }
+                    }
+
+                    auto comparator = [](const auto& l, const auto& r) { return l.prefetchOrder < r.prefetchOrder; };
+                    std::sort(tasks.begin(), tasks.end(), comparator);
+
+                    const size_t batchSize = qMax(1, QThread::idealThreadCount());
+                    if (tasks.size() > batchSize)
+                    {
+                        tasks.erase(std::next(tasks.begin(), batchSize), tasks.end());
+                    }
+                }
+
                 if (!tasks.empty())
                 {
                     locker.unlock();
@@ -70,6 +246,7 @@ void PDFAsynchronousPageCompilerWorkerThread::run()
                         PDFCMSPointer cms = proxy->getCMSManager()->getCurrentCMS();
                         PDFRenderer renderer(proxy->getDocument(), proxy->getFontCache(), cms.data(), proxy->getOptionalContentActivity(), proxy->getFeatures(), proxy->getMeshQualitySettings());
                         renderer.setOperationControl(m_compiler);
+                        renderer.setImageResolution(task.imageResolution);
                         renderer.compile(&task.precompiledPage, task.pageIndex);
                         task.finished = true;
                         return compiledPage;
@@ -113,9 +290,10 @@ void PDFAsynchronousPageCompilerWorkerThread::run()
 
 PDFAsynchronousPageCompiler::PDFAsynchronousPageCompiler(PDFDrawWidgetProxy* proxy) :
     BaseClass(proxy),
-    m_proxy(proxy)
+    m_proxy(proxy),
+    m_cache(128 * 1024 * 1024)
 {
-    m_cache.setMaxCost(128 * 1024 * 1024);
+
 }
 
 PDFAsynchronousPageCompiler::~PDFAsynchronousPageCompiler()
@@ -204,12 +382,12 @@ void PDFAsynchronousPageCompiler::reset()
     start();
 }
 
-void PDFAsynchronousPageCompiler::setCacheLimit(int limit)
+void PDFAsynchronousPageCompiler::setCacheLimit(qint64 limit)
 {
-    m_cache.setMaxCost(limit);
+    m_cache.setCacheLimit(limit);
 }
 
-const PDFPrecompiledPage* PDFAsynchronousPageCompiler::getCompiledPage(PDFInteger pageIndex, bool compile)
+std::shared_ptr<const PDFPrecompiledPage> PDFAsynchronousPageCompiler::getCompiledPage(PDFInteger pageIndex, bool compile)
 {
     if (m_state != State::Active || !m_proxy->getDocument())
     {
@@ -217,14 +395,25 @@ const PDFPrecompiledPage* PDFAsynchronousPageCompiler::getCompiledPage(PDFIntege
         return nullptr;
     }
 
-    PDFPrecompiledPage* page = m_cache.object(pageIndex);
+    std::shared_ptr<PDFPrecompiledPage> page = m_cache.getPage(pageIndex);
 
-    if (!page && compile)
+    // Images of the page may be decoded with insufficient resolution
+    // for current zoom, then page must be compiled again.
+    const bool isResolutionInsufficient = page && m_imageResolution > 0.0 && page->getImageResolutionLimit() < m_imageResolution;
+
+    if ((!page || isResolutionInsufficient) && compile)
     {
         QMutexLocker locker(&m_mutex);
-        if (!m_tasks.count(pageIndex))
+        auto it = m_tasks.find(pageIndex);
+        if (it == m_tasks.end())
+        {
+            m_tasks.insert(std::make_pair(pageIndex, CompileTask(pageIndex, m_imageResolution * IMAGE_RESOLUTION_MARGIN)));
+            m_waitCondition.wakeOne();
+        }
+        else if (it->second.prefetch)
         {
-            m_tasks.insert(std::make_pair(pageIndex, CompileTask(pageIndex)));
+            // Page is needed now, so it is no longer a low priority task
+            it->second.prefetch = false;
             m_waitCondition.wakeOne();
         }
     }
@@ -245,25 +434,81 @@ void PDFAsynchronousPageCompiler::smartClearCache(const int milisecondsLimit, co
         return;
     }
 
+    setActivePages(activePages);
+    m_cache.removeExpiredPages(milisecondsLimit);
+}
+
+void PDFAsynchronousPageCompiler::setActivePages(const std::vector<PDFInteger>& activePages)
+{
+    std::vector<PDFInteger> sortedPages = activePages;
+    std::sort(sortedPages.begin(), sortedPages.end());
+    sortedPages.erase(std::unique(sortedPages.begin(), sortedPages.end()), sortedPages.end());
+    m_cache.setVisiblePages(qMove(sortedPages));
+}
+
+void PDFAsynchronousPageCompiler::setImageResolution(PDFReal imageResolution)
+{
+    m_imageResolution = imageResolution;
+}
+
+void PDFAsynchronousPageCompiler::prefetchPages(const std::vector<PDFInteger>& pages)
+{
+    if (m_state != State::Active || !m_proxy->getDocument())
+    {
+        // Engine is not active, do nothing
+        return;
+    }
+
+    std::vector<PDFInteger> sortedPages = pages;
+    std::sort(sortedPages.begin(), sortedPages.end());
+    sortedPages.erase(std::unique(sortedPages.begin(), sortedPages.end()), sortedPages.end());
+    m_cache.setPrefetchedPages(sortedPages);
+
     QMutexLocker locker(&m_mutex);
 
-    Q_ASSERT(std::is_sorted(activePages.cbegin(), activePages.cend()));
+    // Cancel stale prefetch requests. If task is being compiled,
+    // it is finished, and compiled page is stored in the cache.
+    for (auto it = m_tasks.begin(); it != m_tasks.end();)
+    {
+        const CompileTask& task = it->second;
+        if (task.prefetch && !task.finished && !std::binary_search(sortedPages.cbegin(), sortedPages.cend(), task.pageIndex))
+        {
+            it = m_tasks.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
 
-    QList<PDFInteger> pageIndices = m_cache.keys();
-    for (const PDFInteger pageIndex : pageIndices)
+    bool isTaskAdded = false;
+    for (size_t i = 0; i < pages.size(); ++i)
     {
-        if (std::binary_search(activePages.cbegin(), activePages.cend(), pageIndex))
+        const PDFInteger pageIndex = pages[i];
+        if (m_cache.contains(pageIndex))
         {
-            // We do not remove active page
             continue;
         }
 
-        const PDFPrecompiledPage* page = m_cache.object(pageIndex);
-        if (page && page->hasExpired(milisecondsLimit))
+        auto it = m_tasks.find(pageIndex);
+        if (it == m_tasks.end())
+        {
+            CompileTask task(pageIndex, m_imageResolution * IMAGE_RESOLUTION_MARGIN);
+            task.prefetch = true;
+            task.prefetchOrder = int(i);
+            m_tasks.insert(std::make_pair(pageIndex, qMove(task)));
+            isTaskAdded = true;
+        }
+        else if (it->second.prefetch)
         {
-            m_cache.remove(pageIndex);
+            it->second.prefetchOrder = int(i);
         }
     }
+
+    if (isTaskAdded)
+    {
+        m_waitCondition.wakeOne();
+    }
 }
 
 void PDFAsynchronousPageCompiler::onPageCompiled()
@@ -283,10 +528,9 @@ void PDFAsynchronousPageCompiler::onPageCompiled()
                 if (m_state == State::Active)
                 {
                     // If we are in active state, try to store precompiled page
-                    PDFPrecompiledPage* page = new PDFPrecompiledPage(std::move(task.precompiledPage));
-                    page->markAccessed();
-                    qint64 memoryConsumptionEstimate = page->getMemoryConsumptionEstimate();
-                    if (m_cache.insert(it->first, page, memoryConsumptionEstimate))
+                    task.precompiledPage.markAccessed();
+                    qint64 memoryConsumptionEstimate = task.precompiledPage.getMemoryConsumptionEstimate();
+                    if (m_cache.insert(it->first, std::move(task.precompiledPage)))
                     {
                         compiledPages.push_back(it->first);
                     }
@@ -294,7 +538,7 @@ void PDFAsynchronousPageCompiler::onPageCompiled()
                     {
                         // We can't insert page to the cache, because cache size is too small. We will
                         // emit error string to inform the user, that cache is too small.
-                        QString message = PDFTranslationContext::tr("Precompiled page size is too high (%1 kB). Cache size is %2 kB. Increase the cache size!").arg(memoryConsumptionEstimate / 1024).arg(m_cache.maxCost() / 1024);
+                        QString message = PDFTranslationContext::tr("Precompiled page size is too high (%1 kB). Cache size is %2 kB. Increase the cache size!").arg(memoryConsumptionEstimate / 1024).arg(m_cache.getCacheLimit() / 1024);
                         errors[it->first] = PDFRenderError(RenderErrorType::Error, message);
                     }
                 }
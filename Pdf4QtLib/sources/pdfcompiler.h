@@ -27,6 +27,9 @@
 #include <QFutureWatcher>
 #include <QWaitCondition>
 
+#include <list>
+#include <memory>
+
 namespace pdf
 {
 class PDFDrawWidgetProxy;
@@ -51,8 +54,113 @@ private:
     QWaitCondition* m_waitCondition;
 };
 
+/// Cache of precompiled pages with memory limit in bytes. If memory limit is
+/// exceeded, then least recently used pages are removed from the cache. Pages
+/// can have priority - visible pages are never removed to make space for other
+/// pages, prefetched pages are removed only to make space for prefetched or visible
+/// pages. Total size of the pages in the cache never exceeds the memory limit.
+/// Cache is not thread safe.
+class PDF4QTLIBSHARED_EXPORT PDFPrecompiledPageCache
+{
+public:
+    explicit PDFPrecompiledPageCache(qint64 cacheLimit);
+
+    enum class Priority
+    {
+        Normal,
+        Prefetched,
+        Visible
+    };
+
+    struct Statistics
+    {
+        qint64 hits = 0;        ///< Number of successful page lookups
+        qint64 misses = 0;      ///< Number of unsuccessful page lookups
+        qint64 evictions = 0;   ///< Number of pages removed to make space for other pages
+        qint64 rejections = 0;  ///< Number of pages, which didn't fit into the cache
+    };
+
+    /// Returns page from the cache and marks it as most recently used.
+    /// If page is not in the cache, nullptr is returned. Page is shared,
+    /// so it stays valid, even if it is removed from the cache meanwhile.
+    /// \param pageIndex Page index
+    std::shared_ptr<PDFPrecompiledPage> getPage(PDFInteger pageIndex);
+
+    /// Inserts page into the cache. Less important pages are removed from the cache,
+    /// if there is not enough space for the page. If page doesn't fit into the
+    /// cache even after that, then it is not inserted and false is returned.
+    /// \param pageIndex Page index
+    /// \param page Precompiled page
+    bool insert(PDFInteger pageIndex, PDFPrecompiledPage page);
+
+    /// Removes page from the cache
+    /// \param pageIndex Page index
+    void remove(PDFInteger pageIndex);
+
+    /// Removes all pages from the cache
+    void clear();
+
+    /// Removes pages with normal priority, which were not accessed for given time
+    /// \param milisecondsLimit Pages with access time above this limit will be removed
+    void removeExpiredPages(qint64 milisecondsLimit);
+
+    /// Sets pages with visible priority
+    /// \param pages Page indices
+    void setVisiblePages(std::vector<PDFInteger> pages);
+
+    /// Sets pages with prefetched priority
+    /// \param pages Page indices
+    void setPrefetchedPages(std::vector<PDFInteger> pages);
+
+    /// Returns priority of the page
+    /// \param pageIndex Page index
+    Priority getPriority(PDFInteger pageIndex) const;
+
+    /// Returns true, if page is in the cache (statistics
+    /// and order of least recently used pages are not changed).
+    /// \param pageIndex Page index
+    bool contains(PDFInteger pageIndex) const { return m_entries.count(pageIndex); }
+
+    /// Sets memory limit of the cache. If cache is bigger than the new
+    /// limit, pages are removed (including visible pages, if needed).
+    /// \param cacheLimit Cache limit [bytes]
+    void setCacheLimit(qint64 cacheLimit);
+
+    qint64 getCacheLimit() const { return m_cacheLimit; }
+    qint64 getCacheSize() const { return m_cacheSize; }
+    size_t getPageCount() const { return m_entries.size(); }
+    const Statistics& getStatistics() const { return m_statistics; }
+    void resetStatistics() { m_statistics = Statistics(); }
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<PDFPrecompiledPage> page;
+        qint64 size = 0;
+        std::list<PDFInteger>::iterator lruIterator;
+    };
+
+    /// Removes least recently used pages with priority at most \p maxPriority,
+    /// until cache size plus \p requiredSize fits into the cache limit.
+    /// Returns true, if enough space was made.
+    bool makeSpace(qint64 requiredSize, Priority maxPriority);
+
+    qint64 m_cacheLimit;
+    qint64 m_cacheSize = 0;
+    std::map<PDFInteger, Entry> m_entries;
+
+    /// Most recently used pages are at the front of the list
+    std::list<PDFInteger> m_lruList;
+
+    /// Sorted visible and prefetched pages
+    std::vector<PDFInteger> m_visiblePages;
+    std::vector<PDFInteger> m_prefetchedPages;
+
+    Statistics m_statistics;
+};
+
 /// Asynchronous page compiler compiles pages asynchronously, and stores them in the
-/// cache. Cache size can be set. This object is designed to cooperate with
+/// cache. Cache size (in bytes) can be set. This object is designed to cooperate with
 /// draw widget proxy.
 class PDFAsynchronousPageCompiler : public QObject, public PDFOperationControl
 {
@@ -83,7 +191,13 @@ public:
 
     /// Sets cache limit in bytes
     /// \param limit Cache limit [bytes]
-    void setCacheLimit(int limit);
+    void setCacheLimit(qint64 limit);
+
+    /// Returns statistics of the precompiled page cache
+    const PDFPrecompiledPageCache::Statistics& getCacheStatistics() const { return m_cache.getStatistics(); }
+
+    /// Returns size of the precompiled pages in the cache in bytes
+    qint64 getCacheSize() const { return m_cache.getCacheSize(); }
 
     enum class State
     {
@@ -101,18 +215,44 @@ public:
     /// Tries to retrieve precompiled page from the cache. If page is not found,
     /// then nullptr is returned (no exception is thrown). If \p compile is set to true,
     /// and page is not found, and compiler is active, then new asynchronous compile
-    /// task is performed.
+    /// task is performed. If page is found, but its images were decoded with lower
+    /// resolution, than current image resolution, then page is compiled again
+    /// and the old page is returned meanwhile. Returned page is shared with the cache,
+    /// so it can be used (for example, by asynchronous rendering), even after it is
+    /// removed from the cache.
     /// \param pageIndex Index of page
     /// \param compile Compile the page, if it is not found in the cache
-    const PDFPrecompiledPage* getCompiledPage(PDFInteger pageIndex, bool compile);
+    std::shared_ptr<const PDFPrecompiledPage> getCompiledPage(PDFInteger pageIndex, bool compile);
 
     /// Performs smart cache clear. Too old pages are removed from the cache,
-    /// but only if these pages are not in active pages. Use this function to
-    /// clear cache to avoid huge memory consumption.
+    /// but only if these pages are not in active or prefetched pages. Active pages
+    /// are pinned in the cache, so they are not removed to make space for other pages.
+    /// Use this function to clear cache to avoid huge memory consumption.
     /// \param milisecondsLimit Pages with access time above this limit will be erased
     /// \param activePages Sorted vector of active pages, which should remain in cache
     void smartClearCache(const int milisecondsLimit, const std::vector<PDFInteger>& activePages);
 
+    /// Sets active pages, which are pinned in the cache, so they are not removed
+    /// to make space for other pages. Call this function each time, when set
+    /// of the visible pages changes.
+    /// \param activePages Active pages
+    void setActivePages(const std::vector<PDFInteger>& activePages);
+
+    /// Requests compilation of pages with low priority. Prefetched pages are compiled
+    /// only, if no other pages are waiting for compilation, in the order of the vector.
+    /// Pending prefetch requests of pages, which are not in the vector, are cancelled.
+    /// Prefetched pages are kept in the cache with higher priority, than other
+    /// pages (but with lower priority, than active pages).
+    /// \param pages Pages to be prefetched, ordered by importance
+    void prefetchPages(const std::vector<PDFInteger>& pages);
+
+    /// Sets resolution (in device pixels per page unit), at which pages are
+    /// displayed. Images of compiled pages are decoded only with resolution
+    /// sufficient for this resolution (with a margin for zooming), so large
+    /// images are not decoded in full resolution, if they are drawn small.
+    /// \param imageResolution Image resolution
+    void setImageResolution(PDFReal imageResolution);
+
     /// Is operation being cancelled?
     virtual bool isOperationCancelled() const override;
 
@@ -125,13 +265,20 @@ private:
 
     void onPageCompiled();
 
+    /// Images are decoded with higher resolution, than is currently needed,
+    /// so page isn't compiled again after each small zoom change.
+    static constexpr PDFReal IMAGE_RESOLUTION_MARGIN = 2.0;
+
     struct CompileTask
     {
         CompileTask() = default;
-        CompileTask(PDFInteger pageIndex) : pageIndex(pageIndex) { }
+        CompileTask(PDFInteger pageIndex, PDFReal imageResolution) : pageIndex(pageIndex), imageResolution(imageResolution) { }
 
         PDFInteger pageIndex = 0;
         bool finished = false;
+        bool prefetch = false;      ///< Low priority task (page is not displayed yet)
+        int prefetchOrder = 0;      ///< Order of the prefetch task (lower is compiled sooner)
+        PDFReal imageResolution = 0.0; ///< Resolution of decoded images, zero means full resolution
         PDFPrecompiledPage precompiledPage;
     };
 
@@ -141,7 +288,8 @@ private:
     PDFAsynchronousPageCompilerWorkerThread* m_thread = nullptr;
 
     PDFDrawWidgetProxy* m_proxy;
-    QCache<PDFInteger, PDFPrecompiledPage> m_cache;
+    PDFPrecompiledPageCache m_cache;
+    PDFReal m_imageResolution = 0.0;
 
     /// This task is protected by mutex. Every access to this
     /// variable must be done with locked mutex.
@@ -42,6 +42,7 @@ static constexpr const char* PDF_FILE_HEADER_REGEXP = "%PDF-([[:digit:]]\\.[[:di
 
 static constexpr const int PDF_HEADER_SCAN_LIMIT = 1024;
 static constexpr const int PDF_FOOTER_SCAN_LIMIT = 1024;
+static constexpr const int PDF_LINEARIZATION_SCAN_LIMIT = 1024;
 
 // Stream dictionary constants - entries common to all stream dictionaries
 static constexpr const char* PDF_STREAM_DICT_LENGTH = "Length";
@@ -0,0 +1,353 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pdfcontentstreambytecode.h"
+#include "pdfdocument.h"
+#include "pdfexception.h"
+#include "pdfstreamfilters.h"
+#include "pdfdbgheap.h"
+
+namespace pdf
+{
+
+PDFContentStreamBytecode PDFContentStreamBytecode::compile(QByteArray content, const PDFDocument* document)
+{
+    PDFContentStreamBytecode bytecode;
+    bytecode.m_content = qMove(content);
+
+    // Tokens are views into the content of the bytecode, so content must
+    // not be changed after this point.
+    const QByteArray& data = bytecode.m_content;
+    PDFLexicalAnalyzer parser(data.constBegin(), data.constEnd());
+
+    while (!parser.isAtEnd())
+    {
+        bool tokenFetched = false;
+        PDFInteger oldParserPosition = parser.pos();
+
+        try
+        {
+            PDFLexicalAnalyzer::Token token = parser.fetch();
+            tokenFetched = true;
+
+            switch (token.type)
+            {
+                case PDFLexicalAnalyzer::TokenType::Command:
+                {
+                    const QByteArrayView command = token.getStringView();
+
+                    if (command == "BI")
+                    {
+                        PDFObject inlineImage = bytecode.readInlineImage(parser, document);
+                        bytecode.m_inlineImages.emplace_back(qMove(inlineImage));
+                        bytecode.addInstruction(InstructionType::InlineImage, uint32_t(bytecode.m_inlineImages.size() - 1), 0);
+                    }
+                    else
+                    {
+                        bytecode.addInstruction(InstructionType::Command, uint32_t(command.data() - data.constData()), uint32_t(command.size()));
+                    }
+                    break;
+                }
+
+                case PDFLexicalAnalyzer::TokenType::EndOfFile:
+                {
+                    // Do nothing, just break, we are at the end
+                    break;
+                }
+
+                default:
+                {
+                    // Push the operand onto the operand stack
+                    bytecode.m_operands.push_back(std::move(token));
+                    break;
+                }
+            }
+        }
+        catch (const PDFException& exception)
+        {
+            // If we get exception when parsing, and parser position is not advanced,
+            // then we must advance it manually, otherwise we get infinite loop.
+            if (!tokenFetched && oldParserPosition == parser.pos() && !parser.isAtEnd())
+            {
+                parser.seek(parser.pos() + 1);
+            }
+
+            bytecode.m_errors.push_back(exception.getMessage());
+            bytecode.addInstruction(InstructionType::Error, uint32_t(bytecode.m_errors.size() - 1), 0);
+        }
+    }
+
+    // Operands can be split between multiple content streams,
+    // so we must also store operands without a command.
+    const size_t usedOperandCount = !bytecode.m_instructions.empty() ? bytecode.m_instructions.back().firstOperand + bytecode.m_instructions.back().operandCount : 0;
+    if (usedOperandCount < bytecode.m_operands.size())
+    {
+        bytecode.addInstruction(InstructionType::Operands, 0, 0);
+    }
+
+    bytecode.m_instructions.shrink_to_fit();
+    bytecode.m_operands.shrink_to_fit();
+    return bytecode;
+}
+
+qint64 PDFContentStreamBytecode::getMemoryConsumptionEstimate() const
+{
+    qint64 result = sizeof(*this);
+    result += m_content.size();
+    result += m_instructions.capacity() * sizeof(Instruction);
+    result += m_operands.capacity() * sizeof(PDFLexicalAnalyzer::Token);
+
+    for (const PDFLexicalAnalyzer::Token& token : m_operands)
+    {
+        if (!token.isView())
+        {
+            result += token.getStringView().size();
+        }
+    }
+
+    for (const PDFObject& inlineImage : m_inlineImages)
+    {
+        result += sizeof(PDFStream) + inlineImage.getStream()->getContent()->size();
+    }
+
+    for (const QString& error : m_errors)
+    {
+        result += error.size() * sizeof(QChar);
+    }
+
+    return result;
+}
+
+PDFObject PDFContentStreamBytecode::readInlineImage(PDFLexicalAnalyzer& parser, const PDFDocument* document) const
+{
+    const QByteArray& content = m_content;
+
+    // Strategy: We will try to find position of BI/ID/EI in the stream. If we can determine
+    // length of the stream explicitly, then we use explicit length. We also create a PDFObject
+    // from the inline image dictionary/image content stream and then process it like XObject.
+    PDFInteger operatorBIPosition = parser.pos();
+    PDFInteger operatorIDPosition = parser.findSubstring("ID", operatorBIPosition);
+    PDFInteger operatorEIPosition = parser.findSubstring("EI", operatorIDPosition);
+
+    // According the PDF 1.7 specification, single white space characters is after ID, then the byte
+    // immediately after it is interpreted as first byte of image data.
+    PDFInteger startDataPosition = operatorIDPosition + 3;
+
+    if (operatorIDPosition == -1 || operatorEIPosition == -1)
+    {
+        throw PDFException(PDFTranslationContext::tr("Invalid inline image dictionary, ID operator is missing."));
+    }
+
+    Q_ASSERT(operatorBIPosition < content.size());
+    Q_ASSERT(operatorIDPosition < content.size());
+    Q_ASSERT(operatorBIPosition <= operatorIDPosition);
+
+    PDFLexicalAnalyzer inlineImageLexicalAnalyzer(content.constBegin() + operatorBIPosition, content.constBegin() + operatorIDPosition);
+    PDFParser inlineImageParser([&inlineImageLexicalAnalyzer]{ return inlineImageLexicalAnalyzer.fetch(); });
+
+    constexpr std::pair<const char*, const char*> replacements[] =
+    {
+        { "BPC", "BitsPerComponent" },
+        { "CS", "ColorSpace" },
+        { "D", "Decode" },
+        { "DP", "DecodeParms" },
+        { "F", "Filter" },
+        { "H", "Height" },
+        { "IM", "ImageMask" },
+        { "I", "Interpolate" },
+        { "W", "Width" },
+        { "L", "Length" },
+        { "G", "DeviceGray" },
+        { "RGB", "DeviceRGB" },
+        { "CMYK", "DeviceCMYK" }
+    };
+
+    std::shared_ptr<PDFDictionary> dictionarySharedPointer = std::make_shared<PDFDictionary>();
+    PDFDictionary* dictionary = dictionarySharedPointer.get();
+
+    while (inlineImageParser.lookahead().type != PDFLexicalAnalyzer::TokenType::EndOfFile)
+    {
+        PDFObject nameObject = inlineImageParser.getObject();
+        PDFObject valueObject = inlineImageParser.getObject();
+
+        if (!nameObject.isName())
+        {
+            throw PDFException(PDFTranslationContext::tr("Expected name in the inline image dictionary stream."));
+        }
+
+        // Replace the name, if neccessary
+        QByteArray name = nameObject.getString();
+        for (auto [string, replacement] : replacements)
+        {
+            if (name == string)
+            {
+                name = replacement;
+                break;
+            }
+        }
+
+        dictionary->addEntry(PDFInplaceOrMemoryString(qMove(name)), qMove(valueObject));
+    }
+
+    PDFDocumentDataLoaderDecorator loader(document);
+    PDFInteger dataLength = 0;
+
+    if (dictionary->hasKey("Length"))
+    {
+        dataLength = loader.readIntegerFromDictionary(dictionary, "Length", 0);
+    }
+    else if (dictionary->hasKey("Filter"))
+    {
+        dataLength = -1;
+
+        // We will try to use stream filter hint
+        QByteArray filterName = loader.readNameFromDictionary(dictionary, "Filter");
+        if (!filterName.isEmpty())
+        {
+            dataLength = PDFStreamFilterStorage::getStreamDataLength(content, filterName, startDataPosition);
+        }
+
+        if (dataLength == -1)
+        {
+            // We will use EI operator position to determine stream length
+            dataLength = operatorEIPosition - startDataPosition;
+        }
+    }
+    else
+    {
+        // We will calculate stream size from the with/height and bit per component
+        const PDFInteger width = loader.readIntegerFromDictionary(dictionary, "Width", 0);
+        const PDFInteger height = loader.readIntegerFromDictionary(dictionary, "Height", 0);
+        const PDFInteger bpc = loader.readIntegerFromDictionary(dictionary, "BitsPerComponent", 8);
+
+        if (width <= 0 || height <= 0 || bpc <= 0)
+        {
+            throw PDFException(PDFTranslationContext::tr("Expected name in the inline image dictionary stream."));
+        }
+
+        const PDFInteger stride = (width * bpc + 7) / 8;
+        dataLength = stride * height;
+    }
+
+    // We will once more find the "EI" operator, due to recomputed dataLength.
+    operatorEIPosition = parser.findSubstring("EI", startDataPosition + dataLength);
+    if (operatorEIPosition == -1)
+    {
+        throw PDFException(PDFTranslationContext::tr("Invalid inline image stream."));
+    }
+
+    // We must seek after EI operator.
+    parser.seek(operatorEIPosition + 2);
+
+    QByteArray buffer = content.mid(startDataPosition, dataLength);
+    return PDFObject::createStream(std::make_shared<PDFStream>(std::move(*dictionary), std::move(buffer)));
+}
+
+void PDFContentStreamBytecode::addInstruction(InstructionType type, uint32_t data, uint32_t dataSize)
+{
+    Instruction instruction;
+    instruction.type = type;
+    instruction.firstOperand = !m_instructions.empty() ? m_instructions.back().firstOperand + m_instructions.back().operandCount : 0;
+    instruction.operandCount = uint32_t(m_operands.size() - instruction.firstOperand);
+    instruction.data = data;
+    instruction.dataSize = dataSize;
+    m_instructions.push_back(instruction);
+}
+
+PDFContentStreamBytecodePointer PDFContentStreamBytecodeCache::getBytecode(const PDFDocument* document, PDFObjectReference reference, const PDFStream* stream)
+{
+    {
+        QMutexLocker lock(&m_mutex);
+
+        auto it = m_entries.find(reference);
+        if (it != m_entries.end() && it->second.stream == stream)
+        {
+            // Mark the entry as most recently used
+            m_lruList.splice(m_lruList.begin(), m_lruList, it->second.lruIterator);
+            return it->second.bytecode;
+        }
+    }
+
+    // Decode and compile the stream without the lock, so multiple
+    // content streams can be compiled in parallel.
+    PDFContentStreamBytecodePointer bytecode = std::make_shared<const PDFContentStreamBytecode>(PDFContentStreamBytecode::compile(document->getDecodedStream(stream), document));
+    const qint64 size = bytecode->getMemoryConsumptionEstimate();
+
+    QMutexLocker lock(&m_mutex);
+
+    auto it = m_entries.find(reference);
+    if (it != m_entries.end())
+    {
+        // Stream was compiled meanwhile in another thread, or entry is obsolete
+        m_cacheSize -= it->second.size;
+        m_lruList.erase(it->second.lruIterator);
+        m_entries.erase(it);
+    }
+
+    if (size <= m_cacheLimit)
+    {
+        m_lruList.push_front(reference);
+
+        Entry entry;
+        entry.bytecode = bytecode;
+        entry.stream = stream;
+        entry.size = size;
+        entry.lruIterator = m_lruList.begin();
+        m_entries.emplace(reference, qMove(entry));
+        m_cacheSize += size;
+
+        shrink();
+    }
+
+    return bytecode;
+}
+
+void PDFContentStreamBytecodeCache::setCacheLimit(qint64 cacheLimit)
+{
+    QMutexLocker lock(&m_mutex);
+    m_cacheLimit = cacheLimit;
+    shrink();
+}
+
+qint64 PDFContentStreamBytecodeCache::getCacheSize() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_cacheSize;
+}
+
+void PDFContentStreamBytecodeCache::clear()
+{
+    QMutexLocker lock(&m_mutex);
+    m_entries.clear();
+    m_lruList.clear();
+    m_cacheSize = 0;
+}
+
+void PDFContentStreamBytecodeCache::shrink()
+{
+    while (m_cacheSize > m_cacheLimit && !m_lruList.empty())
+    {
+        auto it = m_entries.find(m_lruList.back());
+        Q_ASSERT(it != m_entries.end());
+
+        m_cacheSize -= it->second.size;
+        m_entries.erase(it);
+        m_lruList.pop_back();
+    }
+}
+
+}   // namespace pdf
@@ -0,0 +1,176 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef PDFCONTENTSTREAMBYTECODE_H
+#define PDFCONTENTSTREAMBYTECODE_H
+
+#include "pdfglobal.h"
+#include "pdfobject.h"
+#include "pdfparser.h"
+
+#include <QMutex>
+#include <QByteArray>
+
+#include <map>
+#include <list>
+#include <memory>
+#include <vector>
+
+namespace pdf
+{
+class PDFDocument;
+
+/// Content stream, which was decoded and tokenized. It is stored as an array
+/// of instructions (commands with their operands), which can be executed repeatedly
+/// without decoding and lexical analysis of the content stream. Operands and commands
+/// are views into the decoded content, which is stored together with the instructions.
+/// Inline images are parsed during compilation, syntax errors of the content stream
+/// are stored as error instructions, so they are reported when bytecode is executed.
+class PDF4QTLIBSHARED_EXPORT PDFContentStreamBytecode
+{
+public:
+    explicit PDFContentStreamBytecode() = default;
+
+    enum class InstructionType : uint8_t
+    {
+        Command,        ///< Execute command with operands
+        InlineImage,    ///< Paint inline image (BI/ID/EI operators)
+        Error,          ///< Report error in the content stream
+        Operands        ///< Push operands only (operands at the end of the content stream)
+    };
+
+    struct Instruction
+    {
+        InstructionType type = InstructionType::Command;
+        uint32_t firstOperand = 0;
+        uint32_t operandCount = 0;
+
+        /// Offset of the command in the content (Command), index
+        /// of the inline image (InlineImage) or index of the error (Error)
+        uint32_t data = 0;
+
+        /// Length of the command (Command)
+        uint32_t dataSize = 0;
+    };
+
+    using Instructions = std::vector<Instruction>;
+
+    /// Compiles the decoded content stream. Function doesn't throw exceptions,
+    /// errors in the content stream are stored as error instructions.
+    /// \param content Decoded content stream
+    /// \param document Document (used to parse inline image dictionaries)
+    static PDFContentStreamBytecode compile(QByteArray content, const PDFDocument* document);
+
+    /// Returns instructions of the compiled content stream
+    const Instructions& getInstructions() const { return m_instructions; }
+
+    /// Returns operand with given index
+    /// \param index Index of the operand
+    const PDFLexicalAnalyzer::Token& getOperand(size_t index) const { return m_operands[index]; }
+
+    /// Returns command of the instruction of type Command
+    /// \param instruction Instruction
+    QByteArrayView getCommand(const Instruction& instruction) const { return QByteArrayView(m_content.constData() + instruction.data, instruction.dataSize); }
+
+    /// Returns inline image of the instruction of type InlineImage
+    /// \param instruction Instruction
+    const PDFStream* getInlineImage(const Instruction& instruction) const { return m_inlineImages[instruction.data].getStream(); }
+
+    /// Returns error message of the instruction of type Error
+    /// \param instruction Instruction
+    const QString& getError(const Instruction& instruction) const { return m_errors[instruction.data]; }
+
+    /// Returns estimate of the memory consumption in bytes
+    qint64 getMemoryConsumptionEstimate() const;
+
+private:
+    /// Reads inline image. Lexical analyzer must be positioned after the BI
+    /// operator, it is positioned after the EI operator, if image is read.
+    /// If error occurs, exception is thrown.
+    /// \param parser Lexical analyzer of the content stream
+    /// \param document Document
+    PDFObject readInlineImage(PDFLexicalAnalyzer& parser, const PDFDocument* document) const;
+
+    /// Adds instruction. All operands, which were not used by
+    /// previous instructions, are operands of this instruction.
+    void addInstruction(InstructionType type, uint32_t data, uint32_t dataSize);
+
+    QByteArray m_content;
+    Instructions m_instructions;
+    std::vector<PDFLexicalAnalyzer::Token> m_operands;
+    std::vector<PDFObject> m_inlineImages;
+    std::vector<QString> m_errors;
+};
+
+using PDFContentStreamBytecodePointer = std::shared_ptr<const PDFContentStreamBytecode>;
+
+/// Cache of compiled content streams of the document (page content streams
+/// and form XObjects), keyed by object reference. When cache limit is exceeded,
+/// least recently used content streams are removed from the cache. Cache is thread safe.
+class PDF4QTLIBSHARED_EXPORT PDFContentStreamBytecodeCache
+{
+public:
+    static constexpr qint64 DEFAULT_CACHE_LIMIT = 128 * 1024 * 1024;
+
+    explicit PDFContentStreamBytecodeCache(qint64 cacheLimit = DEFAULT_CACHE_LIMIT) :
+        m_cacheLimit(cacheLimit)
+    {
+
+    }
+
+    /// Returns compiled content stream. If it is not in the cache, then content stream
+    /// is decoded, compiled and inserted into the cache. If stream can't be decoded,
+    /// then exception is thrown.
+    /// \param document Document, to which the stream belongs
+    /// \param reference Reference to the content stream
+    /// \param stream Content stream
+    PDFContentStreamBytecodePointer getBytecode(const PDFDocument* document, PDFObjectReference reference, const PDFStream* stream);
+
+    /// Sets cache limit in bytes. If cache exceeds the limit, it is shrinked.
+    /// \param cacheLimit Cache limit in bytes
+    void setCacheLimit(qint64 cacheLimit);
+
+    /// Returns estimated size of the cached data in bytes
+    qint64 getCacheSize() const;
+
+    /// Removes all compiled content streams from the cache
+    void clear();
+
+private:
+    struct Entry
+    {
+        PDFContentStreamBytecodePointer bytecode;
+        const PDFStream* stream = nullptr;
+        qint64 size = 0;
+        std::list<PDFObjectReference>::iterator lruIterator;
+    };
+
+    /// Removes least recently used entries, until cache limit is satisfied
+    void shrink();
+
+    mutable QMutex m_mutex;
+    qint64 m_cacheLimit;
+    qint64 m_cacheSize = 0;
+    std::map<PDFObjectReference, Entry> m_entries;
+
+    /// Most recently used references are at the front of the list
+    std::list<PDFObjectReference> m_lruList;
+};
+
+}   // namespace pdf
+
+#endif // PDFCONTENTSTREAMBYTECODE_H
@@ -17,12 +17,18 @@
 
 
 #include "pdfdocument.h"
+#include "pdfcontentstreambytecode.h"
+#include "pdfimagecache.h"
 #include "pdfencoding.h"
 #include "pdfexception.h"
 #include "pdfstreamfilters.h"
 #include "pdfconstants.h"
+#include "pdfexecutionpolicy.h"
 #include "pdfdbgheap.h"
 
+#include <algorithm>
+#include <numeric>
+
 namespace pdf
 {
 
@@ -33,6 +39,11 @@ QByteArray PDFObjectStorage::getDecodedStream(const PDFStream* stream) const
     return PDFStreamFilterStorage::getDecodedStream(stream, std::bind(QOverload<const PDFObject&>::of(&PDFObjectStorage::getObject), this, std::placeholders::_1), getSecurityHandler());
 }
 
+PDFStreamDataSourcePointer PDFObjectStorage::createDecodedStreamDataSource(const PDFStream* stream) const
+{
+    return PDFStreamFilterStorage::createDecodedStreamDataSource(stream, std::bind(QOverload<const PDFObject&>::of(&PDFObjectStorage::getObject), this, std::placeholders::_1), getSecurityHandler());
+}
+
 PDFDocument::~PDFDocument()
 {
 
@@ -69,6 +80,11 @@ QByteArray PDFDocument::getDecodedStream(const PDFStream* stream) const
     return m_pdfObjectStorage.getDecodedStream(stream);
 }
 
+PDFStreamDataSourcePointer PDFDocument::createDecodedStreamDataSource(const PDFStream* stream) const
+{
+    return m_pdfObjectStorage.createDecodedStreamDataSource(stream);
+}
+
 const PDFDictionary* PDFDocument::getTrailerDictionary() const
 {
     const PDFObject& trailerDictionary = m_pdfObjectStorage.getTrailerDictionary();
@@ -102,6 +118,8 @@ QByteArray PDFDocument::getVersion() const
 
 void PDFDocument::init()
 {
+    m_contentStreamBytecodeCache = std::make_shared<PDFContentStreamBytecodeCache>();
+    m_imageCache = std::make_shared<PDFImageCache>();
     initInfo();
 
     const PDFDictionary* dictionary = getTrailerDictionary();
@@ -122,26 +140,142 @@ void PDFDocument::initInfo()
     }
 }
 
+PDFObjectStorage::PDFObjectStorage(PDFObjects&& objects,
+                                   PDFObject&& trailerDictionary,
+                                   PDFSecurityHandlerPointer&& securityHandler,
+                                   PDFObjectLoaderPointer loader) :
+    m_objects(std::move(objects)),
+    m_trailerDictionary(std::move(trailerDictionary)),
+    m_securityHandler(std::move(securityHandler)),
+    m_objectLoader(qMove(loader))
+{
+    if (m_objectLoader)
+    {
+        m_loadedOnDemand.assign(m_objects.size(), true);
+    }
+}
+
 bool PDFObjectStorage::operator==(const PDFObjectStorage& other) const
 {
     // We compare just content. Security handler just defines encryption behavior.
-    return m_objects == other.m_objects &&
-           m_trailerDictionary == other.m_trailerDictionary;
+    return m_objects.size() == other.m_objects.size() &&
+           m_trailerDictionary == other.m_trailerDictionary &&
+           getModifiedReferences(other).empty();
+}
+
+std::vector<PDFObjectReference> PDFObjectStorage::getModifiedReferences(const PDFObjectStorage& originalStorage) const
+{
+    const size_t objectCount = qMax(m_objects.size(), originalStorage.m_objects.size());
+
+    auto getEntry = [](const PDFObjectStorage& storage, size_t index)
+    {
+        if (index >= storage.m_objects.size())
+        {
+            return Entry();
+        }
+
+        Entry entry = storage.m_objects[index];
+        if (storage.isLoadedOnDemand(index))
+        {
+            entry.object = storage.m_objectLoader->loadObject(PDFObjectReference(static_cast<PDFInteger>(index), entry.generation));
+        }
+        return entry;
+    };
+
+    std::vector<PDFObjectReference> references(objectCount);
+    auto checkModified = [&](size_t index)
+    {
+        // Objects loaded on demand by the same loader were not changed
+        if (isLoadedOnDemand(index) &&
+            originalStorage.isLoadedOnDemand(index) &&
+            m_objectLoader == originalStorage.m_objectLoader &&
+            m_objects[index].generation == originalStorage.m_objects[index].generation)
+        {
+            return;
+        }
+
+        const Entry entry = getEntry(*this, index);
+        const Entry originalEntry = getEntry(originalStorage, index);
+
+        if ((entry.object.isNull() && originalEntry.object.isNull()) || entry == originalEntry)
+        {
+            return;
+        }
+
+        const PDFInteger generation = entry.object.isNull() ? originalEntry.generation : entry.generation;
+        references[index] = PDFObjectReference(static_cast<PDFInteger>(index), generation);
+    };
+
+    std::vector<size_t> indices(objectCount, 0);
+    std::iota(indices.begin(), indices.end(), 0);
+    PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Unknown, indices.cbegin(), indices.cend(), checkModified);
+
+    // Object number zero is never used, so it is the mark of unmodified object
+    references.erase(std::remove_if(references.begin(), references.end(), [](const PDFObjectReference& reference) { return reference.objectNumber == 0; }), references.end());
+    return references;
+}
+
+PDFObjectStorage::PDFObjects PDFObjectStorage::getObjects() const
+{
+    if (!m_objectLoader)
+    {
+        return m_objects;
+    }
+
+    PDFObjects objects = m_objects;
+
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+        if (isLoadedOnDemand(i))
+        {
+            indices.push_back(i);
+        }
+    }
+
+    auto loadObject = [this, &objects](size_t index)
+    {
+        Entry& entry = objects[index];
+        entry.object = m_objectLoader->loadObject(PDFObjectReference(static_cast<PDFInteger>(index), entry.generation));
+    };
+    PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Unknown, indices.cbegin(), indices.cend(), loadObject);
+
+    return objects;
+}
+
+PDFObjectStorage::PDFObjects& PDFObjectStorage::getObjects()
+{
+    // Caller can modify the objects, so we must load them all
+    // and we no longer can load objects on demand.
+    loadAllObjects();
+    return m_objects;
+}
+
+void PDFObjectStorage::loadAllObjects()
+{
+    if (m_objectLoader)
+    {
+        m_objects = static_cast<const PDFObjectStorage*>(this)->getObjects();
+        m_objectLoader.reset();
+        m_loadedOnDemand.clear();
+    }
 }
 
-const PDFObject& PDFObjectStorage::getObject(PDFObjectReference reference) const
+PDFObject PDFObjectStorage::getObject(PDFObjectReference reference) const
 {
     if (reference.objectNumber >= 0 &&
         reference.objectNumber < static_cast<PDFInteger>(m_objects.size()) &&
         m_objects[reference.objectNumber].generation == reference.generation)
     {
+        if (isLoadedOnDemand(reference.objectNumber))
+        {
+            return m_objectLoader->loadObject(reference);
+        }
+
         return m_objects[reference.objectNumber].object;
     }
-    else
-    {
-        static const PDFObject dummy;
-        return dummy;
-    }
+
+    return PDFObject();
 }
 
 PDFObjectReference PDFObjectStorage::addObject(PDFObject object)
@@ -154,6 +288,12 @@ PDFObjectReference PDFObjectStorage::addObject(PDFObject object)
 void PDFObjectStorage::setObject(PDFObjectReference reference, PDFObject object)
 {
     m_objects[reference.objectNumber] = Entry(reference.generation, qMove(object));
+
+    if (isLoadedOnDemand(reference.objectNumber))
+    {
+        // Object was replaced, do not load the original one
+        m_loadedOnDemand[reference.objectNumber] = false;
+    }
 }
 
 void PDFObjectStorage::updateTrailerDictionary(PDFObject trailerDictionary)
@@ -643,7 +783,7 @@ std::vector<QByteArray> PDFDocumentDataLoaderDecorator::readStringArray(const PD
     return std::vector<QByteArray>();
 }
 
-const PDFObject& PDFObjectStorage::getObject(const PDFObject& object) const
+PDFObject PDFObjectStorage::getObject(const PDFObject& object) const
 {
     if (object.isReference())
     {
@@ -22,6 +22,7 @@
 #include "pdfobject.h"
 #include "pdfcatalog.h"
 #include "pdfsecurityhandler.h"
+#include "pdfstreamfilters.h"
 
 #include <QtCore>
 #include <QColor>
@@ -34,6 +35,28 @@ namespace pdf
 {
 class PDFDocument;
 class PDFDocumentBuilder;
+class PDFContentStreamBytecodeCache;
+class PDFImageCache;
+
+/// Interface for loading objects on demand. If object storage has an object loader,
+/// then objects are not parsed when document is being opened, but when they are
+/// accessed. Object storage doesn't keep loaded objects, loader is responsible
+/// for keeping them, while it exists, so content of the loaded object (for example,
+/// dictionary) stays valid for the lifetime of the storage. Each object must be
+/// loaded only once. Implementation must be thread safe.
+class PDF4QTLIBSHARED_EXPORT PDFObjectLoader
+{
+public:
+    explicit inline PDFObjectLoader() = default;
+    virtual ~PDFObjectLoader() = default;
+
+    /// Loads object with given reference (object is parsed and decrypted).
+    /// If object cannot be loaded, null object is returned. No exception is thrown.
+    /// \param reference Reference to the object
+    virtual PDFObject loadObject(PDFObjectReference reference) const = 0;
+};
+
+using PDFObjectLoaderPointer = std::shared_ptr<const PDFObjectLoader>;
 
 /// Storage for objects. This class is not thread safe for writing (calling non-const functions). Caller must ensure
 /// locking, if this object is used from multiple threads. Calling const functions should be thread safe.
@@ -73,15 +96,28 @@ public:
 
     }
 
+    /// Creates object storage, in which objects are loaded on demand. Entries
+    /// in \p objects must have valid generation numbers, objects are loaded
+    /// by \p loader, when they are accessed. Loaded objects are kept by the loader,
+    /// so only objects, which were accessed, consume memory.
+    /// \param objects Object entries (objects are not loaded yet)
+    /// \param trailerDictionary Trailer dictionary
+    /// \param securityHandler Security handler
+    /// \param loader Object loader
+    explicit PDFObjectStorage(PDFObjects&& objects, PDFObject&& trailerDictionary, PDFSecurityHandlerPointer&& securityHandler, PDFObjectLoaderPointer loader);
+
     /// Returns object from the object storage. If invalid reference is passed,
-    /// then null object is returned (no exception is thrown).
-    const PDFObject& getObject(PDFObjectReference reference) const;
+    /// then null object is returned (no exception is thrown). Object is returned
+    /// by value, because objects loaded on demand are not stored in the storage,
+    /// but content of the object (for example, dictionary) is owned by the storage
+    /// (or its object loader) and it is valid, as long as the storage exists.
+    PDFObject getObject(PDFObjectReference reference) const;
 
     /// If object is reference, the dereference attempt is performed
     /// and object is returned. If it is not a reference, then self
     /// is returned. If dereference attempt fails, then null object
     /// is returned (no exception is thrown).
-    const PDFObject& getObject(const PDFObject& object) const;
+    PDFObject getObject(const PDFObject& object) const;
 
     /// Returns dictionary from an object. If object is not a dictionary,
     /// then nullptr is returned (no exception is thrown).
@@ -89,16 +125,38 @@ public:
 
     /// Returns object by reference. If dereference attempt fails, then null object
     /// is returned (no exception is thrown).
-    const PDFObject& getObjectByReference(PDFObjectReference reference) const;
+    PDFObject getObjectByReference(PDFObjectReference reference) const;
 
-    /// Returns array of objects stored in this storage
-    const PDFObjects& getObjects() const { return m_objects; }
+    /// Returns copy of array of objects stored in this storage. If objects
+    /// are loaded on demand, all objects are loaded (in parallel) by the
+    /// object loader, but they are not stored in the storage.
+    PDFObjects getObjects() const;
 
-    /// Returns array of objects stored in this storage
-    PDFObjects& getObjects() { return m_objects; }
+    /// Returns array of objects stored in this storage. If objects are loaded
+    /// on demand, all objects are loaded into the storage first, and they are
+    /// no longer loaded on demand.
+    PDFObjects& getObjects();
+
+    /// Returns number of objects (including objects, which are not loaded yet)
+    size_t getObjectCount() const { return m_objects.size(); }
+
+    /// Returns references of objects, which are new, changed or deleted in this
+    /// storage compared to the original storage. Objects, which are loaded on demand
+    /// by the same loader in both storages, are unchanged, so they are not loaded.
+    /// References of deleted objects have generation number of the original object.
+    /// References are sorted by object number.
+    /// \param originalStorage Original storage
+    std::vector<PDFObjectReference> getModifiedReferences(const PDFObjectStorage& originalStorage) const;
 
     /// Sets array of objects
-    void setObjects(PDFObjects&& objects) { m_objects = qMove(objects); }
+    void setObjects(PDFObjects&& objects) { m_objects = qMove(objects); m_objectLoader.reset(); m_loadedOnDemand.clear(); }
+
+    /// Returns true, if some objects are loaded on demand by the object loader
+    bool isLazyLoading() const { return m_objectLoader != nullptr; }
+
+    /// Loads all objects, which are loaded on demand, into the storage. Objects
+    /// are loaded in parallel. If objects are not loaded on demand, nothing happens.
+    void loadAllObjects();
 
     /// Returns trailer dictionary
     const PDFObject& getTrailerDictionary() const { return m_trailerDictionary; }
@@ -131,14 +189,30 @@ public:
     /// \param stream Stream to be decoded
     QByteArray getDecodedStream(const PDFStream* stream) const;
 
+    /// Creates data source, from which decoded data of the stream can be read
+    /// incrementally. If stream filters are invalid, nullptr is returned.
+    /// Storage must exist, until data source is destroyed.
+    /// \param stream Stream to be decoded
+    PDFStreamDataSourcePointer createDecodedStreamDataSource(const PDFStream* stream) const;
+
     /// Set trailer dictionary
     /// \param object Object defining trailer dictionary
     void setTrailerDictionary(const PDFObject& object) { m_trailerDictionary = object; }
 
 private:
+    /// Returns true, if object with given index is loaded on demand by the object loader
+    bool isLoadedOnDemand(size_t index) const { return m_objectLoader && index < m_loadedOnDemand.size() && m_loadedOnDemand[index]; }
+
     PDFObjects m_objects;
     PDFObject m_trailerDictionary;
     PDFSecurityHandlerPointer m_securityHandler;
+
+    /// Object loader (objects are loaded on demand), or nullptr
+    PDFObjectLoaderPointer m_objectLoader;
+
+    /// Flags, which objects are loaded on demand (i.e. they were not
+    /// replaced using setObject, or loaded into the storage)
+    std::vector<bool> m_loadedOnDemand;
 };
 
 /// Loads data from the object contained in the PDF document, such as integers,
@@ -426,7 +500,7 @@ public:
     /// and object is returned. If it is not a reference, then self
     /// is returned. If dereference attempt fails, then null object
     /// is returned (no exception is thrown).
-    const PDFObject& getObject(const PDFObject& object) const;
+    PDFObject getObject(const PDFObject& object) const;
 
     /// Returns dictionary from an object. If object is not a dictionary,
     /// then nullptr is returned (no exception is thrown).
@@ -434,7 +508,7 @@ public:
 
     /// Returns object by reference. If dereference attempt fails, then null object
     /// is returned (no exception is thrown).
-    const PDFObject& getObjectByReference(PDFObjectReference reference) const;
+    PDFObject getObjectByReference(PDFObjectReference reference) const;
 
     /// Returns the document catalog
     const PDFCatalog* getCatalog() const { return &m_catalog; }
@@ -444,6 +518,12 @@ public:
     /// \param stream Stream to be decoded
     QByteArray getDecodedStream(const PDFStream* stream) const;
 
+    /// Creates data source, from which decoded data of the stream can be read
+    /// incrementally. If stream filters are invalid, nullptr is returned.
+    /// Document must exist, until data source is destroyed.
+    /// \param stream Stream to be decoded
+    PDFStreamDataSourcePointer createDecodedStreamDataSource(const PDFStream* stream) const;
+
     /// Returns the trailer dictionary
     const PDFDictionary* getTrailerDictionary() const;
 
@@ -452,6 +532,14 @@ public:
     /// header.
     QByteArray getVersion() const;
 
+    /// Returns cache of compiled content streams (page contents, forms) of this
+    /// document. Cache is thread safe. If document is not initialized, nullptr is returned.
+    PDFContentStreamBytecodeCache* getContentStreamBytecodeCache() const { return m_contentStreamBytecodeCache.get(); }
+
+    /// Returns cache of decoded images of this document. Cache is thread
+    /// safe. If document is not initialized, nullptr is returned.
+    PDFImageCache* getImageCache() const { return m_imageCache.get(); }
+
     explicit PDFDocument(PDFObjectStorage&& storage, PDFVersion version) :
         m_pdfObjectStorage(std::move(storage))
     {
@@ -482,6 +570,12 @@ private:
 
     /// Catalog object
     PDFCatalog m_catalog;
+
+    /// Cache of compiled content streams
+    std::shared_ptr<PDFContentStreamBytecodeCache> m_contentStreamBytecodeCache;
+
+    /// Cache of decoded images
+    std::shared_ptr<PDFImageCache> m_imageCache;
 };
 
 using PDFDocumentPointer = QSharedPointer<PDFDocument>;
@@ -568,7 +662,7 @@ private:
 // Implementation
 
 inline
-const PDFObject& PDFDocument::getObject(const PDFObject& object) const
+PDFObject PDFDocument::getObject(const PDFObject& object) const
 {
     if (object.isReference())
     {
@@ -596,7 +690,7 @@ const PDFDictionary* PDFDocument::getDictionaryFromObject(const PDFObject& objec
 }
 
 inline
-const PDFObject& PDFDocument::getObjectByReference(PDFObjectReference reference) const
+PDFObject PDFDocument::getObjectByReference(PDFObjectReference reference) const
 {
     return m_pdfObjectStorage.getObject(reference);
 }
@@ -618,7 +712,7 @@ const PDFDictionary* PDFObjectStorage::getDictionaryFromObject(const PDFObject&
 }
 
 inline
-const PDFObject& PDFObjectStorage::getObjectByReference(PDFObjectReference reference) const
+PDFObject PDFObjectStorage::getObjectByReference(PDFObjectReference reference) const
 {
     return getObject(reference);
 }
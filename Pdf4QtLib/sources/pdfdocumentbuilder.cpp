@@ -683,7 +683,7 @@ void PDFDocumentBuilder::reset()
 
 void PDFDocumentBuilder::createDocument()
 {
-    if (!m_storage.getObjects().empty())
+    if (m_storage.getObjectCount() > 0)
     {
         reset();
     }
@@ -703,7 +703,7 @@ void PDFDocumentBuilder::setDocument(const PDFDocument* document)
 
 PDFDocument PDFDocumentBuilder::build()
 {
-    updateTrailerDictionary(m_storage.getObjects().size());
+    updateTrailerDictionary(m_storage.getObjectCount());
     return PDFDocument(PDFObjectStorage(m_storage), m_version);
 }
 
@@ -346,7 +346,7 @@ public:
     /// and object is returned. If it is not a reference, then self
     /// is returned. If dereference attempt fails, then null object
     /// is returned (no exception is thrown).
-    const PDFObject& getObject(const PDFObject& object) const;
+    PDFObject getObject(const PDFObject& object) const;
 
     /// Returns dictionary from an object. If object is not a dictionary,
     /// then nullptr is returned (no exception is thrown).
@@ -354,7 +354,7 @@ public:
 
     /// Returns object by reference. If dereference attempt fails, then null object
     /// is returned (no exception is thrown).
-    const PDFObject& getObjectByReference(PDFObjectReference reference) const;
+    PDFObject getObjectByReference(PDFObjectReference reference) const;
 
     /// Returns the decoded stream. If stream data cannot be decoded,
     /// then empty byte array is returned.
@@ -1622,7 +1622,7 @@ private:
 // Implementation
 
 inline
-const PDFObject& PDFDocumentBuilder::getObject(const PDFObject& object) const
+PDFObject PDFDocumentBuilder::getObject(const PDFObject& object) const
 {
     if (object.isReference())
     {
@@ -1650,7 +1650,7 @@ const PDFDictionary* PDFDocumentBuilder::getDictionaryFromObject(const PDFObject
 }
 
 inline
-const PDFObject& PDFDocumentBuilder::getObjectByReference(PDFObjectReference reference) const
+PDFObject PDFDocumentBuilder::getObjectByReference(PDFObjectReference reference) const
 {
     return m_storage.getObject(reference);
 }
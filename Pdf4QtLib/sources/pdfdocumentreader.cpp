@@ -23,9 +23,11 @@
 #include "pdfparser.h"
 #include "pdfstreamfilters.h"
 #include "pdfexecutionpolicy.h"
+#include "pdflinearization.h"
 #include "pdfdbgheap.h"
 
 #include <QFile>
+#include <QCache>
 
 #include <regex>
 #include <cctype>
@@ -35,6 +37,665 @@
 namespace pdf
 {
 
+/// Maximal size of decoded object streams in the cache of lazy object loader (in bytes)
+static constexpr const int PDF_LAZY_LOADER_OBJECT_STREAM_CACHE_LIMIT = 32 * 1024 * 1024;
+
+/// Minimal size of the window, in which object is read from byte range source
+static constexpr const PDFInteger PDF_LAZY_LOADER_MIN_WINDOW_SIZE = 4096;
+
+/// Size of the data, in which object header of the page object is verified
+static constexpr const PDFInteger PDF_LAZY_LOADER_OBJECT_HEADER_SIZE = 32;
+
+/// Reads indirect object from the source data at given offset. Checks, that scanned
+/// object has the same reference, as expected. Throws exception, if object can't be read.
+/// \param source Source data (can be only part of the file)
+/// \param sourceOffset Offset of the source data in the file
+/// \param context Parsing context
+/// \param offset Offset of the object in the file
+/// \param reference Reference to the object
+static PDFObject readIndirectObject(const QByteArray& source, PDFInteger sourceOffset, PDFParsingContext* context, PDFInteger offset, PDFObjectReference reference)
+{
+    PDFParsingContext::PDFParsingContextGuard guard(context, reference);
+
+    PDFParser parser(source, context, PDFParser::AllowStreams);
+    parser.seek(offset - sourceOffset);
+
+    PDFObject objectNumber = parser.getObject();
+    PDFObject generation = parser.getObject();
+
+    if (!objectNumber.isInt() || !generation.isInt())
+    {
+        throw PDFException(PDFDocumentReader::tr("Can't read object at position %1.").arg(offset));
+    }
+
+    if (!parser.fetchCommand(PDF_OBJECT_START_MARK))
+    {
+        throw PDFException(PDFDocumentReader::tr("Can't read object at position %1.").arg(offset));
+    }
+
+    PDFObject object = parser.getObject();
+
+    if (!parser.fetchCommand(PDF_OBJECT_END_MARK))
+    {
+        throw PDFException(PDFDocumentReader::tr("Can't read object at position %1.").arg(offset));
+    }
+
+    PDFObjectReference scannedReference(objectNumber.getInteger(), generation.getInteger());
+    if (scannedReference != reference)
+    {
+        throw PDFException(PDFDocumentReader::tr("Can't read object at position %1.").arg(offset));
+    }
+
+    return object;
+}
+
+/// Scans data for indirect objects (object header "n g obj") and stores
+/// offsets of found objects. Offsets of objects are absolute (offset of data is added).
+/// \param data Data to be scanned
+/// \param dataOffset Offset of the data in the file
+/// \param offsets Found object offsets (first occurence of object is stored)
+static void scanObjectOffsets(const QByteArray& data, PDFInteger dataOffset, std::map<PDFObjectReference, PDFInteger>& offsets)
+{
+    const int shift = static_cast<int>(std::strlen(PDF_OBJECT_START_MARK));
+
+    auto skipWhitespace = [&data](int position) { while (position >= 0 && PDFLexicalAnalyzer::isWhitespace(data[position])) { --position; } return position; };
+    auto skipDigits = [&data](int position) { while (position >= 0 && std::isdigit(static_cast<unsigned char>(data[position]))) { --position; } return position; };
+
+    int startOffset = data.indexOf(PDF_OBJECT_START_MARK);
+    while (startOffset != -1)
+    {
+        const int generationEnd = skipWhitespace(startOffset - 1);
+        const int generationStart = skipDigits(generationEnd);
+        const int objectNumberEnd = skipWhitespace(generationStart);
+        const int objectNumberStart = skipDigits(objectNumberEnd);
+
+        const bool isObjectHeader = generationEnd < startOffset - 1 &&
+                                    generationStart < generationEnd &&
+                                    objectNumberEnd < generationStart &&
+                                    objectNumberStart < objectNumberEnd &&
+                                    (objectNumberStart < 0 || PDFLexicalAnalyzer::isWhitespace(data[objectNumberStart]));
+
+        if (isObjectHeader)
+        {
+            const PDFInteger objectNumber = data.mid(objectNumberStart + 1, objectNumberEnd - objectNumberStart).toLongLong();
+            const PDFInteger generation = data.mid(generationStart + 1, generationEnd - generationStart).toLongLong();
+            offsets.emplace(PDFObjectReference(objectNumber, generation), dataOffset + objectNumberStart + 1);
+        }
+
+        startOffset = data.indexOf(PDF_OBJECT_START_MARK, startOffset + shift);
+    }
+}
+
+/// Decoded object stream (stream of type ObjStm) with parsed object
+/// numbers and offsets of the objects stored in the object stream.
+struct PDFDecodedObjectStream
+{
+    QByteArray data;
+    std::vector<std::pair<PDFInteger, PDFInteger>> objectNumberAndOffset;
+
+    /// Returns offset of the object in the decoded data. Index of the object
+    /// in the object stream (from the reference table) is used as a hint.
+    /// If object is not found in the object stream, -1 is returned.
+    /// \param objectNumber Object number
+    /// \param indexInObjectStream Index of the object in the object stream
+    PDFInteger getObjectOffset(PDFInteger objectNumber, PDFInteger indexInObjectStream) const;
+
+    /// Decodes object stream and parses object numbers and offsets
+    /// of the objects. If error occurs, exception is thrown.
+    /// \param object Object stream
+    /// \param objectStreamReference Reference to the object stream
+    /// \param context Parsing context
+    /// \param securityHandler Security handler
+    static PDFDecodedObjectStream decode(const PDFObject& object,
+                                         PDFObjectReference objectStreamReference,
+                                         PDFParsingContext* context,
+                                         const PDFSecurityHandler* securityHandler);
+};
+
+using PDFDecodedObjectStreamPointer = std::shared_ptr<const PDFDecodedObjectStream>;
+
+PDFInteger PDFDecodedObjectStream::getObjectOffset(PDFInteger objectNumber, PDFInteger indexInObjectStream) const
+{
+    if (indexInObjectStream >= 0 &&
+        indexInObjectStream < static_cast<PDFInteger>(objectNumberAndOffset.size()) &&
+        objectNumberAndOffset[indexInObjectStream].first == objectNumber)
+    {
+        return objectNumberAndOffset[indexInObjectStream].second;
+    }
+
+    auto it = std::find_if(objectNumberAndOffset.cbegin(), objectNumberAndOffset.cend(), [objectNumber](const auto& item) { return item.first == objectNumber; });
+    if (it != objectNumberAndOffset.cend())
+    {
+        return it->second;
+    }
+
+    return -1;
+}
+
+PDFDecodedObjectStream PDFDecodedObjectStream::decode(const PDFObject& object,
+                                                      PDFObjectReference objectStreamReference,
+                                                      PDFParsingContext* context,
+                                                      const PDFSecurityHandler* securityHandler)
+{
+    if (!object.isStream())
+    {
+        throw PDFException(PDFTranslationContext::tr("Object stream %1 is invalid.").arg(objectStreamReference.objectNumber));
+    }
+
+    const PDFStream* objectStream = object.getStream();
+    const PDFDictionary* objectStreamDictionary = objectStream->getDictionary();
+
+    const PDFObject& objectStreamType = objectStreamDictionary->get("Type");
+    if (!objectStreamType.isName() || objectStreamType.getString() != "ObjStm")
+    {
+        throw PDFException(PDFTranslationContext::tr("Object stream %1 is invalid.").arg(objectStreamReference.objectNumber));
+    }
+
+    const PDFObject& nObject = objectStreamDictionary->get("N");
+    const PDFObject& firstObject = objectStreamDictionary->get("First");
+    if (!nObject.isInt() || !firstObject.isInt())
+    {
+        throw PDFException(PDFTranslationContext::tr("Object stream %1 is invalid.").arg(objectStreamReference.objectNumber));
+    }
+
+    // Number of objects in object stream dictionary
+    const PDFInteger n = nObject.getInteger();
+    const PDFInteger first = firstObject.getInteger();
+
+    PDFDecodedObjectStream result;
+    result.data = PDFStreamFilterStorage::getDecodedStream(objectStream, securityHandler);
+
+    PDFParsingContext::PDFParsingContextGuard guard(context, objectStreamReference);
+    PDFParser parser(result.data, context, PDFParser::AllowStreams);
+
+    result.objectNumberAndOffset.reserve(qBound(PDFInteger(0), n, PDFInteger(result.data.size())));
+    for (PDFInteger i = 0; i < n; ++i)
+    {
+        PDFObject currentObjectNumber = parser.getObject();
+        PDFObject currentOffset = parser.getObject();
+
+        if (!currentObjectNumber.isInt() || !currentOffset.isInt())
+        {
+            throw PDFException(PDFTranslationContext::tr("Object stream %1 is invalid.").arg(objectStreamReference.objectNumber));
+        }
+
+        result.objectNumberAndOffset.emplace_back(currentObjectNumber.getInteger(), currentOffset.getInteger() + first);
+    }
+
+    return result;
+}
+
+/// Object loader used, when document is read with lazy loading enabled. Objects
+/// are read from the byte range source using reference table, parsed and decrypted,
+/// when they are requested. Only byte range of the requested object is read from
+/// the source. Loaded objects are kept by the loader, while it exists, so pointers
+/// to their content (for example, dictionaries) stay valid for the lifetime of the
+/// document. Only byte windows read from the source and decoded object streams
+/// are released, decoded object streams are kept in the cache bounded by memory
+/// consumption, so objects from the same object stream are parsed only once,
+/// when they are accessed in sequence.
+///
+/// If document is linearized, then reference table contains only objects of the
+/// first page. Other objects are located using hint tables, or, if they can't be
+/// located, main reference table is read, when it is needed for the first time.
+class PDFLazyObjectLoader : public PDFObjectLoader
+{
+public:
+    explicit PDFLazyObjectLoader(PDFByteRangeSourcePointer source,
+                                 PDFXRefTable xrefTable,
+                                 PDFObjectReference encryptObjectReference);
+
+    virtual PDFObject loadObject(PDFObjectReference reference) const override;
+
+    /// Sets security handler. Must be called before loader is used
+    /// from multiple threads.
+    void setSecurityHandler(PDFSecurityHandlerPointer securityHandler) { m_securityHandler = qMove(securityHandler); }
+
+    /// Sets offset of the main reference table. Reference table of this loader is
+    /// then treated as first page reference table of the linearized document, and
+    /// main reference table is read, when object is not found in the first page
+    /// reference table. Must be called before loader is used from multiple threads.
+    /// \param mainXRefTableOffset Offset of the main reference table
+    void setMainXRefTableOffset(PDFInteger mainXRefTableOffset) { m_mainXRefTableOffset = mainXRefTableOffset; }
+
+    /// Reads hint tables of the linearized document. If hint tables can't be read,
+    /// only main reference table is used. Must be called after security handler is
+    /// set, and before loader is used from multiple threads. Returns true, if hint
+    /// tables were read.
+    /// \param dictionary Linearization dictionary
+    bool readHintTables(const PDFLinearizationDictionary& dictionary);
+
+    /// Returns linearization info (valid only, if hint tables were read)
+    const PDFLinearizationInfo& getLinearizationInfo() const { return m_linearizationInfo; }
+
+private:
+    /// Reference table with sorted offsets of occupied entries
+    struct XRefTableData
+    {
+        void setXRefTable(PDFXRefTable table);
+
+        PDFXRefTable xrefTable;
+        std::vector<PDFInteger> offsets;
+    };
+
+    /// Loads object (object is loaded only once). Can throw exception.
+    PDFObject loadObjectImpl(PDFObjectReference reference) const;
+
+    /// Loads object from the object stream. Decoded object stream is stored
+    /// in the cache, so object stream is not decoded again, when other objects
+    /// from the same object stream are loaded. Can throw exception.
+    PDFObject loadObjectFromObjectStream(const PDFXRefTable::Entry& entry) const;
+
+    /// Returns decoded object stream (using cache). Can throw exception.
+    PDFDecodedObjectStreamPointer getDecodedObjectStream(PDFParsingContext* context, PDFObjectReference objectStreamReference) const;
+
+    /// Reads object at given offset from the source. Can throw exception.
+    PDFObject readObject(PDFParsingContext* context, PDFInteger offset, PDFObjectReference reference) const;
+
+    /// Fetches object from the reference table without decryption. It is used
+    /// in the parsing context, for example, when stream length is a reference.
+    PDFObject getObjectFromXrefTable(PDFParsingContext* context, PDFObjectReference reference) const;
+
+    /// Returns reference table entry for given reference. If document is
+    /// linearized, then object is located using hint tables or main reference table.
+    PDFXRefTable::Entry getEntry(PDFObjectReference reference) const;
+
+    /// Finds object offset using hint tables. If object is not found, -1 is returned.
+    PDFInteger findLinearizedObjectOffset(PDFObjectReference reference) const;
+
+    /// Returns main reference table (table is read, if it was not read yet). Returns
+    /// nullptr, if document is not linearized (first reference table is complete).
+    const XRefTableData* getMainXRefTable() const;
+
+    /// Finds loaded object. Returns true, if object was found.
+    /// \param reference Reference to the object
+    /// \param object Found object
+    bool findLoadedObject(PDFObjectReference reference, PDFObject& object) const;
+
+    /// Inserts object into loaded objects. If other thread has loaded the same
+    /// object meanwhile, then object loaded by the other thread is returned,
+    /// so all callers share the same content of the object.
+    /// \param reference Reference to the object
+    /// \param object Loaded object
+    PDFObject insertLoadedObject(PDFObjectReference reference, PDFObject object) const;
+
+    PDFByteRangeSourcePointer m_source;
+    XRefTableData m_xrefTable;
+    PDFSecurityHandlerPointer m_securityHandler;
+    PDFObjectReference m_encryptObjectReference;
+
+    mutable QMutex m_cacheMutex;
+    mutable std::map<PDFObjectReference, PDFObject> m_loadedObjects;
+    mutable QCache<PDFObjectReference, PDFDecodedObjectStreamPointer> m_objectStreamCache;
+
+    /// Linearization info (hint tables)
+    PDFLinearizationInfo m_linearizationInfo;
+
+    /// Offset of main reference table (document is linearized and reference
+    /// table contains only objects of the first page), -1 otherwise.
+    PDFInteger m_mainXRefTableOffset = -1;
+
+    mutable QMutex m_linearizationMutex;
+    mutable std::atomic_bool m_isMainXRefTableRead = false;
+    mutable XRefTableData m_mainXRefTable;
+
+    /// Offsets of objects found in byte ranges from the hint tables
+    mutable std::map<PDFObjectReference, PDFInteger> m_linearizedObjectOffsets;
+
+    /// Byte ranges from the hint tables, which were already scanned
+    mutable std::set<PDFInteger> m_scannedByteRanges;
+};
+
+void PDFLazyObjectLoader::XRefTableData::setXRefTable(PDFXRefTable table)
+{
+    xrefTable = qMove(table);
+    offsets.clear();
+
+    std::vector<PDFXRefTable::Entry> occupiedEntries = xrefTable.getOccupiedEntries();
+    offsets.reserve(occupiedEntries.size());
+    for (const PDFXRefTable::Entry& entry : occupiedEntries)
+    {
+        offsets.push_back(entry.offset);
+    }
+    std::sort(offsets.begin(), offsets.end());
+}
+
+PDFLazyObjectLoader::PDFLazyObjectLoader(PDFByteRangeSourcePointer source,
+                                         PDFXRefTable xrefTable,
+                                         PDFObjectReference encryptObjectReference) :
+    m_source(qMove(source)),
+    m_encryptObjectReference(encryptObjectReference),
+    m_objectStreamCache(PDF_LAZY_LOADER_OBJECT_STREAM_CACHE_LIMIT)
+{
+    m_xrefTable.setXRefTable(qMove(xrefTable));
+}
+
+bool PDFLazyObjectLoader::readHintTables(const PDFLinearizationDictionary& dictionary)
+{
+    try
+    {
+        // Hint stream is a part of the first page section, so it is in the first page reference table
+        PDFObjectReference hintStreamReference;
+        for (const PDFXRefTable::Entry& entry : m_xrefTable.xrefTable.getOccupiedEntries())
+        {
+            if (entry.offset == dictionary.getHintStreamOffset())
+            {
+                hintStreamReference = entry.reference;
+                break;
+            }
+        }
+
+        if (!hintStreamReference.isValid())
+        {
+            throw PDFException(PDFDocumentReader::tr("Hint stream is invalid."));
+        }
+
+        PDFObject hintStreamObject = loadObjectImpl(hintStreamReference);
+        if (!hintStreamObject.isStream())
+        {
+            throw PDFException(PDFDocumentReader::tr("Hint stream is invalid."));
+        }
+
+        const PDFStream* hintStream = hintStreamObject.getStream();
+        QByteArray hintStreamData = PDFStreamFilterStorage::getDecodedStream(hintStream, m_securityHandler.data());
+        m_linearizationInfo = PDFLinearizationInfo::parse(dictionary, hintStream, hintStreamData, m_xrefTable.xrefTable.getSize());
+        return true;
+    }
+    catch (const PDFException&)
+    {
+        // Hint tables are not used, main reference table will be used instead
+        m_linearizationInfo = PDFLinearizationInfo();
+    }
+
+    return false;
+}
+
+PDFObject PDFLazyObjectLoader::loadObject(PDFObjectReference reference) const
+{
+    try
+    {
+        return loadObjectImpl(reference);
+    }
+    catch (const PDFException&)
+    {
+        // Object can't be loaded, treat it as null object
+    }
+
+    return PDFObject();
+}
+
+PDFObject PDFLazyObjectLoader::loadObjectImpl(PDFObjectReference reference) const
+{
+    PDFObject loadedObject;
+    if (findLoadedObject(reference, loadedObject))
+    {
+        return loadedObject;
+    }
+
+    const PDFXRefTable::Entry entry = getEntry(reference);
+    switch (entry.type)
+    {
+        case PDFXRefTable::EntryType::Free:
+            return PDFObject();
+
+        case PDFXRefTable::EntryType::Occupied:
+        {
+            auto objectFetcher = [this](PDFParsingContext* context, PDFObjectReference reference) { return getObjectFromXrefTable(context, reference); };
+            PDFParsingContext context(objectFetcher);
+            PDFObject object = readObject(&context, entry.offset, reference);
+
+            // Encryption dictionary is never encrypted
+            if (m_securityHandler && m_securityHandler->getMode() != EncryptionMode::None && reference != m_encryptObjectReference)
+            {
+                object = m_securityHandler->decryptObject(object, reference);
+            }
+
+            return insertLoadedObject(reference, qMove(object));
+        }
+
+        case PDFXRefTable::EntryType::InObjectStream:
+            return loadObjectFromObjectStream(entry);
+
+        default:
+        {
+            Q_ASSERT(false);
+            break;
+        }
+    }
+
+    return PDFObject();
+}
+
+PDFObject PDFLazyObjectLoader::loadObjectFromObjectStream(const PDFXRefTable::Entry& entry) const
+{
+    const PDFObjectReference objectStreamReference = entry.objectStream;
+
+    auto objectFetcher = [this](PDFParsingContext* context, PDFObjectReference reference) { return getObjectFromXrefTable(context, reference); };
+    PDFParsingContext context(objectFetcher);
+
+    PDFDecodedObjectStreamPointer objectStream = getDecodedObjectStream(&context, objectStreamReference);
+    const PDFInteger offset = objectStream->getObjectOffset(entry.reference.objectNumber, entry.indexInObjectStream);
+    if (offset == -1)
+    {
+        // Object is not in the object stream, treat it as null object
+        return PDFObject();
+    }
+
+    PDFParsingContext::PDFParsingContextGuard guard(&context, objectStreamReference);
+    PDFParser parser(objectStream->data, &context, PDFParser::AllowStreams);
+    parser.seek(offset);
+    PDFObject object = parser.getObject();
+
+    return insertLoadedObject(entry.reference, qMove(object));
+}
+
+PDFDecodedObjectStreamPointer PDFLazyObjectLoader::getDecodedObjectStream(PDFParsingContext* context, PDFObjectReference objectStreamReference) const
+{
+    {
+        QMutexLocker lock(&m_cacheMutex);
+        if (const PDFDecodedObjectStreamPointer* objectStream = m_objectStreamCache.object(objectStreamReference))
+        {
+            return *objectStream;
+        }
+    }
+
+    const PDFObject object = loadObjectImpl(objectStreamReference);
+    PDFDecodedObjectStreamPointer objectStream = std::make_shared<const PDFDecodedObjectStream>(PDFDecodedObjectStream::decode(object, objectStreamReference, context, m_securityHandler.data()));
+
+    const qsizetype cost = objectStream->data.size() + objectStream->objectNumberAndOffset.size() * sizeof(std::pair<PDFInteger, PDFInteger>);
+    QMutexLocker lock(&m_cacheMutex);
+    m_objectStreamCache.insert(objectStreamReference, new PDFDecodedObjectStreamPointer(objectStream), cost);
+    return objectStream;
+}
+
+PDFObject PDFLazyObjectLoader::readObject(PDFParsingContext* context, PDFInteger offset, PDFObjectReference reference) const
+{
+    // Object ends before the start of the next object in the usual case, so
+    // we read just the data between these two offsets. If object can't be read,
+    // we will try it again with larger window (file can be updated incrementally).
+    const PDFInteger size = m_source->getSize();
+    PDFInteger nextOffset = size;
+
+    auto updateNextOffset = [offset, &nextOffset](const std::vector<PDFInteger>& offsets)
+    {
+        auto it = std::upper_bound(offsets.cbegin(), offsets.cend(), offset);
+        if (it != offsets.cend())
+        {
+            nextOffset = qMin(nextOffset, *it);
+        }
+    };
+
+    updateNextOffset(m_xrefTable.offsets);
+    if (m_isMainXRefTableRead.load(std::memory_order_acquire))
+    {
+        updateNextOffset(m_mainXRefTable.offsets);
+    }
+    else if (m_mainXRefTableOffset != -1)
+    {
+        // Reference table is not complete, so we do not know, where the object
+        // ends. Do not read the whole remainder of the file, start with small window.
+        nextOffset = qMin(nextOffset, offset + PDF_LAZY_LOADER_MIN_WINDOW_SIZE);
+    }
+
+    PDFInteger windowSize = nextOffset - offset;
+    while (true)
+    {
+        QByteArray window = m_source->read(offset, windowSize);
+        const bool isWholeRemainder = offset + window.size() >= size;
+
+        try
+        {
+            return readIndirectObject(window, offset, context, offset, reference);
+        }
+        catch (const PDFException&)
+        {
+            if (isWholeRemainder)
+            {
+                throw;
+            }
+
+            windowSize = qMin(qMax(windowSize * 4, PDF_LAZY_LOADER_MIN_WINDOW_SIZE), size - offset);
+        }
+    }
+
+    return PDFObject();
+}
+
+PDFObject PDFLazyObjectLoader::getObjectFromXrefTable(PDFParsingContext* context, PDFObjectReference reference) const
+{
+    const PDFXRefTable::Entry entry = getEntry(reference);
+    if (entry.type == PDFXRefTable::EntryType::Occupied)
+    {
+        return readObject(context, entry.offset, reference);
+    }
+
+    return PDFObject();
+}
+
+PDFXRefTable::Entry PDFLazyObjectLoader::getEntry(PDFObjectReference reference) const
+{
+    const PDFXRefTable::Entry& entry = m_xrefTable.xrefTable.getEntry(reference);
+    if (entry.type != PDFXRefTable::EntryType::Free || m_mainXRefTableOffset == -1)
+    {
+        return entry;
+    }
+
+    // Document is linearized, first try to find object using hint tables,
+    // so we do not need to read main reference table at the end of the file.
+    const PDFInteger offset = findLinearizedObjectOffset(reference);
+    if (offset != -1)
+    {
+        PDFXRefTable::Entry linearizedEntry;
+        linearizedEntry.reference = reference;
+        linearizedEntry.offset = offset;
+        linearizedEntry.type = PDFXRefTable::EntryType::Occupied;
+        return linearizedEntry;
+    }
+
+    return getMainXRefTable()->xrefTable.getEntry(reference);
+}
+
+PDFInteger PDFLazyObjectLoader::findLinearizedObjectOffset(PDFObjectReference reference) const
+{
+    if (!m_linearizationInfo.isValid())
+    {
+        return -1;
+    }
+
+    // Page objects are located directly, so page tree can be built without
+    // reading of the whole page byte range. Just object header is verified.
+    if (reference.generation == 0)
+    {
+        const PDFInteger pageObjectOffset = m_linearizationInfo.findPageObjectOffset(reference.objectNumber);
+        if (pageObjectOffset != -1)
+        {
+            const PDFInteger headerLength = qMin(PDF_LAZY_LOADER_OBJECT_HEADER_SIZE, m_source->getSize() - pageObjectOffset);
+            if (headerLength > 0)
+            {
+                std::map<PDFObjectReference, PDFInteger> headerOffsets;
+                scanObjectOffsets(m_source->read(pageObjectOffset, headerLength), pageObjectOffset, headerOffsets);
+
+                auto it = headerOffsets.find(reference);
+                if (it != headerOffsets.cend() && it->second == pageObjectOffset)
+                {
+                    return pageObjectOffset;
+                }
+            }
+        }
+    }
+
+    const PDFLinearizationInfo::ByteRange byteRange = m_linearizationInfo.findObjectByteRange(reference.objectNumber);
+    if (!byteRange.isValid())
+    {
+        return -1;
+    }
+
+    QMutexLocker lock(&m_linearizationMutex);
+
+    if (!m_scannedByteRanges.count(byteRange.offset))
+    {
+        // Byte range is marked as scanned only, if it was read successfully
+        scanObjectOffsets(m_source->read(byteRange.offset, byteRange.length), byteRange.offset, m_linearizedObjectOffsets);
+        m_scannedByteRanges.insert(byteRange.offset);
+    }
+
+    auto it = m_linearizedObjectOffsets.find(reference);
+    if (it != m_linearizedObjectOffsets.cend())
+    {
+        return it->second;
+    }
+
+    return -1;
+}
+
+const PDFLazyObjectLoader::XRefTableData* PDFLazyObjectLoader::getMainXRefTable() const
+{
+    if (!m_isMainXRefTableRead.load(std::memory_order_acquire))
+    {
+        QMutexLocker lock(&m_linearizationMutex);
+        if (!m_isMainXRefTableRead.load(std::memory_order_relaxed))
+        {
+            PDFXRefTable xrefTable;
+
+            try
+            {
+                xrefTable.readXRefTable(nullptr, m_source.get(), m_mainXRefTableOffset);
+            }
+            catch (const PDFException&)
+            {
+                // Main reference table is damaged, objects outside
+                // the first page will be treated as null objects.
+                xrefTable = PDFXRefTable();
+            }
+
+            m_mainXRefTable.setXRefTable(qMove(xrefTable));
+            m_isMainXRefTableRead.store(true, std::memory_order_release);
+        }
+    }
+
+    return &m_mainXRefTable;
+}
+
+bool PDFLazyObjectLoader::findLoadedObject(PDFObjectReference reference, PDFObject& object) const
+{
+    QMutexLocker lock(&m_cacheMutex);
+
+    auto it = m_loadedObjects.find(reference);
+    if (it != m_loadedObjects.end())
+    {
+        object = it->second;
+        return true;
+    }
+
+    return false;
+}
+
+PDFObject PDFLazyObjectLoader::insertLoadedObject(PDFObjectReference reference, PDFObject object) const
+{
+    QMutexLocker lock(&m_cacheMutex);
+    return m_loadedObjects.emplace(reference, qMove(object)).first->second;
+}
+
 PDFDocumentReader::PDFDocumentReader(PDFProgress* progress, const std::function<QString(bool*)>& getPasswordCallback, bool permissive, bool authorizeOwnerOnly) :
     m_result(Result::OK),
     m_getPasswordCallback(getPasswordCallback),
@@ -53,6 +714,23 @@ PDFDocument PDFDocumentReader::readFromFile(const QString& fileName)
 
     if (file.exists())
     {
+        if (m_lazyLoading)
+        {
+            // Try to map the file into the memory. File must stay opened, while
+            // the memory is mapped, so it is owned by the object loader.
+            std::shared_ptr<QFile> mappedFile = std::make_shared<QFile>(fileName);
+            if (mappedFile->open(QFile::ReadOnly) && mappedFile->size() > 0)
+            {
+                if (uchar* data = mappedFile->map(0, mappedFile->size()))
+                {
+                    m_mappedFile = qMove(mappedFile);
+                    return readFromBuffer(QByteArray::fromRawData(reinterpret_cast<const char*>(data), m_mappedFile->size()));
+                }
+            }
+
+            // File can't be mapped, so read it as usual
+        }
+
         if (file.open(QFile::ReadOnly))
         {
             PDFDocument document = readFromDevice(&file);
@@ -165,7 +843,7 @@ void PDFDocumentReader::checkHeader(const QByteArray& buffer)
 
 PDFInteger PDFDocumentReader::findXrefTableOffset(const QByteArray& buffer)
 {
-    const int startXRefPosition = findFromEnd(PDF_START_OF_XREF_MARK, buffer, PDF_FOOTER_SCAN_LIMIT);
+    const PDFInteger startXRefPosition = findFromEnd(PDF_START_OF_XREF_MARK, buffer, PDF_FOOTER_SCAN_LIMIT);
     if (startXRefPosition == FIND_NOT_FOUND_RESULT)
     {
         throw PDFException(tr("Start of object reference table not found."));
@@ -179,44 +857,13 @@ PDFInteger PDFDocumentReader::findXrefTableOffset(const QByteArray& buffer)
         throw PDFException(tr("Start of object reference table not found."));
     }
 
-    const PDFInteger firstXrefTableOffset = token.data.toLongLong();
+    const PDFInteger firstXrefTableOffset = token.getInteger();
     return firstXrefTableOffset;
 }
 
 PDFObject PDFDocumentReader::getObject(PDFParsingContext* context, PDFInteger offset, PDFObjectReference reference) const
 {
-    PDFParsingContext::PDFParsingContextGuard guard(context, reference);
-
-    PDFParser parser(m_source, context, PDFParser::AllowStreams);
-    parser.seek(offset);
-
-    PDFObject objectNumber = parser.getObject();
-    PDFObject generation = parser.getObject();
-
-    if (!objectNumber.isInt() || !generation.isInt())
-    {
-        throw PDFException(tr("Can't read object at position %1.").arg(offset));
-    }
-
-    if (!parser.fetchCommand(PDF_OBJECT_START_MARK))
-    {
-        throw PDFException(tr("Can't read object at position %1.").arg(offset));
-    }
-
-    PDFObject object = parser.getObject();
-
-    if (!parser.fetchCommand(PDF_OBJECT_END_MARK))
-    {
-        throw PDFException(tr("Can't read object at position %1.").arg(offset));
-    }
-
-    PDFObjectReference scannedReference(objectNumber.getInteger(), generation.getInteger());
-    if (scannedReference != reference)
-    {
-        throw PDFException(tr("Can't read object at position %1.").arg(offset));
-    }
-
-    return object;
+    return readIndirectObject(m_source, 0, context, offset, reference);
 }
 
 PDFObject PDFDocumentReader::getObjectFromXrefTable(PDFXRefTable* xrefTable, PDFParsingContext* context, PDFObjectReference reference) const
@@ -426,17 +1073,26 @@ PDFDocumentReader::Result PDFDocumentReader::processSecurityHandler(const PDFObj
 
 void PDFDocumentReader::processObjectStreams(PDFXRefTable* xrefTable, PDFObjectStorage::PDFObjects& objects)
 {
-    // Then process object streams
+    // Then process object streams. We create index of object streams by object
+    // number, so we can check in constant time, that object is really stored in
+    // the object stream. Each object belongs to at most one object stream, so
+    // object streams can be processed in parallel without locking.
     std::vector<PDFXRefTable::Entry> objectStreamEntries = xrefTable->getObjectStreamEntries();
+    std::vector<PDFObjectReference> objectStreamIndex(objects.size());
     std::set<PDFObjectReference> objectStreams;
     for (const PDFXRefTable::Entry& entry : objectStreamEntries)
     {
         Q_ASSERT(entry.type == PDFXRefTable::EntryType::InObjectStream);
         objectStreams.insert(entry.objectStream);
+
+        if (entry.reference.objectNumber >= 0 && entry.reference.objectNumber < static_cast<PDFInteger>(objectStreamIndex.size()))
+        {
+            objectStreamIndex[entry.reference.objectNumber] = entry.objectStream;
+        }
     }
 
     auto objectFetcher = [this, xrefTable](PDFParsingContext* context, PDFObjectReference reference) { return getObjectFromXrefTable(xrefTable, context, reference); };
-    auto processObjectStream = [this, &objectFetcher, &objects, &objectStreamEntries] (const PDFObjectReference& objectStreamReference)
+    auto processObjectStream = [this, &objectFetcher, &objects, &objectStreamIndex] (const PDFObjectReference& objectStreamReference)
     {
         if (m_result != Result::OK)
         {
@@ -452,70 +1108,23 @@ void PDFDocumentReader::processObjectStreams(PDFXRefTable* xrefTable, PDFObjectS
             }
 
             const PDFObject& object = objects[objectStreamReference.objectNumber].object;
-            if (!object.isStream())
-            {
-                throw PDFException(PDFTranslationContext::tr("Object stream %1 is invalid.").arg(objectStreamReference.objectNumber));
-            }
-
-            const PDFStream* objectStream = object.getStream();
-            const PDFDictionary* objectStreamDictionary = objectStream->getDictionary();
-
-            const PDFObject& objectStreamType = objectStreamDictionary->get("Type");
-            if (!objectStreamType.isName() || objectStreamType.getString() != "ObjStm")
-            {
-                throw PDFException(PDFTranslationContext::tr("Object stream %1 is invalid.").arg(objectStreamReference.objectNumber));
-            }
-
-            const PDFObject& nObject = objectStreamDictionary->get("N");
-            const PDFObject& firstObject = objectStreamDictionary->get("First");
-            if (!nObject.isInt() || !firstObject.isInt())
-            {
-                throw PDFException(PDFTranslationContext::tr("Object stream %1 is invalid.").arg(objectStreamReference.objectNumber));
-            }
-
-            // Number of objects in object stream dictionary
-            const PDFInteger n = nObject.getInteger();
-            const PDFInteger first = firstObject.getInteger();
-
-            QByteArray objectStreamData = PDFStreamFilterStorage::getDecodedStream(objectStream, m_securityHandler.data());
+            PDFDecodedObjectStream objectStream = PDFDecodedObjectStream::decode(object, objectStreamReference, &context, m_securityHandler.data());
 
             PDFParsingContext::PDFParsingContextGuard guard(&context, objectStreamReference);
-            PDFParser parser(objectStreamData, &context, PDFParser::AllowStreams);
+            PDFParser parser(objectStream.data, &context, PDFParser::AllowStreams);
 
-            std::vector<std::pair<PDFInteger, PDFInteger>> objectNumberAndOffset;
-            objectNumberAndOffset.reserve(n);
-            for (PDFInteger i = 0; i < n; ++i)
+            for (const auto& [objectNumber, offset] : objectStream.objectNumberAndOffset)
             {
-                PDFObject currentObjectNumber = parser.getObject();
-                PDFObject currentOffset = parser.getObject();
-
-                if (!currentObjectNumber.isInt() || !currentOffset.isInt())
+                if (objectNumber < 0 ||
+                    objectNumber >= static_cast<PDFInteger>(objectStreamIndex.size()) ||
+                    objectStreamIndex[objectNumber] != objectStreamReference)
                 {
-                    throw PDFException(PDFTranslationContext::tr("Object stream %1 is invalid.").arg(objectStreamReference.objectNumber));
+                    // Silently ignore this error. It is not critical, so, maybe this object will be null.
+                    continue;
                 }
 
-                const PDFInteger objectNumber = currentObjectNumber.getInteger();
-                const PDFInteger offset = currentOffset.getInteger() + first;
-                objectNumberAndOffset.emplace_back(objectNumber, offset);
-            }
-
-            for (size_t i = 0; i < objectNumberAndOffset.size(); ++i)
-            {
-                const PDFInteger objectNumber = objectNumberAndOffset[i].first;
-                const PDFInteger offset = objectNumberAndOffset[i].second;
                 parser.seek(offset);
-
-                PDFObject currentObject = parser.getObject();
-                auto predicate = [objectNumber, objectStreamReference](const PDFXRefTable::Entry& entry) -> bool { return entry.reference.objectNumber == objectNumber && entry.objectStream == objectStreamReference; };
-                if (std::find_if(objectStreamEntries.cbegin(), objectStreamEntries.cend(), predicate) != objectStreamEntries.cend())
-                {
-                    QMutexLocker lock(&m_mutex);
-                    objects[objectNumber].object = qMove(currentObject);
-                }
-                else
-                {
-                    // Silently ignore this error. It is not critical, so, maybe this object will be null.
-                }
+                objects[objectNumber].object = parser.getObject();
             }
         }
         catch (const PDFException& exception)
@@ -530,6 +1139,205 @@ void PDFDocumentReader::processObjectStreams(PDFXRefTable* xrefTable, PDFObjectS
     PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Unknown, objectStreams.cbegin(), objectStreams.cend(), processObjectStream);
 }
 
+PDFDocument PDFDocumentReader::readLazyDocument(PDFXRefTable xrefTable, PDFByteRangeSourcePointer source, const PDFLinearizationDictionary& linearizationDictionary)
+{
+    PDFObjectStorage::PDFObjects objects;
+    objects.resize(xrefTable.getSize());
+
+    for (const PDFXRefTable::Entry& entry : xrefTable.getOccupiedEntries())
+    {
+        objects[entry.reference.objectNumber].generation = entry.reference.generation;
+    }
+
+    for (const PDFXRefTable::Entry& entry : xrefTable.getObjectStreamEntries())
+    {
+        objects[entry.reference.objectNumber].generation = entry.reference.generation;
+    }
+
+    PDFObject trailerDictionaryObject = xrefTable.getTrailerDictionary();
+    const PDFDictionary* trailerDictionary = nullptr;
+    if (trailerDictionaryObject.isDictionary())
+    {
+        trailerDictionary = trailerDictionaryObject.getDictionary();
+    }
+    else if (trailerDictionaryObject.isStream())
+    {
+        trailerDictionary = trailerDictionaryObject.getStream()->getDictionary();
+    }
+    else
+    {
+        throw PDFException(tr("Invalid trailer dictionary."));
+    }
+
+    PDFObjectReference encryptObjectReference;
+    const PDFObject& encryptObject = trailerDictionary->get("Encrypt");
+    if (encryptObject.isReference())
+    {
+        encryptObjectReference = encryptObject.getReference();
+    }
+
+    std::shared_ptr<PDFLazyObjectLoader> loader = std::make_shared<PDFLazyObjectLoader>(qMove(source), qMove(xrefTable), encryptObjectReference);
+
+    if (linearizationDictionary.isValid())
+    {
+        // Reference table contains only objects of the first page. Trailer of the first page
+        // contains total number of objects and offset of the main reference table.
+        const PDFObject& sizeObject = trailerDictionary->get("Size");
+        const PDFObject& previousObject = trailerDictionary->get(PDF_XREF_TRAILER_PREVIOUS);
+        if (!sizeObject.isInt() || !previousObject.isInt())
+        {
+            throw PDFException(tr("Invalid trailer dictionary of linearized document."));
+        }
+
+        if (sizeObject.getInteger() > static_cast<PDFInteger>(objects.size()))
+        {
+            objects.resize(sizeObject.getInteger());
+        }
+
+        loader->setMainXRefTableOffset(previousObject.getInteger());
+    }
+
+    // Security handler needs the encryption dictionary. Encryption dictionary
+    // can't be in the object stream and it is never encrypted.
+    if (encryptObjectReference.isValid() && static_cast<size_t>(encryptObjectReference.objectNumber) < objects.size())
+    {
+        objects[encryptObjectReference.objectNumber].object = loader->loadObject(encryptObjectReference);
+    }
+
+    if (processSecurityHandler(trailerDictionaryObject, std::vector<PDFXRefTable::Entry>(), objects) == Result::Cancelled)
+    {
+        return PDFDocument();
+    }
+
+    loader->setSecurityHandler(m_securityHandler);
+
+    if (linearizationDictionary.isValid())
+    {
+        if (loader->readHintTables(linearizationDictionary))
+        {
+            m_linearizationInfo = loader->getLinearizationInfo();
+        }
+        else
+        {
+            m_warnings << tr("Hint tables of linearized document are invalid.");
+        }
+    }
+
+    PDFObjectStorage storage(std::move(objects), qMove(trailerDictionaryObject), qMove(m_securityHandler), qMove(loader));
+    return PDFDocument(std::move(storage), m_version);
+}
+
+PDFLinearizationDictionary PDFDocumentReader::readLinearizationDictionary(const PDFByteRangeSource* source, PDFXRefTable* xrefTable)
+{
+    PDFLinearizationDictionary dictionary;
+
+    try
+    {
+        // Linearization dictionary must be the first object in the file,
+        // and it must be contained in the first 1024 bytes of the file.
+        const QByteArray prefix = source->read(0, PDF_LINEARIZATION_SCAN_LIMIT);
+        PDFParser parser(prefix, nullptr, PDFParser::None);
+
+        PDFObject objectNumber = parser.getObject();
+        PDFObject generation = parser.getObject();
+
+        if (!objectNumber.isInt() || !generation.isInt() || !parser.fetchCommand(PDF_OBJECT_START_MARK))
+        {
+            return PDFLinearizationDictionary();
+        }
+
+        dictionary = PDFLinearizationDictionary::parse(parser.getObject());
+        const int objectEndOffset = prefix.indexOf(PDF_OBJECT_END_MARK);
+
+        // If file length doesn't match, then document was updated incrementally
+        // and it is no longer linearized.
+        if (!dictionary.isValid() || dictionary.getFileLength() != source->getSize() || objectEndOffset == -1 || !parser.fetchCommand(PDF_OBJECT_END_MARK))
+        {
+            return PDFLinearizationDictionary();
+        }
+
+        // First page reference table follows the linearization dictionary
+        xrefTable->readXRefTable(nullptr, source, objectEndOffset + std::strlen(PDF_OBJECT_END_MARK), false);
+        return dictionary;
+    }
+    catch (const PDFException& exception)
+    {
+        // Document is not linearized, if first object can't be read. If linearization
+        // dictionary is valid, then first page reference table is damaged.
+        if (dictionary.isValid())
+        {
+            m_warnings << tr("Linearization of the document is invalid: %1").arg(exception.getMessage());
+        }
+        *xrefTable = PDFXRefTable();
+    }
+
+    return PDFLinearizationDictionary();
+}
+
+PDFDocument PDFDocumentReader::readFromSource(PDFByteRangeSourcePointer source)
+{
+    reset();
+
+    try
+    {
+        // HEADER CHECKING
+        //  1) Check if header is present
+        //  2) Scan header version
+        checkHeader(source->read(0, PDF_HEADER_SCAN_LIMIT));
+
+        // Linearized document can be opened using only the beginning of the file,
+        // objects of other pages are located using hint tables.
+        PDFXRefTable xrefTable;
+        PDFLinearizationDictionary linearizationDictionary = readLinearizationDictionary(source.get(), &xrefTable);
+
+        if (!linearizationDictionary.isValid())
+        {
+            const PDFInteger size = source->getSize();
+
+            // FOOTER CHECKING
+            //  1) Check, if EOF marking is present
+            //  2) Find start of cross reference table
+            const QByteArray footer = source->read(size - PDF_FOOTER_SCAN_LIMIT, PDF_FOOTER_SCAN_LIMIT);
+            checkFooter(footer);
+            const PDFInteger firstXrefTableOffset = findXrefTableOffset(footer);
+
+            // Now, we are ready to scan xref table
+            xrefTable.readXRefTable(nullptr, source.get(), firstXrefTableOffset);
+        }
+
+        if (xrefTable.getSize() == 0)
+        {
+            throw PDFException(tr("Empty xref table."));
+        }
+
+        return readLazyDocument(qMove(xrefTable), source, linearizationDictionary);
+    }
+    catch (const PDFException &parserException)
+    {
+        m_result = Result::Failed;
+        m_errorMessage = parserException.getMessage();
+        m_warnings << m_errorMessage;
+    }
+
+    if (m_result == Result::Failed && m_permissive)
+    {
+        // Damaged document can be restored only from the whole data
+        try
+        {
+            m_source = source->read(0, source->getSize());
+        }
+        catch (const PDFException&)
+        {
+            // Source data can't be read, document can't be restored
+            return PDFDocument();
+        }
+
+        return readDamagedDocumentFromBuffer(m_source);
+    }
+
+    return PDFDocument();
+}
+
 PDFDocument PDFDocumentReader::readFromBuffer(const QByteArray& buffer)
 {
     bool shouldTryPermissiveReading = true;
@@ -558,6 +1366,12 @@ PDFDocument PDFDocumentReader::readFromBuffer(const QByteArray& buffer)
             throw PDFException(tr("Empty xref table."));
         }
 
+        if (m_lazyLoading)
+        {
+            // Objects will be loaded on demand from the source data
+            return readLazyDocument(qMove(xrefTable), std::make_shared<PDFByteArrayRangeSource>(m_source, m_mappedFile), PDFLinearizationDictionary());
+        }
+
         PDFObjectStorage::PDFObjects objects;
         objects.resize(xrefTable.getSize());
 
@@ -784,10 +1598,12 @@ void PDFDocumentReader::reset()
     m_errorMessage = QString();
     m_version = PDFVersion();
     m_source = QByteArray();
+    m_mappedFile.reset();
     m_securityHandler = nullptr;
+    m_linearizationInfo = PDFLinearizationInfo();
 }
 
-int PDFDocumentReader::findFromEnd(const char* what, const QByteArray& byteArray, int limit)
+PDFInteger PDFDocumentReader::findFromEnd(const char* what, const QByteArray& byteArray, int limit)
 {
     if (byteArray.isEmpty())
     {
@@ -795,8 +1611,8 @@ int PDFDocumentReader::findFromEnd(const char* what, const QByteArray& byteArray
         return FIND_NOT_FOUND_RESULT;
     }
 
-    const int size = byteArray.size();
-    const int adjustedLimit = qMin(byteArray.size(), limit);
+    const qsizetype size = byteArray.size();
+    const qsizetype adjustedLimit = qMin(byteArray.size(), qsizetype(limit));
     const int whatLength = static_cast<int>(std::strlen(what));
 
     if (adjustedLimit < whatLength)
@@ -23,8 +23,11 @@
 #include "pdfdocument.h"
 #include "pdfprogress.h"
 #include "pdfxreftable.h"
+#include "pdfbyterangesource.h"
+#include "pdflinearization.h"
 
 #include <QtCore>
+#include <QFile>
 #include <QIODevice>
 
 namespace pdf
@@ -56,7 +59,8 @@ public:
 
     /// Reads a PDF document from the specified file. If file doesn't exist,
     /// cannot be opened or contain invalid pdf, empty PDF file is returned.
-    /// No exception is thrown.
+    /// No exception is thrown. If lazy loading is enabled, then file is
+    /// memory mapped and it stays opened, until document is destroyed.
     PDFDocument readFromFile(const QString& fileName);
 
     /// Reads a PDF document from the specified device. If device is not opened
@@ -69,18 +73,53 @@ public:
     /// PDF is read, then empty PDF document is returned. No exception is thrown.
     PDFDocument readFromBuffer(const QByteArray& buffer);
 
+    /// Reads a PDF document from the byte range source. Document is always read
+    /// with lazy loading, only byte ranges of the cross reference table are read,
+    /// objects are read from the source, when they are accessed. Source is owned
+    /// by the document. If document is linearized, then only the beginning of the
+    /// file is read (first page section), and objects of other pages are located
+    /// using hint tables. If document is damaged and reader is permissive, then
+    /// whole source is read and restoration of the document is attempted.
+    /// No exception is thrown.
+    /// \param source Byte range source
+    PDFDocument readFromSource(PDFByteRangeSourcePointer source);
+
     /// Returns result code for reading document from the device
     Result getReadingResult() const { return m_result; }
 
     /// Returns error message, if document reading was unsuccessfull
     const QString& getErrorMessage() const { return m_errorMessage; }
 
-    /// Get source data of the document
+    /// Get source data of the document. If document was read from file
+    /// with lazy loading enabled, then source data are memory mapped file,
+    /// and they are valid only while the document exists.
     const QByteArray& getSource() const { return m_source; }
 
     /// Returns warning messages
     const QStringList& getWarnings() const { return m_warnings; }
 
+    /// Returns linearization info of the document, which was read from the
+    /// byte range source. If document is not linearized, or hint tables
+    /// are invalid, then invalid linearization info is returned.
+    const PDFLinearizationInfo& getLinearizationInfo() const { return m_linearizationInfo; }
+
+    /// Returns true, if lazy loading of objects is enabled
+    bool isLazyLoading() const { return m_lazyLoading; }
+
+    /// Enables or disables lazy loading of objects. When lazy loading is enabled,
+    /// only cross reference table is read, when document is opened. Objects
+    /// are parsed and decrypted, when they are accessed for the first time.
+    /// Files are memory mapped instead of being read into the memory. Damaged
+    /// documents are not restored, if error occurs during object loading.
+    /// \param lazyLoading Enable lazy loading
+    void setLazyLoading(bool lazyLoading) { m_lazyLoading = lazyLoading; }
+
+    /// Finds offset of the last cross reference section from the end of the file
+    /// (value after the 'startxref' keyword). If offset is not found, then
+    /// exception is thrown.
+    /// \param buffer End of the file (or whole file)
+    static PDFInteger findXrefTableOffset(const QByteArray& buffer);
+
 private:
     static constexpr const int FIND_NOT_FOUND_RESULT = -1;
 
@@ -94,15 +133,29 @@ private:
     /// \param byteArray Byte array to be scanned from the end
     /// \param limit Scan up to this value bytes from the end
     /// \returns Position of string, or FIND_NOT_FOUND_RESULT
-    int findFromEnd(const char* what, const QByteArray& byteArray, int limit);
+    static PDFInteger findFromEnd(const char* what, const QByteArray& byteArray, int limit);
 
     void checkFooter(const QByteArray& buffer);
     void checkHeader(const QByteArray& buffer);
-    PDFInteger findXrefTableOffset(const QByteArray& buffer);
     Result processReferenceTableEntries(PDFXRefTable* xrefTable, const std::vector<PDFXRefTable::Entry>& occupiedEntries, PDFObjectStorage::PDFObjects& objects);
     Result processSecurityHandler(const PDFObject& trailerDictionaryObject, const std::vector<PDFXRefTable::Entry>& occupiedEntries, PDFObjectStorage::PDFObjects& objects);
     void processObjectStreams(PDFXRefTable* xrefTable, PDFObjectStorage::PDFObjects& objects);
 
+    /// Creates document with lazy loading from the reference table. Objects
+    /// are not loaded, except encryption dictionary, which is needed for
+    /// security handler initialization. Can throw exception.
+    /// \param xrefTable Reference table (first page reference table, if document is linearized)
+    /// \param source Source of the document data
+    /// \param linearizationDictionary Linearization dictionary (invalid, if document is not linearized)
+    PDFDocument readLazyDocument(PDFXRefTable xrefTable, PDFByteRangeSourcePointer source, const PDFLinearizationDictionary& linearizationDictionary);
+
+    /// Tries to read linearization dictionary from the beginning of the source. If document
+    /// is linearized, then first page reference table is read and valid linearization
+    /// dictionary is returned. Otherwise, invalid dictionary is returned.
+    /// \param source Source of the document data
+    /// \param xrefTable First page reference table
+    PDFLinearizationDictionary readLinearizationDictionary(const PDFByteRangeSource* source, PDFXRefTable* xrefTable);
+
     /// This function fetches object from the buffer from the specified offset.
     /// Can throw exception, returns a pair of scanned reference and object content.
     /// \param context Context
@@ -160,6 +213,9 @@ private:
     /// Raw document data (byte array containing source data for created document)
     QByteArray m_source;
 
+    /// Memory mapped file (if lazy loading is enabled and document is read from the file)
+    std::shared_ptr<QFile> m_mappedFile;
+
     /// Security handler
     PDFSecurityHandlerPointer m_securityHandler;
 
@@ -170,6 +226,12 @@ private:
     /// reading fails)
     bool m_authorizeOwnerOnly;
 
+    /// Load objects on demand, when they are accessed for the first time
+    bool m_lazyLoading = false;
+
+    /// Linearization info of the document (hint tables)
+    PDFLinearizationInfo m_linearizationInfo;
+
     /// Warnings
     QStringList m_warnings;
 };
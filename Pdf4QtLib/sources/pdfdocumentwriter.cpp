@@ -19,11 +19,18 @@
 #include "pdfconstants.h"
 #include "pdfvisitor.h"
 #include "pdfparser.h"
+#include "pdfdocumentreader.h"
+#include "pdfobjectutils.h"
+#include "pdflinearization.h"
+#include "pdfstreamfilters.h"
+#include "pdfexecutionpolicy.h"
 #include "pdfdbgheap.h"
 
 #include <QFile>
 #include <QSaveFile>
 
+#include <deque>
+
 namespace pdf
 {
 
@@ -182,6 +189,17 @@ PDFOperationResult PDFDocumentWriter::write(const QString& fileName, const PDFDo
         return tr("Writing of encrypted documents is not supported.");
     }
 
+    if (storage.isLazyLoading())
+    {
+        // Objects are loaded on demand from the memory mapped file, which can
+        // be the same file we are writing to. So we write a copy of the document,
+        // in which all objects are loaded.
+        PDFObjectStorage loadedStorage = storage;
+        loadedStorage.loadAllObjects();
+        PDFDocument loadedDocument(qMove(loadedStorage), document->getInfo()->version);
+        return write(fileName, &loadedDocument, safeWrite);
+    }
+
     if (safeWrite)
     {
         QSaveFile file(fileName);
@@ -240,23 +258,27 @@ PDFOperationResult PDFDocumentWriter::write(QIODevice* device, const PDFDocument
     }
 
     const PDFObjectStorage& storage = document->getStorage();
-    const PDFObjectStorage::PDFObjects& objects = storage.getObjects();
-    const size_t objectCount = objects.size();
     const bool isEncrypted = storage.getSecurityHandler()->getMode() != EncryptionMode::None;
     if (!storage.getSecurityHandler()->isEncryptionAllowed())
     {
         return tr("Writing of encrypted documents is not supported.");
     }
 
+    if (m_flags.testFlag(Linearize))
+    {
+        return writeLinearized(device, document);
+    }
+
+    if (m_flags.testFlag(ObjectStreams))
+    {
+        return writeCompressed(device, document);
+    }
+
+    const PDFObjectStorage::PDFObjects objects = storage.getObjects();
+    const size_t objectCount = objects.size();
+
     // Write header
-    PDFVersion version = document->getInfo()->version;
-    device->write(QString("%PDF-%1.%2").arg(version.major).arg(version.minor).toLatin1());
-    writeCRLF(device);
-    device->write("% PDF producer: ");
-    device->write(PDF_LIBRARY_NAME);
-    writeCRLF(device);
-    writeCRLF(device);
-    writeCRLF(device);
+    device->write(getFileHeader(document->getInfo()->version));
 
     PDFObjectReference encryptObjectReference;
     PDFObject encryptObject = document->getTrailerDictionary()->get("Encrypt");
@@ -367,6 +389,1039 @@ PDFOperationResult PDFDocumentWriter::write(QIODevice* device, const PDFDocument
     return true;
 }
 
+/// Entry of the cross-reference stream (type 0 - free object, type 1 - object
+/// at the offset, type 2 - object in the object stream)
+struct PDFXRefStreamEntry
+{
+    int type = 0;
+    PDFInteger field2 = 0;
+    PDFInteger field3 = 0;
+};
+
+/// Creates cross-reference stream from the entries. Entries \p W, \p Filter
+/// and \p Length are added to the stream dictionary.
+/// \param entries Entries of the cross-reference stream
+/// \param dictionary Stream dictionary
+static PDFObject createXRefStream(const std::vector<PDFXRefStreamEntry>& entries, PDFDictionary dictionary)
+{
+    PDFInteger maxField2 = 0;
+    PDFInteger maxField3 = 0;
+    for (const PDFXRefStreamEntry& entry : entries)
+    {
+        maxField2 = qMax(maxField2, entry.field2);
+        maxField3 = qMax(maxField3, entry.field3);
+    }
+
+    auto getByteCount = [](PDFInteger value)
+    {
+        int byteCount = 1;
+        while (value > 0xFF)
+        {
+            value >>= 8;
+            ++byteCount;
+        }
+        return byteCount;
+    };
+
+    const int field2Bytes = getByteCount(maxField2);
+    const int field3Bytes = getByteCount(maxField3);
+
+    QByteArray xrefData;
+    xrefData.reserve(int(entries.size()) * (1 + field2Bytes + field3Bytes));
+    auto writeField = [&xrefData](PDFInteger value, int byteCount)
+    {
+        for (int i = byteCount - 1; i >= 0; --i)
+        {
+            xrefData.push_back(char((value >> (8 * i)) & 0xFF));
+        }
+    };
+
+    for (const PDFXRefStreamEntry& entry : entries)
+    {
+        writeField(entry.type, 1);
+        writeField(entry.field2, field2Bytes);
+        writeField(entry.field3, field3Bytes);
+    }
+    xrefData = PDFFlateDecodeFilter::compress(xrefData);
+
+    PDFArray widthArray;
+    widthArray.appendItem(PDFObject::createInteger(1));
+    widthArray.appendItem(PDFObject::createInteger(field2Bytes));
+    widthArray.appendItem(PDFObject::createInteger(field3Bytes));
+
+    dictionary.addEntry(PDFInplaceOrMemoryString("W"), PDFObject::createArray(std::make_shared<PDFArray>(qMove(widthArray))));
+    dictionary.addEntry(PDFInplaceOrMemoryString("Filter"), PDFObject::createName(QByteArray("FlateDecode")));
+    dictionary.addEntry(PDFInplaceOrMemoryString("Length"), PDFObject::createInteger(xrefData.size()));
+
+    return PDFObject::createStream(std::make_shared<PDFStream>(qMove(dictionary), qMove(xrefData)));
+}
+
+PDFOperationResult PDFDocumentWriter::writeIncrementalUpdate(const QString& fileName, const PDFDocument* document, const PDFDocument* originalDocument)
+{
+    Q_ASSERT(document);
+    Q_ASSERT(originalDocument);
+
+    QFile file(fileName);
+    if (!file.open(QFile::ReadWrite))
+    {
+        return tr("File '%1' can't be opened for writing. %2").arg(fileName, file.errorString());
+    }
+
+    const qint64 fileSize = file.size();
+    file.seek(qMax(fileSize - PDF_FOOTER_SCAN_LIMIT, qint64(0)));
+    const QByteArray footer = file.read(PDF_FOOTER_SCAN_LIMIT);
+
+    PDFInteger previousXRefOffset = -1;
+    try
+    {
+        previousXRefOffset = PDFDocumentReader::findXrefTableOffset(footer);
+    }
+    catch (const PDFException& exception)
+    {
+        return exception.getMessage();
+    }
+
+    if (!file.seek(fileSize))
+    {
+        return tr("File '%1' can't be opened for writing. %2").arg(fileName, file.errorString());
+    }
+
+    PDFOperationResult result = writeIncrementalUpdate(&file, document, originalDocument, previousXRefOffset);
+    file.close();
+    return result;
+}
+
+PDFOperationResult PDFDocumentWriter::writeIncrementalUpdate(QIODevice* device, const PDFDocument* document, const PDFDocument* originalDocument, PDFInteger previousXRefOffset)
+{
+    if (!device->isWritable())
+    {
+        return tr("Device is not writable.");
+    }
+
+    const PDFObjectStorage& storage = document->getStorage();
+    const PDFSecurityHandler* securityHandler = storage.getSecurityHandler();
+    const bool isEncrypted = securityHandler->getMode() != EncryptionMode::None;
+    if (!securityHandler->isEncryptionAllowed())
+    {
+        return tr("Writing of encrypted documents is not supported.");
+    }
+
+    const PDFObjectStorage& originalStorage = originalDocument->getStorage();
+    const size_t objectCount = qMax(storage.getObjectCount(), originalStorage.getObjectCount());
+
+    PDFObjectReference encryptObjectReference;
+    const PDFObject& encryptObject = document->getTrailerDictionary()->get("Encrypt");
+    if (encryptObject.isReference())
+    {
+        encryptObjectReference = encryptObject.getReference();
+    }
+
+    // Find changed objects. Objects, which are loaded on demand in both
+    // documents, are unchanged, so they are neither loaded, nor compared.
+    const std::vector<PDFObjectReference> modifiedReferences = storage.getModifiedReferences(originalStorage);
+
+    // Write changed objects. Deleted objects are marked as free entries
+    // with incremented generation number.
+    writeCRLF(device);
+
+    std::vector<PDFXRefStreamEntry> xrefEntries;
+    xrefEntries.reserve(modifiedReferences.size() + 1);
+    for (const PDFObjectReference& reference : modifiedReferences)
+    {
+        PDFObject object = storage.getObject(reference);
+        if (object.isNull())
+        {
+            const PDFInteger generation = qMin(reference.generation + 1, PDFInteger(PDF_MAX_OBJECT_GENERATION));
+            xrefEntries.push_back(PDFXRefStreamEntry{ 0, 0, generation });
+            continue;
+        }
+
+        if (isEncrypted && reference != encryptObjectReference)
+        {
+            object = securityHandler->encryptObject(object, reference);
+        }
+
+        xrefEntries.push_back(PDFXRefStreamEntry{ 1, device->pos(), reference.generation });
+        device->write(getSerializedIndirectObject(reference, object));
+    }
+
+    // New cross-reference section has the same format as the previous one,
+    // i.e. if previous section was a cross-reference stream, we write a stream.
+    const PDFObject& originalTypeObject = originalDocument->getTrailerDictionary()->get("Type");
+    const bool isXRefStream = originalTypeObject.isName() && originalTypeObject.getString() == "XRef";
+
+    std::vector<PDFInteger> objectNumbers;
+    objectNumbers.reserve(modifiedReferences.size() + 1);
+    for (const PDFObjectReference& reference : modifiedReferences)
+    {
+        objectNumbers.push_back(reference.objectNumber);
+    }
+
+    const PDFInteger xrefOffset = device->pos();
+    const PDFObjectReference xrefStreamReference(PDFInteger(objectCount), 0);
+    if (isXRefStream)
+    {
+        objectNumbers.push_back(xrefStreamReference.objectNumber);
+        xrefEntries.push_back(PDFXRefStreamEntry{ 1, xrefOffset, 0 });
+    }
+
+    // Changed objects are grouped into subsections of consecutive object numbers
+    std::vector<std::pair<size_t, size_t>> subsections;
+    for (size_t i = 0; i < objectNumbers.size();)
+    {
+        size_t last = i + 1;
+        while (last < objectNumbers.size() && objectNumbers[last] == objectNumbers[last - 1] + 1)
+        {
+            ++last;
+        }
+
+        subsections.emplace_back(i, last);
+        i = last;
+    }
+
+    PDFDictionary trailerDictionary = *document->getTrailerDictionary();
+    PDFDictionary newTrailerDictionary;
+
+    if (isXRefStream)
+    {
+        newTrailerDictionary.addEntry(PDFInplaceOrMemoryString("Type"), PDFObject::createName(QByteArray("XRef")));
+        newTrailerDictionary.addEntry(PDFInplaceOrMemoryString("Size"), PDFObject::createInteger(PDFInteger(objectCount + 1)));
+
+        PDFArray indexArray;
+        for (const auto& subsection : subsections)
+        {
+            indexArray.appendItem(PDFObject::createInteger(objectNumbers[subsection.first]));
+            indexArray.appendItem(PDFObject::createInteger(PDFInteger(subsection.second - subsection.first)));
+        }
+        newTrailerDictionary.addEntry(PDFInplaceOrMemoryString("Index"), PDFObject::createArray(std::make_shared<PDFArray>(qMove(indexArray))));
+    }
+    else
+    {
+        newTrailerDictionary.addEntry(PDFInplaceOrMemoryString("Size"), PDFObject::createInteger(PDFInteger(objectCount)));
+    }
+
+    for (const char* entry : { "Root", "Encrypt", "Info", "ID"})
+    {
+        PDFObject object = trailerDictionary.get(entry);
+        if (!object.isNull())
+        {
+            newTrailerDictionary.addEntry(PDFInplaceOrMemoryString(entry), qMove(object));
+        }
+    }
+
+    newTrailerDictionary.addEntry(PDFInplaceOrMemoryString("Prev"), PDFObject::createInteger(previousXRefOffset));
+
+    if (isXRefStream)
+    {
+        // Cross-reference stream is never encrypted
+        PDFObject xrefStreamObject = createXRefStream(xrefEntries, qMove(newTrailerDictionary));
+        device->write(getSerializedIndirectObject(xrefStreamReference, xrefStreamObject));
+    }
+    else
+    {
+        device->write("xref");
+        writeCRLF(device);
+
+        for (const auto& subsection : subsections)
+        {
+            device->write(QString("%1 %2").arg(objectNumbers[subsection.first]).arg(subsection.second - subsection.first).toLatin1());
+            writeCRLF(device);
+
+            for (size_t i = subsection.first; i < subsection.second; ++i)
+            {
+                const PDFXRefStreamEntry& entry = xrefEntries[i];
+                QString offsetString = QString::number(entry.field2).rightJustified(10, QChar('0'), true);
+                QString generationString = QString::number(entry.field3).rightJustified(5, QChar('0'), true);
+
+                device->write(offsetString.toLatin1());
+                device->write(" ");
+                device->write(generationString.toLatin1());
+                device->write(" ");
+                device->write(entry.type == 0 ? "f" : "n");
+                writeCRLF(device);
+            }
+        }
+
+        PDFObject trailerDictionaryObject = PDFObject::createDictionary(std::make_shared<PDFDictionary>(qMove(newTrailerDictionary)));
+
+        device->write("trailer");
+        writeCRLF(device);
+        PDFWriteObjectVisitor trailerVisitor(device);
+        trailerDictionaryObject.accept(&trailerVisitor);
+        writeCRLF(device);
+    }
+
+    device->write("startxref");
+    writeCRLF(device);
+    device->write(QString::number(xrefOffset).toLatin1());
+    writeCRLF(device);
+
+    // Write footer
+    device->write("%%EOF");
+
+    return true;
+}
+
+/// Maximal number of objects packed into one object stream
+static constexpr const size_t PDF_OBJECT_STREAM_MAX_OBJECT_COUNT = 100;
+
+/// Object stream of the compressed document
+struct PDFCompressedObjectStream
+{
+    PDFObjectReference reference;       ///< Reference of the object stream
+    std::vector<size_t> objectNumbers;  ///< Numbers of objects packed in the stream
+    QByteArray data;                    ///< Serialized object stream (including header/footer)
+};
+
+PDFOperationResult PDFDocumentWriter::writeCompressed(QIODevice* device, const PDFDocument* document)
+{
+    const PDFObjectStorage& storage = document->getStorage();
+    const PDFObjectStorage::PDFObjects& objects = storage.getObjects();
+    const PDFDictionary* trailerDictionary = document->getTrailerDictionary();
+    const PDFSecurityHandler* securityHandler = storage.getSecurityHandler();
+    const bool isEncrypted = securityHandler->getMode() != EncryptionMode::None;
+    const size_t objectCount = objects.size();
+
+    PDFObjectReference encryptObjectReference;
+    const PDFObject& encryptObject = trailerDictionary->get("Encrypt");
+    if (encryptObject.isReference())
+    {
+        encryptObjectReference = encryptObject.getReference();
+    }
+
+    // Cross-reference streams and object streams are supported since PDF 1.5
+    PDFVersion version = document->getInfo()->version;
+    if (version.major < 1 || (version.major == 1 && version.minor < 5))
+    {
+        version = PDFVersion(1, 5);
+    }
+    device->write(getFileHeader(version));
+
+    // Streams, objects with nonzero generation number and encryption
+    // dictionary can't be stored in the object stream (see PDF Reference 1.7,
+    // chapter 3.4.6).
+    std::vector<size_t> packedObjects;
+    std::vector<size_t> unpackedObjects;
+    for (size_t i = 1; i < objectCount; ++i)
+    {
+        const PDFObjectStorage::Entry& entry = objects[i];
+        if (entry.object.isNull())
+        {
+            continue;
+        }
+
+        if (entry.object.isStream() || entry.generation != 0 || PDFObjectReference(i, entry.generation) == encryptObjectReference)
+        {
+            unpackedObjects.push_back(i);
+        }
+        else
+        {
+            packedObjects.push_back(i);
+        }
+    }
+
+    std::vector<PDFCompressedObjectStream> objectStreams;
+    objectStreams.reserve((packedObjects.size() + PDF_OBJECT_STREAM_MAX_OBJECT_COUNT - 1) / PDF_OBJECT_STREAM_MAX_OBJECT_COUNT);
+    for (size_t i = 0; i < packedObjects.size(); i += PDF_OBJECT_STREAM_MAX_OBJECT_COUNT)
+    {
+        PDFCompressedObjectStream objectStream;
+        objectStream.reference = PDFObjectReference(PDFInteger(objectCount + objectStreams.size()), 0);
+        objectStream.objectNumbers.assign(packedObjects.cbegin() + i, packedObjects.cbegin() + qMin(i + PDF_OBJECT_STREAM_MAX_OBJECT_COUNT, packedObjects.size()));
+        objectStreams.emplace_back(qMove(objectStream));
+    }
+
+    // Objects inside object stream are not encrypted, whole object stream is encrypted instead
+    auto createObjectStream = [&](PDFCompressedObjectStream& objectStream)
+    {
+        QByteArray header;
+        QBuffer buffer;
+        buffer.open(QBuffer::WriteOnly);
+        PDFWriteObjectVisitor visitor(&buffer);
+
+        for (size_t objectNumber : objectStream.objectNumbers)
+        {
+            header += QByteArray::number(qulonglong(objectNumber)) + " " + QByteArray::number(buffer.pos()) + " ";
+            objects[objectNumber].object.accept(&visitor);
+            writeCRLF(&buffer);
+        }
+        buffer.close();
+
+        PDFDictionary dictionary;
+        dictionary.addEntry(PDFInplaceOrMemoryString("Type"), PDFObject::createName(QByteArray("ObjStm")));
+        dictionary.addEntry(PDFInplaceOrMemoryString("N"), PDFObject::createInteger(PDFInteger(objectStream.objectNumbers.size())));
+        dictionary.addEntry(PDFInplaceOrMemoryString("First"), PDFObject::createInteger(header.size()));
+        dictionary.addEntry(PDFInplaceOrMemoryString("Filter"), PDFObject::createName(QByteArray("FlateDecode")));
+
+        QByteArray content = PDFFlateDecodeFilter::compress(header + buffer.data());
+        dictionary.addEntry(PDFInplaceOrMemoryString("Length"), PDFObject::createInteger(content.size()));
+
+        PDFObject object = PDFObject::createStream(std::make_shared<PDFStream>(qMove(dictionary), qMove(content)));
+        if (isEncrypted)
+        {
+            object = securityHandler->encryptObject(object, objectStream.reference);
+        }
+
+        objectStream.data = getSerializedIndirectObject(objectStream.reference, object);
+    };
+    PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Unknown, objectStreams.begin(), objectStreams.end(), createObjectStream);
+
+    // Write objects, which are not packed, and object streams
+    const size_t xrefStreamObjectNumber = objectCount + objectStreams.size();
+    const size_t xrefStreamSize = xrefStreamObjectNumber + 1;
+
+    std::vector<PDFXRefStreamEntry> xrefEntries(xrefStreamSize);
+    xrefEntries[0].field3 = PDF_MAX_OBJECT_GENERATION;
+    for (size_t i = 1; i < objectCount; ++i)
+    {
+        xrefEntries[i].field3 = objects[i].generation;
+    }
+
+    for (size_t objectNumber : unpackedObjects)
+    {
+        const PDFObjectReference reference(PDFInteger(objectNumber), objects[objectNumber].generation);
+        PDFObject object = objects[objectNumber].object;
+
+        if (isEncrypted && reference != encryptObjectReference)
+        {
+            object = securityHandler->encryptObject(object, reference);
+        }
+
+        xrefEntries[objectNumber] = PDFXRefStreamEntry{ 1, device->pos(), reference.generation };
+        device->write(getSerializedIndirectObject(reference, object));
+    }
+
+    for (const PDFCompressedObjectStream& objectStream : objectStreams)
+    {
+        xrefEntries[objectStream.reference.objectNumber] = PDFXRefStreamEntry{ 1, device->pos(), 0 };
+        device->write(objectStream.data);
+
+        for (size_t i = 0; i < objectStream.objectNumbers.size(); ++i)
+        {
+            xrefEntries[objectStream.objectNumbers[i]] = PDFXRefStreamEntry{ 2, objectStream.reference.objectNumber, PDFInteger(i) };
+        }
+    }
+
+    // Write cross-reference stream. It is never encrypted.
+    const PDFInteger xrefOffset = device->pos();
+    xrefEntries[xrefStreamObjectNumber] = PDFXRefStreamEntry{ 1, xrefOffset, 0 };
+
+    PDFDictionary xrefDictionary;
+    xrefDictionary.addEntry(PDFInplaceOrMemoryString("Type"), PDFObject::createName(QByteArray("XRef")));
+    xrefDictionary.addEntry(PDFInplaceOrMemoryString("Size"), PDFObject::createInteger(PDFInteger(xrefStreamSize)));
+    for (const char* entry : { "Root", "Encrypt", "Info", "ID" })
+    {
+        PDFObject object = trailerDictionary->get(entry);
+        if (!object.isNull())
+        {
+            xrefDictionary.addEntry(PDFInplaceOrMemoryString(entry), qMove(object));
+        }
+    }
+
+    PDFObject xrefStreamObject = createXRefStream(xrefEntries, qMove(xrefDictionary));
+    device->write(getSerializedIndirectObject(PDFObjectReference(PDFInteger(xrefStreamObjectNumber), 0), xrefStreamObject));
+
+    device->write("startxref");
+    writeCRLF(device);
+    device->write(QString::number(xrefOffset).toLatin1());
+    writeCRLF(device);
+
+    // Write footer
+    device->write("%%EOF");
+
+    return true;
+}
+
+/// Width of the numbers in the linearization dictionary and in the first page
+/// trailer. Numbers are padded, so size of these objects doesn't depend on values.
+static constexpr const int PDF_LINEARIZATION_NUMBER_WIDTH = 10;
+
+/// Object of the linearized document
+struct PDFLinearizedObject
+{
+    PDFObjectReference sourceReference; ///< Reference of the object in the source document
+    PDFObjectReference reference;       ///< Reference of the object in the written document
+    QByteArray data;                    ///< Serialized object (including header/footer)
+};
+
+PDFOperationResult PDFDocumentWriter::writeLinearized(QIODevice* device, const PDFDocument* document)
+{
+    const PDFObjectStorage& storage = document->getStorage();
+    const PDFCatalog* catalog = document->getCatalog();
+    const PDFDictionary* trailerDictionary = document->getTrailerDictionary();
+    const PDFSecurityHandler* securityHandler = storage.getSecurityHandler();
+    const bool isEncrypted = securityHandler->getMode() != EncryptionMode::None;
+    const size_t pageCount = catalog->getPageCount();
+
+    const PDFObject& rootObject = trailerDictionary->get("Root");
+    if (!rootObject.isReference())
+    {
+        return tr("Document catalog is invalid.");
+    }
+
+    if (pageCount == 0)
+    {
+        return tr("Document without pages can't be linearized.");
+    }
+
+    const PDFObjectReference rootReference = rootObject.getReference();
+    PDFObjectReference encryptReference;
+    const PDFObject& encryptObject = trailerDictionary->get("Encrypt");
+    if (encryptObject.isReference())
+    {
+        encryptReference = encryptObject.getReference();
+    }
+
+    std::vector<PDFObjectReference> pageReferences;
+    std::set<PDFObjectReference> pageReferenceSet;
+    pageReferences.reserve(pageCount);
+    for (size_t i = 0; i < pageCount; ++i)
+    {
+        const PDFObjectReference pageReference = catalog->getPage(i)->getPageReference();
+        pageReferences.push_back(pageReference);
+        pageReferenceSet.insert(pageReference);
+    }
+
+    // Collects objects reachable from the start objects in breadth-first order. Objects,
+    // for which stop predicate returns true, are not collected (and not traversed).
+    auto collectObjects = [&storage](const std::vector<PDFObjectReference>& startReferences, const auto& isStopped)
+    {
+        std::vector<PDFObjectReference> result;
+        std::set<PDFObjectReference> visited;
+        std::deque<PDFObjectReference> workSet;
+
+        for (const PDFObjectReference& reference : startReferences)
+        {
+            if (visited.insert(reference).second)
+            {
+                workSet.push_back(reference);
+            }
+        }
+
+        while (!workSet.empty())
+        {
+            const PDFObjectReference reference = workSet.front();
+            workSet.pop_front();
+
+            const PDFObject& object = storage.getObject(reference);
+            if (object.isNull())
+            {
+                continue;
+            }
+
+            result.push_back(reference);
+            for (const PDFObjectReference& childReference : PDFObjectUtils::getDirectReferences(object))
+            {
+                if (!isStopped(childReference) && visited.insert(childReference).second)
+                {
+                    workSet.push_back(childReference);
+                }
+            }
+        }
+
+        return result;
+    };
+
+    // 1) Document-level objects. Document catalog, page tree and objects needed
+    //    to open the document, together with encryption dictionary.
+    std::vector<PDFObjectReference> documentObjects = { rootReference };
+    {
+        std::vector<PDFObjectReference> startReferences;
+        if (const PDFDictionary* catalogDictionary = storage.getDictionaryFromObject(storage.getObject(rootReference)))
+        {
+            for (const char* key : { "Pages", "ViewerPreferences", "PageMode", "Threads", "OpenAction", "AcroForm" })
+            {
+                std::set<PDFObjectReference> references = PDFObjectUtils::getDirectReferences(catalogDictionary->get(key));
+                startReferences.insert(startReferences.end(), references.cbegin(), references.cend());
+            }
+        }
+
+        if (encryptReference.isValid())
+        {
+            startReferences.push_back(encryptReference);
+        }
+
+        auto isStopped = [&](PDFObjectReference reference) { return reference == rootReference || pageReferenceSet.count(reference); };
+        std::vector<PDFObjectReference> references = collectObjects(startReferences, isStopped);
+        std::copy_if(references.cbegin(), references.cend(), std::back_inserter(documentObjects), [rootReference](PDFObjectReference reference) { return reference != rootReference; });
+    }
+    const std::set<PDFObjectReference> documentObjectSet(documentObjects.cbegin(), documentObjects.cend());
+
+    // Collects all objects used by the page, which are not document-level objects
+    auto collectPageObjects = [&](size_t pageIndex)
+    {
+        const PDFObjectReference pageReference = pageReferences[pageIndex];
+        auto isStopped = [&](PDFObjectReference reference)
+        {
+            return reference != pageReference && (pageReferenceSet.count(reference) || documentObjectSet.count(reference));
+        };
+        return collectObjects({ pageReference }, isStopped);
+    };
+
+    // 2) First page objects (including objects shared with other pages)
+    std::vector<PDFObjectReference> firstPageObjects = collectPageObjects(0);
+    std::map<PDFObjectReference, uint32_t> firstPageObjectIndices;
+    for (const PDFObjectReference& reference : firstPageObjects)
+    {
+        firstPageObjectIndices[reference] = static_cast<uint32_t>(firstPageObjectIndices.size());
+    }
+
+    // 3) Objects of other pages. Objects used only by one page are written together
+    //    with the page, objects used by multiple pages are written as shared objects.
+    std::vector<std::vector<PDFObjectReference>> pageObjects(pageCount);
+    std::map<PDFObjectReference, size_t> usageCount;
+    for (size_t i = 1; i < pageCount; ++i)
+    {
+        pageObjects[i] = collectPageObjects(i);
+        for (const PDFObjectReference& reference : pageObjects[i])
+        {
+            if (!firstPageObjectIndices.count(reference))
+            {
+                ++usageCount[reference];
+            }
+        }
+    }
+
+    std::vector<std::vector<PDFObjectReference>> pageExclusiveObjects(pageCount);
+    std::vector<PDFObjectReference> sharedObjects;
+    std::map<PDFObjectReference, uint32_t> sharedObjectIndices;
+    for (size_t i = 1; i < pageCount; ++i)
+    {
+        for (const PDFObjectReference& reference : pageObjects[i])
+        {
+            auto it = usageCount.find(reference);
+            if (it == usageCount.cend())
+            {
+                // Object is in the first page
+                continue;
+            }
+
+            if (it->second == 1)
+            {
+                pageExclusiveObjects[i].push_back(reference);
+            }
+            else if (!sharedObjectIndices.count(reference))
+            {
+                sharedObjectIndices[reference] = static_cast<uint32_t>(sharedObjects.size());
+                sharedObjects.push_back(reference);
+            }
+        }
+    }
+
+    // 4) All remaining objects (page tree nodes, outlines, document information, ...)
+    std::set<PDFObjectReference> placedObjects = documentObjectSet;
+    placedObjects.insert(firstPageObjects.cbegin(), firstPageObjects.cend());
+    placedObjects.insert(sharedObjects.cbegin(), sharedObjects.cend());
+    for (const std::vector<PDFObjectReference>& references : pageExclusiveObjects)
+    {
+        placedObjects.insert(references.cbegin(), references.cend());
+    }
+
+    std::vector<PDFObjectReference> otherObjects;
+    const PDFObjectStorage::PDFObjects& objects = storage.getObjects();
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+        const PDFObjectReference reference(PDFInteger(i), objects[i].generation);
+        if (!objects[i].object.isNull() && !placedObjects.count(reference))
+        {
+            otherObjects.push_back(reference);
+            placedObjects.insert(reference);
+        }
+    }
+
+    // References to objects, which doesn't exist, are replaced by reference to the free entry
+    std::set<PDFObjectReference> danglingReferences;
+    auto checkDanglingReferences = [&](const PDFObject& object)
+    {
+        for (const PDFObjectReference& reference : PDFObjectUtils::getDirectReferences(object))
+        {
+            if (!placedObjects.count(reference))
+            {
+                danglingReferences.insert(reference);
+            }
+        }
+    };
+    for (const PDFObjectReference& reference : placedObjects)
+    {
+        checkDanglingReferences(storage.getObject(reference));
+    }
+    for (const char* key : { "Root", "Encrypt", "Info" })
+    {
+        checkDanglingReferences(trailerDictionary->get(key));
+    }
+
+    // Renumber objects. Objects of the main section (all pages except the first page,
+    // shared objects and other objects) are numbered from 1, objects of the first page
+    // section are numbered after them.
+    std::map<PDFObjectReference, PDFObjectReference> referenceMapping;
+    PDFInteger objectNumber = 1;
+    auto addMapping = [&](const std::vector<PDFObjectReference>& references)
+    {
+        for (const PDFObjectReference& reference : references)
+        {
+            referenceMapping[reference] = PDFObjectReference(objectNumber++, 0);
+        }
+    };
+
+    for (size_t i = 1; i < pageCount; ++i)
+    {
+        addMapping(pageExclusiveObjects[i]);
+    }
+    addMapping(sharedObjects);
+    addMapping(otherObjects);
+
+    if (!danglingReferences.empty())
+    {
+        const PDFObjectReference freeReference(objectNumber++, 0);
+        for (const PDFObjectReference& reference : danglingReferences)
+        {
+            referenceMapping[reference] = freeReference;
+        }
+    }
+
+    const PDFInteger mainSectionSize = objectNumber;
+    const PDFObjectReference linearizationDictionaryReference(objectNumber++, 0);
+    addMapping(documentObjects);
+    const PDFObjectReference hintStreamReference(objectNumber++, 0);
+    addMapping(firstPageObjects);
+    const PDFInteger totalSize = objectNumber;
+
+    // Serialize objects in the file order
+    std::vector<PDFLinearizedObject> fileObjects;
+    fileObjects.reserve(placedObjects.size());
+    auto addFileObjects = [&](const std::vector<PDFObjectReference>& references)
+    {
+        for (const PDFObjectReference& reference : references)
+        {
+            fileObjects.push_back(PDFLinearizedObject{ reference, referenceMapping.at(reference), QByteArray() });
+        }
+    };
+
+    addFileObjects(documentObjects);
+    addFileObjects(firstPageObjects);
+    for (size_t i = 1; i < pageCount; ++i)
+    {
+        addFileObjects(pageExclusiveObjects[i]);
+    }
+    addFileObjects(sharedObjects);
+    addFileObjects(otherObjects);
+
+    const PDFObjectReference newEncryptReference = encryptReference.isValid() ? referenceMapping.at(encryptReference) : PDFObjectReference();
+    auto serializeObject = [&](const PDFObjectReference& reference, PDFObject object)
+    {
+        if (isEncrypted && reference != newEncryptReference)
+        {
+            object = securityHandler->encryptObject(object, reference);
+        }
+
+        return getSerializedIndirectObject(reference, object);
+    };
+
+    auto serializeFileObject = [&](PDFLinearizedObject& fileObject)
+    {
+        PDFObject object = PDFObjectUtils::replaceReferences(storage.getObject(fileObject.sourceReference), referenceMapping);
+        fileObject.data = serializeObject(fileObject.reference, qMove(object));
+    };
+    PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Unknown, fileObjects.begin(), fileObjects.end(), serializeFileObject);
+
+    const size_t documentObjectCount = documentObjects.size();
+    const size_t firstPageObjectCount = firstPageObjects.size();
+    const size_t firstPageEndIndex = documentObjectCount + firstPageObjectCount;
+
+    auto getNumber = [](PDFInteger value) { return QByteArray::number(value).rightJustified(PDF_LINEARIZATION_NUMBER_WIDTH, ' '); };
+    auto getXRefEntry = [](PDFInteger offset, PDFInteger generation, bool occupied)
+    {
+        QByteArray entry;
+        entry += QByteArray::number(offset).rightJustified(10, '0', true);
+        entry += " ";
+        entry += QByteArray::number(generation).rightJustified(5, '0', true);
+        entry += occupied ? " n\x0D\x0A" : " f\x0D\x0A";
+        return entry;
+    };
+
+    const QByteArray fileHeader = getFileHeader(document->getInfo()->version);
+    const PDFInteger firstPageObjectNumber = referenceMapping.at(pageReferences.front()).objectNumber;
+    auto getLinearizationDictionary = [&](PDFInteger fileLength, PDFInteger hintStreamOffset, PDFInteger hintStreamLength, PDFInteger firstPageEndOffset, PDFInteger mainXRefTableFirstEntryOffset)
+    {
+        QByteArray data = QString("%1 %2 obj").arg(linearizationDictionaryReference.objectNumber).arg(linearizationDictionaryReference.generation).toLatin1() + "\x0D\x0A";
+        data += "<< /Linearized 1 /L " + getNumber(fileLength);
+        data += " /H [ " + getNumber(hintStreamOffset) + " " + getNumber(hintStreamLength) + " ]";
+        data += " /O " + getNumber(firstPageObjectNumber);
+        data += " /E " + getNumber(firstPageEndOffset);
+        data += " /N " + getNumber(PDFInteger(pageCount));
+        data += " /T " + getNumber(mainXRefTableFirstEntryOffset);
+        data += " >>\x0D\x0A";
+        data += "endobj\x0D\x0A";
+        return data;
+    };
+
+    // First page reference table contains the linearization dictionary, document-level
+    // objects, hint stream and first page objects (in this order).
+    auto getFirstPageXRefTable = [&](const std::vector<PDFInteger>& offsets, PDFInteger mainXRefTableOffset)
+    {
+        QByteArray data = "xref\x0D\x0A";
+        data += QByteArray::number(linearizationDictionaryReference.objectNumber) + " " + QByteArray::number(totalSize - linearizationDictionaryReference.objectNumber) + "\x0D\x0A";
+        for (PDFInteger offset : offsets)
+        {
+            data += getXRefEntry(offset, 0, true);
+        }
+
+        data += "trailer\x0D\x0A";
+        data += "<< /Size " + QByteArray::number(totalSize) + " ";
+        for (const char* key : { "Root", "Encrypt", "Info", "ID" })
+        {
+            const PDFObject& object = trailerDictionary->get(key);
+            if (!object.isNull())
+            {
+                data += "/" + QByteArray(key) + " " + getSerializedObject(PDFObjectUtils::replaceReferences(object, referenceMapping)) + " ";
+            }
+        }
+        data += "/Prev " + getNumber(mainXRefTableOffset) + " >>\x0D\x0A";
+        data += "startxref\x0D\x0A";
+        data += "0\x0D\x0A";
+        data += "%%EOF\x0D\x0A";
+        return data;
+    };
+
+    // Compute offsets of objects as if hint stream is not present in the file (offsets
+    // in the hint tables are defined in this way). Hint stream is written before the
+    // first page objects.
+    const PDFInteger linearizationDictionaryOffset = fileHeader.size();
+    const PDFInteger firstPageXRefTableOffset = linearizationDictionaryOffset + getLinearizationDictionary(0, 0, 0, 0, 0).size();
+    const PDFInteger firstPageXRefTableSize = getFirstPageXRefTable(std::vector<PDFInteger>(totalSize - linearizationDictionaryReference.objectNumber, 0), 0).size();
+
+    std::vector<PDFInteger> offsets;
+    offsets.reserve(fileObjects.size() + 1);
+    PDFInteger offset = firstPageXRefTableOffset + firstPageXRefTableSize;
+    for (const PDFLinearizedObject& fileObject : fileObjects)
+    {
+        offsets.push_back(offset);
+        offset += fileObject.data.size();
+    }
+    offsets.push_back(offset);
+
+    const PDFInteger hintStreamOffset = offsets[documentObjectCount];
+    auto getObjectsLength = [&offsets](size_t first, size_t last) { return offsets[last] - offsets[first]; };
+
+    // Page offset hint table
+    std::vector<uint32_t> pageObjectCounts(pageCount, 0);
+    std::vector<uint32_t> pageLengths(pageCount, 0);
+    std::vector<std::vector<uint32_t>> pageSharedObjectIdentifiers(pageCount);
+
+    pageObjectCounts[0] = static_cast<uint32_t>(firstPageObjectCount);
+    pageLengths[0] = static_cast<uint32_t>(getObjectsLength(documentObjectCount, firstPageEndIndex));
+
+    size_t pageStartIndex = firstPageEndIndex;
+    for (size_t i = 1; i < pageCount; ++i)
+    {
+        const size_t pageEndIndex = pageStartIndex + pageExclusiveObjects[i].size();
+        pageObjectCounts[i] = static_cast<uint32_t>(pageExclusiveObjects[i].size());
+        pageLengths[i] = static_cast<uint32_t>(getObjectsLength(pageStartIndex, pageEndIndex));
+        pageStartIndex = pageEndIndex;
+
+        for (const PDFObjectReference& reference : pageObjects[i])
+        {
+            auto firstPageIt = firstPageObjectIndices.find(reference);
+            if (firstPageIt != firstPageObjectIndices.cend())
+            {
+                pageSharedObjectIdentifiers[i].push_back(firstPageIt->second);
+            }
+
+            auto sharedIt = sharedObjectIndices.find(reference);
+            if (sharedIt != sharedObjectIndices.cend())
+            {
+                pageSharedObjectIdentifiers[i].push_back(static_cast<uint32_t>(firstPageObjectCount) + sharedIt->second);
+            }
+        }
+    }
+
+    const auto [minObjectCount, maxObjectCount] = std::minmax_element(pageObjectCounts.cbegin(), pageObjectCounts.cend());
+    const auto [minPageLength, maxPageLength] = std::minmax_element(pageLengths.cbegin(), pageLengths.cend());
+    uint32_t maxSharedObjectCount = 0;
+    uint32_t maxSharedObjectIdentifier = 0;
+    for (const std::vector<uint32_t>& identifiers : pageSharedObjectIdentifiers)
+    {
+        maxSharedObjectCount = qMax(maxSharedObjectCount, static_cast<uint32_t>(identifiers.size()));
+        for (uint32_t identifier : identifiers)
+        {
+            maxSharedObjectIdentifier = qMax(maxSharedObjectIdentifier, identifier);
+        }
+    }
+
+    PDFPageOffsetHintTable pageOffsetHintTable;
+    PDFPageOffsetHintTable::Header& pageHeader = pageOffsetHintTable.header;
+    pageHeader.leastObjectCount = *minObjectCount;
+    pageHeader.firstPageObjectOffset = static_cast<uint32_t>(offsets[documentObjectCount]);
+    pageHeader.objectCountBits = PDFLinearizationInfo::getBitCount(*maxObjectCount - *minObjectCount);
+    pageHeader.leastPageLength = *minPageLength;
+    pageHeader.pageLengthBits = PDFLinearizationInfo::getBitCount(*maxPageLength - *minPageLength);
+
+    // Content stream offsets and lengths are not used by viewers, so we
+    // specify whole page as content stream (as other writers do).
+    pageHeader.leastContentStreamOffset = 0;
+    pageHeader.contentStreamOffsetBits = 0;
+    pageHeader.leastContentStreamLength = pageHeader.leastPageLength;
+    pageHeader.contentStreamLengthBits = pageHeader.pageLengthBits;
+    pageHeader.sharedObjectCountBits = PDFLinearizationInfo::getBitCount(maxSharedObjectCount);
+    pageHeader.sharedObjectIdentifierBits = PDFLinearizationInfo::getBitCount(maxSharedObjectIdentifier);
+    pageHeader.sharedObjectNumeratorBits = 0;
+    pageHeader.sharedObjectDenominator = 1;
+
+    pageOffsetHintTable.entries.resize(pageCount);
+    for (size_t i = 0; i < pageCount; ++i)
+    {
+        PDFPageOffsetHintTable::Entry& entry = pageOffsetHintTable.entries[i];
+        entry.objectCountDelta = pageObjectCounts[i] - pageHeader.leastObjectCount;
+        entry.pageLengthDelta = pageLengths[i] - pageHeader.leastPageLength;
+        entry.sharedObjectIdentifiers = qMove(pageSharedObjectIdentifiers[i]);
+        entry.sharedObjectNumerators.resize(entry.sharedObjectIdentifiers.size(), 0);
+        entry.contentStreamLengthDelta = entry.pageLengthDelta;
+    }
+
+    // Shared object hint table - objects of the first page are followed by shared objects,
+    // each object forms its own group.
+    const size_t sharedStartIndex = pageStartIndex;
+    std::vector<uint32_t> groupLengths;
+    groupLengths.reserve(firstPageObjectCount + sharedObjects.size());
+    for (size_t i = documentObjectCount; i < firstPageEndIndex; ++i)
+    {
+        groupLengths.push_back(static_cast<uint32_t>(getObjectsLength(i, i + 1)));
+    }
+    for (size_t i = sharedStartIndex; i < sharedStartIndex + sharedObjects.size(); ++i)
+    {
+        groupLengths.push_back(static_cast<uint32_t>(getObjectsLength(i, i + 1)));
+    }
+
+    PDFSharedObjectHintTable sharedObjectHintTable;
+    PDFSharedObjectHintTable::Header& sharedHeader = sharedObjectHintTable.header;
+    if (!sharedObjects.empty())
+    {
+        sharedHeader.firstSharedObjectNumber = static_cast<uint32_t>(referenceMapping.at(sharedObjects.front()).objectNumber);
+        sharedHeader.firstSharedObjectOffset = static_cast<uint32_t>(offsets[sharedStartIndex]);
+    }
+    sharedHeader.firstPageEntryCount = static_cast<uint32_t>(firstPageObjectCount);
+    sharedHeader.entryCount = static_cast<uint32_t>(groupLengths.size());
+    sharedHeader.objectCountBits = 0;
+
+    const auto [minGroupLength, maxGroupLength] = std::minmax_element(groupLengths.cbegin(), groupLengths.cend());
+    sharedHeader.leastGroupLength = *minGroupLength;
+    sharedHeader.groupLengthBits = PDFLinearizationInfo::getBitCount(*maxGroupLength - *minGroupLength);
+
+    sharedObjectHintTable.entries.resize(groupLengths.size());
+    for (size_t i = 0; i < groupLengths.size(); ++i)
+    {
+        sharedObjectHintTable.entries[i].groupLengthDelta = groupLengths[i] - sharedHeader.leastGroupLength;
+    }
+
+    // Create hint stream
+    QByteArray hintStreamData = PDFLinearizationInfo::writePageOffsetHintTable(pageOffsetHintTable);
+    const PDFInteger sharedObjectHintTableOffset = hintStreamData.size();
+    hintStreamData += PDFLinearizationInfo::writeSharedObjectHintTable(sharedObjectHintTable);
+    hintStreamData = PDFFlateDecodeFilter::compress(hintStreamData);
+
+    PDFDictionary hintStreamDictionary;
+    hintStreamDictionary.addEntry(PDFInplaceOrMemoryString("Filter"), PDFObject::createName(QByteArray("FlateDecode")));
+    hintStreamDictionary.addEntry(PDFInplaceOrMemoryString("Length"), PDFObject::createInteger(hintStreamData.size()));
+    hintStreamDictionary.addEntry(PDFInplaceOrMemoryString("S"), PDFObject::createInteger(sharedObjectHintTableOffset));
+    PDFObject hintStreamObject = PDFObject::createStream(std::make_shared<PDFStream>(qMove(hintStreamDictionary), qMove(hintStreamData)));
+    const QByteArray hintStream = serializeObject(hintStreamReference, qMove(hintStreamObject));
+    const PDFInteger hintStreamLength = hintStream.size();
+
+    // Now, adjust offsets of objects after the hint stream
+    for (size_t i = documentObjectCount; i < offsets.size(); ++i)
+    {
+        offsets[i] += hintStreamLength;
+    }
+
+    const PDFInteger firstPageEndOffset = offsets[firstPageEndIndex];
+    const PDFInteger mainXRefTableOffset = offsets.back();
+
+    QByteArray mainXRefTable = "xref\x0D\x0A";
+    mainXRefTable += "0 " + QByteArray::number(mainSectionSize) + "\x0D\x0A";
+    const PDFInteger mainXRefTableFirstEntryOffset = mainXRefTableOffset + mainXRefTable.size() - 1;
+
+    std::vector<PDFInteger> mainSectionOffsets(mainSectionSize, -1);
+    std::vector<PDFInteger> firstPageSectionOffsets;
+    firstPageSectionOffsets.reserve(totalSize - linearizationDictionaryReference.objectNumber);
+    firstPageSectionOffsets.push_back(linearizationDictionaryOffset);
+    for (size_t i = 0; i < fileObjects.size(); ++i)
+    {
+        if (i == documentObjectCount)
+        {
+            firstPageSectionOffsets.push_back(hintStreamOffset);
+        }
+
+        if (i < firstPageEndIndex)
+        {
+            firstPageSectionOffsets.push_back(offsets[i]);
+        }
+        else
+        {
+            mainSectionOffsets[fileObjects[i].reference.objectNumber] = offsets[i];
+        }
+    }
+
+    for (PDFInteger i = 0; i < mainSectionSize; ++i)
+    {
+        const PDFInteger objectOffset = mainSectionOffsets[i];
+        mainXRefTable += getXRefEntry(qMax(objectOffset, PDFInteger(0)), i == 0 ? PDF_MAX_OBJECT_GENERATION : 0, objectOffset != -1);
+    }
+
+    mainXRefTable += "trailer\x0D\x0A";
+    mainXRefTable += "<< /Size " + QByteArray::number(mainSectionSize) + " >>\x0D\x0A";
+    mainXRefTable += "startxref\x0D\x0A";
+    mainXRefTable += QByteArray::number(firstPageXRefTableOffset) + "\x0D\x0A";
+    mainXRefTable += "%%EOF";
+
+    const PDFInteger fileLength = mainXRefTableOffset + mainXRefTable.size();
+
+    // Write the document
+    device->write(fileHeader);
+    device->write(getLinearizationDictionary(fileLength, hintStreamOffset, hintStreamLength, firstPageEndOffset, mainXRefTableFirstEntryOffset));
+    device->write(getFirstPageXRefTable(firstPageSectionOffsets, mainXRefTableOffset));
+
+    for (size_t i = 0; i < fileObjects.size(); ++i)
+    {
+        if (i == documentObjectCount)
+        {
+            device->write(hintStream);
+        }
+
+        device->write(fileObjects[i].data);
+    }
+
+    device->write(mainXRefTable);
+    return true;
+}
+
+QByteArray PDFDocumentWriter::getFileHeader(PDFVersion version)
+{
+    QByteArray header = QString("%PDF-%1.%2").arg(version.major).arg(version.minor).toLatin1();
+    header += "\x0D\x0A";
+    header += "% PDF producer: ";
+    header += PDF_LIBRARY_NAME;
+    header += "\x0D\x0A";
+    header += "\x0D\x0A";
+    header += "\x0D\x0A";
+    return header;
+}
+
+QByteArray PDFDocumentWriter::getSerializedIndirectObject(PDFObjectReference reference, const PDFObject& object)
+{
+    QBuffer buffer;
+
+    if (buffer.open(QBuffer::WriteOnly))
+    {
+        PDFWriteObjectVisitor visitor(&buffer);
+        writeObjectHeader(&buffer, reference);
+        object.accept(&visitor);
+        writeObjectFooter(&buffer);
+
+        buffer.close();
+    }
+
+    return buffer.data();
+}
+
 void PDFDocumentWriter::writeCRLF(QIODevice* device)
 {
     device->write("\x0D\x0A");
@@ -40,6 +40,21 @@ public:
 
     }
 
+    enum WriteFlag
+    {
+        None            = 0x0000,   ///< Document is written in the standard way
+        Linearize       = 0x0001,   ///< Document is written linearized (Fast Web View), so it can be displayed before it is completely read
+        ObjectStreams   = 0x0002,   ///< Objects are packed into compressed object streams and cross-reference stream is written (ignored for linearized documents)
+    };
+    Q_DECLARE_FLAGS(WriteFlags, WriteFlag)
+
+    /// Returns flags, which are used when document is written
+    WriteFlags getFlags() const { return m_flags; }
+
+    /// Sets flags, which are used when document is written
+    /// \param flags Write flags
+    void setFlags(WriteFlags flags) { m_flags = flags; }
+
     /// Writes document to the file. If \p safeWrite is true, then document is first
     /// written to the temporary file, and then renamed to original file name atomically,
     /// so no data can be lost on, for example, power failure. If it is not possible to
@@ -56,6 +71,26 @@ public:
     /// \param document Document
     PDFOperationResult write(QIODevice* device, const PDFDocument* document);
 
+    /// Writes incremental update of the original document to the file, which
+    /// contains the original document. Only new, changed and deleted objects
+    /// are appended to the end of the file, followed by a new cross reference
+    /// section and trailer (with /Prev entry). If the original file uses cross
+    /// reference streams, cross reference stream is written instead of the table.
+    /// Original content of the file is not changed, so existing signatures remain valid.
+    /// \param fileName File name of the original document
+    /// \param document Modified document
+    /// \param originalDocument Original document (as it was read from the file)
+    PDFOperationResult writeIncrementalUpdate(const QString& fileName, const PDFDocument* document, const PDFDocument* originalDocument);
+
+    /// Writes incremental update of the original document to the output device.
+    /// Device must be positioned at the end of the original file data, because
+    /// offsets of the objects are computed from the device position.
+    /// \param device Output device
+    /// \param document Modified document
+    /// \param originalDocument Original document (as it was read from the file)
+    /// \param previousXRefOffset Offset of the last cross reference section of the original file
+    PDFOperationResult writeIncrementalUpdate(QIODevice* device, const PDFDocument* document, const PDFDocument* originalDocument, PDFInteger previousXRefOffset);
+
     /// Calculates document file size, as if it is written to the disk.
     /// No file is accessed by this function; document is written
     /// to fake stream, which counts operations. If error occurs, and
@@ -73,14 +108,42 @@ public:
     static QByteArray getSerializedObject(const PDFObject& object);
 
 private:
+    /// Writes linearized document to the output device. Objects are renumbered
+    /// and reordered, so objects of the first page are at the beginning of the
+    /// file, followed by objects of other pages, shared objects and other objects.
+    /// \param device Output device
+    /// \param document Document
+    PDFOperationResult writeLinearized(QIODevice* device, const PDFDocument* document);
+
+    /// Writes document to the output device using object streams and cross-reference
+    /// stream. Objects, which can be stored in object streams, are packed together
+    /// and compressed, other objects are written as usual.
+    /// \param device Output device
+    /// \param document Document
+    PDFOperationResult writeCompressed(QIODevice* device, const PDFDocument* document);
+
+    /// Returns file header of the document (version and producer)
+    /// \param version Version of the document
+    static QByteArray getFileHeader(PDFVersion version);
+
+    /// Writes an indirect object to byte array, including object header/footer
+    /// \param reference Reference of the object
+    /// \param object Object to be written
+    static QByteArray getSerializedIndirectObject(PDFObjectReference reference, const PDFObject& object);
+
     static void writeCRLF(QIODevice* device);
     static void writeObjectHeader(QIODevice* device, PDFObjectReference reference);
     static void writeObjectFooter(QIODevice* device);
 
     /// Progress indicator
     PDFProgress* m_progress;
+
+    /// Write flags
+    WriteFlags m_flags = None;
 };
 
 }   // namespace pdf
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(pdf::PDFDocumentWriter::WriteFlags)
+
 #endif // PDFDOCUMENTWRITER_H
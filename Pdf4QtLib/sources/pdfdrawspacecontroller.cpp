@@ -24,12 +24,15 @@
 #include "pdfconstants.h"
 #include "pdfcms.h"
 #include "pdfannotation.h"
+#include "pdfimagecache.h"
 #include "pdfdbgheap.h"
 
 #include <QTimer>
 #include <QPainter>
 #include <QFontMetrics>
 
+#include <cmath>
+
 namespace pdf
 {
 
@@ -466,7 +469,11 @@ PDFDrawWidgetProxy::PDFDrawWidgetProxy(QObject* parent) :
     m_rasterizer(new PDFRasterizer(this)),
     m_progress(nullptr),
     m_cacheClearTimer(new QTimer(this)),
-    m_useOpenGL(false)
+    m_useOpenGL(false),
+    m_pagePrefetchingEnabled(false),
+    m_imageCacheLimit(PDFImageCache::DEFAULT_CACHE_LIMIT),
+    m_scrollVelocity(0.0),
+    m_scrollDirection(1)
 {
     m_controller = new PDFDrawSpaceController(this);
     connect(m_controller, &PDFDrawSpaceController::drawSpaceChanged, this, &PDFDrawWidgetProxy::update);
@@ -476,6 +483,10 @@ PDFDrawWidgetProxy::PDFDrawWidgetProxy(QObject* parent) :
     connect(m_compiler, &PDFAsynchronousPageCompiler::pageImageChanged, this, &PDFDrawWidgetProxy::pageImageChanged);
     connect(m_textLayoutCompiler, &PDFAsynchronousTextLayoutCompiler::textLayoutChanged, this, &PDFDrawWidgetProxy::onTextLayoutChanged);
     connect(m_cacheClearTimer, &QTimer::timeout, this, &PDFDrawWidgetProxy::performPageCacheClear);
+    connect(m_controller, &PDFDrawSpaceController::drawSpaceChanged, this, &PDFDrawWidgetProxy::clearTileCache);
+    connect(this, &PDFDrawWidgetProxy::drawSpaceChanged, this, &PDFDrawWidgetProxy::updateActivePages);
+    connect(this, &PDFDrawWidgetProxy::pageImageChanged, this, &PDFDrawWidgetProxy::onPageImageChanged);
+    connect(&m_tileCache, &PDFPageTileCache::tilesRendered, this, &PDFDrawWidgetProxy::repaintNeeded);
 }
 
 PDFDrawWidgetProxy::~PDFDrawWidgetProxy()
@@ -492,6 +503,11 @@ void PDFDrawWidgetProxy::setDocument(const PDFModifiedDocument& document)
         m_textLayoutCompiler->stop(document.hasReset() || document.hasPageContentsChanged());
         m_controller->setDocument(document);
 
+        if (const PDFDocument* currentDocument = getDocument())
+        {
+            currentDocument->getImageCache()->setCacheLimit(m_imageCacheLimit);
+        }
+
         if (PDFOptionalContentActivity* optionalContentActivity = document.getOptionalContentActivity())
         {
             connect(optionalContentActivity, &PDFOptionalContentActivity::optionalContentGroupStateChanged, this, &PDFDrawWidgetProxy::onOptionalContentGroupStateChanged, Qt::UniqueConnection);
@@ -780,15 +796,30 @@ void PDFDrawWidgetProxy::drawPages(QPainter* painter, QRect rect, PDFRenderer::F
                 painter->fillRect(placedRect, paperColor);
             }
 
-            const PDFPrecompiledPage* compiledPage = m_compiler->getCompiledPage(item.pageIndex, true);
+            const PDFPage* page = m_controller->getDocument()->getCatalog()->getPage(item.pageIndex);
+            const QTransform pageMatrix = createPagePointToDevicePointMatrix(page, placedRect);
+            const PDFReal devicePixelRatio = painter->device() ? painter->device()->devicePixelRatioF() : 1.0;
+
+            // Images of compiled pages are decoded with resolution, at which pages are displayed
+            m_compiler->setImageResolution(std::sqrt(std::abs(pageMatrix.determinant())) * devicePixelRatio);
+
+            std::shared_ptr<const PDFPrecompiledPage> compiledPage = m_compiler->getCompiledPage(item.pageIndex, true);
             if (compiledPage && compiledPage->isValid())
             {
                 QElapsedTimer timer;
                 timer.start();
 
-                const PDFPage* page = m_controller->getDocument()->getCatalog()->getPage(item.pageIndex);
-                QTransform matrix = QTransform(createPagePointToDevicePointMatrix(page, placedRect)) * baseMatrix;
-                compiledPage->draw(painter, page->getCropBox(), matrix, features, groupInfo.transparency);
+                QTransform matrix = pageMatrix * baseMatrix;
+
+                // Very large pages are drawn using tiles, so only visible area of the page is rendered
+                if (PDFPageTileCache::isTiledRenderingUsed((QSizeF(placedRect.size()) * devicePixelRatio).toSize()))
+                {
+                    m_tileCache.drawPage(painter, item.pageIndex, page->getCropBox(), compiledPage, pageMatrix, placedRect, rect, features, paperColor, groupInfo.drawPaper, groupInfo.transparency);
+                }
+                else
+                {
+                    compiledPage->draw(painter, page->getCropBox(), matrix, features, groupInfo.transparency);
+                }
                 PDFTextLayoutGetter layoutGetter = m_textLayoutCompiler->getTextLayoutLazy(item.pageIndex);
 
                 // Draw text blocks/text lines, if it is enabled
@@ -848,7 +879,7 @@ void PDFDrawWidgetProxy::drawPages(QPainter* painter, QRect rect, PDFRenderer::F
                     for (IDocumentDrawInterface* drawInterface : m_drawInterfaces)
                     {
                         painter->save();
-                        drawInterface->drawPage(painter, item.pageIndex, compiledPage, layoutGetter, matrix, drawInterfaceErrors);
+                        drawInterface->drawPage(painter, item.pageIndex, compiledPage.get(), layoutGetter, matrix, drawInterfaceErrors);
                         painter->restore();
                     }
                 }
@@ -881,6 +912,9 @@ void PDFDrawWidgetProxy::drawPages(QPainter* painter, QRect rect, PDFRenderer::F
                     painter->drawText(0, 0, PDFTranslationContext::tr("Compile time:    %1 [ms]").arg(formatDrawTime(compiledPage->getCompilingTimeNS())));
                     painter->translate(0, lineSpacing);
                     painter->drawText(0, 0, PDFTranslationContext::tr("Draw time:       %1 [ms]").arg(formatDrawTime(drawTimeNS)));
+                    painter->translate(0, lineSpacing);
+                    const PDFPageContentProcessor::ColorConversionStatistics& colorStatistics = compiledPage->getColorConversionStatistics();
+                    painter->drawText(0, 0, PDFTranslationContext::tr("Color memo:      %1 hits / %2 misses").arg(colorStatistics.memoHits).arg(colorStatistics.memoMisses));
 
                     painter->restore();
                 }
@@ -918,11 +952,11 @@ QImage PDFDrawWidgetProxy::drawThumbnailImage(PDFInteger pageIndex, int pixelSiz
 
         if (imageSize.isValid())
         {
-            const PDFPrecompiledPage* compiledPage = m_compiler->getCompiledPage(pageIndex, true);
+            std::shared_ptr<const PDFPrecompiledPage> compiledPage = m_compiler->getCompiledPage(pageIndex, true);
             if (compiledPage && compiledPage->isValid())
             {
                 // Rasterize the image.
-                image = m_rasterizer->render(pageIndex, page, compiledPage, imageSize, m_features, m_widget->getAnnotationManager(), PageRotation::None);
+                image = m_rasterizer->render(pageIndex, page, compiledPage.get(), imageSize, m_features, m_widget->getAnnotationManager(), PageRotation::None);
             }
 
             if (image.isNull())
@@ -1297,6 +1331,31 @@ void PDFDrawWidgetProxy::performPageCacheClear()
     m_compiler->smartClearCache(CACHE_PAGE_EXPIRATION_TIMEOUT, activePage);
 }
 
+void PDFDrawWidgetProxy::updateActivePages()
+{
+    if (m_widget && getDocument())
+    {
+        m_compiler->setActivePages(getActivePages());
+    }
+}
+
+void PDFDrawWidgetProxy::onPageImageChanged(bool all, const std::vector<PDFInteger>& pages)
+{
+    if (all)
+    {
+        m_tileCache.clear();
+    }
+    else
+    {
+        m_tileCache.removePages(pages);
+    }
+}
+
+void PDFDrawWidgetProxy::clearTileCache()
+{
+    m_tileCache.clear();
+}
+
 void PDFDrawWidgetProxy::onTextLayoutChanged()
 {
     Q_EMIT repaintNeeded();
@@ -1362,12 +1421,150 @@ void PDFDrawWidgetProxy::prefetchPages(PDFInteger pageIndex)
 
     if (const PDFDocument* document = getDocument())
     {
+        // Predicted pages are prefetched first, then pages after the page
+        std::vector<PDFInteger> pages = getPredictedPages();
+
         const PDFInteger pageCount = document->getCatalog()->getPageCount();
         const PDFInteger pageEnd = qMin(pageCount, pageIndex + prefetchCount + 1);
         for (PDFInteger i = pageIndex + 1; i < pageEnd; ++i)
         {
-            m_compiler->getCompiledPage(i, true);
+            if (std::find(pages.cbegin(), pages.cend(), i) == pages.cend())
+            {
+                pages.push_back(i);
+            }
         }
+
+        m_compiler->prefetchPages(pages);
+    }
+}
+
+void PDFDrawWidgetProxy::setPagePrefetchingEnabled(bool enabled)
+{
+    if (m_pagePrefetchingEnabled != enabled)
+    {
+        m_pagePrefetchingEnabled = enabled;
+
+        if (!enabled)
+        {
+            // Cancel pending prefetch requests
+            m_compiler->prefetchPages({ });
+        }
+    }
+}
+
+void PDFDrawWidgetProxy::updateScrollVelocity(PDFReal delta)
+{
+    if (qFuzzyIsNull(delta))
+    {
+        return;
+    }
+
+    const int direction = delta > 0.0 ? 1 : -1;
+    const qint64 elapsed = m_scrollTimer.isValid() ? m_scrollTimer.restart() : PREFETCH_VELOCITY_TIMEOUT + 1;
+    if (!m_scrollTimer.isValid())
+    {
+        m_scrollTimer.start();
+    }
+
+    if (elapsed > PREFETCH_VELOCITY_TIMEOUT || direction != m_scrollDirection)
+    {
+        // Scrolling was started or direction was reversed, we can't use
+        // old velocity. Prefetch requests in the old direction are cancelled
+        // when pages are prefetched next time.
+        m_scrollVelocity = 0.0;
+    }
+    else
+    {
+        // Exponential smoothing of the velocity, so single scroll
+        // events with unusual delta do not change velocity much.
+        const PDFReal velocity = delta / PDFReal(qMax(elapsed, qint64(1)));
+        m_scrollVelocity = 0.5 * m_scrollVelocity + 0.5 * velocity;
+    }
+
+    m_scrollDirection = direction;
+}
+
+std::vector<PDFInteger> PDFDrawWidgetProxy::getPredictedPages() const
+{
+    std::vector<PDFInteger> pages;
+
+    if (!getDocument() || !m_widget)
+    {
+        return pages;
+    }
+
+    // If user stopped scrolling, velocity is obsolete
+    const bool isVelocityValid = m_scrollTimer.isValid() && !m_scrollTimer.hasExpired(PREFETCH_VELOCITY_TIMEOUT);
+    const PDFReal velocity = isVelocityValid ? qAbs(m_scrollVelocity) : 0.0;
+
+    if (isBlockMode())
+    {
+        if (m_currentBlock == INVALID_BLOCK_INDEX)
+        {
+            return pages;
+        }
+
+        // Prefetch next block in the scroll direction, and when user
+        // is browsing blocks fast, also the block after it.
+        const PDFInteger blockCount = PDFInteger(m_controller->getBlockCount());
+        const PDFInteger prefetchBlockCount = velocity * PREFETCH_LOOKAHEAD_TIME > 1.0 ? 2 : 1;
+        for (PDFInteger i = 1; i <= prefetchBlockCount; ++i)
+        {
+            const PDFInteger blockIndex = PDFInteger(m_currentBlock) + i * m_scrollDirection;
+            if (blockIndex < 0 || blockIndex >= blockCount)
+            {
+                break;
+            }
+
+            for (const PDFDrawSpaceController::LayoutItem& item : m_controller->getLayoutItems(size_t(blockIndex)))
+            {
+                pages.push_back(item.pageIndex);
+            }
+        }
+    }
+    else
+    {
+        // Prefetch area is right after the widget area in the scroll direction, its height
+        // is distance scrolled with current velocity during the lookahead time, at least
+        // height of the widget.
+        const QRect rect = m_widget->rect();
+        const int height = qMax(rect.height(), 1);
+        const int lookahead = qBound(height, qRound(velocity * PREFETCH_LOOKAHEAD_TIME), height * PREFETCH_MAX_VIEWPORTS);
+
+        QRect prefetchRect = rect;
+        if (m_scrollDirection > 0)
+        {
+            prefetchRect.setTop(rect.bottom() + 1);
+            prefetchRect.setHeight(lookahead);
+        }
+        else
+        {
+            prefetchRect.setBottom(rect.top() - 1);
+            prefetchRect.setTop(rect.top() - lookahead);
+        }
+
+        pages = getPagesIntersectingRect(prefetchRect);
+
+        if (m_scrollDirection < 0)
+        {
+            // Nearest pages must be first
+            std::reverse(pages.begin(), pages.end());
+        }
+    }
+
+    if (pages.size() > PREFETCH_MAX_PAGES)
+    {
+        pages.resize(PREFETCH_MAX_PAGES);
+    }
+
+    return pages;
+}
+
+void PDFDrawWidgetProxy::performPagePrefetch()
+{
+    if (m_pagePrefetchingEnabled && getDocument())
+    {
+        m_compiler->prefetchPages(getPredictedPages());
     }
 }
 
@@ -1412,9 +1609,13 @@ void PDFDrawWidgetProxy::setVerticalOffset(int value)
 
     if (m_verticalOffset != verticalOffset)
     {
+        // Offset decreases, when scrolling to the following pages
+        updateScrollVelocity(m_verticalOffset - verticalOffset);
+
         m_verticalOffset = verticalOffset;
         updateVerticalScrollbarFromOffset();
         Q_EMIT drawSpaceChanged();
+        performPagePrefetch();
     }
 }
 
@@ -1422,8 +1623,14 @@ void PDFDrawWidgetProxy::setBlockIndex(int index)
 {
     if (m_currentBlock != index)
     {
+        if (m_currentBlock != INVALID_BLOCK_INDEX)
+        {
+            updateScrollVelocity(PDFReal(index) - PDFReal(m_currentBlock));
+        }
+
         m_currentBlock = static_cast<size_t>(index);
         update();
+        performPagePrefetch();
     }
 }
 
@@ -1517,6 +1724,16 @@ void PDFDrawWidgetProxy::setColorTolerance(PDFReal colorTolerance)
     }
 }
 
+void PDFDrawWidgetProxy::setImageCacheLimit(qint64 imageCacheLimit)
+{
+    m_imageCacheLimit = imageCacheLimit;
+
+    if (const PDFDocument* document = getDocument())
+    {
+        document->getImageCache()->setCacheLimit(m_imageCacheLimit);
+    }
+}
+
 void PDFDrawWidgetProxy::onColorManagementSystemChanged()
 {
     m_compiler->reset();
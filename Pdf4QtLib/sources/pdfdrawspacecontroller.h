@@ -23,9 +23,11 @@
 #include "pdfrenderer.h"
 #include "pdffont.h"
 #include "pdfdocumentdrawinterface.h"
+#include "pdfpagetilecache.h"
 
 #include <QRectF>
 #include <QObject>
+#include <QElapsedTimer>
 #include <QMarginsF>
 
 class QPainter;
@@ -182,7 +184,7 @@ struct PDFWidgetSnapshot
         PDFInteger pageIndex = -1;  ///< Index of page
         QRectF rect;                ///< Page rectangle on viewport
         QTransform pageToDeviceMatrix;             ///< Transforms page coordinates to widget coordinates
-        const PDFPrecompiledPage* compiledPage = nullptr; ///< Compiled page (can be nullptr)
+        std::shared_ptr<const PDFPrecompiledPage> compiledPage; ///< Compiled page (can be nullptr)
     };
 
     bool hasPage(PDFInteger pageIndex) const { return getPageSnapshot(pageIndex) != nullptr; }
@@ -333,9 +335,20 @@ public:
     void updateRenderer(bool useOpenGL, const QSurfaceFormat& surfaceFormat);
 
     /// Prefetches (prerenders) pages after page with pageIndex, i.e., prepares
-    /// for non-flickering scroll operation.
+    /// for non-flickering scroll operation. Pages predicted from the scrolling
+    /// are prefetched first.
     void prefetchPages(PDFInteger pageIndex);
 
+    /// Enables or disables predictive page prefetching. If it is enabled, then
+    /// pages, which will be probably displayed soon (predicted from the scroll
+    /// velocity and direction), are compiled with low priority, when
+    /// draw area is scrolled.
+    /// \param enabled Enable predictive page prefetching
+    void setPagePrefetchingEnabled(bool enabled);
+
+    /// Returns true, if predictive page prefetching is enabled
+    bool isPagePrefetchingEnabled() const { return m_pagePrefetchingEnabled; }
+
     static constexpr PDFReal ZOOM_STEP = 1.2;
 
     const PDFDocument* getDocument() const { return m_controller->getDocument(); }
@@ -358,6 +371,11 @@ public:
     void setMinimalMeshResolutionRatio(PDFReal ratio);
     void setColorTolerance(PDFReal colorTolerance);
 
+    /// Sets cache limit of decoded images of the document. Limit
+    /// is also applied to documents, which will be set later.
+    /// \param imageCacheLimit Image cache limit [bytes]
+    void setImageCacheLimit(qint64 imageCacheLimit);
+
     static constexpr PDFReal getMinZoom() { return MIN_ZOOM; }
     static constexpr PDFReal getMaxZoom() { return MAX_ZOOM; }
 
@@ -439,10 +457,37 @@ private:
     static constexpr qint64 CACHE_CLEAR_TIMEOUT = 5000;
     static constexpr qint64 CACHE_PAGE_EXPIRATION_TIMEOUT = 30000;
 
+    /// Scroll velocity is reset, if no scroll occured during this timeout [ms]
+    static constexpr qint64 PREFETCH_VELOCITY_TIMEOUT = 300;
+
+    /// Time [ms], for which we predict the scrolling in the current velocity
+    static constexpr PDFReal PREFETCH_LOOKAHEAD_TIME = 500.0;
+
+    /// Maximal prefetch area (in multiples of the widget height)
+    static constexpr int PREFETCH_MAX_VIEWPORTS = 10;
+
+    /// Maximal number of prefetched pages
+    static constexpr size_t PREFETCH_MAX_PAGES = 8;
+
+    /// Updates scroll velocity and direction using the change of the position
+    /// in the document (positive value means scrolling to the following pages).
+    /// \param delta Change of the position (in pixels, or in blocks in block mode)
+    void updateScrollVelocity(PDFReal delta);
+
+    /// Returns pages, which will be probably displayed soon, predicted
+    /// from the scroll velocity and direction. Nearest pages are first.
+    std::vector<PDFInteger> getPredictedPages() const;
+
+    /// Prefetches predicted pages, if page prefetching is enabled
+    void performPagePrefetch();
+
     /// Converts rectangle from device space to the pixel space
     QRectF fromDeviceSpace(const QRectF& rect) const;
 
     void performPageCacheClear();
+    void updateActivePages();
+    void onPageImageChanged(bool all, const std::vector<PDFInteger>& pages);
+    void clearTileCache();
 
     void onTextLayoutChanged();
     void onOptionalContentGroupStateChanged();
@@ -532,6 +577,9 @@ private:
     /// Page compiler
     PDFAsynchronousPageCompiler* m_compiler;
 
+    /// Rendered tiles of very large pages
+    PDFPageTileCache m_tileCache;
+
     /// Text layout compiler
     PDFAsynchronousTextLayoutCompiler* m_textLayoutCompiler;
 
@@ -553,6 +601,22 @@ private:
     /// Surface format for OpenGL
     QSurfaceFormat m_surfaceFormat;
 
+    /// Predictive page prefetching is enabled
+    bool m_pagePrefetchingEnabled;
+
+    /// Cache limit of decoded images of the document [bytes]
+    qint64 m_imageCacheLimit;
+
+    /// Scroll velocity (in pixels per millisecond, or blocks per millisecond
+    /// in block mode), positive value means scrolling to the following pages.
+    PDFReal m_scrollVelocity;
+
+    /// Last scroll direction (1 to the following pages, -1 to the previous pages)
+    int m_scrollDirection;
+
+    /// Timer measuring time from the last scroll
+    QElapsedTimer m_scrollTimer;
+
     /// Page group info for rendering. Group of pages
     /// can be rendered with transparency or without paper
     /// as overlay.
@@ -118,11 +118,12 @@ void PDFWidget::updateRenderer(RendererEngine engine, int samplesCount)
     updateRendererImpl();
 }
 
-void PDFWidget::updateCacheLimits(int compiledPageCacheLimit, int thumbnailsCacheLimit, int fontCacheLimit, int instancedFontCacheLimit)
+void PDFWidget::updateCacheLimits(qint64 compiledPageCacheLimit, int thumbnailsCacheLimit, int fontCacheLimit, int instancedFontCacheLimit, qint64 imageCacheLimit)
 {
     m_proxy->getCompiler()->setCacheLimit(compiledPageCacheLimit);
     QPixmapCache::setCacheLimit(thumbnailsCacheLimit);
     m_proxy->getFontCache()->setCacheLimits(fontCacheLimit, instancedFontCacheLimit);
+    m_proxy->setImageCacheLimit(imageCacheLimit);
 }
 
 int PDFWidget::getPageRenderingErrorCount() const
@@ -80,7 +80,8 @@ public:
     /// \param thumbnailsCacheLimit Thumbnail image cache limit [kB]
     /// \param fontCacheLimit Font cache limit [-]
     /// \param instancedFontCacheLimit Instanced font cache limit [-]
-    void updateCacheLimits(int compiledPageCacheLimit, int thumbnailsCacheLimit, int fontCacheLimit, int instancedFontCacheLimit);
+    /// \param imageCacheLimit Decoded image cache limit [bytes]
+    void updateCacheLimits(qint64 compiledPageCacheLimit, int thumbnailsCacheLimit, int fontCacheLimit, int instancedFontCacheLimit, qint64 imageCacheLimit);
 
     const PDFCMSManager* getCMSManager() const { return m_cmsManager; }
     PDFToolManager* getToolManager() const { return m_toolManager; }
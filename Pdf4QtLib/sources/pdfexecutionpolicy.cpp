@@ -19,12 +19,455 @@
 #include "pdfexecutionpolicy.h"
 #include "pdfdbgheap.h"
 
+#include <QMutex>
 #include <QThread>
 #include <QApplication>
+#include <QWaitCondition>
+
+#include <deque>
+#include <iterator>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <exception>
 
 namespace pdf
 {
 
+/// Work-stealing task scheduler. Each worker thread has its own task queue,
+/// tasks created by the worker are pushed at the back of its queue and the worker
+/// takes them from the back (so the most recently created, nested tasks are processed
+/// first). Idle threads steal tasks from the front of the queues of other threads.
+/// Tasks created by threads, which are not workers of the scheduler, are pushed
+/// into the global queue. Task is a participation of the thread in the job,
+/// participating thread takes the chunks of the job, until all chunks are processed.
+/// Thread, which waits for the job to be finished, helps to execute pending tasks
+/// of the job and of the jobs nested in it, so the scheduler doesn't deadlock, when
+/// jobs are nested. Tasks of unrelated jobs are never taken by the waiting thread,
+/// so it can't get stuck in a long running task of another job.
+class PDFWorkStealingScheduler
+{
+public:
+    explicit PDFWorkStealingScheduler();
+
+    /// Maximal thread count slots - page (and unknown) scope and content scope
+    enum ThreadCountSlot
+    {
+        PrimarySlot,
+        AuxiliarySlot,
+        LastSlot
+    };
+
+    /// Executes the chunks of the job and waits for them to be finished
+    void execute(ThreadCountSlot slot, size_t chunkCount, const PDFExecutionPolicy::ChunkFunction& function);
+
+    /// Stops the worker threads. Jobs can still be executed after
+    /// the scheduler has been stopped, but only by the calling threads.
+    void stop();
+
+    int getActiveThreadCount(ThreadCountSlot slot) const { return m_activeThreadCount[slot].load(std::memory_order_relaxed); }
+    int getMaxThreadCount(ThreadCountSlot slot) const { return m_maxThreadCount[slot].load(std::memory_order_relaxed); }
+    void setMaxThreadCount(ThreadCountSlot slot, int count) { m_maxThreadCount[slot].store(count, std::memory_order_relaxed); }
+
+private:
+    struct Job
+    {
+        const Job* parent = nullptr; ///< Job, in which chunk this job was created
+        const PDFExecutionPolicy::ChunkFunction* function = nullptr;
+        ThreadCountSlot slot = PrimarySlot;
+        size_t chunkCount = 0;
+        std::atomic<size_t> nextChunk = 0;
+        std::atomic<int> pendingTasks = 0;
+
+        QMutex exceptionMutex;
+        std::exception_ptr exception;
+    };
+
+    struct TaskQueue
+    {
+        QMutex mutex;
+        std::deque<Job*> tasks;
+    };
+
+    /// Starts the worker threads, if they were not started yet
+    void ensureStarted();
+
+    /// Worker thread main loop
+    void runWorker(size_t workerIndex);
+
+    /// Pushes tasks into the queue of the current thread
+    void pushTasks(Job* job, int count);
+
+    /// Takes a task from the queue of the current thread, or from the global queue,
+    /// or steals it from other workers. If no task is found, nullptr is returned.
+    /// \param owner If not null, only tasks of this job, or of jobs nested in it, are taken
+    Job* takeTask(const Job* owner = nullptr);
+
+    /// Returns true, if job is the owner job, or it is nested in the owner job
+    static bool isNestedJob(const Job* job, const Job* owner);
+
+    /// Executes the task, i.e. processes the chunks of the job
+    void runTask(Job* job);
+
+    /// Processes the chunks of the job, until all chunks are taken
+    void participate(Job* job);
+
+    /// Waits until some tasks are pushed after the push generation was read,
+    /// or until the job is finished
+    void waitForJob(const Job* job, quint64 pushGeneration);
+
+    std::atomic<bool> m_started;
+    std::atomic<int> m_queuedTasks;
+    std::atomic<quint64> m_pushGeneration;
+    std::atomic<int> m_activeThreadCount[LastSlot];
+    std::atomic<int> m_maxThreadCount[LastSlot];
+
+    QMutex m_mutex;
+    QWaitCondition m_waitCondition; ///< Idle workers wait here
+    QWaitCondition m_jobWaitCondition; ///< Threads waiting for the jobs to be finished wait here
+    bool m_stopping;
+
+    TaskQueue m_globalQueue;
+    std::vector<std::unique_ptr<TaskQueue>> m_workerQueues;
+    std::vector<QThread*> m_workers;
+
+    /// Index of the worker in the scheduler, -1 for threads, which are not workers
+    static thread_local int s_workerIndex;
+
+    /// Job, which chunk is being processed by the current thread
+    static thread_local const Job* s_currentJob;
+};
+
+thread_local int PDFWorkStealingScheduler::s_workerIndex = -1;
+thread_local const PDFWorkStealingScheduler::Job* PDFWorkStealingScheduler::s_currentJob = nullptr;
+
+PDFWorkStealingScheduler::PDFWorkStealingScheduler() :
+    m_started(false),
+    m_queuedTasks(0),
+    m_pushGeneration(0),
+    m_activeThreadCount{ 0, 0 },
+    m_maxThreadCount{ QThread::idealThreadCount(), QThread::idealThreadCount() },
+    m_stopping(false)
+{
+
+}
+
+void PDFWorkStealingScheduler::execute(ThreadCountSlot slot, size_t chunkCount, const PDFExecutionPolicy::ChunkFunction& function)
+{
+    if (chunkCount == 0)
+    {
+        return;
+    }
+
+    ensureStarted();
+
+    Job job;
+    job.parent = s_currentJob;
+    job.function = &function;
+    job.slot = slot;
+    job.chunkCount = chunkCount;
+
+    // Calling thread also participates in the job, so we need one task less
+    const int taskCount = qMin(getMaxThreadCount(slot), int(qMin(chunkCount, size_t(std::numeric_limits<int>::max())))) - 1;
+    if (taskCount > 0)
+    {
+        job.pendingTasks.store(taskCount, std::memory_order_relaxed);
+        pushTasks(&job, taskCount);
+    }
+
+    participate(&job);
+
+    // Help to execute pending tasks of the job and of the nested jobs, until all
+    // tasks of the job are finished. Tasks of the job can't be left in the queues,
+    // because they refer to the job.
+    while (job.pendingTasks.load(std::memory_order_acquire) > 0)
+    {
+        const quint64 pushGeneration = m_pushGeneration.load(std::memory_order_acquire);
+        if (Job* task = takeTask(&job))
+        {
+            runTask(task);
+        }
+        else
+        {
+            waitForJob(&job, pushGeneration);
+        }
+    }
+
+    if (job.exception)
+    {
+        std::rethrow_exception(job.exception);
+    }
+}
+
+void PDFWorkStealingScheduler::stop()
+{
+    std::vector<QThread*> workers;
+
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stopping = true;
+        m_waitCondition.wakeAll();
+        m_jobWaitCondition.wakeAll();
+        workers = qMove(m_workers);
+    }
+
+    for (QThread* worker : workers)
+    {
+        worker->wait();
+        delete worker;
+    }
+}
+
+void PDFWorkStealingScheduler::ensureStarted()
+{
+    if (m_started.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    QMutexLocker lock(&m_mutex);
+    if (m_started.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    // Worker queues are created only once and never changed,
+    // so other threads can access them without locking.
+    const int workerCount = qMax(QThread::idealThreadCount(), qMax(getMaxThreadCount(PrimarySlot), getMaxThreadCount(AuxiliarySlot)));
+    m_workerQueues.reserve(workerCount);
+    for (int i = 0; i < workerCount; ++i)
+    {
+        m_workerQueues.emplace_back(std::make_unique<TaskQueue>());
+    }
+
+    if (!m_stopping)
+    {
+        m_workers.reserve(workerCount);
+        for (int i = 0; i < workerCount; ++i)
+        {
+            QThread* worker = QThread::create(&PDFWorkStealingScheduler::runWorker, this, size_t(i));
+            worker->start();
+            m_workers.push_back(worker);
+        }
+    }
+
+    m_started.store(true, std::memory_order_release);
+}
+
+void PDFWorkStealingScheduler::runWorker(size_t workerIndex)
+{
+    s_workerIndex = int(workerIndex);
+
+    while (true)
+    {
+        if (Job* task = takeTask())
+        {
+            runTask(task);
+            continue;
+        }
+
+        QMutexLocker lock(&m_mutex);
+        if (m_stopping)
+        {
+            break;
+        }
+
+        if (m_queuedTasks.load(std::memory_order_acquire) == 0)
+        {
+            m_waitCondition.wait(&m_mutex);
+        }
+    }
+}
+
+void PDFWorkStealingScheduler::pushTasks(Job* job, int count)
+{
+    TaskQueue* queue = (s_workerIndex != -1) ? m_workerQueues[s_workerIndex].get() : &m_globalQueue;
+
+    {
+        QMutexLocker lock(&queue->mutex);
+        queue->tasks.insert(queue->tasks.end(), count, job);
+    }
+
+    m_queuedTasks.fetch_add(count, std::memory_order_release);
+
+    // Lock the mutex, so waiting threads can't miss the notification. Threads waiting
+    // for the jobs are always woken up, because they take only tasks of their jobs.
+    QMutexLocker lock(&m_mutex);
+    m_pushGeneration.fetch_add(1, std::memory_order_release);
+    m_jobWaitCondition.wakeAll();
+
+    if (count == 1)
+    {
+        m_waitCondition.wakeOne();
+    }
+    else
+    {
+        m_waitCondition.wakeAll();
+    }
+}
+
+PDFWorkStealingScheduler::Job* PDFWorkStealingScheduler::takeTask(const Job* owner)
+{
+    if (m_queuedTasks.load(std::memory_order_acquire) == 0)
+    {
+        return nullptr;
+    }
+
+    auto takeFromQueue = [this, owner](TaskQueue* queue, bool back) -> Job*
+    {
+        QMutexLocker lock(&queue->mutex);
+        if (queue->tasks.empty())
+        {
+            return nullptr;
+        }
+
+        Job* job = nullptr;
+        if (!owner)
+        {
+            if (back)
+            {
+                job = queue->tasks.back();
+                queue->tasks.pop_back();
+            }
+            else
+            {
+                job = queue->tasks.front();
+                queue->tasks.pop_front();
+            }
+        }
+        else
+        {
+            // Queued jobs are alive (they wait for their tasks), and so are their
+            // parents, so the chain of the parent jobs can be safely traversed.
+            auto isOwnedTask = [owner](const Job* task) { return isNestedJob(task, owner); };
+            if (back)
+            {
+                auto it = std::find_if(queue->tasks.rbegin(), queue->tasks.rend(), isOwnedTask);
+                if (it == queue->tasks.rend())
+                {
+                    return nullptr;
+                }
+
+                job = *it;
+                queue->tasks.erase(std::next(it).base());
+            }
+            else
+            {
+                auto it = std::find_if(queue->tasks.begin(), queue->tasks.end(), isOwnedTask);
+                if (it == queue->tasks.end())
+                {
+                    return nullptr;
+                }
+
+                job = *it;
+                queue->tasks.erase(it);
+            }
+        }
+
+        m_queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+        return job;
+    };
+
+    const int workerIndex = s_workerIndex;
+    const int workerCount = int(m_workerQueues.size());
+
+    // First, try to take most recent task from our own queue
+    if (workerIndex != -1)
+    {
+        if (Job* job = takeFromQueue(m_workerQueues[workerIndex].get(), true))
+        {
+            return job;
+        }
+    }
+
+    if (Job* job = takeFromQueue(&m_globalQueue, false))
+    {
+        return job;
+    }
+
+    // Steal oldest task from other workers, start with the next worker,
+    // so not all threads are stealing from the same queue.
+    for (int i = 1; i <= workerCount; ++i)
+    {
+        const int victimIndex = (qMax(workerIndex, 0) + i) % workerCount;
+        if (victimIndex != workerIndex)
+        {
+            if (Job* job = takeFromQueue(m_workerQueues[victimIndex].get(), false))
+            {
+                return job;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+bool PDFWorkStealingScheduler::isNestedJob(const Job* job, const Job* owner)
+{
+    for (; job; job = job->parent)
+    {
+        if (job == owner)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void PDFWorkStealingScheduler::runTask(Job* job)
+{
+    participate(job);
+
+    // Job can be destroyed immediately after the last task is finished,
+    // so we must not access it after the decrement.
+    if (job->pendingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        QMutexLocker lock(&m_mutex);
+        m_jobWaitCondition.wakeAll();
+    }
+}
+
+void PDFWorkStealingScheduler::participate(Job* job)
+{
+    std::atomic<int>& activeThreadCount = m_activeThreadCount[job->slot];
+    activeThreadCount.fetch_add(1, std::memory_order_relaxed);
+
+    const Job* previousJob = s_currentJob;
+    s_currentJob = job;
+
+    for (size_t chunk = job->nextChunk.fetch_add(1, std::memory_order_relaxed); chunk < job->chunkCount; chunk = job->nextChunk.fetch_add(1, std::memory_order_relaxed))
+    {
+        try
+        {
+            (*job->function)(chunk);
+        }
+        catch (...)
+        {
+            QMutexLocker lock(&job->exceptionMutex);
+            if (!job->exception)
+            {
+                job->exception = std::current_exception();
+            }
+        }
+    }
+
+    s_currentJob = previousJob;
+    activeThreadCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void PDFWorkStealingScheduler::waitForJob(const Job* job, quint64 pushGeneration)
+{
+    // Push generation is incremented and finished job is signalled under the mutex,
+    // so checking both conditions under the mutex can't miss the notification.
+    QMutexLocker lock(&m_mutex);
+    if (job->pendingTasks.load(std::memory_order_acquire) > 0 &&
+        m_pushGeneration.load(std::memory_order_acquire) == pushGeneration)
+    {
+        m_jobWaitCondition.wait(&m_mutex);
+    }
+}
+
 struct PDFExecutionPolicyHolder
 {
     PDFExecutionPolicyHolder()
@@ -33,15 +476,32 @@ struct PDFExecutionPolicyHolder
     }
     ~PDFExecutionPolicyHolder()
     {
-        auxiliary.waitForDone();
-        primary.waitForDone();
+        scheduler.stop();
     }
 
     PDFExecutionPolicy policy;
-    QThreadPool primary;
-    QThreadPool auxiliary;
+    PDFWorkStealingScheduler scheduler;
 } s_execution_policy;
 
+static PDFWorkStealingScheduler::ThreadCountSlot getThreadCountSlot(PDFExecutionPolicy::Scope scope)
+{
+    switch (scope)
+    {
+        case PDFExecutionPolicy::Scope::Page:
+        case PDFExecutionPolicy::Scope::Unknown:
+            return PDFWorkStealingScheduler::PrimarySlot;
+
+        case PDFExecutionPolicy::Scope::Content:
+            return PDFWorkStealingScheduler::AuxiliarySlot;
+
+        default:
+            Q_ASSERT(false);
+            break;
+    }
+
+    return PDFWorkStealingScheduler::PrimarySlot;
+}
+
 void PDFExecutionPolicy::setStrategy(Strategy strategy)
 {
     s_execution_policy.policy.m_strategy.store(strategy, std::memory_order_relaxed);
@@ -81,19 +541,19 @@ bool PDFExecutionPolicy::isParallelizing(Scope scope)
 
 int PDFExecutionPolicy::getActiveThreadCount(Scope scope)
 {
-    return getThreadPool(scope)->activeThreadCount();
+    return s_execution_policy.scheduler.getActiveThreadCount(getThreadCountSlot(scope));
 }
 
 int PDFExecutionPolicy::getMaxThreadCount(Scope scope)
 {
-    return getThreadPool(scope)->maxThreadCount();
+    return s_execution_policy.scheduler.getMaxThreadCount(getThreadCountSlot(scope));
 }
 
 void PDFExecutionPolicy::setMaxThreadCount(Scope scope, int count)
 {
     // Sanitize value!
     count = qMax(count, 1);
-    getThreadPool(scope)->setMaxThreadCount(count);
+    s_execution_policy.scheduler.setMaxThreadCount(getThreadCountSlot(scope), count);
 }
 
 int PDFExecutionPolicy::getIdealThreadCount(Scope scope)
@@ -119,27 +579,12 @@ void PDFExecutionPolicy::endProcessingContentStream()
 
 void PDFExecutionPolicy::finalize()
 {
-    s_execution_policy.auxiliary.waitForDone();
-    s_execution_policy.primary.waitForDone();
+    s_execution_policy.scheduler.stop();
 }
 
-QThreadPool* PDFExecutionPolicy::getThreadPool(PDFExecutionPolicy::Scope scope)
+void PDFExecutionPolicy::executeChunks(Scope scope, size_t chunkCount, const ChunkFunction& function)
 {
-    switch (scope)
-    {
-        case Scope::Page:
-        case Scope::Unknown:
-            return &s_execution_policy.primary;
-
-        case Scope::Content:
-            return &s_execution_policy.auxiliary;
-
-        default:
-            Q_ASSERT(false);
-            break;
-    }
-
-    return nullptr;
+    s_execution_policy.scheduler.execute(getThreadCountSlot(scope), chunkCount, function);
 }
 
 PDFExecutionPolicy::PDFExecutionPolicy() :
@@ -20,15 +20,18 @@
 
 #include "pdfglobal.h"
 
-#include <QSemaphore>
-#include <QThreadPool>
-
 #include <atomic>
+#include <vector>
+#include <numeric>
+#include <optional>
 #include <execution>
+#include <algorithm>
+#include <functional>
 
 namespace pdf
 {
 struct PDFExecutionPolicyHolder;
+class PDFWorkStealingScheduler;
 
 /// Defines thread execution policy based on settings and actual number of page content
 /// streams being processed. It can regulate number of threads executed at each
@@ -59,91 +62,134 @@ public:
     /// \param scope Scope for which we want to determine execution policy
     static bool isParallelizing(Scope scope);
 
+    /// Executes function for each item in the range. If we are parallelizing for
+    /// given scope, then items are divided into chunks, which are processed by the
+    /// work-stealing scheduler. Calling thread also processes the chunks, and
+    /// when it waits for other threads, it helps to execute other pending tasks,
+    /// so nested calls of this function do not block the threads of the scheduler.
+    /// If function throws an exception, then first exception is rethrown
+    /// in the calling thread, after all chunks have been processed.
+    /// \param scope Scope
+    /// \param first Start of the range
+    /// \param last End of the range
+    /// \param f Function executed for each item of the range
     template<typename ForwardIt, typename UnaryFunction>
-    class Runnable : public QRunnable
+    static void execute(Scope scope, ForwardIt first, ForwardIt last, UnaryFunction f)
     {
-    public:
-        explicit inline Runnable(ForwardIt it, ForwardIt itEnd, UnaryFunction* function, QSemaphore* semaphore) :
-            m_forwardIt(qMove(it)),
-            m_forwardItEnd(qMove(itEnd)),
-            m_function(function),
-            m_semaphore(semaphore),
-            m_packSize(static_cast<int>(std::distance(m_forwardIt, m_forwardItEnd)))
+        if (isParallelizing(scope))
         {
-            setAutoDelete(true);
+            std::vector<ForwardIt> chunks = createChunks(scope, first, last);
+            auto processChunk = [&chunks, &f](size_t chunk)
+            {
+                for (auto it = chunks[chunk]; it != chunks[chunk + 1]; ++it)
+                {
+                    f(*it);
+                }
+            };
+            executeChunks(scope, chunks.size() - 1, processChunk);
         }
-
-        virtual void run() override
+        else
         {
-            QSemaphoreReleaser semaphoreReleaser(m_semaphore, m_packSize);
-            for (auto it = m_forwardIt; it != m_forwardItEnd; ++it)
-            {
-                (*m_function)(*it);
-            }
+            std::for_each(std::execution::seq, first, last, f);
         }
+    }
 
-    private:
-        ForwardIt m_forwardIt;
-        ForwardIt m_forwardItEnd;
-        UnaryFunction* m_function;
-        QSemaphore* m_semaphore;
-        int m_packSize;
-    };
-
-    template<typename ForwardIt, typename UnaryFunction>
-    static void execute(Scope scope, ForwardIt first, ForwardIt last, UnaryFunction f)
+    /// Sorts the range. If we are parallelizing for given scope and range
+    /// is large enough, then parallel merge sort is used.
+    /// \param scope Scope
+    /// \param first Start of the range
+    /// \param last End of the range
+    /// \param f Comparator
+    template<typename RandomIt, typename Comparator>
+    static void sort(Scope scope, RandomIt first, RandomIt last, Comparator f)
     {
-        if (isParallelizing(scope))
+        const size_t count = std::distance(first, last);
+        if (!isParallelizing(scope) || count < PARALLEL_SORT_THRESHOLD)
         {
-            QSemaphore semaphore(0);
-            int count = static_cast<int>(std::distance(first, last));
-            int remainder = count;
+            std::sort(first, last, f);
+            return;
+        }
 
-            int bucketSize = 1;
+        // Divide the range into power of two chunks, so they can be merged pairwise
+        size_t chunkCount = 1;
+        const size_t maxChunkCount = qMin(size_t(getMaxThreadCount(scope)), count / (PARALLEL_SORT_THRESHOLD / 2));
+        while (chunkCount < maxChunkCount)
+        {
+            chunkCount *= 2;
+        }
 
-            // For page scope, we do not divide the tasks into buckets, i.e.
-            // each bucket will have size 1. But if we are in a content scope,
-            // then we are processing smaller task, so we divide the work
-            // into buckets of appropriate size.
-            if (scope != Scope::Page)
-            {
-                const int buckets = 8 * QThread::idealThreadCount();
-                bucketSize = qMax(1, count / buckets);
-            }
+        std::vector<RandomIt> chunks;
+        chunks.reserve(chunkCount + 1);
+        for (size_t i = 0; i <= chunkCount; ++i)
+        {
+            chunks.push_back(std::next(first, count * i / chunkCount));
+        }
 
-            QThreadPool* pool = getThreadPool(scope);
+        executeChunks(scope, chunkCount, [&chunks, &f](size_t chunk) { std::sort(chunks[chunk], chunks[chunk + 1], f); });
 
-            // Divide tasks into buckets with given bucket size
-            auto it = first;
-            while (remainder > 0)
+        for (size_t width = 1; width < chunkCount; width *= 2)
+        {
+            auto mergeChunks = [&chunks, &f, width](size_t merge)
             {
-                const int currentSize = qMin(remainder, bucketSize);
+                const size_t startChunk = 2 * merge * width;
+                std::inplace_merge(chunks[startChunk], chunks[startChunk + width], chunks[startChunk + 2 * width], f);
+            };
+            executeChunks(scope, chunkCount / (2 * width), mergeChunks);
+        }
+    }
 
-                auto itStart = it;
-                auto itEnd = std::next(it, currentSize);
-                pool->start(new Runnable(itStart, itEnd, &f, &semaphore));
+    /// Transforms each item of the range and reduces the transformed values
+    /// using the binary operation. Chunks are reduced in parallel, partial
+    /// results are then reduced in the order of the chunks, so binary
+    /// operation must be associative, but it needn't be commutative.
+    /// \param scope Scope
+    /// \param first Start of the range
+    /// \param last End of the range
+    /// \param init Initial value
+    /// \param reduce Binary reduce operation
+    /// \param transform Unary transform operation
+    template<typename ForwardIt, typename T, typename BinaryOperation, typename UnaryOperation>
+    static T transformReduce(Scope scope, ForwardIt first, ForwardIt last, T init, BinaryOperation reduce, UnaryOperation transform)
+    {
+        if (!isParallelizing(scope))
+        {
+            return std::transform_reduce(std::execution::seq, first, last, qMove(init), reduce, transform);
+        }
 
-                remainder -= currentSize;
-                std::advance(it, currentSize);
-            }
+        std::vector<ForwardIt> chunks = createChunks(scope, first, last);
+        std::vector<std::optional<T>> partialResults(chunks.size() - 1);
 
-            Q_ASSERT(it == last);
+        auto reduceChunk = [&chunks, &partialResults, &reduce, &transform](size_t chunk)
+        {
+            auto it = chunks[chunk];
+            T value = transform(*it);
+            for (++it; it != chunks[chunk + 1]; ++it)
+            {
+                value = reduce(qMove(value), transform(*it));
+            }
+            partialResults[chunk] = qMove(value);
+        };
+        executeChunks(scope, partialResults.size(), reduceChunk);
 
-            semaphore.acquire(count);
-        }
-        else
+        for (std::optional<T>& partialResult : partialResults)
         {
-            std::for_each(std::execution::seq, first, last, f);
+            init = reduce(qMove(init), qMove(*partialResult));
         }
+
+        return init;
     }
 
-    template<typename ForwardIt, typename Comparator>
-    static void sort(Scope scope, ForwardIt first, ForwardIt last, Comparator f)
+    /// Reduces items of the range using the binary operation,
+    /// see \p transformReduce for details.
+    /// \param scope Scope
+    /// \param first Start of the range
+    /// \param last End of the range
+    /// \param init Initial value
+    /// \param operation Binary reduce operation
+    template<typename ForwardIt, typename T, typename BinaryOperation>
+    static T reduce(Scope scope, ForwardIt first, ForwardIt last, T init, BinaryOperation operation)
     {
-        Q_UNUSED(scope);
-
-        // We always sort by single thread
-        std::sort(std::execution::seq, first, last, f);
+        return transformReduce(scope, first, last, qMove(init), operation, [](const auto& value) { return value; });
     }
 
     /// Returns number of active threads for given scope
@@ -172,9 +218,53 @@ public:
 
 private:
     friend struct PDFExecutionPolicyHolder;
+    friend class PDFWorkStealingScheduler;
+
+    /// Minimal number of items to be sorted in parallel
+    static constexpr size_t PARALLEL_SORT_THRESHOLD = 4096;
+
+    using ChunkFunction = std::function<void(size_t)>;
+
+    /// Executes function for each chunk index in range [0, chunkCount) using
+    /// the work-stealing scheduler and waits until all chunks are processed.
+    /// \param scope Scope (used to limit number of threads)
+    /// \param chunkCount Chunk count
+    /// \param function Function executed for each chunk
+    static void executeChunks(Scope scope, size_t chunkCount, const ChunkFunction& function);
+
+    /// Divides the range into chunks. Returns starting iterators of the chunks,
+    /// last item of the result is the end of the range. For page scope, each
+    /// chunk contains single item, otherwise we are processing smaller tasks,
+    /// so the work is divided into chunks of appropriate size.
+    template<typename ForwardIt>
+    static std::vector<ForwardIt> createChunks(Scope scope, ForwardIt first, ForwardIt last)
+    {
+        const size_t count = std::distance(first, last);
+
+        size_t chunkSize = 1;
+        if (scope != Scope::Page)
+        {
+            const size_t chunkCount = 8 * size_t(getMaxThreadCount(scope));
+            chunkSize = qMax(size_t(1), count / chunkCount);
+        }
 
-    /// Returns thread pool based on scope
-    static QThreadPool* getThreadPool(Scope scope);
+        std::vector<ForwardIt> chunks;
+        chunks.reserve(count / chunkSize + 2);
+
+        size_t remainder = count;
+        auto it = first;
+        chunks.push_back(it);
+        while (remainder > 0)
+        {
+            const size_t currentSize = qMin(remainder, chunkSize);
+            std::advance(it, currentSize);
+            chunks.push_back(it);
+            remainder -= currentSize;
+        }
+
+        Q_ASSERT(it == last);
+        return chunks;
+    }
 
     explicit PDFExecutionPolicy();
 
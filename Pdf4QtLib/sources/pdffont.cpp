@@ -21,6 +21,7 @@
 #include "pdfnametounicode.h"
 #include "pdfexception.h"
 #include "pdfutils.h"
+#include "pdfglyphatlas.h"
 #include "pdfdbgheap.h"
 
 #include <ft2build.h>
@@ -33,6 +34,7 @@
 #include <QMutex>
 #include <QReadWriteLock>
 #include <QPainterPath>
+#include <QTransform>
 #include <QDataStream>
 #include <QTreeWidgetItem>
 
@@ -462,49 +464,63 @@ private:
     PDFFontPointer m_parentFont;
 };
 
-/// Implementation of the PDFRealizedFont class using PIMPL pattern
-class PDFRealizedFontImpl : public IRealizedFontImpl
+/// Font program loaded into the FreeType. Face is shared by all realized fonts
+/// of the same font (with different pixel sizes), so font program is loaded only once.
+/// Glyph outlines are cached in em units (font size 1.0) and they are scaled
+/// by realized fonts to their pixel size. Face is thread safe, access
+/// to the FreeType face must be protected by the mutex.
+class PDFRealizedFontFace
 {
 public:
-    explicit PDFRealizedFontImpl();
-    virtual ~PDFRealizedFontImpl();
-
-    virtual void fillTextSequence(const QByteArray& byteArray, TextSequence& textSequence, PDFRenderErrorReporter* reporter) override;
-    virtual bool isHorizontalWritingSystem() const override { return !m_isVertical; }
-    virtual void dumpFontToTreeItem(QTreeWidgetItem* item) const override;
-    virtual QString getPostScriptName() const override { return m_postScriptName; }
-    virtual CharacterInfos getCharacterInfos() const override;
-
-    static constexpr const PDFReal PIXEL_SIZE_MULTIPLIER = 100.0;
-
-private:
-    friend class PDFRealizedFont;
-
-    static constexpr const PDFReal FONT_WIDTH_MULTIPLIER = 1.0 / 1000.0;
-    static constexpr const PDFReal FORMAT_26_6_MULTIPLIER = 1 / 64.0;
-    static constexpr const PDFReal FONT_MULTIPLIER = FORMAT_26_6_MULTIPLIER / PIXEL_SIZE_MULTIPLIER;
+    explicit PDFRealizedFontFace();
+    ~PDFRealizedFontFace();
 
     struct Glyph
     {
         QPainterPath glyph;
         PDFReal advance = 0.0;
+        PDFAtlasGlyphId atlasId;
     };
 
-    static int outlineMoveTo(const FT_Vector* to, void* user);
-    static int outlineLineTo(const FT_Vector* to, void* user);
-    static int outlineConicTo(const FT_Vector* control, const FT_Vector* to, void* user);
-    static int outlineCubicTo(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user);
+    /// Creates font face from the font. If font face can't be created,
+    /// then exception is thrown. For Type 3 fonts, nullptr is returned.
+    /// \param font Font
+    /// \param reporter Error reporter
+    static PDFRealizedFontFacePointer createFontFace(PDFFontPointer font, PDFRenderErrorReporter* reporter);
 
-    /// Get glyph for glyph index
-    const Glyph& getGlyph(unsigned int glyphIndex);
+    /// Returns glyph outline in em units
+    /// \param glyphIndex Glyph index
+    /// \param isVertical Use vertical advance
+    Glyph getGlyph(unsigned int glyphIndex, bool isVertical);
+
+    /// Returns glyph index for unicode character. If font
+    /// doesn't have unicode character map, zero is returned.
+    /// \param character Unicode character
+    GID getGlyphIndex(QChar character);
+
+    /// Returns postscript name of the font
+    const QString& getPostScriptName() const { return m_postScriptName; }
 
     /// Function checks, if error occured, and if yes, then exception is thrown
     static void checkFreeTypeError(FT_Error error);
 
-    /// Read/write lock for accessing the glyph data
-    QReadWriteLock m_readWriteLock;
+private:
+    friend class PDFRealizedFontImpl;
+
+    /// Glyph outlines are loaded with this size in pixels, and are scaled to em units
+    static constexpr const FT_UInt REFERENCE_PIXEL_SIZE = 1000;
+    static constexpr const PDFReal FORMAT_26_6_MULTIPLIER = 1 / 64.0;
+    static constexpr const PDFReal FONT_MULTIPLIER = FORMAT_26_6_MULTIPLIER / REFERENCE_PIXEL_SIZE;
 
-    /// Glyph cache, must be protected by the mutex above
+    static int outlineMoveTo(const FT_Vector* to, void* user);
+    static int outlineLineTo(const FT_Vector* to, void* user);
+    static int outlineConicTo(const FT_Vector* control, const FT_Vector* to, void* user);
+    static int outlineCubicTo(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user);
+
+    /// Mutex for accessing the FreeType face and glyph cache
+    QMutex m_mutex;
+
+    /// Glyph cache (glyphs are in em units), must be protected by the mutex above
     std::unordered_map<unsigned int, Glyph> m_glyphCache;
 
     /// For embedded fonts, this byte array contains embedded font data
@@ -519,34 +535,64 @@ private:
     /// Face of the font
     FT_Face m_face;
 
+    /// True, if font is embedded
+    bool m_isEmbedded;
+
+    /// Postscript name of the font
+    QString m_postScriptName;
+};
+
+/// Implementation of the PDFRealizedFont class using PIMPL pattern
+class PDFRealizedFontImpl : public IRealizedFontImpl
+{
+public:
+    explicit PDFRealizedFontImpl();
+    virtual ~PDFRealizedFontImpl();
+
+    virtual void fillTextSequence(const QByteArray& byteArray, TextSequence& textSequence, PDFRenderErrorReporter* reporter) override;
+    virtual bool isHorizontalWritingSystem() const override { return !m_isVertical; }
+    virtual void dumpFontToTreeItem(QTreeWidgetItem* item) const override;
+    virtual QString getPostScriptName() const override { return m_fontFace->getPostScriptName(); }
+    virtual CharacterInfos getCharacterInfos() const override;
+
+private:
+    friend class PDFRealizedFont;
+
+    static constexpr const PDFReal FONT_WIDTH_MULTIPLIER = 1.0 / 1000.0;
+
+    using Glyph = PDFRealizedFontFace::Glyph;
+
+    /// Get glyph for glyph index
+    const Glyph& getGlyph(unsigned int glyphIndex);
+
+    /// Read/write lock for accessing the glyph data
+    QReadWriteLock m_readWriteLock;
+
+    /// Glyph cache (glyphs are scaled to the pixel size), must be protected by the mutex above
+    std::unordered_map<unsigned int, Glyph> m_glyphCache;
+
+    /// Font face (shared by realized fonts of different sizes)
+    PDFRealizedFontFacePointer m_fontFace;
+
     /// Pixel size of the font
     PDFReal m_pixelSize;
 
     /// Parent font
     PDFFontPointer m_parentFont;
 
-    /// True, if font is embedded
-    bool m_isEmbedded;
-
     /// True, if font has vertical writing system
     bool m_isVertical;
-
-    /// Postscript name of the font
-    QString m_postScriptName;
 };
 
-PDFRealizedFontImpl::PDFRealizedFontImpl() :
+PDFRealizedFontFace::PDFRealizedFontFace() :
     m_library(nullptr),
     m_face(nullptr),
-    m_pixelSize(0.0),
-    m_parentFont(nullptr),
-    m_isEmbedded(false),
-    m_isVertical(false)
+    m_isEmbedded(false)
 {
 
 }
 
-PDFRealizedFontImpl::~PDFRealizedFontImpl()
+PDFRealizedFontFace::~PDFRealizedFontFace()
 {
     if (m_face)
     {
@@ -561,6 +607,19 @@ PDFRealizedFontImpl::~PDFRealizedFontImpl()
     }
 }
 
+PDFRealizedFontImpl::PDFRealizedFontImpl() :
+    m_pixelSize(0.0),
+    m_parentFont(nullptr),
+    m_isVertical(false)
+{
+
+}
+
+PDFRealizedFontImpl::~PDFRealizedFontImpl()
+{
+
+}
+
 void PDFRealizedFontImpl::fillTextSequence(const QByteArray& byteArray, TextSequence& textSequence, PDFRenderErrorReporter* reporter)
 {
     switch (m_parentFont->getFontType())
@@ -583,10 +642,7 @@ void PDFRealizedFontImpl::fillTextSequence(const QByteArray& byteArray, TextSequ
                 if (!glyphIndex)
                 {
                     // Try to obtain glyph index from unicode
-                    if (m_face->charmap && m_face->charmap->encoding == FT_ENCODING_UNICODE)
-                    {
-                        glyphIndex = FT_Get_Char_Index(m_face, (*encoding)[static_cast<uint8_t>(byteArray[i])].unicode());
-                    }
+                    glyphIndex = m_fontFace->getGlyphIndex((*encoding)[static_cast<uint8_t>(byteArray[i])]);
                 }
 
                 const PDFReal glyphWidth = font->getGlyphAdvance(static_cast<uint8_t>(byteArray[i]));
@@ -594,7 +650,7 @@ void PDFRealizedFontImpl::fillTextSequence(const QByteArray& byteArray, TextSequ
                 if (glyphIndex)
                 {
                     const Glyph& glyph = getGlyph(glyphIndex);
-                    textSequence.items.emplace_back(&glyph.glyph, (*encoding)[static_cast<uint8_t>(byteArray[i])], glyph.advance);
+                    textSequence.items.emplace_back(&glyph.glyph, (*encoding)[static_cast<uint8_t>(byteArray[i])], glyph.advance, glyphIndex, &glyph.atlasId);
                 }
                 else
                 {
@@ -629,7 +685,7 @@ void PDFRealizedFontImpl::fillTextSequence(const QByteArray& byteArray, TextSequ
                 {
                     QChar character = toUnicode->getToUnicode(cid);
                     const Glyph& glyph = getGlyph(glyphIndex);
-                    textSequence.items.emplace_back(&glyph.glyph, character, glyph.advance);
+                    textSequence.items.emplace_back(&glyph.glyph, character, glyph.advance, glyphIndex, &glyph.atlasId);
                 }
                 else
                 {
@@ -685,10 +741,7 @@ CharacterInfos PDFRealizedFontImpl::getCharacterInfos() const
                 if (!glyphIndex)
                 {
                     // Try to obtain glyph index from unicode
-                    if (m_face->charmap && m_face->charmap->encoding == FT_ENCODING_UNICODE)
-                    {
-                        glyphIndex = FT_Get_Char_Index(m_face, character.unicode());
-                    }
+                    glyphIndex = m_fontFace->getGlyphIndex(character);
                 }
 
                 if (glyphIndex)
@@ -711,8 +764,11 @@ CharacterInfos PDFRealizedFontImpl::getCharacterInfos() const
             const PDFFontCMap* toUnicode = font->getToUnicode();
             const PDFCIDtoGIDMapper* CIDtoGIDmapper = font->getCIDtoGIDMapper();
 
+            QMutexLocker lock(&m_fontFace->m_mutex);
+            FT_Face face = m_fontFace->m_face;
+
             FT_UInt index = 0;
-            FT_ULong character = FT_Get_First_Char(m_face, &index);
+            FT_ULong character = FT_Get_First_Char(face, &index);
             while (index != 0)
             {
                 const GID gid = index;
@@ -723,7 +779,7 @@ CharacterInfos PDFRealizedFontImpl::getCharacterInfos() const
                 info.character = toUnicode->getToUnicode(cid);
                 result.emplace_back(qMove(info));
 
-                character = FT_Get_Next_Char(m_face, character, &index);
+                character = FT_Get_Next_Char(face, character, &index);
             }
 
             if (result.empty())
@@ -738,7 +794,7 @@ CharacterInfos PDFRealizedFontImpl::getCharacterInfos() const
                         continue;
                     }
 
-                    if (!FT_Load_Glyph(m_face, gid, FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING))
+                    if (!FT_Load_Glyph(face, gid, FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING))
                     {
                         CharacterInfo info;
                         info.gid = gid;
@@ -764,34 +820,37 @@ CharacterInfos PDFRealizedFontImpl::getCharacterInfos() const
 
 void PDFRealizedFontImpl::dumpFontToTreeItem(QTreeWidgetItem* item) const
 {
+    QMutexLocker lock(&m_fontFace->m_mutex);
+    FT_Face face = m_fontFace->m_face;
+
     QTreeWidgetItem* root = new QTreeWidgetItem(item, { PDFTranslationContext::tr("Details") });
 
-    if (m_face->family_name)
+    if (face->family_name)
     {
-        new QTreeWidgetItem(root, { PDFTranslationContext::tr("Font"), QString::fromLatin1(m_face->family_name) });
+        new QTreeWidgetItem(root, { PDFTranslationContext::tr("Font"), QString::fromLatin1(face->family_name) });
     }
-    if (m_face->style_name)
+    if (face->style_name)
     {
-        new QTreeWidgetItem(root, { PDFTranslationContext::tr("Style"), QString::fromLatin1(m_face->style_name) });
+        new QTreeWidgetItem(root, { PDFTranslationContext::tr("Style"), QString::fromLatin1(face->style_name) });
     }
 
     QString yesString = PDFTranslationContext::tr("Yes");
     QString noString = PDFTranslationContext::tr("No");
 
-    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Glyph count"), QString::number(m_face->num_glyphs) });
-    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Is CID keyed"), (m_face->face_flags & FT_FACE_FLAG_CID_KEYED) ? yesString : noString });
-    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Is bold"), (m_face->style_flags & FT_STYLE_FLAG_BOLD) ? yesString : noString });
-    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Is italics"), (m_face->style_flags & FT_STYLE_FLAG_ITALIC) ? yesString : noString });
-    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Has vertical writing system"), (m_face->face_flags & FT_FACE_FLAG_VERTICAL) ? yesString : noString });
-    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Has SFNT storage scheme"), (m_face->face_flags & FT_FACE_FLAG_SFNT) ? yesString : noString });
-    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Has glyph names"), (m_face->face_flags & FT_FACE_FLAG_GLYPH_NAMES) ? yesString : noString });
+    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Glyph count"), QString::number(face->num_glyphs) });
+    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Is CID keyed"), (face->face_flags & FT_FACE_FLAG_CID_KEYED) ? yesString : noString });
+    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Is bold"), (face->style_flags & FT_STYLE_FLAG_BOLD) ? yesString : noString });
+    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Is italics"), (face->style_flags & FT_STYLE_FLAG_ITALIC) ? yesString : noString });
+    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Has vertical writing system"), (face->face_flags & FT_FACE_FLAG_VERTICAL) ? yesString : noString });
+    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Has SFNT storage scheme"), (face->face_flags & FT_FACE_FLAG_SFNT) ? yesString : noString });
+    new QTreeWidgetItem(root, { PDFTranslationContext::tr("Has glyph names"), (face->face_flags & FT_FACE_FLAG_GLYPH_NAMES) ? yesString : noString });
 
-    if (m_face->num_charmaps > 0)
+    if (face->num_charmaps > 0)
     {
         QTreeWidgetItem* encodingRoot = new QTreeWidgetItem(item, { PDFTranslationContext::tr("Encoding") });
-        for (FT_Int i = 0; i < m_face->num_charmaps; ++i)
+        for (FT_Int i = 0; i < face->num_charmaps; ++i)
         {
-            FT_CharMap charMap = m_face->charmaps[i];
+            FT_CharMap charMap = face->charmaps[i];
 
             const FT_Encoding encoding = charMap->encoding;
             QString encodingName;
@@ -863,34 +922,77 @@ void PDFRealizedFontImpl::dumpFontToTreeItem(QTreeWidgetItem* item) const
     }
 }
 
-int PDFRealizedFontImpl::outlineMoveTo(const FT_Vector* to, void* user)
+int PDFRealizedFontFace::outlineMoveTo(const FT_Vector* to, void* user)
 {
     Glyph* glyph = reinterpret_cast<Glyph*>(user);
     glyph->glyph.moveTo(to->x * FONT_MULTIPLIER, to->y * FONT_MULTIPLIER);
     return 0;
 }
 
-int PDFRealizedFontImpl::outlineLineTo(const FT_Vector* to, void* user)
+int PDFRealizedFontFace::outlineLineTo(const FT_Vector* to, void* user)
 {
     Glyph* glyph = reinterpret_cast<Glyph*>(user);
     glyph->glyph.lineTo(to->x * FONT_MULTIPLIER, to->y * FONT_MULTIPLIER);
     return 0;
 }
 
-int PDFRealizedFontImpl::outlineConicTo(const FT_Vector* control, const FT_Vector* to, void* user)
+int PDFRealizedFontFace::outlineConicTo(const FT_Vector* control, const FT_Vector* to, void* user)
 {
     Glyph* glyph = reinterpret_cast<Glyph*>(user);
     glyph->glyph.quadTo(control->x * FONT_MULTIPLIER, control->y * FONT_MULTIPLIER, to->x * FONT_MULTIPLIER, to->y * FONT_MULTIPLIER);
     return 0;
 }
 
-int PDFRealizedFontImpl::outlineCubicTo(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user)
+int PDFRealizedFontFace::outlineCubicTo(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user)
 {
     Glyph* glyph = reinterpret_cast<Glyph*>(user);
     glyph->glyph.cubicTo(control1->x * FONT_MULTIPLIER, control1->y * FONT_MULTIPLIER, control2->x * FONT_MULTIPLIER, control2->y * FONT_MULTIPLIER, to->x * FONT_MULTIPLIER, to->y * FONT_MULTIPLIER);
     return 0;
 }
 
+PDFRealizedFontFace::Glyph PDFRealizedFontFace::getGlyph(unsigned int glyphIndex, bool isVertical)
+{
+    QMutexLocker lock(&m_mutex);
+
+    // First look into cache
+    auto it = m_glyphCache.find(glyphIndex);
+    if (it != m_glyphCache.cend())
+    {
+        return it->second;
+    }
+
+    Glyph glyph;
+
+    FT_Outline_Funcs glyphOutlineInterface;
+    glyphOutlineInterface.delta = 0;
+    glyphOutlineInterface.shift = 0;
+    glyphOutlineInterface.move_to = PDFRealizedFontFace::outlineMoveTo;
+    glyphOutlineInterface.line_to = PDFRealizedFontFace::outlineLineTo;
+    glyphOutlineInterface.conic_to = PDFRealizedFontFace::outlineConicTo;
+    glyphOutlineInterface.cubic_to = PDFRealizedFontFace::outlineCubicTo;
+
+    checkFreeTypeError(FT_Load_Glyph(m_face, glyphIndex, FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING));
+    checkFreeTypeError(FT_Outline_Decompose(&m_face->glyph->outline, &glyphOutlineInterface, &glyph));
+    glyph.glyph.closeSubpath();
+    glyph.advance = !isVertical ? m_face->glyph->advance.x : m_face->glyph->advance.y;
+    glyph.advance *= FONT_MULTIPLIER;
+
+    m_glyphCache[glyphIndex] = glyph;
+    return glyph;
+}
+
+GID PDFRealizedFontFace::getGlyphIndex(QChar character)
+{
+    QMutexLocker lock(&m_mutex);
+
+    if (m_face->charmap && m_face->charmap->encoding == FT_ENCODING_UNICODE)
+    {
+        return FT_Get_Char_Index(m_face, character.unicode());
+    }
+
+    return 0;
+}
+
 const PDFRealizedFontImpl::Glyph& PDFRealizedFontImpl::getGlyph(unsigned int glyphIndex)
 {
     if (glyphIndex)
@@ -906,23 +1008,13 @@ const PDFRealizedFontImpl::Glyph& PDFRealizedFontImpl::getGlyph(unsigned int gly
             }
         }
 
-        QWriteLocker writeLock(&m_readWriteLock);
-        Glyph glyph;
-
-        FT_Outline_Funcs glyphOutlineInterface;
-        glyphOutlineInterface.delta = 0;
-        glyphOutlineInterface.shift = 0;
-        glyphOutlineInterface.move_to = PDFRealizedFontImpl::outlineMoveTo;
-        glyphOutlineInterface.line_to = PDFRealizedFontImpl::outlineLineTo;
-        glyphOutlineInterface.conic_to = PDFRealizedFontImpl::outlineConicTo;
-        glyphOutlineInterface.cubic_to = PDFRealizedFontImpl::outlineCubicTo;
-
-        checkFreeTypeError(FT_Load_Glyph(m_face, glyphIndex, FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING));
-        checkFreeTypeError(FT_Outline_Decompose(&m_face->glyph->outline, &glyphOutlineInterface, &glyph));
-        glyph.glyph.closeSubpath();
-        glyph.advance = !m_isVertical ? m_face->glyph->advance.x : m_face->glyph->advance.y;
-        glyph.advance *= FONT_MULTIPLIER;
+        // Glyph outline is shared by all sizes of the font, we just scale it
+        Glyph glyph = m_fontFace->getGlyph(glyphIndex, m_isVertical);
+        glyph.glyph = QTransform::fromScale(m_pixelSize, m_pixelSize).map(glyph.glyph);
+        glyph.advance *= m_pixelSize;
+        glyph.atlasId = PDFAtlasGlyphId::create(glyph.glyph);
 
+        QWriteLocker writeLock(&m_readWriteLock);
         auto it = m_glyphCache.find(glyphIndex);
         if (it == m_glyphCache.cend())
         {
@@ -935,7 +1027,7 @@ const PDFRealizedFontImpl::Glyph& PDFRealizedFontImpl::getGlyph(unsigned int gly
     return dummy;
 }
 
-void PDFRealizedFontImpl::checkFreeTypeError(FT_Error error)
+void PDFRealizedFontFace::checkFreeTypeError(FT_Error error)
 {
     if (error)
     {
@@ -979,7 +1071,7 @@ CharacterInfos PDFRealizedFont::getCharacterInfos() const
     return m_impl->getCharacterInfos();
 }
 
-PDFRealizedFontPointer PDFRealizedFont::createRealizedFont(PDFFontPointer font, PDFReal pixelSize, PDFRenderErrorReporter* reporter)
+PDFRealizedFontPointer PDFRealizedFont::createRealizedFont(PDFFontPointer font, PDFReal pixelSize, PDFRenderErrorReporter* reporter, PDFRealizedFontFacePointer fontFace)
 {
     PDFRealizedFontPointer result;
 
@@ -989,64 +1081,84 @@ PDFRealizedFontPointer PDFRealizedFont::createRealizedFont(PDFFontPointer font,
     }
     else
     {
-        std::unique_ptr<PDFRealizedFontImpl> implPtr(new PDFRealizedFontImpl());
+        if (!fontFace)
+        {
+            fontFace = createFontFace(font, reporter);
+        }
 
-        PDFRealizedFontImpl* impl = implPtr.get();
+        PDFRealizedFontImpl* impl = new PDFRealizedFontImpl();
         impl->m_parentFont = font;
         impl->m_pixelSize = pixelSize;
+        impl->m_fontFace = qMove(fontFace);
 
         const PDFFontCMap* cmap = font->getCMap();
-        const FontDescriptor* descriptor = font->getFontDescriptor();
-        if (descriptor->isEmbedded())
+        impl->m_isVertical = cmap ? cmap->isVertical() : false;
+        result.reset(new PDFRealizedFont(impl));
+    }
+
+    return result;
+}
+
+PDFRealizedFontFacePointer PDFRealizedFont::createFontFace(PDFFontPointer font, PDFRenderErrorReporter* reporter)
+{
+    return PDFRealizedFontFace::createFontFace(qMove(font), reporter);
+}
+
+PDFRealizedFontFacePointer PDFRealizedFontFace::createFontFace(PDFFontPointer font, PDFRenderErrorReporter* reporter)
+{
+    if (font->getFontType() == FontType::Type3)
+    {
+        return PDFRealizedFontFacePointer();
+    }
+
+    PDFRealizedFontFacePointer fontFace(new PDFRealizedFontFace());
+
+    const FontDescriptor* descriptor = font->getFontDescriptor();
+    if (descriptor->isEmbedded())
+    {
+        checkFreeTypeError(FT_Init_FreeType(&fontFace->m_library));
+        const QByteArray* embeddedFontData = descriptor->getEmbeddedFontData();
+        Q_ASSERT(embeddedFontData);
+        fontFace->m_embeddedFontData = *embeddedFontData;
+
+        // At this time, embedded font data should not be empty!
+        Q_ASSERT(!fontFace->m_embeddedFontData.isEmpty());
+
+        checkFreeTypeError(FT_New_Memory_Face(fontFace->m_library, reinterpret_cast<const FT_Byte*>(fontFace->m_embeddedFontData.constData()), fontFace->m_embeddedFontData.size(), 0, &fontFace->m_face));
+        FT_Select_Charmap(fontFace->m_face, FT_ENCODING_UNICODE); // We try to select unicode encoding, but if it fails, we don't do anything (use glyph indices instead)
+        checkFreeTypeError(FT_Set_Pixel_Sizes(fontFace->m_face, 0, REFERENCE_PIXEL_SIZE));
+        fontFace->m_isEmbedded = true;
+    }
+    else
+    {
+        StandardFontType standardFontType = StandardFontType::Invalid;
+        if (font->getFontType() == FontType::Type1 || font->getFontType() == FontType::MMType1)
         {
-            PDFRealizedFontImpl::checkFreeTypeError(FT_Init_FreeType(&impl->m_library));
-            const QByteArray* embeddedFontData = descriptor->getEmbeddedFontData();
-            Q_ASSERT(embeddedFontData);
-            impl->m_embeddedFontData = *embeddedFontData;
-
-            // At this time, embedded font data should not be empty!
-            Q_ASSERT(!impl->m_embeddedFontData.isEmpty());
-
-            PDFRealizedFontImpl::checkFreeTypeError(FT_New_Memory_Face(impl->m_library, reinterpret_cast<const FT_Byte*>(impl->m_embeddedFontData.constData()), impl->m_embeddedFontData.size(), 0, &impl->m_face));
-            FT_Select_Charmap(impl->m_face, FT_ENCODING_UNICODE); // We try to select unicode encoding, but if it fails, we don't do anything (use glyph indices instead)
-            PDFRealizedFontImpl::checkFreeTypeError(FT_Set_Pixel_Sizes(impl->m_face, 0, qRound(pixelSize * PDFRealizedFontImpl::PIXEL_SIZE_MULTIPLIER)));
-            impl->m_isVertical = cmap ? cmap->isVertical() : false;
-            impl->m_isEmbedded = true;
-            result.reset(new PDFRealizedFont(implPtr.release()));
+            Q_ASSERT(dynamic_cast<const PDFType1Font*>(font.get()));
+            const PDFType1Font* type1Font = static_cast<const PDFType1Font*>(font.get());
+            standardFontType = type1Font->getStandardFontType();
         }
-        else
-        {
-            StandardFontType standardFontType = StandardFontType::Invalid;
-            if (font->getFontType() == FontType::Type1 || font->getFontType() == FontType::MMType1)
-            {
-                Q_ASSERT(dynamic_cast<const PDFType1Font*>(font.get()));
-                const PDFType1Font* type1Font = static_cast<const PDFType1Font*>(font.get());
-                standardFontType = type1Font->getStandardFontType();
-            }
 
-            const PDFSystemFontInfoStorage* fontStorage = PDFSystemFontInfoStorage::getInstance();
-            impl->m_systemFontData = fontStorage->loadFont(descriptor, standardFontType, reporter);
+        const PDFSystemFontInfoStorage* fontStorage = PDFSystemFontInfoStorage::getInstance();
+        fontFace->m_systemFontData = fontStorage->loadFont(descriptor, standardFontType, reporter);
 
-            if (impl->m_systemFontData.isEmpty())
-            {
-                throw PDFException(PDFTranslationContext::tr("Can't load system font '%1'.").arg(QString::fromLatin1(descriptor->fontName)));
-            }
+        if (fontFace->m_systemFontData.isEmpty())
+        {
+            throw PDFException(PDFTranslationContext::tr("Can't load system font '%1'.").arg(QString::fromLatin1(descriptor->fontName)));
+        }
 
-            PDFRealizedFontImpl::checkFreeTypeError(FT_Init_FreeType(&impl->m_library));
-            PDFRealizedFontImpl::checkFreeTypeError(FT_New_Memory_Face(impl->m_library, reinterpret_cast<const FT_Byte*>(impl->m_systemFontData.constData()), impl->m_systemFontData.size(), 0, &impl->m_face));
-            FT_Select_Charmap(impl->m_face, FT_ENCODING_UNICODE); // We try to select unicode encoding, but if it fails, we don't do anything (use glyph indices instead)
-            PDFRealizedFontImpl::checkFreeTypeError(FT_Set_Pixel_Sizes(impl->m_face, 0, qRound(pixelSize * PDFRealizedFontImpl::PIXEL_SIZE_MULTIPLIER)));
-            impl->m_isVertical = cmap ? cmap->isVertical() : false;
-            impl->m_isEmbedded = false;
-            if (const char* postScriptName = FT_Get_Postscript_Name(impl->m_face))
-            {
-                impl->m_postScriptName = QString::fromLatin1(postScriptName);
-            }
-            result.reset(new PDFRealizedFont(implPtr.release()));
+        checkFreeTypeError(FT_Init_FreeType(&fontFace->m_library));
+        checkFreeTypeError(FT_New_Memory_Face(fontFace->m_library, reinterpret_cast<const FT_Byte*>(fontFace->m_systemFontData.constData()), fontFace->m_systemFontData.size(), 0, &fontFace->m_face));
+        FT_Select_Charmap(fontFace->m_face, FT_ENCODING_UNICODE); // We try to select unicode encoding, but if it fails, we don't do anything (use glyph indices instead)
+        checkFreeTypeError(FT_Set_Pixel_Sizes(fontFace->m_face, 0, REFERENCE_PIXEL_SIZE));
+        fontFace->m_isEmbedded = false;
+        if (const char* postScriptName = FT_Get_Postscript_Name(fontFace->m_face))
+        {
+            fontFace->m_postScriptName = QString::fromLatin1(postScriptName);
         }
     }
 
-    return result;
+    return fontFace;
 }
 
 FontDescriptor PDFFont::readFontDescriptor(const PDFObject& fontDescriptorObject, const PDFDocument* document)
@@ -1087,20 +1199,26 @@ FontDescriptor PDFFont::readFontDescriptor(const PDFObject& fontDescriptorObject
         fontDescriptor.boundingBox = fontLoader.readRectangle(fontDescriptorDictionary->get("FontBBox"), QRectF());
         fontDescriptor.charset = fontLoader.readStringFromDictionary(fontDescriptorDictionary, "Charset");
 
-        auto loadStream = [fontDescriptorDictionary, document](QByteArray& byteArray, const char* name)
+        auto loadStream = [fontDescriptorDictionary, document](QByteArray& byteArray, PDFObjectReference& reference, const char* name)
         {
             if (fontDescriptorDictionary->hasKey(name))
             {
-                const PDFObject& streamObject = document->getObject(fontDescriptorDictionary->get(name));
+                const PDFObject& streamReferenceObject = fontDescriptorDictionary->get(name);
+                const PDFObject& streamObject = document->getObject(streamReferenceObject);
                 if (streamObject.isStream())
                 {
                     byteArray = document->getDecodedStream(streamObject.getStream());
+
+                    if (streamReferenceObject.isReference())
+                    {
+                        reference = streamReferenceObject.getReference();
+                    }
                 }
             }
         };
-        loadStream(fontDescriptor.fontFile, "FontFile");
-        loadStream(fontDescriptor.fontFile2, "FontFile2");
-        loadStream(fontDescriptor.fontFile3, "FontFile3");
+        loadStream(fontDescriptor.fontFile, fontDescriptor.fontFileReference, "FontFile");
+        loadStream(fontDescriptor.fontFile2, fontDescriptor.fontFile2Reference, "FontFile2");
+        loadStream(fontDescriptor.fontFile3, fontDescriptor.fontFile3Reference, "FontFile3");
     }
 
     return fontDescriptor;
@@ -1870,6 +1988,7 @@ void PDFFontCache::setDocument(const PDFModifiedDocument& document)
         if (document.hasReset() || document.hasPageContentsChanged())
         {
             m_fontCache.clear();
+            m_fontFaceCache.clear();
             m_realizedFontCache.clear();
         }
     }
@@ -1894,6 +2013,7 @@ PDFFontPointer PDFFontCache::getFont(const PDFObject& fontObject) const
             {
                 // We have exceeded the cache limit. Clear the cache.
                 m_fontCache.clear();
+                m_fontFaceCache.clear();
             }
 
             it = m_fontCache.insert(std::make_pair(reference, qMove(font))).first;
@@ -1915,8 +2035,26 @@ PDFRealizedFontPointer PDFFontCache::getRealizedFont(const PDFFontPointer& font,
     auto it = m_realizedFontCache.find(std::make_pair(font, size));
     if (it == m_realizedFontCache.cend())
     {
-        // We must create the realized font
-        PDFRealizedFontPointer realizedFont = PDFRealizedFont::createRealizedFont(font, size, reporter);
+        // We must create the realized font. Font face is shared by all sizes
+        // of the font, so font program is loaded only once.
+        PDFRealizedFontFacePointer fontFace;
+        if (font->getFontType() != FontType::Type3)
+        {
+            auto faceIt = m_fontFaceCache.find(font);
+            if (faceIt == m_fontFaceCache.cend())
+            {
+                if (m_fontFaceCache.size() >= m_fontCacheLimit)
+                {
+                    // Font faces are held also by realized fonts, so they can be removed from the cache
+                    m_fontFaceCache.clear();
+                }
+
+                faceIt = m_fontFaceCache.insert(std::make_pair(font, PDFRealizedFont::createFontFace(font, reporter))).first;
+            }
+            fontFace = faceIt->second;
+        }
+
+        PDFRealizedFontPointer realizedFont = PDFRealizedFont::createRealizedFont(font, size, reporter, qMove(fontFace));
 
         if (m_fontCacheShrinkDisabledObjects.empty() && m_realizedFontCache.size() >= m_realizedFontCacheLimit)
         {
@@ -1962,6 +2100,7 @@ void PDFFontCache::shrink()
         if (m_fontCache.size() >= m_fontCacheLimit)
         {
             m_fontCache.clear();
+            m_fontFaceCache.clear();
         }
         if (m_realizedFontCache.size() >= m_realizedFontCacheLimit)
         {
@@ -2020,10 +2159,10 @@ PDFFontCMap PDFFontCMap::createFromData(const QByteArray& data)
     {
         PDFLexicalAnalyzer::Token token = parser.fetch();
 
-        if (token.type == PDFLexicalAnalyzer::TokenType::Name && token.data.toByteArray() == "WMode")
+        if (token.type == PDFLexicalAnalyzer::TokenType::Name && token.getStringView() == "WMode")
         {
             PDFLexicalAnalyzer::Token valueToken = parser.fetch();
-            vertical = valueToken.type == PDFLexicalAnalyzer::TokenType::Integer && valueToken.data.value<PDFInteger>() == 1;
+            vertical = valueToken.type == PDFLexicalAnalyzer::TokenType::Integer && valueToken.getInteger() == 1;
             continue;
         }
 
@@ -2031,7 +2170,7 @@ PDFFontCMap PDFFontCMap::createFromData(const QByteArray& data)
         {
             if (currentToken.type == PDFLexicalAnalyzer::TokenType::String)
             {
-                QByteArray byteArray = currentToken.data.toByteArray();
+                QByteArray byteArray = currentToken.getString();
 
                 unsigned int codeValue = 0;
                 for (int i = 0; i < byteArray.size(); ++i)
@@ -2049,7 +2188,7 @@ PDFFontCMap PDFFontCMap::createFromData(const QByteArray& data)
         {
             if (currentToken.type == PDFLexicalAnalyzer::TokenType::Integer)
             {
-                return currentToken.data.value<PDFInteger>();
+                return currentToken.getInteger();
             }
 
             throw PDFException(PDFTranslationContext::tr("Can't fetch CID from CMap definition."));
@@ -2059,7 +2198,7 @@ PDFFontCMap PDFFontCMap::createFromData(const QByteArray& data)
         {
             if (currentToken.type == PDFLexicalAnalyzer::TokenType::String)
             {
-                QByteArray byteArray = currentToken.data.toByteArray();
+                QByteArray byteArray = currentToken.getString();
 
                 if (byteArray.size() == 2)
                 {
@@ -2077,12 +2216,12 @@ PDFFontCMap PDFFontCMap::createFromData(const QByteArray& data)
 
         if (token.type == PDFLexicalAnalyzer::TokenType::Command)
         {
-            QByteArray command = token.data.toByteArray();
+            QByteArrayView command = token.getStringView();
             if (command == "usecmap")
             {
                 if (previousToken.type == PDFLexicalAnalyzer::TokenType::Name)
                 {
-                    additionalMappings.emplace_back(createFromName(previousToken.data.toByteArray()));
+                    additionalMappings.emplace_back(createFromName(previousToken.getString()));
                 }
                 else
                 {
@@ -2094,7 +2233,7 @@ PDFFontCMap PDFFontCMap::createFromData(const QByteArray& data)
                 PDFLexicalAnalyzer::Token token1 = parser.fetch();
 
                 if (token1.type == PDFLexicalAnalyzer::TokenType::Command &&
-                    token1.data.toByteArray() == "endbfrange")
+                    token1.getStringView() == "endbfrange")
                 {
                     break;
                 }
@@ -2115,7 +2254,7 @@ PDFFontCMap PDFFontCMap::createFromData(const QByteArray& data)
                     PDFLexicalAnalyzer::Token token1 = parser.fetch();
 
                     if (token1.type == PDFLexicalAnalyzer::TokenType::Command &&
-                        token1.data.toByteArray() == "endcidrange")
+                        token1.getStringView() == "endcidrange")
                     {
                         break;
                     }
@@ -2137,7 +2276,7 @@ PDFFontCMap PDFFontCMap::createFromData(const QByteArray& data)
                     PDFLexicalAnalyzer::Token token1 = parser.fetch();
 
                     if (token1.type == PDFLexicalAnalyzer::TokenType::Command &&
-                        token1.data.toByteArray() == "endcidchar")
+                        token1.getStringView() == "endcidchar")
                     {
                         break;
                     }
@@ -2157,7 +2296,7 @@ PDFFontCMap PDFFontCMap::createFromData(const QByteArray& data)
                     PDFLexicalAnalyzer::Token token1 = parser.fetch();
 
                     if (token1.type == PDFLexicalAnalyzer::TokenType::Command &&
-                        token1.data.toByteArray() == "endbfchar")
+                        token1.getStringView() == "endbfchar")
                     {
                         break;
                     }
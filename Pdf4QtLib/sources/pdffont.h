@@ -38,6 +38,7 @@ class PDFDocument;
 class PDFModifiedDocument;
 class PDFRenderErrorReporter;
 class PDFFontCMap;
+struct PDFAtlasGlyphId;
 
 using CID = unsigned int;
 using GID = unsigned int;
@@ -60,7 +61,7 @@ enum class TextRenderingMode
 struct TextSequenceItem
 {
     inline explicit TextSequenceItem() = default;
-    inline explicit TextSequenceItem(const QPainterPath* glyph, QChar character, PDFReal advance) : glyph(glyph), character(character), advance(advance) { }
+    inline explicit TextSequenceItem(const QPainterPath* glyph, QChar character, PDFReal advance, GID glyphIndex = 0, const PDFAtlasGlyphId* atlasId = nullptr) : glyph(glyph), character(character), advance(advance), glyphIndex(glyphIndex), atlasId(atlasId) { }
     inline explicit TextSequenceItem(PDFReal advance) : character(), advance(advance) { }
     inline explicit TextSequenceItem(const QByteArray* characterContentStream, QChar character, PDFReal advance) : characterContentStream(characterContentStream), character(character), advance(advance) { }
 
@@ -73,6 +74,12 @@ struct TextSequenceItem
     const QByteArray* characterContentStream = nullptr;
     QChar character;
     PDFReal advance = 0;
+
+    /// Glyph index in the font program (zero, if glyph is not from the font program)
+    GID glyphIndex = 0;
+
+    /// Identification of the glyph outline in the glyph atlas (can be nullptr)
+    const PDFAtlasGlyphId* atlasId = nullptr;
 };
 
 struct TextSequence
@@ -206,6 +213,12 @@ struct PDF4QTLIBSHARED_EXPORT FontDescriptor
     /// in the font dictionary.
     QByteArray fontFile3;
 
+    /// References to the embedded font program streams (invalid references,
+    /// if font program is not embedded, or it is a direct object)
+    PDFObjectReference fontFileReference;
+    PDFObjectReference fontFile2Reference;
+    PDFObjectReference fontFile3Reference;
+
     /// Character set
     QByteArray charset;
 };
@@ -215,9 +228,11 @@ class PDFFont;
 using PDFFontPointer = QSharedPointer<PDFFont>;
 
 class PDFRealizedFont;
+class PDFRealizedFontFace;
 class IRealizedFontImpl;
 
 using PDFRealizedFontPointer = QSharedPointer<PDFRealizedFont>;
+using PDFRealizedFontFacePointer = QSharedPointer<PDFRealizedFontFace>;
 
 struct CharacterInfo
 {
@@ -253,8 +268,20 @@ public:
     CharacterInfos getCharacterInfos() const;
 
     /// Creates new realized font from the standard font. If font can't be created,
-    /// then exception is thrown.
-    static PDFRealizedFontPointer createRealizedFont(PDFFontPointer font, PDFReal pixelSize, PDFRenderErrorReporter* reporter);
+    /// then exception is thrown. Font face can be shared between realized fonts
+    /// of different sizes, if it is not specified, new font face is created.
+    /// \param font Font
+    /// \param pixelSize Pixel size of the font
+    /// \param reporter Error reporter
+    /// \param fontFace Font face created by \p createFontFace (can be nullptr)
+    static PDFRealizedFontPointer createRealizedFont(PDFFontPointer font, PDFReal pixelSize, PDFRenderErrorReporter* reporter, PDFRealizedFontFacePointer fontFace = PDFRealizedFontFacePointer());
+
+    /// Creates font face, i.e. font program loaded into the font engine, together with
+    /// glyph outline cache. Font face doesn't depend on font size. For Type 3 fonts,
+    /// nullptr is returned. If font face can't be created, then exception is thrown.
+    /// \param font Font
+    /// \param reporter Error reporter
+    static PDFRealizedFontFacePointer createFontFace(PDFFontPointer font, PDFRenderErrorReporter* reporter);
 
 private:
     /// Constructs new realized font
@@ -425,6 +452,7 @@ private:
     mutable QMutex m_mutex;
     const PDFDocument* m_document;
     mutable std::map<PDFObjectReference, PDFFontPointer> m_fontCache;
+    mutable std::map<PDFFontPointer, PDFRealizedFontFacePointer> m_fontFaceCache;
     mutable std::map<std::pair<PDFFontPointer, PDFReal>, PDFRealizedFontPointer> m_realizedFontCache;
     mutable std::set<const void*> m_fontCacheShrinkDisabledObjects;
 };
@@ -0,0 +1,1253 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pdffontsubsetter.h"
+#include "pdfexception.h"
+#include "pdfdbgheap.h"
+
+#include <QtEndian>
+#include <QCryptographicHash>
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <vector>
+
+namespace pdf
+{
+
+constexpr uint32_t makeTrueTypeTag(char c1, char c2, char c3, char c4)
+{
+    return (uint32_t(uint8_t(c1)) << 24) | (uint32_t(uint8_t(c2)) << 16) | (uint32_t(uint8_t(c3)) << 8) | uint32_t(uint8_t(c4));
+}
+
+/// Table record in the table directory of the TrueType font program
+struct PDFTrueTypeTableRecord
+{
+    uint32_t tag = 0;
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    QByteArray data;
+};
+
+/// Reads big-endian values from the font program, with range checking
+class PDFTrueTypeFontReader
+{
+public:
+    explicit PDFTrueTypeFontReader(const QByteArray& data) :
+        m_data(data)
+    {
+
+    }
+
+    uint16_t readUInt16(qint64 offset) const
+    {
+        checkRange(offset, 2);
+        return qFromBigEndian<quint16>(m_data.constData() + offset);
+    }
+
+    int16_t readInt16(qint64 offset) const
+    {
+        return static_cast<int16_t>(readUInt16(offset));
+    }
+
+    uint32_t readUInt32(qint64 offset) const
+    {
+        checkRange(offset, 4);
+        return qFromBigEndian<quint32>(m_data.constData() + offset);
+    }
+
+    void checkRange(qint64 offset, qint64 length) const
+    {
+        if (offset < 0 || length < 0 || offset + length > m_data.size())
+        {
+            throw PDFException(PDFTranslationContext::tr("Invalid TrueType font program - data are out of range."));
+        }
+    }
+
+private:
+    const QByteArray& m_data;
+};
+
+static void writeUInt16(QByteArray& data, uint16_t value)
+{
+    data.append(char(value >> 8));
+    data.append(char(value));
+}
+
+static void writeUInt32(QByteArray& data, uint32_t value)
+{
+    writeUInt16(data, uint16_t(value >> 16));
+    writeUInt16(data, uint16_t(value));
+}
+
+static void padToFourBytes(QByteArray& data)
+{
+    while (data.size() % 4 != 0)
+    {
+        data.append(char(0));
+    }
+}
+
+static uint32_t calculateTrueTypeChecksum(const QByteArray& data)
+{
+    // Checksum is sum of the 32-bit words, table is padded with zeroes
+    uint32_t checksum = 0;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.constData());
+    for (int i = 0; i < data.size(); ++i)
+    {
+        checksum += uint32_t(bytes[i]) << (8 * (3 - i % 4));
+    }
+    return checksum;
+}
+
+QByteArray PDFTrueTypeFontSubsetter::createSubset(const QByteArray& fontProgram, const std::set<GID>& glyphs)
+{
+    constexpr uint32_t TAG_HEAD = makeTrueTypeTag('h', 'e', 'a', 'd');
+    constexpr uint32_t TAG_MAXP = makeTrueTypeTag('m', 'a', 'x', 'p');
+    constexpr uint32_t TAG_LOCA = makeTrueTypeTag('l', 'o', 'c', 'a');
+    constexpr uint32_t TAG_GLYF = makeTrueTypeTag('g', 'l', 'y', 'f');
+
+    // Tables, which are needed to render the font embedded in the PDF document
+    constexpr std::array keptTables = {
+        makeTrueTypeTag('c', 'm', 'a', 'p'),
+        makeTrueTypeTag('c', 'v', 't', ' '),
+        makeTrueTypeTag('f', 'p', 'g', 'm'),
+        TAG_GLYF,
+        TAG_HEAD,
+        makeTrueTypeTag('h', 'h', 'e', 'a'),
+        makeTrueTypeTag('h', 'm', 't', 'x'),
+        TAG_LOCA,
+        TAG_MAXP,
+        makeTrueTypeTag('n', 'a', 'm', 'e'),
+        makeTrueTypeTag('O', 'S', '/', '2'),
+        makeTrueTypeTag('p', 'o', 's', 't'),
+        makeTrueTypeTag('p', 'r', 'e', 'p')
+    };
+
+    PDFTrueTypeFontReader reader(fontProgram);
+
+    const uint32_t sfntVersion = reader.readUInt32(0);
+    if (sfntVersion != 0x00010000 && sfntVersion != makeTrueTypeTag('t', 'r', 'u', 'e'))
+    {
+        throw PDFException(PDFTranslationContext::tr("Font program is not a TrueType font program."));
+    }
+
+    // Read the table directory
+    const uint16_t tableCount = reader.readUInt16(4);
+    std::vector<PDFTrueTypeTableRecord> tables;
+    tables.reserve(tableCount);
+    for (uint16_t i = 0; i < tableCount; ++i)
+    {
+        const qint64 recordOffset = 12 + 16 * qint64(i);
+
+        PDFTrueTypeTableRecord record;
+        record.tag = reader.readUInt32(recordOffset);
+        record.offset = reader.readUInt32(recordOffset + 8);
+        record.length = reader.readUInt32(recordOffset + 12);
+        reader.checkRange(record.offset, record.length);
+
+        if (std::find(keptTables.cbegin(), keptTables.cend(), record.tag) != keptTables.cend())
+        {
+            record.data = fontProgram.mid(record.offset, record.length);
+            tables.push_back(qMove(record));
+        }
+    }
+
+    auto findTable = [&tables](uint32_t tag) -> PDFTrueTypeTableRecord&
+    {
+        auto it = std::find_if(tables.begin(), tables.end(), [tag](const PDFTrueTypeTableRecord& record) { return record.tag == tag; });
+        if (it == tables.end())
+        {
+            throw PDFException(PDFTranslationContext::tr("Invalid TrueType font program - required table is missing."));
+        }
+        return *it;
+    };
+
+    PDFTrueTypeTableRecord& headTable = findTable(TAG_HEAD);
+    PDFTrueTypeTableRecord& maxpTable = findTable(TAG_MAXP);
+    PDFTrueTypeTableRecord& locaTable = findTable(TAG_LOCA);
+    PDFTrueTypeTableRecord& glyfTable = findTable(TAG_GLYF);
+
+    if (headTable.length < 54 || maxpTable.length < 6)
+    {
+        throw PDFException(PDFTranslationContext::tr("Invalid TrueType font program - invalid head or maxp table."));
+    }
+
+    const bool isShortLocaFormat = reader.readInt16(qint64(headTable.offset) + 50) == 0;
+    const uint16_t glyphCount = reader.readUInt16(qint64(maxpTable.offset) + 4);
+
+    // Read glyph locations
+    std::vector<uint32_t> locations(size_t(glyphCount) + 1, 0);
+    if (locaTable.length < locations.size() * (isShortLocaFormat ? 2 : 4))
+    {
+        throw PDFException(PDFTranslationContext::tr("Invalid TrueType font program - invalid loca table."));
+    }
+
+    for (size_t i = 0; i < locations.size(); ++i)
+    {
+        if (isShortLocaFormat)
+        {
+            locations[i] = 2 * uint32_t(reader.readUInt16(qint64(locaTable.offset) + 2 * i));
+        }
+        else
+        {
+            locations[i] = reader.readUInt32(qint64(locaTable.offset) + 4 * i);
+        }
+
+        if (locations[i] > glyfTable.length || (i > 0 && locations[i] < locations[i - 1]))
+        {
+            throw PDFException(PDFTranslationContext::tr("Invalid TrueType font program - invalid glyph location."));
+        }
+    }
+
+    // Determine used glyphs. Glyph 0 (.notdef) is always used, and components
+    // of the composite glyphs must be also present in the subset.
+    std::vector<bool> usedGlyphs(glyphCount, false);
+    std::vector<GID> stack = { 0 };
+    for (GID glyph : glyphs)
+    {
+        if (glyph < glyphCount)
+        {
+            stack.push_back(glyph);
+        }
+    }
+
+    while (!stack.empty())
+    {
+        const GID glyph = stack.back();
+        stack.pop_back();
+
+        if (glyph >= glyphCount || usedGlyphs[glyph])
+        {
+            continue;
+        }
+        usedGlyphs[glyph] = true;
+
+        const qint64 glyphStart = qint64(glyfTable.offset) + locations[glyph];
+        const qint64 glyphEnd = qint64(glyfTable.offset) + locations[glyph + 1];
+        if (glyphEnd - glyphStart < 10 || reader.readInt16(glyphStart) >= 0)
+        {
+            // Empty glyph, or simple glyph
+            continue;
+        }
+
+        // Composite glyph - read components
+        constexpr uint16_t ARG_1_AND_2_ARE_WORDS = 0x0001;
+        constexpr uint16_t WE_HAVE_A_SCALE = 0x0008;
+        constexpr uint16_t MORE_COMPONENTS = 0x0020;
+        constexpr uint16_t WE_HAVE_AN_X_AND_Y_SCALE = 0x0040;
+        constexpr uint16_t WE_HAVE_A_TWO_BY_TWO = 0x0080;
+
+        qint64 offset = glyphStart + 10;
+        uint16_t flags = MORE_COMPONENTS;
+        while ((flags & MORE_COMPONENTS) && offset + 4 <= glyphEnd)
+        {
+            flags = reader.readUInt16(offset);
+            stack.push_back(reader.readUInt16(offset + 2));
+            offset += 4;
+            offset += (flags & ARG_1_AND_2_ARE_WORDS) ? 4 : 2;
+
+            if (flags & WE_HAVE_A_SCALE)
+            {
+                offset += 2;
+            }
+            else if (flags & WE_HAVE_AN_X_AND_Y_SCALE)
+            {
+                offset += 4;
+            }
+            else if (flags & WE_HAVE_A_TWO_BY_TWO)
+            {
+                offset += 8;
+            }
+        }
+    }
+
+    // Create new glyf table. Glyph indices are preserved, unused glyphs are empty.
+    QByteArray glyfData;
+    std::vector<uint32_t> newLocations(locations.size(), 0);
+    for (GID glyph = 0; glyph < glyphCount; ++glyph)
+    {
+        newLocations[glyph] = glyfData.size();
+        if (usedGlyphs[glyph])
+        {
+            glyfData.append(glyfTable.data.mid(locations[glyph], locations[glyph + 1] - locations[glyph]));
+            padToFourBytes(glyfData);
+        }
+    }
+    newLocations.back() = glyfData.size();
+
+    // Create new loca table, use short format, if it is possible
+    const bool isNewShortLocaFormat = glyfData.size() <= 2 * 0xFFFF;
+    QByteArray locaData;
+    for (uint32_t location : newLocations)
+    {
+        if (isNewShortLocaFormat)
+        {
+            writeUInt16(locaData, uint16_t(location / 2));
+        }
+        else
+        {
+            writeUInt32(locaData, location);
+        }
+    }
+
+    glyfTable.data = qMove(glyfData);
+    locaTable.data = qMove(locaData);
+
+    // Update head table - clear checksum adjustment and set loca format
+    qToBigEndian<quint32>(0, headTable.data.data() + 8);
+    qToBigEndian<qint16>(isNewShortLocaFormat ? 0 : 1, headTable.data.data() + 50);
+
+    // Write the font program. Tables in the table directory must be sorted by tag.
+    std::sort(tables.begin(), tables.end(), [](const PDFTrueTypeTableRecord& l, const PDFTrueTypeTableRecord& r) { return l.tag < r.tag; });
+
+    const uint16_t newTableCount = uint16_t(tables.size());
+    uint16_t entrySelector = 0;
+    while ((2u << entrySelector) <= newTableCount)
+    {
+        ++entrySelector;
+    }
+    const uint16_t searchRange = uint16_t((1u << entrySelector) * 16);
+    const uint16_t rangeShift = uint16_t(newTableCount * 16 - searchRange);
+
+    QByteArray result;
+    writeUInt32(result, sfntVersion);
+    writeUInt16(result, newTableCount);
+    writeUInt16(result, searchRange);
+    writeUInt16(result, entrySelector);
+    writeUInt16(result, rangeShift);
+
+    uint32_t tableOffset = 12 + 16 * uint32_t(newTableCount);
+    uint32_t headTableOffset = 0;
+    for (const PDFTrueTypeTableRecord& table : tables)
+    {
+        QByteArray paddedData = table.data;
+        padToFourBytes(paddedData);
+
+        writeUInt32(result, table.tag);
+        writeUInt32(result, calculateTrueTypeChecksum(paddedData));
+        writeUInt32(result, tableOffset);
+        writeUInt32(result, uint32_t(table.data.size()));
+
+        if (table.tag == TAG_HEAD)
+        {
+            headTableOffset = tableOffset;
+        }
+
+        tableOffset += uint32_t(paddedData.size());
+    }
+
+    for (const PDFTrueTypeTableRecord& table : tables)
+    {
+        result.append(table.data);
+        padToFourBytes(result);
+    }
+
+    // Checksum adjustment is computed from the whole font program
+    const uint32_t checksumAdjustment = 0xB1B0AFBA - calculateTrueTypeChecksum(result);
+    qToBigEndian<quint32>(checksumAdjustment, result.data() + headTableOffset + 8);
+
+    return result;
+}
+
+QByteArray PDFTrueTypeFontSubsetter::createSubsetTag(const QByteArray& subset)
+{
+    const QByteArray hash = QCryptographicHash::hash(subset, QCryptographicHash::Md5);
+
+    QByteArray tag;
+    for (int i = 0; i < 6; ++i)
+    {
+        tag.append(char('A' + uint8_t(hash[i]) % 26));
+    }
+    return tag;
+}
+
+QByteArray PDFTrueTypeFontSubsetter::getSubsetFontName(const QByteArray& fontName, const QByteArray& tag)
+{
+    auto isTagged = [&fontName]()
+    {
+        if (fontName.size() < 7 || fontName[6] != '+')
+        {
+            return false;
+        }
+
+        return std::all_of(fontName.cbegin(), std::next(fontName.cbegin(), 6), [](char c) { return c >= 'A' && c <= 'Z'; });
+    };
+
+    const QByteArray name = isTagged() ? fontName.mid(7) : fontName;
+    return tag + "+" + name;
+}
+
+/// Reads values from the CFF font program, with range checking
+class PDFCFFFontReader
+{
+public:
+    explicit PDFCFFFontReader(const QByteArray& data) :
+        m_data(data)
+    {
+
+    }
+
+    uint8_t readCard8(qint64 offset) const
+    {
+        checkRange(offset, 1);
+        return uint8_t(m_data[int(offset)]);
+    }
+
+    uint16_t readCard16(qint64 offset) const
+    {
+        checkRange(offset, 2);
+        return qFromBigEndian<quint16>(m_data.constData() + offset);
+    }
+
+    uint32_t readOffset(qint64 offset, uint8_t offsetSize) const
+    {
+        checkRange(offset, offsetSize);
+
+        uint32_t value = 0;
+        for (uint8_t i = 0; i < offsetSize; ++i)
+        {
+            value = (value << 8) | uint8_t(m_data[int(offset + i)]);
+        }
+        return value;
+    }
+
+    void checkRange(qint64 offset, qint64 length) const
+    {
+        if (offset < 0 || length < 0 || offset + length > m_data.size())
+        {
+            throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - data are out of range."));
+        }
+    }
+
+private:
+    const QByteArray& m_data;
+};
+
+/// Index (array of variable-sized objects) in the CFF font program
+struct PDFCFFIndex
+{
+    qint64 offset = 0;  ///< Offset of the index in the font program
+    qint64 size = 0;    ///< Size of the whole index in bytes
+    std::vector<QByteArray> items;
+};
+
+/// Entry (operands and operator) of the dictionary in the CFF font program
+struct PDFCFFDictEntry
+{
+    uint16_t op = 0;                ///< Operator, two-byte operators are stored as 0x0C00 | second byte
+    QByteArray operandData;         ///< Encoded operands
+    std::vector<qint64> operands;   ///< Integer operands, real operands are stored as zero
+};
+
+using PDFCFFDict = std::vector<PDFCFFDictEntry>;
+
+/// Private dictionary of the font with local subroutines
+struct PDFCFFPrivateDict
+{
+    PDFCFFDict dict;
+    QByteArray subrsData;   ///< Data of local subroutines index, empty, if font has no local subroutines
+    PDFCFFIndex subrs;
+};
+
+constexpr uint16_t CFF_OPERATOR_CHARSET = 15;
+constexpr uint16_t CFF_OPERATOR_ENCODING = 16;
+constexpr uint16_t CFF_OPERATOR_CHARSTRINGS = 17;
+constexpr uint16_t CFF_OPERATOR_PRIVATE = 18;
+constexpr uint16_t CFF_OPERATOR_SUBRS = 19;
+constexpr uint16_t CFF_OPERATOR_CHARSTRING_TYPE = 0x0C06;
+constexpr uint16_t CFF_OPERATOR_ROS = 0x0C1E;
+constexpr uint16_t CFF_OPERATOR_FDARRAY = 0x0C24;
+constexpr uint16_t CFF_OPERATOR_FDSELECT = 0x0C25;
+
+/// Standard encoding of the CFF font program, maps character codes to standard string identifiers (SID)
+static constexpr std::array<uint8_t, 256> CFF_STANDARD_ENCODING = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,  16,
+     17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,  32,
+     33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,
+     49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,
+     65,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,  77,  78,  79,  80,
+     81,  82,  83,  84,  85,  86,  87,  88,  89,  90,  91,  92,  93,  94,  95,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,  96,  97,  98,  99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110,
+      0, 111, 112, 113, 114,   0, 115, 116, 117, 118, 119, 120, 121, 122,   0, 123,
+      0, 124, 125, 126, 127, 128, 129, 130, 131,   0, 132, 133,   0, 134, 135, 136,
+    137,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0, 138,   0, 139,   0,   0,   0,   0, 140, 141, 142, 143,   0,   0,   0,   0,
+      0, 144,   0,   0,   0, 145,   0,   0, 146, 147, 148, 149,   0,   0,   0,   0
+};
+
+static PDFCFFIndex readCFFIndex(const PDFCFFFontReader& reader, const QByteArray& data, qint64 offset)
+{
+    PDFCFFIndex index;
+    index.offset = offset;
+
+    const uint16_t count = reader.readCard16(offset);
+    if (count == 0)
+    {
+        index.size = 2;
+        return index;
+    }
+
+    const uint8_t offsetSize = reader.readCard8(offset + 2);
+    if (offsetSize < 1 || offsetSize > 4)
+    {
+        throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - invalid index."));
+    }
+
+    // Offsets are relative to the byte preceding the object data
+    const qint64 dataOffset = offset + 3 + (qint64(count) + 1) * offsetSize - 1;
+    index.items.reserve(count);
+
+    uint32_t itemOffset = reader.readOffset(offset + 3, offsetSize);
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        const uint32_t nextItemOffset = reader.readOffset(offset + 3 + (qint64(i) + 1) * offsetSize, offsetSize);
+        if (itemOffset < 1 || nextItemOffset < itemOffset)
+        {
+            throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - invalid index."));
+        }
+
+        reader.checkRange(dataOffset + itemOffset, nextItemOffset - itemOffset);
+        index.items.push_back(data.mid(dataOffset + itemOffset, nextItemOffset - itemOffset));
+        itemOffset = nextItemOffset;
+    }
+
+    index.size = dataOffset + itemOffset - offset;
+    return index;
+}
+
+static QByteArray writeCFFIndex(const std::vector<QByteArray>& items)
+{
+    QByteArray data;
+    writeUInt16(data, uint16_t(items.size()));
+
+    if (items.empty())
+    {
+        return data;
+    }
+
+    uint32_t lastOffset = 1;
+    for (const QByteArray& item : items)
+    {
+        lastOffset += uint32_t(item.size());
+    }
+
+    uint8_t offsetSize = 1;
+    while (offsetSize < 4 && (lastOffset >> (8 * offsetSize)) != 0)
+    {
+        ++offsetSize;
+    }
+    data.append(char(offsetSize));
+
+    auto writeOffset = [&data, offsetSize](uint32_t offset)
+    {
+        for (int i = offsetSize - 1; i >= 0; --i)
+        {
+            data.append(char(offset >> (8 * i)));
+        }
+    };
+
+    uint32_t offset = 1;
+    writeOffset(offset);
+    for (const QByteArray& item : items)
+    {
+        offset += uint32_t(item.size());
+        writeOffset(offset);
+    }
+
+    for (const QByteArray& item : items)
+    {
+        data.append(item);
+    }
+
+    return data;
+}
+
+static PDFCFFDict readCFFDict(const QByteArray& data)
+{
+    PDFCFFFontReader reader(data);
+    PDFCFFDict dict;
+    PDFCFFDictEntry entry;
+
+    qint64 operandStart = 0;
+    qint64 position = 0;
+    while (position < data.size())
+    {
+        const uint8_t b0 = reader.readCard8(position);
+        if (b0 <= 21)
+        {
+            entry.op = b0;
+            entry.operandData = data.mid(operandStart, position - operandStart);
+            if (b0 == 12)
+            {
+                entry.op = 0x0C00 | reader.readCard8(position + 1);
+                ++position;
+            }
+            ++position;
+
+            dict.push_back(qMove(entry));
+            entry = PDFCFFDictEntry();
+            operandStart = position;
+        }
+        else if (b0 == 28)
+        {
+            entry.operands.push_back(int16_t(reader.readCard16(position + 1)));
+            position += 3;
+        }
+        else if (b0 == 29)
+        {
+            entry.operands.push_back(int32_t((uint32_t(reader.readCard16(position + 1)) << 16) | reader.readCard16(position + 3)));
+            position += 5;
+        }
+        else if (b0 == 30)
+        {
+            // Real number, nibbles are terminated by 0xF nibble
+            ++position;
+            uint8_t value = 0;
+            do
+            {
+                value = reader.readCard8(position++);
+            }
+            while ((value & 0x0F) != 0x0F && (value & 0xF0) != 0xF0);
+            entry.operands.push_back(0);
+        }
+        else if (b0 >= 32 && b0 <= 246)
+        {
+            entry.operands.push_back(qint64(b0) - 139);
+            ++position;
+        }
+        else if (b0 >= 247 && b0 <= 250)
+        {
+            entry.operands.push_back((qint64(b0) - 247) * 256 + reader.readCard8(position + 1) + 108);
+            position += 2;
+        }
+        else if (b0 >= 251 && b0 <= 254)
+        {
+            entry.operands.push_back(-(qint64(b0) - 251) * 256 - reader.readCard8(position + 1) - 108);
+            position += 2;
+        }
+        else
+        {
+            throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - invalid dictionary."));
+        }
+    }
+
+    return dict;
+}
+
+static QByteArray writeCFFDict(const PDFCFFDict& dict)
+{
+    QByteArray data;
+    for (const PDFCFFDictEntry& entry : dict)
+    {
+        data.append(entry.operandData);
+        if (entry.op >= 0x0C00)
+        {
+            data.append(char(12));
+        }
+        data.append(char(entry.op & 0xFF));
+    }
+    return data;
+}
+
+static PDFCFFDictEntry* findCFFDictEntry(PDFCFFDict& dict, uint16_t op)
+{
+    auto it = std::find_if(dict.begin(), dict.end(), [op](const PDFCFFDictEntry& entry) { return entry.op == op; });
+    return it != dict.end() ? &*it : nullptr;
+}
+
+/// Sets operands of the dictionary entry. Operands are encoded using 5 bytes,
+/// so the size of the dictionary doesn't depend on the values of the operands.
+static void setCFFDictEntryOperands(PDFCFFDictEntry& entry, std::initializer_list<qint64> operands)
+{
+    entry.operandData.clear();
+    entry.operands.clear();
+    for (qint64 operand : operands)
+    {
+        entry.operandData.append(char(29));
+        writeUInt32(entry.operandData, uint32_t(operand));
+        entry.operands.push_back(operand);
+    }
+}
+
+static qint64 getCFFDictEntryOffset(const PDFCFFDictEntry* entry, size_t operandIndex = 0)
+{
+    if (!entry || entry->operands.size() <= operandIndex || entry->operands[operandIndex] < 0)
+    {
+        throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - invalid dictionary."));
+    }
+    return entry->operands[operandIndex];
+}
+
+static PDFCFFPrivateDict readCFFPrivateDict(const PDFCFFFontReader& reader, const QByteArray& data, const PDFCFFDictEntry* privateEntry)
+{
+    const qint64 size = getCFFDictEntryOffset(privateEntry, 0);
+    const qint64 offset = getCFFDictEntryOffset(privateEntry, 1);
+    reader.checkRange(offset, size);
+
+    PDFCFFPrivateDict privateDict;
+    privateDict.dict = readCFFDict(data.mid(offset, size));
+
+    // Offset of local subroutines is relative to the private dictionary
+    if (const PDFCFFDictEntry* subrsEntry = findCFFDictEntry(privateDict.dict, CFF_OPERATOR_SUBRS))
+    {
+        privateDict.subrs = readCFFIndex(reader, data, offset + getCFFDictEntryOffset(subrsEntry));
+        privateDict.subrsData = data.mid(privateDict.subrs.offset, privateDict.subrs.size);
+    }
+
+    return privateDict;
+}
+
+/// Writes private dictionary followed by its local subroutines
+/// \param privateDict Private dictionary
+/// \param[out] privateDictSize Size of the private dictionary (without subroutines)
+static QByteArray writeCFFPrivateDict(PDFCFFPrivateDict privateDict, qint64& privateDictSize)
+{
+    PDFCFFDictEntry* subrsEntry = findCFFDictEntry(privateDict.dict, CFF_OPERATOR_SUBRS);
+    if (subrsEntry)
+    {
+        setCFFDictEntryOperands(*subrsEntry, { 0 });
+        privateDictSize = writeCFFDict(privateDict.dict).size();
+        setCFFDictEntryOperands(*subrsEntry, { privateDictSize });
+    }
+
+    QByteArray data = writeCFFDict(privateDict.dict);
+    privateDictSize = data.size();
+    data.append(privateDict.subrsData);
+    return data;
+}
+
+/// Finds components of accented glyphs (endchar operator with arguments
+/// of the deprecated seac operator) in the Type 2 charstrings.
+class PDFCFFCharStringScanner
+{
+public:
+    explicit PDFCFFCharStringScanner(const std::vector<QByteArray>& globalSubrs, const std::vector<QByteArray>& localSubrs) :
+        m_globalSubrs(globalSubrs),
+        m_localSubrs(localSubrs)
+    {
+
+    }
+
+    /// Scans the charstring. If glyph is accented glyph, returns true
+    /// and standard codes of the base and accent characters.
+    /// \param charString Charstring of the glyph
+    /// \param[out] baseCode Standard code of the base character
+    /// \param[out] accentCode Standard code of the accent character
+    bool scan(const QByteArray& charString, int& baseCode, int& accentCode)
+    {
+        m_stack.clear();
+        m_stemCount = 0;
+        m_isAccented = false;
+
+        scanImpl(charString, 0);
+
+        baseCode = m_baseCode;
+        accentCode = m_accentCode;
+        return m_isAccented;
+    }
+
+private:
+    /// Returns true, if endchar operator was reached
+    bool scanImpl(const QByteArray& charString, int depth)
+    {
+        // Maximal nesting of subroutines is 10
+        if (depth > 10)
+        {
+            throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - subroutines are nested too deeply."));
+        }
+
+        PDFCFFFontReader reader(charString);
+        qint64 position = 0;
+        while (position < charString.size())
+        {
+            const uint8_t b0 = reader.readCard8(position++);
+            if (b0 == 28)
+            {
+                m_stack.push_back(int16_t(reader.readCard16(position)));
+                position += 2;
+            }
+            else if (b0 >= 32 && b0 <= 246)
+            {
+                m_stack.push_back(int(b0) - 139);
+            }
+            else if (b0 >= 247 && b0 <= 250)
+            {
+                m_stack.push_back((int(b0) - 247) * 256 + reader.readCard8(position++) + 108);
+            }
+            else if (b0 >= 251 && b0 <= 254)
+            {
+                m_stack.push_back(-(int(b0) - 251) * 256 - reader.readCard8(position++) - 108);
+            }
+            else if (b0 == 255)
+            {
+                // Fixed 16.16 number, we need only the integer part
+                m_stack.push_back(int16_t(reader.readCard16(position)));
+                position += 4;
+            }
+            else
+            {
+                switch (b0)
+                {
+                    case 1:     // hstem
+                    case 3:     // vstem
+                    case 18:    // hstemhm
+                    case 23:    // vstemhm
+                        m_stemCount += int(m_stack.size() / 2);
+                        m_stack.clear();
+                        break;
+
+                    case 19:    // hintmask
+                    case 20:    // cntrmask
+                        // Operands are arguments of implicit vstem operator
+                        m_stemCount += int(m_stack.size() / 2);
+                        m_stack.clear();
+                        position += (m_stemCount + 7) / 8;
+                        break;
+
+                    case 10:    // callsubr
+                    case 29:    // callgsubr
+                    {
+                        const std::vector<QByteArray>& subrs = (b0 == 10) ? m_localSubrs : m_globalSubrs;
+                        if (m_stack.empty())
+                        {
+                            throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - invalid charstring."));
+                        }
+
+                        const qint64 subrIndex = qint64(m_stack.back()) + getSubrBias(subrs.size());
+                        m_stack.pop_back();
+                        if (subrIndex < 0 || subrIndex >= qint64(subrs.size()))
+                        {
+                            throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - invalid subroutine."));
+                        }
+
+                        if (scanImpl(subrs[subrIndex], depth + 1))
+                        {
+                            return true;
+                        }
+                        break;
+                    }
+
+                    case 11:    // return
+                        return false;
+
+                    case 14:    // endchar
+                        if (m_stack.size() >= 4)
+                        {
+                            m_isAccented = true;
+                            m_baseCode = m_stack[m_stack.size() - 2];
+                            m_accentCode = m_stack[m_stack.size() - 1];
+                        }
+                        return true;
+
+                    case 12:    // escape, two-byte operators (flex, arithmetic operators)
+                        ++position;
+                        m_stack.clear();
+                        break;
+
+                    default:
+                        m_stack.clear();
+                        break;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    static int getSubrBias(size_t subrCount)
+    {
+        if (subrCount < 1240)
+        {
+            return 107;
+        }
+        else if (subrCount < 33900)
+        {
+            return 1131;
+        }
+
+        return 32768;
+    }
+
+    const std::vector<QByteArray>& m_globalSubrs;
+    const std::vector<QByteArray>& m_localSubrs;
+    std::vector<int> m_stack;
+    int m_stemCount = 0;
+    bool m_isAccented = false;
+    int m_baseCode = 0;
+    int m_accentCode = 0;
+};
+
+bool PDFCFFFontSubsetter::isCFFFontProgram(const QByteArray& fontProgram)
+{
+    // OpenType and TrueType font programs start with version tag, CFF font programs with major version 1
+    return fontProgram.size() >= 4 && uint8_t(fontProgram[0]) == 1 && uint8_t(fontProgram[2]) >= 4;
+}
+
+QByteArray PDFCFFFontSubsetter::createSubset(const QByteArray& fontProgram, const std::set<GID>& glyphs)
+{
+    if (!isCFFFontProgram(fontProgram))
+    {
+        throw PDFException(PDFTranslationContext::tr("Font program is not a CFF font program."));
+    }
+
+    PDFCFFFontReader reader(fontProgram);
+    const uint8_t headerSize = reader.readCard8(2);
+
+    const PDFCFFIndex nameIndex = readCFFIndex(reader, fontProgram, headerSize);
+    const PDFCFFIndex topDictIndex = readCFFIndex(reader, fontProgram, nameIndex.offset + nameIndex.size);
+    const PDFCFFIndex stringIndex = readCFFIndex(reader, fontProgram, topDictIndex.offset + topDictIndex.size);
+    const PDFCFFIndex globalSubrIndex = readCFFIndex(reader, fontProgram, stringIndex.offset + stringIndex.size);
+
+    if (topDictIndex.items.size() != 1)
+    {
+        throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - font program must contain exactly one font."));
+    }
+
+    PDFCFFDict topDict = readCFFDict(topDictIndex.items.front());
+    const bool isCIDKeyed = findCFFDictEntry(topDict, CFF_OPERATOR_ROS) != nullptr;
+
+    if (const PDFCFFDictEntry* charStringTypeEntry = findCFFDictEntry(topDict, CFF_OPERATOR_CHARSTRING_TYPE))
+    {
+        if (charStringTypeEntry->operands.size() != 1 || charStringTypeEntry->operands.front() != 2)
+        {
+            throw PDFException(PDFTranslationContext::tr("CFF font program with Type 1 charstrings can't be subsetted."));
+        }
+    }
+
+    const PDFCFFIndex charStringsIndex = readCFFIndex(reader, fontProgram, getCFFDictEntryOffset(findCFFDictEntry(topDict, CFF_OPERATOR_CHARSTRINGS)));
+    const size_t glyphCount = charStringsIndex.items.size();
+    if (glyphCount == 0)
+    {
+        throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - font has no glyphs."));
+    }
+
+    // Read charset - it maps glyph indices to glyph names (SIDs) or CIDs. Offsets
+    // 0, 1 and 2 are predefined charsets (ISOAdobe, Expert and ExpertSubset).
+    PDFCFFDictEntry* charsetEntry = findCFFDictEntry(topDict, CFF_OPERATOR_CHARSET);
+    const qint64 charsetOffset = charsetEntry ? getCFFDictEntryOffset(charsetEntry) : 0;
+    std::vector<uint16_t> glyphNames;
+    QByteArray charsetData;
+    if (charsetOffset > 2)
+    {
+        glyphNames.reserve(glyphCount);
+        glyphNames.push_back(0);
+
+        const uint8_t format = reader.readCard8(charsetOffset);
+        qint64 position = charsetOffset + 1;
+        while (glyphNames.size() < glyphCount)
+        {
+            switch (format)
+            {
+                case 0:
+                    glyphNames.push_back(reader.readCard16(position));
+                    position += 2;
+                    break;
+
+                case 1:
+                case 2:
+                {
+                    const uint16_t first = reader.readCard16(position);
+                    const uint16_t left = (format == 1) ? reader.readCard8(position + 2) : reader.readCard16(position + 2);
+                    position += (format == 1) ? 3 : 4;
+
+                    for (uint32_t i = 0; i <= left && glyphNames.size() < glyphCount; ++i)
+                    {
+                        glyphNames.push_back(uint16_t(first + i));
+                    }
+                    break;
+                }
+
+                default:
+                    throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - invalid charset."));
+            }
+        }
+
+        charsetData = fontProgram.mid(charsetOffset, position - charsetOffset);
+    }
+    else if (isCIDKeyed)
+    {
+        throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - CID-keyed font must have charset."));
+    }
+    else if (charsetOffset == 0)
+    {
+        // ISOAdobe charset, glyph names are standard strings
+        for (size_t i = 0; i < glyphCount; ++i)
+        {
+            glyphNames.push_back(uint16_t(i));
+        }
+    }
+
+    // Read custom encoding (offsets 0 and 1 are predefined Standard and Expert encodings)
+    PDFCFFDictEntry* encodingEntry = isCIDKeyed ? nullptr : findCFFDictEntry(topDict, CFF_OPERATOR_ENCODING);
+    const qint64 encodingOffset = encodingEntry ? getCFFDictEntryOffset(encodingEntry) : 0;
+    QByteArray encodingData;
+    if (encodingOffset > 1)
+    {
+        const uint8_t format = reader.readCard8(encodingOffset);
+        qint64 position = encodingOffset + 1;
+        switch (format & 0x7F)
+        {
+            case 0:
+                position += 1 + reader.readCard8(position);
+                break;
+
+            case 1:
+                position += 1 + 2 * qint64(reader.readCard8(position));
+                break;
+
+            default:
+                throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - invalid encoding."));
+        }
+
+        // Supplements of the encoding
+        if (format & 0x80)
+        {
+            position += 1 + 3 * qint64(reader.readCard8(position));
+        }
+
+        reader.checkRange(encodingOffset, position - encodingOffset);
+        encodingData = fontProgram.mid(encodingOffset, position - encodingOffset);
+    }
+
+    // Read private dictionaries. CID-keyed fonts have private dictionaries
+    // in font dictionaries of FDArray, glyphs are assigned to the font
+    // dictionaries by FDSelect.
+    PDFCFFDictEntry* fdSelectEntry = nullptr;
+    PDFCFFDictEntry* fdArrayEntry = nullptr;
+    QByteArray fdSelectData;
+    std::vector<PDFCFFDict> fontDicts;
+    std::vector<PDFCFFPrivateDict> privateDicts;
+    if (isCIDKeyed)
+    {
+        fdSelectEntry = findCFFDictEntry(topDict, CFF_OPERATOR_FDSELECT);
+        fdArrayEntry = findCFFDictEntry(topDict, CFF_OPERATOR_FDARRAY);
+
+        const qint64 fdSelectOffset = getCFFDictEntryOffset(fdSelectEntry);
+        const uint8_t format = reader.readCard8(fdSelectOffset);
+        qint64 fdSelectSize = 0;
+        switch (format)
+        {
+            case 0:
+                fdSelectSize = 1 + qint64(glyphCount);
+                break;
+
+            case 3:
+                fdSelectSize = 1 + 2 + 3 * qint64(reader.readCard16(fdSelectOffset + 1)) + 2;
+                break;
+
+            default:
+                throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - invalid FDSelect."));
+        }
+        reader.checkRange(fdSelectOffset, fdSelectSize);
+        fdSelectData = fontProgram.mid(fdSelectOffset, fdSelectSize);
+
+        const PDFCFFIndex fdArrayIndex = readCFFIndex(reader, fontProgram, getCFFDictEntryOffset(fdArrayEntry));
+        for (const QByteArray& fontDictData : fdArrayIndex.items)
+        {
+            PDFCFFDict fontDict = readCFFDict(fontDictData);
+            privateDicts.push_back(readCFFPrivateDict(reader, fontProgram, findCFFDictEntry(fontDict, CFF_OPERATOR_PRIVATE)));
+            fontDicts.push_back(qMove(fontDict));
+        }
+    }
+    else
+    {
+        privateDicts.push_back(readCFFPrivateDict(reader, fontProgram, findCFFDictEntry(topDict, CFF_OPERATOR_PRIVATE)));
+    }
+
+    // Determine used glyphs. Glyph 0 (.notdef) is always used.
+    std::vector<bool> usedGlyphs(glyphCount, false);
+    usedGlyphs[0] = true;
+    if (isCIDKeyed)
+    {
+        std::map<uint16_t, GID> cidToGid;
+        for (size_t i = 0; i < glyphNames.size(); ++i)
+        {
+            cidToGid.emplace(glyphNames[i], GID(i));
+        }
+
+        for (GID cid : glyphs)
+        {
+            auto it = cidToGid.find(uint16_t(cid));
+            if (cid <= 0xFFFF && it != cidToGid.cend())
+            {
+                usedGlyphs[it->second] = true;
+            }
+        }
+    }
+    else
+    {
+        std::map<uint16_t, GID> sidToGid;
+        for (size_t i = 0; i < glyphNames.size(); ++i)
+        {
+            sidToGid.emplace(glyphNames[i], GID(i));
+        }
+
+        // Components of the accented glyphs must be also present in the subset
+        PDFCFFCharStringScanner scanner(globalSubrIndex.items, privateDicts.front().subrs.items);
+        std::vector<GID> stack(glyphs.cbegin(), glyphs.cend());
+        while (!stack.empty())
+        {
+            const GID glyph = stack.back();
+            stack.pop_back();
+
+            if (glyph >= glyphCount || usedGlyphs[glyph])
+            {
+                continue;
+            }
+            usedGlyphs[glyph] = true;
+
+            int baseCode = 0;
+            int accentCode = 0;
+            if (scanner.scan(charStringsIndex.items[glyph], baseCode, accentCode))
+            {
+                for (int code : { baseCode, accentCode })
+                {
+                    auto it = (code >= 0 && code < int(CFF_STANDARD_ENCODING.size())) ? sidToGid.find(CFF_STANDARD_ENCODING[code]) : sidToGid.end();
+                    if (it == sidToGid.end())
+                    {
+                        throw PDFException(PDFTranslationContext::tr("Invalid CFF font program - component of the accented glyph not found."));
+                    }
+                    stack.push_back(it->second);
+                }
+            }
+        }
+    }
+
+    // Create new charstrings. Glyph indices are preserved, unused glyphs are empty (endchar).
+    std::vector<QByteArray> charStrings;
+    charStrings.reserve(glyphCount);
+    for (size_t i = 0; i < glyphCount; ++i)
+    {
+        charStrings.push_back(usedGlyphs[i] ? charStringsIndex.items[i] : QByteArray(1, char(14)));
+    }
+    const QByteArray charStringsData = writeCFFIndex(charStrings);
+
+    // Offsets in the top dictionary are written using fixed size operands,
+    // so we can determine size of the top dictionary before the layout is known.
+    auto setOffset = [](PDFCFFDictEntry* entry, qint64 offset)
+    {
+        if (entry)
+        {
+            setCFFDictEntryOperands(*entry, { offset });
+        }
+    };
+    auto setPrivate = [](PDFCFFDictEntry* entry, qint64 size, qint64 offset)
+    {
+        setCFFDictEntryOperands(*entry, { size, offset });
+    };
+
+    PDFCFFDictEntry* charStringsEntry = findCFFDictEntry(topDict, CFF_OPERATOR_CHARSTRINGS);
+    PDFCFFDictEntry* privateEntry = isCIDKeyed ? nullptr : findCFFDictEntry(topDict, CFF_OPERATOR_PRIVATE);
+    setOffset(!charsetData.isEmpty() ? charsetEntry : nullptr, 0);
+    setOffset(!encodingData.isEmpty() ? encodingEntry : nullptr, 0);
+    setOffset(charStringsEntry, 0);
+    setOffset(fdSelectEntry, 0);
+    setOffset(fdArrayEntry, 0);
+    if (privateEntry)
+    {
+        setPrivate(privateEntry, 0, 0);
+    }
+
+    // Layout: header, name index, top dict index, string index, global subroutines,
+    // charset, encoding, FDSelect, charstrings, private dictionary (or FDArray
+    // followed by private dictionaries of the font dictionaries).
+    const qint64 topDictIndexSize = writeCFFIndex({ writeCFFDict(topDict) }).size();
+    qint64 offset = headerSize + nameIndex.size + topDictIndexSize + stringIndex.size + globalSubrIndex.size;
+
+    QByteArray data;
+    if (!charsetData.isEmpty())
+    {
+        setOffset(charsetEntry, offset);
+        data.append(charsetData);
+        offset += charsetData.size();
+    }
+
+    if (!encodingData.isEmpty())
+    {
+        setOffset(encodingEntry, offset);
+        data.append(encodingData);
+        offset += encodingData.size();
+    }
+
+    if (isCIDKeyed)
+    {
+        setOffset(fdSelectEntry, offset);
+        data.append(fdSelectData);
+        offset += fdSelectData.size();
+    }
+
+    setOffset(charStringsEntry, offset);
+    data.append(charStringsData);
+    offset += charStringsData.size();
+
+    if (isCIDKeyed)
+    {
+        for (PDFCFFDict& fontDict : fontDicts)
+        {
+            setPrivate(findCFFDictEntry(fontDict, CFF_OPERATOR_PRIVATE), 0, 0);
+        }
+
+        auto writeFDArray = [&fontDicts]()
+        {
+            std::vector<QByteArray> items;
+            for (const PDFCFFDict& fontDict : fontDicts)
+            {
+                items.push_back(writeCFFDict(fontDict));
+            }
+            return writeCFFIndex(items);
+        };
+
+        setOffset(fdArrayEntry, offset);
+        qint64 privateDictOffset = offset + writeFDArray().size();
+
+        QByteArray privateDictsData;
+        for (size_t i = 0; i < fontDicts.size(); ++i)
+        {
+            qint64 privateDictSize = 0;
+            QByteArray privateDictData = writeCFFPrivateDict(privateDicts[i], privateDictSize);
+            setPrivate(findCFFDictEntry(fontDicts[i], CFF_OPERATOR_PRIVATE), privateDictSize, privateDictOffset);
+            privateDictOffset += privateDictData.size();
+            privateDictsData.append(privateDictData);
+        }
+
+        data.append(writeFDArray());
+        data.append(privateDictsData);
+    }
+    else
+    {
+        qint64 privateDictSize = 0;
+        QByteArray privateDictData = writeCFFPrivateDict(privateDicts.front(), privateDictSize);
+        setPrivate(privateEntry, privateDictSize, offset);
+        data.append(privateDictData);
+    }
+
+    QByteArray result = fontProgram.left(headerSize);
+    result.append(fontProgram.mid(nameIndex.offset, nameIndex.size));
+    result.append(writeCFFIndex({ writeCFFDict(topDict) }));
+    result.append(fontProgram.mid(stringIndex.offset, stringIndex.size));
+    result.append(fontProgram.mid(globalSubrIndex.offset, globalSubrIndex.size));
+    result.append(data);
+    return result;
+}
+
+}   // namespace pdf
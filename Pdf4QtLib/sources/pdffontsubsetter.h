@@ -0,0 +1,88 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef PDFFONTSUBSETTER_H
+#define PDFFONTSUBSETTER_H
+
+#include "pdfglobal.h"
+#include "pdffont.h"
+
+#include <QByteArray>
+
+#include <set>
+
+namespace pdf
+{
+
+/// Creates subsets of TrueType font programs (embedded as FontFile2 streams).
+/// CFF font programs are subsetted by PDFCFFFontSubsetter.
+/// Glyph indices are preserved, outlines of glyphs, which are not used, are
+/// removed from the glyf table, so cmap, hmtx and CIDToGIDMap of the font
+/// remain valid. Tables, which are not needed for rendering of the font
+/// in the PDF document (for example, OpenType layout tables), are removed.
+class PDF4QTLIBSHARED_EXPORT PDFTrueTypeFontSubsetter
+{
+public:
+    explicit PDFTrueTypeFontSubsetter() = delete;
+
+    /// Creates subset of the TrueType font program. Glyph with index 0 (.notdef)
+    /// and components of the composite glyphs are always kept. If font program
+    /// is invalid, or it is not a TrueType font program, exception is thrown.
+    /// \param fontProgram TrueType font program
+    /// \param glyphs Glyph indices, which are used
+    static QByteArray createSubset(const QByteArray& fontProgram, const std::set<GID>& glyphs);
+
+    /// Creates subset tag (six uppercase letters) from the subset font program.
+    /// Different subsets get different tags (with high probability).
+    /// \param subset Subset font program
+    static QByteArray createSubsetTag(const QByteArray& subset);
+
+    /// Returns font name of the subset font, i.e. font name prefixed by the tag
+    /// and plus sign (for example, ABCDEF+Arial), as required by PDF specification.
+    /// If font name already has a subset tag, it is replaced.
+    /// \param fontName Font name
+    /// \param tag Subset tag
+    static QByteArray getSubsetFontName(const QByteArray& fontName, const QByteArray& tag);
+};
+
+/// Creates subsets of bare CFF font programs (embedded as FontFile3 streams
+/// with subtype Type1C or CIDFontType0C). Type 1 font programs (FontFile) and
+/// OpenType font programs are not subsetted. Glyph indices are preserved, charstrings
+/// of glyphs, which are not used, are replaced by empty charstrings, so charset,
+/// encoding and FDSelect of the font remain valid. Subroutines are kept.
+class PDF4QTLIBSHARED_EXPORT PDFCFFFontSubsetter
+{
+public:
+    explicit PDFCFFFontSubsetter() = delete;
+
+    /// Returns true, if font program is a bare CFF font program
+    /// \param fontProgram Font program
+    static bool isCFFFontProgram(const QByteArray& fontProgram);
+
+    /// Creates subset of the CFF font program. Glyph with index 0 (.notdef)
+    /// and components of the accented glyphs are always kept. Glyphs of
+    /// CID-keyed fonts are CIDs (glyph indices of these fonts are interpreted
+    /// as CIDs), glyphs of other fonts are glyph indices. If font program
+    /// is invalid, or it is not a CFF font program, exception is thrown.
+    /// \param fontProgram CFF font program
+    /// \param glyphs Glyph indices (or CIDs), which are used
+    static QByteArray createSubset(const QByteArray& fontProgram, const std::set<GID>& glyphs);
+};
+
+}   // namespace pdf
+
+#endif // PDFFONTSUBSETTER_H
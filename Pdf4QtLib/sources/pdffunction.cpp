@@ -1678,25 +1678,25 @@ PDFPostScriptFunction::Program PDFPostScriptFunction::parseProgram(const QByteAr
         {
             case PDFLexicalAnalyzer::TokenType::Boolean:
             {
-                result.emplace_back(OperandObject::createBoolean(token.data.toBool()), result.size() + 1);
+                result.emplace_back(OperandObject::createBoolean(token.getBool()), result.size() + 1);
                 break;
             }
 
             case PDFLexicalAnalyzer::TokenType::Integer:
             {
-                result.emplace_back(OperandObject::createInteger(token.data.toLongLong()), result.size() + 1);
+                result.emplace_back(OperandObject::createInteger(token.getInteger()), result.size() + 1);
                 break;
             }
 
             case PDFLexicalAnalyzer::TokenType::Real:
             {
-                result.emplace_back(OperandObject::createReal(token.data.toDouble()), result.size() + 1);
+                result.emplace_back(OperandObject::createReal(token.getReal()), result.size() + 1);
                 break;
             }
 
             case PDFLexicalAnalyzer::TokenType::Command:
             {
-                QByteArray command = token.data.toByteArray();
+                QByteArray command = token.getString();
                 if (command == "{")
                 {
                     // Opening bracket - means start of block
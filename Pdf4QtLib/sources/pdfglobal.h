@@ -123,6 +123,12 @@ struct PDFObjectReference
     constexpr bool isValid() const { return objectNumber > 0; }
 };
 
+/// Hash function for object reference, so it can be used as a key in Qt containers
+inline size_t qHash(const PDFObjectReference& reference, size_t seed = 0)
+{
+    return qHashMulti(seed, reference.objectNumber, reference.generation);
+}
+
 /// Represents version identification
 struct PDFVersion
 {
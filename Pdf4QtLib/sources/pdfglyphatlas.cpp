@@ -0,0 +1,334 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pdfglyphatlas.h"
+#include "pdfdbgheap.h"
+
+#include <QPainter>
+#include <QPaintDevice>
+
+#include <cmath>
+
+namespace pdf
+{
+
+PDFAtlasGlyphId PDFAtlasGlyphId::create(const QPainterPath& outline)
+{
+    PDFAtlasGlyphId id;
+
+    // Calculate FNV-1a hash of the outline elements
+    quint64 hash = 14695981039346656037ULL;
+    auto addToHash = [&hash](const void* data, size_t size)
+    {
+        const uchar* bytes = static_cast<const uchar*>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    const int fillRule = outline.fillRule();
+    addToHash(&fillRule, sizeof(fillRule));
+
+    for (int i = 0, count = outline.elementCount(); i < count; ++i)
+    {
+        const QPainterPath::Element& element = outline.elementAt(i);
+        const int type = element.type;
+        addToHash(&type, sizeof(type));
+        addToHash(&element.x, sizeof(element.x));
+        addToHash(&element.y, sizeof(element.y));
+    }
+
+    id.hash = hash;
+    id.elementCount = outline.elementCount();
+    id.bounds = outline.controlPointRect();
+    return id;
+}
+
+PDFAtlasGlyph PDFAtlasGlyph::create(QPainterPath outline, QTransform matrix, PDFReal fontSize, PDFAtlasGlyphId id)
+{
+    PDFAtlasGlyph glyph;
+    glyph.outline = qMove(outline);
+    glyph.matrix = qMove(matrix);
+    glyph.fontSize = fontSize;
+    glyph.id = qMove(id);
+    return glyph;
+}
+
+PDFGlyphAtlas* PDFGlyphAtlas::getInstance()
+{
+    static PDFGlyphAtlas instance;
+    return &instance;
+}
+
+bool PDFGlyphAtlas::drawGlyph(QPainter* painter, const PDFAtlasGlyph& glyph, QColor color, bool antialiasing)
+{
+    if (glyph.fontSize <= 0.0)
+    {
+        return false;
+    }
+
+    const PDFReal devicePixelRatio = painter->device() ? painter->device()->devicePixelRatioF() : 1.0;
+    const QTransform deviceMatrix = glyph.matrix * painter->worldTransform() * QTransform::fromScale(devicePixelRatio, devicePixelRatio);
+
+    if (deviceMatrix.type() > QTransform::TxScale)
+    {
+        // Rotated, skewed or projected glyphs are drawn as vector paths
+        return false;
+    }
+
+    const PDFReal emSizeX = deviceMatrix.m11() * glyph.fontSize;
+    const PDFReal emSizeY = deviceMatrix.m22() * glyph.fontSize;
+    if (qAbs(emSizeX) > MAX_GLYPH_SIZE || qAbs(emSizeY) > MAX_GLYPH_SIZE)
+    {
+        return false;
+    }
+
+    Key key;
+    key.hash = glyph.id.hash;
+    key.sizeX = qRound(emSizeX * SIZE_BUCKETS_PER_PIXEL);
+    key.sizeY = qRound(emSizeY * SIZE_BUCKETS_PER_PIXEL);
+    key.antialiasing = antialiasing;
+
+    if (key.sizeX == 0 || key.sizeY == 0)
+    {
+        return false;
+    }
+
+    // Glyph origin is snapped to the pixel grid, fractional part
+    // of the position is stored in the subpixel position.
+    const QPointF origin = deviceMatrix.map(QPointF(0.0, 0.0));
+    const PDFReal originX = std::floor(origin.x());
+    const PDFReal originY = std::floor(origin.y());
+    key.subpixelX = qBound(0, int((origin.x() - originX) * SUBPIXEL_POSITIONS), SUBPIXEL_POSITIONS - 1);
+    key.subpixelY = qBound(0, int((origin.y() - originY) * SUBPIXEL_POSITIONS), SUBPIXEL_POSITIONS - 1);
+
+    QImage mask;
+    QPoint offset;
+    Shard& shard = getShard(key);
+
+    {
+        QMutexLocker lock(&shard.mutex);
+
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end() && it->second.id == glyph.id)
+        {
+            // Mark the entry as most recently used
+            shard.lruList.splice(shard.lruList.begin(), shard.lruList, it->second.lruIterator);
+            mask = it->second.mask;
+            offset = it->second.offset;
+        }
+    }
+
+    if (mask.isNull())
+    {
+        mask = renderGlyphMask(glyph, key, offset);
+
+        if (mask.isNull())
+        {
+            return false;
+        }
+
+        const qint64 size = mask.sizeInBytes() + sizeof(Entry) + sizeof(Key);
+
+        // If other glyph with the same hash is already in the cache,
+        // then glyph is drawn, but the cache entry is kept.
+        bool isCacheLimitExceeded = false;
+        {
+            QMutexLocker lock(&shard.mutex);
+            const qint64 cacheLimit = m_cacheLimit.load(std::memory_order_relaxed);
+            if (!shard.entries.count(key) && size <= cacheLimit)
+            {
+                shard.lruList.push_front(key);
+
+                Entry entry;
+                entry.mask = mask;
+                entry.offset = offset;
+                entry.id = glyph.id;
+                entry.size = size;
+                entry.lruIterator = shard.lruList.begin();
+                shard.entries.emplace(key, qMove(entry));
+
+                // Make space in this shard first, so other shards are not locked in most cases
+                m_cacheSize.fetch_add(size, std::memory_order_relaxed);
+                while (m_cacheSize.load(std::memory_order_relaxed) > cacheLimit && shard.lruList.size() > 1)
+                {
+                    removeLeastRecentlyUsed(shard);
+                }
+
+                isCacheLimitExceeded = m_cacheSize.load(std::memory_order_relaxed) > cacheLimit;
+            }
+        }
+
+        if (isCacheLimitExceeded)
+        {
+            shrink();
+        }
+    }
+
+    const QImage& image = tintGlyphMask(mask, color);
+
+    // Draw the image in device pixels
+    const QRectF targetRect((originX + offset.x()) / devicePixelRatio,
+                            (originY + offset.y()) / devicePixelRatio,
+                            mask.width() / devicePixelRatio,
+                            mask.height() / devicePixelRatio);
+
+    const QTransform worldTransform = painter->worldTransform();
+    painter->setWorldTransform(QTransform());
+    painter->drawImage(targetRect, image, QRectF(0, 0, mask.width(), mask.height()));
+    painter->setWorldTransform(worldTransform);
+
+    return true;
+}
+
+void PDFGlyphAtlas::setCacheLimit(qint64 cacheLimit)
+{
+    m_cacheLimit.store(cacheLimit, std::memory_order_relaxed);
+    shrink();
+}
+
+qint64 PDFGlyphAtlas::getCacheSize() const
+{
+    return m_cacheSize.load(std::memory_order_relaxed);
+}
+
+void PDFGlyphAtlas::clear()
+{
+    for (Shard& shard : m_shards)
+    {
+        QMutexLocker lock(&shard.mutex);
+        while (!shard.lruList.empty())
+        {
+            removeLeastRecentlyUsed(shard);
+        }
+    }
+}
+
+QImage PDFGlyphAtlas::renderGlyphMask(const PDFAtlasGlyph& glyph, const Key& key, QPoint& offset)
+{
+    // Glyph is rendered with the size of the size bucket, and it is placed
+    // in the center of its subpixel position.
+    const PDFReal scaleX = key.sizeX / (glyph.fontSize * SIZE_BUCKETS_PER_PIXEL);
+    const PDFReal scaleY = key.sizeY / (glyph.fontSize * SIZE_BUCKETS_PER_PIXEL);
+    const PDFReal subpixelX = (key.subpixelX + 0.5) / SUBPIXEL_POSITIONS;
+    const PDFReal subpixelY = (key.subpixelY + 0.5) / SUBPIXEL_POSITIONS;
+
+    const QPainterPath path = QTransform(scaleX, 0.0, 0.0, scaleY, subpixelX, subpixelY).map(glyph.outline);
+    const QRect bounds = path.boundingRect().toAlignedRect().adjusted(-1, -1, 1, 1);
+
+    if (bounds.isEmpty())
+    {
+        return QImage();
+    }
+
+    QImage image(bounds.size(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing, key.antialiasing);
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(Qt::black);
+    painter.translate(-bounds.topLeft());
+    painter.drawPath(path);
+    painter.end();
+
+    offset = bounds.topLeft();
+    return image.convertToFormat(QImage::Format_Alpha8);
+}
+
+const QImage& PDFGlyphAtlas::tintGlyphMask(const QImage& mask, QColor color)
+{
+    // Image is allocated only, when it is too small for the glyph
+    thread_local QImage image;
+    if (image.width() < mask.width() || image.height() < mask.height())
+    {
+        image = QImage(qMax(image.width(), mask.width()), qMax(image.height(), mask.height()), QImage::Format_ARGB32_Premultiplied);
+    }
+
+    const QRgb premultipliedColor = qPremultiply(color.rgba());
+    const uint red = qRed(premultipliedColor);
+    const uint green = qGreen(premultipliedColor);
+    const uint blue = qBlue(premultipliedColor);
+    const uint alpha = qAlpha(premultipliedColor);
+
+    for (int y = 0; y < mask.height(); ++y)
+    {
+        const uchar* coverageLine = mask.constScanLine(y);
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+
+        for (int x = 0; x < mask.width(); ++x)
+        {
+            const uint coverage = coverageLine[x];
+            switch (coverage)
+            {
+                case 0:
+                    line[x] = 0;
+                    break;
+
+                case 255:
+                    line[x] = premultipliedColor;
+                    break;
+
+                default:
+                    line[x] = qRgba((red * coverage + 127) / 255, (green * coverage + 127) / 255, (blue * coverage + 127) / 255, (alpha * coverage + 127) / 255);
+                    break;
+            }
+        }
+    }
+
+    return image;
+}
+
+void PDFGlyphAtlas::removeLeastRecentlyUsed(Shard& shard)
+{
+    auto it = shard.entries.find(shard.lruList.back());
+    Q_ASSERT(it != shard.entries.end());
+
+    m_cacheSize.fetch_sub(it->second.size, std::memory_order_relaxed);
+    shard.entries.erase(it);
+    shard.lruList.pop_back();
+}
+
+void PDFGlyphAtlas::shrink()
+{
+    // Least recently used entries are removed from the shards in round robin
+    // fashion, so glyphs are removed from all shards evenly. Only one shard
+    // is locked at a time.
+    bool isRemoved = true;
+    while (isRemoved && m_cacheSize.load(std::memory_order_relaxed) > m_cacheLimit.load(std::memory_order_relaxed))
+    {
+        isRemoved = false;
+        for (Shard& shard : m_shards)
+        {
+            QMutexLocker lock(&shard.mutex);
+            if (m_cacheSize.load(std::memory_order_relaxed) <= m_cacheLimit.load(std::memory_order_relaxed))
+            {
+                break;
+            }
+
+            if (!shard.lruList.empty())
+            {
+                removeLeastRecentlyUsed(shard);
+                isRemoved = true;
+            }
+        }
+    }
+}
+
+}   // namespace pdf
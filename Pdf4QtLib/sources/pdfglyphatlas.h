@@ -0,0 +1,187 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef PDFGLYPHATLAS_H
+#define PDFGLYPHATLAS_H
+
+#include "pdfglobal.h"
+
+#include <QImage>
+#include <QColor>
+#include <QMutex>
+#include <QTransform>
+#include <QPainterPath>
+
+#include <map>
+#include <list>
+#include <tuple>
+#include <atomic>
+
+class QPainter;
+
+namespace pdf
+{
+
+/// Identification of the glyph outline in the glyph atlas. It is calculated
+/// once per glyph, when glyph is inserted into the realized font glyph cache.
+struct PDF4QTLIBSHARED_EXPORT PDFAtlasGlyphId
+{
+    /// Calculates hash, element count and bounds of the glyph outline
+    /// \param outline Glyph outline
+    static PDFAtlasGlyphId create(const QPainterPath& outline);
+
+    bool operator==(const PDFAtlasGlyphId&) const = default;
+
+    quint64 hash = 0;       ///< Hash of the glyph outline
+    int elementCount = 0;   ///< Element count of the glyph outline
+    QRectF bounds;          ///< Bounding rectangle of the glyph outline
+};
+
+/// Glyph of the text, which can be drawn using the glyph atlas
+struct PDF4QTLIBSHARED_EXPORT PDFAtlasGlyph
+{
+    /// Creates glyph
+    /// \param outline Glyph outline in the text space (scaled by font size)
+    /// \param matrix Matrix mapping glyph outline to the user space
+    /// \param fontSize Font size
+    /// \param id Identification of the glyph outline
+    static PDFAtlasGlyph create(QPainterPath outline, QTransform matrix, PDFReal fontSize, PDFAtlasGlyphId id);
+
+    QPainterPath outline;   ///< Glyph outline in the text space (scaled by font size)
+    QTransform matrix;      ///< Matrix mapping glyph outline to the user space
+    PDFReal fontSize = 0.0;
+    PDFAtlasGlyphId id;     ///< Identification of the glyph outline
+};
+
+/// Atlas of rasterized glyphs. Filling of many small glyph outlines by painter's
+/// path rasterizer is slow, so small text is drawn using glyph bitmaps instead.
+/// Coverage mask of each glyph is rasterized once for each size bucket and subpixel
+/// position, and then it is tinted by the fill color and blitted onto the painter.
+/// Glyphs are identified by hash of their outline, so atlas can be shared between
+/// documents. Element count and bounds of the outline are compared on a cache hit,
+/// so hash collision doesn't draw wrong glyph. Large text, and text, which is rotated
+/// or skewed, is not drawn by the atlas. When cache limit is exceeded, least recently
+/// used glyphs are removed. Atlas is thread safe, glyphs are distributed into shards
+/// with their own locks, so threads drawing pages in parallel don't block each other.
+class PDF4QTLIBSHARED_EXPORT PDFGlyphAtlas
+{
+public:
+    static constexpr qint64 DEFAULT_CACHE_LIMIT = 32 * 1024 * 1024;
+
+    /// Text with larger em size (in device pixels) is drawn as vector paths
+    static constexpr PDFReal MAX_GLYPH_SIZE = 48.0;
+
+    explicit PDFGlyphAtlas(qint64 cacheLimit = DEFAULT_CACHE_LIMIT) :
+        m_cacheLimit(cacheLimit),
+        m_cacheSize(0)
+    {
+
+    }
+
+    /// Returns global instance of the glyph atlas
+    static PDFGlyphAtlas* getInstance();
+
+    /// Draws glyph using the atlas. If glyph can't be drawn using the atlas
+    /// (for example, it is too large, or it is rotated), then false is returned
+    /// and nothing is drawn, glyph should be drawn as vector path.
+    /// \param painter Painter
+    /// \param glyph Glyph
+    /// \param color Fill color of the glyph
+    /// \param antialiasing Use antialiasing
+    bool drawGlyph(QPainter* painter, const PDFAtlasGlyph& glyph, QColor color, bool antialiasing);
+
+    /// Sets cache limit in bytes. If cache exceeds the limit, it is shrinked.
+    /// \param cacheLimit Cache limit in bytes
+    void setCacheLimit(qint64 cacheLimit);
+
+    /// Returns size of the rasterized glyphs in bytes
+    qint64 getCacheSize() const;
+
+    /// Removes all glyphs from the atlas
+    void clear();
+
+private:
+    static constexpr int SIZE_BUCKETS_PER_PIXEL = 4;
+    static constexpr int SUBPIXEL_POSITIONS = 4;
+    static constexpr int SHARD_COUNT = 16;
+
+    struct Key
+    {
+        bool operator<(const Key& other) const
+        {
+            return std::tie(hash, sizeX, sizeY, subpixelX, subpixelY, antialiasing) <
+                   std::tie(other.hash, other.sizeX, other.sizeY, other.subpixelX, other.subpixelY, other.antialiasing);
+        }
+
+        quint64 hash = 0;       ///< Hash of the glyph outline
+        int sizeX = 0;          ///< Horizontal em size bucket
+        int sizeY = 0;          ///< Vertical em size bucket
+        int subpixelX = 0;
+        int subpixelY = 0;
+        bool antialiasing = true;
+    };
+
+    struct Entry
+    {
+        QImage mask;    ///< Coverage mask of the glyph (alpha only)
+        QPoint offset;  ///< Offset of the image from the glyph origin
+        PDFAtlasGlyphId id;
+        qint64 size = 0;
+        std::list<Key>::iterator lruIterator;
+    };
+
+    /// Part of the atlas with its own lock. Least recently used
+    /// order of the glyphs is maintained separately in each shard.
+    struct Shard
+    {
+        QMutex mutex;
+        std::map<Key, Entry> entries;
+
+        /// Most recently used glyphs are at the front of the list
+        std::list<Key> lruList;
+    };
+
+    /// Rasterizes coverage mask of the glyph
+    /// \param glyph Glyph
+    /// \param key Key of the glyph
+    /// \param offset Offset of the image from the glyph origin
+    static QImage renderGlyphMask(const PDFAtlasGlyph& glyph, const Key& key, QPoint& offset);
+
+    /// Fills the image by the color using coverage mask of the glyph. Image
+    /// is reused between calls, so it must not be stored by the caller.
+    /// \param mask Coverage mask of the glyph
+    /// \param color Fill color
+    static const QImage& tintGlyphMask(const QImage& mask, QColor color);
+
+    /// Returns shard, in which glyph with given key is stored
+    Shard& getShard(const Key& key) { return m_shards[(key.hash ^ (key.hash >> 32)) % SHARD_COUNT]; }
+
+    /// Removes least recently used entry of the shard. Shard must be locked.
+    void removeLeastRecentlyUsed(Shard& shard);
+
+    /// Removes least recently used entries of all shards, until cache limit
+    /// is satisfied. Shards must not be locked by the calling thread.
+    void shrink();
+
+    std::atomic<qint64> m_cacheLimit;
+    std::atomic<qint64> m_cacheSize;
+    Shard m_shards[SHARD_COUNT];
+};
+
+}   // namespace pdf
+
+#endif // PDFGLYPHATLAS_H
@@ -66,12 +66,16 @@ public:
     /// \param isSoftMask Is it a soft mask image?
     /// \param renderingIntent Default rendering intent of the image
     /// \param errorReporter Error reporter for reporting errors (or warnings)
+    /// \param reduceLevel Image is decoded with size reduced by factor 2^reduceLevel,
+    ///        if decoder supports it (JPEG and JPEG 2000 images), otherwise full
+    ///        resolution image is decoded.
     static PDFImage createImage(const PDFDocument* document,
                                 const PDFStream* stream,
                                 PDFColorSpacePointer colorSpace,
                                 bool isSoftMask,
                                 RenderingIntent renderingIntent,
-                                PDFRenderErrorReporter* errorReporter);
+                                PDFRenderErrorReporter* errorReporter,
+                                int reduceLevel = 0);
 
     /// Returns image transformed from image data and color space
     QImage getImage(const PDFCMS* cms,
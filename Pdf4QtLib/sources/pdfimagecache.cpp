@@ -0,0 +1,231 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pdfimagecache.h"
+#include "pdfdbgheap.h"
+
+#include <QLineF>
+#include <QTransform>
+
+#include <limits>
+
+namespace pdf
+{
+
+PDFImagePyramid PDFImagePyramid::create(QImage image, bool isReduced)
+{
+    PDFImagePyramid pyramid;
+
+    if (image.isNull())
+    {
+        return pyramid;
+    }
+
+    pyramid.m_isReduced = isReduced;
+
+    // Convert the image into format Format_ARGB32_Premultiplied for fast drawing.
+    // If this format is used, then no image conversion is performed while drawing.
+    if (image.format() != QImage::Format_ARGB32_Premultiplied)
+    {
+        image.convertTo(QImage::Format_ARGB32_Premultiplied);
+    }
+
+    pyramid.m_levels.push_back(image);
+
+    while (qMax(image.width(), image.height()) > MIN_LEVEL_SIZE)
+    {
+        const int width = qMax(image.width() / 2, 1);
+        const int height = qMax(image.height() / 2, 1);
+
+        image = image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+        if (image.format() != QImage::Format_ARGB32_Premultiplied)
+        {
+            image.convertTo(QImage::Format_ARGB32_Premultiplied);
+        }
+
+        pyramid.m_levels.push_back(image);
+    }
+
+    return pyramid;
+}
+
+int PDFImagePyramid::getReduceLevel(QSize imageSize, const QTransform& matrix)
+{
+    const qreal width = QLineF(matrix.map(QPointF(0.0, 0.0)), matrix.map(QPointF(1.0, 0.0))).length();
+    const qreal height = QLineF(matrix.map(QPointF(0.0, 0.0)), matrix.map(QPointF(0.0, 1.0))).length();
+
+    int level = 0;
+    while (level < MAX_REDUCE_LEVEL &&
+           qMax(imageSize.width(), imageSize.height()) > MIN_LEVEL_SIZE &&
+           imageSize.width() / 2 >= width &&
+           imageSize.height() / 2 >= height)
+    {
+        imageSize /= 2;
+        ++level;
+    }
+
+    return level;
+}
+
+PDFReal PDFImagePyramid::getResolutionLimit(const QTransform& matrix) const
+{
+    if (!m_isReduced || m_levels.empty())
+    {
+        return std::numeric_limits<PDFReal>::infinity();
+    }
+
+    const qreal width = QLineF(matrix.map(QPointF(0.0, 0.0)), matrix.map(QPointF(1.0, 0.0))).length();
+    const qreal height = QLineF(matrix.map(QPointF(0.0, 0.0)), matrix.map(QPointF(0.0, 1.0))).length();
+
+    PDFReal limit = std::numeric_limits<PDFReal>::infinity();
+    if (!qFuzzyIsNull(width))
+    {
+        limit = qMin(limit, m_levels.front().width() / width);
+    }
+    if (!qFuzzyIsNull(height))
+    {
+        limit = qMin(limit, m_levels.front().height() / height);
+    }
+
+    return limit;
+}
+
+const QImage& PDFImagePyramid::getImage() const
+{
+    static const QImage dummy;
+    return !m_levels.empty() ? m_levels.front() : dummy;
+}
+
+const QImage& PDFImagePyramid::getImage(const QTransform& matrix) const
+{
+    const qreal width = QLineF(matrix.map(QPointF(0.0, 0.0)), matrix.map(QPointF(1.0, 0.0))).length();
+    const qreal height = QLineF(matrix.map(QPointF(0.0, 0.0)), matrix.map(QPointF(0.0, 1.0))).length();
+
+    // Levels are sorted from the largest one to the smallest one
+    for (auto it = m_levels.rbegin(); it != m_levels.rend(); ++it)
+    {
+        if (it->width() >= width && it->height() >= height)
+        {
+            return *it;
+        }
+    }
+
+    return getImage();
+}
+
+void PDFImagePyramid::invertColors()
+{
+    for (QImage& image : m_levels)
+    {
+        image.invertPixels(QImage::InvertRgb);
+    }
+}
+
+qint64 PDFImagePyramid::getMemoryConsumptionEstimate() const
+{
+    qint64 memoryConsumption = sizeof(*this) + sizeof(QImage) * m_levels.capacity();
+
+    for (const QImage& image : m_levels)
+    {
+        memoryConsumption += image.sizeInBytes();
+    }
+
+    return memoryConsumption;
+}
+
+PDFImagePyramid PDFImageCache::getImage(const Key& key, const PDFStream* stream)
+{
+    QMutexLocker lock(&m_mutex);
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end() && it->second.stream == stream)
+    {
+        // Mark the entry as most recently used
+        m_lruList.splice(m_lruList.begin(), m_lruList, it->second.lruIterator);
+        return it->second.imagePyramid;
+    }
+
+    return PDFImagePyramid();
+}
+
+void PDFImageCache::insert(const Key& key, const PDFStream* stream, PDFImagePyramid imagePyramid)
+{
+    const qint64 size = imagePyramid.getMemoryConsumptionEstimate();
+
+    QMutexLocker lock(&m_mutex);
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end())
+    {
+        // Image was decoded meanwhile in another thread, or entry is obsolete
+        m_cacheSize -= it->second.size;
+        m_lruList.erase(it->second.lruIterator);
+        m_entries.erase(it);
+    }
+
+    if (size <= m_cacheLimit)
+    {
+        m_lruList.push_front(key);
+
+        Entry entry;
+        entry.imagePyramid = qMove(imagePyramid);
+        entry.stream = stream;
+        entry.size = size;
+        entry.lruIterator = m_lruList.begin();
+        m_entries.emplace(key, qMove(entry));
+        m_cacheSize += size;
+
+        shrink();
+    }
+}
+
+void PDFImageCache::setCacheLimit(qint64 cacheLimit)
+{
+    QMutexLocker lock(&m_mutex);
+    m_cacheLimit = cacheLimit;
+    shrink();
+}
+
+qint64 PDFImageCache::getCacheSize() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_cacheSize;
+}
+
+void PDFImageCache::clear()
+{
+    QMutexLocker lock(&m_mutex);
+    m_entries.clear();
+    m_lruList.clear();
+    m_cacheSize = 0;
+}
+
+void PDFImageCache::shrink()
+{
+    while (m_cacheSize > m_cacheLimit && !m_lruList.empty())
+    {
+        auto it = m_entries.find(m_lruList.back());
+        Q_ASSERT(it != m_entries.end());
+
+        m_cacheSize -= it->second.size;
+        m_entries.erase(it);
+        m_lruList.pop_back();
+    }
+}
+
+}   // namespace pdf
@@ -0,0 +1,184 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef PDFIMAGECACHE_H
+#define PDFIMAGECACHE_H
+
+#include "pdfglobal.h"
+#include "pdfobject.h"
+
+#include <QImage>
+#include <QMutex>
+
+#include <map>
+#include <list>
+#include <vector>
+#include <tuple>
+
+class QTransform;
+
+namespace pdf
+{
+
+/// Decoded image together with its downsampled versions (mip levels). Each mip level
+/// has half the size of the previous one. When image is drawn smaller than its
+/// resolution (for example, 600 dpi scan displayed as a thumbnail), then the
+/// smallest sufficient mip level is used instead of the full resolution image.
+/// If image was decoded with reduced resolution (JPEG and JPEG 2000 decoders
+/// can do it much faster, than decoding of the full image), then the largest
+/// level is smaller than the original image.
+/// Images are stored in format Format_ARGB32_Premultiplied, so no conversion
+/// is performed while drawing. Images are implicitly shared, so copying
+/// of the pyramid is cheap.
+class PDF4QTLIBSHARED_EXPORT PDFImagePyramid
+{
+public:
+    explicit inline PDFImagePyramid() = default;
+
+    /// Creates image pyramid from the decoded image
+    /// \param image Decoded image
+    /// \param isReduced Image was decoded with lower resolution than the original image
+    static PDFImagePyramid create(QImage image, bool isReduced = false);
+
+    /// Returns reduce level of the image (so image is decoded with size reduced
+    /// by factor 2^level), which is still sufficient for drawing of the image
+    /// using given matrix. Matrix maps unit square of the image to the device pixels.
+    /// \param imageSize Size of the full resolution image
+    /// \param matrix Matrix mapping unit square to the device pixels
+    static int getReduceLevel(QSize imageSize, const QTransform& matrix);
+
+    /// Returns true, if pyramid doesn't contain any image
+    bool isEmpty() const { return m_levels.empty(); }
+
+    /// Returns true, if image was decoded with lower resolution than the original image
+    bool isReduced() const { return m_isReduced; }
+
+    /// Returns largest decoded image
+    const QImage& getImage() const;
+
+    /// Returns smallest image, which is at least as large as the image
+    /// mapped by the given matrix. Matrix maps unit square of the image
+    /// to the device pixels.
+    /// \param matrix Matrix mapping unit square to the device pixels
+    const QImage& getImage(const QTransform& matrix) const;
+
+    /// Returns maximal scale factor s, for which the largest decoded image is
+    /// sufficient for drawing using matrix (matrix * scale(s, s)). If image
+    /// is not reduced, then it is always sufficient and infinity is returned.
+    /// \param matrix Matrix mapping unit square to the device pixels
+    PDFReal getResolutionLimit(const QTransform& matrix) const;
+
+    /// Returns all images, the first one is the largest decoded image
+    const std::vector<QImage>& getLevels() const { return m_levels; }
+
+    /// Inverts colors of all images
+    void invertColors();
+
+    /// Returns estimate of memory consumption in bytes
+    qint64 getMemoryConsumptionEstimate() const;
+
+private:
+    /// Images smaller than this size are not downsampled
+    static constexpr int MIN_LEVEL_SIZE = 64;
+
+    /// Maximal reduce level of decoded image
+    static constexpr int MAX_REDUCE_LEVEL = 5;
+
+    std::vector<QImage> m_levels;
+    bool m_isReduced = false;
+};
+
+/// Cache of decoded images of the document. Decoding of the image (including color
+/// conversion) is expensive, and the same image is often used on many pages (logos,
+/// backgrounds) or the page is compiled repeatedly. Images are identified by reference
+/// of the image stream together with the color management settings, which
+/// were used to convert them. Cache is byte budgeted, if the cache limit
+/// is exceeded, least recently used images are removed from the cache.
+/// Cache is thread safe.
+class PDF4QTLIBSHARED_EXPORT PDFImageCache
+{
+public:
+    static constexpr qint64 DEFAULT_CACHE_LIMIT = 256 * 1024 * 1024;
+
+    explicit PDFImageCache(qint64 cacheLimit = DEFAULT_CACHE_LIMIT) :
+        m_cacheLimit(cacheLimit)
+    {
+
+    }
+
+    struct Key
+    {
+        bool operator<(const Key& other) const
+        {
+            return std::tie(reference, cmsIdentifier, renderingIntent, defaultColorSpaces) <
+                   std::tie(other.reference, other.cmsIdentifier, other.renderingIntent, other.defaultColorSpaces);
+        }
+
+        PDFObjectReference reference;   ///< Reference to the image stream
+        quint64 cmsIdentifier = 0;      ///< Identifier of color management system (see PDFCMS::getIdentifier)
+        RenderingIntent renderingIntent = RenderingIntent::Perceptual;
+        const void* defaultColorSpaces = nullptr; ///< Color space dictionary, if it redefines default color spaces
+    };
+
+    /// Returns cached image pyramid. If image is not found in the cache,
+    /// then empty pyramid is returned. Cached image may have been decoded
+    /// with reduced resolution, caller must check, if it is sufficient.
+    /// \param key Key of the image
+    /// \param stream Image stream
+    PDFImagePyramid getImage(const Key& key, const PDFStream* stream);
+
+    /// Inserts image pyramid into the cache, old image is replaced. If image
+    /// is too large to be stored in the cache, it is not inserted.
+    /// \param key Key of the image
+    /// \param stream Image stream
+    /// \param imagePyramid Image pyramid
+    void insert(const Key& key, const PDFStream* stream, PDFImagePyramid imagePyramid);
+
+    /// Sets cache limit in bytes. If cache exceeds the limit, it is shrinked.
+    /// \param cacheLimit Cache limit in bytes
+    void setCacheLimit(qint64 cacheLimit);
+
+    /// Returns size of the cached images in bytes
+    qint64 getCacheSize() const;
+
+    /// Removes all images from the cache
+    void clear();
+
+private:
+    struct Entry
+    {
+        PDFImagePyramid imagePyramid;
+        const PDFStream* stream = nullptr;
+        qint64 size = 0;
+        std::list<Key>::iterator lruIterator;
+    };
+
+    /// Removes least recently used entries, until cache limit is satisfied
+    void shrink();
+
+    mutable QMutex m_mutex;
+    qint64 m_cacheLimit;
+    qint64 m_cacheSize = 0;
+    std::map<Key, Entry> m_entries;
+
+    /// Most recently used images are at the front of the list
+    std::list<Key> m_lruList;
+};
+
+}   // namespace pdf
+
+#endif // PDFIMAGECACHE_H
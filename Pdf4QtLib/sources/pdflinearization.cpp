@@ -0,0 +1,498 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pdflinearization.h"
+#include "pdfexception.h"
+#include "pdfutils.h"
+#include "pdfdbgheap.h"
+
+#include <algorithm>
+
+namespace pdf
+{
+
+/// Maximal number of bits of the value in the hint table
+static constexpr const uint16_t PDF_HINT_TABLE_MAX_BITS = 32;
+
+PDFLinearizationDictionary PDFLinearizationDictionary::parse(const PDFObject& object)
+{
+    PDFLinearizationDictionary result;
+
+    if (!object.isDictionary())
+    {
+        return result;
+    }
+
+    const PDFDictionary* dictionary = object.getDictionary();
+    const PDFObject& linearizedObject = dictionary->get("Linearized");
+    if (!linearizedObject.isInt() && !linearizedObject.isReal())
+    {
+        return result;
+    }
+
+    auto readInteger = [dictionary](const char* key, PDFInteger defaultValue) -> PDFInteger
+    {
+        const PDFObject& integerObject = dictionary->get(key);
+        return integerObject.isInt() ? integerObject.getInteger() : defaultValue;
+    };
+
+    const PDFObject& hintStreamObject = dictionary->get("H");
+    if (!hintStreamObject.isArray())
+    {
+        return result;
+    }
+
+    std::vector<PDFInteger> hintStreamValues;
+    const PDFArray* hintStreamArray = hintStreamObject.getArray();
+    for (size_t i = 0, count = hintStreamArray->getCount(); i < count; ++i)
+    {
+        const PDFObject& item = hintStreamArray->getItem(i);
+        if (!item.isInt())
+        {
+            return result;
+        }
+        hintStreamValues.push_back(item.getInteger());
+    }
+
+    if (hintStreamValues.size() != 2 && hintStreamValues.size() != 4)
+    {
+        return result;
+    }
+
+    result.m_hintStreamOffset = hintStreamValues[0];
+    result.m_hintStreamLength = hintStreamValues[1];
+    if (hintStreamValues.size() == 4)
+    {
+        result.m_overflowHintStreamOffset = hintStreamValues[2];
+        result.m_overflowHintStreamLength = hintStreamValues[3];
+    }
+
+    result.m_firstPageObjectNumber = readInteger("O", 0);
+    result.m_firstPageEndOffset = readInteger("E", 0);
+    result.m_pageCount = readInteger("N", 0);
+    result.m_mainXRefTableOffset = readInteger("T", 0);
+    result.m_firstPageIndex = readInteger("P", 0);
+
+    // File length is set at last, because it is used as validity flag
+    result.m_fileLength = readInteger("L", 0);
+    return result;
+}
+
+PDFLinearizationInfo PDFLinearizationInfo::parse(const PDFLinearizationDictionary& dictionary,
+                                                 const PDFStream* hintStream,
+                                                 const QByteArray& hintStreamData,
+                                                 PDFInteger objectCount)
+{
+    // Each page has at least one object (the page object itself)
+    if (!dictionary.isValid() || dictionary.getPageCount() > dictionary.getFileLength() || dictionary.getPageCount() > objectCount)
+    {
+        throw PDFException(tr("Invalid linearization dictionary."));
+    }
+
+    // Page numbering of objects described in the hint table assumes, that first
+    // page is the first page of the document. Other layouts are not supported.
+    if (dictionary.getFirstPageIndex() != 0)
+    {
+        throw PDFException(tr("Linearized document with first page %1 is not supported.").arg(dictionary.getFirstPageIndex() + 1));
+    }
+
+    const PDFObject& sharedObjectHintTableOffsetObject = hintStream->getDictionary()->get("S");
+    if (!sharedObjectHintTableOffsetObject.isInt())
+    {
+        throw PDFException(tr("Invalid hint stream - shared object hint table is missing."));
+    }
+
+    PDFLinearizationInfo result;
+    result.m_dictionary = dictionary;
+    result.m_pageOffsetHintTable = readPageOffsetHintTable(hintStreamData, dictionary.getPageCount());
+    result.m_sharedObjectHintTable = readSharedObjectHintTable(hintStreamData, sharedObjectHintTableOffsetObject.getInteger());
+    result.buildObjectRanges();
+    return result;
+}
+
+PDFPageOffsetHintTable PDFLinearizationInfo::readPageOffsetHintTable(const QByteArray& data, PDFInteger pageCount)
+{
+    PDFPageOffsetHintTable table;
+    PDFPageOffsetHintTable::Header& header = table.header;
+
+    PDFBitReader reader(&data, 8);
+
+    auto readBitCount = [&reader]() -> uint16_t
+    {
+        const uint16_t bits = reader.readUnsignedWord();
+        if (bits > PDF_HINT_TABLE_MAX_BITS)
+        {
+            throw PDFException(tr("Invalid hint table - %1-bit values are not supported.").arg(bits));
+        }
+        return bits;
+    };
+
+    header.leastObjectCount = reader.readUnsignedInt();
+    header.firstPageObjectOffset = reader.readUnsignedInt();
+    header.objectCountBits = readBitCount();
+    header.leastPageLength = reader.readUnsignedInt();
+    header.pageLengthBits = readBitCount();
+    header.leastContentStreamOffset = reader.readUnsignedInt();
+    header.contentStreamOffsetBits = readBitCount();
+    header.leastContentStreamLength = reader.readUnsignedInt();
+    header.contentStreamLengthBits = readBitCount();
+    header.sharedObjectCountBits = readBitCount();
+    header.sharedObjectIdentifierBits = readBitCount();
+    header.sharedObjectNumeratorBits = readBitCount();
+    header.sharedObjectDenominator = reader.readUnsignedWord();
+
+    // Page count is taken from the file, so check, that hint table can
+    // contain so many entries, before we allocate them.
+    const PDFInteger bitsPerEntry = PDFInteger(header.objectCountBits) + header.pageLengthBits + header.sharedObjectCountBits +
+                                    header.contentStreamOffsetBits + header.contentStreamLengthBits;
+    const PDFInteger remainingBits = PDFInteger(data.size() - reader.getPosition()) * 8;
+    if (pageCount < 0 || (bitsPerEntry > 0 && pageCount > remainingBits / bitsPerEntry))
+    {
+        throw PDFException(tr("Invalid page offset hint table."));
+    }
+
+    table.entries.resize(pageCount);
+
+    // Items of the per-page entries are grouped - first item of all pages, then
+    // second item of all pages and so on. Each group starts at the byte boundary.
+    auto readItems = [&](auto itemFunction)
+    {
+        for (PDFPageOffsetHintTable::Entry& entry : table.entries)
+        {
+            itemFunction(entry);
+        }
+        reader.alignToBytes();
+    };
+
+    readItems([&](PDFPageOffsetHintTable::Entry& entry) { entry.objectCountDelta = reader.read(header.objectCountBits); });
+    readItems([&](PDFPageOffsetHintTable::Entry& entry) { entry.pageLengthDelta = reader.read(header.pageLengthBits); });
+    readItems([&](PDFPageOffsetHintTable::Entry& entry)
+    {
+        const PDFInteger sharedObjectCount = reader.read(header.sharedObjectCountBits);
+        if (sharedObjectCount > data.size() * 8)
+        {
+            throw PDFException(tr("Invalid page offset hint table."));
+        }
+        entry.sharedObjectIdentifiers.resize(sharedObjectCount);
+    });
+    readItems([&](PDFPageOffsetHintTable::Entry& entry)
+    {
+        for (uint32_t& identifier : entry.sharedObjectIdentifiers)
+        {
+            identifier = reader.read(header.sharedObjectIdentifierBits);
+        }
+    });
+    readItems([&](PDFPageOffsetHintTable::Entry& entry)
+    {
+        entry.sharedObjectNumerators.resize(entry.sharedObjectIdentifiers.size());
+        for (uint32_t& numerator : entry.sharedObjectNumerators)
+        {
+            numerator = reader.read(header.sharedObjectNumeratorBits);
+        }
+    });
+    readItems([&](PDFPageOffsetHintTable::Entry& entry) { entry.contentStreamOffsetDelta = reader.read(header.contentStreamOffsetBits); });
+    readItems([&](PDFPageOffsetHintTable::Entry& entry) { entry.contentStreamLengthDelta = reader.read(header.contentStreamLengthBits); });
+
+    return table;
+}
+
+PDFSharedObjectHintTable PDFLinearizationInfo::readSharedObjectHintTable(const QByteArray& data, PDFInteger offset)
+{
+    PDFSharedObjectHintTable table;
+    PDFSharedObjectHintTable::Header& header = table.header;
+
+    PDFBitReader reader(&data, 8);
+    reader.seek(offset);
+
+    auto readBitCount = [&reader]() -> uint16_t
+    {
+        const uint16_t bits = reader.readUnsignedWord();
+        if (bits > PDF_HINT_TABLE_MAX_BITS)
+        {
+            throw PDFException(tr("Invalid hint table - %1-bit values are not supported.").arg(bits));
+        }
+        return bits;
+    };
+
+    header.firstSharedObjectNumber = reader.readUnsignedInt();
+    header.firstSharedObjectOffset = reader.readUnsignedInt();
+    header.firstPageEntryCount = reader.readUnsignedInt();
+    header.entryCount = reader.readUnsignedInt();
+    header.objectCountBits = readBitCount();
+    header.leastGroupLength = reader.readUnsignedInt();
+    header.groupLengthBits = readBitCount();
+
+    if (header.firstPageEntryCount > header.entryCount || header.entryCount > static_cast<uint32_t>(data.size()) * 8)
+    {
+        throw PDFException(tr("Invalid shared object hint table."));
+    }
+
+    table.entries.resize(header.entryCount);
+
+    for (PDFSharedObjectHintTable::Entry& entry : table.entries)
+    {
+        entry.groupLengthDelta = reader.read(header.groupLengthBits);
+    }
+    reader.alignToBytes();
+
+    // Signatures of the object groups are not used (and they are not
+    // used in practice), so we just skip them.
+    std::vector<bool> signatures;
+    signatures.reserve(table.entries.size());
+    for (size_t i = 0; i < table.entries.size(); ++i)
+    {
+        signatures.push_back(reader.read(1) != 0);
+    }
+    reader.alignToBytes();
+
+    for (bool signature : signatures)
+    {
+        if (signature)
+        {
+            reader.skipBytes(16);
+        }
+    }
+
+    for (PDFSharedObjectHintTable::Entry& entry : table.entries)
+    {
+        entry.objectCountMinusOne = reader.read(header.objectCountBits);
+    }
+    reader.alignToBytes();
+
+    return table;
+}
+
+QByteArray PDFLinearizationInfo::writePageOffsetHintTable(const PDFPageOffsetHintTable& table)
+{
+    const PDFPageOffsetHintTable::Header& header = table.header;
+
+    PDFBitWriter writer(8);
+    writer.write(header.leastObjectCount, 32);
+    writer.write(header.firstPageObjectOffset, 32);
+    writer.write(header.objectCountBits, 16);
+    writer.write(header.leastPageLength, 32);
+    writer.write(header.pageLengthBits, 16);
+    writer.write(header.leastContentStreamOffset, 32);
+    writer.write(header.contentStreamOffsetBits, 16);
+    writer.write(header.leastContentStreamLength, 32);
+    writer.write(header.contentStreamLengthBits, 16);
+    writer.write(header.sharedObjectCountBits, 16);
+    writer.write(header.sharedObjectIdentifierBits, 16);
+    writer.write(header.sharedObjectNumeratorBits, 16);
+    writer.write(header.sharedObjectDenominator, 16);
+
+    // Items are grouped in the same way as they are read
+    auto writeItems = [&](auto itemFunction)
+    {
+        for (const PDFPageOffsetHintTable::Entry& entry : table.entries)
+        {
+            itemFunction(entry);
+        }
+        writer.finishLine();
+    };
+
+    writeItems([&](const PDFPageOffsetHintTable::Entry& entry) { writer.write(entry.objectCountDelta, header.objectCountBits); });
+    writeItems([&](const PDFPageOffsetHintTable::Entry& entry) { writer.write(entry.pageLengthDelta, header.pageLengthBits); });
+    writeItems([&](const PDFPageOffsetHintTable::Entry& entry) { writer.write(entry.sharedObjectIdentifiers.size(), header.sharedObjectCountBits); });
+    writeItems([&](const PDFPageOffsetHintTable::Entry& entry)
+    {
+        for (uint32_t identifier : entry.sharedObjectIdentifiers)
+        {
+            writer.write(identifier, header.sharedObjectIdentifierBits);
+        }
+    });
+    writeItems([&](const PDFPageOffsetHintTable::Entry& entry)
+    {
+        for (uint32_t numerator : entry.sharedObjectNumerators)
+        {
+            writer.write(numerator, header.sharedObjectNumeratorBits);
+        }
+    });
+    writeItems([&](const PDFPageOffsetHintTable::Entry& entry) { writer.write(entry.contentStreamOffsetDelta, header.contentStreamOffsetBits); });
+    writeItems([&](const PDFPageOffsetHintTable::Entry& entry) { writer.write(entry.contentStreamLengthDelta, header.contentStreamLengthBits); });
+
+    return writer.takeByteArray();
+}
+
+QByteArray PDFLinearizationInfo::writeSharedObjectHintTable(const PDFSharedObjectHintTable& table)
+{
+    const PDFSharedObjectHintTable::Header& header = table.header;
+
+    PDFBitWriter writer(8);
+    writer.write(header.firstSharedObjectNumber, 32);
+    writer.write(header.firstSharedObjectOffset, 32);
+    writer.write(header.firstPageEntryCount, 32);
+    writer.write(header.entryCount, 32);
+    writer.write(header.objectCountBits, 16);
+    writer.write(header.leastGroupLength, 32);
+    writer.write(header.groupLengthBits, 16);
+
+    for (const PDFSharedObjectHintTable::Entry& entry : table.entries)
+    {
+        writer.write(entry.groupLengthDelta, header.groupLengthBits);
+    }
+    writer.finishLine();
+
+    // Signatures of object groups are not written
+    for (size_t i = 0; i < table.entries.size(); ++i)
+    {
+        writer.write(0, 1);
+    }
+    writer.finishLine();
+
+    for (const PDFSharedObjectHintTable::Entry& entry : table.entries)
+    {
+        writer.write(entry.objectCountMinusOne, header.objectCountBits);
+    }
+    writer.finishLine();
+
+    return writer.takeByteArray();
+}
+
+uint16_t PDFLinearizationInfo::getBitCount(uint32_t value)
+{
+    uint16_t bits = 0;
+    while (value > 0)
+    {
+        ++bits;
+        value >>= 1;
+    }
+    return bits;
+}
+
+PDFLinearizationInfo::ByteRange PDFLinearizationInfo::getPageByteRange(PDFInteger pageIndex) const
+{
+    if (pageIndex >= 0 && pageIndex < static_cast<PDFInteger>(m_pageRanges.size()))
+    {
+        return m_pageRanges[pageIndex].byteRange;
+    }
+
+    return ByteRange();
+}
+
+PDFObjectReference PDFLinearizationInfo::getPageReference(PDFInteger pageIndex) const
+{
+    if (pageIndex >= 0 && pageIndex < static_cast<PDFInteger>(m_pageRanges.size()))
+    {
+        return PDFObjectReference(m_pageRanges[pageIndex].firstObjectNumber, 0);
+    }
+
+    return PDFObjectReference();
+}
+
+PDFInteger PDFLinearizationInfo::findPageObjectOffset(PDFInteger objectNumber) const
+{
+    auto comparator = [](const ObjectRange& range, PDFInteger objectNumber) { return range.firstObjectNumber < objectNumber; };
+
+    // Pages other than the first page are sorted by object number
+    if (m_pageRanges.size() > 1)
+    {
+        auto it = std::lower_bound(std::next(m_pageRanges.cbegin()), m_pageRanges.cend(), objectNumber, comparator);
+        if (it != m_pageRanges.cend() && it->firstObjectNumber == objectNumber)
+        {
+            return it->byteRange.offset;
+        }
+    }
+
+    return -1;
+}
+
+PDFLinearizationInfo::ByteRange PDFLinearizationInfo::findObjectByteRange(PDFInteger objectNumber) const
+{
+    auto comparator = [](const ObjectRange& range, PDFInteger objectNumber) { return range.firstObjectNumber + range.objectCount <= objectNumber; };
+
+    // Pages other than the first page are sorted by object number
+    if (m_pageRanges.size() > 1)
+    {
+        auto it = std::lower_bound(std::next(m_pageRanges.cbegin()), m_pageRanges.cend(), objectNumber, comparator);
+        if (it != m_pageRanges.cend() && it->firstObjectNumber <= objectNumber)
+        {
+            return it->byteRange;
+        }
+    }
+
+    auto it = std::lower_bound(m_sharedObjectRanges.cbegin(), m_sharedObjectRanges.cend(), objectNumber, comparator);
+    if (it != m_sharedObjectRanges.cend() && it->firstObjectNumber <= objectNumber)
+    {
+        return it->byteRange;
+    }
+
+    return ByteRange();
+}
+
+void PDFLinearizationInfo::buildObjectRanges()
+{
+    m_pageRanges.clear();
+    m_sharedObjectRanges.clear();
+
+    const PDFPageOffsetHintTable::Header& pageHeader = m_pageOffsetHintTable.header;
+    PDFInteger objectNumber = m_dictionary.getFirstPageObjectNumber();
+    PDFInteger offset = pageHeader.firstPageObjectOffset;
+
+    m_pageRanges.reserve(m_pageOffsetHintTable.entries.size());
+    for (const PDFPageOffsetHintTable::Entry& entry : m_pageOffsetHintTable.entries)
+    {
+        // Objects of the first page are at the end of object numbering,
+        // objects of the second page are numbered starting with 1.
+        if (m_pageRanges.size() == 1)
+        {
+            objectNumber = 1;
+        }
+
+        ObjectRange range;
+        range.firstObjectNumber = objectNumber;
+        range.objectCount = PDFInteger(pageHeader.leastObjectCount) + entry.objectCountDelta;
+        range.byteRange.offset = getFileOffset(offset);
+        range.byteRange.length = PDFInteger(pageHeader.leastPageLength) + entry.pageLengthDelta;
+        m_pageRanges.push_back(range);
+
+        objectNumber += range.objectCount;
+        offset += range.byteRange.length;
+    }
+
+    const PDFSharedObjectHintTable::Header& sharedHeader = m_sharedObjectHintTable.header;
+    objectNumber = sharedHeader.firstSharedObjectNumber;
+    offset = sharedHeader.firstSharedObjectOffset;
+
+    // First entries are objects of the first page, they are in the first page reference table
+    for (size_t i = sharedHeader.firstPageEntryCount; i < m_sharedObjectHintTable.entries.size(); ++i)
+    {
+        const PDFSharedObjectHintTable::Entry& entry = m_sharedObjectHintTable.entries[i];
+
+        ObjectRange range;
+        range.firstObjectNumber = objectNumber;
+        range.objectCount = PDFInteger(entry.objectCountMinusOne) + 1;
+        range.byteRange.offset = getFileOffset(offset);
+        range.byteRange.length = PDFInteger(sharedHeader.leastGroupLength) + entry.groupLengthDelta;
+        m_sharedObjectRanges.push_back(range);
+
+        objectNumber += range.objectCount;
+        offset += range.byteRange.length;
+    }
+}
+
+PDFInteger PDFLinearizationInfo::getFileOffset(PDFInteger offset) const
+{
+    if (offset >= m_dictionary.getHintStreamOffset())
+    {
+        return offset + m_dictionary.getHintStreamLength();
+    }
+
+    return offset;
+}
+
+}   // namespace pdf
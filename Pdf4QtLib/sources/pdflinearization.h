@@ -0,0 +1,246 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef PDFLINEARIZATION_H
+#define PDFLINEARIZATION_H
+
+#include "pdfglobal.h"
+#include "pdfobject.h"
+
+#include <QCoreApplication>
+
+#include <vector>
+
+namespace pdf
+{
+
+/// Linearization parameter dictionary. It is the first object in the linearized
+/// file (Fast Web View), and it describes layout of the file, so the first page
+/// can be displayed before whole file is read. See PDF Reference 1.7, Annex F.
+class PDF4QTLIBSHARED_EXPORT PDFLinearizationDictionary
+{
+public:
+    explicit PDFLinearizationDictionary() = default;
+
+    /// Parses linearization dictionary from the object. If object is not
+    /// a valid linearization dictionary, then invalid dictionary is returned.
+    /// Function doesn't throw exception.
+    /// \param object Object (direct dictionary)
+    static PDFLinearizationDictionary parse(const PDFObject& object);
+
+    /// Returns true, if dictionary is valid linearization dictionary
+    bool isValid() const { return m_fileLength > 0 && m_pageCount > 0; }
+
+    /// Returns length of the entire file in bytes. If file length doesn't match,
+    /// then file was updated incrementally and linearization is no longer valid.
+    PDFInteger getFileLength() const { return m_fileLength; }
+
+    PDFInteger getHintStreamOffset() const { return m_hintStreamOffset; }
+    PDFInteger getHintStreamLength() const { return m_hintStreamLength; }
+    PDFInteger getOverflowHintStreamOffset() const { return m_overflowHintStreamOffset; }
+    PDFInteger getOverflowHintStreamLength() const { return m_overflowHintStreamLength; }
+    PDFInteger getFirstPageObjectNumber() const { return m_firstPageObjectNumber; }
+    PDFInteger getFirstPageEndOffset() const { return m_firstPageEndOffset; }
+    PDFInteger getPageCount() const { return m_pageCount; }
+    PDFInteger getMainXRefTableOffset() const { return m_mainXRefTableOffset; }
+    PDFInteger getFirstPageIndex() const { return m_firstPageIndex; }
+
+private:
+    PDFInteger m_fileLength = 0;
+    PDFInteger m_hintStreamOffset = 0;
+    PDFInteger m_hintStreamLength = 0;
+    PDFInteger m_overflowHintStreamOffset = 0;
+    PDFInteger m_overflowHintStreamLength = 0;
+    PDFInteger m_firstPageObjectNumber = 0;
+    PDFInteger m_firstPageEndOffset = 0;
+    PDFInteger m_pageCount = 0;
+    PDFInteger m_mainXRefTableOffset = 0;
+    PDFInteger m_firstPageIndex = 0;
+};
+
+/// Page offset hint table of the linearized file. Table contains information
+/// about objects and byte ranges of all pages. Values are stored exactly as in
+/// the hint stream, i.e. as deltas from the minimal values in the header.
+struct PDFPageOffsetHintTable
+{
+    struct Header
+    {
+        uint32_t leastObjectCount = 0;
+        uint32_t firstPageObjectOffset = 0;
+        uint16_t objectCountBits = 0;
+        uint32_t leastPageLength = 0;
+        uint16_t pageLengthBits = 0;
+        uint32_t leastContentStreamOffset = 0;
+        uint16_t contentStreamOffsetBits = 0;
+        uint32_t leastContentStreamLength = 0;
+        uint16_t contentStreamLengthBits = 0;
+        uint16_t sharedObjectCountBits = 0;
+        uint16_t sharedObjectIdentifierBits = 0;
+        uint16_t sharedObjectNumeratorBits = 0;
+        uint16_t sharedObjectDenominator = 0;
+    };
+
+    struct Entry
+    {
+        uint32_t objectCountDelta = 0;
+        uint32_t pageLengthDelta = 0;
+        std::vector<uint32_t> sharedObjectIdentifiers;
+        std::vector<uint32_t> sharedObjectNumerators;
+        uint32_t contentStreamOffsetDelta = 0;
+        uint32_t contentStreamLengthDelta = 0;
+    };
+
+    Header header;
+    std::vector<Entry> entries;
+};
+
+/// Shared object hint table of the linearized file. Table contains information
+/// about object groups, which are referenced from multiple pages. First entries
+/// belong to the objects of the first page, remaining entries are in the shared
+/// objects section.
+struct PDFSharedObjectHintTable
+{
+    struct Header
+    {
+        uint32_t firstSharedObjectNumber = 0;
+        uint32_t firstSharedObjectOffset = 0;
+        uint32_t firstPageEntryCount = 0;
+        uint32_t entryCount = 0;
+        uint16_t objectCountBits = 0;
+        uint32_t leastGroupLength = 0;
+        uint16_t groupLengthBits = 0;
+    };
+
+    struct Entry
+    {
+        uint32_t groupLengthDelta = 0;
+        uint32_t objectCountMinusOne = 0;
+    };
+
+    Header header;
+    std::vector<Entry> entries;
+};
+
+/// Linearization information of the document. It contains linearization dictionary
+/// and hint tables, from which byte ranges of the pages and shared objects are computed.
+/// Offsets returned by this class are offsets in the file (hint stream length is
+/// already taken into account).
+class PDF4QTLIBSHARED_EXPORT PDFLinearizationInfo
+{
+    Q_DECLARE_TR_FUNCTIONS(pdf::PDFLinearizationInfo)
+
+public:
+    explicit PDFLinearizationInfo() = default;
+
+    struct ByteRange
+    {
+        PDFInteger offset = -1;
+        PDFInteger length = 0;
+
+        bool isValid() const { return offset >= 0; }
+    };
+
+    /// Parses linearization info from the decoded primary hint stream.
+    /// If error occurs, exception is thrown.
+    /// \param dictionary Linearization dictionary
+    /// \param hintStream Hint stream object
+    /// \param hintStreamData Decoded data of the hint stream
+    /// \param objectCount Number of objects in the document (upper bound of the page count)
+    static PDFLinearizationInfo parse(const PDFLinearizationDictionary& dictionary,
+                                      const PDFStream* hintStream,
+                                      const QByteArray& hintStreamData,
+                                      PDFInteger objectCount);
+
+    /// Reads page offset hint table from the data. If hint table can't
+    /// contain entries for all pages, exception is thrown.
+    static PDFPageOffsetHintTable readPageOffsetHintTable(const QByteArray& data, PDFInteger pageCount);
+
+    /// Reads shared object hint table from the data
+    static PDFSharedObjectHintTable readSharedObjectHintTable(const QByteArray& data, PDFInteger offset);
+
+    /// Writes page offset hint table to the byte array
+    static QByteArray writePageOffsetHintTable(const PDFPageOffsetHintTable& table);
+
+    /// Writes shared object hint table to the byte array
+    static QByteArray writeSharedObjectHintTable(const PDFSharedObjectHintTable& table);
+
+    /// Returns number of bits needed to represent the value in the hint table
+    static uint16_t getBitCount(uint32_t value);
+
+    /// Returns true, if linearization info is valid
+    bool isValid() const { return m_dictionary.isValid(); }
+
+    const PDFLinearizationDictionary& getDictionary() const { return m_dictionary; }
+    const PDFPageOffsetHintTable& getPageOffsetHintTable() const { return m_pageOffsetHintTable; }
+    const PDFSharedObjectHintTable& getSharedObjectHintTable() const { return m_sharedObjectHintTable; }
+
+    /// Returns byte range of the page. Page object is the first object
+    /// in this range. If page index is invalid, invalid range is returned.
+    /// \param pageIndex Page index
+    ByteRange getPageByteRange(PDFInteger pageIndex) const;
+
+    /// Returns reference to the page object of the given page. If page index
+    /// is invalid, invalid reference is returned.
+    /// \param pageIndex Page index
+    PDFObjectReference getPageReference(PDFInteger pageIndex) const;
+
+    /// Finds byte range, which contains object with given object number. Range
+    /// can contain multiple objects (page or object group). Objects of the first
+    /// page are not located by this function, they are present in the first
+    /// page reference table. If object is not found, invalid range is returned.
+    /// \param objectNumber Object number
+    ByteRange findObjectByteRange(PDFInteger objectNumber) const;
+
+    /// Returns offset of the page object with given object number. Page object
+    /// is the first object of the page, so its offset is known without reading
+    /// of the page byte range. Page object of the first page is not located
+    /// by this function. If object is not a page object, -1 is returned.
+    /// \param objectNumber Object number
+    PDFInteger findPageObjectOffset(PDFInteger objectNumber) const;
+
+private:
+    /// Item of the lookup table - objects [firstObjectNumber, firstObjectNumber + objectCount)
+    /// are stored in the given byte range.
+    struct ObjectRange
+    {
+        PDFInteger firstObjectNumber = 0;
+        PDFInteger objectCount = 0;
+        ByteRange byteRange;
+    };
+
+    /// Computes object ranges from the hint tables
+    void buildObjectRanges();
+
+    /// Adjusts offset from the hint table to the file offset. Offsets in the hint
+    /// tables are computed as if the primary hint stream was not present in the file.
+    PDFInteger getFileOffset(PDFInteger offset) const;
+
+    PDFLinearizationDictionary m_dictionary;
+    PDFPageOffsetHintTable m_pageOffsetHintTable;
+    PDFSharedObjectHintTable m_sharedObjectHintTable;
+
+    /// Object ranges of pages (index is page index)
+    std::vector<ObjectRange> m_pageRanges;
+
+    /// Object ranges of the shared object groups (not in the first page),
+    /// sorted by object number
+    std::vector<ObjectRange> m_sharedObjectRanges;
+};
+
+}   // namespace pdf
+
+#endif // PDFLINEARIZATION_H
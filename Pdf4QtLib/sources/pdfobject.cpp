@@ -102,8 +102,13 @@ bool PDFObject::operator==(const PDFObject& other) const
         // values are "equal" (NaN == NaN returns false)
         if (std::holds_alternative<PDFObjectContentPointer>(m_data))
         {
-            Q_ASSERT(std::get<PDFObjectContentPointer>(m_data));
-            return std::get<PDFObjectContentPointer>(m_data)->equals(std::get<PDFObjectContentPointer>(other.m_data).get());
+            const PDFObjectContentPointer& content = std::get<PDFObjectContentPointer>(m_data);
+            const PDFObjectContentPointer& otherContent = std::get<PDFObjectContentPointer>(other.m_data);
+            Q_ASSERT(content);
+
+            // Content is often shared between objects (for example, when document
+            // is modified), so we can avoid deep comparison in this case.
+            return content == otherContent || content->equals(otherContent.get());
         }
 
         return m_data == other.m_data;
@@ -112,6 +117,50 @@ bool PDFObject::operator==(const PDFObject& other) const
     return false;
 }
 
+size_t PDFObject::getHash() const
+{
+    const size_t typeHash = qHash(static_cast<int>(m_type));
+
+    switch (m_type)
+    {
+        case Type::Null:
+            return typeHash;
+
+        case Type::Bool:
+            return qHashMulti(typeHash, getBool());
+
+        case Type::Int:
+            return qHashMulti(typeHash, getInteger());
+
+        case Type::Real:
+        {
+            // Values 0.0 and -0.0 are equal, but have different bit representation
+            const PDFReal value = getReal();
+            return value != 0.0 ? qHashMulti(typeHash, value) : typeHash;
+        }
+
+        case Type::Reference:
+            return qHashMulti(typeHash, getReference());
+
+        case Type::String:
+        case Type::Name:
+        {
+            if (std::holds_alternative<PDFInplaceString>(m_data))
+            {
+                return qHashMulti(typeHash, std::get<PDFInplaceString>(m_data).getHash());
+            }
+
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    Q_ASSERT(std::holds_alternative<PDFObjectContentPointer>(m_data));
+    return qHashMulti(typeHash, std::get<PDFObjectContentPointer>(m_data)->getHash());
+}
+
 void PDFObject::accept(PDFAbstractVisitor* visitor) const
 {
     switch (m_type)
@@ -216,6 +265,11 @@ bool PDFString::equals(const PDFObjectContent* other) const
     return m_string == otherString->m_string;
 }
 
+size_t PDFString::getHash() const
+{
+    return qHash(m_string);
+}
+
 void PDFString::setString(const QByteArray& string)
 {
     m_string = string;
@@ -233,6 +287,18 @@ bool PDFArray::equals(const PDFObjectContent* other) const
     return m_objects == otherArray->m_objects;
 }
 
+size_t PDFArray::getHash() const
+{
+    size_t hash = qHash(m_objects.size());
+
+    for (const PDFObject& object : m_objects)
+    {
+        hash = qHashMulti(hash, object.getHash());
+    }
+
+    return hash;
+}
+
 void PDFArray::appendItem(PDFObject object)
 {
     m_objects.push_back(std::move(object));
@@ -250,6 +316,18 @@ bool PDFDictionary::equals(const PDFObjectContent* other) const
     return m_dictionary == otherStream->m_dictionary;
 }
 
+size_t PDFDictionary::getHash() const
+{
+    size_t hash = qHash(m_dictionary.size());
+
+    for (const DictionaryEntry& entry : m_dictionary)
+    {
+        hash = qHashMulti(hash, entry.first.getHash(), entry.second.getHash());
+    }
+
+    return hash;
+}
+
 const PDFObject& PDFDictionary::get(const QByteArray& key) const
 {
     auto it = find(key);
@@ -362,6 +440,11 @@ bool PDFStream::equals(const PDFObjectContent* other) const
     return m_dictionary.equals(&otherStream->m_dictionary) && m_content == otherStream->m_content;
 }
 
+size_t PDFStream::getHash() const
+{
+    return qHashMulti(m_dictionary.getHash(), m_content);
+}
+
 PDFObject PDFObjectManipulator::merge(PDFObject left, PDFObject right, MergeFlags flags)
 {
     const bool leftHasDictionary = left.isDictionary() || left.isStream();
@@ -540,6 +623,21 @@ PDFInplaceOrMemoryString::PDFInplaceOrMemoryString(QByteArray string)
     }
 }
 
+size_t PDFInplaceOrMemoryString::getHash() const
+{
+    if (std::holds_alternative<PDFInplaceString>(m_value))
+    {
+        return std::get<PDFInplaceString>(m_value).getHash();
+    }
+
+    if (std::holds_alternative<QByteArray>(m_value))
+    {
+        return qHash(std::get<QByteArray>(m_value));
+    }
+
+    return 0;
+}
+
 bool PDFInplaceOrMemoryString::equals(const char* value, size_t length) const
 {
     if (std::holds_alternative<PDFInplaceString>(m_value))
@@ -50,6 +50,10 @@ public:
     /// equal to the content of the other object.
     virtual bool equals(const PDFObjectContent* other) const = 0;
 
+    /// Returns structural hash of the content. Contents, which are
+    /// equal (see function equals), have the same hash.
+    virtual size_t getHash() const = 0;
+
     /// Optimizes memory consumption of this object
     virtual void optimize() = 0;
 };
@@ -107,6 +111,8 @@ struct PDFInplaceString
         return (size > 0) ? QByteArray(string.data(), size) : QByteArray();
     }
 
+    size_t getHash() const { return qHashBits(string.data(), size); }
+
     uint8_t size = 0;
     std::array<char, MAX_STRING_SIZE> string = { };
 };
@@ -154,6 +160,9 @@ public:
     /// Returns string. If string is inplace, byte array is constructed.
     QByteArray getString() const;
 
+    /// Returns hash of the string (no memory is allocated)
+    size_t getHash() const;
+
 private:
     std::variant<typename std::monostate, PDFInplaceString, QByteArray> m_value;
 };
@@ -231,6 +240,11 @@ public:
     bool operator==(const PDFObject& other) const;
     bool operator!=(const PDFObject& other) const { return !(*this == other); }
 
+    /// Returns structural hash of the object (content of arrays, dictionaries
+    /// and streams is hashed, references are not followed). Objects, which
+    /// are equal, have the same hash.
+    size_t getHash() const;
+
     /// Accepts the visitor
     void accept(PDFAbstractVisitor* visitor) const;
 
@@ -299,6 +313,7 @@ public:
     virtual ~PDFString() override = default;
 
     virtual bool equals(const PDFObjectContent* other) const override;
+    virtual size_t getHash() const override;
 
     const QByteArray& getString() const { return m_string; }
     void setString(const QByteArray &getString);
@@ -319,6 +334,7 @@ public:
     virtual ~PDFArray() override = default;
 
     virtual bool equals(const PDFObjectContent* other) const override;
+    virtual size_t getHash() const override;
 
     /// Returns item at the specified index. If index is invalid,
     /// then it throws an exception.
@@ -363,6 +379,7 @@ public:
     virtual ~PDFDictionary() override = default;
 
     virtual bool equals(const PDFObjectContent* other) const override;
+    virtual size_t getHash() const override;
 
     /// Returns object for the key. If key is not found in the dictionary,
     /// then valid reference to the null object is returned.
@@ -478,6 +495,7 @@ public:
     virtual ~PDFStream() override = default;
 
     virtual bool equals(const PDFObjectContent* other) const override;
+    virtual size_t getHash() const override;
 
     /// Returns dictionary for this content stream
     const PDFDictionary* getDictionary() const { return &m_dictionary; }
@@ -23,8 +23,28 @@
 #include "pdfconstants.h"
 #include "pdfdocumentbuilder.h"
 #include "pdfstreamfilters.h"
+#include "pdfparser.h"
+#include "pdfimage.h"
+#include "pdfccittfaxdecoder.h"
+#include "pdfpagecontentprocessor.h"
+#include "pdffontsubsetter.h"
+#include "pdfoptionalcontent.h"
+#include "pdfcms.h"
+#include "pdfexception.h"
 #include "pdfdbgheap.h"
 
+#include <QMutex>
+#include <QtMath>
+#include <QTransform>
+
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include <jpeglib.h>
+
 namespace pdf
 {
 
@@ -107,6 +127,701 @@ void PDFRemoveNullDictionaryEntriesVisitor::visitDictionary(const PDFDictionary*
     m_objectStack.push_back(PDFObject::createDictionary(std::make_shared<PDFDictionary>(qMove(entries))));
 }
 
+/// Scans content streams of the page and determines size of the images on the page
+/// (in points). If image is used in a way, where its size can't be determined
+/// (for example in a tiling pattern, in a Type 3 font, or in an annotation
+/// appearance stream), then placement of the image is marked as unknown.
+class PDFImagePlacementScanner
+{
+public:
+    explicit inline PDFImagePlacementScanner(const PDFDocument* document) :
+        m_document(document)
+    {
+
+    }
+
+    struct Placement
+    {
+        PDFReal width = 0.0;        ///< Maximal width of the image on the page in points
+        PDFReal height = 0.0;       ///< Maximal height of the image on the page in points
+        bool isUnknown = false;     ///< Size of the image can't be determined
+    };
+
+    using Placements = std::map<PDFObjectReference, Placement>;
+
+    /// Scans page content stream and appearance streams of page annotations
+    /// \param page Page
+    Placements scanPage(const PDFPage* page);
+
+    /// Merges placements from the source to the target
+    /// \param target Target placements
+    /// \param source Source placements
+    static void merge(Placements& target, const Placements& source);
+
+private:
+    void scanContent(const QByteArray& content, const PDFObject& resources, QTransform matrix, bool isPlacementKnown);
+    void scanXObject(PDFObjectReference reference, const PDFObject& parentResources, const QTransform& matrix, bool isPlacementKnown);
+    void scanStreamWithUnknownPlacement(const PDFObject& object, const PDFObject& parentResources);
+    void scanResourcesWithUnknownPlacement(const PDFDictionary* resources, const PDFObject& resourcesObject);
+    void addImage(PDFObjectReference reference, const QTransform& matrix, bool isPlacementKnown);
+
+    const PDFDocument* m_document;
+    Placements m_placements;
+
+    /// Forms, which are currently being scanned (protection against cyclic forms)
+    std::set<PDFObjectReference> m_activeForms;
+
+    /// Streams, which were already scanned with unknown placement
+    std::set<PDFObjectReference> m_unknownPlacementStreams;
+};
+
+PDFImagePlacementScanner::Placements PDFImagePlacementScanner::scanPage(const PDFPage* page)
+{
+    // Multiple content streams of the page are treated as if they were concatenated
+    QByteArray content;
+    const PDFObject& contents = m_document->getObject(page->getContents());
+    if (contents.isArray())
+    {
+        const PDFArray* array = contents.getArray();
+        for (size_t i = 0, count = array->getCount(); i < count; ++i)
+        {
+            const PDFObject& streamObject = m_document->getObject(array->getItem(i));
+            if (streamObject.isStream())
+            {
+                content.append(m_document->getDecodedStream(streamObject.getStream()));
+                content.append('\n');
+            }
+        }
+    }
+    else if (contents.isStream())
+    {
+        content = m_document->getDecodedStream(contents.getStream());
+    }
+
+    const PDFReal userUnit = page->getUserUnit();
+    scanContent(content, page->getResources(), QTransform::fromScale(userUnit, userUnit), true);
+
+    // Size of the annotation appearance streams depends on the annotation
+    // rectangle, so we treat images in appearance streams as unknown.
+    for (const PDFObjectReference& annotationReference : page->getAnnotations())
+    {
+        const PDFDictionary* annotationDictionary = m_document->getDictionaryFromObject(m_document->getObjectByReference(annotationReference));
+        const PDFDictionary* appearanceDictionary = annotationDictionary ? m_document->getDictionaryFromObject(annotationDictionary->get("AP")) : nullptr;
+
+        if (!appearanceDictionary)
+        {
+            continue;
+        }
+
+        for (size_t i = 0, count = appearanceDictionary->getCount(); i < count; ++i)
+        {
+            const PDFObject& appearance = appearanceDictionary->getValue(i);
+            const PDFObject& dereferencedAppearance = m_document->getObject(appearance);
+            if (dereferencedAppearance.isDictionary())
+            {
+                const PDFDictionary* stateDictionary = dereferencedAppearance.getDictionary();
+                for (size_t j = 0, stateCount = stateDictionary->getCount(); j < stateCount; ++j)
+                {
+                    scanStreamWithUnknownPlacement(stateDictionary->getValue(j), PDFObject());
+                }
+            }
+            else
+            {
+                scanStreamWithUnknownPlacement(appearance, PDFObject());
+            }
+        }
+    }
+
+    return qMove(m_placements);
+}
+
+void PDFImagePlacementScanner::merge(Placements& target, const Placements& source)
+{
+    for (const auto& item : source)
+    {
+        Placement& placement = target[item.first];
+        placement.width = qMax(placement.width, item.second.width);
+        placement.height = qMax(placement.height, item.second.height);
+        placement.isUnknown = placement.isUnknown || item.second.isUnknown;
+    }
+}
+
+void PDFImagePlacementScanner::scanContent(const QByteArray& content, const PDFObject& resources, QTransform matrix, bool isPlacementKnown)
+{
+    const PDFDictionary* resourcesDictionary = m_document->getDictionaryFromObject(resources);
+    if (!resourcesDictionary)
+    {
+        return;
+    }
+
+    scanResourcesWithUnknownPlacement(resourcesDictionary, resources);
+
+    const PDFDictionary* xobjectDictionary = m_document->getDictionaryFromObject(resourcesDictionary->get("XObject"));
+    if (!xobjectDictionary)
+    {
+        return;
+    }
+
+    std::vector<QTransform> matrixStack;
+    std::vector<PDFLexicalAnalyzer::Token> operands;
+
+    auto isNumber = [](const PDFLexicalAnalyzer::Token& token)
+    {
+        return token.type == PDFLexicalAnalyzer::TokenType::Integer || token.type == PDFLexicalAnalyzer::TokenType::Real;
+    };
+
+    try
+    {
+        PDFLexicalAnalyzer parser(content.constBegin(), content.constEnd());
+
+        while (!parser.isAtEnd())
+        {
+            PDFLexicalAnalyzer::Token token = parser.fetch();
+
+            switch (token.type)
+            {
+                case PDFLexicalAnalyzer::TokenType::Command:
+                {
+                    const QByteArrayView command = token.getStringView();
+
+                    if (command == "q")
+                    {
+                        matrixStack.push_back(matrix);
+                    }
+                    else if (command == "Q")
+                    {
+                        if (!matrixStack.empty())
+                        {
+                            matrix = matrixStack.back();
+                            matrixStack.pop_back();
+                        }
+                    }
+                    else if (command == "cm")
+                    {
+                        if (operands.size() == 6 && std::all_of(operands.cbegin(), operands.cend(), isNumber))
+                        {
+                            QTransform transform(operands[0].getReal(), operands[1].getReal(),
+                                                 operands[2].getReal(), operands[3].getReal(),
+                                                 operands[4].getReal(), operands[5].getReal());
+                            matrix = transform * matrix;
+                        }
+                    }
+                    else if (command == "Do")
+                    {
+                        if (operands.size() == 1 && operands.front().type == PDFLexicalAnalyzer::TokenType::Name)
+                        {
+                            const PDFObject& object = xobjectDictionary->get(operands.front().getString());
+                            if (object.isReference())
+                            {
+                                scanXObject(object.getReference(), resources, matrix, isPlacementKnown);
+                            }
+                        }
+                    }
+                    else if (command == "BI")
+                    {
+                        // Inline image can contain arbitrary binary data, skip them
+                        PDFInteger operatorIDPosition = parser.findSubstring("ID", parser.pos());
+                        PDFInteger operatorEIPosition = (operatorIDPosition != -1) ? parser.findSubstring("EI", operatorIDPosition + 3) : -1;
+
+                        if (operatorEIPosition == -1)
+                        {
+                            throw PDFException(PDFTranslationContext::tr("Invalid inline image stream."));
+                        }
+
+                        parser.seek(operatorEIPosition + 2);
+                    }
+
+                    operands.clear();
+                    break;
+                }
+
+                case PDFLexicalAnalyzer::TokenType::EndOfFile:
+                    break;
+
+                default:
+                    operands.push_back(qMove(token));
+                    break;
+            }
+        }
+    }
+    catch (const PDFException&)
+    {
+        // Content stream is damaged, so we can't determine placement
+        // of the images used in this content stream.
+        for (size_t i = 0, count = xobjectDictionary->getCount(); i < count; ++i)
+        {
+            const PDFObject& object = xobjectDictionary->getValue(i);
+            if (object.isReference())
+            {
+                scanXObject(object.getReference(), resources, QTransform(), false);
+            }
+        }
+    }
+}
+
+void PDFImagePlacementScanner::scanXObject(PDFObjectReference reference, const PDFObject& parentResources, const QTransform& matrix, bool isPlacementKnown)
+{
+    const PDFObject& object = m_document->getObjectByReference(reference);
+    if (!object.isStream())
+    {
+        return;
+    }
+
+    const PDFStream* stream = object.getStream();
+    const PDFDictionary* dictionary = stream->getDictionary();
+    PDFDocumentDataLoaderDecorator loader(m_document);
+    const QByteArray subtype = loader.readNameFromDictionary(dictionary, "Subtype");
+
+    if (subtype == "Image")
+    {
+        addImage(reference, matrix, isPlacementKnown);
+    }
+    else if (subtype == "Form")
+    {
+        if (!isPlacementKnown)
+        {
+            scanStreamWithUnknownPlacement(PDFObject::createReference(reference), parentResources);
+            return;
+        }
+
+        if (m_activeForms.count(reference))
+        {
+            // Cyclic form
+            return;
+        }
+
+        std::vector<PDFReal> formMatrix = loader.readNumberArrayFromDictionary(dictionary, "Matrix", { 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 });
+        QTransform formTransform;
+        if (formMatrix.size() == 6)
+        {
+            formTransform = QTransform(formMatrix[0], formMatrix[1], formMatrix[2], formMatrix[3], formMatrix[4], formMatrix[5]);
+        }
+
+        // Forms without resources use resources of the parent (deprecated feature)
+        const PDFObject& resources = dictionary->hasKey("Resources") ? dictionary->get("Resources") : parentResources;
+
+        m_activeForms.insert(reference);
+        scanContent(m_document->getDecodedStream(stream), resources, formTransform * matrix, true);
+        m_activeForms.erase(reference);
+    }
+}
+
+void PDFImagePlacementScanner::scanStreamWithUnknownPlacement(const PDFObject& object, const PDFObject& parentResources)
+{
+    if (object.isReference())
+    {
+        if (m_unknownPlacementStreams.count(object.getReference()))
+        {
+            return;
+        }
+
+        m_unknownPlacementStreams.insert(object.getReference());
+    }
+
+    const PDFObject& dereferencedObject = m_document->getObject(object);
+    if (dereferencedObject.isStream())
+    {
+        const PDFStream* stream = dereferencedObject.getStream();
+        const PDFDictionary* dictionary = stream->getDictionary();
+        const PDFObject& resources = dictionary->hasKey("Resources") ? dictionary->get("Resources") : parentResources;
+        scanContent(m_document->getDecodedStream(stream), resources, QTransform(), false);
+    }
+}
+
+void PDFImagePlacementScanner::scanResourcesWithUnknownPlacement(const PDFDictionary* resources, const PDFObject& resourcesObject)
+{
+    // Tiling patterns
+    if (const PDFDictionary* patternDictionary = m_document->getDictionaryFromObject(resources->get("Pattern")))
+    {
+        for (size_t i = 0, count = patternDictionary->getCount(); i < count; ++i)
+        {
+            scanStreamWithUnknownPlacement(patternDictionary->getValue(i), resourcesObject);
+        }
+    }
+
+    // Type 3 fonts
+    if (const PDFDictionary* fontDictionary = m_document->getDictionaryFromObject(resources->get("Font")))
+    {
+        PDFDocumentDataLoaderDecorator loader(m_document);
+        for (size_t i = 0, count = fontDictionary->getCount(); i < count; ++i)
+        {
+            const PDFDictionary* font = m_document->getDictionaryFromObject(fontDictionary->getValue(i));
+            if (!font || loader.readNameFromDictionary(font, "Subtype") != "Type3")
+            {
+                continue;
+            }
+
+            const PDFObject& fontResources = font->hasKey("Resources") ? font->get("Resources") : resourcesObject;
+            if (const PDFDictionary* charProcs = m_document->getDictionaryFromObject(font->get("CharProcs")))
+            {
+                for (size_t j = 0, charProcCount = charProcs->getCount(); j < charProcCount; ++j)
+                {
+                    scanStreamWithUnknownPlacement(charProcs->getValue(j), fontResources);
+                }
+            }
+        }
+    }
+
+    // Soft masks in graphic states
+    if (const PDFDictionary* graphicStateDictionary = m_document->getDictionaryFromObject(resources->get("ExtGState")))
+    {
+        for (size_t i = 0, count = graphicStateDictionary->getCount(); i < count; ++i)
+        {
+            const PDFDictionary* graphicState = m_document->getDictionaryFromObject(graphicStateDictionary->getValue(i));
+            const PDFDictionary* softMask = graphicState ? m_document->getDictionaryFromObject(graphicState->get("SMask")) : nullptr;
+
+            if (softMask)
+            {
+                scanStreamWithUnknownPlacement(softMask->get("G"), resourcesObject);
+            }
+        }
+    }
+}
+
+void PDFImagePlacementScanner::addImage(PDFObjectReference reference, const QTransform& matrix, bool isPlacementKnown)
+{
+    Placement& placement = m_placements[reference];
+
+    if (isPlacementKnown)
+    {
+        // Image is painted into the unit square, so the size of the image
+        // is given by the lengths of the transformed unit vectors.
+        placement.width = qMax(placement.width, std::hypot(matrix.m11(), matrix.m12()));
+        placement.height = qMax(placement.height, std::hypot(matrix.m21(), matrix.m22()));
+    }
+    else
+    {
+        placement.isUnknown = true;
+    }
+}
+
+struct PDFJPEGDCTDestination
+{
+    jpeg_destination_mgr destinationManager;
+    QByteArray* buffer = nullptr;
+};
+
+/// Encoder of the image data used in image recompression
+class PDFImageDataEncoder
+{
+public:
+    /// Downsamples the image data to the target size. Image must
+    /// have 8 bits per component. If image is indexed, then nearest
+    /// neighbour sampling is used, because indices can't be averaged.
+    /// \param imageData Image data
+    /// \param width Target width
+    /// \param height Target height
+    /// \param isIndexed Is image indexed?
+    static PDFImageData downsample(const PDFImageData& imageData, unsigned int width, unsigned int height, bool isIndexed);
+
+    /// Encodes image data using Flate compression with PNG predictors. Filter
+    /// of each row is chosen by minimal sum of absolute differences heuristic.
+    /// \param imageData Image data
+    static QByteArray encodeFlate(const PDFImageData& imageData);
+
+    /// Encodes image data using DCT (JPEG) compression. Image must have 8 bits
+    /// per component and one or three components. If error occurs, exception is thrown.
+    /// \param imageData Image data
+    /// \param quality Quality of the compression (0-100)
+    static QByteArray encodeDCT(const PDFImageData& imageData, int quality);
+};
+
+PDFImageData PDFImageDataEncoder::downsample(const PDFImageData& imageData, unsigned int width, unsigned int height, bool isIndexed)
+{
+    Q_ASSERT(imageData.getBitsPerComponent() == 8);
+
+    const unsigned int components = imageData.getComponents();
+    const unsigned int sourceWidth = imageData.getWidth();
+    const unsigned int sourceHeight = imageData.getHeight();
+    const unsigned int stride = width * components;
+
+    // Returns half-open interval of source pixels covered by the target pixel
+    auto getSourceInterval = [](unsigned int index, unsigned int sourceSize, unsigned int targetSize)
+    {
+        const unsigned int first = static_cast<unsigned int>(uint64_t(index) * sourceSize / targetSize);
+        const unsigned int last = qMax(first + 1, static_cast<unsigned int>(uint64_t(index + 1) * sourceSize / targetSize));
+        return std::make_pair(first, qMin(last, sourceSize));
+    };
+
+    QByteArray data(stride * height, 0);
+    std::vector<uint32_t> sums(components, 0);
+
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        const std::pair<unsigned int, unsigned int> rows = getSourceInterval(y, sourceHeight, height);
+        unsigned char* targetRow = reinterpret_cast<unsigned char*>(data.data()) + y * stride;
+
+        for (unsigned int x = 0; x < width; ++x)
+        {
+            const std::pair<unsigned int, unsigned int> columns = getSourceInterval(x, sourceWidth, width);
+            unsigned char* targetPixel = targetRow + x * components;
+
+            if (isIndexed)
+            {
+                const unsigned char* sourcePixel = imageData.getRow((rows.first + rows.second) / 2) + ((columns.first + columns.second) / 2) * components;
+                std::copy(sourcePixel, sourcePixel + components, targetPixel);
+                continue;
+            }
+
+            std::fill(sums.begin(), sums.end(), 0);
+            for (unsigned int sourceY = rows.first; sourceY < rows.second; ++sourceY)
+            {
+                const unsigned char* sourcePixel = imageData.getRow(sourceY) + columns.first * components;
+                for (unsigned int sourceX = columns.first; sourceX < columns.second; ++sourceX)
+                {
+                    for (unsigned int component = 0; component < components; ++component)
+                    {
+                        sums[component] += *sourcePixel++;
+                    }
+                }
+            }
+
+            const uint32_t pixelCount = (rows.second - rows.first) * (columns.second - columns.first);
+            for (unsigned int component = 0; component < components; ++component)
+            {
+                targetPixel[component] = static_cast<unsigned char>((sums[component] + pixelCount / 2) / pixelCount);
+            }
+        }
+    }
+
+    return PDFImageData(components, 8, width, height, stride, imageData.getMaskingType(), qMove(data),
+                        std::vector<PDFInteger>(imageData.getColorKeyMask()),
+                        std::vector<PDFReal>(imageData.getDecode()),
+                        std::vector<PDFReal>(imageData.getMatte()));
+}
+
+QByteArray PDFImageDataEncoder::encodeFlate(const PDFImageData& imageData)
+{
+    const unsigned int stride = imageData.getStride();
+    const unsigned int height = imageData.getHeight();
+    const unsigned int bytesPerPixel = qMax(1u, imageData.getComponents() * imageData.getBitsPerComponent() / 8);
+
+    auto paethPredictor = [](int a, int b, int c)
+    {
+        const int p = a + b - c;
+        const int pa = std::abs(p - a);
+        const int pb = std::abs(p - b);
+        const int pc = std::abs(p - c);
+
+        if (pa <= pb && pa <= pc)
+        {
+            return a;
+        }
+
+        return (pb <= pc) ? b : c;
+    };
+
+    // PNG filter types: None, Sub, Up, Average, Paeth
+    constexpr int FILTER_COUNT = 5;
+    std::array<std::vector<uint8_t>, FILTER_COUNT> filteredRows;
+    for (std::vector<uint8_t>& filteredRow : filteredRows)
+    {
+        filteredRow.resize(stride, 0);
+    }
+
+    const std::vector<uint8_t> zeroRow(stride, 0);
+    const uint8_t* previousRow = zeroRow.data();
+
+    QByteArray predictedData;
+    predictedData.reserve((stride + 1) * height);
+
+    for (unsigned int row = 0; row < height; ++row)
+    {
+        const uint8_t* currentRow = imageData.getRow(row);
+
+        for (unsigned int i = 0; i < stride; ++i)
+        {
+            const int x = currentRow[i];
+            const int a = (i >= bytesPerPixel) ? currentRow[i - bytesPerPixel] : 0;
+            const int b = previousRow[i];
+            const int c = (i >= bytesPerPixel) ? previousRow[i - bytesPerPixel] : 0;
+
+            filteredRows[0][i] = static_cast<uint8_t>(x);
+            filteredRows[1][i] = static_cast<uint8_t>(x - a);
+            filteredRows[2][i] = static_cast<uint8_t>(x - b);
+            filteredRows[3][i] = static_cast<uint8_t>(x - (a + b) / 2);
+            filteredRows[4][i] = static_cast<uint8_t>(x - paethPredictor(a, b, c));
+        }
+
+        int bestFilter = 0;
+        uint64_t bestSum = std::numeric_limits<uint64_t>::max();
+        for (int filter = 0; filter < FILTER_COUNT; ++filter)
+        {
+            uint64_t sum = 0;
+            for (uint8_t value : filteredRows[filter])
+            {
+                sum += std::abs(static_cast<int8_t>(value));
+            }
+
+            if (sum < bestSum)
+            {
+                bestSum = sum;
+                bestFilter = filter;
+            }
+        }
+
+        predictedData.append(static_cast<char>(bestFilter));
+        predictedData.append(reinterpret_cast<const char*>(filteredRows[bestFilter].data()), stride);
+        previousRow = currentRow;
+    }
+
+    return PDFFlateDecodeFilter::compress(predictedData);
+}
+
+QByteArray PDFImageDataEncoder::encodeDCT(const PDFImageData& imageData, int quality)
+{
+    Q_ASSERT(imageData.getBitsPerComponent() == 8);
+    Q_ASSERT(imageData.getComponents() == 1 || imageData.getComponents() == 3);
+
+    constexpr int BUFFER_BLOCK_SIZE = 65536;
+
+    QByteArray buffer;
+    PDFJPEGDCTDestination destination;
+    std::memset(&destination.destinationManager, 0, sizeof(jpeg_destination_mgr));
+    destination.buffer = &buffer;
+
+    auto initDestinationMethod = [](j_compress_ptr compress)
+    {
+        PDFJPEGDCTDestination* destination = reinterpret_cast<PDFJPEGDCTDestination*>(compress->dest);
+        destination->buffer->resize(BUFFER_BLOCK_SIZE);
+        destination->destinationManager.next_output_byte = reinterpret_cast<JOCTET*>(destination->buffer->data());
+        destination->destinationManager.free_in_buffer = destination->buffer->size();
+    };
+
+    auto emptyOutputBufferMethod = [](j_compress_ptr compress) -> boolean
+    {
+        // Buffer is full, so we enlarge it
+        PDFJPEGDCTDestination* destination = reinterpret_cast<PDFJPEGDCTDestination*>(compress->dest);
+        const qsizetype oldSize = destination->buffer->size();
+        destination->buffer->resize(oldSize * 2);
+        destination->destinationManager.next_output_byte = reinterpret_cast<JOCTET*>(destination->buffer->data()) + oldSize;
+        destination->destinationManager.free_in_buffer = oldSize;
+        return TRUE;
+    };
+
+    auto termDestinationMethod = [](j_compress_ptr compress)
+    {
+        PDFJPEGDCTDestination* destination = reinterpret_cast<PDFJPEGDCTDestination*>(compress->dest);
+        destination->buffer->resize(destination->buffer->size() - destination->destinationManager.free_in_buffer);
+    };
+
+    auto errorMethod = [](j_common_ptr ptr)
+    {
+        char buffer[JMSG_LENGTH_MAX] = { };
+        (ptr->err->format_message)(ptr, buffer);
+
+        jpeg_destroy(ptr);
+        throw PDFException(PDFTranslationContext::tr("Error writing JPEG (DCT) image: %1.").arg(QString::fromLatin1(buffer)));
+    };
+
+    destination.destinationManager.init_destination = initDestinationMethod;
+    destination.destinationManager.empty_output_buffer = emptyOutputBufferMethod;
+    destination.destinationManager.term_destination = termDestinationMethod;
+
+    jpeg_compress_struct codec;
+    jpeg_error_mgr errorManager;
+    std::memset(&codec, 0, sizeof(jpeg_compress_struct));
+    std::memset(&errorManager, 0, sizeof(errorManager));
+
+    jpeg_std_error(&errorManager);
+    errorManager.error_exit = errorMethod;
+    codec.err = &errorManager;
+
+    jpeg_create_compress(&codec);
+    codec.dest = reinterpret_cast<jpeg_destination_mgr*>(&destination);
+    codec.image_width = imageData.getWidth();
+    codec.image_height = imageData.getHeight();
+    codec.input_components = imageData.getComponents();
+    codec.in_color_space = (imageData.getComponents() == 3) ? JCS_RGB : JCS_GRAYSCALE;
+
+    jpeg_set_defaults(&codec);
+    jpeg_set_quality(&codec, qBound(0, quality, 100), TRUE);
+    jpeg_start_compress(&codec, TRUE);
+
+    while (codec.next_scanline < codec.image_height)
+    {
+        JSAMPROW row = const_cast<JSAMPROW>(imageData.getRow(codec.next_scanline));
+        jpeg_write_scanlines(&codec, &row, 1);
+    }
+
+    jpeg_finish_compress(&codec);
+    jpeg_destroy_compress(&codec);
+
+    return buffer;
+}
+
+/// Collects glyphs of the embedded TrueType and CFF font programs, which are drawn
+/// on the page. Optional content is ignored, so glyphs in the hidden
+/// content are also collected.
+class PDFUsedGlyphsCollector : public PDFPageContentProcessor
+{
+public:
+    using PDFPageContentProcessor::PDFPageContentProcessor;
+
+    /// Used glyphs, key is reference to the font program stream (FontFile2,
+    /// or FontFile3 with CFF font program). Glyphs of CID-keyed CFF fonts are CIDs.
+    using UsedGlyphs = std::map<PDFObjectReference, std::set<GID>>;
+
+    const UsedGlyphs& getUsedGlyphs() const { return m_usedGlyphs; }
+
+    /// Returns references to the embedded font programs, which are neither
+    /// TrueType nor CFF font programs (Type 1 and OpenType), and can't be subsetted.
+    const std::set<PDFObjectReference>& getOtherFontPrograms() const { return m_otherFontPrograms; }
+
+    virtual bool isContentSuppressedByOC(PDFObjectReference ocgOrOcmd) override;
+
+protected:
+    virtual void performTextSequence(const TextSequence& textSequence) override;
+
+private:
+    UsedGlyphs m_usedGlyphs;
+    std::set<PDFObjectReference> m_otherFontPrograms;
+};
+
+bool PDFUsedGlyphsCollector::isContentSuppressedByOC(PDFObjectReference ocgOrOcmd)
+{
+    Q_UNUSED(ocgOrOcmd);
+    return false;
+}
+
+void PDFUsedGlyphsCollector::performTextSequence(const TextSequence& textSequence)
+{
+    const PDFFontPointer& font = getGraphicState()->getTextFont();
+    if (!font)
+    {
+        return;
+    }
+
+    const FontDescriptor* fontDescriptor = font->getFontDescriptor();
+    PDFObjectReference fontProgramReference = fontDescriptor->fontFile2Reference;
+    if (!fontProgramReference.isValid() && PDFCFFFontSubsetter::isCFFFontProgram(fontDescriptor->fontFile3))
+    {
+        fontProgramReference = fontDescriptor->fontFile3Reference;
+    }
+
+    if (!fontProgramReference.isValid())
+    {
+        // Font is not an embedded TrueType or CFF font
+        for (const PDFObjectReference& reference : { fontDescriptor->fontFileReference, fontDescriptor->fontFile3Reference })
+        {
+            if (reference.isValid())
+            {
+                m_otherFontPrograms.insert(reference);
+            }
+        }
+        return;
+    }
+
+    std::set<GID>& glyphs = m_usedGlyphs[fontProgramReference];
+    for (const TextSequenceItem& item : textSequence.items)
+    {
+        if (item.isCharacter())
+        {
+            glyphs.insert(item.glyphIndex);
+        }
+    }
+}
+
 PDFOptimizer::PDFOptimizer(OptimizationFlags flags, QObject* parent) :
     QObject(parent),
     m_flags(flags)
@@ -120,8 +835,10 @@ void PDFOptimizer::optimize()
     // stage can consist from multiple passes.
     constexpr OptimizationFlags stages[] = { OptimizationFlags(DereferenceSimpleObjects),
                                              OptimizationFlags(RemoveNullObjects),
+                                             OptimizationFlags(SubsetFonts),
                                              OptimizationFlags(RemoveUnusedObjects | MergeIdenticalObjects),
                                              OptimizationFlags(ShrinkObjectStorage),
+                                             OptimizationFlags(RecompressImages),
                                              OptimizationFlags(RecompressFlateStreams) };
 
     int stage = 1;
@@ -148,6 +865,10 @@ void PDFOptimizer::optimize()
             {
                 pass = performRemoveNullObjects() || pass;
             }
+            if (currentSteps.testFlag(SubsetFonts))
+            {
+                pass = performSubsetFonts() || pass;
+            }
             if (currentSteps.testFlag(RemoveUnusedObjects))
             {
                 pass = performRemoveUnusedObjects() || pass;
@@ -160,6 +881,10 @@ void PDFOptimizer::optimize()
             {
                 pass = performShrinkObjectStorage() || pass;
             }
+            if (currentSteps.testFlag(RecompressImages))
+            {
+                pass = performRecompressImages() || pass;
+            }
             if (currentSteps.testFlag(RecompressFlateStreams))
             {
                 pass = performRecompressFlateStreams() || pass;
@@ -179,6 +904,18 @@ void PDFOptimizer::setFlags(OptimizationFlags flags)
     m_flags = flags;
 }
 
+PDFDocumentWriter::WriteFlags PDFOptimizer::getWriteFlags() const
+{
+    PDFDocumentWriter::WriteFlags flags = PDFDocumentWriter::None;
+
+    if (m_flags.testFlag(CompressObjectStreams))
+    {
+        flags |= PDFDocumentWriter::ObjectStreams;
+    }
+
+    return flags;
+}
+
 bool PDFOptimizer::performDereferenceSimpleObjects()
 {
     std::atomic<PDFInteger> counter = 0;
@@ -248,54 +985,97 @@ bool PDFOptimizer::performMergeIdenticalObjects()
     std::map<PDFObjectReference, PDFObjectReference> replacementMap;
     PDFObjectStorage::PDFObjects objects =  m_storage.getObjects();
 
-    // Find same objects
-    QMutex mutex;
+    // Compute structural hashes of the objects
+    std::vector<size_t> hashes(objects.size(), 0);
     PDFIntegerRange<size_t> range(0, objects.size());
-    auto processEntry = [this, &counter, &objects, &mutex, &replacementMap](size_t index)
+    auto computeHash = [&objects, &hashes](size_t index)
+    {
+        hashes[index] = objects[index].object.getHash();
+    };
+    PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Unknown, range.begin(), range.end(), computeHash);
+
+    // Divide objects into buckets by hash, objects in the bucket are sorted by index
+    std::vector<std::vector<size_t>> buckets;
+    std::unordered_map<size_t, size_t> bucketIndices;
+    bucketIndices.reserve(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i)
     {
-        const PDFObjectStorage::Entry& entry = objects[index];
+        if (objects[i].object.isNull())
+        {
+            // Jakub Melka: we do not merge null objects, they are just removed
+            continue;
+        }
+
+        auto it = bucketIndices.find(hashes[i]);
+        if (it == bucketIndices.cend())
+        {
+            bucketIndices[hashes[i]] = buckets.size();
+            buckets.push_back({ i });
+        }
+        else
+        {
+            buckets[it->second].push_back(i);
+        }
+    }
+
+    // Find same objects. Each object is merged with the first identical object.
+    QMutex mutex;
+    auto processBucket = [this, &counter, &objects, &mutex, &replacementMap](const std::vector<size_t>& bucket)
+    {
+        if (bucket.size() < 2)
+        {
+            return;
+        }
 
-        // We do not merge special objects, such as pages
-        if (const PDFDictionary* dictionary = m_storage.getDictionaryFromObject(entry.object))
+        std::vector<size_t> representatives;
+        for (size_t index : bucket)
         {
-            PDFObject nameObject = m_storage.getObject(dictionary->get("Type"));
-            if (nameObject.isName())
+            const PDFObjectStorage::Entry& entry = objects[index];
+
+            // We do not merge special objects, such as pages
+            bool isMergeable = true;
+            if (const PDFDictionary* dictionary = m_storage.getDictionaryFromObject(entry.object))
             {
-                if (nameObject.getString() == "Page")
+                PDFObject nameObject = m_storage.getObject(dictionary->get("Type"));
+                if (nameObject.isName() && nameObject.getString() == "Page")
                 {
-                    return;
+                    isMergeable = false;
                 }
             }
-        }
-
-        for (size_t i = 0; i < index; ++i)
-        {
-            if (objects[i].object.isNull())
-            {
-                // Jakub Melka: we do not merge null objects, they are just removed
-                continue;
-            }
 
-            if (objects[i].object == entry.object)
+            auto it = std::find_if(representatives.cbegin(), representatives.cend(), [&](size_t i) { return objects[i].object == entry.object; });
+            if (isMergeable && it != representatives.cend())
             {
                 QMutexLocker lock(&mutex);
                 PDFObjectReference oldReference = PDFObjectReference(PDFInteger(index), objects[index].generation);
-                PDFObjectReference newReference = PDFObjectReference(PDFInteger(i), objects[i].generation);
+                PDFObjectReference newReference = PDFObjectReference(PDFInteger(*it), objects[*it].generation);
                 replacementMap[oldReference] = newReference;
                 ++counter;
-                break;
+            }
+            else if (it == representatives.cend())
+            {
+                representatives.push_back(index);
             }
         }
     };
-    PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Unknown, range.begin(), range.end(), processEntry);
+    PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Unknown, buckets.cbegin(), buckets.cend(), processBucket);
 
-    // Replace objects
+    // Replace objects. Merged objects are no longer referenced, so we remove
+    // them. Objects, which become identical after the replacement, are merged
+    // in the next pass.
     if (!replacementMap.empty())
     {
-        for (size_t i = 0; i < objects.size(); ++i)
+        auto replaceEntry = [&replacementMap](PDFObjectStorage::Entry& entry)
         {
-            objects[i].object = PDFObjectUtils::replaceReferences(objects[i].object, replacementMap);
+            entry.object = PDFObjectUtils::replaceReferences(entry.object, replacementMap);
+        };
+        PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Unknown, objects.begin(), objects.end(), replaceEntry);
+
+        for (const auto& item : replacementMap)
+        {
+            objects[item.first.objectNumber].object = PDFObject();
         }
+
         PDFObject trailerDictionary = PDFObjectUtils::replaceReferences(m_storage.getTrailerDictionary(), replacementMap);
         m_storage.setTrailerDictionary(trailerDictionary);
     }
@@ -452,4 +1232,596 @@ bool PDFOptimizer::performRecompressFlateStreams()
     return false;
 }
 
+bool PDFOptimizer::performRecompressImages()
+{
+    std::atomic<PDFInteger> imagesRecompressed = 0;
+    std::atomic<PDFInteger> imagesDownsampled = 0;
+    std::atomic<PDFInteger> bytesSaved = 0;
+
+    PDFObjectStorage::PDFObjects objects = m_storage.getObjects();
+
+    try
+    {
+        // Temporary document is used to decode images and content streams
+        PDFDocument document(PDFObjectStorage(m_storage), PDFVersion(2, 0));
+        const PDFCatalog* catalog = document.getCatalog();
+
+        // Determine size of the images on the pages
+        QMutex placementsMutex;
+        PDFImagePlacementScanner::Placements placements;
+        PDFIntegerRange<size_t> pageRange(0, catalog->getPageCount());
+        auto scanPage = [&document, catalog, &placements, &placementsMutex](size_t pageIndex)
+        {
+            PDFImagePlacementScanner scanner(&document);
+            PDFImagePlacementScanner::Placements pagePlacements = scanner.scanPage(catalog->getPage(pageIndex));
+
+            QMutexLocker lock(&placementsMutex);
+            PDFImagePlacementScanner::merge(placements, pagePlacements);
+        };
+        PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Page, pageRange.begin(), pageRange.end(), scanPage);
+
+        // Find soft masks and stencil masks of the images. Masks are never downsampled,
+        // because their size can be bound to the size of the masked image.
+        std::set<PDFObjectReference> softMasks;
+        std::set<PDFObjectReference> masks;
+        for (const PDFObjectStorage::Entry& entry : objects)
+        {
+            if (entry.object.isStream())
+            {
+                const PDFDictionary* dictionary = entry.object.getStream()->getDictionary();
+                const PDFObject& softMask = dictionary->get("SMask");
+                const PDFObject& mask = dictionary->get("Mask");
+
+                if (softMask.isReference())
+                {
+                    softMasks.insert(softMask.getReference());
+                }
+                if (mask.isReference())
+                {
+                    masks.insert(mask.getReference());
+                }
+            }
+        }
+
+        PDFIntegerRange<size_t> range(0, objects.size());
+        auto processEntry = [&, this](size_t index)
+        {
+            PDFObjectStorage::Entry& entry = objects[index];
+            if (!entry.object.isStream())
+            {
+                return;
+            }
+
+            const PDFObjectReference reference(PDFInteger(index), entry.generation);
+            const bool isSoftMask = softMasks.count(reference);
+
+            QSizeF placementSize;
+            auto it = placements.find(reference);
+            if (it != placements.cend() && !it->second.isUnknown && !isSoftMask && !masks.count(reference))
+            {
+                placementSize = QSizeF(it->second.width, it->second.height);
+            }
+
+            try
+            {
+                const PDFStream* stream = entry.object.getStream();
+                bool isDownsampled = false;
+                PDFObject recompressedImage = recompressImage(&document, stream, placementSize, isSoftMask, &isDownsampled);
+
+                if (!recompressedImage.isNull())
+                {
+                    bytesSaved += stream->getContent()->size() - recompressedImage.getStream()->getContent()->size();
+                    ++imagesRecompressed;
+
+                    if (isDownsampled)
+                    {
+                        ++imagesDownsampled;
+                    }
+
+                    entry.object = qMove(recompressedImage);
+                }
+            }
+            catch (const PDFException&)
+            {
+                // Image can't be decoded or encoded, leave it as it is
+            }
+            catch (const PDFRendererException&)
+            {
+                // Image can't be decoded, leave it as it is
+            }
+        };
+
+        PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Unknown, range.begin(), range.end(), processEntry);
+    }
+    catch (const PDFException&)
+    {
+        // Document is damaged, images can't be processed
+        Q_EMIT optimizationProgress(tr("Images can't be recompressed, document is invalid."));
+        return false;
+    }
+
+    m_storage.setObjects(qMove(objects));
+    Q_EMIT optimizationProgress(tr("Images recompressed: %1, downsampled: %2, bytes saved: %3").arg(imagesRecompressed).arg(imagesDownsampled).arg(bytesSaved));
+
+    return false;
+}
+
+bool PDFOptimizer::performSubsetFonts()
+{
+    std::atomic<PDFInteger> fontsSubsetted = 0;
+    std::atomic<PDFInteger> bytesSaved = 0;
+
+    PDFObjectStorage::PDFObjects objects = m_storage.getObjects();
+    std::set<PDFObjectReference> otherFontPrograms;
+
+    try
+    {
+        // Temporary document is used to process content streams of the pages
+        PDFDocument document(PDFObjectStorage(m_storage), PDFVersion(2, 0));
+        const PDFCatalog* catalog = document.getCatalog();
+
+        PDFFontCache fontCache(DEFAULT_FONT_CACHE_LIMIT, DEFAULT_REALIZED_FONT_CACHE_LIMIT);
+        PDFCMSGeneric cms;
+        PDFMeshQualitySettings mqs;
+        PDFOptionalContentActivity oca(&document, OCUsage::Export, nullptr);
+        PDFModifiedDocument md(&document, &oca);
+        fontCache.setDocument(md);
+        fontCache.setCacheShrinkEnabled(nullptr, false);
+
+        // Collect glyphs used on the pages
+        QMutex mutex;
+        bool isContentValid = true;
+        PDFUsedGlyphsCollector::UsedGlyphs usedGlyphs;
+        PDFIntegerRange<size_t> pageRange(0, catalog->getPageCount());
+        auto collectGlyphs = [&](size_t pageIndex)
+        {
+            PDFUsedGlyphsCollector collector(catalog->getPage(pageIndex), &document, &fontCache, &cms, &oca, QTransform(), mqs);
+            QList<PDFRenderError> errors = collector.processContents();
+            const bool hasErrors = std::any_of(errors.cbegin(), errors.cend(), [](const PDFRenderError& error) { return error.type == RenderErrorType::Error; });
+
+            QMutexLocker lock(&mutex);
+            isContentValid = isContentValid && !hasErrors;
+            for (const auto& item : collector.getUsedGlyphs())
+            {
+                usedGlyphs[item.first].insert(item.second.cbegin(), item.second.cend());
+            }
+            otherFontPrograms.insert(collector.getOtherFontPrograms().cbegin(), collector.getOtherFontPrograms().cend());
+        };
+        PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Page, pageRange.begin(), pageRange.end(), collectGlyphs);
+        fontCache.setCacheShrinkEnabled(nullptr, true);
+
+        if (!isContentValid)
+        {
+            // We can't be sure, that all used glyphs were collected
+            Q_EMIT optimizationProgress(tr("Fonts can't be subsetted, content of some page is invalid."));
+            return false;
+        }
+
+        // Fonts used in annotation appearance streams and in default resources of the
+        // interactive form are not subsetted, because appearance streams can be regenerated.
+        std::vector<PDFObject> excludedObjects;
+        for (size_t pageIndex = 0; pageIndex < catalog->getPageCount(); ++pageIndex)
+        {
+            for (const PDFObjectReference& annotationReference : catalog->getPage(pageIndex)->getAnnotations())
+            {
+                if (const PDFDictionary* annotationDictionary = document.getDictionaryFromObject(PDFObject::createReference(annotationReference)))
+                {
+                    excludedObjects.push_back(annotationDictionary->get("AP"));
+                }
+            }
+        }
+        if (const PDFDictionary* formDictionary = document.getDictionaryFromObject(catalog->getFormObject()))
+        {
+            excludedObjects.push_back(formDictionary->get("DR"));
+        }
+        const std::set<PDFObjectReference> excludedReferences = PDFObjectUtils::getReferences(excludedObjects, m_storage);
+
+        // Font programs with the same data share the used glyphs, so their
+        // subsets are also the same, and they can be merged afterwards.
+        std::map<QByteArray, std::set<GID>> glyphsByFontProgram;
+        std::vector<std::pair<PDFObjectReference, QByteArray>> fontPrograms;
+        for (const auto& item : usedGlyphs)
+        {
+            const PDFObjectReference reference = item.first;
+            if (excludedReferences.count(reference) || reference.objectNumber >= PDFInteger(objects.size()) || objects[reference.objectNumber].generation != reference.generation)
+            {
+                continue;
+            }
+
+            const PDFObject& object = objects[reference.objectNumber].object;
+            if (!object.isStream() || object.getStream()->getDictionary()->hasKey(PDF_STREAM_DICT_FILE_SPECIFICATION))
+            {
+                continue;
+            }
+
+            QByteArray fontProgram = document.getDecodedStream(object.getStream());
+            glyphsByFontProgram[fontProgram].insert(item.second.cbegin(), item.second.cend());
+            fontPrograms.emplace_back(reference, qMove(fontProgram));
+        }
+
+        std::vector<QByteArray> subsetTags(fontPrograms.size());
+        PDFIntegerRange<size_t> range(0, fontPrograms.size());
+        auto processFontProgram = [&](size_t index)
+        {
+            const PDFObjectReference reference = fontPrograms[index].first;
+            const QByteArray& fontProgram = fontPrograms[index].second;
+            PDFObjectStorage::Entry& entry = objects[reference.objectNumber];
+            const PDFStream* stream = entry.object.getStream();
+
+            try
+            {
+                const bool isCFFFontProgram = PDFCFFFontSubsetter::isCFFFontProgram(fontProgram);
+                QByteArray subset = isCFFFontProgram ? PDFCFFFontSubsetter::createSubset(fontProgram, glyphsByFontProgram.at(fontProgram))
+                                                     : PDFTrueTypeFontSubsetter::createSubset(fontProgram, glyphsByFontProgram.at(fontProgram));
+                QByteArray compressedSubset = PDFFlateDecodeFilter::compress(subset);
+
+                const PDFInteger currentBytesSaved = stream->getContent()->size() - compressedSubset.size();
+                if (currentBytesSaved > 0)
+                {
+                    PDFDictionary updatedDictionary = *stream->getDictionary();
+                    updatedDictionary.setEntry(PDFInplaceOrMemoryString(PDF_STREAM_DICT_FILTER), PDFObject::createName("FlateDecode"));
+                    updatedDictionary.removeEntry(PDF_STREAM_DICT_DECODE_PARMS);
+                    updatedDictionary.removeEntry(PDF_STREAM_DICT_DECODED_LENGTH);
+                    updatedDictionary.setEntry(PDFInplaceOrMemoryString(PDF_STREAM_DICT_LENGTH), PDFObject::createInteger(compressedSubset.size()));
+                    if (!isCFFFontProgram)
+                    {
+                        updatedDictionary.setEntry(PDFInplaceOrMemoryString("Length1"), PDFObject::createInteger(subset.size()));
+                    }
+
+                    bytesSaved += currentBytesSaved;
+                    ++fontsSubsetted;
+                    subsetTags[index] = PDFTrueTypeFontSubsetter::createSubsetTag(subset);
+                    entry.object = PDFObject::createStream(std::make_shared<PDFStream>(qMove(updatedDictionary), qMove(compressedSubset)));
+                }
+            }
+            catch (const PDFException&)
+            {
+                // Font program is invalid, or it can't be subsetted, leave it as it is
+            }
+        };
+        PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Unknown, range.begin(), range.end(), processFontProgram);
+
+        std::map<PDFObjectReference, QByteArray> fontProgramTags;
+        for (size_t i = 0; i < fontPrograms.size(); ++i)
+        {
+            if (!subsetTags[i].isEmpty())
+            {
+                fontProgramTags[fontPrograms[i].first] = subsetTags[i];
+            }
+        }
+
+        renameSubsetFonts(objects, fontProgramTags);
+    }
+    catch (const PDFException&)
+    {
+        // Document is damaged, fonts can't be processed
+        Q_EMIT optimizationProgress(tr("Fonts can't be subsetted, document is invalid."));
+        return false;
+    }
+
+    m_storage.setObjects(qMove(objects));
+    Q_EMIT optimizationProgress(tr("Fonts subsetted: %1, bytes saved: %2").arg(fontsSubsetted).arg(bytesSaved));
+    if (!otherFontPrograms.empty())
+    {
+        Q_EMIT optimizationProgress(tr("Fonts not subsetted (only TrueType and CFF fonts can be subsetted): %1").arg(otherFontPrograms.size()));
+    }
+
+    return false;
+}
+
+void PDFOptimizer::renameSubsetFonts(PDFObjectStorage::PDFObjects& objects, const std::map<PDFObjectReference, QByteArray>& fontProgramTags)
+{
+    if (fontProgramTags.empty())
+    {
+        return;
+    }
+
+    auto findTag = [](const std::map<PDFObjectReference, QByteArray>& tags, const PDFObject& object) -> QByteArray
+    {
+        if (object.isReference())
+        {
+            auto it = tags.find(object.getReference());
+            if (it != tags.cend())
+            {
+                return it->second;
+            }
+        }
+        return QByteArray();
+    };
+
+    auto renameFont = [](const PDFObject& object, const char* key, const QByteArray& tag)
+    {
+        PDFDictionary dictionary = *object.getDictionary();
+        const PDFObject& nameObject = dictionary.get(key);
+        if (nameObject.isName())
+        {
+            dictionary.setEntry(PDFInplaceOrMemoryString(key), PDFObject::createName(PDFTrueTypeFontSubsetter::getSubsetFontName(nameObject.getString(), tag)));
+        }
+        return PDFObject::createDictionary(std::make_shared<PDFDictionary>(qMove(dictionary)));
+    };
+
+    // Font descriptors of the subsetted font programs
+    std::map<PDFObjectReference, QByteArray> fontDescriptorTags;
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+        PDFObjectStorage::Entry& entry = objects[i];
+        if (!entry.object.isDictionary())
+        {
+            continue;
+        }
+
+        const QByteArray tag = findTag(fontProgramTags, entry.object.getDictionary()->get("FontFile2"));
+        if (!tag.isEmpty())
+        {
+            entry.object = renameFont(entry.object, "FontName", tag);
+            fontDescriptorTags[PDFObjectReference(PDFInteger(i), entry.generation)] = tag;
+        }
+    }
+
+    // Simple fonts and CID fonts using the font descriptors. Font descriptor can be also a direct object.
+    std::map<PDFObjectReference, QByteArray> fontTags;
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+        PDFObjectStorage::Entry& entry = objects[i];
+        if (!entry.object.isDictionary())
+        {
+            continue;
+        }
+
+        const PDFObject& fontDescriptorObject = entry.object.getDictionary()->get("FontDescriptor");
+        QByteArray tag = findTag(fontDescriptorTags, fontDescriptorObject);
+        if (tag.isEmpty() && fontDescriptorObject.isDictionary())
+        {
+            tag = findTag(fontProgramTags, fontDescriptorObject.getDictionary()->get("FontFile2"));
+            if (!tag.isEmpty())
+            {
+                PDFDictionary dictionary = *entry.object.getDictionary();
+                dictionary.setEntry(PDFInplaceOrMemoryString("FontDescriptor"), renameFont(fontDescriptorObject, "FontName", tag));
+                entry.object = PDFObject::createDictionary(std::make_shared<PDFDictionary>(qMove(dictionary)));
+            }
+        }
+
+        if (!tag.isEmpty())
+        {
+            entry.object = renameFont(entry.object, "BaseFont", tag);
+            fontTags[PDFObjectReference(PDFInteger(i), entry.generation)] = tag;
+        }
+    }
+
+    // Type 0 fonts using the CID fonts
+    for (PDFObjectStorage::Entry& entry : objects)
+    {
+        if (!entry.object.isDictionary())
+        {
+            continue;
+        }
+
+        const PDFObject& descendantFontsObject = entry.object.getDictionary()->get("DescendantFonts");
+        if (descendantFontsObject.isArray() && descendantFontsObject.getArray()->getCount() > 0)
+        {
+            const QByteArray tag = findTag(fontTags, descendantFontsObject.getArray()->getItem(0));
+            if (!tag.isEmpty())
+            {
+                entry.object = renameFont(entry.object, "BaseFont", tag);
+            }
+        }
+    }
+}
+
+PDFObject PDFOptimizer::recompressImage(const PDFDocument* document,
+                                        const PDFStream* stream,
+                                        QSizeF placementSize,
+                                        bool isSoftMask,
+                                        bool* isDownsampled) const
+{
+    const PDFDictionary* dictionary = stream->getDictionary();
+    PDFDocumentDataLoaderDecorator loader(document);
+
+    if (dictionary->hasKey(PDF_STREAM_DICT_FILE_SPECIFICATION) || loader.readNameFromDictionary(dictionary, "Subtype") != "Image")
+    {
+        // Not an image, or external file stream
+        return PDFObject();
+    }
+
+    // Determine the image filter (last filter in the filter list)
+    const PDFObject& filterObject = document->getObject(dictionary->get(PDF_STREAM_DICT_FILTER));
+    QByteArray imageFilterName;
+    if (filterObject.isName())
+    {
+        imageFilterName = filterObject.getString();
+    }
+    else if (filterObject.isArray())
+    {
+        std::vector<QByteArray> filterNames = loader.readNameArray(filterObject);
+        if (!filterNames.empty())
+        {
+            imageFilterName = filterNames.back();
+        }
+    }
+
+    if (imageFilterName == "JPXDecode" || imageFilterName == "JBIG2Decode")
+    {
+        // These compressions usually perform better than ours
+        return PDFObject();
+    }
+
+    if (document->getObject(dictionary->get("Mask")).isArray())
+    {
+        // Color key masking is defined by exact sample values, which
+        // are changed by downsampling or by lossy compression.
+        return PDFObject();
+    }
+
+    const bool isDCT = imageFilterName == "DCTDecode" || imageFilterName == "DCT";
+    const bool isImageMask = loader.readBooleanFromDictionary(dictionary, "ImageMask", false);
+
+    PDFColorSpacePointer colorSpace;
+    if (isSoftMask)
+    {
+        colorSpace.reset(new PDFDeviceGrayColorSpace());
+    }
+    else if (!isImageMask)
+    {
+        colorSpace = PDFAbstractColorSpace::createColorSpace(nullptr, document, document->getObject(dictionary->get("ColorSpace")));
+    }
+
+    PDFRenderErrorReporterDummy errorReporter;
+    PDFImage image = PDFImage::createImage(document, stream, colorSpace, isSoftMask, RenderingIntent::Perceptual, &errorReporter);
+    const PDFImageData& imageData = image.getImageData();
+
+    if (!imageData.isValid() || imageData.getData().size() < qsizetype(imageData.getStride()) * imageData.getHeight())
+    {
+        return PDFObject();
+    }
+
+    const unsigned int bitsPerComponent = imageData.getBitsPerComponent();
+    const unsigned int components = imageData.getComponents();
+    const bool isMonochrome = bitsPerComponent == 1 && components == 1;
+    if (!isMonochrome && bitsPerComponent != 8)
+    {
+        return PDFObject();
+    }
+
+    const bool isIndexed = colorSpace && colorSpace->getColorSpace() == PDFAbstractColorSpace::ColorSpace::Indexed;
+
+    // Soft mask with Matte entry must have the same size as the parent image
+    const PDFObject& softMaskObject = document->getObject(dictionary->get("SMask"));
+    const bool hasMatte = softMaskObject.isStream() && softMaskObject.getStream()->getDictionary()->hasKey("Matte");
+
+    // Downsample the image, if its resolution on the page exceeds the target resolution
+    PDFImageData downsampledImageData;
+    const PDFImageData* outputImageData = &imageData;
+    if (!isMonochrome && !hasMatte && placementSize.isValid())
+    {
+        const PDFReal requiredWidth = placementSize.width() / 72.0 * m_imageSettings.targetDpi;
+        const PDFReal requiredHeight = placementSize.height() / 72.0 * m_imageSettings.targetDpi;
+        const PDFReal scale = qMax(requiredWidth / imageData.getWidth(), requiredHeight / imageData.getHeight());
+
+        if (scale * m_imageSettings.dpiThreshold < 1.0)
+        {
+            const unsigned int width = static_cast<unsigned int>(qBound(1, qCeil(imageData.getWidth() * scale), int(imageData.getWidth())));
+            const unsigned int height = static_cast<unsigned int>(qBound(1, qCeil(imageData.getHeight() * scale), int(imageData.getHeight())));
+
+            downsampledImageData = PDFImageDataEncoder::downsample(imageData, width, height, isIndexed);
+            outputImageData = &downsampledImageData;
+            *isDownsampled = true;
+        }
+    }
+
+    if (isDCT && !*isDownsampled)
+    {
+        // Do not recompress DCT image again, we would lose quality for nothing
+        // (and lossless compression of the decoded image is usually larger).
+        return PDFObject();
+    }
+
+    QByteArray encodedData;
+    QByteArray filterName;
+    PDFObject decodeParameters;
+    PDFObjectFactory factory;
+
+    if (isMonochrome && m_imageSettings.useCCITTForMonochrome)
+    {
+        encodedData = PDFCCITTFaxEncoder::encode(*outputImageData);
+        filterName = "CCITTFaxDecode";
+
+        factory.beginDictionary();
+        factory.beginDictionaryItem("K");
+        factory << PDFInteger(-1);
+        factory.endDictionaryItem();
+        factory.beginDictionaryItem("Columns");
+        factory << PDFInteger(outputImageData->getWidth());
+        factory.endDictionaryItem();
+        factory.beginDictionaryItem("Rows");
+        factory << PDFInteger(outputImageData->getHeight());
+        factory.endDictionaryItem();
+        factory.endDictionary();
+        decodeParameters = factory.takeObject();
+    }
+    else
+    {
+        const bool canUseDCT = bitsPerComponent == 8 && (components == 1 || components == 3) && !isIndexed && !isSoftMask;
+
+        bool useDCT = false;
+        switch (m_imageSettings.compression)
+        {
+            case ImageCompression::Auto:
+                useDCT = isDCT;
+                break;
+
+            case ImageCompression::Flate:
+                useDCT = false;
+                break;
+
+            case ImageCompression::DCT:
+                useDCT = true;
+                break;
+        }
+
+        if (useDCT && canUseDCT)
+        {
+            encodedData = PDFImageDataEncoder::encodeDCT(*outputImageData, m_imageSettings.jpegQuality);
+            filterName = "DCTDecode";
+        }
+        else
+        {
+            encodedData = PDFImageDataEncoder::encodeFlate(*outputImageData);
+            filterName = "FlateDecode";
+
+            factory.beginDictionary();
+            factory.beginDictionaryItem("Predictor");
+            factory << PDFInteger(15);
+            factory.endDictionaryItem();
+            factory.beginDictionaryItem("Colors");
+            factory << PDFInteger(components);
+            factory.endDictionaryItem();
+            factory.beginDictionaryItem("BitsPerComponent");
+            factory << PDFInteger(bitsPerComponent);
+            factory.endDictionaryItem();
+            factory.beginDictionaryItem("Columns");
+            factory << PDFInteger(outputImageData->getWidth());
+            factory.endDictionaryItem();
+            factory.endDictionary();
+            decodeParameters = factory.takeObject();
+        }
+    }
+
+    if (encodedData.size() >= stream->getContent()->size())
+    {
+        // Recompressed image is not smaller, use original one
+        *isDownsampled = false;
+        return PDFObject();
+    }
+
+    PDFDictionary updatedDictionary = *dictionary;
+    updatedDictionary.setEntry(PDFInplaceOrMemoryString(PDF_STREAM_DICT_FILTER), PDFObject::createName(filterName));
+    if (!decodeParameters.isNull())
+    {
+        updatedDictionary.setEntry(PDFInplaceOrMemoryString(PDF_STREAM_DICT_DECODE_PARMS), qMove(decodeParameters));
+    }
+    else
+    {
+        updatedDictionary.removeEntry(PDF_STREAM_DICT_DECODE_PARMS);
+    }
+    updatedDictionary.setEntry(PDFInplaceOrMemoryString(PDF_STREAM_DICT_LENGTH), PDFObject::createInteger(encodedData.size()));
+    updatedDictionary.setEntry(PDFInplaceOrMemoryString("Width"), PDFObject::createInteger(outputImageData->getWidth()));
+    updatedDictionary.setEntry(PDFInplaceOrMemoryString("Height"), PDFObject::createInteger(outputImageData->getHeight()));
+    updatedDictionary.setEntry(PDFInplaceOrMemoryString("BitsPerComponent"), PDFObject::createInteger(bitsPerComponent));
+    updatedDictionary.removeEntry(PDF_STREAM_DICT_DECODED_LENGTH);
+
+    // Decode array of decoded image data can differ from the dictionary,
+    // for example, when CCITT image with BlackIs1 entry was decoded.
+    if (!imageData.getDecode().empty())
+    {
+        factory << imageData.getDecode();
+        updatedDictionary.setEntry(PDFInplaceOrMemoryString("Decode"), factory.takeObject());
+    }
+    else
+    {
+        updatedDictionary.removeEntry("Decode");
+    }
+
+    return PDFObject::createStream(std::make_shared<PDFStream>(qMove(updatedDictionary), qMove(encodedData)));
+}
+
 }   // namespace pdf
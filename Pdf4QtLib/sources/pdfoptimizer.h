@@ -19,8 +19,12 @@
 #define PDFOPTIMIZER_H
 
 #include "pdfdocument.h"
+#include "pdfdocumentwriter.h"
 
 #include <QObject>
+#include <QSizeF>
+
+#include <map>
 
 namespace pdf
 {
@@ -44,10 +48,32 @@ public:
         MergeIdenticalObjects       = 0x0008, ///< Merge identical objects
         ShrinkObjectStorage         = 0x0010, ///< Shrink object storage, so unused objects are filled with used (and generation number increased)
         RecompressFlateStreams      = 0x0020, ///< Flate streams are recompressed with maximal compression
-        All                         = 0xFFFF, ///< All optimizations turned on
+        CompressObjectStreams       = 0x0040, ///< Objects are packed into compressed object streams, when optimized document is written
+        RecompressImages            = 0x0080, ///< Images are downsampled to the target resolution and recompressed (lossy)
+        SubsetFonts                 = 0x0100, ///< Embedded TrueType and CFF fonts are reduced to glyphs, which are used in the document (glyphs are lost for editing)
+        All                         = 0x007F, ///< All optimizations, which don't change the document content, turned on. Lossy optimizations must be turned on explicitly.
     };
     Q_DECLARE_FLAGS(OptimizationFlags, OptimizationFlag)
 
+    enum class ImageCompression
+    {
+        Auto,   ///< DCT compression is used for images already compressed by DCT, Flate otherwise
+        Flate,  ///< Lossless Flate compression with PNG predictors
+        DCT     ///< Lossy DCT (JPEG) compression, used where it is possible
+    };
+
+    /// Settings of the image recompression. Image is downsampled only, if its
+    /// resolution (determined by its placement on pages) exceeds target resolution
+    /// multiplied by the threshold. Monochromatic images are never downsampled.
+    struct ImageSettings
+    {
+        PDFReal targetDpi = 150.0;
+        PDFReal dpiThreshold = 1.5;
+        ImageCompression compression = ImageCompression::Auto;
+        int jpegQuality = 85;
+        bool useCCITTForMonochrome = true;
+    };
+
     explicit PDFOptimizer(OptimizationFlags flags, QObject* parent);
 
     /// Set document, which should be optimalized
@@ -75,6 +101,13 @@ public:
     OptimizationFlags getFlags() const;
     void setFlags(OptimizationFlags flags);
 
+    /// Returns flags of the document writer, which should be used
+    /// to write the optimized document.
+    PDFDocumentWriter::WriteFlags getWriteFlags() const;
+
+    const ImageSettings& getImageSettings() const { return m_imageSettings; }
+    void setImageSettings(const ImageSettings& imageSettings) { m_imageSettings = imageSettings; }
+
 signals:
     void optimizationStarted();
     void optimizationProgress(QString progressText);
@@ -87,8 +120,30 @@ private:
     bool performMergeIdenticalObjects();
     bool performShrinkObjectStorage();
     bool performRecompressFlateStreams();
+    bool performRecompressImages();
+    bool performSubsetFonts();
+
+    /// Recompresses the image. If image can't be recompressed, or recompressed
+    /// image is not smaller, then null object is returned.
+    /// \param document Document
+    /// \param stream Image stream
+    /// \param placementSize Maximal size of the image on the pages (in points), invalid size, if unknown
+    /// \param isSoftMask Is image used as a soft mask?
+    /// \param isDownsampled Is set to true, if image was downsampled
+    PDFObject recompressImage(const PDFDocument* document,
+                              const PDFStream* stream,
+                              QSizeF placementSize,
+                              bool isSoftMask,
+                              bool* isDownsampled) const;
+
+    /// Prefixes names of the subsetted fonts (BaseFont of the font and FontName
+    /// of the font descriptor) with the subset tag.
+    /// \param objects Objects of the document
+    /// \param fontProgramTags Subset tags of the subsetted font programs
+    static void renameSubsetFonts(PDFObjectStorage::PDFObjects& objects, const std::map<PDFObjectReference, QByteArray>& fontProgramTags);
 
     OptimizationFlags m_flags;
+    ImageSettings m_imageSettings;
     PDFObjectStorage m_storage;
 };
 
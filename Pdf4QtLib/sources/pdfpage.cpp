@@ -302,7 +302,7 @@ void PDFPage::parseImpl(std::vector<PDFPage>& pages,
                 page.m_pageReference = objectReference;
                 page.m_mediaBox = currentInheritableAttributes.getMediaBox();
                 page.m_cropBox = currentInheritableAttributes.getCropBox();
-                page.m_resources = storage->getObject(currentInheritableAttributes.getResources());
+                page.m_resources = currentInheritableAttributes.getResources();
                 page.m_pageRotation = currentInheritableAttributes.getPageRotation();
 
                 if (!page.m_cropBox.isValid())
@@ -314,7 +314,7 @@ void PDFPage::parseImpl(std::vector<PDFPage>& pages,
                 page.m_bleedBox = loader.readRectangle(dictionary->get("BleedBox"), page.getCropBox());
                 page.m_trimBox = loader.readRectangle(dictionary->get("TrimBox"), page.getCropBox());
                 page.m_artBox = loader.readRectangle(dictionary->get("ArtBox"), page.getCropBox());
-                page.m_contents = storage->getObject(dictionary->get("Contents"));
+                page.m_contents = dictionary->get("Contents");
                 page.m_annots = loader.readReferenceArrayFromDictionary(dictionary, "Annots");
                 page.m_lastModified = PDFEncoding::convertToDateTime(loader.readStringFromDictionary(dictionary, "LastModified"));
                 page.m_thumbnailReference = loader.readReferenceFromDictionary(dictionary, "Thumb");
@@ -156,7 +156,12 @@ public:
     inline const QRectF& getArtBox() const { return m_artBox; }
     inline PageRotation getPageRotation() const { return m_pageRotation; }
 
+    /// Returns resources of the page. Resources are not dereferenced, so objects
+    /// need not to be loaded, until page is processed.
     inline const PDFObject& getResources() const { return m_resources; }
+
+    /// Returns contents of the page (stream or array of streams). Contents
+    /// are not dereferenced, so they need not to be loaded, until page is processed.
     inline const PDFObject& getContents() const { return m_contents; }
 
     QRectF getRectMM(const QRectF& rect) const;
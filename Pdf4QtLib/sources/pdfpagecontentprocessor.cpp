@@ -19,6 +19,8 @@
 #include "pdfdocument.h"
 #include "pdfexception.h"
 #include "pdfimage.h"
+#include "pdfimagecache.h"
+#include "pdfcms.h"
 #include "pdfpattern.h"
 #include "pdfexecutionpolicy.h"
 #include "pdfstreamfilters.h"
@@ -26,6 +28,9 @@
 
 #include <QPainterPathStroker>
 
+#include <array>
+#include <functional>
+
 namespace pdf
 {
 
@@ -157,24 +162,127 @@ static constexpr const std::pair<const char*, PDFPageContentProcessor::Operator>
     { "EX", PDFPageContentProcessor::Operator::CompatibilityEnd }
 };
 
+/// Perfect hash of the operators. Each operator has at most three characters,
+/// so it is packed into 32-bit key together with its length (so name containing
+/// zero bytes can't match shorter operator), and the key is then hashed by
+/// multiplicative hashing.
+/// Multiplier was chosen so that no two operators share the same slot of the table,
+/// so operator is found by a single table lookup and a single key comparison.
+/// Table is created at compile time and its perfectness is also checked at compile time.
+class PDFOperatorPerfectHash
+{
+public:
+    static constexpr int MAX_OPERATOR_LENGTH = 3;
+    static constexpr uint32_t MULTIPLIER = 0x18128D91;
+    static constexpr uint32_t TABLE_BITS = 8;
+    static constexpr size_t TABLE_SIZE = size_t(1) << TABLE_BITS;
+
+    struct Entry
+    {
+        uint32_t key = 0;
+        PDFPageContentProcessor::Operator op = PDFPageContentProcessor::Operator::Invalid;
+    };
+
+    using Table = std::array<Entry, TABLE_SIZE>;
+
+    static constexpr uint32_t getKey(const char* string)
+    {
+        uint32_t key = 0;
+        int length = 0;
+        for (; string[length]; ++length)
+        {
+            key |= uint32_t(uint8_t(string[length])) << (8 * length);
+        }
+        return key | (uint32_t(length) << 24);
+    }
+
+    static constexpr uint32_t getHash(uint32_t key)
+    {
+        return (key * MULTIPLIER) >> (32 - TABLE_BITS);
+    }
+
+    static constexpr Table createTable()
+    {
+        Table table = { };
+        for (const auto& operatorDescriptor : operators)
+        {
+            const uint32_t key = getKey(operatorDescriptor.first);
+            table[getHash(key)] = Entry{ key, operatorDescriptor.second };
+        }
+        return table;
+    }
+
+    /// Returns true, if each operator has its own slot in the table
+    static constexpr bool isPerfect(const Table& table)
+    {
+        for (const auto& operatorDescriptor : operators)
+        {
+            const uint32_t key = getKey(operatorDescriptor.first);
+            const Entry& entry = table[getHash(key)];
+
+            if (entry.key != key || entry.op != operatorDescriptor.second)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Finds operator by its name, if it is not found, Operator::Invalid is returned
+    /// \param command Command (operator name)
+    static inline PDFPageContentProcessor::Operator getOperator(QByteArrayView command);
+};
+
+static constexpr PDFOperatorPerfectHash::Table operatorTable = PDFOperatorPerfectHash::createTable();
+static_assert(PDFOperatorPerfectHash::isPerfect(operatorTable), "Operator hash table is not perfect, change the multiplier.");
+
+inline PDFPageContentProcessor::Operator PDFOperatorPerfectHash::getOperator(QByteArrayView command)
+{
+    if (command.size() > MAX_OPERATOR_LENGTH)
+    {
+        return PDFPageContentProcessor::Operator::Invalid;
+    }
+
+    uint32_t key = uint32_t(command.size()) << 24;
+    for (qsizetype i = 0; i < command.size(); ++i)
+    {
+        key |= uint32_t(uint8_t(command[i])) << (8 * i);
+    }
+
+    const Entry& entry = operatorTable[getHash(key)];
+    return (entry.key == key) ? entry.op : PDFPageContentProcessor::Operator::Invalid;
+}
+
+PDFPageContentProcessor::Operator PDFPageContentProcessor::getOperator(QByteArrayView command)
+{
+    return PDFOperatorPerfectHash::getOperator(command);
+}
+
 void PDFPageContentProcessor::initDictionaries(const PDFObject& resourcesObject)
 {
-    const PDFObject& resources = m_document->getObject(resourcesObject);
-    auto getDictionary = [this, &resources](const char* resourceName) -> const pdf::PDFDictionary*
+    const PDFObject resources = m_document->getObject(resourcesObject);
+    auto getDictionaryObject = [this, &resources](const char* resourceName) -> PDFObject
     {
         if (resources.isDictionary() && resources.getDictionary()->hasKey(resourceName))
         {
-            const PDFObject& resourceDictionary = m_document->getObject(resources.getDictionary()->get(resourceName));
+            PDFObject resourceDictionary = m_document->getObject(resources.getDictionary()->get(resourceName));
             if (resourceDictionary.isDictionary())
             {
-                return resourceDictionary.getDictionary();
+                return resourceDictionary;
             }
         }
 
-        return nullptr;
+        return PDFObject();
+    };
+    auto getDictionary = [&getDictionaryObject](const char* resourceName) -> const pdf::PDFDictionary*
+    {
+        const PDFObject resourceDictionary = getDictionaryObject(resourceName);
+        return resourceDictionary.isDictionary() ? resourceDictionary.getDictionary() : nullptr;
     };
 
-    m_colorSpaceDictionary = getDictionary(COLOR_SPACE_DICTIONARY);
+    // Color space dictionary is held, because its address is used as a key in the color space cache
+    m_colorSpaceDictionaryObject = getDictionaryObject(COLOR_SPACE_DICTIONARY);
+    m_colorSpaceDictionary = m_colorSpaceDictionaryObject.isDictionary() ? m_colorSpaceDictionaryObject.getDictionary() : nullptr;
     m_fontDictionary = getDictionary("Font");
     m_xobjectDictionary = getDictionary("XObject");
     m_extendedGraphicStateDictionary = getDictionary(PDF_RESOURCE_EXTGSTATE);
@@ -300,7 +408,8 @@ void PDFPageContentProcessor::initializeProcessor()
 
 QList<PDFRenderError> PDFPageContentProcessor::processContents()
 {
-    const PDFObject& contents = m_page->getContents();
+    const PDFObject& contentsObject = m_page->getContents();
+    const PDFObject contents = m_document->getObject(contentsObject);
 
     // Initialize stream processor
     initializeProcessor();
@@ -318,10 +427,11 @@ QList<PDFRenderError> PDFPageContentProcessor::processContents()
                 break;
             }
 
-            const PDFObject& streamObject = m_document->getObject(array->getItem(i));
+            const PDFObject& streamObjectOrReference = array->getItem(i);
+            const PDFObject& streamObject = m_document->getObject(streamObjectOrReference);
             if (streamObject.isStream())
             {
-                processContentStream(streamObject.getStream());
+                processContentStream(streamObject.getStream(), streamObjectOrReference.isReference() ? streamObjectOrReference.getReference() : PDFObjectReference());
             }
             else
             {
@@ -331,7 +441,8 @@ QList<PDFRenderError> PDFPageContentProcessor::processContents()
     }
     else if (contents.isStream())
     {
-        processContentStream(contents.getStream());
+        const PDFObjectReference contentsReference = contentsObject.isReference() ? contentsObject.getReference() : PDFObjectReference();
+        processContentStream(contents.getStream(), contentsReference);
     }
     else
     {
@@ -399,6 +510,21 @@ void PDFPageContentProcessor::performImagePainting(const QImage& image)
     Q_UNUSED(image);
 }
 
+void PDFPageContentProcessor::performImagePyramidPainting(const PDFImagePyramid& imagePyramid)
+{
+    performImagePainting(imagePyramid.getImage());
+}
+
+bool PDFPageContentProcessor::isImageCacheUsed() const
+{
+    return false;
+}
+
+PDFReal PDFPageContentProcessor::getImageResolution() const
+{
+    return 0.0;
+}
+
 void PDFPageContentProcessor::performMeshPainting(const PDFMesh& mesh)
 {
     Q_UNUSED(mesh);
@@ -473,6 +599,11 @@ void PDFPageContentProcessor::performOutputCharacter(const PDFTextCharacterInfo&
     Q_UNUSED(info);
 }
 
+void PDFPageContentProcessor::performTextSequence(const TextSequence& textSequence)
+{
+    Q_UNUSED(textSequence);
+}
+
 void PDFPageContentProcessor::performTextBegin(ProcessOrder order)
 {
     Q_UNUSED(order);
@@ -528,181 +659,59 @@ PDFPageContentProcessor::PDFTransparencyGroup PDFPageContentProcessor::parseTran
 
 void PDFPageContentProcessor::processContent(const QByteArray& content)
 {
-    PDFLexicalAnalyzer parser(content.constBegin(), content.constEnd());
+    processBytecode(PDFContentStreamBytecode::compile(content, m_document));
+}
 
-    while (!parser.isAtEnd() && !isProcessingCancelled())
+void PDFPageContentProcessor::processBytecode(const PDFContentStreamBytecode& bytecode)
+{
+    for (const PDFContentStreamBytecode::Instruction& instruction : bytecode.getInstructions())
     {
-        bool tokenFetched = false;
-        PDFInteger oldParserPosition = parser.pos();
+        if (isProcessingCancelled())
+        {
+            break;
+        }
 
-        try
+        // Push the operands onto the operand stack
+        for (uint32_t i = 0; i < instruction.operandCount; ++i)
         {
-            PDFLexicalAnalyzer::Token token = parser.fetch();
-            tokenFetched = true;
+            m_operands.push_back(bytecode.getOperand(instruction.firstOperand + i));
+        }
 
-            switch (token.type)
+        try
+        {
+            switch (instruction.type)
             {
-                case PDFLexicalAnalyzer::TokenType::Command:
+                case PDFContentStreamBytecode::InstructionType::Command:
                 {
-                    QByteArray command = token.data.toByteArray();
-
-                    if (command == "BI")
-                    {
-                        // Strategy: We will try to find position of BI/ID/EI in the stream. If we can determine
-                        // length of the stream explicitly, then we use explicit length. We also create a PDFObject
-                        // from the inline image dictionary/image content stream and then process it like XObject.
-                        PDFInteger operatorBIPosition = parser.pos();
-                        PDFInteger operatorIDPosition = parser.findSubstring("ID", operatorBIPosition);
-                        PDFInteger operatorEIPosition = parser.findSubstring("EI", operatorIDPosition);
-
-                        // According the PDF 1.7 specification, single white space characters is after ID, then the byte
-                        // immediately after it is interpreted as first byte of image data.
-                        PDFInteger startDataPosition = operatorIDPosition + 3;
-
-                        if (operatorIDPosition == -1 || operatorEIPosition == -1)
-                        {
-                            throw PDFException(PDFTranslationContext::tr("Invalid inline image dictionary, ID operator is missing."));
-                        }
-
-                        Q_ASSERT(operatorBIPosition < content.size());
-                        Q_ASSERT(operatorIDPosition < content.size());
-                        Q_ASSERT(operatorBIPosition <= operatorIDPosition);
-
-                        PDFLexicalAnalyzer inlineImageLexicalAnalyzer(content.constBegin() + operatorBIPosition, content.constBegin() + operatorIDPosition);
-                        PDFParser inlineImageParser([&inlineImageLexicalAnalyzer]{ return inlineImageLexicalAnalyzer.fetch(); });
-
-                        constexpr std::pair<const char*, const char*> replacements[] =
-                        {
-                            { "BPC", "BitsPerComponent" },
-                            { "CS", "ColorSpace" },
-                            { "D", "Decode" },
-                            { "DP", "DecodeParms" },
-                            { "F", "Filter" },
-                            { "H", "Height" },
-                            { "IM", "ImageMask" },
-                            { "I", "Interpolate" },
-                            { "W", "Width" },
-                            { "L", "Length" },
-                            { "G", "DeviceGray" },
-                            { "RGB", "DeviceRGB" },
-                            { "CMYK", "DeviceCMYK" }
-                        };
-
-                        std::shared_ptr<PDFDictionary> dictionarySharedPointer = std::make_shared<PDFDictionary>();
-                        PDFDictionary* dictionary = dictionarySharedPointer.get();
-
-                        while (inlineImageParser.lookahead().type != PDFLexicalAnalyzer::TokenType::EndOfFile)
-                        {
-                            PDFObject nameObject = inlineImageParser.getObject();
-                            PDFObject valueObject = inlineImageParser.getObject();
-
-                            if (!nameObject.isName())
-                            {
-                                throw PDFException(PDFTranslationContext::tr("Expected name in the inline image dictionary stream."));
-                            }
-
-                            // Replace the name, if neccessary
-                            QByteArray name = nameObject.getString();
-                            for (auto [string, replacement] : replacements)
-                            {
-                                if (name == string)
-                                {
-                                    name = replacement;
-                                    break;
-                                }
-                            }
-
-                            dictionary->addEntry(PDFInplaceOrMemoryString(qMove(name)), qMove(valueObject));
-                        }
-
-                        PDFDocumentDataLoaderDecorator loader(m_document);
-                        PDFInteger dataLength = 0;
-
-                        if (dictionary->hasKey("Length"))
-                        {
-                            dataLength = loader.readIntegerFromDictionary(dictionary, "Length", 0);
-                        }
-                        else if (dictionary->hasKey("Filter"))
-                        {
-                            dataLength = -1;
-
-                            // We will try to use stream filter hint
-                            QByteArray filterName = loader.readNameFromDictionary(dictionary, "Filter");
-                            if (!filterName.isEmpty())
-                            {
-                                dataLength = PDFStreamFilterStorage::getStreamDataLength(content, filterName, startDataPosition);
-                            }
-
-                            if (dataLength == -1)
-                            {
-                                // We will use EI operator position to determine stream length
-                                dataLength = operatorEIPosition - startDataPosition;
-                            }
-                        }
-                        else
-                        {
-                            // We will calculate stream size from the with/height and bit per component
-                            const PDFInteger width = loader.readIntegerFromDictionary(dictionary, "Width", 0);
-                            const PDFInteger height = loader.readIntegerFromDictionary(dictionary, "Height", 0);
-                            const PDFInteger bpc = loader.readIntegerFromDictionary(dictionary, "BitsPerComponent", 8);
-
-                            if (width <= 0 || height <= 0 || bpc <= 0)
-                            {
-                                throw PDFException(PDFTranslationContext::tr("Expected name in the inline image dictionary stream."));
-                            }
-
-                            const PDFInteger stride = (width * bpc + 7) / 8;
-                            dataLength = stride * height;
-                        }
-
-                        // We will once more find the "EI" operator, due to recomputed dataLength.
-                        operatorEIPosition = parser.findSubstring("EI", startDataPosition + dataLength);
-                        if (operatorEIPosition == -1)
-                        {
-                            throw PDFException(PDFTranslationContext::tr("Invalid inline image stream."));
-                        }
-
-                        // We must seek after EI operator. Then we will paint the image. Because painting of image can throw exception,
-                        // then we will paint the image AFTER we seek the position.
-                        parser.seek(operatorEIPosition + 2);
-
-                        QByteArray buffer = content.mid(startDataPosition, dataLength);
-                        PDFStream imageStream(std::move(*dictionary), std::move(buffer));
-                        paintXObjectImage(&imageStream);
-                    }
-                    else
-                    {
-                        // Process the command, then clear the operand stack
-                        processCommand(command);
-                    }
+                    // Process the command, then clear the operand stack
+                    processCommand(bytecode.getCommand(instruction));
+                    m_operands.clear();
+                    break;
+                }
 
+                case PDFContentStreamBytecode::InstructionType::InlineImage:
+                {
+                    paintXObjectImage(bytecode.getInlineImage(instruction), PDFObjectReference());
                     m_operands.clear();
                     break;
                 }
 
-                case PDFLexicalAnalyzer::TokenType::EndOfFile:
+                case PDFContentStreamBytecode::InstructionType::Error:
                 {
-                    // Do nothing, just break, we are at the end
+                    m_operands.clear();
+                    m_errorList.append(PDFRenderError(RenderErrorType::Error, bytecode.getError(instruction)));
                     break;
                 }
 
-                default:
+                case PDFContentStreamBytecode::InstructionType::Operands:
                 {
-                    // Push the operand onto the operand stack
-                    m_operands.push_back(std::move(token));
+                    // Operands are processed by the command in the next content stream
                     break;
                 }
             }
         }
         catch (const PDFException& exception)
         {
-            // If we get exception when parsing, and parser position is not advanced,
-            // then we must advance it manually, otherwise we get infinite loop.
-            if (!tokenFetched && oldParserPosition == parser.pos() && !parser.isAtEnd())
-            {
-                parser.seek(parser.pos() + 1);
-            }
-
             m_operands.clear();
             m_errorList.append(PDFRenderError(RenderErrorType::Error, exception.getMessage()));
         }
@@ -712,15 +721,32 @@ void PDFPageContentProcessor::processContent(const QByteArray& content)
             m_errorList.append(exception.getError());
         }
     }
+
+    // Operands can be split between multiple content streams, so remaining
+    // operands must not refer to the content, which can be destroyed.
+    for (size_t i = 0; i < m_operands.size(); ++i)
+    {
+        m_operands[i].detach();
+    }
 }
 
-void PDFPageContentProcessor::processContentStream(const PDFStream* stream)
+PDFContentStreamBytecodePointer PDFPageContentProcessor::getContentStreamBytecode(const PDFStream* stream, PDFObjectReference reference) const
 {
-    try
+    PDFContentStreamBytecodeCache* cache = m_document->getContentStreamBytecodeCache();
+    if (cache && reference.isValid())
     {
-        QByteArray content = m_document->getDecodedStream(stream);
+        return cache->getBytecode(m_document, reference, stream);
+    }
 
-        processContent(content);
+    return std::make_shared<const PDFContentStreamBytecode>(PDFContentStreamBytecode::compile(m_document->getDecodedStream(stream), m_document));
+}
+
+void PDFPageContentProcessor::processContentStream(const PDFStream* stream, PDFObjectReference reference)
+{
+    try
+    {
+        PDFContentStreamBytecodePointer bytecode = getContentStreamBytecode(stream, reference);
+        processBytecode(*bytecode);
     }
     catch (const PDFException& exception)
     {
@@ -735,6 +761,16 @@ void PDFPageContentProcessor::processForm(const QTransform& matrix,
                                           const PDFObject& transparencyGroup,
                                           const QByteArray& content,
                                           PDFInteger formStructuralParent)
+{
+    processForm(matrix, boundingBox, resources, transparencyGroup, PDFContentStreamBytecode::compile(content, m_document), formStructuralParent);
+}
+
+void PDFPageContentProcessor::processForm(const QTransform& matrix,
+                                          const QRectF& boundingBox,
+                                          const PDFObject& resources,
+                                          const PDFObject& transparencyGroup,
+                                          const PDFContentStreamBytecode& bytecode,
+                                          PDFInteger formStructuralParent)
 {
     PDFPageContentProcessorStateGuard guard(this);
     PDFTemporaryValueChange structuralParentChangeGuard(&m_structuralParentKey, formStructuralParent);
@@ -785,7 +821,7 @@ void PDFPageContentProcessor::processForm(const QTransform& matrix,
         initDictionaries(resources);
     }
 
-    processContent(content);
+    processBytecode(bytecode);
 }
 
 void PDFPageContentProcessor::processPathPainting(const QPainterPath& path, bool stroke, bool fill, bool text, Qt::FillRule fillRule)
@@ -1074,7 +1110,7 @@ void PDFPageContentProcessor::processTillingPatternPainting(const PDFTilingPatte
     const QRectF boundingBox = tilingPattern->getBoundingBox();
     const PDFReal xStep = qAbs(tilingPattern->getXStep());
     const PDFReal yStep = qAbs(tilingPattern->getYStep());
-    const QByteArray& content = tilingPattern->getContent();
+    const PDFContentStreamBytecode bytecode = PDFContentStreamBytecode::compile(tilingPattern->getContent(), m_document);
     QPainterPath boundingPath;
     boundingPath.addRect(boundingBox);
 
@@ -1100,7 +1136,7 @@ void PDFPageContentProcessor::processTillingPatternPainting(const PDFTilingPatte
             updateGraphicState();
 
             performClipping(boundingPath, boundingPath.fillRule());
-            processContent(content);
+            processBytecode(bytecode);
 
             if (isProcessingCancelled())
             {
@@ -1115,19 +1151,9 @@ void PDFPageContentProcessor::processTillingPatternPainting(const PDFTilingPatte
     }
 }
 
-void PDFPageContentProcessor::processCommand(const QByteArray& command)
+void PDFPageContentProcessor::processCommand(QByteArrayView command)
 {
-    Operator op = Operator::Invalid;
-
-    // Find the command in the command array
-    for (const std::pair<const char*, PDFPageContentProcessor::Operator>& operatorDescriptor : operators)
-    {
-        if (command == operatorDescriptor.first)
-        {
-            op = operatorDescriptor.second;
-            break;
-        }
-    }
+    const Operator op = PDFOperatorPerfectHash::getOperator(command);
 
     switch (op)
     {
@@ -1845,6 +1871,59 @@ void PDFPageContentProcessor::finishMarkedContent()
     }
 }
 
+PDFColorSpacePointer PDFPageContentProcessor::getColorSpaceByName(const QByteArray& name)
+{
+    auto key = std::make_pair(m_colorSpaceDictionary, name);
+    auto it = m_colorSpaceCache.find(key);
+    if (it != m_colorSpaceCache.end())
+    {
+        return it->second.colorSpace;
+    }
+
+    // Cache entry holds the color space dictionary, so dictionary can't be deleted
+    // and its address can't be reused by another dictionary.
+    ColorSpaceCacheEntry entry;
+    entry.colorSpaceDictionary = m_colorSpaceDictionaryObject;
+    entry.colorSpace = PDFAbstractColorSpace::createColorSpace(m_colorSpaceDictionary, m_document, PDFObject::createName(name));
+    PDFColorSpacePointer colorSpace = entry.colorSpace;
+    m_colorSpaceCache.emplace(qMove(key), qMove(entry));
+    return colorSpace;
+}
+
+QColor PDFPageContentProcessor::getMemoizedColor(const PDFColorSpacePointer& colorSpace, const PDFColor& color)
+{
+    const RenderingIntent renderingIntent = m_graphicState.getRenderingIntent();
+
+    size_t hash = std::hash<const void*>()(colorSpace.data()) * 31 + static_cast<size_t>(renderingIntent);
+    for (size_t i = 0; i < color.size(); ++i)
+    {
+        hash = hash * 31 + std::hash<PDFColorComponent>()(color[i]);
+    }
+
+    if (m_colorMemo.empty())
+    {
+        m_colorMemo.resize(COLOR_MEMO_SIZE);
+    }
+
+    // Memo entry holds the color space pointer, so color space can't be deleted
+    // and its address can't be reused by another color space.
+    ColorMemoEntry& entry = m_colorMemo[hash % COLOR_MEMO_SIZE];
+    if (entry.colorSpace == colorSpace && entry.renderingIntent == renderingIntent && entry.color == color)
+    {
+        ++m_colorConversionStatistics.memoHits;
+        return entry.result;
+    }
+
+    ++m_colorConversionStatistics.memoMisses;
+    QColor result = colorSpace->getColor(color, m_CMS, renderingIntent, this, true);
+
+    entry.colorSpace = colorSpace;
+    entry.renderingIntent = renderingIntent;
+    entry.color = color;
+    entry.result = result;
+    return result;
+}
+
 void PDFPageContentProcessor::setOperationControl(const PDFOperationControl* newOperationControl)
 {
     m_operationControl = newOperationControl;
@@ -2105,6 +2184,11 @@ void PDFPageContentProcessor::operatorAdjustCurrentTransformationMatrix(PDFReal
     updateGraphicState();
 }
 
+void PDFPageContentProcessor::reportMissingOperands(size_t operandCount) const
+{
+    throw PDFRendererException(RenderErrorType::Error, PDFTranslationContext::tr("Operator requires %1 operands, but only %2 operands provided.").arg(operandCount).arg(m_operands.size()));
+}
+
 template<>
 PDFReal PDFPageContentProcessor::readOperand<PDFReal>(size_t index) const
 {
@@ -2116,7 +2200,7 @@ PDFReal PDFPageContentProcessor::readOperand<PDFReal>(size_t index) const
         {
             case PDFLexicalAnalyzer::TokenType::Real:
             case PDFLexicalAnalyzer::TokenType::Integer:
-                return token.data.value<PDFReal>();
+                return token.getReal();
 
             default:
                 throw PDFRendererException(RenderErrorType::Error, PDFTranslationContext::tr("Can't read operand (real number) on index %1. Operand is of type '%2'.").arg(index + 1).arg(PDFLexicalAnalyzer::getStringFromOperandType(token.type)));
@@ -2138,7 +2222,7 @@ PDFInteger PDFPageContentProcessor::readOperand<PDFInteger>(size_t index) const
         switch (token.type)
         {
             case PDFLexicalAnalyzer::TokenType::Integer:
-                return token.data.value<PDFInteger>();
+                return token.getInteger();
 
             default:
                 throw PDFRendererException(RenderErrorType::Error, PDFTranslationContext::tr("Can't read operand (integer) on index %1. Operand is of type '%2'.").arg(index + 1).arg(PDFLexicalAnalyzer::getStringFromOperandType(token.type)));
@@ -2160,7 +2244,7 @@ PDFPageContentProcessor::PDFOperandName PDFPageContentProcessor::readOperand<PDF
         switch (token.type)
         {
             case PDFLexicalAnalyzer::TokenType::Name:
-                return PDFOperandName{ token.data.toByteArray() };
+                return PDFOperandName{ token.getString() };
 
             default:
                 throw PDFRendererException(RenderErrorType::Error, PDFTranslationContext::tr("Can't read operand (name) on index %1. Operand is of type '%2'.").arg(index + 1).arg(PDFLexicalAnalyzer::getStringFromOperandType(token.type)));
@@ -2183,7 +2267,7 @@ PDFPageContentProcessor::PDFOperandString PDFPageContentProcessor::readOperand<P
         switch (token.type)
         {
             case PDFLexicalAnalyzer::TokenType::String:
-                return PDFOperandString{ token.data.toByteArray() };
+                return PDFOperandString{ token.getString() };
 
             default:
                 throw PDFRendererException(RenderErrorType::Error, PDFTranslationContext::tr("Can't read operand (string) on index %1. Operand is of type '%2'.").arg(index + 1).arg(PDFLexicalAnalyzer::getStringFromOperandType(token.type)));
@@ -2364,7 +2448,7 @@ void PDFPageContentProcessor::operatorColorSetStrokingColorSpace(PDFPageContentP
         return;
     }
 
-    PDFColorSpacePointer colorSpace = PDFAbstractColorSpace::createColorSpace(m_colorSpaceDictionary, m_document, PDFObject::createName(name.name));
+    PDFColorSpacePointer colorSpace = getColorSpaceByName(name.name);
     if (colorSpace)
     {
         // We must also set default color (it can depend on the color space)
@@ -2387,7 +2471,7 @@ void PDFPageContentProcessor::operatorColorSetFillingColorSpace(PDFOperandName n
         return;
     }
 
-    PDFColorSpacePointer colorSpace = PDFAbstractColorSpace::createColorSpace(m_colorSpaceDictionary, m_document, PDFObject::createName(name.name));
+    PDFColorSpacePointer colorSpace = getColorSpaceByName(name.name);
     if (colorSpace)
     {
         // We must also set default color (it can depend on the color space)
@@ -2410,7 +2494,7 @@ void PDFPageContentProcessor::operatorColorSetStrokingColor()
         return;
     }
 
-    const PDFAbstractColorSpace* colorSpace = m_graphicState.getStrokeColorSpace();
+    const PDFColorSpacePointer& colorSpace = m_graphicState.getStrokeColorSpacePointer();
     const size_t colorSpaceComponentCount = colorSpace->getColorComponentCount();
     const size_t operandCount = m_operands.size();
 
@@ -2421,7 +2505,7 @@ void PDFPageContentProcessor::operatorColorSetStrokingColor()
         {
             color.push_back(readOperand<PDFReal>(i));
         }
-        m_graphicState.setStrokeColor(colorSpace->getColor(color, m_CMS, m_graphicState.getRenderingIntent(), this, true), color);
+        m_graphicState.setStrokeColor(getMemoizedColor(colorSpace, color), color);
         updateGraphicState();
         checkStrokingColor();
     }
@@ -2488,7 +2572,7 @@ void PDFPageContentProcessor::operatorColorSetFillingColor()
         return;
     }
 
-    const PDFAbstractColorSpace* colorSpace = m_graphicState.getFillColorSpace();
+    const PDFColorSpacePointer& colorSpace = m_graphicState.getFillColorSpacePointer();
     const size_t colorSpaceComponentCount = colorSpace->getColorComponentCount();
     const size_t operandCount = m_operands.size();
 
@@ -2499,7 +2583,7 @@ void PDFPageContentProcessor::operatorColorSetFillingColor()
         {
             color.push_back(readOperand<PDFReal>(i));
         }
-        m_graphicState.setFillColor(colorSpace->getColor(color, m_CMS, m_graphicState.getRenderingIntent(), this, true), color);
+        m_graphicState.setFillColor(getMemoizedColor(colorSpace, color), color);
         updateGraphicState();
         checkFillingColor();
     }
@@ -2567,7 +2651,7 @@ void PDFPageContentProcessor::operatorColorSetDeviceGrayStroking(PDFReal gray)
     }
 
     m_graphicState.setStrokeColorSpace(m_deviceGrayColorSpace);
-    m_graphicState.setStrokeColor(getColorFromColorSpace(m_graphicState.getStrokeColorSpace(), gray), PDFColor(PDFColorComponent(gray)));
+    m_graphicState.setStrokeColor(getColorFromColorSpace(m_graphicState.getStrokeColorSpacePointer(), gray), PDFColor(PDFColorComponent(gray)));
     updateGraphicState();
     checkStrokingColor();
 }
@@ -2581,7 +2665,7 @@ void PDFPageContentProcessor::operatorColorSetDeviceGrayFilling(PDFReal gray)
     }
 
     m_graphicState.setFillColorSpace(m_deviceGrayColorSpace);
-    m_graphicState.setFillColor(getColorFromColorSpace(m_graphicState.getFillColorSpace(), gray), PDFColor(PDFColorComponent(gray)));
+    m_graphicState.setFillColor(getColorFromColorSpace(m_graphicState.getFillColorSpacePointer(), gray), PDFColor(PDFColorComponent(gray)));
     updateGraphicState();
     checkFillingColor();
 }
@@ -2595,7 +2679,7 @@ void PDFPageContentProcessor::operatorColorSetDeviceRGBStroking(PDFReal r, PDFRe
     }
 
     m_graphicState.setStrokeColorSpace(m_deviceRGBColorSpace);
-    m_graphicState.setStrokeColor(getColorFromColorSpace(m_graphicState.getStrokeColorSpace(), r, g, b), PDFColor(PDFColorComponent(r), PDFColorComponent(g), PDFColorComponent(b)));
+    m_graphicState.setStrokeColor(getColorFromColorSpace(m_graphicState.getStrokeColorSpacePointer(), r, g, b), PDFColor(PDFColorComponent(r), PDFColorComponent(g), PDFColorComponent(b)));
     updateGraphicState();
     checkStrokingColor();
 }
@@ -2609,7 +2693,7 @@ void PDFPageContentProcessor::operatorColorSetDeviceRGBFilling(PDFReal r, PDFRea
     }
 
     m_graphicState.setFillColorSpace(m_deviceRGBColorSpace);
-    m_graphicState.setFillColor(getColorFromColorSpace(m_graphicState.getFillColorSpace(), r, g, b), PDFColor(PDFColorComponent(r), PDFColorComponent(g), PDFColorComponent(b)));
+    m_graphicState.setFillColor(getColorFromColorSpace(m_graphicState.getFillColorSpacePointer(), r, g, b), PDFColor(PDFColorComponent(r), PDFColorComponent(g), PDFColorComponent(b)));
     updateGraphicState();
     checkFillingColor();
 }
@@ -2623,7 +2707,7 @@ void PDFPageContentProcessor::operatorColorSetDeviceCMYKStroking(PDFReal c, PDFR
     }
 
     m_graphicState.setStrokeColorSpace(m_deviceCMYKColorSpace);
-    m_graphicState.setStrokeColor(getColorFromColorSpace(m_graphicState.getStrokeColorSpace(), c, m, y, k), PDFColor(PDFColorComponent(c), PDFColorComponent(m), PDFColorComponent(y), PDFColorComponent(k)));
+    m_graphicState.setStrokeColor(getColorFromColorSpace(m_graphicState.getStrokeColorSpacePointer(), c, m, y, k), PDFColor(PDFColorComponent(c), PDFColorComponent(m), PDFColorComponent(y), PDFColorComponent(k)));
     updateGraphicState();
     checkStrokingColor();
 }
@@ -2637,7 +2721,7 @@ void PDFPageContentProcessor::operatorColorSetDeviceCMYKFilling(PDFReal c, PDFRe
     }
 
     m_graphicState.setFillColorSpace(m_deviceCMYKColorSpace);
-    m_graphicState.setFillColor(getColorFromColorSpace(m_graphicState.getFillColorSpace(), c, m, y, k), PDFColor(PDFColorComponent(c), PDFColorComponent(m), PDFColorComponent(y), PDFColorComponent(k)));
+    m_graphicState.setFillColor(getColorFromColorSpace(m_graphicState.getFillColorSpacePointer(), c, m, y, k), PDFColor(PDFColorComponent(c), PDFColorComponent(m), PDFColorComponent(y), PDFColorComponent(k)));
     updateGraphicState();
     checkFillingColor();
 }
@@ -2859,19 +2943,21 @@ void PDFPageContentProcessor::operatorTextShowTextIndividualSpacing()
             {
                 case PDFLexicalAnalyzer::TokenType::Integer:
                 {
-                    textSequence.items.push_back(TextSequenceItem(m_operands[i].data.value<PDFInteger>()));
+                    textSequence.items.push_back(TextSequenceItem(m_operands[i].getInteger()));
                     break;
                 }
 
                 case PDFLexicalAnalyzer::TokenType::Real:
                 {
-                    textSequence.items.push_back(TextSequenceItem(m_operands[i].data.value<PDFReal>()));
+                    textSequence.items.push_back(TextSequenceItem(m_operands[i].getReal()));
                     break;
                 }
 
                 case PDFLexicalAnalyzer::TokenType::String:
                 {
-                    realizedFont->fillTextSequence(m_operands[i].data.toByteArray(), textSequence, this);
+                    // Text is processed immediately, so we can avoid deep copy of the operand
+                    const QByteArrayView text = m_operands[i].getStringView();
+                    realizedFont->fillTextSequence(QByteArray::fromRawData(text.data(), text.size()), textSequence, this);
                     break;
                 }
 
@@ -2940,7 +3026,7 @@ void PDFPageContentProcessor::operatorShadingPaintShape(PDFPageContentProcessor:
     processPathPainting(boundingRectPath, false, true, false, boundingRectPath.fillRule());
 }
 
-void PDFPageContentProcessor::paintXObjectImage(const PDFStream* stream)
+void PDFPageContentProcessor::paintXObjectImage(const PDFStream* stream, PDFObjectReference reference)
 {
     if (isContentKindSuppressed(ContentKind::Images))
     {
@@ -2948,9 +3034,72 @@ void PDFPageContentProcessor::paintXObjectImage(const PDFStream* stream)
         return;
     }
 
-    PDFColorSpacePointer colorSpace;
+    // Try to find already decoded image in the cache. Inline images are not cached,
+    // because they don't have a reference. Decoded image depends also on the color
+    // management system, rendering intent and default color spaces of the resources.
+    PDFImageCache* imageCache = isImageCacheUsed() && reference.isValid() && m_CMS ? m_document->getImageCache() : nullptr;
+    PDFImageCache::Key imageCacheKey;
 
+    if (imageCache)
+    {
+        imageCacheKey.reference = reference;
+        imageCacheKey.cmsIdentifier = m_CMS->getIdentifier();
+        imageCacheKey.renderingIntent = m_graphicState.getRenderingIntent();
+
+        if (m_colorSpaceDictionary && (m_colorSpaceDictionary->hasKey(COLOR_SPACE_NAME_DEFAULT_GRAY) ||
+                                       m_colorSpaceDictionary->hasKey(COLOR_SPACE_NAME_DEFAULT_RGB) ||
+                                       m_colorSpaceDictionary->hasKey(COLOR_SPACE_NAME_DEFAULT_CMYK)))
+        {
+            imageCacheKey.defaultColorSpaces = m_colorSpaceDictionary;
+        }
+    }
+
+    // Determine, if image can be decoded with lower resolution. Images drawn
+    // smaller than their resolution are decoded only in sufficient resolution.
     const PDFDictionary* streamDictionary = stream->getDictionary();
+    const PDFReal imageResolution = getImageResolution();
+    QSize imageSize;
+    int reduceLevel = 0;
+
+    if (imageResolution > 0.0)
+    {
+        PDFDocumentDataLoaderDecorator loader(m_document);
+        imageSize.setWidth(int(loader.readIntegerFromDictionary(streamDictionary, "Width", 0)));
+        imageSize.setHeight(int(loader.readIntegerFromDictionary(streamDictionary, "Height", 0)));
+
+        if (!imageSize.isEmpty())
+        {
+            const QTransform unitSquareToDevice = getCurrentWorldMatrix() * QTransform::fromScale(imageResolution, imageResolution);
+            reduceLevel = PDFImagePyramid::getReduceLevel(imageSize, unitSquareToDevice);
+        }
+    }
+
+    if (imageCache)
+    {
+        // Cached image can be used, if it has sufficient resolution, otherwise
+        // the image is decoded again and replaced in the cache.
+        PDFImagePyramid imagePyramid = imageCache->getImage(imageCacheKey, stream);
+        if (!imagePyramid.isEmpty())
+        {
+            bool isSufficient = !imagePyramid.isReduced();
+
+            if (!isSufficient && !imageSize.isEmpty())
+            {
+                const QImage& cachedImage = imagePyramid.getImage();
+                isSufficient = cachedImage.width() >= (imageSize.width() >> reduceLevel) &&
+                               cachedImage.height() >= (imageSize.height() >> reduceLevel);
+            }
+
+            if (isSufficient)
+            {
+                performImagePyramidPainting(imagePyramid);
+                return;
+            }
+        }
+    }
+
+    PDFColorSpacePointer colorSpace;
+
     if (streamDictionary->hasKey("ColorSpace"))
     {
         const PDFObject& colorSpaceObject = m_document->getObject(streamDictionary->get("ColorSpace"));
@@ -2964,7 +3113,7 @@ void PDFPageContentProcessor::paintXObjectImage(const PDFStream* stream)
         }
     }
 
-    PDFImage pdfImage = PDFImage::createImage(m_document, stream, qMove(colorSpace), false, m_graphicState.getRenderingIntent(), this);
+    PDFImage pdfImage = PDFImage::createImage(m_document, stream, qMove(colorSpace), false, m_graphicState.getRenderingIntent(), this, reduceLevel);
 
     if (!performOriginalImagePainting(pdfImage))
     {
@@ -2979,11 +3128,30 @@ void PDFPageContentProcessor::paintXObjectImage(const PDFStream* stream)
                 unmaskedImage.fill(m_graphicState.getFillColor());
                 unmaskedImage.setAlphaChannel(image);
                 image = qMove(unmaskedImage);
+
+                // Image masks are not cached, because they are painted using current fill color
+                imageCache = nullptr;
             }
 
             if (!image.isNull())
             {
-                performImagePainting(image);
+                // Reduced images are always painted as image pyramids, so painter
+                // knows, that the image has lower resolution than the original image.
+                const bool isReduced = !imageSize.isEmpty() && (image.width() < imageSize.width() || image.height() < imageSize.height());
+
+                if (imageCache || isReduced)
+                {
+                    PDFImagePyramid imagePyramid = PDFImagePyramid::create(qMove(image), isReduced);
+                    if (imageCache)
+                    {
+                        imageCache->insert(imageCacheKey, stream, imagePyramid);
+                    }
+                    performImagePyramidPainting(imagePyramid);
+                }
+                else
+                {
+                    performImagePainting(image);
+                }
             }
             else
             {
@@ -2998,7 +3166,7 @@ void PDFPageContentProcessor::reportWarningAboutColorOperatorsInUTP()
     reportRenderErrorOnce(RenderErrorType::Warning, PDFTranslationContext::tr("Color operators are not allowed in uncolored tilling pattern."));
 }
 
-void PDFPageContentProcessor::processForm(const PDFStream* stream)
+void PDFPageContentProcessor::processForm(const PDFStream* stream, PDFObjectReference reference)
 {
     PDFDocumentDataLoaderDecorator loader(getDocument());
     const PDFDictionary* streamDictionary = stream->getDictionary();
@@ -3009,8 +3177,8 @@ void PDFPageContentProcessor::processForm(const PDFStream* stream)
     // Read the transformation matrix, if it is present
     QTransform transformationMatrix = loader.readMatrixFromDictionary(streamDictionary, "Matrix", QTransform());
 
-    // Read the dictionary content
-    QByteArray content = m_document->getDecodedStream(stream);
+    // Read the compiled content stream
+    PDFContentStreamBytecodePointer bytecode = getContentStreamBytecode(stream, reference);
 
     // Read resources
     PDFObject resources = m_document->getObject(streamDictionary->get("Resources"));
@@ -3021,7 +3189,7 @@ void PDFPageContentProcessor::processForm(const PDFStream* stream)
     // Form structural parent key
     const PDFInteger formStructuralParentKey = loader.readIntegerFromDictionary(streamDictionary, "StructParent", m_structuralParentKey);
 
-    processForm(transformationMatrix, boundingBox, resources, transparencyGroup, content, formStructuralParentKey);
+    processForm(transformationMatrix, boundingBox, resources, transparencyGroup, *bytecode, formStructuralParentKey);
 }
 
 void PDFPageContentProcessor::operatorPaintXObject(PDFOperandName name)
@@ -3031,7 +3199,8 @@ void PDFPageContentProcessor::operatorPaintXObject(PDFOperandName name)
 
     if (m_xobjectDictionary)
     {
-        const PDFObject& object = m_document->getObject(m_xobjectDictionary->get(name.name));
+        const PDFObject& objectOrReference = m_xobjectDictionary->get(name.name);
+        const PDFObject& object = m_document->getObject(objectOrReference);
         if (object.isStream())
         {
             const PDFStream* stream = object.getStream();
@@ -3058,7 +3227,7 @@ void PDFPageContentProcessor::operatorPaintXObject(PDFOperandName name)
             QByteArray subtype = loader.readNameFromDictionary(streamDictionary, "Subtype");
             if (subtype == "Image")
             {
-                paintXObjectImage(stream);
+                paintXObjectImage(stream, objectOrReference.isReference() ? objectOrReference.getReference() : PDFObjectReference());
             }
             else if (subtype == "Form")
             {
@@ -3068,7 +3237,7 @@ void PDFPageContentProcessor::operatorPaintXObject(PDFOperandName name)
                     throw PDFRendererException(RenderErrorType::Error, PDFTranslationContext::tr("Form of type %1 not supported.").arg(formType));
                 }
 
-                processForm(stream);
+                processForm(stream, objectOrReference.isReference() ? objectOrReference.getReference() : PDFObjectReference());
             }
             else
             {
@@ -3161,6 +3330,8 @@ void PDFPageContentProcessor::drawText(const TextSequence& textSequence)
     const PDFRealizedFontPointer& font = getRealizedFont();
     if (font)
     {
+        performTextSequence(textSequence);
+
         const bool isType3Font = m_graphicState.getTextFont()->getFontType() == FontType::Type3;
         const PDFReal fontSize = m_graphicState.getTextFontSize();
         const PDFReal horizontalScaling = m_graphicState.getTextHorizontalScaling() * 0.01; // Horizontal scaling is in percents
@@ -3213,6 +3384,13 @@ void PDFPageContentProcessor::drawText(const TextSequence& textSequence)
 
                         if (!glyphPath.isEmpty())
                         {
+                            TextGlyph textGlyph;
+                            textGlyph.glyph = &glyphPath;
+                            textGlyph.matrix = textRenderingMatrix;
+                            textGlyph.fontSize = fontSize;
+                            textGlyph.atlasId = item.atlasId;
+                            PDFTemporaryValueChange<const TextGlyph*> textGlyphGuard(&m_currentTextGlyph, &textGlyph);
+
                             QPainterPath transformedGlyph = textRenderingMatrix.map(glyphPath);
                             processPathPainting(transformedGlyph, stroke, fill, true, transformedGlyph.fillRule());
 
@@ -3892,6 +4070,7 @@ void PDFPageContentProcessor::PDFPageContentProcessorState::setTextCharacterSpac
 
 PDFPageContentProcessor::PDFPageContentProcessorStateGuard::PDFPageContentProcessorStateGuard(PDFPageContentProcessor* processor) :
     m_processor(processor),
+    m_colorSpaceDictionaryObject(processor->m_colorSpaceDictionaryObject),
     m_colorSpaceDictionary(processor->m_colorSpaceDictionary),
     m_fontDictionary(processor->m_fontDictionary),
     m_xobjectDictionary(processor->m_xobjectDictionary),
@@ -3907,6 +4086,7 @@ PDFPageContentProcessor::PDFPageContentProcessorStateGuard::PDFPageContentProces
 PDFPageContentProcessor::PDFPageContentProcessorStateGuard::~PDFPageContentProcessorStateGuard()
 {
     // Restore dictionaries
+    m_processor->m_colorSpaceDictionaryObject = qMove(m_colorSpaceDictionaryObject);
     m_processor->m_colorSpaceDictionary = m_colorSpaceDictionary;
     m_processor->m_fontDictionary = m_fontDictionary;
     m_processor->m_xobjectDictionary = m_xobjectDictionary;
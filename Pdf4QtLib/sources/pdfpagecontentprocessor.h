@@ -21,6 +21,7 @@
 #include "pdfrenderer.h"
 #include "pdfcolorspaces.h"
 #include "pdfparser.h"
+#include "pdfcontentstreambytecode.h"
 #include "pdffont.h"
 #include "pdfutils.h"
 #include "pdfmeshqualitysettings.h"
@@ -32,6 +33,7 @@
 #include <QPainterPath>
 #include <QSharedPointer>
 
+#include <map>
 #include <stack>
 #include <tuple>
 #include <type_traits>
@@ -41,6 +43,7 @@ namespace pdf
 class PDFCMS;
 class PDFMesh;
 class PDFImage;
+class PDFImagePyramid;
 class PDFTilingPattern;
 class PDFShadingPattern;
 class PDFOptionalContentActivity;
@@ -207,6 +210,11 @@ public:
     };
     Q_DECLARE_FLAGS(ProcedureSets, ProcedureSet)
 
+    /// Returns operator with given name. If operator name is unknown,
+    /// then Operator::Invalid is returned.
+    /// \param command Operator name
+    static Operator getOperator(QByteArrayView command);
+
     /// Process the contents of the page
     QList<PDFRenderError> processContents();
 
@@ -370,9 +378,11 @@ protected:
         void setCurrentTransformationMatrix(const QTransform& currentTransformationMatrix);
 
         const PDFAbstractColorSpace* getStrokeColorSpace() const { return m_strokeColorSpace.data(); }
+        const PDFColorSpacePointer& getStrokeColorSpacePointer() const { return m_strokeColorSpace; }
         void setStrokeColorSpace(const QSharedPointer<PDFAbstractColorSpace>& strokeColorSpace);
 
         const PDFAbstractColorSpace* getFillColorSpace() const { return m_fillColorSpace.data(); }
+        const PDFColorSpacePointer& getFillColorSpacePointer() const { return m_fillColorSpace; }
         void setFillColorSpace(const QSharedPointer<PDFAbstractColorSpace>& fillColorSpace);
 
         const QColor& getStrokeColor() const { return m_strokeColor; }
@@ -577,6 +587,26 @@ protected:
     /// \param image Image to be painted
     virtual void performImagePainting(const QImage& image);
 
+    /// Draws the image, which also contains downsampled versions of the image,
+    /// so implementation can choose the image of appropriate size. Default
+    /// implementation paints full resolution image using performImagePainting.
+    /// \param imagePyramid Image with downsampled versions
+    virtual void performImagePyramidPainting(const PDFImagePyramid& imagePyramid);
+
+    /// Returns true, if decoded images are taken from the document's image cache
+    /// (and newly decoded images are inserted into the cache). Then images are
+    /// painted using performImagePyramidPainting. Default implementation
+    /// returns false.
+    virtual bool isImageCacheUsed() const;
+
+    /// Returns resolution of the output (in device pixels per unit of the current
+    /// world matrix), at which images will be drawn. Images are then decoded
+    /// with reduced resolution, if it is sufficient (and decoder supports it),
+    /// and painted using performImagePyramidPainting. If zero is returned,
+    /// then images are always decoded in full resolution. Default implementation
+    /// returns zero.
+    virtual PDFReal getImageResolution() const;
+
     /// This function has to be implemented in the client drawing implementation, it should
     /// draw the mesh. Mesh is in device space coordinates (so world transformation matrix
     /// is identity matrix).
@@ -633,6 +663,11 @@ protected:
     /// Implement to react on character printing
     virtual void performOutputCharacter(const PDFTextCharacterInfo& info);
 
+    /// Implement to react on text sequence drawing. Function is called before
+    /// the text sequence is drawn, current font is set in the graphic state.
+    /// \param textSequence Text sequence to be drawn
+    virtual void performTextSequence(const TextSequence& textSequence);
+
     /// Implement to respond to text begin operator
     virtual void performTextBegin(ProcessOrder order);
 
@@ -662,6 +697,18 @@ protected:
     /// Returns current graphic state
     const PDFPageContentProcessorState* getGraphicState() const { return &m_graphicState; }
 
+    struct TextGlyph
+    {
+        const QPainterPath* glyph = nullptr;    ///< Glyph outline in the text space (scaled by font size)
+        QTransform matrix;                      ///< Matrix mapping glyph outline to the user space
+        PDFReal fontSize = 0.0;
+        const PDFAtlasGlyphId* atlasId = nullptr;   ///< Identification of the glyph outline in the glyph atlas
+    };
+
+    /// Returns glyph of the text, which is being painted by function \p performPathPainting,
+    /// if it is called with text parameter set to true. Otherwise, nullptr is returned.
+    const TextGlyph* getCurrentTextGlyph() const { return m_currentTextGlyph; }
+
     /// Adds error to the error list
     /// \param error Error message
     void addError(const QString& error) { m_errorList.append(PDFRenderError(RenderErrorType::Error, error)); }
@@ -694,6 +741,15 @@ protected:
     /// Returns color management system
     const PDFCMS* getCMS() const { return m_CMS; }
 
+    struct ColorConversionStatistics
+    {
+        qint64 memoHits = 0;    ///< Number of colors taken from the color memo
+        qint64 memoMisses = 0;  ///< Number of colors converted by the color space
+    };
+
+    /// Returns statistics of the color conversions of stroking/filling colors
+    const ColorConversionStatistics& getColorConversionStatistics() const { return m_colorConversionStatistics; }
+
     /// Returns font cache
     const PDFFontCache* getFontCache() const { return m_fontCache; }
 
@@ -710,21 +766,45 @@ protected:
         PDFPageContentProcessor* m_processor;
     };
 
-    /// Process form using form stream
-    void processForm(const PDFStream* stream);
+    /// Process form using form stream. If reference to the form stream is valid,
+    /// then compiled form content stream is taken from the document cache.
+    /// \param stream Form stream
+    /// \param reference Reference to the form stream
+    void processForm(const PDFStream* stream, PDFObjectReference reference = PDFObjectReference());
 
 private:
     /// Initializes the resources dictionaries
     void initDictionaries(const PDFObject& resourcesObject);
 
     /// Process the content stream
-    void processContentStream(const PDFStream* stream);
+    /// \param stream Content stream
+    /// \param reference Reference to the content stream (can be invalid)
+    void processContentStream(const PDFStream* stream, PDFObjectReference reference);
 
     /// Process the content
     void processContent(const QByteArray& content);
 
+    /// Executes the compiled content stream
+    void processBytecode(const PDFContentStreamBytecode& bytecode);
+
+    /// Returns compiled content stream. If reference is valid, then compiled content
+    /// stream is taken from the document cache, otherwise stream is compiled. If stream
+    /// can't be decoded, exception is thrown.
+    /// \param stream Content stream
+    /// \param reference Reference to the content stream (can be invalid)
+    PDFContentStreamBytecodePointer getContentStreamBytecode(const PDFStream* stream, PDFObjectReference reference) const;
+
+    /// Processes form with compiled content stream, see processForm function with
+    /// content stream parameter for details.
+    void processForm(const QTransform& matrix,
+                     const QRectF& boundingBox,
+                     const PDFObject& resources,
+                     const PDFObject& transparencyGroup,
+                     const PDFContentStreamBytecode& bytecode,
+                     PDFInteger formStructuralParent);
+
     /// Processes single command
-    void processCommand(const QByteArray& command);
+    void processCommand(QByteArrayView command);
 
     /// Performs path painting
     /// \param path Path, which should be drawn (can be emtpy - in that case nothing happens)
@@ -780,6 +860,7 @@ private:
         PDFPageContentProcessor* m_processor;
 
         // Stored resources
+        PDFObject m_colorSpaceDictionaryObject;
         const PDFDictionary* m_colorSpaceDictionary;
         const PDFDictionary* m_fontDictionary;
         const PDFDictionary* m_xobjectDictionary;
@@ -822,8 +903,62 @@ private:
     template<typename T>
     T readOperand(size_t index) const;
 
+    /// Converts token to the operand value. Returns false, if token has wrong type.
+    /// These functions are used on the fast path of operator invocation, error
+    /// messages are created only in \p readOperand, when conversion fails.
+    static inline bool convertOperand(const PDFLexicalAnalyzer::Token& token, PDFReal& value)
+    {
+        if (token.type == PDFLexicalAnalyzer::TokenType::Real || token.type == PDFLexicalAnalyzer::TokenType::Integer)
+        {
+            value = token.getReal();
+            return true;
+        }
+        return false;
+    }
+
+    static inline bool convertOperand(const PDFLexicalAnalyzer::Token& token, PDFInteger& value)
+    {
+        if (token.type == PDFLexicalAnalyzer::TokenType::Integer)
+        {
+            value = token.getInteger();
+            return true;
+        }
+        return false;
+    }
+
+    static inline bool convertOperand(const PDFLexicalAnalyzer::Token& token, PDFOperandName& value)
+    {
+        if (token.type == PDFLexicalAnalyzer::TokenType::Name)
+        {
+            value.name = token.getString();
+            return true;
+        }
+        return false;
+    }
+
+    static inline bool convertOperand(const PDFLexicalAnalyzer::Token& token, PDFOperandString& value)
+    {
+        if (token.type == PDFLexicalAnalyzer::TokenType::String)
+        {
+            value.string = token.getString();
+            return true;
+        }
+        return false;
+    }
+
+    /// Reads operand of the operator. Operand count is checked in \p invokeOperator,
+    /// so only type of the operand is checked here. If it is wrong, then \p readOperand
+    /// is called, which throws exception with the appropriate error message.
     template<size_t index, typename T>
-    inline T readOperand() const { return readOperand<T>(index); }
+    inline T readOperand() const
+    {
+        T value = T();
+        if (Q_UNLIKELY(!convertOperand(m_operands[index], value)))
+        {
+            return readOperand<T>(index);
+        }
+        return value;
+    }
 
     template<typename Tuple, class F, std::size_t... I>
     inline void invokeOperatorImpl(F function, std::index_sequence<I...>)
@@ -838,9 +973,18 @@ private:
     template<typename... Operands>
     inline void invokeOperator(void(PDFPageContentProcessor::* function)(Operands...))
     {
+        if (Q_UNLIKELY(m_operands.size() < sizeof...(Operands)))
+        {
+            reportMissingOperands(sizeof...(Operands));
+        }
+
         invokeOperatorImpl<std::tuple<Operands...>>(function, std::make_index_sequence<std::tuple_size_v<std::remove_reference_t<std::tuple<Operands...>>>>{});
     }
 
+    /// Throws exception, that operator has not enough operands
+    /// \param operandCount Required operand count
+    [[noreturn]] void reportMissingOperands(size_t operandCount) const;
+
     /// Returns the current poin in the path. If path doesn't exist, then
     /// exception is thrown.
     QPointF getCurrentPoint() const;
@@ -849,7 +993,7 @@ private:
     void updateGraphicState();
 
     template<typename... Operands>
-    inline QColor getColorFromColorSpace(const PDFAbstractColorSpace* colorSpace, Operands... operands)
+    inline QColor getColorFromColorSpace(const PDFColorSpacePointer& colorSpace, Operands... operands)
     {
 
 
@@ -857,7 +1001,7 @@ private:
         const size_t colorSpaceComponentCount = colorSpace->getColorComponentCount();
         if (operandCount == colorSpaceComponentCount)
         {
-            return colorSpace->getColor(PDFColor(static_cast<PDFColorComponent>(operands)...), m_CMS, m_graphicState.getRenderingIntent(), this, true);
+            return getMemoizedColor(colorSpace, PDFColor(static_cast<PDFColorComponent>(operands)...));
         }
         else
         {
@@ -1001,7 +1145,9 @@ private:
     PDFObject readObjectFromOperandStack(size_t startPosition) const;
 
     /// Implementation of painting of XObject image
-    void paintXObjectImage(const PDFStream* stream);
+    /// \param stream Image stream
+    /// \param reference Reference to the image stream (invalid for inline images)
+    void paintXObjectImage(const PDFStream* stream, PDFObjectReference reference);
 
     /// Report warning about color operators in uncolored tiling pattern
     void reportWarningAboutColorOperatorsInUTP();
@@ -1012,12 +1158,43 @@ private:
     /// Finishes marked content (if end of marked content is missing)
     void finishMarkedContent();
 
+    /// Returns color space of given name from the color space dictionary. Color spaces
+    /// are cached, so repeated selection of the same color space by operators
+    /// 'cs' and 'CS' doesn't parse the color space again (for example, ICC profile),
+    /// and returns the same color space object.
+    /// \param name Name of the color space
+    PDFColorSpacePointer getColorSpaceByName(const QByteArray& name);
+
+    /// Converts color to the device color. Content streams often set the same
+    /// color many times, so last converted colors are memoized. Memo is indexed
+    /// by color space, color components and rendering intent.
+    /// \param colorSpace Color space
+    /// \param color Color in the color space
+    QColor getMemoizedColor(const PDFColorSpacePointer& colorSpace, const PDFColor& color);
+
+    struct ColorMemoEntry
+    {
+        PDFColorSpacePointer colorSpace;
+        RenderingIntent renderingIntent = RenderingIntent::Perceptual;
+        PDFColor color;
+        QColor result;
+    };
+
+    static constexpr size_t COLOR_MEMO_SIZE = 256;
+
+    struct ColorSpaceCacheEntry
+    {
+        PDFObject colorSpaceDictionary; ///< Holds the dictionary, so its address stays valid
+        PDFColorSpacePointer colorSpace;
+    };
+
     const PDFPage* m_page;
     const PDFDocument* m_document;
     const PDFFontCache* m_fontCache;
     const PDFCMS* m_CMS;
     const PDFOptionalContentActivity* m_optionalContentActivity;
     const PDFOperationControl* m_operationControl;
+    PDFObject m_colorSpaceDictionaryObject;
     const PDFDictionary* m_colorSpaceDictionary;
     const PDFDictionary* m_fontDictionary;
     const PDFDictionary* m_xobjectDictionary;
@@ -1032,6 +1209,16 @@ private:
     PDFColorSpacePointer m_deviceRGBColorSpace;
     PDFColorSpacePointer m_deviceCMYKColorSpace;
 
+    /// Color spaces created by operators 'cs' and 'CS' (key is color space dictionary and name)
+    std::map<std::pair<const PDFDictionary*, QByteArray>, ColorSpaceCacheEntry> m_colorSpaceCache;
+
+    /// Glyph of the text, which is currently being painted
+    const TextGlyph* m_currentTextGlyph = nullptr;
+
+    /// Memo of converted colors (direct mapped, allocated on first use)
+    std::vector<ColorMemoEntry> m_colorMemo;
+    ColorConversionStatistics m_colorConversionStatistics;
+
     /// Array with current operand arguments
     PDFFlatArray<PDFLexicalAnalyzer::Token, 33> m_operands;
 
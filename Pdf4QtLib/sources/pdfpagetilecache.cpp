@@ -0,0 +1,312 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pdfpagetilecache.h"
+#include "pdfpainter.h"
+#include "pdfexecutionpolicy.h"
+#include "pdfdbgheap.h"
+
+#include <QtMath>
+#include <QPainter>
+#include <QtConcurrent/QtConcurrent>
+
+namespace pdf
+{
+
+PDFPageTileCache::PDFPageTileCache(qint64 cacheLimit, QObject* parent) :
+    QObject(parent),
+    m_cacheLimit(cacheLimit)
+{
+    connect(&m_renderFutureWatcher, &QFutureWatcher<RenderedTiles>::finished, this, &PDFPageTileCache::onTilesRendered);
+}
+
+PDFPageTileCache::~PDFPageTileCache()
+{
+    m_renderFutureWatcher.waitForFinished();
+}
+
+void PDFPageTileCache::drawPage(QPainter* painter,
+                                PDFInteger pageIndex,
+                                const QRectF& cropBox,
+                                const std::shared_ptr<const PDFPrecompiledPage>& compiledPage,
+                                const QTransform& pagePointToDevicePointMatrix,
+                                QRect placedRect,
+                                QRect rect,
+                                PDFRenderer::Features features,
+                                QColor paperColor,
+                                bool drawPaper,
+                                PDFReal opacity)
+{
+    const QRect visibleRect = placedRect.intersected(rect);
+    if (visibleRect.isEmpty())
+    {
+        return;
+    }
+
+    // Insert tiles, which have been rendered in the meantime
+    insertRenderedTiles();
+
+    // Tiles are rendered in device pixels (for high DPI screens,
+    // device pixels are different from the painter's coordinates).
+    const PDFReal devicePixelRatio = painter->device() ? painter->device()->devicePixelRatioF() : 1.0;
+
+    PDFPageTileKey pageKey;
+    pageKey.pageIndex = pageIndex;
+    pageKey.pageWidth = qMax(qCeil(placedRect.width() * devicePixelRatio), 1);
+    pageKey.pageHeight = qMax(qCeil(placedRect.height() * devicePixelRatio), 1);
+    pageKey.features = uint(features);
+    pageKey.invertColors = features.testFlag(PDFRenderer::InvertColors);
+    pageKey.drawPaper = drawPaper;
+    pageKey.paperColor = paperColor.rgba();
+    pageKey.opacity = qBound(0, qRound(opacity * 255.0), 255);
+
+    // Transformation from the page to the page device pixels
+    QTransform matrix = pagePointToDevicePointMatrix;
+    matrix *= QTransform::fromTranslate(-placedRect.left(), -placedRect.top());
+    matrix *= QTransform::fromScale(devicePixelRatio, devicePixelRatio);
+
+    // Visible rectangle in the page device pixels
+    const PDFReal visibleLeft = (visibleRect.left() - placedRect.left()) * devicePixelRatio;
+    const PDFReal visibleTop = (visibleRect.top() - placedRect.top()) * devicePixelRatio;
+    const PDFReal visibleRight = visibleLeft + visibleRect.width() * devicePixelRatio;
+    const PDFReal visibleBottom = visibleTop + visibleRect.height() * devicePixelRatio;
+
+    const int firstColumn = qMax(qFloor(visibleLeft) / TILE_SIZE, 0);
+    const int lastColumn = qMin((qCeil(visibleRight) - 1) / TILE_SIZE, (pageKey.pageWidth - 1) / TILE_SIZE);
+    const int firstRow = qMax(qFloor(visibleTop) / TILE_SIZE, 0);
+    const int lastRow = qMin((qCeil(visibleBottom) - 1) / TILE_SIZE, (pageKey.pageHeight - 1) / TILE_SIZE);
+
+    std::vector<PDFPageTileKey> missingTiles;
+
+    for (int row = firstRow; row <= lastRow; ++row)
+    {
+        for (int column = firstColumn; column <= lastColumn; ++column)
+        {
+            PDFPageTileKey key = pageKey;
+            key.column = column;
+            key.row = row;
+
+            auto it = m_entries.find(key);
+            if (it == m_entries.end())
+            {
+                missingTiles.push_back(key);
+                continue;
+            }
+
+            // Mark the tile as most recently used
+            m_lruList.splice(m_lruList.begin(), m_lruList, it->second.lruIterator);
+
+            // Tile already contains paper and page graphics drawn with page opacity
+            const QRect tileRect = getTileRect(key);
+            const QRectF targetRect(placedRect.left() + tileRect.left() / devicePixelRatio,
+                                    placedRect.top() + tileRect.top() / devicePixelRatio,
+                                    tileRect.width() / devicePixelRatio,
+                                    tileRect.height() / devicePixelRatio);
+            painter->drawImage(targetRect, it->second.image);
+        }
+    }
+
+    if (missingTiles.empty() || m_isRendering)
+    {
+        // Nothing to render, or tiles are being rendered. Missing tiles
+        // will be rendered, when page is redrawn after that.
+        return;
+    }
+
+    // Compiled page is shared with the page cache, so it stays alive
+    // while tiles are rendered, even if it is removed from the cache.
+    std::shared_ptr<const PDFPrecompiledPage> renderedPage = compiledPage;
+    const quint64 generation = m_generation;
+    auto renderTiles = [renderedPage, missingTiles, cropBox, matrix, features, generation]()
+    {
+        RenderedTiles result;
+        result.generation = generation;
+        result.tiles.resize(missingTiles.size());
+
+        for (size_t i = 0; i < missingTiles.size(); ++i)
+        {
+            result.tiles[i].key = missingTiles[i];
+        }
+
+        auto renderNewTile = [&](RenderedTile& tile)
+        {
+            tile.image = renderTile(tile.key, cropBox, renderedPage.get(), matrix, features);
+        };
+        PDFExecutionPolicy::execute(PDFExecutionPolicy::Scope::Page, result.tiles.begin(), result.tiles.end(), renderNewTile);
+
+        return result;
+    };
+
+    m_isRendering = true;
+    m_renderFuture = QtConcurrent::run(renderTiles);
+    m_renderFutureWatcher.setFuture(m_renderFuture);
+}
+
+void PDFPageTileCache::removePages(const std::vector<PDFInteger>& pages)
+{
+    Q_ASSERT(std::is_sorted(pages.cbegin(), pages.cend()));
+
+    for (auto it = m_entries.begin(); it != m_entries.end();)
+    {
+        if (std::binary_search(pages.cbegin(), pages.cend(), it->first.pageIndex))
+        {
+            m_cacheSize -= it->second.size;
+            m_lruList.erase(it->second.lruIterator);
+            it = m_entries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    ++m_generation;
+}
+
+void PDFPageTileCache::clear()
+{
+    m_entries.clear();
+    m_lruList.clear();
+    m_cacheSize = 0;
+
+    ++m_generation;
+}
+
+void PDFPageTileCache::waitForFinished()
+{
+    m_renderFutureWatcher.waitForFinished();
+    insertRenderedTiles();
+}
+
+void PDFPageTileCache::setCacheLimit(qint64 cacheLimit)
+{
+    m_cacheLimit = cacheLimit;
+    shrink();
+}
+
+bool PDFPageTileCache::isTiledRenderingUsed(QSize pageSize)
+{
+    return pageSize.width() > TILED_RENDERING_THRESHOLD || pageSize.height() > TILED_RENDERING_THRESHOLD;
+}
+
+QImage PDFPageTileCache::renderTile(const PDFPageTileKey& key,
+                                    const QRectF& cropBox,
+                                    const PDFPrecompiledPage* compiledPage,
+                                    const QTransform& pagePointToDevicePointMatrix,
+                                    PDFRenderer::Features features)
+{
+    const QRect tileRect = getTileRect(key);
+
+    // Paper is opaque, only page graphics is drawn with the page
+    // opacity (in the same way, as when page is drawn without tiles).
+    QImage image(tileRect.size(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(key.drawPaper ? QColor::fromRgba(key.paperColor) : QColor(Qt::transparent));
+
+    // Painter clips everything outside the tile, so only graphics
+    // intersecting the tile are drawn (page uses its spatial index).
+    QTransform matrix = pagePointToDevicePointMatrix * QTransform::fromTranslate(-tileRect.left(), -tileRect.top());
+
+    QPainter painter(&image);
+    painter.setClipRect(QRect(QPoint(0, 0), tileRect.size()));
+    compiledPage->draw(&painter, cropBox, matrix, features, key.opacity / 255.0);
+    painter.end();
+
+    return image;
+}
+
+QRect PDFPageTileCache::getTileRect(const PDFPageTileKey& key)
+{
+    QRect tileRect(key.column * TILE_SIZE, key.row * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+    return tileRect.intersected(QRect(0, 0, key.pageWidth, key.pageHeight));
+}
+
+void PDFPageTileCache::onTilesRendered()
+{
+    if (insertRenderedTiles())
+    {
+        Q_EMIT tilesRendered();
+    }
+}
+
+bool PDFPageTileCache::insertRenderedTiles()
+{
+    if (!m_isRendering || !m_renderFuture.isFinished())
+    {
+        return false;
+    }
+
+    RenderedTiles renderedTiles = m_renderFuture.result();
+    m_isRendering = false;
+
+    if (renderedTiles.generation != m_generation)
+    {
+        // Tiles were rendered from the old page contents
+        return false;
+    }
+
+    for (RenderedTile& tile : renderedTiles.tiles)
+    {
+        insert(tile.key, qMove(tile.image));
+    }
+
+    return true;
+}
+
+void PDFPageTileCache::insert(const PDFPageTileKey& key, QImage image)
+{
+    const qint64 size = image.sizeInBytes();
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end())
+    {
+        m_cacheSize -= it->second.size;
+        m_lruList.erase(it->second.lruIterator);
+        m_entries.erase(it);
+    }
+
+    if (size > m_cacheLimit)
+    {
+        // Tile is too large to be stored in the cache
+        return;
+    }
+
+    m_lruList.push_front(key);
+
+    Entry entry;
+    entry.image = qMove(image);
+    entry.size = size;
+    entry.lruIterator = m_lruList.begin();
+    m_entries.emplace(key, qMove(entry));
+    m_cacheSize += size;
+
+    shrink();
+}
+
+void PDFPageTileCache::shrink()
+{
+    while (m_cacheSize > m_cacheLimit && !m_lruList.empty())
+    {
+        auto it = m_entries.find(m_lruList.back());
+        Q_ASSERT(it != m_entries.end());
+
+        m_cacheSize -= it->second.size;
+        m_entries.erase(it);
+        m_lruList.pop_back();
+    }
+}
+
+}   // namespace pdf
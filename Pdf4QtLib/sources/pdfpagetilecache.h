@@ -0,0 +1,209 @@
+//    Copyright (C) 2023 Jakub Melka
+//
+//    This file is part of PDF4QT.
+//
+//    PDF4QT is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    with the written consent of the copyright owner, any later version.
+//
+//    PDF4QT is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with PDF4QT.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef PDFPAGETILECACHE_H
+#define PDFPAGETILECACHE_H
+
+#include "pdfglobal.h"
+#include "pdfrenderer.h"
+
+#include <QImage>
+#include <QColor>
+#include <QObject>
+#include <QFuture>
+#include <QFutureWatcher>
+
+#include <map>
+#include <list>
+#include <memory>
+#include <vector>
+#include <compare>
+
+class QPainter;
+
+namespace pdf
+{
+class PDFPrecompiledPage;
+
+/// Key of the rendered page tile. Tile grid is in device pixels of the page
+/// scaled to the given size, so tiles of different zoom levels have different keys.
+/// Tiles contain the paper and page graphics drawn with page opacity, so paper
+/// color and opacity are also part of the key.
+struct PDFPageTileKey
+{
+    auto operator<=>(const PDFPageTileKey&) const = default;
+
+    PDFInteger pageIndex = -1;
+    int pageWidth = 0;      ///< Width of the page (in device pixels)
+    int pageHeight = 0;     ///< Height of the page (in device pixels)
+    int column = 0;
+    int row = 0;
+    uint features = 0;      ///< Renderer features
+    bool invertColors = false;
+    bool drawPaper = true;  ///< Tile background is filled with paper color
+    QRgb paperColor = 0;    ///< Paper color (inverted, if colors are inverted)
+    int opacity = 255;      ///< Opacity of the page graphics (0-255)
+};
+
+/// Cache of rendered page tiles. Very large pages (for example, engineering
+/// drawings at high zoom) are not drawn at once, but they are split into tiles
+/// of fixed size. Only tiles intersecting the visible area are rendered, so memory
+/// consumption is bounded by the visible area, not by the page size. Tiles are
+/// rendered asynchronously (in parallel), and each tile draws only the graphics
+/// intersecting the tile. Until the tile is rendered, only the paper is visible
+/// in its area (as for pages, which are not compiled yet). When tiles are rendered,
+/// signal \p tilesRendered is emitted. Rendered tiles are cached, so when page is
+/// panned, only newly exposed tiles are rendered. When cache limit is exceeded,
+/// least recently used tiles are removed. Cache is not thread safe, it is used
+/// from the main GUI thread.
+class PDF4QTLIBSHARED_EXPORT PDFPageTileCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int TILE_SIZE = 512;
+    static constexpr qint64 DEFAULT_CACHE_LIMIT = 128 * 1024 * 1024;
+
+    explicit PDFPageTileCache(qint64 cacheLimit = DEFAULT_CACHE_LIMIT, QObject* parent = nullptr);
+    virtual ~PDFPageTileCache() override;
+
+    /// Draws page using tiles. Tiles intersecting the target rectangle, which
+    /// are in the cache, are drawn. Tiles, which are not in the cache, are
+    /// rendered asynchronously, and inserted into the cache later.
+    /// \param painter Painter
+    /// \param pageIndex Page index
+    /// \param cropBox Crop box of the page
+    /// \param compiledPage Compiled page contents
+    /// \param pagePointToDevicePointMatrix Matrix mapping page to the placed rectangle
+    /// \param placedRect Rectangle of the page in the painter's coordinates
+    /// \param rect Visible rectangle in the painter's coordinates
+    /// \param features Renderer features
+    /// \param paperColor Paper color
+    /// \param drawPaper Fill the tiles background by paper color
+    /// \param opacity Opacity of the page graphics (paper is always opaque)
+    void drawPage(QPainter* painter,
+                  PDFInteger pageIndex,
+                  const QRectF& cropBox,
+                  const std::shared_ptr<const PDFPrecompiledPage>& compiledPage,
+                  const QTransform& pagePointToDevicePointMatrix,
+                  QRect placedRect,
+                  QRect rect,
+                  PDFRenderer::Features features,
+                  QColor paperColor,
+                  bool drawPaper,
+                  PDFReal opacity);
+
+    /// Removes tiles of given pages from the cache. Tiles of these
+    /// pages, which are being rendered, are discarded.
+    /// \param pages Sorted vector of page indices
+    void removePages(const std::vector<PDFInteger>& pages);
+
+    /// Removes all tiles from the cache. Tiles, which
+    /// are being rendered, are discarded.
+    void clear();
+
+    /// Waits until tiles being rendered are finished,
+    /// and inserts them into the cache.
+    void waitForFinished();
+
+    /// Sets cache limit in bytes. If cache exceeds the limit, it is shrinked.
+    /// \param cacheLimit Cache limit in bytes
+    void setCacheLimit(qint64 cacheLimit);
+
+    /// Returns cache limit in bytes
+    qint64 getCacheLimit() const { return m_cacheLimit; }
+
+    /// Returns size of the rendered tiles in the cache in bytes
+    qint64 getCacheSize() const { return m_cacheSize; }
+
+    /// Returns true, if page of given size (in device pixels)
+    /// should be drawn using the tiles.
+    /// \param pageSize Size of the page in device pixels
+    static bool isTiledRenderingUsed(QSize pageSize);
+
+signals:
+    void tilesRendered();
+
+private:
+    static constexpr int TILED_RENDERING_THRESHOLD = 4096;
+
+    struct Entry
+    {
+        QImage image;
+        qint64 size = 0;
+        std::list<PDFPageTileKey>::iterator lruIterator;
+    };
+
+    struct RenderedTile
+    {
+        PDFPageTileKey key;
+        QImage image;
+    };
+
+    struct RenderedTiles
+    {
+        quint64 generation = 0;
+        std::vector<RenderedTile> tiles;
+    };
+
+    /// Renders the tile. Function is thread safe.
+    /// \param key Tile key
+    /// \param cropBox Crop box of the page
+    /// \param compiledPage Compiled page contents
+    /// \param pagePointToDevicePointMatrix Matrix mapping page to the page device pixels
+    /// \param features Renderer features
+    static QImage renderTile(const PDFPageTileKey& key,
+                             const QRectF& cropBox,
+                             const PDFPrecompiledPage* compiledPage,
+                             const QTransform& pagePointToDevicePointMatrix,
+                             PDFRenderer::Features features);
+
+    /// Returns rectangle of the tile in the page device pixels
+    /// \param key Tile key
+    static QRect getTileRect(const PDFPageTileKey& key);
+
+    void onTilesRendered();
+
+    /// Inserts rendered tiles into the cache, if rendering is finished.
+    /// Returns true, if some tiles were inserted.
+    bool insertRenderedTiles();
+
+    /// Inserts rendered tile into the cache
+    void insert(const PDFPageTileKey& key, QImage image);
+
+    /// Removes least recently used entries, until cache limit is satisfied
+    void shrink();
+
+    qint64 m_cacheLimit;
+    qint64 m_cacheSize = 0;
+    std::map<PDFPageTileKey, Entry> m_entries;
+
+    /// Most recently used tiles are at the front of the list
+    std::list<PDFPageTileKey> m_lruList;
+
+    /// Generation of the cache, it is incremented each time the tiles are
+    /// removed, so tiles rendered from the old page contents are discarded.
+    quint64 m_generation = 0;
+
+    bool m_isRendering = false;
+    QFuture<RenderedTiles> m_renderFuture;
+    QFutureWatcher<RenderedTiles> m_renderFutureWatcher;
+};
+
+}   // namespace pdf
+
+#endif // PDFPAGETILECACHE_H
@@ -18,11 +18,15 @@
 #include "pdfpainter.h"
 #include "pdfpattern.h"
 #include "pdfcms.h"
+#include "pdfpainterutils.h"
 #include "pdfdbgheap.h"
 
 #include <QPainter>
 #include <QCryptographicHash>
 
+#include <set>
+#include <optional>
+
 namespace pdf
 {
 
@@ -109,6 +113,11 @@ bool PDFPainterBase::isContentSuppressedByOC(PDFObjectReference ocgOrOcmd)
     return PDFPageContentProcessor::isContentSuppressedByOC(ocgOrOcmd);
 }
 
+bool PDFPainterBase::isImageCacheUsed() const
+{
+    return true;
+}
+
 QPen PDFPainterBase::getCurrentPenImpl() const
 {
     const PDFPageContentProcessorState* graphicState = getGraphicState();
@@ -365,6 +374,14 @@ void PDFPainter::performImagePainting(const QImage& image)
     m_painter->restore();
 }
 
+void PDFPainter::performImagePyramidPainting(const PDFImagePyramid& imagePyramid)
+{
+    // Use smallest image, which is not smaller than the image on the device,
+    // so less pixels have to be transformed (or smoothed).
+    const PDFReal devicePixelRatio = m_painter->device() ? m_painter->device()->devicePixelRatioF() : 1.0;
+    performImagePainting(imagePyramid.getImage(m_painter->worldTransform() * QTransform::fromScale(devicePixelRatio, devicePixelRatio)));
+}
+
 void PDFPainter::performMeshPainting(const PDFMesh& mesh)
 {
     m_painter->save();
@@ -421,6 +438,19 @@ void PDFPrecompiledPageGenerator::performPathPainting(const QPainterPath& path,
 
     QPen pen = stroke ? getCurrentPen() : QPen(Qt::NoPen);
     QBrush brush = fill ? getCurrentBrush() : QBrush(Qt::NoBrush);
+
+    // Filled text with solid color can be drawn using glyph atlas. Text stroking
+    // and text clipping modes are always drawn using vector paths.
+    const TextGlyph* textGlyph = text ? getCurrentTextGlyph() : nullptr;
+    if (textGlyph &&
+        textGlyph->atlasId &&
+        getGraphicState()->getTextRenderingMode() == TextRenderingMode::Fill &&
+        brush.style() == Qt::SolidPattern)
+    {
+        m_precompiledPage->addGlyph(qMove(brush), path, PDFAtlasGlyph::create(*textGlyph->glyph, textGlyph->matrix, textGlyph->fontSize, *textGlyph->atlasId));
+        return;
+    }
+
     m_precompiledPage->addPath(qMove(pen), qMove(brush), path, text);
 }
 
@@ -438,8 +468,24 @@ void PDFPrecompiledPageGenerator::performImagePainting(const QImage& image)
         return;
     }
 
-    // Add snap info for image to the snapper
+    performImagePyramidPainting(PDFImagePyramid::create(image));
+}
+
+void PDFPrecompiledPageGenerator::performImagePyramidPainting(const PDFImagePyramid& imagePyramid)
+{
+    if (isContentSuppressed())
+    {
+        // Content is suppressed, do not paint anything
+        return;
+    }
+
+    const QImage& image = imagePyramid.getImage();
+
+    // Image decoded with reduced resolution limits resolution, at which the page can be drawn
     QTransform matrix = getCurrentWorldMatrix();
+    m_precompiledPage->updateImageResolutionLimit(imagePyramid.getResolutionLimit(matrix));
+
+    // Add snap info for image to the snapper
     PDFSnapInfo* snapInfo = m_precompiledPage->getSnapInfo();
     snapInfo->addImage({
                            matrix.map(QPointF(0.0, 0.0)),
@@ -465,12 +511,12 @@ void PDFPrecompiledPageGenerator::performImagePainting(const QImage& image)
             }
 
             imageWithAlpha.setAlphaChannel(alphaChannel);
-            m_precompiledPage->addImage(imageWithAlpha);
+            m_precompiledPage->addImage(PDFImagePyramid::create(qMove(imageWithAlpha)));
             return;
         }
     }
 
-    m_precompiledPage->addImage(image);
+    m_precompiledPage->addImage(imagePyramid);
 }
 
 void PDFPrecompiledPageGenerator::performMeshPainting(const PDFMesh& mesh)
@@ -504,6 +550,11 @@ void PDFPrecompiledPageGenerator::setCompositionMode(QPainter::CompositionMode m
     m_precompiledPage->addSetCompositionMode(mode);
 }
 
+PDFReal PDFPrecompiledPageGenerator::getImageResolution() const
+{
+    return m_imageResolution;
+}
+
 void PDFPrecompiledPage::draw(QPainter* painter,
                               const QRectF& cropBox,
                               const QTransform& pagePointToDevicePointMatrix,
@@ -517,6 +568,13 @@ void PDFPrecompiledPage::draw(QPainter* painter,
     painter->setWorldTransform(QTransform());
     painter->setOpacity(opacity);
 
+    // Determine visible area of the page. Area is enlarged by few pixels
+    // due to antialiasing and cosmetic pens (their width is in pixels).
+    constexpr PDFReal visibleAreaMargin = 4.0;
+    QRectF deviceVisibleRect = painter->hasClipping() ? painter->clipBoundingRect() : QRectF(painter->window());
+    deviceVisibleRect.adjust(-visibleAreaMargin, -visibleAreaMargin, visibleAreaMargin, visibleAreaMargin);
+    const QRectF visibleRect = pagePointToDevicePointMatrix.inverted().mapRect(deviceVisibleRect);
+
     if (features.testFlag(PDFRenderer::ClipToCropBox))
     {
         if (cropBox.isValid())
@@ -529,95 +587,484 @@ void PDFPrecompiledPage::draw(QPainter* painter,
 
     painter->setRenderHint(QPainter::SmoothPixmapTransform, features.testFlag(PDFRenderer::SmoothImages));
 
-    // Process all instructions
-    for (const Instruction& instruction : m_instructions)
+    if (m_spatialIndex.empty() || visibleRect.contains(m_spatialIndex.back().boundingBox))
     {
-        switch (instruction.type)
+        // Whole page is visible, process all instructions
+        for (const Instruction& instruction : m_instructions)
         {
-            case InstructionType::DrawPath:
+            executeInstruction(painter, instruction, pagePointToDevicePointMatrix, features);
+        }
+    }
+    else
+    {
+        // Traverse the spatial index, skip invisible nodes
+        struct TraversedNode
+        {
+            const SpatialIndexNode* node = nullptr;
+            uint32_t instruction = 0;
+            uint32_t child = 0;
+        };
+
+        std::vector<TraversedNode> stack;
+        const SpatialIndexNode* root = &m_spatialIndex.back();
+        if (root->boundingBox.intersects(visibleRect))
+        {
+            stack.push_back(TraversedNode{ root, root->firstInstruction, 0 });
+        }
+
+        while (!stack.empty())
+        {
+            TraversedNode& traversedNode = stack.back();
+            const SpatialIndexNode* node = traversedNode.node;
+
+            if (traversedNode.instruction == node->lastInstruction)
             {
-                const PathPaintData& data = m_paths[instruction.dataIndex];
+                stack.pop_back();
+                continue;
+            }
 
-                // Set antialiasing
-                const bool antialiasing = (data.isText && features.testFlag(PDFRenderer::TextAntialiasing)) || (!data.isText && features.testFlag(PDFRenderer::Antialiasing));
-                painter->setRenderHint(QPainter::Antialiasing, antialiasing);
-                painter->setPen(data.pen);
-                painter->setBrush(data.brush);
-                painter->drawPath(data.path);
+            const SpatialIndexNode* child = nullptr;
+            if (traversedNode.child < node->childCount)
+            {
+                const SpatialIndexNode* candidate = &m_spatialIndex[m_spatialIndexChildren[node->firstChild + traversedNode.child]];
+                if (candidate->firstInstruction == traversedNode.instruction)
+                {
+                    child = candidate;
+                }
+            }
+
+            if (!child)
+            {
+                executeInstruction(painter, m_instructions[traversedNode.instruction++], pagePointToDevicePointMatrix, features);
+                continue;
+            }
+
+            ++traversedNode.child;
+            traversedNode.instruction = child->lastInstruction;
+
+            if (child->boundingBox.intersects(visibleRect))
+            {
+                // Reference to the traversed node is invalidated here
+                stack.push_back(TraversedNode{ child, child->firstInstruction, 0 });
+            }
+            else
+            {
+                // Node is skipped, apply state changes made by the node
+                if (child->worldMatrix != -1)
+                {
+                    painter->setWorldTransform(QTransform(m_matrices[child->worldMatrix] * pagePointToDevicePointMatrix));
+                }
+                if (child->compositionMode != -1)
+                {
+                    painter->setCompositionMode(m_compositionModes[child->compositionMode]);
+                }
+            }
+        }
+    }
+
+    painter->restore();
+}
+
+void PDFPrecompiledPage::executeInstruction(QPainter* painter,
+                                            const Instruction& instruction,
+                                            const QTransform& pagePointToDevicePointMatrix,
+                                            PDFRenderer::Features features) const
+{
+    switch (instruction.type)
+    {
+        case InstructionType::DrawPath:
+        {
+            const PathPaintData& data = m_paths[instruction.dataIndex];
+
+            // Set antialiasing
+            const bool antialiasing = (data.isText && features.testFlag(PDFRenderer::TextAntialiasing)) || (!data.isText && features.testFlag(PDFRenderer::Antialiasing));
+
+            // Small text is drawn using glyph atlas
+            if (data.glyphIndex != -1 &&
+                features.testFlag(PDFRenderer::GlyphAtlas) &&
+                PDFGlyphAtlas::getInstance()->drawGlyph(painter, m_glyphs[data.glyphIndex], data.brush.color(), antialiasing))
+            {
                 break;
             }
 
-            case InstructionType::DrawImage:
+            painter->setRenderHint(QPainter::Antialiasing, antialiasing);
+            painter->setPen(data.pen);
+            painter->setBrush(data.brush);
+            painter->drawPath(data.path);
+            break;
+        }
+
+        case InstructionType::DrawImage:
+        {
+            const ImageData& data = m_images[instruction.dataIndex];
+
+            // Use smallest downsampled image, which is not smaller than the image on the device
+            const PDFReal devicePixelRatio = painter->device() ? painter->device()->devicePixelRatioF() : 1.0;
+            const QImage& image = data.imagePyramid.getImage(painter->worldTransform() * QTransform::fromScale(devicePixelRatio, devicePixelRatio));
+
+            painter->save();
+
+            QTransform imageTransform(1.0 / image.width(), 0, 0, 1.0 / image.height(), 0, 0);
+            QTransform worldTransform = imageTransform * painter->worldTransform();
+
+            // Jakub Melka: Because Qt uses opposite axis direction than PDF, then we must transform the y-axis
+            // to the opposite (so the image is then unchanged)
+            worldTransform.translate(0, image.height());
+            worldTransform.scale(1, -1);
+
+            painter->setWorldTransform(worldTransform);
+            painter->drawImage(0, 0, image);
+            painter->restore();
+            break;
+        }
+
+        case InstructionType::DrawMesh:
+        {
+            const MeshPaintData& data = m_meshes[instruction.dataIndex];
+
+            painter->save();
+            painter->setWorldTransform(QTransform(pagePointToDevicePointMatrix));
+            data.mesh.paint(painter, data.alpha);
+            painter->restore();
+            break;
+        }
+
+        case InstructionType::Clip:
+        {
+            painter->setClipPath(m_clips[instruction.dataIndex].clipPath, Qt::IntersectClip);
+            break;
+        }
+
+        case InstructionType::SaveGraphicState:
+        {
+            painter->save();
+            break;
+        }
+
+        case InstructionType::RestoreGraphicState:
+        {
+            painter->restore();
+            break;
+        }
+
+        case InstructionType::SetWorldMatrix:
+        {
+            painter->setWorldTransform(QTransform(m_matrices[instruction.dataIndex] * pagePointToDevicePointMatrix));
+            break;
+        }
+
+        case InstructionType::SetCompositionMode:
+        {
+            painter->setCompositionMode(m_compositionModes[instruction.dataIndex]);
+            break;
+        }
+
+        default:
+        {
+            Q_ASSERT(false);
+            break;
+        }
+    }
+}
+
+void PDFPrecompiledPage::buildSpatialIndex()
+{
+    m_spatialIndex.clear();
+    m_spatialIndexChildren.clear();
+
+    if (m_instructions.empty())
+    {
+        return;
+    }
+
+    // Bounding box of the graphics, whose extent can't be determined
+    constexpr PDFReal infinity = 1e30;
+    const QRectF infiniteRect(-infinity, -infinity, 2 * infinity, 2 * infinity);
+
+    // Degenerated paths (for example, horizontal lines) can be drawn, even if their area is zero
+    constexpr PDFReal epsilon = 0.01;
+
+    auto unite = [](const QRectF& left, const QRectF& right)
+    {
+        if (left.isEmpty())
+        {
+            return right;
+        }
+        if (right.isEmpty())
+        {
+            return left;
+        }
+        return left.united(right);
+    };
+
+    struct Item
+    {
+        QRectF boundingBox;
+        uint32_t firstInstruction = 0;
+        uint32_t lastInstruction = 0;
+        int32_t node = -1;
+        int32_t worldMatrix = -1;
+        int32_t compositionMode = -1;
+        bool isBarrier = false; ///< Instruction, which is never skipped
+    };
+
+    // Creates node from the items (items must be consecutive)
+    auto createNode = [this, &unite](uint32_t firstInstruction, uint32_t lastInstruction, const Item* begin, const Item* end, bool isGroup)
+    {
+        SpatialIndexNode node;
+        node.firstInstruction = firstInstruction;
+        node.lastInstruction = lastInstruction;
+        node.firstChild = uint32_t(m_spatialIndexChildren.size());
+
+        for (const Item* item = begin; item != end; ++item)
+        {
+            node.boundingBox = unite(node.boundingBox, item->boundingBox);
+
+            if (item->node != -1)
             {
-                const ImageData& data = m_images[instruction.dataIndex];
-                const QImage& image = data.image;
+                m_spatialIndexChildren.push_back(uint32_t(item->node));
+            }
 
-                painter->save();
+            // Save/restore graphic state pair doesn't change the state
+            if (!isGroup)
+            {
+                if (item->worldMatrix != -1)
+                {
+                    node.worldMatrix = item->worldMatrix;
+                }
+                if (item->compositionMode != -1)
+                {
+                    node.compositionMode = item->compositionMode;
+                }
+            }
+        }
 
-                QTransform imageTransform(1.0 / image.width(), 0, 0, 1.0 / image.height(), 0, 0);
-                QTransform worldTransform = imageTransform * painter->worldTransform();
+        node.childCount = uint32_t(m_spatialIndexChildren.size()) - node.firstChild;
+
+        Item item;
+        item.boundingBox = node.boundingBox;
+        item.firstInstruction = firstInstruction;
+        item.lastInstruction = lastInstruction;
+        item.node = int32_t(m_spatialIndex.size());
+        item.worldMatrix = node.worldMatrix;
+        item.compositionMode = node.compositionMode;
+        m_spatialIndex.push_back(node);
+        return item;
+    };
 
-                // Jakub Melka: Because Qt uses opposite axis direction than PDF, then we must transform the y-axis
-                // to the opposite (so the image is then unchanged)
-                worldTransform.translate(0, image.height());
-                worldTransform.scale(1, -1);
+    // Body of the save/restore graphic state pair (or the whole page)
+    struct Group
+    {
+        uint32_t firstInstruction = 0;
+        std::optional<QTransform> matrix; ///< Current world matrix (unknown at the beginning)
+        QRectF clipBox;
+        std::vector<Item> items;
+        std::vector<Item> leafItems; ///< Items of the leaf node being created
+    };
+
+    auto flushLeaf = [&createNode](Group& group)
+    {
+        if (group.leafItems.size() == 1 && group.leafItems.front().node != -1)
+        {
+            // Single group, do not create a new node
+            group.items.push_back(group.leafItems.front());
+        }
+        else if (!group.leafItems.empty())
+        {
+            const Item* begin = group.leafItems.data();
+            const Item* end = begin + group.leafItems.size();
+            group.items.push_back(createNode(begin->firstInstruction, (end - 1)->lastInstruction, begin, end, false));
+        }
+
+        group.leafItems.clear();
+    };
+
+    auto addItem = [&flushLeaf](Group& group, const Item& item)
+    {
+        if (item.isBarrier)
+        {
+            flushLeaf(group);
+            group.items.push_back(item);
+        }
+        else
+        {
+            group.leafItems.push_back(item);
+            if (group.leafItems.size() == SPATIAL_INDEX_NODE_SIZE)
+            {
+                flushLeaf(group);
+            }
+        }
+    };
+
+    // Creates node for the group, consecutive items between barriers are grouped
+    // hierarchically to nodes, until there is at most SPATIAL_INDEX_NODE_SIZE nodes.
+    auto finishGroup = [&](Group& group, uint32_t lastInstruction)
+    {
+        flushLeaf(group);
+
+        std::vector<Item> items;
+        auto it = group.items.cbegin();
+        while (it != group.items.cend())
+        {
+            if (it->isBarrier)
+            {
+                items.push_back(*it++);
+                continue;
+            }
+
+            auto itEnd = std::find_if(it, group.items.cend(), [](const Item& item) { return item.isBarrier; });
+            std::vector<Item> level(it, itEnd);
+            while (level.size() > SPATIAL_INDEX_NODE_SIZE)
+            {
+                std::vector<Item> nextLevel;
+                for (size_t i = 0; i < level.size(); i += SPATIAL_INDEX_NODE_SIZE)
+                {
+                    const Item* begin = level.data() + i;
+                    const Item* end = level.data() + qMin<size_t>(i + SPATIAL_INDEX_NODE_SIZE, level.size());
+                    nextLevel.push_back(end - begin == 1 ? *begin : createNode(begin->firstInstruction, (end - 1)->lastInstruction, begin, end, false));
+                }
+                level = qMove(nextLevel);
+            }
+
+            items.insert(items.end(), level.cbegin(), level.cend());
+            it = itEnd;
+        }
+
+        const Item* begin = items.data();
+        return createNode(group.firstInstruction, lastInstruction, begin, begin + items.size(), true);
+    };
+
+    std::vector<Group> stack;
+    stack.emplace_back();
+    stack.back().clipBox = infiniteRect;
+
+    const uint32_t instructionCount = uint32_t(m_instructions.size());
+    for (uint32_t i = 0; i < instructionCount; ++i)
+    {
+        const Instruction& instruction = m_instructions[i];
+        Group& group = stack.back();
+
+        Item item;
+        item.firstInstruction = i;
+        item.lastInstruction = i + 1;
+
+        switch (instruction.type)
+        {
+            case InstructionType::DrawPath:
+            {
+                const PathPaintData& data = m_paths[instruction.dataIndex];
+                QRectF boundingBox = infiniteRect;
+
+                if (group.matrix)
+                {
+                    boundingBox = data.path.controlPointRect();
 
-                painter->setWorldTransform(worldTransform);
-                painter->drawImage(0, 0, image);
-                painter->restore();
+                    if (data.pen.style() != Qt::NoPen && !data.pen.isCosmetic())
+                    {
+                        // Miter joins and square caps can exceed half of the pen width
+                        const bool isMiterJoin = data.pen.joinStyle() == Qt::MiterJoin || data.pen.joinStyle() == Qt::SvgMiterJoin;
+                        const PDFReal extent = 0.5 * data.pen.widthF() * qMax(isMiterJoin ? data.pen.miterLimit() : 1.0, 1.5);
+                        boundingBox.adjust(-extent, -extent, extent, extent);
+                    }
+
+                    boundingBox = group.matrix->mapRect(boundingBox.adjusted(-epsilon, -epsilon, epsilon, epsilon));
+                }
+
+                item.boundingBox = boundingBox.intersected(group.clipBox);
                 break;
             }
 
-            case InstructionType::DrawMesh:
+            case InstructionType::DrawImage:
             {
-                const MeshPaintData& data = m_meshes[instruction.dataIndex];
+                // Image is drawn in the unit square
+                QRectF boundingBox = group.matrix ? group.matrix->mapRect(QRectF(0.0, 0.0, 1.0, 1.0)) : infiniteRect;
+                item.boundingBox = boundingBox.adjusted(-epsilon, -epsilon, epsilon, epsilon).intersected(group.clipBox);
+                break;
+            }
 
-                painter->save();
-                painter->setWorldTransform(QTransform(pagePointToDevicePointMatrix));
-                data.mesh.paint(painter, data.alpha);
-                painter->restore();
+            case InstructionType::DrawMesh:
+            {
+                // Mesh is drawn in page coordinates
+                QRectF boundingBox = m_meshes[instruction.dataIndex].mesh.getBoundingRect();
+                item.boundingBox = boundingBox.adjusted(-epsilon, -epsilon, epsilon, epsilon).intersected(group.clipBox);
                 break;
             }
 
             case InstructionType::Clip:
             {
-                painter->setClipPath(m_clips[instruction.dataIndex].clipPath, Qt::IntersectClip);
+                if (group.matrix)
+                {
+                    group.clipBox = group.clipBox.intersected(group.matrix->mapRect(m_clips[instruction.dataIndex].clipPath.controlPointRect()));
+                }
+                item.isBarrier = true;
                 break;
             }
 
             case InstructionType::SaveGraphicState:
             {
-                painter->save();
-                break;
+                Group newGroup;
+                newGroup.firstInstruction = i;
+                newGroup.matrix = group.matrix;
+                newGroup.clipBox = group.clipBox;
+                stack.emplace_back(qMove(newGroup));
+                continue;
             }
 
             case InstructionType::RestoreGraphicState:
             {
-                painter->restore();
+                if (stack.size() > 1)
+                {
+                    Item groupItem = finishGroup(stack.back(), i + 1);
+                    stack.pop_back();
+                    addItem(stack.back(), groupItem);
+                    continue;
+                }
+
+                // Restore without save, we do not know the state after it
+                group.matrix = std::nullopt;
+                group.clipBox = infiniteRect;
+                item.isBarrier = true;
                 break;
             }
 
             case InstructionType::SetWorldMatrix:
             {
-                painter->setWorldTransform(QTransform(m_matrices[instruction.dataIndex] * pagePointToDevicePointMatrix));
+                group.matrix = m_matrices[instruction.dataIndex];
+                item.worldMatrix = int32_t(instruction.dataIndex);
                 break;
             }
 
             case InstructionType::SetCompositionMode:
             {
-                painter->setCompositionMode(m_compositionModes[instruction.dataIndex]);
+                item.compositionMode = int32_t(instruction.dataIndex);
                 break;
             }
 
             default:
             {
                 Q_ASSERT(false);
+                item.isBarrier = true;
                 break;
             }
         }
+
+        addItem(group, item);
     }
 
-    painter->restore();
+    // Save graphic state without restore, group ends at the end of the page
+    while (stack.size() > 1)
+    {
+        Item groupItem = finishGroup(stack.back(), instructionCount);
+        stack.pop_back();
+        addItem(stack.back(), groupItem);
+    }
+
+    // Root node is the last node
+    stack.back().firstInstruction = 0;
+    finishGroup(stack.back(), instructionCount);
+
+    m_spatialIndex.shrink_to_fit();
+    m_spatialIndexChildren.shrink_to_fit();
 }
 
 void PDFPrecompiledPage::redact(QPainterPath redactPath, const QTransform& matrix, QColor color)
@@ -646,6 +1093,11 @@ void PDFPrecompiledPage::redact(QPainterPath redactPath, const QTransform& matri
                 QTransform currentMatrix = worldMatrixStack.top().inverted();
                 QPainterPath mappedRedactPath = currentMatrix.map(redactPath);
                 PathPaintData& path = m_paths[instruction.dataIndex];
+                if (path.glyphIndex != -1 && path.path.intersects(mappedRedactPath))
+                {
+                    // Glyph is partially redacted, it can't be drawn using glyph atlas
+                    path.glyphIndex = -1;
+                }
                 path.path = path.path.subtracted(mappedRedactPath);
                 break;
             }
@@ -653,7 +1105,7 @@ void PDFPrecompiledPage::redact(QPainterPath redactPath, const QTransform& matri
             case InstructionType::DrawImage:
             {
                 ImageData& data = m_images[instruction.dataIndex];
-                QImage& image = data.image;
+                QImage image = data.imagePyramid.getImage();
 
                 QTransform imageTransform(1.0 / image.width(), 0, 0, 1.0 / image.height(), 0, 0);
                 QTransform worldTransform = imageTransform * QTransform(worldMatrixStack.top());
@@ -667,6 +1119,9 @@ void PDFPrecompiledPage::redact(QPainterPath redactPath, const QTransform& matri
                 painter.setWorldTransform(worldTransform.inverted());
                 painter.drawPath(redactPath);
                 painter.end();
+
+                // Downsampled images must be also redacted
+                data.imagePyramid = PDFImagePyramid::create(qMove(image));
                 break;
             }
 
@@ -710,6 +1165,8 @@ void PDFPrecompiledPage::redact(QPainterPath redactPath, const QTransform& matri
         addRestoreGraphicState();
         addPath(Qt::NoPen, QBrush(color), matrix.map(redactPath), false);
     }
+
+    buildSpatialIndex();
 }
 
 void PDFPrecompiledPage::addPath(QPen pen, QBrush brush, QPainterPath path, bool isText)
@@ -718,23 +1175,23 @@ void PDFPrecompiledPage::addPath(QPen pen, QBrush brush, QPainterPath path, bool
     m_paths.emplace_back(qMove(pen), qMove(brush), qMove(path), isText);
 }
 
+void PDFPrecompiledPage::addGlyph(QBrush brush, QPainterPath path, PDFAtlasGlyph glyph)
+{
+    addPath(Qt::NoPen, qMove(brush), qMove(path), true);
+    m_paths.back().glyphIndex = int(m_glyphs.size());
+    m_glyphs.emplace_back(qMove(glyph));
+}
+
 void PDFPrecompiledPage::addClip(QPainterPath path)
 {
     m_instructions.emplace_back(InstructionType::Clip, m_clips.size());
     m_clips.emplace_back(qMove(path));
 }
 
-void PDFPrecompiledPage::addImage(QImage image)
+void PDFPrecompiledPage::addImage(PDFImagePyramid imagePyramid)
 {
-    // Convert the image into format Format_ARGB32_Premultiplied for fast drawing.
-    // If this format is used, then no image conversion is performed while drawing.
-    if (image.format() != QImage::Format_ARGB32_Premultiplied)
-    {
-        image.convertTo(QImage::Format_ARGB32_Premultiplied);
-    }
-
     m_instructions.emplace_back(InstructionType::DrawImage, m_images.size());
-    m_images.emplace_back(qMove(image));
+    m_images.emplace_back(qMove(imagePyramid));
 }
 
 void PDFPrecompiledPage::addMesh(PDFMesh mesh, PDFReal alpha)
@@ -761,6 +1218,7 @@ void PDFPrecompiledPage::optimize()
     m_paths.shrink_to_fit();
     m_clips.shrink_to_fit();
     m_images.shrink_to_fit();
+    m_glyphs.shrink_to_fit();
     m_meshes.shrink_to_fit();
     m_matrices.shrink_to_fit();
     m_compositionModes.shrink_to_fit();
@@ -787,7 +1245,7 @@ void PDFPrecompiledPage::invertColors()
 
     for (ImageData& imageData : m_images)
     {
-        imageData.image.invertPixels(QImage::InvertRgb);
+        imageData.imagePyramid.invertColors();
     }
 
     for (MeshPaintData& meshPaintData : m_meshes)
@@ -803,32 +1261,60 @@ void PDFPrecompiledPage::finalize(qint64 compilingTimeNS, QList<PDFRenderError>
     m_compilingTimeNS = compilingTimeNS;
     m_errors = qMove(errors);
 
+    buildSpatialIndex();
+
     // Determine memory consumption
     m_memoryConsumptionEstimate = sizeof(*this);
     m_memoryConsumptionEstimate += sizeof(Instruction) * m_instructions.capacity();
     m_memoryConsumptionEstimate += sizeof(PathPaintData) * m_paths.capacity();
     m_memoryConsumptionEstimate += sizeof(ClipData) * m_clips.capacity();
     m_memoryConsumptionEstimate += sizeof(ImageData) * m_images.capacity();
+    m_memoryConsumptionEstimate += sizeof(PDFAtlasGlyph) * m_glyphs.capacity();
     m_memoryConsumptionEstimate += sizeof(MeshPaintData) * m_meshes.capacity();
     m_memoryConsumptionEstimate += sizeof(QTransform) * m_matrices.capacity();
     m_memoryConsumptionEstimate += sizeof(QPainter::CompositionMode) * m_compositionModes.capacity();
+    m_memoryConsumptionEstimate += sizeof(SpatialIndexNode) * m_spatialIndex.capacity();
+    m_memoryConsumptionEstimate += sizeof(uint32_t) * m_spatialIndexChildren.capacity();
     m_memoryConsumptionEstimate += sizeof(PDFRenderError) * m_errors.size();
 
-    auto calculateQPathMemoryConsumption = [](const QPainterPath& path)
+    for (const PDFRenderError& error : m_errors)
+    {
+        m_memoryConsumptionEstimate += error.message.capacity() * sizeof(QChar);
+    }
+
+    // Images are implicitly shared, so we count memory of each image only once
+    std::set<qint64> imageCacheKeys;
+    auto calculateImageMemoryConsumption = [&imageCacheKeys](const QImage& image) -> qint64
     {
-        return sizeof(QPainterPath::Element) * path.capacity();
+        if (image.isNull() || !imageCacheKeys.insert(image.cacheKey()).second)
+        {
+            return 0;
+        }
+
+        return image.sizeInBytes();
     };
+
     for (const PathPaintData& data : m_paths)
     {
-        m_memoryConsumptionEstimate += calculateQPathMemoryConsumption(data.path);
+        m_memoryConsumptionEstimate += PDFPainterHelper::getPainterPathMemoryConsumptionEstimate(data.path);
+        m_memoryConsumptionEstimate += data.pen.dashPattern().capacity() * sizeof(qreal);
+
+        // Brushes of tiling patterns contain texture image
+        if (data.brush.style() == Qt::TexturePattern)
+        {
+            m_memoryConsumptionEstimate += calculateImageMemoryConsumption(data.brush.textureImage());
+        }
     }
     for (const ClipData& data : m_clips)
     {
-        m_memoryConsumptionEstimate += calculateQPathMemoryConsumption(data.clipPath);
+        m_memoryConsumptionEstimate += PDFPainterHelper::getPainterPathMemoryConsumptionEstimate(data.clipPath);
     }
     for (const ImageData& data : m_images)
     {
-        m_memoryConsumptionEstimate += data.image.sizeInBytes();
+        for (const QImage& image : data.imagePyramid.getLevels())
+        {
+            m_memoryConsumptionEstimate += calculateImageMemoryConsumption(image);
+        }
     }
     for (const MeshPaintData& data : m_meshes)
     {
@@ -912,7 +1398,7 @@ PDFPrecompiledPage::GraphicPieceInfos PDFPrecompiledPage::calculateGraphicPieceI
             case InstructionType::DrawImage:
             {
                 const ImageData& data = m_images[instruction.dataIndex];
-                const QImage& image = data.image;
+                const QImage& image = data.imagePyramid.getImage();
 
                 GraphicPieceInfo info;
                 QByteArray serializedPath;
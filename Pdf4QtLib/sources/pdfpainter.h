@@ -24,11 +24,15 @@
 #include "pdfpagecontentprocessor.h"
 #include "pdftextlayout.h"
 #include "pdfsnapper.h"
+#include "pdfimagecache.h"
+#include "pdfglyphatlas.h"
 
 #include <QPen>
 #include <QBrush>
 #include <QElapsedTimer>
 
+#include <limits>
+
 namespace pdf
 {
 
@@ -51,6 +55,7 @@ public:
     virtual bool isContentSuppressedByOC(PDFObjectReference ocgOrOcmd) override;
 
 protected:
+    virtual bool isImageCacheUsed() const override;
     virtual void performUpdateGraphicsState(const PDFPageContentProcessorState& state) override;
     virtual void performBeginTransparencyGroup(ProcessOrder order, const PDFTransparencyGroup& transparencyGroup) override;
     virtual void performEndTransparencyGroup(ProcessOrder order, const PDFTransparencyGroup& transparencyGroup) override;
@@ -133,6 +138,7 @@ protected:
     virtual void performPathPainting(const QPainterPath& path, bool stroke, bool fill, bool text, Qt::FillRule fillRule) override;
     virtual void performClipping(const QPainterPath& path, Qt::FillRule fillRule) override;
     virtual void performImagePainting(const QImage& image) override;
+    virtual void performImagePyramidPainting(const PDFImagePyramid& imagePyramid) override;
     virtual void performMeshPainting(const PDFMesh& mesh) override;
     virtual void performSaveGraphicState(ProcessOrder order) override;
     virtual void performRestoreGraphicState(ProcessOrder order) override;
@@ -146,7 +152,7 @@ private:
 /// Precompiled page contains precompiled graphic instructions of a PDF page to draw it quickly
 /// on the target painter. It enables very fast drawing, because instructions are not decoded
 /// and interpreted from the PDF stream, but they are just "played" on the painter.
-class PDFPrecompiledPage
+class PDF4QTLIBSHARED_EXPORT PDFPrecompiledPage
 {
 public:
     explicit inline PDFPrecompiledPage() = default;
@@ -183,7 +189,9 @@ public:
         size_t dataIndex = 0;
     };
 
-    /// Paints page onto the painter using matrix
+    /// Paints page onto the painter using matrix. Only graphics intersecting
+    /// painter's clipping area (or painter's window, if clipping is not set)
+    /// is drawn, invisible graphics is skipped using spatial index.
     /// \param painter Painter, onto which is page drawn
     /// \param cropBox Page's crop box
     /// \param pagePointToDevicePointMatrix Page point to device point transformation matrix
@@ -202,8 +210,9 @@ public:
     void redact(QPainterPath redactPath, const QTransform& matrix, QColor color);
 
     void addPath(QPen pen, QBrush brush, QPainterPath path, bool isText);
+    void addGlyph(QBrush brush, QPainterPath path, PDFAtlasGlyph glyph);
     void addClip(QPainterPath path);
-    void addImage(QImage image);
+    void addImage(PDFImagePyramid imagePyramid);
     void addMesh(PDFMesh mesh, PDFReal alpha);
     void addSaveGraphicState() { m_instructions.emplace_back(InstructionType::SaveGraphicState, 0); }
     void addRestoreGraphicState() { m_instructions.emplace_back(InstructionType::RestoreGraphicState, 0); }
@@ -224,6 +233,10 @@ public:
     /// Returns compiling time in nanoseconds
     qint64 getCompilingTimeNS() const { return m_compilingTimeNS; }
 
+    /// Returns statistics of color conversions performed while compiling the page
+    const PDFPageContentProcessor::ColorConversionStatistics& getColorConversionStatistics() const { return m_colorConversionStatistics; }
+    void setColorConversionStatistics(const PDFPageContentProcessor::ColorConversionStatistics& statistics) { m_colorConversionStatistics = statistics; }
+
     /// Returns a list of rendering errors
     const QList<PDFRenderError>& getErrors() const { return m_errors; }
 
@@ -237,6 +250,13 @@ public:
     QColor getPaperColor() const { return m_paperColor; }
     void setPaperColor(QColor paperColor) { m_paperColor = paperColor; }
 
+    /// Returns maximal resolution (in device pixels per page unit), at which
+    /// images of the page can be drawn without loss of quality. If images were
+    /// decoded with reduced resolution, page must be compiled again to be drawn
+    /// with higher resolution. If all images have full resolution, infinity is returned.
+    PDFReal getImageResolutionLimit() const { return m_imageResolutionLimit; }
+    void updateImageResolutionLimit(PDFReal limit) { m_imageResolutionLimit = qMin(m_imageResolutionLimit, limit); }
+
     PDFSnapInfo* getSnapInfo() { return &m_snapInfo; }
     const PDFSnapInfo* getSnapInfo() const { return &m_snapInfo; }
 
@@ -306,6 +326,7 @@ private:
         QBrush brush;
         QPainterPath path;
         bool isText = false;
+        int glyphIndex = -1;    ///< Index of glyph, if text can be drawn using glyph atlas
     };
 
     struct ClipData
@@ -323,13 +344,13 @@ private:
     struct ImageData
     {
         inline ImageData() = default;
-        inline ImageData(QImage image) :
-            image(qMove(image))
+        inline ImageData(PDFImagePyramid imagePyramid) :
+            imagePyramid(qMove(imagePyramid))
         {
 
         }
 
-        QImage image;
+        PDFImagePyramid imagePyramid;
     };
 
     struct MeshPaintData
@@ -346,16 +367,55 @@ private:
         PDFReal alpha = 1.0;
     };
 
+    /// Node of the spatial index. Node contains continuous range of instructions,
+    /// child nodes contain subranges of this range. If node is not visible, all
+    /// its instructions are skipped, only world matrix and composition mode set
+    /// in the node (outside of save/restore graphic state pairs) are applied.
+    /// If node is visible, instructions not contained in child nodes are executed.
+    struct SpatialIndexNode
+    {
+        QRectF boundingBox;             ///< Bounding box of drawn graphics in page coordinates
+        uint32_t firstInstruction = 0;
+        uint32_t lastInstruction = 0;   ///< Index of instruction after the last instruction of the node
+        uint32_t firstChild = 0;        ///< Index of first child in the children array
+        uint32_t childCount = 0;
+        int32_t worldMatrix = -1;       ///< Last world matrix set by the node (-1, if none)
+        int32_t compositionMode = -1;   ///< Last composition mode set by the node (-1, if none)
+    };
+
+    static constexpr uint32_t SPATIAL_INDEX_NODE_SIZE = 16;
+
+    /// Builds spatial index over the instructions. Instructions are grouped into
+    /// nodes (consecutive instructions in the node) hierarchically, painting order
+    /// is kept. Save/restore graphic state pairs form separate nodes, clipping
+    /// instructions are never skipped.
+    void buildSpatialIndex();
+
+    /// Executes instruction on the painter
+    /// \param painter Painter
+    /// \param instruction Instruction
+    /// \param pagePointToDevicePointMatrix Page point to device point transformation matrix
+    /// \param features Renderer features
+    void executeInstruction(QPainter* painter,
+                            const Instruction& instruction,
+                            const QTransform& pagePointToDevicePointMatrix,
+                            PDFRenderer::Features features) const;
+
     qint64 m_compilingTimeNS = 0;
     qint64 m_memoryConsumptionEstimate = 0;
+    PDFPageContentProcessor::ColorConversionStatistics m_colorConversionStatistics;
     QColor m_paperColor = QColor(Qt::white);
+    PDFReal m_imageResolutionLimit = std::numeric_limits<PDFReal>::infinity();
     std::vector<Instruction> m_instructions;
     std::vector<PathPaintData> m_paths;
     std::vector<ClipData> m_clips;
     std::vector<ImageData> m_images;
+    std::vector<PDFAtlasGlyph> m_glyphs;
     std::vector<MeshPaintData> m_meshes;
     std::vector<QTransform> m_matrices;
     std::vector<QPainter::CompositionMode> m_compositionModes;
+    std::vector<SpatialIndexNode> m_spatialIndex; ///< Spatial index nodes, last node is the root node
+    std::vector<uint32_t> m_spatialIndexChildren;
     QList<PDFRenderError> m_errors;
     PDFSnapInfo m_snapInfo;
     QElapsedTimer m_expirationTimer;
@@ -377,18 +437,25 @@ public:
                                                 const PDFOptionalContentActivity* optionalContentActivity,
                                                 const PDFMeshQualitySettings& meshQualitySettings);
 
+    /// Sets resolution (in device pixels per page unit), for which images are decoded.
+    /// Zero means full resolution of images.
+    void setImageResolution(PDFReal imageResolution) { m_imageResolution = imageResolution; }
+
 protected:
     virtual void performPathPainting(const QPainterPath& path, bool stroke, bool fill, bool text, Qt::FillRule fillRule) override;
     virtual void performClipping(const QPainterPath& path, Qt::FillRule fillRule) override;
     virtual void performImagePainting(const QImage& image) override;
+    virtual void performImagePyramidPainting(const PDFImagePyramid& imagePyramid) override;
     virtual void performMeshPainting(const PDFMesh& mesh) override;
     virtual void performSaveGraphicState(ProcessOrder order) override;
     virtual void performRestoreGraphicState(ProcessOrder order) override;
     virtual void setWorldMatrix(const QTransform& matrix) override;
     virtual void setCompositionMode(QPainter::CompositionMode mode) override;
+    virtual PDFReal getImageResolution() const override;
 
 private:
     PDFPrecompiledPage* m_precompiledPage;
+    PDFReal m_imageResolution = 0.0;
 };
 
 }   // namespace pdf
@@ -62,4 +62,19 @@ QRect PDFPainterHelper::drawBubble(QPainter* painter, QPoint point, QColor color
     return rectangle;
 }
 
+qint64 PDFPainterHelper::getPainterPathMemoryConsumptionEstimate(const QPainterPath& path)
+{
+    // Approximate size of the private data of the path (reference counter,
+    // element list header, fill rule and cached bounding rectangles).
+    constexpr qint64 PRIVATE_DATA_SIZE_ESTIMATE = 128;
+
+    const qint64 capacity = path.capacity();
+    if (capacity == 0)
+    {
+        return 0;
+    }
+
+    return PRIVATE_DATA_SIZE_ESTIMATE + capacity * qint64(sizeof(QPainterPath::Element));
+}
+
 }   // namespace pdf
@@ -21,6 +21,7 @@
 #include "pdfglobal.h"
 
 #include <QPainter>
+#include <QPainterPath>
 
 namespace pdf
 {
@@ -55,6 +56,11 @@ public:
     /// \param text Text inside the bubble
     /// \param alignment Bubble alignment relative to the bubble position point
     static QRect drawBubble(QPainter* painter, QPoint point, QColor color, QString text, Qt::Alignment alignment);
+
+    /// Returns estimate of the memory consumed by the path data in bytes
+    /// (path elements and private data of the path). Object itself is not counted.
+    /// \param path Painter path
+    static qint64 getPainterPathMemoryConsumptionEstimate(const QPainterPath& path);
 };
 
 }   // namespace pdf
@@ -164,7 +164,7 @@ PDFLexicalAnalyzer::Token PDFLexicalAnalyzer::fetch()
                 real = -real;
             }
 
-            return !treatAsReal ? Token(TokenType::Integer, QVariant(static_cast<qint64>(integer))) : Token(TokenType::Real, real);
+            return !treatAsReal ? Token(TokenType::Integer, integer) : Token(TokenType::Real, real);
         }
 
         case CHAR_LEFT_BRACKET:
@@ -172,6 +172,23 @@ PDFLexicalAnalyzer::Token PDFLexicalAnalyzer::fetch()
             // String '(', sequence of literal characters enclosed in "()", see PDF 1.7 Reference,
             // chapter 3.2.3. Note: literal string can have properly balanced brackets inside.
 
+            // Fast path - if string doesn't contain escape sequences, then its content
+            // is the same as in the source buffer, so we can use a view.
+            const char* stringBegin = m_current + 1;
+            int viewParenthesisBalance = 1;
+            for (const char* it = stringBegin; it != m_end && *it != CHAR_BACKSLASH; ++it)
+            {
+                if (*it == CHAR_LEFT_BRACKET)
+                {
+                    ++viewParenthesisBalance;
+                }
+                else if (*it == CHAR_RIGHT_BRACKET && --viewParenthesisBalance == 0)
+                {
+                    m_current = it + 1;
+                    return Token::createView(TokenType::String, stringBegin, std::distance(stringBegin, it));
+                }
+            }
+
             int parenthesisBalance = 1;
             QByteArray string;
             string.reserve(STRING_BUFFER_RESERVE);
@@ -304,6 +321,20 @@ PDFLexicalAnalyzer::Token PDFLexicalAnalyzer::fetch()
 
             fetchChar();
 
+            // Fast path - name without '#' characters is a view into the source buffer
+            const char* nameBegin = m_current;
+            const char* nameEnd = nameBegin;
+            while (nameEnd != m_end && *nameEnd != CHAR_MARK && isRegular(*nameEnd))
+            {
+                ++nameEnd;
+            }
+
+            if (nameEnd == m_end || *nameEnd != CHAR_MARK)
+            {
+                m_current = nameEnd;
+                return Token::createView(TokenType::Name, nameBegin, std::distance(nameBegin, nameEnd));
+            }
+
             QByteArray name;
             name.reserve(NAME_BUFFER_RESERVE);
 
@@ -431,14 +462,13 @@ PDFLexicalAnalyzer::Token PDFLexicalAnalyzer::fetch()
             if (isRegular(lookChar()))
             {
                 // It should be sequence of regular characters - command, true, false, null...
-                QByteArray command;
-                command.reserve(COMMAND_BUFFER_RESERVE);
-
+                const char* commandBegin = m_current;
                 while (!isAtEnd() && isRegular(lookChar()))
                 {
-                    command += fetchChar();
+                    ++m_current;
                 }
 
+                const QByteArrayView command(commandBegin, m_current);
                 if (command == BOOL_OBJECT_TRUE_STRING)
                 {
                     return Token(TokenType::Boolean, true);
@@ -453,7 +483,7 @@ PDFLexicalAnalyzer::Token PDFLexicalAnalyzer::fetch()
                 }
                 else
                 {
-                    return Token(TokenType::Command, std::move(command));
+                    return Token::createView(TokenType::Command, command.data(), command.size());
                 }
             }
             else if (m_tokenizingPostScriptFunction)
@@ -461,7 +491,9 @@ PDFLexicalAnalyzer::Token PDFLexicalAnalyzer::fetch()
                 const char currentChar = lookChar();
                 if (currentChar == CHAR_LEFT_CURLY_BRACKET || currentChar == CHAR_RIGHT_CURLY_BRACKET)
                 {
-                    return Token(TokenType::Command, QByteArray(1, fetchChar()));
+                    const char* commandBegin = m_current;
+                    fetchChar();
+                    return Token::createView(TokenType::Command, commandBegin, 1);
                 }
 
                 error(tr("Unexpected character '%1' in the stream.").arg(currentChar));
@@ -699,32 +731,45 @@ PDFParser::PDFParser(std::function<PDFLexicalAnalyzer::Token ()> tokenFetcher) :
     m_lookAhead2 = fetch();
 }
 
+QByteArray PDFParser::getTokenString(const PDFLexicalAnalyzer::Token& token)
+{
+    QByteArrayView string = token.getStringView();
+
+    // Short strings are stored inplace in the PDF object, so we do not need to create
+    // a deep copy of the token data, if token is a view into the source buffer.
+    if (token.isView() && string.size() <= PDFInplaceString::MAX_STRING_SIZE)
+    {
+        return QByteArray::fromRawData(string.data(), string.size());
+    }
+
+    QByteArray result = token.getString();
+    result.shrink_to_fit();
+    return result;
+}
+
 PDFObject PDFParser::getObject()
 {
     switch (m_lookAhead1.type)
     {
         case PDFLexicalAnalyzer::TokenType::Boolean:
         {
-            Q_ASSERT(m_lookAhead1.data.typeId() == QMetaType::Bool);
-            const bool value = m_lookAhead1.data.toBool();
+            const bool value = m_lookAhead1.getBool();
             shift();
             return PDFObject::createBool(value);
         }
 
         case PDFLexicalAnalyzer::TokenType::Integer:
         {
-            Q_ASSERT(m_lookAhead1.data.typeId() == QMetaType::LongLong);
-            const PDFInteger value = m_lookAhead1.data.toLongLong();
+            const PDFInteger value = m_lookAhead1.getInteger();
             shift();
 
             // We must check, if we are reading reference. In this case,
             // actual value is integer and next value is command "R".
             if (m_lookAhead1.type == PDFLexicalAnalyzer::TokenType::Integer &&
                 m_lookAhead2.type == PDFLexicalAnalyzer::TokenType::Command &&
-                m_lookAhead2.data.toByteArray() == PDF_REFERENCE_COMMAND)
+                m_lookAhead2.getStringView() == PDF_REFERENCE_COMMAND)
             {
-                Q_ASSERT(m_lookAhead1.data.typeId() == QMetaType::LongLong);
-                const PDFInteger generation = m_lookAhead1.data.toLongLong();
+                const PDFInteger generation = m_lookAhead1.getInteger();
                 shift();
                 shift();
                 return PDFObject::createReference(PDFObjectReference(value, generation));
@@ -738,26 +783,21 @@ PDFObject PDFParser::getObject()
 
         case PDFLexicalAnalyzer::TokenType::Real:
         {
-            Q_ASSERT(m_lookAhead1.data.typeId() == QMetaType::Double);
-            const PDFReal value = m_lookAhead1.data.toDouble();
+            const PDFReal value = m_lookAhead1.getReal();
             shift();
             return PDFObject::createReal(value);
         }
 
         case PDFLexicalAnalyzer::TokenType::String:
         {
-            Q_ASSERT(m_lookAhead1.data.typeId() == QMetaType::QByteArray);
-            QByteArray array = m_lookAhead1.data.toByteArray();
-            array.shrink_to_fit();
+            QByteArray array = getTokenString(m_lookAhead1);
             shift();
             return PDFObject::createString(std::move(array));
         }
 
         case PDFLexicalAnalyzer::TokenType::Name:
         {
-            Q_ASSERT(m_lookAhead1.data.typeId() == QMetaType::QByteArray);
-            QByteArray array = m_lookAhead1.data.toByteArray();
-            array.shrink_to_fit();
+            QByteArray array = getTokenString(m_lookAhead1);
             shift();
             return PDFObject::createName(std::move(array));
         }
@@ -809,7 +849,7 @@ PDFObject PDFParser::getObject()
                     error(tr("Dictionary key must be a name."));
                 }
 
-                QByteArray key = m_lookAhead1.data.toByteArray();
+                QByteArray key = getTokenString(m_lookAhead1);
                 shift();
 
                 // Second value should be a value
@@ -826,7 +866,7 @@ PDFObject PDFParser::getObject()
 
             // Is it a content stream?
             if (m_lookAhead2.type == PDFLexicalAnalyzer::TokenType::Command &&
-                m_lookAhead2.data.toByteArray() == PDF_STREAM_START_COMMAND)
+                m_lookAhead2.getStringView() == PDF_STREAM_START_COMMAND)
             {
                 if (!m_features.testFlag(AllowStreams))
                 {
@@ -887,7 +927,7 @@ PDFObject PDFParser::getObject()
                 m_lookAhead2 = fetch();
 
                 if (m_lookAhead1.type == PDFLexicalAnalyzer::TokenType::Command &&
-                    m_lookAhead1.data.toByteArray() == PDF_STREAM_END_COMMAND)
+                    m_lookAhead1.getStringView() == PDF_STREAM_END_COMMAND)
                 {
                     // Everything OK, just advance and return stream object
                     shift();
@@ -956,7 +996,7 @@ void PDFParser::seek(PDFInteger offset)
 bool PDFParser::fetchCommand(const char* command)
 {
     if (m_lookAhead1.type == PDFLexicalAnalyzer::TokenType::Command &&
-        m_lookAhead1.data.toByteArray() == command)
+        m_lookAhead1.getStringView() == command)
     {
         shift();
         return true;
@@ -65,7 +65,6 @@ constexpr const char CHAR_MARK                  = '#';
 
 constexpr const int STRING_BUFFER_RESERVE = 32;
 constexpr const int NAME_BUFFER_RESERVE = 16;
-constexpr const int COMMAND_BUFFER_RESERVE = 16;
 
 // Special objects - bool, null object
 
@@ -104,11 +103,23 @@ public:
 
     Q_ENUM(TokenType)
 
+    /// Token of the content stream. Numbers are stored inline, names, commands
+    /// and literal strings without escape sequences are stored as views into the
+    /// source buffer, so no memory is allocated when token is created. Only strings,
+    /// which must be decoded (escape sequences, hexadecimal strings, names with '#'),
+    /// own their data. Token, which is a view, is valid only while the source
+    /// buffer of the lexical analyzer exists. Function \p getString always returns
+    /// a deep copy of the data, so it can be stored safely.
     struct Token
     {
-        explicit Token() : type(TokenType::EndOfFile) { }
+        explicit Token() = default;
         explicit Token(TokenType type) : type(type) { }
-        explicit Token(TokenType type, QVariant data) : type(type), data(qMove(data)) { }
+        explicit Token(TokenType type, bool value) : type(type) { m_integer = value ? 1 : 0; }
+        explicit Token(TokenType type, int value) : type(type) { m_integer = value; }
+        explicit Token(TokenType type, PDFInteger value) : type(type) { m_integer = value; }
+        explicit Token(TokenType type, PDFReal value) : type(type) { m_real = value; }
+        explicit Token(TokenType type, QByteArray value) : type(type), m_string(qMove(value)) { }
+        explicit Token(TokenType type, const char* value) = delete;
 
         Token(const Token&) = default;
         Token(Token&&) = default;
@@ -116,10 +127,144 @@ public:
         Token& operator=(const Token&) = default;
         Token& operator=(Token&&) = default;
 
-        bool operator==(const Token& other) const { return type == other.type && data == other.data; }
+        /// Creates token, whose data are a view into the source buffer (no memory allocation
+        /// is performed). Buffer must exist as long as the token is used.
+        /// \param type Token type (String, Name or Command)
+        /// \param data Pointer to the data in the source buffer
+        /// \param size Size of the data
+        static Token createView(TokenType type, const char* data, qsizetype size)
+        {
+            Token token(type);
+            token.m_string = QByteArray::fromRawData(data, size);
+            token.m_isView = true;
+            return token;
+        }
+
+        /// Returns true, if token carries a value (boolean, number, string, name or command)
+        bool hasData() const
+        {
+            switch (type)
+            {
+                case TokenType::Boolean:
+                case TokenType::Integer:
+                case TokenType::Real:
+                case TokenType::String:
+                case TokenType::Name:
+                case TokenType::Command:
+                    return true;
+
+                default:
+                    return false;
+            }
+        }
+
+        /// Returns true, if token is a view into the source buffer
+        bool isView() const { return m_isView; }
+
+        /// If token is a view into the source buffer, then deep copy of the data
+        /// is created, so token remains valid after source buffer is destroyed.
+        void detach()
+        {
+            if (m_isView)
+            {
+                m_string = getString();
+                m_isView = false;
+            }
+        }
+
+        /// Returns boolean value (for boolean token), false otherwise
+        bool getBool() const { return type == TokenType::Boolean && m_integer != 0; }
+
+        /// Returns integer value (for integer token), zero otherwise
+        PDFInteger getInteger() const { return type == TokenType::Integer ? m_integer : 0; }
+
+        /// Returns real value (integer tokens are converted to real), zero otherwise
+        PDFReal getReal() const
+        {
+            switch (type)
+            {
+                case TokenType::Integer:
+                    return m_integer;
+
+                case TokenType::Real:
+                    return m_real;
+
+                default:
+                    return 0.0;
+            }
+        }
+
+        /// Returns data of the string, name or command token. Returned byte array
+        /// is always a deep copy, so it remains valid after source buffer is destroyed.
+        QByteArray getString() const { return m_isView ? QByteArray(m_string.constData(), m_string.size()) : m_string; }
+
+        /// Returns view to the data of the string, name or command token. No memory
+        /// allocation is performed. View is valid as long as token and its source
+        /// buffer exist.
+        QByteArrayView getStringView() const { return QByteArrayView(m_string); }
+
+        /// Returns data of the token as variant (for diagnostic purposes)
+        QVariant getData() const
+        {
+            switch (type)
+            {
+                case TokenType::Boolean:
+                    return getBool();
+
+                case TokenType::Integer:
+                    return static_cast<qint64>(m_integer);
+
+                case TokenType::Real:
+                    return m_real;
 
-        TokenType type;
-        QVariant data;
+                case TokenType::String:
+                case TokenType::Name:
+                case TokenType::Command:
+                    return getString();
+
+                default:
+                    return QVariant();
+            }
+        }
+
+        bool operator==(const Token& other) const
+        {
+            if (type != other.type)
+            {
+                return false;
+            }
+
+            switch (type)
+            {
+                case TokenType::Boolean:
+                case TokenType::Integer:
+                    return m_integer == other.m_integer;
+
+                case TokenType::Real:
+                    return m_real == other.m_real;
+
+                case TokenType::String:
+                case TokenType::Name:
+                case TokenType::Command:
+                    return getStringView() == other.getStringView();
+
+                default:
+                    return true;
+            }
+        }
+
+        TokenType type = TokenType::EndOfFile;
+
+    private:
+        bool m_isView = false;
+
+        union
+        {
+            PDFInteger m_integer = 0;
+            PDFReal m_real;
+        };
+
+        QByteArray m_string;
     };
 
     /// Fetches a new token from the input stream. If we are at end of the input
@@ -330,6 +475,12 @@ private:
 
     PDFLexicalAnalyzer::Token fetch();
 
+    /// Returns string data of the token (string, name), which can be stored in the
+    /// PDF object. If the string fits into the inplace string, no memory is allocated.
+    /// Returned byte array must be used only to create the PDF object.
+    /// \param token Token
+    static QByteArray getTokenString(const PDFLexicalAnalyzer::Token& token);
+
     /// Functor for fetching tokens
     std::function<PDFLexicalAnalyzer::Token(void)> m_tokenFetcher;
 
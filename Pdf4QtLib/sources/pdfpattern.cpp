@@ -19,6 +19,7 @@
 #include "pdfdocument.h"
 #include "pdfexception.h"
 #include "pdfutils.h"
+#include "pdfpainterutils.h"
 #include "pdfcolorspaces.h"
 #include "pdfexecutionpolicy.h"
 #include "pdfconstants.h"
@@ -1401,11 +1402,47 @@ qint64 PDFMesh::getMemoryConsumptionEstimate() const
     qint64 memoryConsumption = sizeof(*this);
     memoryConsumption += sizeof(QPointF) * m_vertices.capacity();
     memoryConsumption += sizeof(Triangle) * m_triangles.capacity();
-    memoryConsumption += sizeof(QPainterPath::Element) * m_boundingPath.capacity();
-    memoryConsumption += sizeof(QPainterPath::Element) * m_backgroundPath.capacity();
+    memoryConsumption += PDFPainterHelper::getPainterPathMemoryConsumptionEstimate(m_boundingPath);
+    memoryConsumption += PDFPainterHelper::getPainterPathMemoryConsumptionEstimate(m_backgroundPath);
     return memoryConsumption;
 }
 
+QRectF PDFMesh::getBoundingRect() const
+{
+    QRectF boundingRect;
+
+    if (!m_triangles.empty())
+    {
+        PDFReal minX = std::numeric_limits<PDFReal>::infinity();
+        PDFReal minY = std::numeric_limits<PDFReal>::infinity();
+        PDFReal maxX = -std::numeric_limits<PDFReal>::infinity();
+        PDFReal maxY = -std::numeric_limits<PDFReal>::infinity();
+
+        for (const QPointF& vertex : m_vertices)
+        {
+            minX = qMin(minX, vertex.x());
+            minY = qMin(minY, vertex.y());
+            maxX = qMax(maxX, vertex.x());
+            maxY = qMax(maxY, vertex.y());
+        }
+
+        // Triangles are also stroked by pen of unit width
+        boundingRect = QRectF(QPointF(minX, minY), QPointF(maxX, maxY)).adjusted(-1.0, -1.0, 1.0, 1.0);
+    }
+
+    if (!m_backgroundPath.isEmpty() && m_backgroundColor.isValid())
+    {
+        boundingRect = boundingRect.isEmpty() ? m_backgroundPath.controlPointRect() : boundingRect.united(m_backgroundPath.controlPointRect());
+    }
+
+    if (!m_boundingPath.isEmpty())
+    {
+        boundingRect = boundingRect.intersected(m_boundingPath.controlPointRect());
+    }
+
+    return boundingRect;
+}
+
 void PDFMesh::invertColors()
 {
     for (Triangle& triangle : m_triangles)
@@ -144,6 +144,9 @@ public:
     /// Returns estimate of number of bytes, which this mesh occupies in memory
     qint64 getMemoryConsumptionEstimate() const;
 
+    /// Returns bounding rectangle of the painted area of the mesh
+    QRectF getBoundingRect() const;
+
     /// Invert colors
     void invertColors();
 
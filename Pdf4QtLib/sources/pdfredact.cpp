@@ -172,7 +172,13 @@ PDFDocument PDFRedact::perform(Options options)
     }
 
     PDFDocument redactedDocument = builder.build();
-    PDFOptimizer optimizer(PDFOptimizer::All, nullptr);
+    // Only lossless optimizations are used, redaction must not change the remaining content
+    PDFOptimizer optimizer(PDFOptimizer::OptimizationFlags(PDFOptimizer::DereferenceSimpleObjects |
+                                                           PDFOptimizer::RemoveNullObjects |
+                                                           PDFOptimizer::RemoveUnusedObjects |
+                                                           PDFOptimizer::MergeIdenticalObjects |
+                                                           PDFOptimizer::ShrinkObjectStorage |
+                                                           PDFOptimizer::RecompressFlateStreams), nullptr);
     optimizer.setDocument(&redactedDocument);
     optimizer.optimize();
     return optimizer.takeOptimizedDocument();
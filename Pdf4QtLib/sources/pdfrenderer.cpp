@@ -24,6 +24,7 @@
 #include "pdfdbgheap.h"
 
 #include <QDir>
+#include <QThread>
 #include <QElapsedTimer>
 #include <QOpenGLContext>
 #include <QOffscreenSurface>
@@ -172,7 +173,9 @@ void PDFRenderer::compile(PDFPrecompiledPage* precompiledPage, size_t pageIndex)
 
     PDFPrecompiledPageGenerator generator(precompiledPage, m_features, page, m_document, m_fontCache, m_cms, m_optionalContentActivity, m_meshQualitySettings);
     generator.setOperationControl(m_operationControl);
+    generator.setImageResolution(m_imageResolution);
     QList<PDFRenderError> errors = generator.processContents();
+    precompiledPage->setColorConversionStatistics(generator.getColorConversionStatistics());
 
     if (m_features.testFlag(InvertColors))
     {
@@ -63,6 +63,7 @@ public:
         InvertColors            = 0x0100,   ///< Invert colors
         DenyExtraGraphics       = 0x0200,   ///< Do not display additional graphics, for example from tools
         DisplayAnnotations      = 0x0400,   ///< Display annotations
+        GlyphAtlas              = 0x0800,   ///< Draw small text using cached glyph bitmaps
     };
 
     Q_DECLARE_FLAGS(Features, Feature)
@@ -112,11 +113,21 @@ public:
                                                         PageRotation rotation);
 
     /// Returns default renderer features
-    static constexpr Features getDefaultFeatures() { return Features(Antialiasing | TextAntialiasing | ClipToCropBox | DisplayAnnotations); }
+    static constexpr Features getDefaultFeatures() { return Features(Antialiasing | TextAntialiasing | ClipToCropBox | DisplayAnnotations | GlyphAtlas); }
 
     const PDFOperationControl* getOperationControl() const;
     void setOperationControl(const PDFOperationControl* newOperationControl);
 
+    /// Returns resolution (in device pixels per page unit), for which images
+    /// of compiled pages are decoded. Zero means full resolution of images.
+    PDFReal getImageResolution() const { return m_imageResolution; }
+
+    /// Sets resolution (in device pixels per page unit), for which images of compiled
+    /// pages are decoded. Compiled page then can't be drawn with higher resolution
+    /// without loss of quality, see PDFPrecompiledPage::getImageResolutionLimit.
+    /// Zero means full resolution of images.
+    void setImageResolution(PDFReal imageResolution) { m_imageResolution = imageResolution; }
+
 private:
     const PDFDocument* m_document;
     const PDFFontCache* m_fontCache;
@@ -125,6 +136,7 @@ private:
     const PDFOperationControl* m_operationControl;
     Features m_features;
     PDFMeshQualitySettings m_meshQualitySettings;
+    PDFReal m_imageResolution = 0.0;
 };
 
 /// Renders PDF pages to bitmap images (QImage). It can use OpenGL for painting,
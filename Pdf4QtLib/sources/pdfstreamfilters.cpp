@@ -27,9 +27,434 @@
 
 #include <QtEndian>
 
+#include <array>
+#include <limits>
+#include <cstring>
+
 namespace pdf
 {
 
+/// Maximal size of the memory, which is allocated in advance for the decoded
+/// stream data using the decoded length (/DL) of the stream.
+static constexpr const PDFInteger PDF_DECODED_LENGTH_HINT_LIMIT = 64 * 1024 * 1024;
+
+/// Data source, which decompresses data compressed by the flate method. Data
+/// are inflated incrementally, as they are read from the upstream data source.
+class PDFFlateDataSource : public PDFStreamDataSource
+{
+public:
+    explicit PDFFlateDataSource(PDFStreamDataSourcePointer source);
+    virtual ~PDFFlateDataSource() override;
+
+    virtual PDFInteger read(char* buffer, PDFInteger maxSize) override;
+
+private:
+    PDFStreamDataSourcePointer m_source;
+    z_stream m_stream = { };
+    std::array<char, 16384> m_inputBuffer = { };
+    bool m_isInputFinished = false;
+    bool m_isFinished = false;
+};
+
+PDFFlateDataSource::PDFFlateDataSource(PDFStreamDataSourcePointer source) :
+    m_source(qMove(source))
+{
+    if (inflateInit(&m_stream) != Z_OK)
+    {
+        throw PDFException(PDFTranslationContext::tr("Failed to initialize flate decompression stream."));
+    }
+}
+
+PDFFlateDataSource::~PDFFlateDataSource()
+{
+    inflateEnd(&m_stream);
+}
+
+PDFInteger PDFFlateDataSource::read(char* buffer, PDFInteger maxSize)
+{
+    if (m_isFinished || maxSize <= 0)
+    {
+        return 0;
+    }
+
+    m_stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    m_stream.avail_out = static_cast<uInt>(qMin(maxSize, PDFInteger(std::numeric_limits<uInt>::max())));
+    const uInt availableOutput = m_stream.avail_out;
+
+    while (m_stream.avail_out > 0)
+    {
+        if (m_stream.avail_in == 0 && !m_isInputFinished)
+        {
+            const PDFInteger bytesRead = m_source->read(m_inputBuffer.data(), PDFInteger(m_inputBuffer.size()));
+            m_isInputFinished = bytesRead == 0;
+            m_stream.next_in = reinterpret_cast<Bytef*>(m_inputBuffer.data());
+            m_stream.avail_in = static_cast<uInt>(bytesRead);
+        }
+
+        const int error = inflate(&m_stream, Z_NO_FLUSH);
+        if (error == Z_STREAM_END)
+        {
+            m_isFinished = true;
+            break;
+        }
+
+        // Buffer error only means, that we must provide more input data
+        const bool isMoreInputNeeded = error == Z_BUF_ERROR && m_stream.avail_in == 0 && !m_isInputFinished;
+        if (error != Z_OK && !isMoreInputNeeded)
+        {
+            QString errorMessage;
+            if (m_stream.msg)
+            {
+                errorMessage = QString::fromLatin1(m_stream.msg);
+            }
+            else
+            {
+                errorMessage = PDFTranslationContext::tr("zlib code: %1").arg(error);
+            }
+
+            throw PDFException(PDFTranslationContext::tr("Error decompressing by flate method: %1").arg(errorMessage));
+        }
+    }
+
+    return availableOutput - m_stream.avail_out;
+}
+
+/// Data source, which decodes all data from the upstream data source at once
+/// using the stream filter. It is used for filters, which can't decode data
+/// incrementally. Data are decoded, when they are read for the first time.
+class PDFStreamFilterDataSource : public PDFStreamDataSource
+{
+public:
+    explicit PDFStreamFilterDataSource(PDFStreamDataSourcePointer source,
+                                       const PDFStreamFilter* filter,
+                                       PDFObjectFetcher objectFetcher,
+                                       PDFObject parameters,
+                                       const PDFSecurityHandler* securityHandler);
+
+    virtual PDFInteger read(char* buffer, PDFInteger maxSize) override;
+    virtual QByteArray readAll(PDFInteger sizeHint = 0) override;
+
+private:
+    void decode();
+
+    PDFStreamDataSourcePointer m_source;
+    PDFStreamDataSourcePointer m_decodedData;
+    const PDFStreamFilter* m_filter;
+    PDFObjectFetcher m_objectFetcher;
+    PDFObject m_parameters;
+    const PDFSecurityHandler* m_securityHandler;
+};
+
+PDFStreamFilterDataSource::PDFStreamFilterDataSource(PDFStreamDataSourcePointer source,
+                                                     const PDFStreamFilter* filter,
+                                                     PDFObjectFetcher objectFetcher,
+                                                     PDFObject parameters,
+                                                     const PDFSecurityHandler* securityHandler) :
+    m_source(qMove(source)),
+    m_filter(filter),
+    m_objectFetcher(qMove(objectFetcher)),
+    m_parameters(qMove(parameters)),
+    m_securityHandler(securityHandler)
+{
+
+}
+
+PDFInteger PDFStreamFilterDataSource::read(char* buffer, PDFInteger maxSize)
+{
+    decode();
+    return m_decodedData->read(buffer, maxSize);
+}
+
+QByteArray PDFStreamFilterDataSource::readAll(PDFInteger sizeHint)
+{
+    decode();
+    return m_decodedData->readAll(sizeHint);
+}
+
+void PDFStreamFilterDataSource::decode()
+{
+    if (!m_decodedData)
+    {
+        m_decodedData = std::make_unique<PDFByteArrayDataSource>(m_filter->apply(m_source->readAll(), m_objectFetcher, m_parameters, m_securityHandler));
+        m_source.reset();
+    }
+}
+
+/// Data source, which applies predictor to the data from the upstream
+/// data source. Data are decoded row by row.
+class PDFStreamPredictorDataSource : public PDFStreamDataSource
+{
+public:
+    explicit PDFStreamPredictorDataSource(PDFStreamDataSourcePointer source, const PDFStreamPredictor& predictor);
+
+    virtual PDFInteger read(char* buffer, PDFInteger maxSize) override;
+
+private:
+    /// Reads and decodes next row. Returns false, if end of data was reached.
+    bool decodeRow();
+
+    /// Decodes row using PNG predictor (row starts with predictor type byte)
+    void decodePNGRow();
+
+    /// Decodes row using TIFF predictor
+    /// \param rowSize Size of the encoded row
+    void decodeTIFFRow(PDFInteger rowSize);
+
+    PDFStreamDataSourcePointer m_source;
+    PDFStreamPredictor m_predictor;
+    int m_pixelBytes = 0;
+    std::vector<char> m_encodedRow;
+    std::vector<uint8_t> m_line;
+    std::vector<uint8_t> m_lineOld;
+    QByteArray m_tiffRow;
+    const char* m_decodedRow = nullptr;
+    PDFInteger m_decodedRowSize = 0;
+    PDFInteger m_decodedRowPosition = 0;
+};
+
+PDFStreamPredictorDataSource::PDFStreamPredictorDataSource(PDFStreamDataSourcePointer source, const PDFStreamPredictor& predictor) :
+    m_source(qMove(source)),
+    m_predictor(predictor)
+{
+    const bool isPNGPredictor = m_predictor.m_predictor != PDFStreamPredictor::TIFF;
+    m_pixelBytes = (m_predictor.m_components * m_predictor.m_bitsPerComponent + 7) / 8;
+    m_encodedRow.resize(isPNGPredictor ? m_predictor.m_stride + 1 : m_predictor.m_stride, 0);
+
+    if (isPNGPredictor)
+    {
+        // Idea: to avoid using if for many cases, we use larger buffer filled with zeros
+        const int totalBytes = m_predictor.m_stride + m_pixelBytes;
+        m_line.resize(totalBytes, 0);
+        m_lineOld.resize(totalBytes, 0);
+    }
+}
+
+PDFInteger PDFStreamPredictorDataSource::read(char* buffer, PDFInteger maxSize)
+{
+    PDFInteger bytesWritten = 0;
+    while (bytesWritten < maxSize)
+    {
+        if (m_decodedRowPosition == m_decodedRowSize && !decodeRow())
+        {
+            break;
+        }
+
+        const PDFInteger count = qMin(maxSize - bytesWritten, m_decodedRowSize - m_decodedRowPosition);
+        std::memcpy(buffer + bytesWritten, m_decodedRow + m_decodedRowPosition, count);
+        bytesWritten += count;
+        m_decodedRowPosition += count;
+    }
+
+    return bytesWritten;
+}
+
+bool PDFStreamPredictorDataSource::decodeRow()
+{
+    const PDFInteger bytesRead = m_source->readFully(m_encodedRow.data(), PDFInteger(m_encodedRow.size()));
+    if (bytesRead == 0)
+    {
+        return false;
+    }
+
+    if (m_predictor.m_predictor == PDFStreamPredictor::TIFF)
+    {
+        decodeTIFFRow(bytesRead);
+    }
+    else
+    {
+        // According to the PDF specification, incomplete line is completed. For this
+        // reason, we behave as we have zero data in the buffer.
+        std::fill(std::next(m_encodedRow.begin(), bytesRead), m_encodedRow.end(), 0);
+        decodePNGRow();
+    }
+
+    m_decodedRowPosition = 0;
+    return true;
+}
+
+void PDFStreamPredictorDataSource::decodePNGRow()
+{
+    const int stride = m_predictor.m_stride;
+    const int pixelBytes = m_pixelBytes;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(m_encodedRow.data());
+
+    // First, read the predictor data for current line
+    const PDFStreamPredictor::Predictor currentPredictor = static_cast<PDFStreamPredictor::Predictor>(data[0] + 10);
+    std::vector<uint8_t>& line = m_line;
+    const std::vector<uint8_t>& lineOld = m_lineOld;
+
+    for (int i = 0; i < stride; ++i)
+    {
+        const uint8_t currentByte = data[i + 1];
+
+        int lineIndex = i + pixelBytes;
+        switch (currentPredictor)
+        {
+            case PDFStreamPredictor::PNG_Sub:
+            {
+                line[lineIndex] = line[i] + currentByte;
+                break;
+            }
+
+            case PDFStreamPredictor::PNG_Up:
+            {
+                line[lineIndex] = lineOld[lineIndex] + currentByte;
+                break;
+            }
+
+            case PDFStreamPredictor::PNG_Average:
+            {
+                line[lineIndex] = (lineOld[lineIndex] + line[i]) / 2 + currentByte;
+                break;
+            }
+
+            case PDFStreamPredictor::PNG_Paeth:
+            {
+                // a = left,
+                // b = upper,
+                // c = upper left
+                const int a = line[i];
+                const int b = lineOld[lineIndex];
+                const int c = lineOld[i];
+                const int p = a + b - c;
+                const int pa = std::abs(p - a);
+                const int pb = std::abs(p - b);
+                const int pc = std::abs(p - c);
+                if (pa <= pb && pa <= pc)
+                {
+                    line[lineIndex] = a + currentByte;
+                }
+                else if (pb <= pc)
+                {
+                    line[lineIndex] = b + currentByte;
+                }
+                else
+                {
+                    line[lineIndex] = c + currentByte;
+                }
+                break;
+            }
+
+            case PDFStreamPredictor::PNG_None:
+            default:
+            {
+                line[lineIndex] = currentByte;
+                break;
+            }
+        }
+    }
+
+    // Swap the buffers, decoded row is now in the old line
+    std::swap(m_line, m_lineOld);
+    m_decodedRow = reinterpret_cast<const char*>(m_lineOld.data() + pixelBytes);
+    m_decodedRowSize = stride;
+}
+
+void PDFStreamPredictorDataSource::decodeTIFFRow(PDFInteger rowSize)
+{
+    const int bitsPerComponent = m_predictor.m_bitsPerComponent;
+    const QByteArray data = QByteArray::fromRawData(m_encodedRow.data(), rowSize);
+
+    PDFBitWriter writer(bitsPerComponent);
+    PDFBitReader reader(&data, bitsPerComponent);
+
+    writer.reserve(data.size());
+    std::vector<uint32_t> leftValues(m_predictor.m_components, 0);
+
+    for (int i = 0; i < m_predictor.m_columns; ++i)
+    {
+        for (int componentIndex = 0; componentIndex < m_predictor.m_components; ++componentIndex)
+        {
+            leftValues[componentIndex] = (leftValues[componentIndex] + reader.read()) & reader.max();
+            writer.write(leftValues[componentIndex]);
+        }
+    }
+    writer.finishLine();
+
+    m_tiffRow = writer.takeByteArray();
+    m_decodedRow = m_tiffRow.constData();
+    m_decodedRowSize = m_tiffRow.size();
+}
+
+QByteArray PDFStreamDataSource::readAll(PDFInteger sizeHint)
+{
+    QByteArray result;
+    if (sizeHint > 0)
+    {
+        result.reserve(sizeHint);
+    }
+
+    while (true)
+    {
+        const PDFInteger size = result.size();
+        const PDFInteger freeCapacity = result.capacity() - size;
+
+        PDFInteger bytesRead = 0;
+        if (freeCapacity > 0)
+        {
+            // Read directly into the allocated memory of the result
+            result.resize(size + freeCapacity);
+            bytesRead = read(result.data() + size, freeCapacity);
+            result.resize(size + bytesRead);
+        }
+        else
+        {
+            std::array<char, 16384> buffer;
+            bytesRead = read(buffer.data(), PDFInteger(buffer.size()));
+            result.append(buffer.data(), bytesRead);
+        }
+
+        if (bytesRead == 0)
+        {
+            break;
+        }
+    }
+
+    return result;
+}
+
+PDFInteger PDFStreamDataSource::readFully(char* buffer, PDFInteger size)
+{
+    PDFInteger bytesRead = 0;
+    while (bytesRead < size)
+    {
+        const PDFInteger currentBytesRead = read(buffer + bytesRead, size - bytesRead);
+        if (currentBytesRead == 0)
+        {
+            break;
+        }
+        bytesRead += currentBytesRead;
+    }
+    return bytesRead;
+}
+
+PDFInteger PDFByteArrayDataSource::read(char* buffer, PDFInteger maxSize)
+{
+    const PDFInteger count = qBound(PDFInteger(0), maxSize, PDFInteger(m_data.size()) - m_position);
+    std::memcpy(buffer, m_data.constData() + m_position, count);
+    m_position += count;
+    return count;
+}
+
+QByteArray PDFByteArrayDataSource::readAll(PDFInteger sizeHint)
+{
+    Q_UNUSED(sizeHint);
+
+    QByteArray result;
+    if (m_position == 0)
+    {
+        // Data are shared, no copy is performed
+        result = m_data;
+    }
+    else
+    {
+        result = m_data.mid(m_position);
+    }
+
+    m_position = m_data.size();
+    return result;
+}
+
 QByteArray PDFAsciiHexDecodeFilter::apply(const QByteArray& data,
                                           const PDFObjectFetcher& objectFetcher,
                                           const PDFObject& parameters,
@@ -379,8 +804,18 @@ QByteArray PDFFlateDecodeFilter::apply(const QByteArray& data,
 {
     Q_UNUSED(securityHandler);
 
+    return createDataSource(std::make_unique<PDFByteArrayDataSource>(data), objectFetcher, parameters, securityHandler)->readAll();
+}
+
+PDFStreamDataSourcePointer PDFFlateDecodeFilter::createDataSource(PDFStreamDataSourcePointer source,
+                                                                  const PDFObjectFetcher& objectFetcher,
+                                                                  const PDFObject& parameters,
+                                                                  const PDFSecurityHandler* securityHandler) const
+{
+    Q_UNUSED(securityHandler);
+
     PDFStreamPredictor predictor = PDFStreamPredictor::createPredictor(objectFetcher, parameters);
-    return predictor.apply(uncompress(data));
+    return predictor.createDataSource(std::make_unique<PDFFlateDataSource>(qMove(source)));
 }
 
 QByteArray PDFFlateDecodeFilter::compress(const QByteArray& decompressedData)
@@ -483,56 +918,8 @@ PDFInteger PDFFlateDecodeFilter::getStreamDataLength(const QByteArray& data, PDF
 
 QByteArray PDFFlateDecodeFilter::uncompress(const QByteArray& data)
 {
-    QByteArray result;
-
-    z_stream stream = { };
-    stream.next_in = const_cast<Bytef*>(convertByteArrayToUcharPtr(data));
-    stream.avail_in = data.size();
-
-    std::array<Bytef, 1024> outputBuffer = { };
-
-    int error = inflateInit(&stream);
-    if (error != Z_OK)
-    {
-        throw PDFException(PDFTranslationContext::tr("Failed to initialize flate decompression stream."));
-    }
-
-    do
-    {
-        stream.next_out = outputBuffer.data();
-        stream.avail_out = static_cast<uInt>(outputBuffer.size());
-
-        error = inflate(&stream, Z_NO_FLUSH);
-
-        int bytesWritten = int(outputBuffer.size()) - stream.avail_out;
-        result.append(reinterpret_cast<const char*>(outputBuffer.data()), bytesWritten);
-    } while (error == Z_OK);
-
-    QString errorMessage;
-    if (stream.msg)
-    {
-        errorMessage = QString::fromLatin1(stream.msg);
-    }
-
-    inflateEnd(&stream);
-
-    switch (error)
-    {
-        case Z_STREAM_END:
-            break; // No error, normal behaviour
-
-        default:
-        {
-            if (errorMessage.isEmpty())
-            {
-                errorMessage = PDFTranslationContext::tr("zlib code: %1").arg(error);
-            }
-
-            throw PDFException(PDFTranslationContext::tr("Error decompressing by flate method: %1").arg(errorMessage));
-        }
-    }
-
-    return result;
+    PDFFlateDataSource source(std::make_unique<PDFByteArrayDataSource>(data));
+    return source.readAll();
 }
 
 QByteArray PDFRunLengthDecodeFilter::apply(const QByteArray& data,
@@ -671,16 +1058,41 @@ PDFStreamFilterStorage::StreamFilters PDFStreamFilterStorage::getStreamFilters(c
 }
 
 QByteArray PDFStreamFilterStorage::getDecodedStream(const PDFStream* stream, const PDFObjectFetcher& objectFetcher, const PDFSecurityHandler* securityHandler)
+{
+    PDFStreamDataSourcePointer source = createDecodedStreamDataSource(stream, objectFetcher, securityHandler);
+
+    if (!source)
+    {
+        // Stream filters are invalid
+        return QByteArray();
+    }
+
+    // Decoded length is only a hint from the file, it is used to allocate the memory
+    // for the decoded data at once. Hint is limited by the usual compression ratio and
+    // by the absolute limit, so invalid value can't cause allocation of a huge amount
+    // of memory. If decoded data are larger, memory is allocated as data are read.
+    PDFInteger sizeHint = 0;
+    const PDFObject decodedLengthObject = objectFetcher(stream->getDictionary()->get(PDF_STREAM_DICT_DECODED_LENGTH));
+    if (decodedLengthObject.isInt())
+    {
+        const PDFInteger maximalSizeHint = qMin(4 * PDFInteger(stream->getContent()->size()), PDF_DECODED_LENGTH_HINT_LIMIT);
+        sizeHint = qBound(PDFInteger(0), decodedLengthObject.getInteger(), maximalSizeHint);
+    }
+
+    return source->readAll(sizeHint);
+}
+
+PDFStreamDataSourcePointer PDFStreamFilterStorage::createDecodedStreamDataSource(const PDFStream* stream, const PDFObjectFetcher& objectFetcher, const PDFSecurityHandler* securityHandler)
 {
     StreamFilters streamFilters = getStreamFilters(stream, objectFetcher);
-    QByteArray result = *stream->getContent();
 
     if (!streamFilters.valid)
     {
         // Stream filters are invalid
-        return QByteArray();
+        return nullptr;
     }
 
+    PDFStreamDataSourcePointer source = std::make_unique<PDFByteArrayDataSource>(*stream->getContent());
     for (size_t i = 0, count = streamFilters.filterObjects.size(); i < count; ++i)
     {
         const PDFStreamFilter* streamFilter = streamFilters.filterObjects[i];
@@ -688,11 +1100,11 @@ QByteArray PDFStreamFilterStorage::getDecodedStream(const PDFStream* stream, con
 
         if (streamFilter)
         {
-            result = streamFilter->apply(result, objectFetcher, streamFilterParameters, securityHandler);
+            source = streamFilter->createDataSource(qMove(source), objectFetcher, streamFilterParameters, securityHandler);
         }
     }
 
-    return result;
+    return source;
 }
 
 QByteArray PDFStreamFilterStorage::getDecodedStream(const PDFStream* stream, const PDFSecurityHandler* securityHandler)
@@ -776,20 +1188,30 @@ PDFStreamPredictor PDFStreamPredictor::createPredictor(const PDFObjectFetcher& o
 }
 
 QByteArray PDFStreamPredictor::apply(const QByteArray& data) const
+{
+    if (m_predictor == NoPredictor)
+    {
+        return data;
+    }
+
+    return createDataSource(std::make_unique<PDFByteArrayDataSource>(data))->readAll(data.size());
+}
+
+PDFStreamDataSourcePointer PDFStreamPredictor::createDataSource(PDFStreamDataSourcePointer source) const
 {
     switch (m_predictor)
     {
         case NoPredictor:
-            return data;
+            return source;
 
         case TIFF:
-            return applyTIFFPredictor(data);
+            return std::make_unique<PDFStreamPredictorDataSource>(qMove(source), *this);
 
         default:
         {
             if (m_predictor >= 10)
             {
-                return applyPNGPredictor(data);
+                return std::make_unique<PDFStreamPredictorDataSource>(qMove(source), *this);
             }
             break;
         }
@@ -798,139 +1220,6 @@ QByteArray PDFStreamPredictor::apply(const QByteArray& data) const
     throw PDFException(PDFTranslationContext::tr("Invalid predictor algorithm."));
 }
 
-QByteArray PDFStreamPredictor::applyPNGPredictor(const QByteArray& data) const
-{
-    QByteArray outputData;
-    outputData.reserve(data.size());
-
-    auto it = data.cbegin();
-    auto itEnd = data.cend();
-
-    int pixelBytes = (m_components * m_bitsPerComponent + 7) / 8;
-
-    auto readByte = [&it, &itEnd]() -> uint8_t
-    {
-        if (it != itEnd)
-        {
-            return static_cast<uint8_t>(*it++);
-        }
-
-        // According to the PDF specification, incomplete line is completed. For this
-        // reason, we behave as we have zero data in the buffer.
-        return 0;
-    };
-
-    // Idea: to avoid using if for many cases, we use larger buffer filled with zeros
-    const int totalBytes = m_stride + pixelBytes;
-    std::vector<uint8_t> line(totalBytes, 0);
-    std::vector<uint8_t> lineOld(totalBytes, 0);
-
-    Predictor currentPredictor = m_predictor;
-    while (it != itEnd)
-    {
-        // First, read the predictor data for current line
-        currentPredictor = static_cast<Predictor>(readByte() + 10);
-
-        for (int i = 0; i < m_stride; ++i)
-        {
-            uint8_t currentByte = readByte();
-
-            int lineIndex = i + pixelBytes;
-            switch (currentPredictor)
-            {
-                case PNG_Sub:
-                {
-                    line[lineIndex] = line[i] + currentByte;
-                    break;
-                }
-
-                case PNG_Up:
-                {
-                    line[lineIndex] = lineOld[lineIndex] + currentByte;
-                    break;
-                }
-
-                case PNG_Average:
-                {
-                    line[lineIndex] = (lineOld[lineIndex] + line[i]) / 2 + currentByte;
-                    break;
-                }
-
-                case PNG_Paeth:
-                {
-                    // a = left,
-                    // b = upper,
-                    // c = upper left
-                    const int a = line[i];
-                    const int b = lineOld[lineIndex];
-                    const int c = lineOld[i];
-                    const int p = a + b - c;
-                    const int pa = std::abs(p - a);
-                    const int pb = std::abs(p - b);
-                    const int pc = std::abs(p - c);
-                    if (pa <= pb && pa <= pc)
-                    {
-                        line[lineIndex] = a + currentByte;
-                    }
-                    else if (pb <= pc)
-                    {
-                        line[lineIndex] = b + currentByte;
-                    }
-                    else
-                    {
-                        line[lineIndex] = c + currentByte;
-                    }
-                    break;
-                }
-
-                case PNG_None:
-                default:
-                {
-                    line[lineIndex] = currentByte;
-                    break;
-                }
-            }
-
-            // Fill the output buffer
-            outputData.push_back(static_cast<const char>(line[lineIndex]));
-        }
-
-        // Swap the buffers
-        std::swap(line, lineOld);
-    }
-
-    return outputData;
-}
-
-QByteArray PDFStreamPredictor::applyTIFFPredictor(const QByteArray& data) const
-{
-    Q_UNUSED(data);
-
-    PDFBitWriter writer(m_bitsPerComponent);
-    PDFBitReader reader(&data, m_bitsPerComponent);
-
-    writer.reserve(data.size());
-    std::vector<uint32_t> leftValues(m_components, 0);
-
-    while (!reader.isAtEnd())
-    {
-        for (int i = 0; i < m_columns; ++i)
-        {
-            for (int componentIndex = 0; componentIndex < m_components; ++componentIndex)
-            {
-                leftValues[componentIndex] = (leftValues[componentIndex] + reader.read()) & reader.max();
-                writer.write(leftValues[componentIndex]);
-            }
-        }
-
-        std::fill(leftValues.begin(), leftValues.end(), 0);
-        reader.alignToBytes();
-        writer.finishLine();
-    }
-
-    return writer.takeByteArray();
-}
-
 QByteArray PDFCryptFilter::apply(const QByteArray& data,
                                  const PDFObjectFetcher& objectFetcher,
                                  const PDFObject& parameters,
@@ -963,6 +1252,14 @@ QByteArray PDFCryptFilter::apply(const QByteArray& data,
     return securityHandler->decryptByFilter(data, cryptFilterName, objectReference);
 }
 
+PDFStreamDataSourcePointer PDFStreamFilter::createDataSource(PDFStreamDataSourcePointer source,
+                                                             const PDFObjectFetcher& objectFetcher,
+                                                             const PDFObject& parameters,
+                                                             const PDFSecurityHandler* securityHandler) const
+{
+    return std::make_unique<PDFStreamFilterDataSource>(qMove(source), this, objectFetcher, parameters, securityHandler);
+}
+
 PDFInteger PDFStreamFilter::getStreamDataLength(const QByteArray& data, PDFInteger offset) const
 {
     Q_UNUSED(data);
@@ -30,7 +30,53 @@ namespace pdf
 class PDFStreamFilter;
 class PDFSecurityHandler;
 
-using PDFObjectFetcher = std::function<const PDFObject&(const PDFObject&)>;
+using PDFObjectFetcher = std::function<PDFObject(const PDFObject&)>;
+
+/// Source of the decoded stream data. Data sources can be chained - each filter
+/// pulls chunks of data from its upstream data source, so stream is decoded
+/// incrementally, and intermediate results of the filters are not stored
+/// in the memory as a whole.
+class PDF4QTLIBSHARED_EXPORT PDFStreamDataSource
+{
+public:
+    explicit PDFStreamDataSource() = default;
+    virtual ~PDFStreamDataSource() = default;
+
+    /// Reads at most \p maxSize bytes of decoded data into the buffer. Returns
+    /// number of bytes read, zero is returned, if end of data was reached.
+    /// If error occurs, exception is thrown.
+    /// \param buffer Output buffer
+    /// \param maxSize Size of the output buffer
+    virtual PDFInteger read(char* buffer, PDFInteger maxSize) = 0;
+
+    /// Reads all remaining data of the data source. If error occurs,
+    /// exception is thrown.
+    /// \param sizeHint Expected size of the data (zero, if unknown)
+    virtual QByteArray readAll(PDFInteger sizeHint = 0);
+
+    /// Reads data into the buffer until the buffer is full, or end of data
+    /// is reached. Returns number of bytes read.
+    /// \param buffer Output buffer
+    /// \param size Size of the output buffer
+    PDFInteger readFully(char* buffer, PDFInteger size);
+};
+
+/// Data source reading data from the byte array (without decoding)
+class PDF4QTLIBSHARED_EXPORT PDFByteArrayDataSource : public PDFStreamDataSource
+{
+public:
+    explicit PDFByteArrayDataSource(QByteArray data) : m_data(qMove(data)) { }
+    virtual ~PDFByteArrayDataSource() override = default;
+
+    virtual PDFInteger read(char* buffer, PDFInteger maxSize) override;
+    virtual QByteArray readAll(PDFInteger sizeHint = 0) override;
+
+private:
+    QByteArray m_data;
+    PDFInteger m_position = 0;
+};
+
+using PDFStreamDataSourcePointer = std::unique_ptr<PDFStreamDataSource>;
 
 /// Storage for stream filters. Can retrieve stream filters by name. Using singleton
 /// design pattern. Use static methods to retrieve filters.
@@ -54,6 +100,14 @@ public:
     /// \param securityHandler Security handler for Crypt filters
     static QByteArray getDecodedStream(const PDFStream* stream, const PDFSecurityHandler* securityHandler);
 
+    /// Creates data source, from which decoded data of the stream can be read
+    /// incrementally. If stream filters are invalid, nullptr is returned. Object fetcher
+    /// is stored in the data source, so objects must exist, until data source is destroyed.
+    /// \param stream Stream containing the data
+    /// \param objectFetcher Function which retrieves objects (for example, reads objects from reference)
+    /// \param securityHandler Security handler for Crypt filters
+    static PDFStreamDataSourcePointer createDecodedStreamDataSource(const PDFStream* stream, const PDFObjectFetcher& objectFetcher, const PDFSecurityHandler* securityHandler);
+
     /// Tries to find stream data length using given filter. Stream will
     /// start at given \p offset in \p data. If stream length cannot be determined,
     /// then -1 is returned.
@@ -99,7 +153,14 @@ public:
     /// \param data Data to be decoded using predictor
     QByteArray apply(const QByteArray& data) const;
 
+    /// Creates data source, which applies the predictor to the data read from
+    /// \p source. Data are decoded row by row. If predictor is not used,
+    /// then \p source is returned.
+    /// \param source Upstream data source
+    PDFStreamDataSourcePointer createDataSource(PDFStreamDataSourcePointer source) const;
+
 private:
+    friend class PDFStreamPredictorDataSource;
 
     enum Predictor
     {
@@ -124,12 +185,6 @@ private:
         m_stride = (m_columns * m_components * m_bitsPerComponent + 7) / 8;
     }
 
-    /// Applies PNG predictor
-    QByteArray applyPNGPredictor(const QByteArray& data) const;
-
-    /// Applies TIFF predictor
-    QByteArray applyTIFFPredictor(const QByteArray& data) const;
-
     Predictor m_predictor = NoPredictor;
     int m_components = 0;
     int m_bitsPerComponent = 0;
@@ -157,6 +212,18 @@ public:
         return apply(data, [](const PDFObject& object) -> const PDFObject& { return object; }, parameters, securityHandler);
     }
 
+    /// Creates data source, which decodes data read from the \p source. Default implementation
+    /// reads all data from the source and decodes them using \p apply function, filters
+    /// capable of incremental decoding reimplement this function.
+    /// \param source Upstream data source
+    /// \param objectFetcher Function which retrieves objects (for example, reads objects from reference)
+    /// \param parameters Stream parameters
+    /// \param securityHandler Security handler for Crypt filters
+    virtual PDFStreamDataSourcePointer createDataSource(PDFStreamDataSourcePointer source,
+                                                        const PDFObjectFetcher& objectFetcher,
+                                                        const PDFObject& parameters,
+                                                        const PDFSecurityHandler* securityHandler) const;
+
     /// Tries to find stream data length. Stream will start at given \p offset in \p data.
     /// If stream length cannot be determined, then -1 is returned.
     /// \param data Buffer data
@@ -211,6 +278,11 @@ public:
                              const PDFObject& parameters,
                              const PDFSecurityHandler* securityHandler) const override;
 
+    virtual PDFStreamDataSourcePointer createDataSource(PDFStreamDataSourcePointer source,
+                                                        const PDFObjectFetcher& objectFetcher,
+                                                        const PDFObject& parameters,
+                                                        const PDFSecurityHandler* securityHandler) const override;
+
     virtual PDFInteger getStreamDataLength(const QByteArray& data, PDFInteger offset) const override;
 
     /// Recompresses data. So, first, data are decompressed, and then
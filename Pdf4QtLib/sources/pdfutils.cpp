@@ -209,6 +209,17 @@ void PDFBitWriter::write(Value value)
     flush(false);
 }
 
+void PDFBitWriter::write(Value value, Value bits)
+{
+    Q_ASSERT(bits <= 32);
+
+    const Value mask = (static_cast<Value>(1) << bits) - static_cast<Value>(1);
+    m_buffer = (m_buffer << bits) | (value & mask);
+    m_bitsInBuffer += bits;
+
+    flush(false);
+}
+
 void PDFBitWriter::flush(bool alignToByteBoundary)
 {
     if (m_bitsInBuffer >= 8)
@@ -200,6 +200,11 @@ public:
     /// Writes value to the output stream
     void write(Value value);
 
+    /// Writes value with given number of bits to the output stream
+    /// \param value Value
+    /// \param bits Number of bits (at most 32)
+    void write(Value value, Value bits);
+
     /// Finish line - align to byte boundary
     void finishLine() { flush(true); }
 
@@ -20,13 +20,15 @@
 #include "pdfexception.h"
 #include "pdfparser.h"
 #include "pdfstreamfilters.h"
+#include "pdfbyterangesource.h"
 #include "pdfdbgheap.h"
 
-#include <stack>
-
 namespace pdf
 {
 
+/// Initial size of the window, in which reference table section is read from byte range source
+static constexpr const PDFInteger PDF_XREF_WINDOW_SIZE = 64 * 1024;
+
 void PDFXRefTable::readXRefTable(PDFParsingContext* context, const QByteArray& byteArray, PDFInteger startTableOffset)
 {
     PDFParser parser(byteArray, context, PDFParser::AllowStreams);
@@ -55,297 +57,359 @@ void PDFXRefTable::readXRefTable(PDFParsingContext* context, const QByteArray& b
 
         // Now, we are ready to scan the table. Seek to the start of the reference table.
         parser.seek(currentOffset);
+        readXRefSection(&parser, &workSet);
+    }
+}
 
-        if (parser.fetchCommand(PDF_XREF_HEADER))
-        {
-            while (!parser.fetchCommand(PDF_XREF_TRAILER))
-            {
-                // Now, first number is start offset, second number is count of table items
-                PDFObject firstObject = parser.getObject();
-                PDFObject countObject = parser.getObject();
+void PDFXRefTable::readXRefTable(PDFParsingContext* context, const PDFByteRangeSource* source, PDFInteger startTableOffset, bool readPreviousSections)
+{
+    m_entries.clear();
 
-                if (!firstObject.isInt() || !countObject.isInt())
-                {
-                    throw PDFException(tr("Invalid format of reference table."));
-                }
+    std::set<PDFInteger> processedOffsets;
+    std::stack<PDFInteger> workSet;
+    workSet.push(startTableOffset);
+
+    while (!workSet.empty())
+    {
+        PDFInteger currentOffset = workSet.top();
+        workSet.pop();
+
+        // Check, if we have cyclical references between tables
+        if (processedOffsets.count(currentOffset))
+        {
+            // If cyclical reference occurs, do not report error, just ignore it.
+            continue;
+        }
+        else
+        {
+            processedOffsets.insert(currentOffset);
+        }
 
-                PDFInteger firstObjectNumber = firstObject.getInteger();
-                PDFInteger count = countObject.getInteger();
+        // We do not know the size of the reference table section, so we read
+        // a window of data, and if section can't be read, we try it again with
+        // larger window. Reading of the section can be repeated - entries, which
+        // were already read, are not overwritten, and they are the same.
+        PDFInteger windowSize = PDF_XREF_WINDOW_SIZE;
+        while (true)
+        {
+            QByteArray window = source->read(currentOffset, windowSize);
+            const bool isWholeRemainder = currentOffset + window.size() >= source->getSize();
 
-                const PDFInteger lastObjectIndex = firstObjectNumber + count - 1;
-                const PDFInteger desiredSize = lastObjectIndex + 1;
+            try
+            {
+                PDFParser parser(window, context, PDFParser::AllowStreams);
+                readXRefSection(&parser, &workSet);
 
-                if (static_cast<PDFInteger>(m_entries.size()) < desiredSize)
+                if (!readPreviousSections)
                 {
-                    m_entries.resize(desiredSize);
+                    return;
                 }
-
-                // Now, read the records
-                for (PDFInteger i = 0; i < count; ++i)
+                break;
+            }
+            catch (const PDFException&)
+            {
+                if (isWholeRemainder)
                 {
-                    const PDFInteger objectNumber = firstObjectNumber + i;
-
-                    PDFObject offset = parser.getObject();
-                    PDFObject generation = parser.getObject();
+                    throw;
+                }
 
-                    bool occupied = parser.fetchCommand(PDF_XREF_OCCUPIED);
-                    if (!occupied && !parser.fetchCommand(PDF_XREF_FREE))
-                    {
-                        throw PDFException(tr("Bad format of reference table entry."));
-                    }
+                windowSize = qMin(windowSize * 4, source->getSize() - currentOffset);
+            }
+        }
+    }
+}
 
-                    if (!offset.isInt() || !generation.isInt())
-                    {
-                        throw PDFException(tr("Bad format of reference table entry."));
-                    }
+void PDFXRefTable::readXRefSection(PDFParser* parser, std::stack<PDFInteger>* workSet)
+{
+    if (parser->fetchCommand(PDF_XREF_HEADER))
+    {
+        while (!parser->fetchCommand(PDF_XREF_TRAILER))
+        {
+            // Now, first number is start offset, second number is count of table items
+            PDFObject firstObject = parser->getObject();
+            PDFObject countObject = parser->getObject();
 
-                    if (static_cast<size_t>(objectNumber) >= m_entries.size())
-                    {
-                        throw PDFException(tr("Bad format of reference table entry."));
-                    }
+            if (!firstObject.isInt() || !countObject.isInt())
+            {
+                throw PDFException(tr("Invalid format of reference table."));
+            }
 
-                    Entry entry;
-                    if (occupied)
-                    {
-                        entry.reference = PDFObjectReference(objectNumber, generation.getInteger());
-                        entry.offset = offset.getInteger();
-                        entry.type = EntryType::Occupied;
-                    }
+            PDFInteger firstObjectNumber = firstObject.getInteger();
+            PDFInteger count = countObject.getInteger();
 
-                    if (m_entries[objectNumber].type == EntryType::Free)
-                    {
-                        m_entries[objectNumber] = std::move(entry);
-                    }
-                }
-            }
+            const PDFInteger lastObjectIndex = firstObjectNumber + count - 1;
+            const PDFInteger desiredSize = lastObjectIndex + 1;
 
-            PDFObject trailerDictionary = parser.getObject();
-            if (!trailerDictionary.isDictionary())
+            if (static_cast<PDFInteger>(m_entries.size()) < desiredSize)
             {
-                throw PDFException(tr("Trailer dictionary is invalid."));
+                m_entries.resize(desiredSize);
             }
 
-            // Now, we have scanned the table. If we didn't have a trailer dictionary yet, then
-            // try to load it. We must also check, that trailer dictionary is OK.
-            if (m_trailerDictionary.isNull())
+            // Now, read the records
+            for (PDFInteger i = 0; i < count; ++i)
             {
-                m_trailerDictionary = trailerDictionary;
-            }
+                const PDFInteger objectNumber = firstObjectNumber + i;
 
-            const PDFDictionary* dictionary = trailerDictionary.getDictionary();
-            if (dictionary->hasKey(PDF_XREF_TRAILER_PREVIOUS))
-            {
-                PDFObject previousOffset = dictionary->get(PDF_XREF_TRAILER_PREVIOUS);
+                PDFObject offset = parser->getObject();
+                PDFObject generation = parser->getObject();
 
-                if (!previousOffset.isInt())
+                bool occupied = parser->fetchCommand(PDF_XREF_OCCUPIED);
+                if (!occupied && !parser->fetchCommand(PDF_XREF_FREE))
                 {
-                    throw PDFException(tr("Offset of previous reference table is invalid."));
+                    throw PDFException(tr("Bad format of reference table entry."));
                 }
 
-                workSet.push(previousOffset.getInteger());
-            }
+                if (!offset.isInt() || !generation.isInt())
+                {
+                    throw PDFException(tr("Bad format of reference table entry."));
+                }
 
-            const PDFObject& xrefstmObject = dictionary->get(PDF_XREF_TRAILER_XREFSTM);
-            if (xrefstmObject.isInt())
-            {
-                workSet.push(xrefstmObject.getInteger());
+                if (static_cast<size_t>(objectNumber) >= m_entries.size())
+                {
+                    throw PDFException(tr("Bad format of reference table entry."));
+                }
+
+                Entry entry;
+                if (occupied)
+                {
+                    entry.reference = PDFObjectReference(objectNumber, generation.getInteger());
+                    entry.offset = offset.getInteger();
+                    entry.type = EntryType::Occupied;
+                }
+
+                if (m_entries[objectNumber].type == EntryType::Free)
+                {
+                    m_entries[objectNumber] = std::move(entry);
+                }
             }
         }
-        else
+
+        PDFObject trailerDictionary = parser->getObject();
+        if (!trailerDictionary.isDictionary())
         {
-            // Try to read cross-reference stream
-            PDFObject crossReferenceStreamObjectNumber = parser.getObject();
-            PDFObject crossReferenceStreamGeneration = parser.getObject();
+            throw PDFException(tr("Trailer dictionary is invalid."));
+        }
 
-            if (!crossReferenceStreamObjectNumber.isInt() || !crossReferenceStreamGeneration.isInt())
-            {
-                throw PDFException(tr("Invalid format of reference table."));
-            }
+        // Now, we have scanned the table. If we didn't have a trailer dictionary yet, then
+        // try to load it. We must also check, that trailer dictionary is OK.
+        if (m_trailerDictionary.isNull())
+        {
+            m_trailerDictionary = trailerDictionary;
+        }
+
+        const PDFDictionary* dictionary = trailerDictionary.getDictionary();
+        if (dictionary->hasKey(PDF_XREF_TRAILER_PREVIOUS))
+        {
+            PDFObject previousOffset = dictionary->get(PDF_XREF_TRAILER_PREVIOUS);
 
-            if (!parser.fetchCommand(PDF_OBJECT_START_MARK))
+            if (!previousOffset.isInt())
             {
-                throw PDFException(tr("Invalid format of reference table."));
+                throw PDFException(tr("Offset of previous reference table is invalid."));
             }
 
-            PDFObject crossReferenceObject = parser.getObject();
+            workSet->push(previousOffset.getInteger());
+        }
 
-            if (!parser.fetchCommand(PDF_OBJECT_END_MARK))
-            {
-                throw PDFException(tr("Invalid format of reference table."));
-            }
+        const PDFObject& xrefstmObject = dictionary->get(PDF_XREF_TRAILER_XREFSTM);
+        if (xrefstmObject.isInt())
+        {
+            workSet->push(xrefstmObject.getInteger());
+        }
+    }
+    else
+    {
+        // Try to read cross-reference stream
+        PDFObject crossReferenceStreamObjectNumber = parser->getObject();
+        PDFObject crossReferenceStreamGeneration = parser->getObject();
+
+        if (!crossReferenceStreamObjectNumber.isInt() || !crossReferenceStreamGeneration.isInt())
+        {
+            throw PDFException(tr("Invalid format of reference table."));
+        }
+
+        if (!parser->fetchCommand(PDF_OBJECT_START_MARK))
+        {
+            throw PDFException(tr("Invalid format of reference table."));
+        }
+
+        PDFObject crossReferenceObject = parser->getObject();
+
+        if (!parser->fetchCommand(PDF_OBJECT_END_MARK))
+        {
+            throw PDFException(tr("Invalid format of reference table."));
+        }
 
-            if (crossReferenceObject.isStream())
+        if (crossReferenceObject.isStream())
+        {
+            const PDFStream* crossReferenceStream = crossReferenceObject.getStream();
+            const PDFDictionary* crossReferenceStreamDictionary = crossReferenceStream->getDictionary();
+            const PDFObject typeObject = crossReferenceStreamDictionary->get("Type");
+            if (typeObject.isName() && typeObject.getString() == "XRef")
             {
-                const PDFStream* crossReferenceStream = crossReferenceObject.getStream();
-                const PDFDictionary* crossReferenceStreamDictionary = crossReferenceStream->getDictionary();
-                const PDFObject typeObject = crossReferenceStreamDictionary->get("Type");
-                if (typeObject.isName() && typeObject.getString() == "XRef")
+                PDFObject sizeObject = crossReferenceStreamDictionary->get("Size");
+                if (!sizeObject.isInt() || sizeObject.getInteger() < 0)
                 {
-                    PDFObject sizeObject = crossReferenceStreamDictionary->get("Size");
-                    if (!sizeObject.isInt() || sizeObject.getInteger() < 0)
-                    {
-                        throw PDFException(tr("Invalid format of cross-reference stream."));
-                    }
+                    throw PDFException(tr("Invalid format of cross-reference stream."));
+                }
 
-                    const PDFInteger desiredSize = sizeObject.getInteger();
-                    if (static_cast<PDFInteger>(m_entries.size()) < desiredSize)
-                    {
-                        m_entries.resize(desiredSize);
-                    }
+                const PDFInteger desiredSize = sizeObject.getInteger();
+                if (static_cast<PDFInteger>(m_entries.size()) < desiredSize)
+                {
+                    m_entries.resize(desiredSize);
+                }
 
-                    PDFObject prevObject = crossReferenceStreamDictionary->get("Prev");
-                    if (prevObject.isInt())
-                    {
-                        workSet.push(prevObject.getInteger());
-                    }
+                PDFObject prevObject = crossReferenceStreamDictionary->get("Prev");
+                if (prevObject.isInt())
+                {
+                    workSet->push(prevObject.getInteger());
+                }
 
-                    // Do not overwrite trailer dictionary, if it was already loaded.
-                    if (m_trailerDictionary.isNull())
-                    {
-                        m_trailerDictionary = crossReferenceObject;
-                    }
+                // Do not overwrite trailer dictionary, if it was already loaded.
+                if (m_trailerDictionary.isNull())
+                {
+                    m_trailerDictionary = crossReferenceObject;
+                }
 
-                    auto readIntegerArray = [crossReferenceStreamDictionary](const char* key, auto defaultValues) -> std::vector<PDFInteger>
+                auto readIntegerArray = [crossReferenceStreamDictionary](const char* key, auto defaultValues) -> std::vector<PDFInteger>
+                {
+                    std::vector<PDFInteger> result;
+
+                    const PDFObject& object = crossReferenceStreamDictionary->get(key);
+                    if (object.isArray())
                     {
-                        std::vector<PDFInteger> result;
+                        const PDFArray* array = object.getArray();
+                        result.reserve(array->getCount());
 
-                        const PDFObject& object = crossReferenceStreamDictionary->get(key);
-                        if (object.isArray())
+                        for (size_t i = 0, count = array->getCount(); i < count; ++i)
                         {
-                            const PDFArray* array = object.getArray();
-                            result.reserve(array->getCount());
-
-                            for (size_t i = 0, count = array->getCount(); i < count; ++i)
+                            const PDFObject& itemObject = array->getItem(i);
+                            if (itemObject.isInt())
                             {
-                                const PDFObject& itemObject = array->getItem(i);
-                                if (itemObject.isInt())
-                                {
-                                    result.push_back(itemObject.getInteger());
-                                }
-                                else
-                                {
-                                    throw PDFException(tr("Invalid format of cross-reference stream."));
-                                }
+                                result.push_back(itemObject.getInteger());
+                            }
+                            else
+                            {
+                                throw PDFException(tr("Invalid format of cross-reference stream."));
                             }
                         }
-                        else
-                        {
-                            result = defaultValues;
-                        }
+                    }
+                    else
+                    {
+                        result = defaultValues;
+                    }
 
-                        return result;
-                    };
+                    return result;
+                };
 
-                    std::vector<PDFInteger> indexArray = readIntegerArray("Index", std::initializer_list<PDFInteger>{ PDFInteger(0), PDFInteger(desiredSize) });
-                    std::vector<PDFInteger> wArray = readIntegerArray("W", std::vector<PDFInteger>());
+                std::vector<PDFInteger> indexArray = readIntegerArray("Index", std::initializer_list<PDFInteger>{ PDFInteger(0), PDFInteger(desiredSize) });
+                std::vector<PDFInteger> wArray = readIntegerArray("W", std::vector<PDFInteger>());
 
-                    if (wArray.size() != 3 || indexArray.empty() || (indexArray.size() % 2 != 0))
-                    {
-                        throw PDFException(tr("Invalid format of cross-reference stream."));
-                    }
+                if (wArray.size() != 3 || indexArray.empty() || (indexArray.size() % 2 != 0))
+                {
+                    throw PDFException(tr("Invalid format of cross-reference stream."));
+                }
 
-                    const int columnTypeBytes = wArray[0];
-                    const int columnObjectNumberOrByteOffsetBytes = wArray[1];
-                    const int columnGenerationNumberOrObjectIndexBytes = wArray[2];
-                    const size_t blockCount = indexArray.size() / 2;
+                const int columnTypeBytes = wArray[0];
+                const int columnObjectNumberOrByteOffsetBytes = wArray[1];
+                const int columnGenerationNumberOrObjectIndexBytes = wArray[2];
+                const size_t blockCount = indexArray.size() / 2;
 
-                    QByteArray data = PDFStreamFilterStorage::getDecodedStream(crossReferenceStream, nullptr);
-                    QDataStream dataStream(&data, QIODevice::ReadOnly);
-                    dataStream.setByteOrder(QDataStream::BigEndian);
+                QByteArray data = PDFStreamFilterStorage::getDecodedStream(crossReferenceStream, nullptr);
+                QDataStream dataStream(&data, QIODevice::ReadOnly);
+                dataStream.setByteOrder(QDataStream::BigEndian);
 
-                    auto readNumber = [&dataStream](int bytes, PDFInteger defaultValue) -> PDFInteger
+                auto readNumber = [&dataStream](int bytes, PDFInteger defaultValue) -> PDFInteger
+                {
+                    if (bytes)
                     {
-                        if (bytes)
+                        uint64_t value = 0;
+
+                        while (bytes--)
                         {
-                            uint64_t value = 0;
+                            uint8_t byte = 0;
+                            dataStream >> byte;
+                            value = (value << 8) + byte;
 
-                            while (bytes--)
+                            // Check, if stream is OK (we doesn't read past the end of the stream,
+                            // data aren't corrupted etc.)
+                            if (dataStream.status() != QDataStream::Ok)
                             {
-                                uint8_t byte = 0;
-                                dataStream >> byte;
-                                value = (value << 8) + byte;
-
-                                // Check, if stream is OK (we doesn't read past the end of the stream,
-                                // data aren't corrupted etc.)
-                                if (dataStream.status() != QDataStream::Ok)
-                                {
-                                    throw PDFException(tr("Invalid format of cross-reference stream - not enough data in the stream."));
-                                }
+                                throw PDFException(tr("Invalid format of cross-reference stream - not enough data in the stream."));
                             }
-
-                            return static_cast<PDFInteger>(value);
                         }
-                        return defaultValue;
-                    };
 
-                    for (size_t i = 0; i < blockCount; ++i)
-                    {
-                        PDFInteger firstObjectNumber = indexArray[2 * i];
-                        PDFInteger count = indexArray[2 * i + 1];
+                        return static_cast<PDFInteger>(value);
+                    }
+                    return defaultValue;
+                };
 
-                        const PDFInteger lastObjectIndex = firstObjectNumber + count - 1;
-                        const PDFInteger currentDesiredSize = lastObjectIndex + 1;
+                for (size_t i = 0; i < blockCount; ++i)
+                {
+                    PDFInteger firstObjectNumber = indexArray[2 * i];
+                    PDFInteger count = indexArray[2 * i + 1];
 
-                        if (static_cast<PDFInteger>(m_entries.size()) < currentDesiredSize)
-                        {
-                            m_entries.resize(currentDesiredSize);
-                        }
+                    const PDFInteger lastObjectIndex = firstObjectNumber + count - 1;
+                    const PDFInteger currentDesiredSize = lastObjectIndex + 1;
+
+                    if (static_cast<PDFInteger>(m_entries.size()) < currentDesiredSize)
+                    {
+                        m_entries.resize(currentDesiredSize);
+                    }
+
+                    for (PDFInteger objectNumber = firstObjectNumber; objectNumber <= lastObjectIndex; ++ objectNumber)
+                    {
+                        int itemType = readNumber(columnTypeBytes, 1);
+                        PDFInteger itemObjectNumberOfObjectStreamOrByteOffset = readNumber(columnObjectNumberOrByteOffsetBytes, 0);
+                        PDFInteger itemGenerationNumberOrObjectIndex = readNumber(columnGenerationNumberOrObjectIndexBytes, 0);
 
-                        for (PDFInteger objectNumber = firstObjectNumber; objectNumber <= lastObjectIndex; ++ objectNumber)
+                        switch (itemType)
                         {
-                            int itemType = readNumber(columnTypeBytes, 1);
-                            int itemObjectNumberOfObjectStreamOrByteOffset = readNumber(columnObjectNumberOrByteOffsetBytes, 0);
-                            int itemGenerationNumberOrObjectIndex = readNumber(columnGenerationNumberOrObjectIndexBytes, 0);
+                            case 0:
+                                // Free object
+                                break;
 
-                            switch (itemType)
+                            case 1:
                             {
-                                case 0:
-                                    // Free object
-                                    break;
+                                Entry entry;
+                                entry.reference = PDFObjectReference(objectNumber, itemGenerationNumberOrObjectIndex);
+                                entry.offset = itemObjectNumberOfObjectStreamOrByteOffset;
+                                entry.type = EntryType::Occupied;
 
-                                case 1:
+                                if (m_entries[objectNumber].type == EntryType::Free)
                                 {
-                                    Entry entry;
-                                    entry.reference = PDFObjectReference(objectNumber, itemGenerationNumberOrObjectIndex);
-                                    entry.offset = itemObjectNumberOfObjectStreamOrByteOffset;
-                                    entry.type = EntryType::Occupied;
-
-                                    if (m_entries[objectNumber].type == EntryType::Free)
-                                    {
-                                        m_entries[objectNumber] = std::move(entry);
-                                    }
-                                    break;
+                                    m_entries[objectNumber] = std::move(entry);
                                 }
+                                break;
+                            }
+
+                            case 2:
+                            {
+                                Entry entry;
+                                entry.reference = PDFObjectReference(objectNumber, 0);
+                                entry.objectStream = PDFObjectReference(itemObjectNumberOfObjectStreamOrByteOffset, 0);
+                                entry.indexInObjectStream = itemGenerationNumberOrObjectIndex;
+                                entry.type = EntryType::InObjectStream;
 
-                                case 2:
+                                if (m_entries[objectNumber].type == EntryType::Free)
                                 {
-                                    Entry entry;
-                                    entry.reference = PDFObjectReference(objectNumber, 0);
-                                    entry.objectStream = PDFObjectReference(itemObjectNumberOfObjectStreamOrByteOffset, 0);
-                                    entry.indexInObjectStream = itemGenerationNumberOrObjectIndex;
-                                    entry.type = EntryType::InObjectStream;
-
-                                    if (m_entries[objectNumber].type == EntryType::Free)
-                                    {
-                                        m_entries[objectNumber] = std::move(entry);
-                                    }
-
-                                    break;
+                                    m_entries[objectNumber] = std::move(entry);
                                 }
 
-                                default:
-                                    // According to the specification, treat this object as null object
-                                    break;
+                                break;
                             }
+
+                            default:
+                                // According to the specification, treat this object as null object
+                                break;
                         }
                     }
                 }
-
-                continue;
             }
 
-            throw PDFException(tr("Invalid format of reference table."));
+            return;
         }
+
+        throw PDFException(tr("Invalid format of reference table."));
     }
 }
 
@@ -23,11 +23,14 @@
 
 #include <QtCore>
 
+#include <stack>
 #include <vector>
 
 namespace pdf
 {
+class PDFParser;
 class PDFParsingContext;
+class PDFByteRangeSource;
 
 /// Represents table of references in the PDF file. It contains
 /// scanned table in the PDF file, together with information, if entry
@@ -70,6 +73,15 @@ public:
     /// \param startTableOffset Offset of first reference table
     void readXRefTable(PDFParsingContext* context, const QByteArray& byteArray, PDFInteger startTableOffset);
 
+    /// Tries to read reference table from the byte range source. Only sections of the
+    /// reference table are read from the source. If error occurs, then exception
+    /// is raised. This fuction also checks redundant entries.
+    /// \param context Current parsing context
+    /// \param source Source of the PDF file data
+    /// \param startTableOffset Offset of first reference table
+    /// \param readPreviousSections Read also previous sections of the reference table (/Prev entry)
+    void readXRefTable(PDFParsingContext* context, const PDFByteRangeSource* source, PDFInteger startTableOffset, bool readPreviousSections = true);
+
     /// Filters only occupied entries and returns them
     std::vector<Entry> getOccupiedEntries() const;
 
@@ -87,6 +99,13 @@ public:
     const PDFObject& getTrailerDictionary() const { return m_trailerDictionary; }
 
 private:
+    /// Reads one section of the reference table (classical reference table or
+    /// cross-reference stream) at current position of the parser. Offsets of
+    /// previous sections are added to the work set.
+    /// \param parser Parser
+    /// \param workSet Offsets of sections to be read
+    void readXRefSection(PDFParser* parser, std::stack<PDFInteger>* workSet);
+
     /// Reference table entries
     std::vector<Entry> m_entries;
 
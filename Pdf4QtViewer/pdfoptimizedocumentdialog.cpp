@@ -55,6 +55,8 @@ PDFOptimizeDocumentDialog::PDFOptimizeDocumentDialog(const pdf::PDFDocument* doc
     addCheckBox(tr("Merge identical objects"), pdf::PDFOptimizer::MergeIdenticalObjects);
     addCheckBox(tr("Shrink object storage (squeeze free entries)"), pdf::PDFOptimizer::ShrinkObjectStorage);
     addCheckBox(tr("Recompress flate streams by maximal compression"), pdf::PDFOptimizer::RecompressFlateStreams);
+    addCheckBox(tr("Downsample and recompress images (lossy)"), pdf::PDFOptimizer::RecompressImages);
+    addCheckBox(tr("Remove unused glyphs from embedded TrueType and CFF fonts"), pdf::PDFOptimizer::SubsetFonts);
 
     m_optimizeButton = ui->buttonBox->addButton(tr("Optimize"), QDialogButtonBox::ActionRole);
 
@@ -61,6 +61,9 @@
 namespace pdfviewer
 {
 
+/// Files of this size or larger are loaded lazily (objects are parsed on demand)
+static constexpr qint64 LAZY_LOADING_FILE_SIZE_THRESHOLD = 64 * 1024 * 1024;
+
 PDFActionManager::PDFActionManager(QObject* parent) :
     BaseClass(parent),
     m_actions(),
@@ -139,6 +142,7 @@ std::vector<QAction*> PDFActionManager::getRenderingOptionActions() const
          RenderOptionSmoothPictures,
          RenderOptionIgnoreOptionalContentSettings,
          RenderOptionDisplayAnnotations,
+         RenderOptionGlyphAtlas,
          RenderOptionInvertColors,
          RenderOptionShowTextBlocks,
          RenderOptionShowTextLines
@@ -243,6 +247,7 @@ void PDFActionManager::initActions(QSize iconSize, bool initializeStampActions)
     setUserData(RenderOptionSmoothPictures, pdf::PDFRenderer::SmoothImages);
     setUserData(RenderOptionIgnoreOptionalContentSettings, pdf::PDFRenderer::IgnoreOptionalContent);
     setUserData(RenderOptionDisplayAnnotations, pdf::PDFRenderer::DisplayAnnotations);
+    setUserData(RenderOptionGlyphAtlas, pdf::PDFRenderer::GlyphAtlas);
     setUserData(RenderOptionInvertColors, pdf::PDFRenderer::InvertColors);
     setUserData(RenderOptionShowTextBlocks, pdf::PDFRenderer::DebugTextBlocks);
     setUserData(RenderOptionShowTextLines, pdf::PDFRenderer::DebugTextLines);
@@ -540,7 +545,8 @@ void PDFProgramController::initialize(Features features,
 
     m_pdfWidget = new pdf::PDFWidget(m_CMSManager, m_settings->getRendererEngine(), m_settings->isMultisampleAntialiasingEnabled() ? m_settings->getRendererSamples() : -1, m_mainWindow);
     m_pdfWidget->setObjectName("pdfWidget");
-    m_pdfWidget->updateCacheLimits(m_settings->getCompiledPageCacheLimit() * 1024, m_settings->getThumbnailsCacheLimit(), m_settings->getFontCacheLimit(), m_settings->getInstancedFontCacheLimit());
+    m_pdfWidget->updateCacheLimits(qint64(m_settings->getCompiledPageCacheLimit()) * 1024, m_settings->getThumbnailsCacheLimit(), m_settings->getFontCacheLimit(), m_settings->getInstancedFontCacheLimit(), qint64(m_settings->getImageCacheLimit()) * 1024);
+    m_pdfWidget->getDrawWidgetProxy()->setPagePrefetchingEnabled(m_settings->isPagePrefetchingEnabled());
     m_pdfWidget->getDrawWidgetProxy()->setProgress(m_progress);
 
     connect(this, &PDFProgramController::queryPasswordRequest, this, &PDFProgramController::onQueryPasswordRequest, Qt::BlockingQueuedConnection);
@@ -1054,9 +1060,27 @@ void PDFProgramController::performSave()
 void PDFProgramController::saveDocument(const QString& fileName)
 {
     pdf::PDFDocumentWriter writer(nullptr);
-    pdf::PDFOperationResult result = writer.write(fileName, m_pdfDocument.data(), true);
+    pdf::PDFOperationResult result = true;
+
+    if (canSaveIncrementally(fileName))
+    {
+        // Only changed objects are appended to the original file, so saving
+        // of small changes (for example, filled form) is fast, and existing
+        // signatures remain valid.
+        if (!m_pdfDocument->getStorage().getModifiedReferences(m_originalDocument->getStorage()).empty())
+        {
+            result = writer.writeIncrementalUpdate(fileName, m_pdfDocument.data(), m_originalDocument.data());
+        }
+    }
+    else
+    {
+        result = writer.write(fileName, m_pdfDocument.data(), true);
+    }
+
     if (result)
     {
+        m_originalDocument = m_pdfDocument;
+
         if (m_undoRedoManager)
         {
             m_undoRedoManager->setIsCurrentSaved(true);
@@ -1076,6 +1100,20 @@ void PDFProgramController::saveDocument(const QString& fileName)
     }
 }
 
+bool PDFProgramController::canSaveIncrementally(const QString& fileName) const
+{
+    if (!m_pdfDocument || !m_originalDocument || fileName != m_fileInfo.originalFileName)
+    {
+        return false;
+    }
+
+    // File must not be changed by someone else since we have read it
+    QFileInfo fileInfo(fileName);
+    return fileInfo.exists() &&
+           fileInfo.size() == m_fileInfo.fileSize &&
+           fileInfo.lastModified() == m_fileInfo.lastModifiedTime;
+}
+
 bool PDFProgramController::isFactorySettingsBeingRestored() const
 {
     return m_isFactorySettingsBeingRestored;
@@ -1563,7 +1601,8 @@ void PDFProgramController::updateActionsAvailability()
 void PDFProgramController::onViewerSettingsChanged()
 {
     m_pdfWidget->updateRenderer(m_settings->getRendererEngine(), m_settings->isMultisampleAntialiasingEnabled() ? m_settings->getRendererSamples() : -1);
-    m_pdfWidget->updateCacheLimits(m_settings->getCompiledPageCacheLimit() * 1024, m_settings->getThumbnailsCacheLimit(), m_settings->getFontCacheLimit(), m_settings->getInstancedFontCacheLimit());
+    m_pdfWidget->updateCacheLimits(qint64(m_settings->getCompiledPageCacheLimit()) * 1024, m_settings->getThumbnailsCacheLimit(), m_settings->getFontCacheLimit(), m_settings->getInstancedFontCacheLimit(), qint64(m_settings->getImageCacheLimit()) * 1024);
+    m_pdfWidget->getDrawWidgetProxy()->setPagePrefetchingEnabled(m_settings->isPagePrefetchingEnabled());
     m_pdfWidget->getDrawWidgetProxy()->setFeatures(m_settings->getFeatures());
     m_pdfWidget->getDrawWidgetProxy()->setPreferredMeshResolutionRatio(m_settings->getPreferredMeshResolutionRatio());
     m_pdfWidget->getDrawWidgetProxy()->setMinimalMeshResolutionRatio(m_settings->getMinimalMeshResolutionRatio());
@@ -1601,7 +1640,8 @@ void PDFProgramController::openDocument(const QString& fileName)
     updateFileInfo(fileName);
 
     QApplication::setOverrideCursor(Qt::WaitCursor);
-    auto readDocument = [this, fileName]() -> AsyncReadingResult
+    const bool lazyLoading = m_fileInfo.fileSize >= LAZY_LOADING_FILE_SIZE_THRESHOLD;
+    auto readDocument = [this, fileName, lazyLoading]() -> AsyncReadingResult
     {
         AsyncReadingResult result;
 
@@ -1615,6 +1655,7 @@ void PDFProgramController::openDocument(const QString& fileName)
 
         // Try to open a new document
         pdf::PDFDocumentReader reader(m_progress, qMove(queryPassword), true, false);
+        reader.setLazyLoading(lazyLoading);
         pdf::PDFDocument document = reader.readFromFile(fileName);
 
         result.errorMessage = reader.getErrorMessage();
@@ -1664,6 +1705,7 @@ void PDFProgramController::onDocumentReadingFinished()
             m_recentFileManager->addRecentFile(m_fileInfo.originalFileName);
 
             m_pdfDocument = qMove(result.document);
+            m_originalDocument = m_pdfDocument;
             m_signatures = qMove(result.signatures);
             pdf::PDFModifiedDocument document(m_pdfDocument.data(), m_optionalContentActivity);
             setDocument(document, true);
@@ -1796,6 +1838,12 @@ void PDFProgramController::setDocument(pdf::PDFModifiedDocument document, bool i
     m_mainWindowInterface->setDocument(document);
     m_CMSManager->setDocument(document);
 
+    if (document.hasReset())
+    {
+        // Transforms of the previous document are no longer needed
+        m_CMSManager->resetCMS();
+    }
+
     updateTitle();
     m_mainWindowInterface->updateUI(true);
 
@@ -1824,6 +1872,7 @@ void PDFProgramController::closeDocument()
     m_signatures.clear();
     setDocument(pdf::PDFModifiedDocument(), true);
     m_pdfDocument.reset();
+    m_originalDocument.reset();
     updateActionsAvailability();
     updateTitle();
 }
@@ -154,6 +154,7 @@ public:
         RenderOptionSmoothPictures,
         RenderOptionIgnoreOptionalContentSettings,
         RenderOptionDisplayAnnotations,
+        RenderOptionGlyphAtlas,
         RenderOptionInvertColors,
         RenderOptionShowTextBlocks,
         RenderOptionShowTextLines,
@@ -385,6 +386,12 @@ private:
 
     void saveDocument(const QString& fileName);
 
+    /// Returns true, if document can be saved to the file as incremental update
+    /// of the original document, i.e. file is the file, from which original
+    /// document was read (or to which it was saved), and it wasn't changed since.
+    /// \param fileName File name
+    bool canSaveIncrementally(const QString& fileName) const;
+
     PDFActionManager* m_actionManager;
     QMainWindow* m_mainWindow;
     IMainWindow* m_mainWindowInterface;
@@ -394,6 +401,10 @@ private:
     PDFRecentFileManager* m_recentFileManager;
     pdf::PDFOptionalContentActivity* m_optionalContentActivity;
     pdf::PDFDocumentPointer m_pdfDocument;
+
+    /// Document as it is stored in the file (changes are saved
+    /// as incremental update of this document)
+    pdf::PDFDocumentPointer m_originalDocument;
     PDFTextToSpeech* m_textToSpeech;
     bool m_isDocumentSetInProgress;
 
@@ -148,6 +148,7 @@ PDFViewerMainWindow::PDFViewerMainWindow(QWidget* parent) :
     m_actionManager->setAction(PDFActionManager::RenderOptionSmoothPictures, ui->actionRenderOptionSmoothPictures);
     m_actionManager->setAction(PDFActionManager::RenderOptionIgnoreOptionalContentSettings, ui->actionRenderOptionIgnoreOptionalContentSettings);
     m_actionManager->setAction(PDFActionManager::RenderOptionDisplayAnnotations, ui->actionRenderOptionDisplayAnnotations);
+    m_actionManager->setAction(PDFActionManager::RenderOptionGlyphAtlas, ui->actionRenderOptionGlyphAtlas);
     m_actionManager->setAction(PDFActionManager::RenderOptionInvertColors, ui->actionInvertColors);
     m_actionManager->setAction(PDFActionManager::RenderOptionShowTextBlocks, ui->actionShow_Text_Blocks);
     m_actionManager->setAction(PDFActionManager::RenderOptionShowTextLines, ui->actionShow_Text_Lines);
@@ -422,12 +423,6 @@ void PDFViewerMainWindow::updateUI(bool fullUpdate)
         if (!currentPages.empty())
         {
             m_pageNumberSpinBox->setValue(currentPages.front() + 1);
-
-            // Prefetch pages, if it is enabled
-            if (m_programController->getSettings()->isPagePrefetchingEnabled())
-            {
-                m_programController->getPdfWidget()->getDrawWidgetProxy()->prefetchPages(currentPages.back());
-            }
         }
 
         m_sidebarWidget->setCurrentPages(currentPages);
@@ -119,6 +119,7 @@ PDFViewerMainWindowLite::PDFViewerMainWindowLite(QWidget* parent) :
     m_actionManager->setAction(PDFActionManager::RenderOptionSmoothPictures, ui->actionRenderOptionSmoothPictures);
     m_actionManager->setAction(PDFActionManager::RenderOptionIgnoreOptionalContentSettings, ui->actionRenderOptionIgnoreOptionalContentSettings);
     m_actionManager->setAction(PDFActionManager::RenderOptionDisplayAnnotations, ui->actionRenderOptionDisplayAnnotations);
+    m_actionManager->setAction(PDFActionManager::RenderOptionGlyphAtlas, ui->actionRenderOptionGlyphAtlas);
     m_actionManager->setAction(PDFActionManager::RenderOptionInvertColors, ui->actionInvertColors);
     m_actionManager->setAction(PDFActionManager::Properties, ui->actionProperties);
     m_actionManager->setAction(PDFActionManager::Options, ui->actionOptions);
@@ -335,12 +336,6 @@ void PDFViewerMainWindowLite::updateUI(bool fullUpdate)
         if (!currentPages.empty())
         {
             m_pageNumberSpinBox->setValue(currentPages.front() + 1);
-
-            // Prefetch pages, if it is enabled
-            if (m_programController->getSettings()->isPagePrefetchingEnabled())
-            {
-                m_programController->getPdfWidget()->getDrawWidgetProxy()->prefetchPages(currentPages.back());
-            }
         }
 
         m_sidebarWidget->setCurrentPages(currentPages);
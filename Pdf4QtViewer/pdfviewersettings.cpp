@@ -17,6 +17,7 @@
 
 #include "pdfviewersettings.h"
 #include "pdfconstants.h"
+#include "pdfimagecache.h"
 #include "pdfdbgheap.h"
 
 #include <QPixmapCache>
@@ -52,6 +53,7 @@ void PDFViewerSettings::readSettings(QSettings& settings, const pdf::PDFCMSSetti
     m_settings.m_thumbnailsCacheLimit = settings.value("thumbnailsCacheLimit", defaultSettings.m_thumbnailsCacheLimit).toInt();
     m_settings.m_fontCacheLimit = settings.value("fontCacheLimit", defaultSettings.m_fontCacheLimit).toInt();
     m_settings.m_instancedFontCacheLimit = settings.value("instancedFontCacheLimit", defaultSettings.m_instancedFontCacheLimit).toInt();
+    m_settings.m_imageCacheLimit = settings.value("imageCacheLimit", defaultSettings.m_imageCacheLimit).toInt();
     m_settings.m_allowLaunchApplications = settings.value("allowLaunchApplications", defaultSettings.m_allowLaunchApplications).toBool();
     m_settings.m_allowLaunchURI = settings.value("allowLaunchURI", defaultSettings.m_allowLaunchURI).toBool();
     m_settings.m_allowDeveloperMode = settings.value("allowDeveloperMode", defaultSettings.m_allowDeveloperMode).toBool();
@@ -119,6 +121,7 @@ void PDFViewerSettings::writeSettings(QSettings& settings)
     settings.setValue("thumbnailsCacheLimit", m_settings.m_thumbnailsCacheLimit);
     settings.setValue("fontCacheLimit", m_settings.m_fontCacheLimit);
     settings.setValue("instancedFontCacheLimit", m_settings.m_instancedFontCacheLimit);
+    settings.setValue("imageCacheLimit", m_settings.m_imageCacheLimit);
     settings.setValue("allowLaunchApplications", m_settings.m_allowLaunchApplications);
     settings.setValue("allowLaunchURI", m_settings.m_allowLaunchURI);
     settings.setValue("allowDeveloperMode", m_settings.m_allowDeveloperMode);
@@ -268,6 +271,7 @@ PDFViewerSettings::Settings::Settings() :
     m_thumbnailsCacheLimit(PIXMAP_CACHE_LIMIT),
     m_fontCacheLimit(pdf::DEFAULT_FONT_CACHE_LIMIT),
     m_instancedFontCacheLimit(pdf::DEFAULT_REALIZED_FONT_CACHE_LIMIT),
+    m_imageCacheLimit(int(pdf::PDFImageCache::DEFAULT_CACHE_LIMIT / 1024)),
     m_speechRate(0.0),
     m_speechPitch(0.0),
     m_speechVolume(1.0),
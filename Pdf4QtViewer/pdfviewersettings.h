@@ -66,6 +66,7 @@ public:
         int m_thumbnailsCacheLimit;
         int m_fontCacheLimit;
         int m_instancedFontCacheLimit;
+        int m_imageCacheLimit;
 
         // Speech settings
         QString m_speechEngine;
@@ -127,6 +128,7 @@ public:
     int getThumbnailsCacheLimit() const { return m_settings.m_thumbnailsCacheLimit; }
     int getFontCacheLimit() const { return m_settings.m_fontCacheLimit; }
     int getInstancedFontCacheLimit() const { return m_settings.m_instancedFontCacheLimit; }
+    int getImageCacheLimit() const { return m_settings.m_imageCacheLimit; }
 
     const pdf::PDFCMSSettings& getColorManagementSystemSettings() const { return m_colorManagementSystemSettings; }
     void setColorManagementSystemSettings(const pdf::PDFCMSSettings& settings) { m_colorManagementSystemSettings = settings; }
@@ -306,6 +306,7 @@ void PDFViewerSettingsDialog::loadData()
     ui->clipToCropBoxCheckBox->setChecked(m_settings.m_features.testFlag(pdf::PDFRenderer::ClipToCropBox));
     ui->displayTimeCheckBox->setChecked(m_settings.m_features.testFlag(pdf::PDFRenderer::DisplayTimes));
     ui->displayAnnotationsCheckBox->setChecked(m_settings.m_features.testFlag(pdf::PDFRenderer::DisplayAnnotations));
+    ui->glyphAtlasCheckBox->setChecked(m_settings.m_features.testFlag(pdf::PDFRenderer::GlyphAtlas));
 
     // Shading
     ui->preferredMeshResolutionEdit->setValue(m_settings.m_preferredMeshResolutionRatio);
@@ -317,6 +318,7 @@ void PDFViewerSettingsDialog::loadData()
     ui->thumbnailCacheSizeEdit->setValue(m_settings.m_thumbnailsCacheLimit);
     ui->cachedFontLimitEdit->setValue(m_settings.m_fontCacheLimit);
     ui->cachedInstancedFontLimitEdit->setValue(m_settings.m_instancedFontCacheLimit);
+    ui->imageCacheSizeEdit->setValue(m_settings.m_imageCacheLimit);
 
     // Security
     ui->allowLaunchCheckBox->setChecked(m_settings.m_allowLaunchApplications);
@@ -450,6 +452,10 @@ void PDFViewerSettingsDialog::saveData()
     {
         m_settings.m_features.setFlag(pdf::PDFRenderer::DisplayAnnotations, ui->displayAnnotationsCheckBox->isChecked());
     }
+    else if (sender == ui->glyphAtlasCheckBox)
+    {
+        m_settings.m_features.setFlag(pdf::PDFRenderer::GlyphAtlas, ui->glyphAtlasCheckBox->isChecked());
+    }
     else if (sender == ui->clipToCropBoxCheckBox)
     {
         m_settings.m_features.setFlag(pdf::PDFRenderer::ClipToCropBox, ui->clipToCropBoxCheckBox->isChecked());
@@ -498,6 +504,10 @@ void PDFViewerSettingsDialog::saveData()
     {
         m_settings.m_instancedFontCacheLimit = ui->cachedInstancedFontLimitEdit->value();
     }
+    else if (sender == ui->imageCacheSizeEdit)
+    {
+        m_settings.m_imageCacheLimit = ui->imageCacheSizeEdit->value();
+    }
     else if (sender == ui->cmsTypeComboBox)
     {
         m_cmsSettings.system = static_cast<pdf::PDFCMSSettings::System>(ui->cmsTypeComboBox->currentData().toInt());
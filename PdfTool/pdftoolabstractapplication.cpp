@@ -318,6 +318,11 @@ void PDFToolAbstractApplication::initializeCommandLineParser(QCommandLineParser*
         {
             parser->addOption(QCommandLineOption(info.option, info.description));
         }
+
+        parser->addOption(QCommandLineOption("linearize", "Write linearized document (fast web view)."));
+        parser->addOption(QCommandLineOption("opt-image-dpi", "Target resolution of recompressed images.", "dpi", "150"));
+        parser->addOption(QCommandLineOption("opt-image-compression", "Compression of recompressed images (auto, flate, dct).", "compression", "auto"));
+        parser->addOption(QCommandLineOption("opt-image-jpeg-quality", "Quality of DCT compression of recompressed images (0-100).", "quality", "85"));
     }
 
     if (optionFlags.testFlag(CertStore))
@@ -903,6 +908,47 @@ PDFToolOptions PDFToolAbstractApplication::getOptions(QCommandLineParser* parser
                 options.optimizeFlags |= info.flag;
             }
         }
+
+        options.optimizeLinearize = parser->isSet("linearize");
+
+        bool ok = false;
+        pdf::PDFReal targetDpi = parser->value("opt-image-dpi").toDouble(&ok);
+        if (ok && targetDpi > 0.0)
+        {
+            options.optimizeImageSettings.targetDpi = targetDpi;
+        }
+        else
+        {
+            PDFConsole::writeError(PDFToolTranslationContext::tr("Invalid image dpi value '%1'.").arg(parser->value("opt-image-dpi")), options.outputCodec);
+        }
+
+        QString imageCompression = parser->value("opt-image-compression");
+        if (imageCompression == "auto")
+        {
+            options.optimizeImageSettings.compression = pdf::PDFOptimizer::ImageCompression::Auto;
+        }
+        else if (imageCompression == "flate")
+        {
+            options.optimizeImageSettings.compression = pdf::PDFOptimizer::ImageCompression::Flate;
+        }
+        else if (imageCompression == "dct")
+        {
+            options.optimizeImageSettings.compression = pdf::PDFOptimizer::ImageCompression::DCT;
+        }
+        else
+        {
+            PDFConsole::writeError(PDFToolTranslationContext::tr("Unknown image compression '%1'.").arg(imageCompression), options.outputCodec);
+        }
+
+        int jpegQuality = parser->value("opt-image-jpeg-quality").toInt(&ok);
+        if (ok && jpegQuality >= 0 && jpegQuality <= 100)
+        {
+            options.optimizeImageSettings.jpegQuality = jpegQuality;
+        }
+        else
+        {
+            PDFConsole::writeError(PDFToolTranslationContext::tr("Invalid jpeg quality '%1'. Quality must be in range from 0 to 100.").arg(parser->value("opt-image-jpeg-quality")), options.outputCodec);
+        }
     }
 
     if (optionFlags.testFlag(CertStore))
@@ -1168,7 +1214,8 @@ std::vector<PDFToolOptions::RenderFeatureInfo> PDFToolOptions::getRenderFeatures
         RenderFeatureInfo{ "render-ignore-opt-content", "Ignore optional content settings (draw everything).", pdf::PDFRenderer::IgnoreOptionalContent },
         RenderFeatureInfo{ "render-clip-to-crop-box", "Clip page graphics to crop box.", pdf::PDFRenderer::ClipToCropBox },
         RenderFeatureInfo{ "render-invert-colors", "Invert all colors.", pdf::PDFRenderer::InvertColors },
-        RenderFeatureInfo{ "render-display-annot", "Display annotations.", pdf::PDFRenderer::DisplayAnnotations }
+        RenderFeatureInfo{ "render-display-annot", "Display annotations.", pdf::PDFRenderer::DisplayAnnotations },
+        RenderFeatureInfo{ "render-glyph-atlas", "Draw small text using cached glyph bitmaps.", pdf::PDFRenderer::GlyphAtlas }
     };
 }
 
@@ -1181,7 +1228,10 @@ std::vector<PDFToolOptions::OptimizeFeatureInfo> PDFToolOptions::getOptimizeFlag
         OptimizeFeatureInfo{ "opt-merge-identical", "Merge identical objects.", pdf::PDFOptimizer::MergeIdenticalObjects },
         OptimizeFeatureInfo{ "opt-shrink-storage", "Shrink object storage by renumbering objects.", pdf::PDFOptimizer::ShrinkObjectStorage },
         OptimizeFeatureInfo{ "opt-recompress-flate", "Recompress flate streams with maximal compression.", pdf::PDFOptimizer::RecompressFlateStreams },
-        OptimizeFeatureInfo{ "opt-all", "Use all optimization algorithms.", pdf::PDFOptimizer::All }
+        OptimizeFeatureInfo{ "opt-object-streams", "Pack objects into compressed object streams and write cross-reference stream.", pdf::PDFOptimizer::CompressObjectStreams },
+        OptimizeFeatureInfo{ "opt-recompress-images", "Downsample images above target resolution and recompress them.", pdf::PDFOptimizer::RecompressImages },
+        OptimizeFeatureInfo{ "opt-subset-fonts", "Remove unused glyphs from embedded TrueType and CFF fonts.", pdf::PDFOptimizer::SubsetFonts },
+        OptimizeFeatureInfo{ "opt-all", "Use all lossless optimization algorithms (images and fonts are not changed).", pdf::PDFOptimizer::All }
     };
 }
 
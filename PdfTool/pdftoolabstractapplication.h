@@ -151,6 +151,8 @@ struct PDFToolOptions
 
     // For option 'Optimize'
     pdf::PDFOptimizer::OptimizationFlags optimizeFlags = pdf::PDFOptimizer::None;
+    bool optimizeLinearize = false;
+    pdf::PDFOptimizer::ImageSettings optimizeImageSettings;
 
     // For option 'CertStore'
     bool certStoreEnumerateSystemCertificates = false;
@@ -47,7 +47,7 @@ QString PDFToolOptimize::getStandardString(PDFToolAbstractApplication::StandardS
 
 int PDFToolOptimize::execute(const PDFToolOptions& options)
 {
-    if (!options.optimizeFlags)
+    if (!options.optimizeFlags && !options.optimizeLinearize)
     {
         PDFConsole::writeError(PDFToolTranslationContext::tr("No optimization option has been set."), options.outputCodec);
         return ErrorInvalidArguments;
@@ -60,13 +60,26 @@ int PDFToolOptimize::execute(const PDFToolOptions& options)
         return ErrorDocumentReading;
     }
 
-    pdf::PDFOptimizer optimizer(options.optimizeFlags, nullptr);
-    QObject::connect(&optimizer, &pdf::PDFOptimizer::optimizationProgress, &optimizer, [&options](QString text) { PDFConsole::writeError(text, options.outputCodec); }, Qt::DirectConnection);
-    optimizer.setDocument(&document);
-    optimizer.optimize();
-    document = optimizer.takeOptimizedDocument();
+    pdf::PDFDocumentWriter::WriteFlags writeFlags = pdf::PDFDocumentWriter::None;
+    if (options.optimizeFlags)
+    {
+        pdf::PDFOptimizer optimizer(options.optimizeFlags, nullptr);
+        QObject::connect(&optimizer, &pdf::PDFOptimizer::optimizationProgress, &optimizer, [&options](QString text) { PDFConsole::writeError(text, options.outputCodec); }, Qt::DirectConnection);
+        optimizer.setDocument(&document);
+        optimizer.setImageSettings(options.optimizeImageSettings);
+        optimizer.optimize();
+        document = optimizer.takeOptimizedDocument();
+        writeFlags = optimizer.getWriteFlags();
+    }
+
+    if (options.optimizeLinearize)
+    {
+        writeFlags |= pdf::PDFDocumentWriter::Linearize;
+    }
 
     pdf::PDFDocumentWriter writer(nullptr);
+    writer.setFlags(writeFlags);
+
     pdf::PDFOperationResult result = writer.write(options.document, &document, true);
     if (!result)
     {
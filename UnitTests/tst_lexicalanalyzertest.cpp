@@ -18,6 +18,8 @@
 
 #include <QtTest>
 #include <QMetaType>
+#include <QBuffer>
+#include <QPainter>
 
 #include "pdfparser.h"
 #include "pdfconstants.h"
@@ -27,8 +29,30 @@
 #include "pdfdocument.h"
 #include "pdfexception.h"
 #include "pdfjbig2decoder.h"
+#include "pdfdocumentbuilder.h"
+#include "pdfdocumentreader.h"
+#include "pdfdocumentwriter.h"
+#include "pdfoptimizer.h"
+#include "pdffontsubsetter.h"
+#include "pdfexecutionpolicy.h"
+#include "pdfccittfaxdecoder.h"
+#include "pdfcontentstreambytecode.h"
+#include "pdfcompiler.h"
+#include "pdfpagetilecache.h"
+#include "pdfimagecache.h"
+#include "pdfglyphatlas.h"
+#include "pdfcolorspaces.h"
+#include "pdfcms.h"
+#include "pdfpagecontentprocessor.h"
 
 #include <regex>
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <set>
+#include <optional>
 
 #ifdef PDF4QT_COMPILER_MSVC
 #pragma warning(push)
@@ -60,12 +84,50 @@ private slots:
     void test_stitching_function();
     void test_postscript_function();
     void test_jbig2_arithmetic_decoder();
+    void test_lazy_loading();
+    void test_linearized_write();
+    void test_linearized_hint_tables();
+    void test_linearized_partial_read();
+    void test_object_streams_write();
+    void test_incremental_update();
+    void test_merge_identical_objects();
+    void test_ccitt_group4_encode();
+    void test_truetype_font_subset();
+    void test_cff_font_subset();
+    void test_execution_policy();
+    void test_flate_predictor_data_source();
+    void test_token_views();
+    void test_content_stream_bytecode();
+    void test_precompiled_page_cache();
+    void test_page_tile_cache();
+    void test_precompiled_page_culling();
+    void test_image_pyramid();
+    void test_image_cache();
+    void test_glyph_atlas();
+    void test_image_color_conversion();
+    void test_content_operator_lookup();
+    void test_color_memo();
 
 private:
     void scanWholeStream(const char* stream);
     void testTokens(const char* stream, const std::vector<pdf::PDFLexicalAnalyzer::Token>& tokens);
 
     QString getStringFromTokens(const std::vector<pdf::PDFLexicalAnalyzer::Token>& tokens);
+
+    /// Creates document with empty pages with given media boxes
+    static pdf::PDFDocument createTestDocument(const std::vector<QRectF>& mediaBoxes);
+
+    /// Writes document into the memory buffer. If document can't be written, empty data are returned.
+    static QByteArray writeToData(const pdf::PDFDocument& document, pdf::PDFDocumentWriter::WriteFlags flags);
+
+    /// Reads document from the data. If document can't be read, std::nullopt is returned.
+    static std::optional<pdf::PDFDocument> readFromData(const QByteArray& data, bool lazyLoading);
+
+    /// Password callback for test documents, which are not encrypted
+    static QString getNoPassword(bool* ok);
+
+    /// Creates source, which reads byte ranges of the data
+    static pdf::PDFByteRangeSourcePointer createRangeSource(const QByteArray& data);
 };
 
 LexicalAnalyzerTest::LexicalAnalyzerTest()
@@ -1102,6 +1164,1480 @@ void LexicalAnalyzerTest::test_jbig2_arithmetic_decoder()
     QVERIFY(decompressed == decompressedByAD);
 }
 
+void LexicalAnalyzerTest::test_lazy_loading()
+{
+    const pdf::PDFDocument document = createTestDocument({ QRectF(0, 0, 400, 400), QRectF(0, 0, 200, 300) });
+    const QByteArray data = writeToData(document, pdf::PDFDocumentWriter::None);
+    QVERIFY(!data.isEmpty());
+
+    std::optional<pdf::PDFDocument> readDocument = readFromData(data, false);
+    QVERIFY(readDocument);
+    QVERIFY(!readDocument->getStorage().isLazyLoading());
+
+    std::optional<pdf::PDFDocument> lazyDocument = readFromData(data, true);
+    QVERIFY(lazyDocument);
+    QVERIFY(lazyDocument->getStorage().isLazyLoading());
+    QCOMPARE(lazyDocument->getCatalog()->getPageCount(), size_t(2));
+
+    // Copy of the storage must be independent of the original storage
+    pdf::PDFObjectStorage storageCopy = lazyDocument->getStorage();
+    QVERIFY(storageCopy.isLazyLoading());
+    QVERIFY(storageCopy == readDocument->getStorage());
+    QVERIFY(*lazyDocument == *readDocument);
+
+    // Whole document access must not load objects into the storage
+    QVERIFY(lazyDocument->getStorage().getObjects() == readDocument->getStorage().getObjects());
+    QVERIFY(lazyDocument->getStorage().isLazyLoading());
+
+    // Replaced objects are no longer loaded on demand
+    const pdf::PDFObjectReference catalogReference = lazyDocument->getTrailerDictionary()->get("Root").getReference();
+    storageCopy.setObject(catalogReference, pdf::PDFObject::createInteger(42));
+    QCOMPARE(storageCopy.getObject(catalogReference).getInteger(), pdf::PDFInteger(42));
+    QVERIFY(lazyDocument->getStorage().getObject(catalogReference).isDictionary());
+
+    // Content of the loaded object is owned by the document, so it is not released
+    const pdf::PDFDictionary* catalogDictionary = lazyDocument->getStorage().getObject(catalogReference).getDictionary();
+    QCOMPARE(lazyDocument->getStorage().getObject(catalogReference).getDictionary(), catalogDictionary);
+
+    storageCopy.loadAllObjects();
+    QVERIFY(!storageCopy.isLazyLoading());
+    QCOMPARE(storageCopy.getObject(catalogReference).getInteger(), pdf::PDFInteger(42));
+
+    // Read document using byte ranges
+    pdf::PDFDocumentReader rangeReader(nullptr, &LexicalAnalyzerTest::getNoPassword, false, false);
+    pdf::PDFDocument rangeDocument = rangeReader.readFromSource(createRangeSource(data));
+    QVERIFY(rangeReader.getReadingResult() == pdf::PDFDocumentReader::Result::OK);
+    QVERIFY(rangeDocument.getStorage().isLazyLoading());
+    QCOMPARE(rangeDocument.getCatalog()->getPageCount(), size_t(2));
+    QVERIFY(rangeDocument == *readDocument);
+
+    // Source, which fails to read the data, must not be read forever
+    auto failingReadFunction = [&data](pdf::PDFInteger offset, pdf::PDFInteger length) { return offset > 0 ? QByteArray() : data.mid(offset, length); };
+    pdf::PDFByteRangeSourcePointer failingSource = std::make_shared<pdf::PDFCallbackRangeSource>(data.size(), failingReadFunction);
+    pdf::PDFDocumentReader failingReader(nullptr, &LexicalAnalyzerTest::getNoPassword, false, false);
+    failingReader.readFromSource(failingSource);
+    QVERIFY(failingReader.getReadingResult() == pdf::PDFDocumentReader::Result::Failed);
+}
+
+void LexicalAnalyzerTest::test_linearized_write()
+{
+    const pdf::PDFDocument document = createTestDocument({ QRectF(0, 0, 400, 400), QRectF(0, 0, 200, 300), QRectF(0, 0, 300, 200) });
+    const QByteArray data = writeToData(document, pdf::PDFDocumentWriter::Linearize);
+    QVERIFY(!data.isEmpty());
+
+    // Linearized document must be readable as an ordinary document
+    std::optional<pdf::PDFDocument> readDocument = readFromData(data, false);
+    QVERIFY(readDocument);
+    QCOMPARE(readDocument->getCatalog()->getPageCount(), size_t(3));
+
+    pdf::PDFDocumentReader rangeReader(nullptr, &LexicalAnalyzerTest::getNoPassword, false, false);
+    pdf::PDFDocument rangeDocument = rangeReader.readFromSource(createRangeSource(data));
+    QVERIFY(rangeReader.getReadingResult() == pdf::PDFDocumentReader::Result::OK);
+    QVERIFY(rangeReader.getWarnings().isEmpty());
+
+    const pdf::PDFLinearizationInfo& linearizationInfo = rangeReader.getLinearizationInfo();
+    QVERIFY(linearizationInfo.isValid());
+    QCOMPARE(linearizationInfo.getDictionary().getFileLength(), pdf::PDFInteger(data.size()));
+    QCOMPARE(rangeDocument.getCatalog()->getPageCount(), size_t(3));
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        QCOMPARE(linearizationInfo.getPageReference(pdf::PDFInteger(i)), rangeDocument.getCatalog()->getPage(i)->getPageReference());
+        QCOMPARE(rangeDocument.getCatalog()->getPage(i)->getMediaBox(), readDocument->getCatalog()->getPage(i)->getMediaBox());
+    }
+}
+
+void LexicalAnalyzerTest::test_linearized_hint_tables()
+{
+    pdf::PDFPageOffsetHintTable table;
+    table.header.leastObjectCount = 2;
+    table.header.objectCountBits = 3;
+    table.header.leastPageLength = 100;
+    table.header.pageLengthBits = 10;
+    table.header.sharedObjectCountBits = 2;
+    table.header.sharedObjectIdentifierBits = 4;
+    table.header.contentStreamLengthBits = 10;
+    table.header.sharedObjectDenominator = 1;
+
+    for (uint32_t i = 0; i < 5; ++i)
+    {
+        pdf::PDFPageOffsetHintTable::Entry entry;
+        entry.objectCountDelta = i;
+        entry.pageLengthDelta = 100 * i + 7;
+        entry.sharedObjectIdentifiers.assign(i % 3, i + 1);
+        entry.sharedObjectNumerators.assign(i % 3, 0);
+        entry.contentStreamLengthDelta = 50 * i;
+        table.entries.push_back(entry);
+    }
+
+    const QByteArray data = pdf::PDFLinearizationInfo::writePageOffsetHintTable(table);
+    pdf::PDFPageOffsetHintTable readTable = pdf::PDFLinearizationInfo::readPageOffsetHintTable(data, 5);
+    QCOMPARE(readTable.entries.size(), table.entries.size());
+
+    for (size_t i = 0; i < table.entries.size(); ++i)
+    {
+        QCOMPARE(readTable.entries[i].objectCountDelta, table.entries[i].objectCountDelta);
+        QCOMPARE(readTable.entries[i].pageLengthDelta, table.entries[i].pageLengthDelta);
+        QCOMPARE(readTable.entries[i].sharedObjectIdentifiers, table.entries[i].sharedObjectIdentifiers);
+        QCOMPARE(readTable.entries[i].contentStreamLengthDelta, table.entries[i].contentStreamLengthDelta);
+    }
+
+    // Page count from the file must not exceed capacity of the hint table
+    QVERIFY_THROWS_EXCEPTION(pdf::PDFException, pdf::PDFLinearizationInfo::readPageOffsetHintTable(data, 1000000000));
+    QVERIFY_THROWS_EXCEPTION(pdf::PDFException, pdf::PDFLinearizationInfo::readPageOffsetHintTable(data, -1));
+}
+
+void LexicalAnalyzerTest::test_linearized_partial_read()
+{
+    pdf::PDFDocumentBuilder builder;
+    pdf::PDFPageContentStreamBuilder contentStreamBuilder(&builder);
+
+    // Pages have large content streams, which are hard to compress
+    quint32 seed = 1;
+    for (int pageIndex = 0; pageIndex < 3; ++pageIndex)
+    {
+        QPainter* painter = contentStreamBuilder.beginNewPage(QRectF(0, 0, 400, 400));
+        for (int i = 0; i < 5000; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            const qreal x = (seed >> 8) % 40000 / 100.0;
+            seed = seed * 1103515245 + 12345;
+            const qreal y = (seed >> 8) % 40000 / 100.0;
+            painter->drawLine(QPointF(x, y), QPointF(y, x));
+        }
+        contentStreamBuilder.end(painter);
+    }
+    pdf::PDFDocument document = builder.build();
+
+    const QByteArray data = writeToData(document, pdf::PDFDocumentWriter::Linearize);
+    QVERIFY(!data.isEmpty());
+
+    pdf::PDFByteRangeSourcePointer source = createRangeSource(data);
+    pdf::PDFDocumentReader rangeReader(nullptr, &LexicalAnalyzerTest::getNoPassword, false, false);
+    pdf::PDFDocument rangeDocument = rangeReader.readFromSource(source);
+    QVERIFY(rangeReader.getReadingResult() == pdf::PDFDocumentReader::Result::OK);
+    QVERIFY(rangeReader.getLinearizationInfo().isValid());
+    QCOMPARE(rangeDocument.getCatalog()->getPageCount(), size_t(3));
+
+    // Opening of the document must not read contents of the other pages
+    const pdf::PDFInteger bytesReadAtOpen = source->getBytesRead();
+    QVERIFY(bytesReadAtOpen < data.size() / 2);
+
+    // Contents of the last page are read, when they are requested
+    const pdf::PDFObject contents = rangeDocument.getObject(rangeDocument.getCatalog()->getPage(2)->getContents());
+    QVERIFY(contents.isStream());
+    QVERIFY(source->getBytesRead() > bytesReadAtOpen);
+}
+
+void LexicalAnalyzerTest::test_object_streams_write()
+{
+    const pdf::PDFDocument document = createTestDocument({ QRectF(0, 0, 400, 400), QRectF(0, 0, 200, 300) });
+    const QByteArray data = writeToData(document, pdf::PDFDocumentWriter::ObjectStreams);
+    QVERIFY(data.contains("/ObjStm"));
+    QVERIFY(data.contains("/XRef"));
+
+    std::optional<pdf::PDFDocument> readDocument = readFromData(data, false);
+    QVERIFY(readDocument);
+    QCOMPARE(readDocument->getCatalog()->getPageCount(), size_t(2));
+
+    // All objects of the original document must be preserved
+    const pdf::PDFObjectStorage::PDFObjects& objects = document.getStorage().getObjects();
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+        const pdf::PDFObjectReference reference(pdf::PDFInteger(i), objects[i].generation);
+        QVERIFY(readDocument->getObjectByReference(reference) == objects[i].object);
+    }
+
+    // Objects loaded lazily from the object streams must be the same
+    std::optional<pdf::PDFDocument> lazyDocument = readFromData(data, true);
+    QVERIFY(lazyDocument);
+    for (size_t i = objects.size(); i > 0; --i)
+    {
+        const pdf::PDFObjectReference reference(pdf::PDFInteger(i - 1), objects[i - 1].generation);
+        QVERIFY(lazyDocument->getObjectByReference(reference) == objects[i - 1].object);
+    }
+}
+
+void LexicalAnalyzerTest::test_incremental_update()
+{
+    const pdf::PDFDocument document = createTestDocument({ QRectF(0, 0, 400, 400), QRectF(0, 0, 200, 300) });
+
+    // Update is written in the same format, as original cross-reference section
+    for (pdf::PDFDocumentWriter::WriteFlags flags : { pdf::PDFDocumentWriter::WriteFlags(pdf::PDFDocumentWriter::None), pdf::PDFDocumentWriter::WriteFlags(pdf::PDFDocumentWriter::ObjectStreams) })
+    {
+        const bool isXRefStream = flags.testFlag(pdf::PDFDocumentWriter::ObjectStreams);
+
+        QBuffer buffer;
+        buffer.open(QBuffer::ReadWrite);
+        pdf::PDFDocumentWriter writer(nullptr);
+        writer.setFlags(flags);
+        QVERIFY(writer.write(&buffer, &document));
+        const QByteArray originalData = buffer.data();
+
+        std::optional<pdf::PDFDocument> readDocument = readFromData(originalData, true);
+        QVERIFY(readDocument);
+        pdf::PDFDocument originalDocument = qMove(*readDocument);
+
+        pdf::PDFDocumentBuilder modifier(&originalDocument);
+        modifier.appendPage(QRectF(0, 0, 300, 200));
+        pdf::PDFDocument modifiedDocument = modifier.build();
+
+        // Unmodified objects are not loaded into the storage
+        QVERIFY(!modifiedDocument.getStorage().getModifiedReferences(originalDocument.getStorage()).empty());
+        QVERIFY(modifiedDocument.getStorage().isLazyLoading());
+
+        QVERIFY(buffer.seek(originalData.size()));
+        QVERIFY(writer.writeIncrementalUpdate(&buffer, &modifiedDocument, &originalDocument, pdf::PDFDocumentReader::findXrefTableOffset(originalData)));
+        const QByteArray data = buffer.data();
+
+        // Original data must be preserved, only changed objects are appended
+        QVERIFY(data.startsWith(originalData));
+        QVERIFY(data.size() - originalData.size() < pdf::PDFDocumentWriter::getDocumentFileSize(&modifiedDocument));
+
+        const QByteArray update = data.mid(originalData.size());
+        QCOMPARE(update.contains("/XRef"), isXRefStream);
+        QCOMPARE(update.contains("trailer"), !isXRefStream);
+
+        std::optional<pdf::PDFDocument> updatedDocument = readFromData(data, false);
+        QVERIFY(updatedDocument);
+        QCOMPARE(updatedDocument->getCatalog()->getPageCount(), size_t(3));
+
+        const pdf::PDFObjectStorage::PDFObjects objects = modifiedDocument.getStorage().getObjects();
+        for (size_t i = 0; i < objects.size(); ++i)
+        {
+            const pdf::PDFObjectReference reference(pdf::PDFInteger(i), objects[i].generation);
+            QVERIFY(updatedDocument->getObjectByReference(reference) == objects[i].object);
+        }
+    }
+}
+
+void LexicalAnalyzerTest::test_merge_identical_objects()
+{
+    auto createDictionary = []()
+    {
+        pdf::PDFDictionary dictionary;
+        dictionary.addEntry(pdf::PDFInplaceOrMemoryString("Key"), pdf::PDFObject::createInteger(1));
+        dictionary.addEntry(pdf::PDFInplaceOrMemoryString("LongKeyInMemory"), pdf::PDFObject::createReal(-0.0));
+        return pdf::PDFObject::createDictionary(std::make_shared<pdf::PDFDictionary>(qMove(dictionary)));
+    };
+    auto createArray = [](pdf::PDFObjectReference reference)
+    {
+        pdf::PDFArray array;
+        array.appendItem(pdf::PDFObject::createReference(reference));
+        return pdf::PDFObject::createArray(std::make_shared<pdf::PDFArray>(qMove(array)));
+    };
+
+    QCOMPARE(createDictionary().getHash(), createDictionary().getHash());
+    QCOMPARE(pdf::PDFObject::createReal(0.0).getHash(), pdf::PDFObject::createReal(-0.0).getHash());
+
+    pdf::PDFDocumentBuilder builder;
+    builder.appendPage(QRectF(0, 0, 400, 400));
+    const pdf::PDFObjectReference dictionary1 = builder.addObject(createDictionary());
+    const pdf::PDFObjectReference dictionary2 = builder.addObject(createDictionary());
+    const pdf::PDFObjectReference array1 = builder.addObject(createArray(dictionary1));
+    const pdf::PDFObjectReference array2 = builder.addObject(createArray(dictionary2));
+    pdf::PDFDocument document = builder.build();
+
+    // Arrays become identical after dictionaries are merged
+    pdf::PDFOptimizer optimizer(pdf::PDFOptimizer::MergeIdenticalObjects, nullptr);
+    optimizer.setDocument(&document);
+    optimizer.optimize();
+    const pdf::PDFObjectStorage& storage = optimizer.getStorage();
+
+    QVERIFY(!storage.getObject(dictionary1).isNull());
+    QVERIFY(storage.getObject(dictionary2).isNull());
+    QVERIFY(!storage.getObject(array1).isNull());
+    QVERIFY(storage.getObject(array2).isNull());
+}
+
+void LexicalAnalyzerTest::test_ccitt_group4_encode()
+{
+    // Image contains long runs (longer than largest make-up code), noise
+    // and lines similar to the previous line, so all coding modes are used.
+    const unsigned int width = 3000;
+    const unsigned int height = 64;
+    const unsigned int stride = (width + 7) / 8;
+
+    QByteArray data(stride * height, 0);
+    QRandomGenerator generator(42);
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        for (unsigned int x = 0; x < width; ++x)
+        {
+            bool isWhite = false;
+            if (y < 8)
+            {
+                isWhite = generator.bounded(2);
+            }
+            else if (y < 16)
+            {
+                isWhite = (x / 2700) % 2;
+            }
+            else
+            {
+                isWhite = (x / (y % 7 + 3) + y / 5) % 2;
+            }
+
+            if (isWhite)
+            {
+                data[y * stride + x / 8] = data[y * stride + x / 8] | char(0x80 >> (x % 8));
+            }
+        }
+    }
+
+    pdf::PDFImageData imageData(1, 1, width, height, stride, pdf::PDFImageData::MaskingType::None, data, { }, { 0.0, 1.0 }, { });
+    QByteArray encodedData = pdf::PDFCCITTFaxEncoder::encode(imageData);
+
+    pdf::PDFCCITTFaxDecoderParameters parameters;
+    parameters.K = -1;
+    parameters.columns = width;
+    parameters.rows = height;
+    parameters.decode = { 0.0, 1.0 };
+
+    pdf::PDFCCITTFaxDecoder decoder(&encodedData, parameters);
+    pdf::PDFImageData decodedImageData = decoder.decode();
+
+    QCOMPARE(decodedImageData.getWidth(), width);
+    QCOMPARE(decodedImageData.getHeight(), height);
+    QCOMPARE(decodedImageData.getData(), data);
+}
+
+void LexicalAnalyzerTest::test_truetype_font_subset()
+{
+    auto writeUInt16 = [](QByteArray& data, uint16_t value) { data.append(char(value >> 8)); data.append(char(value)); };
+    auto writeUInt32 = [&](QByteArray& data, uint32_t value) { writeUInt16(data, uint16_t(value >> 16)); writeUInt16(data, uint16_t(value)); };
+    auto readUInt16 = [](const QByteArray& data, int offset) { return uint16_t((uint8_t(data[offset]) << 8) | uint8_t(data[offset + 1])); };
+    auto readUInt32 = [&](const QByteArray& data, int offset) { return (uint32_t(readUInt16(data, offset)) << 16) | readUInt16(data, offset + 2); };
+    auto getChecksum = [&](QByteArray data)
+    {
+        while (data.size() % 4 != 0)
+        {
+            data.append(char(0));
+        }
+
+        uint32_t checksum = 0;
+        for (int i = 0; i < data.size(); i += 4)
+        {
+            checksum += readUInt32(data, i);
+        }
+        return checksum;
+    };
+
+    // Glyphs 0, 1, 3 and 4 are simple glyphs, glyph 2 is composite glyph with glyph 3 as a component
+    auto createSimpleGlyph = [&](uint16_t value)
+    {
+        QByteArray glyph;
+        writeUInt16(glyph, 1);
+        for (int i = 0; i < 5; ++i)
+        {
+            writeUInt16(glyph, value);
+        }
+        return glyph;
+    };
+
+    QByteArray compositeGlyph;
+    writeUInt16(compositeGlyph, uint16_t(-1));
+    for (int i = 0; i < 4; ++i)
+    {
+        writeUInt16(compositeGlyph, 0);
+    }
+    writeUInt16(compositeGlyph, 0x0001); // ARG_1_AND_2_ARE_WORDS, no more components
+    writeUInt16(compositeGlyph, 3);
+    writeUInt16(compositeGlyph, 10);
+    writeUInt16(compositeGlyph, 20);
+
+    const std::vector<QByteArray> glyphs = { createSimpleGlyph(100), createSimpleGlyph(101), compositeGlyph, createSimpleGlyph(103), createSimpleGlyph(104) };
+
+    QByteArray glyf;
+    QByteArray loca;
+    for (const QByteArray& glyph : glyphs)
+    {
+        writeUInt32(loca, uint32_t(glyf.size()));
+        glyf.append(glyph);
+    }
+    writeUInt32(loca, uint32_t(glyf.size()));
+
+    QByteArray head(54, 0);
+    head[51] = 1; // Long loca format
+
+    QByteArray maxp;
+    writeUInt32(maxp, 0x00005000);
+    writeUInt16(maxp, uint16_t(glyphs.size()));
+
+    // Tables in the table directory are sorted by tag
+    const std::vector<std::pair<QByteArray, QByteArray>> tables = { { "glyf", glyf }, { "head", head }, { "loca", loca }, { "maxp", maxp } };
+
+    QByteArray font;
+    writeUInt32(font, 0x00010000);
+    writeUInt16(font, uint16_t(tables.size()));
+    writeUInt16(font, 64);
+    writeUInt16(font, 2);
+    writeUInt16(font, 0);
+
+    uint32_t offset = 12 + 16 * uint32_t(tables.size());
+    for (const auto& table : tables)
+    {
+        font.append(table.first);
+        writeUInt32(font, getChecksum(table.second));
+        writeUInt32(font, offset);
+        writeUInt32(font, uint32_t(table.second.size()));
+        offset += uint32_t(table.second.size() + 3) / 4 * 4;
+    }
+    for (const auto& table : tables)
+    {
+        font.append(table.second);
+        while (font.size() % 4 != 0)
+        {
+            font.append(char(0));
+        }
+    }
+
+    const QByteArray subset = pdf::PDFTrueTypeFontSubsetter::createSubset(font, { 2 });
+
+    // Read the table directory of the subset, table checksums must be valid
+    std::map<QByteArray, QByteArray> subsetTables;
+    const uint16_t tableCount = readUInt16(subset, 4);
+    for (uint16_t i = 0; i < tableCount; ++i)
+    {
+        const int recordOffset = 12 + 16 * i;
+        const QByteArray tag = subset.mid(recordOffset, 4);
+        const QByteArray data = subset.mid(readUInt32(subset, recordOffset + 8), readUInt32(subset, recordOffset + 12));
+
+        if (tag != "head")
+        {
+            QCOMPARE(readUInt32(subset, recordOffset + 4), getChecksum(data));
+        }
+        subsetTables[tag] = data;
+    }
+    QCOMPARE(subsetTables.size(), tables.size());
+
+    // Checksum of the whole font is adjusted by the head table
+    QCOMPARE(getChecksum(subset), uint32_t(0xB1B0AFBA));
+
+    // Subset is small, so short loca format is used
+    const QByteArray& subsetHead = subsetTables["head"];
+    const QByteArray& subsetLoca = subsetTables["loca"];
+    const QByteArray& subsetGlyf = subsetTables["glyf"];
+    QCOMPARE(readUInt16(subsetHead, 50), uint16_t(0));
+    QCOMPARE(subsetLoca.size(), qsizetype(2 * (glyphs.size() + 1)));
+
+    // Glyph 0 (.notdef), used glyph and component of the composite glyph are kept
+    for (size_t i = 0; i < glyphs.size(); ++i)
+    {
+        const int start = 2 * readUInt16(subsetLoca, int(2 * i));
+        const int end = 2 * readUInt16(subsetLoca, int(2 * (i + 1)));
+        const bool isUsed = i == 0 || i == 2 || i == 3;
+
+        if (isUsed)
+        {
+            QVERIFY(end - start >= glyphs[i].size());
+            QCOMPARE(subsetGlyf.mid(start, glyphs[i].size()), glyphs[i]);
+        }
+        else
+        {
+            QCOMPARE(end, start);
+        }
+    }
+
+    // Subset font name has a tag
+    const QByteArray tag = pdf::PDFTrueTypeFontSubsetter::createSubsetTag(subset);
+    QCOMPARE(tag.size(), qsizetype(6));
+    QVERIFY(std::all_of(tag.cbegin(), tag.cend(), [](char c) { return c >= 'A' && c <= 'Z'; }));
+    QCOMPARE(pdf::PDFTrueTypeFontSubsetter::getSubsetFontName("Arial", "ABCDEF"), QByteArray("ABCDEF+Arial"));
+    QCOMPARE(pdf::PDFTrueTypeFontSubsetter::getSubsetFontName("XYZXYZ+Arial", "ABCDEF"), QByteArray("ABCDEF+Arial"));
+
+    // Font program, which is not a TrueType font program, is rejected
+    QVERIFY_THROWS_EXCEPTION(pdf::PDFException, pdf::PDFTrueTypeFontSubsetter::createSubset(QByteArray("OTTO") + QByteArray(32, 0), { 1 }));
+}
+
+void LexicalAnalyzerTest::test_cff_font_subset()
+{
+    // Font with glyphs .notdef, space, A, B, C, acute, Aacute and D. Glyph B uses hint mask,
+    // glyph C calls local subroutine, Aacute is accented glyph (A + acute) and D calls global
+    // subroutine with accented glyph (A + acute).
+    const QByteArray font = QByteArray::fromHex("010004010001010108546573744346460001010113f81b028b8bf8a6f95005c90f8df73f12d81100010101085465737443464600010101078b8bccf7560e000001002200230024007d00ab0025000801010d1925363b474f53f8888b16f874f950fc74060ef8928b16f87ef946fc7e060ef89c8b16f888f93cfc88060ef8888bbd12959f1713c0efef15f75c060ef888200a0ef8ba8b16f8a6f91efca6060ef8ec8b8bccf7560ef8ec201d8d130001010107efef15bd060b");
+
+    // CID-keyed font with the same glyphs, glyphs have CIDs 0, 1, 10, 11, 12, 30, 31 and 40
+    const QByteArray cidFont = QByteArray::fromHex("010004010001010108546573744346460001010121f81bf81c8b0c1ef81d028b8bf8a6f95005ef0c22e60ff30c25f7620c24f7041100030101060e1541646f62654964656e746974795465737443464600010101078b8bccf7560e01000100000a02001e010028000300010000000008000801010d1925363b474f53f8888b16f874f950fc74060ef8928b16f87ef946fc7e060ef89c8b16f888f93cfc88060ef8888bbd12959f1713c0efef15f75c060ef888200a0ef8ba8b16f8a6f91efca6060ef8ec8b8bccf7560ef8ec201d00010101111e1c3f8b8b1e1c3f8b8b0c078df777128d130001010107efef15bd060b");
+
+    QVERIFY(pdf::PDFCFFFontSubsetter::isCFFFontProgram(font));
+    QVERIFY(pdf::PDFCFFFontSubsetter::isCFFFontProgram(cidFont));
+    QVERIFY(!pdf::PDFCFFFontSubsetter::isCFFFontProgram(QByteArray::fromHex("00010000000400800003")));
+    QVERIFY(!pdf::PDFCFFFontSubsetter::isCFFFontProgram(QByteArray("OTTO")));
+
+    // Components of the accented glyphs are always kept, also when accented glyph is in subroutine
+    const QByteArray accentedSubset = pdf::PDFCFFFontSubsetter::createSubset(font, { 6 });
+    QVERIFY(accentedSubset.size() < font.size());
+    QCOMPARE(accentedSubset, pdf::PDFCFFFontSubsetter::createSubset(font, { 2, 5, 6 }));
+    QCOMPARE(pdf::PDFCFFFontSubsetter::createSubset(font, { 7 }), pdf::PDFCFFFontSubsetter::createSubset(font, { 2, 5, 7 }));
+
+    // Subset of the subset with the same glyphs is the same
+    QCOMPARE(pdf::PDFCFFFontSubsetter::createSubset(accentedSubset, { 6 }), accentedSubset);
+
+    // Glyphs are not renumbered, so subset of a single glyph differs from subset of another glyph
+    const QByteArray emptySubset = pdf::PDFCFFFontSubsetter::createSubset(font, { });
+    QVERIFY(emptySubset.size() < pdf::PDFCFFFontSubsetter::createSubset(font, { 3 }).size());
+    QVERIFY(pdf::PDFCFFFontSubsetter::createSubset(font, { 3 }) != pdf::PDFCFFFontSubsetter::createSubset(font, { 4 }));
+
+    // Glyphs of CID-keyed fonts are CIDs, unknown CIDs are ignored
+    const QByteArray cidSubset = pdf::PDFCFFFontSubsetter::createSubset(cidFont, { 10, 40, 999 });
+    QVERIFY(cidSubset.size() < cidFont.size());
+    QCOMPARE(cidSubset, pdf::PDFCFFFontSubsetter::createSubset(cidFont, { 10, 40 }));
+    QCOMPARE(pdf::PDFCFFFontSubsetter::createSubset(cidSubset, { 10, 40 }), cidSubset);
+    QVERIFY(cidSubset != pdf::PDFCFFFontSubsetter::createSubset(cidFont, { 2, 3 }));
+
+    // Invalid font programs can't be subsetted
+    QVERIFY_THROWS_EXCEPTION(pdf::PDFException, pdf::PDFCFFFontSubsetter::createSubset(QByteArray::fromHex("00010000000400800003"), { 1 }));
+    QVERIFY_THROWS_EXCEPTION(pdf::PDFException, pdf::PDFCFFFontSubsetter::createSubset(font.left(font.size() / 2), { 1 }));
+}
+
+void LexicalAnalyzerTest::test_execution_policy()
+{
+    using Policy = pdf::PDFExecutionPolicy;
+    constexpr Policy::Scope scope = Policy::Scope::Unknown;
+
+    const int maxThreadCount = Policy::getMaxThreadCount(scope);
+    Policy::setStrategy(Policy::Strategy::AlwaysMultithreaded);
+    Policy::setMaxThreadCount(scope, 4);
+
+    std::vector<int> values(100000);
+    std::iota(values.begin(), values.end(), 1);
+
+    // Each item is processed exactly once
+    std::atomic<qint64> sum = 0;
+    Policy::execute(scope, values.cbegin(), values.cend(), [&sum](int value) { sum += value; });
+    QCOMPARE(sum.load(), qint64(values.size()) * qint64(values.size() + 1) / 2);
+
+    // Parallel sort gives the same result as sequential sort
+    std::vector<int> shuffled(values.size());
+    for (size_t i = 0; i < shuffled.size(); ++i)
+    {
+        shuffled[i] = int((i * 7919) % shuffled.size());
+    }
+    std::vector<int> sorted = shuffled;
+    std::sort(sorted.begin(), sorted.end(), std::greater<int>());
+    Policy::sort(scope, shuffled.begin(), shuffled.end(), std::greater<int>());
+    QVERIFY(shuffled == sorted);
+
+    // Partial results are reduced in order, so non-commutative operation can be used
+    QCOMPARE(Policy::reduce(scope, values.cbegin(), values.cend(), qint64(0), std::plus<qint64>()), sum.load());
+    auto concatenate = [](QByteArray left, const QByteArray& right) { return left + right; };
+    auto toString = [](int value) { return QByteArray::number(value % 10); };
+    QByteArray expected;
+    for (int value : values)
+    {
+        expected += toString(value);
+    }
+    QCOMPARE(Policy::transformReduce(scope, values.cbegin(), values.cend(), QByteArray(), concatenate, toString), expected);
+    QCOMPARE(Policy::reduce(scope, values.cend(), values.cend(), qint64(42), std::plus<qint64>()), qint64(42));
+
+    // Exception from the worker task is rethrown in the calling thread
+    auto throwException = [](int value)
+    {
+        if (value == 5000)
+        {
+            throw pdf::PDFException("Worker exception");
+        }
+    };
+    QVERIFY_THROWS_EXCEPTION(pdf::PDFException, Policy::execute(scope, values.cbegin(), values.cend(), throwException));
+
+    // Nested parallel calls must not block threads of the scheduler
+    std::atomic<qint64> nestedSum = 0;
+    std::vector<int> outerValues(32, 0);
+    auto processOuterValue = [&](int)
+    {
+        Policy::execute(scope, values.cbegin(), values.cbegin() + 1000, [&nestedSum](int value) { nestedSum += value; });
+    };
+    Policy::execute(scope, outerValues.cbegin(), outerValues.cend(), processOuterValue);
+    QCOMPARE(nestedSum.load(), qint64(outerValues.size()) * 1000 * 1001 / 2);
+
+    // Thread waiting for its job doesn't execute tasks of unrelated jobs
+    std::atomic<bool> unrelatedJobRunning = true;
+    std::atomic<int> unrelatedChunksOnCallingThread = 0;
+    QThread* const callingThread = QThread::currentThread();
+    QThread* unrelatedThread = QThread::create([&]()
+    {
+        std::vector<int> unrelatedValues(256, 0);
+        Policy::execute(scope, unrelatedValues.cbegin(), unrelatedValues.cend(), [&](int)
+        {
+            if (QThread::currentThread() == callingThread)
+            {
+                ++unrelatedChunksOnCallingThread;
+            }
+            QThread::usleep(200);
+        });
+        unrelatedJobRunning = false;
+    });
+    unrelatedThread->start();
+    while (unrelatedJobRunning)
+    {
+        Policy::execute(scope, outerValues.cbegin(), outerValues.cend(), [](int) { QThread::usleep(50); });
+    }
+    unrelatedThread->wait();
+    delete unrelatedThread;
+    QCOMPARE(unrelatedChunksOnCallingThread.load(), 0);
+
+    Policy::setMaxThreadCount(scope, maxThreadCount);
+    Policy::setStrategy(Policy::Strategy::PageMultithreaded);
+}
+
+void LexicalAnalyzerTest::test_flate_predictor_data_source()
+{
+    // Create rows encoded by the PNG Up predictor
+    constexpr int columns = 37;
+    constexpr int rows = 500;
+
+    QByteArray encodedRows;
+    QByteArray expectedData;
+    QByteArray previousRow(columns, 0);
+    for (int row = 0; row < rows; ++row)
+    {
+        QByteArray currentRow(columns, 0);
+        encodedRows.append(char(2));
+        for (int column = 0; column < columns; ++column)
+        {
+            const char difference = char((row * 7 + column * 13) % 5);
+            currentRow[column] = char(previousRow[column] + difference);
+            encodedRows.append(difference);
+        }
+        expectedData.append(currentRow);
+        previousRow = currentRow;
+    }
+
+    // Missing bytes of the incomplete row are treated as zeros, so with
+    // the Up predictor, they are the same as in the previous row.
+    const int missingBytes = columns / 2;
+    encodedRows.chop(missingBytes);
+    for (int column = columns - missingBytes; column < columns; ++column)
+    {
+        expectedData[(rows - 1) * columns + column] = expectedData[(rows - 2) * columns + column];
+    }
+
+    pdf::PDFDictionary decodeParameters;
+    decodeParameters.setEntry(pdf::PDFInplaceOrMemoryString("Predictor"), pdf::PDFObject::createInteger(12));
+    decodeParameters.setEntry(pdf::PDFInplaceOrMemoryString("Columns"), pdf::PDFObject::createInteger(columns));
+
+    pdf::PDFDictionary dictionary;
+    dictionary.setEntry(pdf::PDFInplaceOrMemoryString(pdf::PDF_STREAM_DICT_FILTER), pdf::PDFObject::createName("FlateDecode"));
+    dictionary.setEntry(pdf::PDFInplaceOrMemoryString(pdf::PDF_STREAM_DICT_DECODE_PARMS), pdf::PDFObject::createDictionary(std::make_shared<pdf::PDFDictionary>(qMove(decodeParameters))));
+    pdf::PDFStream stream(qMove(dictionary), pdf::PDFFlateDecodeFilter::compress(encodedRows));
+
+    QCOMPARE(pdf::PDFStreamFilterStorage::getDecodedStream(&stream, nullptr), expectedData);
+
+    // Read decoded data incrementally, in small chunks
+    pdf::PDFStreamDataSourcePointer dataSource = pdf::PDFStreamFilterStorage::createDecodedStreamDataSource(&stream, [](const pdf::PDFObject& object) -> const pdf::PDFObject& { return object; }, nullptr);
+    QVERIFY(dataSource);
+
+    QByteArray decodedData;
+    char buffer[11] = { };
+    while (const pdf::PDFInteger bytesRead = dataSource->read(buffer, pdf::PDFInteger(sizeof(buffer))))
+    {
+        decodedData.append(buffer, bytesRead);
+    }
+    QCOMPARE(decodedData, expectedData);
+}
+
+void LexicalAnalyzerTest::test_token_views()
+{
+    using Type = pdf::PDFLexicalAnalyzer::TokenType;
+
+    QByteArray content("/Name /A#42 (Text) (Escaped\\n) 12 -3.5 re");
+    pdf::PDFLexicalAnalyzer analyzer(content.constData(), content.constData() + content.size());
+
+    pdf::PDFLexicalAnalyzer::Token name = analyzer.fetch();
+    pdf::PDFLexicalAnalyzer::Token escapedName = analyzer.fetch();
+    pdf::PDFLexicalAnalyzer::Token string = analyzer.fetch();
+    pdf::PDFLexicalAnalyzer::Token escapedString = analyzer.fetch();
+    pdf::PDFLexicalAnalyzer::Token integer = analyzer.fetch();
+    pdf::PDFLexicalAnalyzer::Token real = analyzer.fetch();
+    pdf::PDFLexicalAnalyzer::Token command = analyzer.fetch();
+
+    // Tokens without escape sequences refer to the source buffer
+    QVERIFY(name.isView());
+    QVERIFY(string.isView());
+    QVERIFY(command.isView());
+    QVERIFY(!escapedName.isView());
+    QVERIFY(!escapedString.isView());
+    QVERIFY(name.getStringView().data() == content.constData() + 1);
+
+    QCOMPARE(name.getStringView(), QByteArrayView("Name"));
+    QCOMPARE(escapedName.getString(), QByteArray("AB"));
+    QCOMPARE(string.getString(), QByteArray("Text"));
+    QCOMPARE(escapedString.getString(), QByteArray("Escaped\n"));
+    QCOMPARE(integer.getInteger(), pdf::PDFInteger(12));
+    QCOMPARE(integer.getReal(), 12.0);
+    QCOMPARE(real.getReal(), -3.5);
+    QCOMPARE(command.getStringView(), QByteArrayView("re"));
+    QVERIFY(command == pdf::PDFLexicalAnalyzer::Token(Type::Command, QByteArray("re")));
+
+    // Detached token must not refer to the source buffer
+    command.detach();
+    content.fill('x');
+    QVERIFY(!command.isView());
+    QCOMPARE(command.getString(), QByteArray("re"));
+}
+
+void LexicalAnalyzerTest::test_content_stream_bytecode()
+{
+    using Type = pdf::PDFContentStreamBytecode::InstructionType;
+
+    pdf::PDFContentStreamBytecode bytecode = pdf::PDFContentStreamBytecode::compile("1 0 0 RG 10 20 m /F1 12 Tf ) 7 w [(A) 5 (B)] TJ 3 4", nullptr);
+    const pdf::PDFContentStreamBytecode::Instructions& instructions = bytecode.getInstructions();
+
+    const std::vector<std::pair<Type, uint32_t>> expectedInstructions = { { Type::Command, 3 }, { Type::Command, 2 }, { Type::Command, 2 }, { Type::Error, 0 }, { Type::Command, 1 }, { Type::Command, 5 }, { Type::Operands, 2 } };
+    QCOMPARE(instructions.size(), expectedInstructions.size());
+
+    for (size_t i = 0; i < instructions.size(); ++i)
+    {
+        QCOMPARE(instructions[i].type, expectedInstructions[i].first);
+        QCOMPARE(instructions[i].operandCount, expectedInstructions[i].second);
+    }
+
+    QCOMPARE(bytecode.getCommand(instructions[0]), QByteArrayView("RG"));
+    QCOMPARE(bytecode.getCommand(instructions[2]), QByteArrayView("Tf"));
+    QCOMPARE(bytecode.getCommand(instructions[5]), QByteArrayView("TJ"));
+    QCOMPARE(bytecode.getOperand(instructions[2].firstOperand).getString(), QByteArray("F1"));
+    QCOMPARE(bytecode.getOperand(instructions[4].firstOperand).getInteger(), pdf::PDFInteger(7));
+    QCOMPARE(bytecode.getOperand(instructions[6].firstOperand + 1).getInteger(), pdf::PDFInteger(4));
+    QVERIFY(!bytecode.getError(instructions[3]).isEmpty());
+}
+
+void LexicalAnalyzerTest::test_precompiled_page_cache()
+{
+    auto createPage = []()
+    {
+        pdf::PDFPrecompiledPage page;
+        page.finalize(0, { });
+        return page;
+    };
+
+    const qint64 pageSize = createPage().getMemoryConsumptionEstimate();
+    QVERIFY(pageSize > 0);
+
+    pdf::PDFPrecompiledPageCache cache(3 * pageSize);
+    QVERIFY(cache.insert(0, createPage()));
+    QVERIFY(cache.insert(1, createPage()));
+    QVERIFY(cache.insert(2, createPage()));
+    QCOMPARE(cache.getCacheSize(), 3 * pageSize);
+
+    // Least recently used page is removed
+    QVERIFY(cache.getPage(0));
+    QVERIFY(cache.insert(3, createPage()));
+    QVERIFY(!cache.contains(1));
+    QVERIFY(!cache.getPage(1));
+    QVERIFY(cache.contains(0));
+
+    // Page is shared, it stays valid, when it is removed from the cache
+    std::shared_ptr<pdf::PDFPrecompiledPage> sharedPage = cache.getPage(3);
+    QVERIFY(sharedPage && sharedPage == cache.getPage(3));
+    cache.remove(3);
+    QCOMPARE(sharedPage->getMemoryConsumptionEstimate(), pageSize);
+    QVERIFY(cache.insert(3, createPage()));
+    QVERIFY(sharedPage != cache.getPage(3));
+
+    // Visible pages are not removed to make space for other pages
+    cache.setVisiblePages({ 2, 3 });
+    QVERIFY(cache.insert(4, createPage()));
+    QVERIFY(!cache.contains(0));
+    QVERIFY(cache.insert(5, createPage()));
+    QVERIFY(!cache.contains(4));
+    QVERIFY(cache.contains(2) && cache.contains(3) && cache.contains(5));
+
+    // Prefetched pages are removed only to make space for prefetched or visible pages
+    cache.setPrefetchedPages({ 5 });
+    QVERIFY(!cache.insert(6, createPage()));
+    QVERIFY(!cache.contains(6));
+    QVERIFY(cache.contains(5));
+
+    cache.setPrefetchedPages({ 5, 7 });
+    QCOMPARE(cache.getPriority(7), pdf::PDFPrecompiledPageCache::Priority::Prefetched);
+    QVERIFY(cache.insert(7, createPage()));
+    QVERIFY(!cache.contains(5));
+    QCOMPARE(cache.getCacheSize(), 3 * pageSize);
+
+    const pdf::PDFPrecompiledPageCache::Statistics& statistics = cache.getStatistics();
+    QCOMPARE(statistics.hits, qint64(4));
+    QCOMPARE(statistics.misses, qint64(1));
+    QCOMPARE(statistics.evictions, qint64(4));
+    QCOMPARE(statistics.rejections, qint64(1));
+
+    // Cache limit is a hard limit, even visible pages are removed
+    cache.setCacheLimit(pageSize);
+    QCOMPARE(cache.getPageCount(), size_t(1));
+    QVERIFY(cache.contains(3));
+    QCOMPARE(cache.getCacheSize(), pageSize);
+
+    cache.setCacheLimit(pageSize - 1);
+    QCOMPARE(cache.getPageCount(), size_t(0));
+    QCOMPARE(cache.getCacheSize(), qint64(0));
+    QVERIFY(!cache.insert(3, createPage()));
+}
+
+void LexicalAnalyzerTest::test_page_tile_cache()
+{
+    constexpr int tileSize = pdf::PDFPageTileCache::TILE_SIZE;
+    constexpr qint64 tileBytes = tileSize * tileSize * 4;
+
+    // Black square in the first tile
+    QPainterPath path;
+    path.addRect(100, 100, 200, 200);
+
+    std::shared_ptr<pdf::PDFPrecompiledPage> compiledPage = std::make_shared<pdf::PDFPrecompiledPage>();
+    compiledPage->addPath(QPen(Qt::NoPen), QBrush(Qt::black), path, false);
+    compiledPage->finalize(0, { });
+
+    const QRect placedRect(0, 0, 2 * tileSize, 2 * tileSize);
+    const QRectF cropBox(placedRect);
+    const QRect visibleRect(0, 0, 600, 600);
+    const pdf::PDFRenderer::Features features = pdf::PDFRenderer::None;
+
+    pdf::PDFPageTileCache cache;
+    QImage image(visibleRect.size(), QImage::Format_ARGB32_Premultiplied);
+
+    auto drawPage = [&](QColor paperColor, pdf::PDFReal opacity)
+    {
+        image.fill(Qt::red);
+        QPainter painter(&image);
+        cache.drawPage(&painter, 0, cropBox, compiledPage, QTransform(), placedRect, visibleRect, features, paperColor, true, opacity);
+        painter.end();
+    };
+
+    // Tiles are rendered asynchronously, nothing is drawn until they are finished
+    drawPage(Qt::white, 1.0);
+    QCOMPARE(image.pixel(50, 50), QColor(Qt::red).rgb());
+    cache.waitForFinished();
+    QCOMPARE(cache.getCacheSize(), 4 * tileBytes);
+
+    drawPage(Qt::white, 1.0);
+    QCOMPARE(image.pixel(50, 50), QColor(Qt::white).rgb());
+    QCOMPARE(image.pixel(150, 150), QColor(Qt::black).rgb());
+    QCOMPARE(image.pixel(550, 550), QColor(Qt::white).rgb());
+
+    // Paper color is part of the key
+    drawPage(Qt::yellow, 1.0);
+    QCOMPARE(image.pixel(50, 50), QColor(Qt::red).rgb());
+    cache.waitForFinished();
+    QCOMPARE(cache.getCacheSize(), 8 * tileBytes);
+    drawPage(Qt::yellow, 1.0);
+    QCOMPARE(image.pixel(50, 50), QColor(Qt::yellow).rgb());
+
+    // Opacity is applied to page graphics only, paper is opaque
+    drawPage(Qt::white, 0.5);
+    cache.waitForFinished();
+    drawPage(Qt::white, 0.5);
+    QCOMPARE(image.pixel(50, 50), QColor(Qt::white).rgb());
+    QVERIFY(qAbs(qGray(image.pixel(150, 150)) - 128) <= 2);
+    QCOMPARE(qRed(image.pixel(150, 150)), qGreen(image.pixel(150, 150)));
+
+    // Tiles rendered from the old page contents are discarded
+    cache.removePages({ 0 });
+    QCOMPARE(cache.getCacheSize(), qint64(0));
+    drawPage(Qt::white, 1.0);
+    cache.removePages({ 0 });
+    cache.waitForFinished();
+    QCOMPARE(cache.getCacheSize(), qint64(0));
+
+    drawPage(Qt::white, 1.0);
+    cache.waitForFinished();
+    QCOMPARE(cache.getCacheSize(), 4 * tileBytes);
+    cache.setCacheLimit(tileBytes);
+    QCOMPARE(cache.getCacheSize(), tileBytes);
+    cache.clear();
+    QCOMPARE(cache.getCacheSize(), qint64(0));
+
+    // Page is shared with the tile renderer, so it can be released while tiles are rendered
+    drawPage(Qt::white, 1.0);
+    compiledPage.reset();
+    cache.waitForFinished();
+    QCOMPARE(cache.getCacheSize(), tileBytes);
+}
+
+void LexicalAnalyzerTest::test_precompiled_page_culling()
+{
+    pdf::PDFPrecompiledPage page;
+
+    auto addSquare = [&page](qreal x, qreal y, qreal size, QColor color)
+    {
+        QPainterPath path;
+        path.addRect(x, y, size, size);
+        page.addPath(QPen(Qt::NoPen), QBrush(color), path, false);
+    };
+
+    auto addFarSquares = [&addSquare](int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            addSquare(300 + (i % 10) * 9, 300 + (i / 10) * 9, 6, Qt::darkGreen);
+        }
+    };
+
+    page.addSetWorldMatrix(QTransform());
+
+    // Grid of squares over the whole page
+    for (int i = 0; i < 100; ++i)
+    {
+        addSquare((i % 10) * 40, (i / 10) * 40, 30, (i % 3) ? Qt::black : Qt::blue);
+    }
+
+    // Invisible nodes change world matrix and composition mode
+    addFarSquares(40);
+    page.addSetWorldMatrix(QTransform::fromTranslate(-5, -5));
+    page.addSetCompositionMode(QPainter::CompositionMode_Difference);
+    addFarSquares(40);
+
+    // Invisible save/restore pair doesn't change the state
+    page.addSaveGraphicState();
+    page.addSetWorldMatrix(QTransform::fromTranslate(1000, 1000));
+    page.addSetCompositionMode(QPainter::CompositionMode_Source);
+    addFarSquares(20);
+    page.addRestoreGraphicState();
+
+    for (int i = 0; i < 10; ++i)
+    {
+        addSquare(10 + i * 12, 100, 8, Qt::red);
+    }
+
+    // Unbalanced restore and save
+    page.addRestoreGraphicState();
+    page.addSetWorldMatrix(QTransform::fromTranslate(3, 7));
+    addFarSquares(40);
+    addSquare(100, 20, 40, Qt::magenta);
+    page.addSaveGraphicState();
+    addFarSquares(20);
+    page.addSetCompositionMode(QPainter::CompositionMode_Difference);
+    addSquare(60, 20, 50, Qt::yellow);
+    page.finalize(0, { });
+
+    const QRectF cropBox(0, 0, 400, 400);
+    const QRect clipRect(0, 0, 150, 150);
+
+    auto drawPage = [&](bool clip)
+    {
+        QImage image(400, 400, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::white);
+
+        QPainter painter(&image);
+        if (clip)
+        {
+            painter.setClipRect(clipRect);
+        }
+        page.draw(&painter, cropBox, QTransform(), pdf::PDFRenderer::None, 1.0);
+        painter.end();
+
+        return image.copy(clipRect);
+    };
+
+    const QImage fullImage = drawPage(false);
+    const QImage culledImage = drawPage(true);
+    QVERIFY(fullImage == culledImage);
+
+    // Matrix and composition mode set in invisible nodes are applied
+    QCOMPARE(fullImage.pixel(33, 98), QColor(Qt::cyan).rgb());
+    QCOMPARE(fullImage.pixel(130, 50), QColor(Qt::magenta).rgb());
+}
+
+void LexicalAnalyzerTest::test_image_pyramid()
+{
+    QImage image(1000, 500, QImage::Format_RGB32);
+    image.fill(Qt::red);
+
+    const pdf::PDFImagePyramid pyramid = pdf::PDFImagePyramid::create(image);
+    QVERIFY(!pyramid.isEmpty());
+    QVERIFY(!pyramid.isReduced());
+    QCOMPARE(pyramid.getLevels().size(), size_t(5));
+    QCOMPARE(pyramid.getImage().size(), QSize(1000, 500));
+    QCOMPARE(pyramid.getImage().format(), QImage::Format_ARGB32_Premultiplied);
+    QCOMPARE(pyramid.getLevels().back().size(), QSize(62, 31));
+
+    // Smallest level, which is not smaller than the image on the device, is selected
+    QCOMPARE(pyramid.getImage(QTransform::fromScale(1000, 500)).size(), QSize(1000, 500));
+    QCOMPARE(pyramid.getImage(QTransform::fromScale(400, 200)).size(), QSize(500, 250));
+    QCOMPARE(pyramid.getImage(QTransform::fromScale(250, 125)).size(), QSize(250, 125));
+    QCOMPARE(pyramid.getImage(QTransform::fromScale(251, 10)).size(), QSize(500, 250));
+    QCOMPARE(pyramid.getImage(QTransform::fromScale(10, 10)).size(), QSize(62, 31));
+    QCOMPARE(pyramid.getImage(QTransform::fromScale(2000, 1000)).size(), QSize(1000, 500));
+    QCOMPARE(pyramid.getImage(QTransform::fromScale(300, -100)).size(), QSize(500, 250));
+    QCOMPARE(pyramid.getImage(QTransform().rotate(90).scale(300, 100)).size(), QSize(500, 250));
+
+    // Full resolution image is sufficient for any resolution
+    QVERIFY(std::isinf(pyramid.getResolutionLimit(QTransform::fromScale(100, 50))));
+
+    const pdf::PDFImagePyramid reducedPyramid = pdf::PDFImagePyramid::create(image, true);
+    QVERIFY(reducedPyramid.isReduced());
+    QCOMPARE(reducedPyramid.getResolutionLimit(QTransform::fromScale(100, 50)), 10.0);
+    QCOMPARE(reducedPyramid.getResolutionLimit(QTransform::fromScale(100, 100)), 5.0);
+
+    // Reduce level of the decoded image
+    QCOMPARE(pdf::PDFImagePyramid::getReduceLevel(QSize(4000, 2000), QTransform::fromScale(4000, 2000)), 0);
+    QCOMPARE(pdf::PDFImagePyramid::getReduceLevel(QSize(4000, 2000), QTransform::fromScale(2001, 100)), 0);
+    QCOMPARE(pdf::PDFImagePyramid::getReduceLevel(QSize(4000, 2000), QTransform::fromScale(2000, 1000)), 1);
+    QCOMPARE(pdf::PDFImagePyramid::getReduceLevel(QSize(4000, 2000), QTransform::fromScale(1000, 500)), 2);
+    QCOMPARE(pdf::PDFImagePyramid::getReduceLevel(QSize(4000, 2000), QTransform::fromScale(1, 1)), 5);
+    QCOMPARE(pdf::PDFImagePyramid::getReduceLevel(QSize(100, 100), QTransform::fromScale(1, 1)), 1);
+    QCOMPARE(pdf::PDFImagePyramid::getReduceLevel(QSize(64, 64), QTransform::fromScale(1, 1)), 0);
+}
+
+void LexicalAnalyzerTest::test_image_cache()
+{
+    auto createPyramid = []()
+    {
+        QImage image(100, 100, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::blue);
+        return pdf::PDFImagePyramid::create(image);
+    };
+
+    auto createKey = [](pdf::PDFInteger objectNumber)
+    {
+        pdf::PDFImageCache::Key key;
+        key.reference = pdf::PDFObjectReference(objectNumber, 0);
+        return key;
+    };
+
+    pdf::PDFStream stream;
+    pdf::PDFStream otherStream;
+    const qint64 imageSize = createPyramid().getMemoryConsumptionEstimate();
+
+    pdf::PDFImageCache cache(3 * imageSize);
+    QVERIFY(cache.getImage(createKey(1), &stream).isEmpty());
+
+    cache.insert(createKey(1), &stream, createPyramid());
+    cache.insert(createKey(2), &stream, createPyramid());
+    cache.insert(createKey(3), &stream, createPyramid());
+    QCOMPARE(cache.getCacheSize(), 3 * imageSize);
+
+    // Image of different stream with the same key is not returned
+    QVERIFY(cache.getImage(createKey(1), &otherStream).isEmpty());
+
+    // Access of image 1 makes image 2 least recently used
+    QVERIFY(!cache.getImage(createKey(1), &stream).isEmpty());
+    cache.insert(createKey(4), &stream, createPyramid());
+    QCOMPARE(cache.getCacheSize(), 3 * imageSize);
+    QVERIFY(cache.getImage(createKey(2), &stream).isEmpty());
+    QVERIFY(!cache.getImage(createKey(1), &stream).isEmpty());
+    QVERIFY(!cache.getImage(createKey(3), &stream).isEmpty());
+    QVERIFY(!cache.getImage(createKey(4), &stream).isEmpty());
+
+    // Key also contains color management settings
+    pdf::PDFImageCache::Key otherKey = createKey(1);
+    otherKey.cmsIdentifier = 1;
+    QVERIFY(cache.getImage(otherKey, &stream).isEmpty());
+
+    // Inserting image with the same key replaces the old image
+    QImage reducedImage(100, 100, QImage::Format_ARGB32_Premultiplied);
+    reducedImage.fill(Qt::green);
+    cache.insert(createKey(1), &stream, pdf::PDFImagePyramid::create(reducedImage, true));
+    QVERIFY(cache.getImage(createKey(1), &stream).isReduced());
+    QCOMPARE(cache.getCacheSize(), 3 * imageSize);
+
+    // Image larger than the cache limit is not inserted
+    QImage largeImage(1000, 1000, QImage::Format_ARGB32_Premultiplied);
+    largeImage.fill(Qt::white);
+    cache.insert(createKey(5), &stream, pdf::PDFImagePyramid::create(largeImage));
+    QVERIFY(cache.getImage(createKey(5), &stream).isEmpty());
+    QVERIFY(!cache.getImage(createKey(1), &stream).isEmpty());
+
+    // Lowering the cache limit removes least recently used images
+    cache.insert(createKey(2), &stream, createPyramid());
+    cache.setCacheLimit(imageSize);
+    QCOMPARE(cache.getCacheSize(), imageSize);
+    QVERIFY(!cache.getImage(createKey(2), &stream).isEmpty());
+
+    cache.clear();
+    QCOMPARE(cache.getCacheSize(), qint64(0));
+    QVERIFY(cache.getImage(createKey(2), &stream).isEmpty());
+}
+
+void LexicalAnalyzerTest::test_glyph_atlas()
+{
+    auto createGlyph = [](QTransform matrix, QRectF rect)
+    {
+        QPainterPath outline;
+        outline.addRect(rect);
+        return pdf::PDFAtlasGlyph::create(outline, matrix, 10.0, pdf::PDFAtlasGlyphId::create(outline));
+    };
+
+    QImage image(200, 200, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);
+    QPainter painter(&image);
+
+    pdf::PDFGlyphAtlas atlas;
+    const pdf::PDFAtlasGlyph glyph = createGlyph(QTransform(), QRectF(0.0, -7.0, 5.0, 7.0));
+    QVERIFY(atlas.drawGlyph(&painter, glyph, Qt::black, true));
+    const qint64 glyphSize = atlas.getCacheSize();
+    QVERIFY(glyphSize > 0);
+
+    // Glyph on other pixel position, and glyph with nearly the same size, uses the same entry
+    QVERIFY(atlas.drawGlyph(&painter, createGlyph(QTransform::fromTranslate(20.0, 20.0), QRectF(0.0, -7.0, 5.0, 7.0)), Qt::black, true));
+    QVERIFY(atlas.drawGlyph(&painter, createGlyph(QTransform::fromScale(1.01, 1.01), QRectF(0.0, -7.0, 5.0, 7.0)), Qt::black, true));
+    QCOMPARE(atlas.getCacheSize(), glyphSize);
+
+    // Other size bucket creates a new entry, other color uses the same coverage mask
+    QVERIFY(atlas.drawGlyph(&painter, createGlyph(QTransform::fromScale(2.0, 2.0), QRectF(0.0, -7.0, 5.0, 7.0)), Qt::black, true));
+    const qint64 scaledGlyphSize = atlas.getCacheSize() - glyphSize;
+    QVERIFY(scaledGlyphSize > glyphSize);
+    QVERIFY(atlas.drawGlyph(&painter, glyph, Qt::red, true));
+    QCOMPARE(atlas.getCacheSize(), glyphSize + scaledGlyphSize);
+
+    // Coverage mask is tinted by the fill color, also by the semitransparent color
+    QImage tintedImage(20, 20, QImage::Format_ARGB32_Premultiplied);
+    tintedImage.fill(Qt::transparent);
+    QPainter tintedPainter(&tintedImage);
+    QVERIFY(atlas.drawGlyph(&tintedPainter, createGlyph(QTransform::fromTranslate(2.0, 10.0), QRectF(0.0, -7.0, 5.0, 7.0)), Qt::red, true));
+    QVERIFY(atlas.drawGlyph(&tintedPainter, createGlyph(QTransform::fromTranslate(12.0, 10.0), QRectF(0.0, -7.0, 5.0, 7.0)), QColor(0, 0, 255, 128), true));
+    tintedPainter.end();
+    QCOMPARE(tintedImage.pixel(4, 6), QColor(Qt::red).rgba());
+    QCOMPARE(tintedImage.pixel(14, 6), qPremultiply(QColor(0, 0, 255, 128).rgba()));
+    QCOMPARE(tintedImage.pixel(9, 6), qRgba(0, 0, 0, 0));
+    QCOMPARE(atlas.getCacheSize(), glyphSize + scaledGlyphSize);
+
+    // Rotated glyph, and too large glyph, is not drawn by the atlas
+    QTransform rotation;
+    rotation.rotate(30.0);
+    QVERIFY(!atlas.drawGlyph(&painter, createGlyph(rotation, QRectF(0.0, -7.0, 5.0, 7.0)), Qt::black, true));
+    QVERIFY(!atlas.drawGlyph(&painter, createGlyph(QTransform::fromScale(10.0, 10.0), QRectF(0.0, -7.0, 5.0, 7.0)), Qt::black, true));
+    QCOMPARE(atlas.getCacheSize(), glyphSize + scaledGlyphSize);
+
+    // Glyph with colliding hash, but other outline, doesn't replace the entry
+    pdf::PDFAtlasGlyph collidingGlyph = createGlyph(QTransform(), QRectF(0.0, -3.0, 2.0, 3.0));
+    collidingGlyph.id.hash = glyph.id.hash;
+    QVERIFY(atlas.drawGlyph(&painter, collidingGlyph, Qt::black, true));
+    QCOMPARE(atlas.getCacheSize(), glyphSize + scaledGlyphSize);
+
+    // Lowering the cache limit removes least recently used glyphs, scaled
+    // glyph is removed, because unscaled glyph was used last.
+    QVERIFY(atlas.drawGlyph(&painter, glyph, Qt::black, true));
+    atlas.setCacheLimit(glyphSize);
+    QCOMPARE(atlas.getCacheSize(), glyphSize);
+    QVERIFY(atlas.drawGlyph(&painter, glyph, Qt::black, true));
+    QCOMPARE(atlas.getCacheSize(), glyphSize);
+
+    atlas.clear();
+    QCOMPARE(atlas.getCacheSize(), qint64(0));
+}
+
+void LexicalAnalyzerTest::test_image_color_conversion()
+{
+    pdf::PDFCMSGeneric cms;
+    pdf::PDFRenderErrorReporterDummy reporter;
+
+    // Image is big enough to use per-component tables also for 8-bit CMYK images
+    const unsigned int width = 257;
+    const unsigned int height = 256;
+
+    auto createData = [](unsigned int size, quint32 seed)
+    {
+        QByteArray data(size, 0);
+        for (char& value : data)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            value = char(seed >> 24);
+        }
+        return data;
+    };
+
+    auto readSample = [](const QByteArray& data, size_t bitOffset, unsigned int bitsPerComponent)
+    {
+        unsigned int value = 0;
+        for (unsigned int i = 0; i < bitsPerComponent; ++i, ++bitOffset)
+        {
+            const unsigned char byte = data[int(bitOffset / 8)];
+            value = (value << 1) | ((byte >> (7 - bitOffset % 8)) & 1);
+        }
+        return value;
+    };
+
+    // Compares image with colors transformed one by one using the color space
+    auto checkImage = [&](const pdf::PDFAbstractColorSpace* colorSpace, unsigned int bitsPerComponent, std::vector<pdf::PDFReal> decode, bool isIndexed)
+    {
+        const unsigned int componentCount = static_cast<unsigned int>(colorSpace->getColorComponentCount());
+        const unsigned int stride = (width * componentCount * bitsPerComponent + 7) / 8;
+        const QByteArray data = createData(stride * height, bitsPerComponent * 31 + componentCount);
+        const double max = (1 << bitsPerComponent) - 1;
+
+        pdf::PDFImageData imageData(componentCount, bitsPerComponent, width, height, stride, pdf::PDFImageData::MaskingType::None, data, { }, std::vector<pdf::PDFReal>(decode), { });
+        QImage image = colorSpace->getImage(imageData, pdf::PDFImageData(), &cms, pdf::RenderingIntent::Perceptual, &reporter, nullptr);
+        QCOMPARE(image.size(), QSize(width, height));
+        image = image.convertToFormat(QImage::Format_RGB888);
+
+        pdf::PDFColor color;
+        color.resize(componentCount);
+
+        for (unsigned int i = 0; i < height; ++i)
+        {
+            const unsigned char* line = image.constScanLine(i);
+            size_t bitOffset = size_t(i) * stride * 8;
+
+            for (unsigned int j = 0; j < width; ++j)
+            {
+                for (unsigned int k = 0; k < componentCount; ++k)
+                {
+                    const unsigned int value = readSample(data, bitOffset, bitsPerComponent);
+                    bitOffset += bitsPerComponent;
+
+                    if (isIndexed)
+                    {
+                        color[k] = value;
+                    }
+                    else if (!decode.empty())
+                    {
+                        color[k] = pdf::interpolate(value, 0.0, max, decode[2 * k], decode[2 * k + 1]);
+                    }
+                    else
+                    {
+                        color[k] = value * (1.0 / max);
+                    }
+                }
+
+                const QRgb rgb = colorSpace->getColor(color, &cms, pdf::RenderingIntent::Perceptual, &reporter, !isIndexed).rgb();
+                const unsigned char* pixel = line + 3 * j;
+                if (pixel[0] != qRed(rgb) || pixel[1] != qGreen(rgb) || pixel[2] != qBlue(rgb))
+                {
+                    QFAIL(qPrintable(QString("Pixel (%1, %2) differs, bpc = %3, components = %4.").arg(j).arg(i).arg(bitsPerComponent).arg(componentCount)));
+                }
+            }
+        }
+    };
+
+    pdf::PDFColorSpacePointer gray(new pdf::PDFDeviceGrayColorSpace());
+    pdf::PDFColorSpacePointer rgb(new pdf::PDFDeviceRGBColorSpace());
+    pdf::PDFColorSpacePointer cmyk(new pdf::PDFDeviceCMYKColorSpace());
+
+    for (unsigned int bitsPerComponent : { 1, 2, 4, 8 })
+    {
+        for (const pdf::PDFColorSpacePointer& colorSpace : { gray, rgb, cmyk })
+        {
+            const size_t componentCount = colorSpace->getColorComponentCount();
+
+            // Without decode array, with inverting decode array and with decode array out of range
+            std::vector<pdf::PDFReal> invertingDecode;
+            std::vector<pdf::PDFReal> rangeDecode;
+            for (size_t k = 0; k < componentCount; ++k)
+            {
+                invertingDecode.insert(invertingDecode.end(), { 1.0, 0.0 });
+                rangeDecode.insert(rangeDecode.end(), { -0.25, 0.2 + 0.3 * k });
+            }
+
+            checkImage(colorSpace.data(), bitsPerComponent, { }, false);
+            checkImage(colorSpace.data(), bitsPerComponent, invertingDecode, false);
+            checkImage(colorSpace.data(), bitsPerComponent, rangeDecode, false);
+        }
+
+        // Indexed color space with fewer colors than sample values
+        const int maxValue = std::max((1 << bitsPerComponent) - 2, 0);
+        QByteArray colors = createData((maxValue + 1) * 3, bitsPerComponent);
+        pdf::PDFIndexedColorSpace indexed(rgb, qMove(colors), maxValue);
+        checkImage(&indexed, bitsPerComponent, { }, true);
+    }
+}
+
+void LexicalAnalyzerTest::test_content_operator_lookup()
+{
+    using Operator = pdf::PDFPageContentProcessor::Operator;
+
+    const std::pair<const char*, Operator> operators[] =
+    {
+        { "w", Operator::SetLineWidth },
+        { "J", Operator::SetLineCap },
+        { "j", Operator::SetLineJoin },
+        { "M", Operator::SetMitterLimit },
+        { "d", Operator::SetLineDashPattern },
+        { "ri", Operator::SetRenderingIntent },
+        { "i", Operator::SetFlatness },
+        { "gs", Operator::SetGraphicState },
+        { "q", Operator::SaveGraphicState },
+        { "Q", Operator::RestoreGraphicState },
+        { "cm", Operator::AdjustCurrentTransformationMatrix },
+        { "m", Operator::MoveCurrentPoint },
+        { "l", Operator::LineTo },
+        { "c", Operator::Bezier123To },
+        { "v", Operator::Bezier23To },
+        { "y", Operator::Bezier13To },
+        { "h", Operator::EndSubpath },
+        { "re", Operator::Rectangle },
+        { "S", Operator::PathStroke },
+        { "s", Operator::PathCloseStroke },
+        { "f", Operator::PathFillWinding },
+        { "F", Operator::PathFillWinding2 },
+        { "f*", Operator::PathFillEvenOdd },
+        { "B", Operator::PathFillStrokeWinding },
+        { "B*", Operator::PathFillStrokeEvenOdd },
+        { "b", Operator::PathCloseFillStrokeWinding },
+        { "b*", Operator::PathCloseFillStrokeEvenOdd },
+        { "n", Operator::PathClear },
+        { "W", Operator::ClipWinding },
+        { "W*", Operator::ClipEvenOdd },
+        { "BT", Operator::TextBegin },
+        { "ET", Operator::TextEnd },
+        { "Tc", Operator::TextSetCharacterSpacing },
+        { "Tw", Operator::TextSetWordSpacing },
+        { "Tz", Operator::TextSetHorizontalScale },
+        { "TL", Operator::TextSetLeading },
+        { "Tf", Operator::TextSetFontAndFontSize },
+        { "Tr", Operator::TextSetRenderMode },
+        { "Ts", Operator::TextSetRise },
+        { "Td", Operator::TextMoveByOffset },
+        { "TD", Operator::TextSetLeadingAndMoveByOffset },
+        { "Tm", Operator::TextSetMatrix },
+        { "T*", Operator::TextMoveByLeading },
+        { "Tj", Operator::TextShowTextString },
+        { "TJ", Operator::TextShowTextIndividualSpacing },
+        { "'", Operator::TextNextLineShowText },
+        { "\"", Operator::TextSetSpacingAndShowText },
+        { "d0", Operator::Type3FontSetOffset },
+        { "d1", Operator::Type3FontSetOffsetAndBB },
+        { "CS", Operator::ColorSetStrokingColorSpace },
+        { "cs", Operator::ColorSetFillingColorSpace },
+        { "SC", Operator::ColorSetStrokingColor },
+        { "SCN", Operator::ColorSetStrokingColorN },
+        { "sc", Operator::ColorSetFillingColor },
+        { "scn", Operator::ColorSetFillingColorN },
+        { "G", Operator::ColorSetDeviceGrayStroking },
+        { "g", Operator::ColorSetDeviceGrayFilling },
+        { "RG", Operator::ColorSetDeviceRGBStroking },
+        { "rg", Operator::ColorSetDeviceRGBFilling },
+        { "K", Operator::ColorSetDeviceCMYKStroking },
+        { "k", Operator::ColorSetDeviceCMYKFilling },
+        { "sh", Operator::ShadingPaintShape },
+        { "BI", Operator::InlineImageBegin },
+        { "ID", Operator::InlineImageData },
+        { "EI", Operator::InlineImageEnd },
+        { "Do", Operator::PaintXObject },
+        { "MP", Operator::MarkedContentPoint },
+        { "DP", Operator::MarkedContentPointWithProperties },
+        { "BMC", Operator::MarkedContentBegin },
+        { "BDC", Operator::MarkedContentBeginWithProperties },
+        { "EMC", Operator::MarkedContentEnd },
+        { "BX", Operator::CompatibilityBegin },
+        { "EX", Operator::CompatibilityEnd }
+    };
+
+    // Each operator is found, and each operator has its own name
+    std::set<Operator> foundOperators;
+    for (const auto& [name, op] : operators)
+    {
+        QCOMPARE(pdf::PDFPageContentProcessor::getOperator(name), op);
+        foundOperators.insert(op);
+    }
+    QCOMPARE(foundOperators.size(), size_t(Operator::Invalid));
+
+    // Unknown operators, too long operators and empty operator are invalid
+    for (const char* name : { "", "x", "BTX", "qQ", "Tjj", "BDCX", "EMCEMC", "re ", "sc1" })
+    {
+        QCOMPARE(pdf::PDFPageContentProcessor::getOperator(name), Operator::Invalid);
+    }
+
+    // Operator name is compared including its length
+    QCOMPARE(pdf::PDFPageContentProcessor::getOperator(QByteArrayView("BTX", 2)), Operator::TextBegin);
+    QCOMPARE(pdf::PDFPageContentProcessor::getOperator(QByteArrayView("B\0", 2)), Operator::Invalid);
+    QCOMPARE(pdf::PDFPageContentProcessor::getOperator(QByteArrayView("\0\0\0", 3)), Operator::Invalid);
+}
+
+void LexicalAnalyzerTest::test_color_memo()
+{
+    // Page with named color spaces, colors are set repeatedly
+    pdf::PDFDocumentBuilder builder;
+    const pdf::PDFObjectReference pageReference = builder.appendPage(QRectF(0, 0, 100, 100));
+
+    pdf::PDFObjectFactory resourcesFactory;
+    resourcesFactory.beginDictionary();
+    resourcesFactory.beginDictionaryItem("ColorSpace");
+    resourcesFactory.beginDictionary();
+    resourcesFactory.beginDictionaryItem("CS0");
+    resourcesFactory << pdf::WrapName("DeviceCMYK");
+    resourcesFactory.endDictionaryItem();
+    resourcesFactory.beginDictionaryItem("CS1");
+    resourcesFactory.beginArray();
+    resourcesFactory << pdf::WrapName("Indexed") << pdf::WrapName("DeviceRGB") << 1 << pdf::WrapString(QByteArray::fromHex("FF000000FF00"));
+    resourcesFactory.endArray();
+    resourcesFactory.endDictionaryItem();
+    resourcesFactory.endDictionary();
+    resourcesFactory.endDictionaryItem();
+    resourcesFactory.endDictionary();
+    const pdf::PDFObjectReference resourcesReference = builder.addObject(resourcesFactory.takeObject());
+
+    QByteArray content = "/CS0 cs 0.1 0.2 0.3 0.4 sc 0 0 10 10 re f\n"
+                         "0.1 0.2 0.3 0.4 sc 0 0 10 10 re f\n"
+                         "/CS1 cs 1 sc 0 0 10 10 re f\n"
+                         "/CS0 cs 0.1 0.2 0.3 0.4 sc 0 0 10 10 re f\n"
+                         "0.5 g 0 0 10 10 re f\n"
+                         "0.5 g 0 0 10 10 re f\n"
+                         "/Saturation ri 0.5 g 0 0 10 10 re f\n";
+    pdf::PDFDictionary contentDictionary;
+    contentDictionary.addEntry(pdf::PDFInplaceOrMemoryString("Length"), pdf::PDFObject::createInteger(content.size()));
+    const pdf::PDFObjectReference contentReference = builder.addObject(pdf::PDFObject::createStream(std::make_shared<pdf::PDFStream>(qMove(contentDictionary), qMove(content))));
+
+    pdf::PDFObjectFactory pageFactory;
+    pageFactory.beginDictionary();
+    pageFactory.beginDictionaryItem("Contents");
+    pageFactory << contentReference;
+    pageFactory.endDictionaryItem();
+    pageFactory.beginDictionaryItem("Resources");
+    pageFactory << resourcesReference;
+    pageFactory.endDictionaryItem();
+    pageFactory.endDictionary();
+    builder.mergeTo(pageReference, pageFactory.takeObject());
+
+    pdf::PDFDocument document = builder.build();
+    const pdf::PDFPage* page = document.getCatalog()->getPage(0);
+    QVERIFY(page);
+
+    struct FillColor
+    {
+        pdf::PDFColorSpacePointer colorSpace;
+        pdf::PDFColor color;
+        pdf::RenderingIntent renderingIntent;
+        QColor result;
+    };
+
+    class ColorRecorder : public pdf::PDFPageContentProcessor
+    {
+    public:
+        using pdf::PDFPageContentProcessor::PDFPageContentProcessor;
+
+        std::vector<FillColor> fillColors;
+
+    protected:
+        virtual void performPathPainting(const QPainterPath& path, bool stroke, bool fill, bool text, Qt::FillRule fillRule) override
+        {
+            Q_UNUSED(path);
+            Q_UNUSED(stroke);
+            Q_UNUSED(text);
+            Q_UNUSED(fillRule);
+
+            if (fill)
+            {
+                const PDFPageContentProcessorState* state = getGraphicState();
+                fillColors.push_back({ state->getFillColorSpacePointer(), state->getFillColorOriginal(), state->getRenderingIntent(), state->getFillColor() });
+            }
+        }
+    };
+
+    pdf::PDFCMSGeneric cms;
+    pdf::PDFRenderErrorReporterDummy reporter;
+    ColorRecorder recorder(page, &document, nullptr, &cms, nullptr, QTransform(), pdf::PDFMeshQualitySettings());
+    QVERIFY(recorder.processContents().isEmpty());
+    QCOMPARE(recorder.fillColors.size(), size_t(7));
+
+    // Memoized colors are the same as colors converted by the color space
+    for (const FillColor& fillColor : recorder.fillColors)
+    {
+        QCOMPARE(fillColor.result, fillColor.colorSpace->getColor(fillColor.color, &cms, fillColor.renderingIntent, &reporter, true));
+    }
+    QCOMPARE(recorder.fillColors[2].result.rgb(), qRgb(0, 0xFF, 0));
+    QCOMPARE(recorder.fillColors[6].renderingIntent, pdf::RenderingIntent::Saturation);
+
+    // Named color space is created only once
+    QVERIFY(recorder.fillColors[0].colorSpace == recorder.fillColors[3].colorSpace);
+    QVERIFY(recorder.fillColors[0].colorSpace != recorder.fillColors[2].colorSpace);
+
+    // Repeated colors are taken from the memo (color can be evicted from the memo
+    // by other color only, if it is not repeated immediately)
+    const pdf::PDFPageContentProcessor::ColorConversionStatistics& statistics = recorder.getColorConversionStatistics();
+    QCOMPARE(statistics.memoHits + statistics.memoMisses, qint64(7));
+    QVERIFY(statistics.memoHits >= 2);
+    QVERIFY(statistics.memoMisses >= 4);
+}
+
 void LexicalAnalyzerTest::scanWholeStream(const char* stream)
 {
     pdf::PDFLexicalAnalyzer analyzer(stream, stream + strlen(stream));
@@ -1145,19 +2681,66 @@ QString LexicalAnalyzerTest::getStringFromTokens(const std::vector<pdf::PDFLexic
     {
         QString tokenTypeAsString = metaEnum.valueToKey(static_cast<int>(token.type));
 
-        if (!token.data.isValid())
+        if (!token.hasData())
         {
             stringTokens << tokenTypeAsString;
         }
         else
         {
-            stringTokens << QString("%1(%2)").arg(tokenTypeAsString, token.data.toString());
+            stringTokens << QString("%1(%2)").arg(tokenTypeAsString, token.getData().toString());
         }
     }
 
     return QString("{ %1 }").arg(stringTokens.join(", "));
 }
 
+pdf::PDFDocument LexicalAnalyzerTest::createTestDocument(const std::vector<QRectF>& mediaBoxes)
+{
+    pdf::PDFDocumentBuilder builder;
+    for (const QRectF& mediaBox : mediaBoxes)
+    {
+        builder.appendPage(mediaBox);
+    }
+    return builder.build();
+}
+
+QByteArray LexicalAnalyzerTest::writeToData(const pdf::PDFDocument& document, pdf::PDFDocumentWriter::WriteFlags flags)
+{
+    QBuffer buffer;
+    buffer.open(QBuffer::ReadWrite);
+    pdf::PDFDocumentWriter writer(nullptr);
+    writer.setFlags(flags);
+    if (!writer.write(&buffer, &document))
+    {
+        return QByteArray();
+    }
+    return buffer.data();
+}
+
+std::optional<pdf::PDFDocument> LexicalAnalyzerTest::readFromData(const QByteArray& data, bool lazyLoading)
+{
+    pdf::PDFDocumentReader reader(nullptr, &LexicalAnalyzerTest::getNoPassword, false, false);
+    reader.setLazyLoading(lazyLoading);
+    pdf::PDFDocument document = reader.readFromBuffer(data);
+    if (reader.getReadingResult() != pdf::PDFDocumentReader::Result::OK)
+    {
+        return std::nullopt;
+    }
+    return document;
+}
+
+QString LexicalAnalyzerTest::getNoPassword(bool* ok)
+{
+    *ok = false;
+    return QString();
+}
+
+pdf::PDFByteRangeSourcePointer LexicalAnalyzerTest::createRangeSource(const QByteArray& data)
+{
+    auto readFunction = [data](pdf::PDFInteger offset, pdf::PDFInteger length) { return data.mid(offset, length); };
+    return std::make_shared<pdf::PDFCallbackRangeSource>(data.size(), readFunction);
+}
+
 #ifdef PDF4QT_COMPILER_MSVC
 #pragma warning(pop)
 #endif